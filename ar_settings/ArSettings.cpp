@@ -1,4 +1,11 @@
 #include "ArSettings.h"
+#include "DepthProc.h"
+#include "Recorder.h"
+#include "Compositor.h"
+#include "SceneMirror.h"
+#include "ViewGraph.h"
+#include "CalibEngine.h"
+#include "IcpEngine.h"
 #include "../optitrk/optitrack.h"
 #include "../aruco_marker/aruco_armarker.h"
 
@@ -7,6 +14,8 @@
 #include <thread>
 #include <atomic>
 #include <mutex>
+#include <ctime>
+#include <librealsense2/hpp/rs_internal.hpp>
 #include "VisMtvApi.h"
 
 using namespace std;
@@ -60,6 +69,20 @@ namespace rs_settings
 
 	glm::fmat4x4 mat_ircs2irss, mat_irss2ircs;
 
+	// replay (InitializeRealsenseReplay) : the recorded color frames come out of a software device
+#define REPLAY_SLOTS 4
+#define REPLAY_MAX_IN_FLIGHT 2 // FAST : one frame held by the consumer, one in the queue
+	bool _is_replay = false;
+	session_reader replay_reader;
+	rs2::software_device* _replay_dev = NULL;
+	rs2::software_sensor* _replay_sensor = NULL;
+	rs2::syncer* _replay_sync = NULL;
+	rs2::stream_profile replay_profile;
+	vector<char> replay_pixels[REPLAY_SLOTS];
+	std::atomic_bool replay_slot_busy[REPLAY_SLOTS];
+	std::atomic_int replay_in_flight{ 0 };
+	std::atomic<long long> replay_fed{ 0 }, replay_dropped{ 0 };
+
 	void GetRsCamParams(rs2_intrinsics& _rgb_intrinsics, rs2_intrinsics& _depth_intrinsics, rs2_extrinsics& _rgb_extrinsics)
 	{
 		_rgb_intrinsics = rgb_intrinsics;
@@ -203,12 +226,149 @@ namespace rs_settings
 		is_initialized = true;
 	}
 
+	bool InitializeRealsenseReplay(const std::string& file_replay, const int rs_w, const int rs_h)
+	{
+		if (is_initialized) return false;
+		if (!replay_reader.Open(file_replay))
+		{
+			cout << "FAIL TO OPEN " << file_replay << endl;
+			return false;
+		}
+		const rec_file_header& rec_header = replay_reader.GetHeader();
+		if (rec_header.img_w != rs_w || rec_header.img_h != rs_h || rec_header.img_channels != 3)
+		{
+			cout << "replay : " << rec_header.img_w << " x " << rec_header.img_h << " x " << rec_header.img_channels << " images, "
+				<< rs_w << " x " << rs_h << " x 3 expected" << endl;
+			replay_reader.Close();
+			return false;
+		}
+
+		rgb_intrinsics = rs2_intrinsics();
+		rgb_intrinsics.width = rs_w;
+		rgb_intrinsics.height = rs_h;
+		rgb_intrinsics.model = RS2_DISTORTION_NONE;
+		const float* k = rec_header.img_intrinsics;
+		if (k[0] > 0)
+		{
+			rgb_intrinsics.fx = k[0];
+			rgb_intrinsics.fy = k[1];
+			rgb_intrinsics.ppx = k[2];
+			rgb_intrinsics.ppy = k[3];
+		}
+		else
+		{
+			// not recorded (version 1 file) : 69.4 deg horizontal fov of the D4xx color sensor
+			cout << "replay : no color intrinsics in the file, nominal D4xx fov is used" << endl;
+			rgb_intrinsics.fx = rgb_intrinsics.fy = 0.5f * rs_w / tan(glm::radians(69.4f) * 0.5f);
+			rgb_intrinsics.ppx = 0.5f * rs_w;
+			rgb_intrinsics.ppy = 0.5f * rs_h;
+		}
+		depth_intrinsics = rgb_intrinsics;
+		rgb_extrinsics = rs2_extrinsics();
+		rgb_extrinsics.rotation[0] = rgb_extrinsics.rotation[4] = rgb_extrinsics.rotation[8] = 1.f;
+
+		for (int i = 0; i < REPLAY_SLOTS; i++)
+		{
+			replay_pixels[i].resize((size_t)rs_w * rs_h * 3);
+			replay_slot_busy[i] = false;
+		}
+		replay_in_flight = 0;
+		replay_fed = replay_dropped = 0;
+
+		_replay_dev = new rs2::software_device();
+		_replay_sensor = new rs2::software_sensor(_replay_dev->add_sensor("Replay"));
+		replay_profile = _replay_sensor->add_video_stream({ RS2_STREAM_COLOR, 0, 0, rs_w, rs_h, 60, 3, RS2_FORMAT_RGB8, rgb_intrinsics });
+		_replay_sync = new rs2::syncer();
+		_replay_sensor->open(replay_profile);
+		_replay_sensor->start(*_replay_sync);
+
+		_use_depthsensor = false;
+		_use_testeyecam = false;
+		_is_replay = true;
+		is_initialized = true;
+		return true;
+	}
+
+	// librealsense calls it when the last reference of a replayed frame is released
+	void ReleaseReplayPixels(void* pixels)
+	{
+		for (int i = 0; i < REPLAY_SLOTS; i++)
+			if (replay_pixels[i].data() == pixels) replay_slot_busy[i] = false;
+		replay_in_flight--;
+	}
+
+	// feeds the frame of the optitrk replay cursor (FAST : moves the cursor as soon as the consumer takes a frame)
+	void RunReplayThread(rs2::frame_queue& original_data)
+	{
+		profiler::SetThreadName("rs replay");
+		int fed_idx = -1;
+		while (rs_alive)
+		{
+			const int mode = optitrk::GetReplayMode();
+			int num_frames = 0;
+			int idx = optitrk::GetReplayFrame(NULL, &num_frames);
+			if (mode == TRK_REPLAY_FAST && replay_in_flight < REPLAY_MAX_IN_FLIGHT && idx < num_frames - 1)
+				idx = optitrk::StepReplay(1);
+			if (idx < 0 || idx == fed_idx)
+			{
+				Sleep(1);
+				continue;
+			}
+			// RECORDED : the frames the clock went past are skipped
+			if (idx > fed_idx + 1 && mode == TRK_REPLAY_RECORDED) replay_dropped += idx - fed_idx - 1;
+			fed_idx = idx;
+			PROF_ZONE("rs replay feed");
+
+			int slot = -1;
+			for (int i = 0; i < REPLAY_SLOTS && slot < 0; i++)
+				if (!replay_slot_busy[i]) slot = i;
+			if (slot < 0 || !replay_reader.ReadImage(idx, replay_pixels[slot].data()))
+			{
+				replay_dropped++;
+				continue;
+			}
+			replay_slot_busy[slot] = true;
+			replay_in_flight++;
+
+			rs2_software_video_frame frame;
+			frame.pixels = replay_pixels[slot].data();
+			frame.deleter = ReleaseReplayPixels;
+			frame.stride = rgb_intrinsics.width * 3;
+			frame.bpp = 3;
+			// host time of the injection, GetCaptureTimeMs maps it back to the GetMonotonicTimeMs() domain
+			frame.timestamp = std::chrono::duration<double, std::milli>(std::chrono::system_clock::now().time_since_epoch()).count();
+			frame.domain = RS2_TIMESTAMP_DOMAIN_SYSTEM_TIME;
+			frame.frame_number = idx;
+			frame.profile = replay_profile.get();
+			_replay_sensor->on_video_frame(frame);
+
+			rs2::frameset data;
+			if (_replay_sync->try_wait_for_frames(&data, 100))
+			{
+				original_data.enqueue(data);
+				replay_fed++;
+			}
+		}
+	}
+
+	void GetReplayStats(long long& frames_fed, long long& frames_dropped)
+	{
+		frames_fed = replay_fed;
+		frames_dropped = replay_dropped;
+	}
+
 	void RunRsThread(rs2::frame_queue& original_data, rs2::frame_queue& filtered_data, rs2::frame_queue& eye_data)
 	{
 		if (!is_initialized | rs_alive) return;
 
 		rs_alive = true;
+		if (_is_replay)
+		{
+			video_processing_thread = std::thread(RunReplayThread, std::ref(original_data));
+			return;
+		}
 		video_processing_thread = std::thread([&]() {
+			profiler::SetThreadName("rs");
 			while (rs_alive)
 			{
 				// Fetch frames from the pipeline and send them for processing
@@ -220,6 +380,7 @@ namespace rs_settings
 
 					if (data_depth != NULL && _use_depthsensor)
 					{
+						PROF_ZONE("rs depth filters");
 						// First make the frames spatially aligned
 						data_depth = data_depth.apply_filter(align_to);
 
@@ -287,8 +448,50 @@ namespace rs_settings
 		}
 	}
 
+	// device clock of the color stream -> host clock, per stream since the streams may come from different devices
+	static std::mutex hw_clock_lock;
+	static std::map<int, clock_offset_estimator> hw_clocks; // key : stream unique id
+
+	double GetCaptureTimeMs(const rs2::frame& frame)
+	{
+		double t_now = GetMonotonicTimeMs();
+		if (!frame) return t_now;
+		double t_sys_now = std::chrono::duration<double, std::milli>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+		if (frame.get_frame_timestamp_domain() == RS2_TIMESTAMP_DOMAIN_HARDWARE_CLOCK)
+		{
+			// the arrival of the frame on the host (system time metadata), or now when the backend does not report it
+			double t_arrival = t_now;
+			if (frame.supports_frame_metadata(RS2_FRAME_METADATA_TIME_OF_ARRIVAL))
+			{
+				double age = t_sys_now - (double)frame.get_frame_metadata(RS2_FRAME_METADATA_TIME_OF_ARRIVAL);
+				if (age >= 0 && age <= 1000.0) t_arrival = t_now - age;
+			}
+			std::lock_guard<std::mutex> lock(hw_clock_lock);
+			return min(hw_clocks[frame.get_profile().unique_id()].Map(frame.get_timestamp(), t_arrival), t_now);
+		}
+
+		// global/system time stamps are host wall-clock (ms), only the age of the frame is taken
+		double age = t_sys_now - frame.get_timestamp();
+		if (age < 0 || age > 1000.0) return t_now;
+		return t_now - age;
+	}
+
 	void DeinitializeRealsense()
 	{
+		if (_is_replay)
+		{
+			_replay_sensor->stop();
+			_replay_sensor->close();
+			delete _replay_sync;
+			delete _replay_sensor;
+			delete _replay_dev;
+			_replay_sync = NULL;
+			_replay_sensor = NULL;
+			_replay_dev = NULL;
+			replay_reader.Close();
+			_is_replay = false;
+		}
 		delete _ctx;
 		delete _pipe;
 		delete _eye_pipe;
@@ -330,17 +533,37 @@ namespace var_settings
 	vzm::ObjStates default_obj_state;
 
 	bool is_rsrb_detected = false;
+	pose_history trk_pose_hist;
+	depth_normal_kernel depth_kernel;
+	point_cloud_stage pc_stage;
 	glm::fmat4x4 mat_ws2clf, mat_clf2ws;
 
 	glm::fmat4x4 mat_rscs2clf;
 	glm::fmat4x4 mat_stgcs2clf;
 	glm::fmat4x4 mat_stgcs2clf_2;
 
-	// rs calib history
-	vector<track_info> record_trk_info;
-	vector<void*> record_rsimg;
+	// rs camera to rigid body calibration (Calib_TC), solved by the engine's worker thread
+	// tc_calib_pt_pairs mirrors the reservoir of the last result (display, rs_calib file), Pair_Clear empties it
+	calib_engine tc_calib;
+	uint64_t tc_calib_version = 0;
+	int tc_calib_mirrored = 0; // pairs mirrored from the last result
+
+	// model to rs point cloud registration (ICP), refined by the tracker's worker thread in the match model frame
+	// source : model vertices scaled to meters (mat_ms2icp), target : rs depth points, or the captured points of a click
+	// created by the first registration, its solver pool is not started when the dll is loaded (deleted by DeinitializeVarSettings)
+	icp_tracker* model_icp = NULL;
+	uint64_t model_icp_version = 0;
+	glm::fmat4x4 mat_pc2ws; // depth camera space to ws of the staged point cloud
+	glm::fmat4x4 mat_ms2icp; // model os to the source space (the scale of the model os2ws)
+	glm::fmat4x4 model_icp_pose; // mat_os2matchmodefrm given to or applied from the tracker
+	int model_icp_src_id = 0;
+	long long model_icp_pc_frame = 0;
+	bool model_icp_continuous = false, model_icp_pending = false;
+
+	// rs calib history (streamed to a .krec file by the recorder's writer thread)
+	session_recorder recorder;
+	vector<char> record_trk_buf;
 	map<string, int> action_info;
-	vector<int> record_key;
 
 	std::string operation_name;
 
@@ -359,6 +582,13 @@ namespace var_settings
 		g_info.stg_scene_id = 5;
 		g_info.znavi_rs_scene_id = 9;
 		g_info.znavi_stg_scene_id = 10;
+		scene_mirror::BindScene(MS_WS, g_info.ws_scene_id);
+		scene_mirror::BindScene(MS_RS, g_info.rs_scene_id);
+		scene_mirror::BindScene(MS_STG, g_info.stg_scene_id);
+		scene_mirror::BindScene(MS_MODEL, g_info.model_scene_id);
+		scene_mirror::BindScene(MS_CSECTION, g_info.csection_scene_id);
+		scene_mirror::BindScene(MS_ZNAVI_RS, g_info.znavi_rs_scene_id);
+		scene_mirror::BindScene(MS_ZNAVI_STG, g_info.znavi_stg_scene_id);
 
 		g_info.window_name_rs_view = "RealSense VIEW";
 		g_info.window_name_ws_view = "World VIEW";
@@ -437,6 +667,10 @@ namespace var_settings
 			ar_marker.register_marker(i, 5.15);
 			//ar_marker.aruco_marker_file_out(i, "armk" + to_string(i) + ".bmp");
 		}
+		// the calibration markers are searched around their previous positions, the full frame every 10 frames (half resolution)
+		__MarkerTrackParams armk_track_params;
+		armk_track_params.roi_tracking = true;
+		ar_marker.set_track_params(armk_track_params);
 	}
 
 	void SetOperationDesription(std::string& operation_name)
@@ -686,10 +920,9 @@ namespace var_settings
 			vzm::SetRenderTestParam("_bool_ApplySampleRateToGradient", apply_samplerate2grad, sizeof(bool), -1, -1);//g_info.model_scene_id, model_cam_id);
 
 			volume_ws_state.is_visible = false;
-			vzm::ReplaceOrAddSceneObject(g_info.ws_scene_id, g_info.model_volume_id, volume_ws_state);
-			vzm::ReplaceOrAddSceneObject(g_info.model_scene_id, g_info.model_volume_id, volume_ws_state);
+			scene_mirror::SetStates(MS_WS | MS_MODEL, g_info.model_volume_id, volume_ws_state);
 		}
-		vzm::ReplaceOrAddSceneObject(g_info.model_scene_id, g_info.model_ms_obj_id, model_state);
+		scene_mirror::SetState(g_info.model_scene_id, g_info.model_ms_obj_id, model_state);
 
 		vzm::CameraParameters rs_cam_params;
 		__cv3__ rs_cam_params.pos = glm::fvec3(0);
@@ -931,7 +1164,7 @@ namespace var_settings
 					sobj_state.diffusion = 0.5f;
 					sobj_state.specular = 0.0f;
 					vzm::GenerateSpheresObject(__FP spheres_xyzr[0], __FP spheres_rgb[0], (int)g_info.model_ms_pick_pts.size(), g_info.model_ms_pick_spheres_id);
-					vzm::ReplaceOrAddSceneObject(g_info.model_scene_id, g_info.model_ms_pick_spheres_id, sobj_state);
+					scene_mirror::SetState(g_info.model_scene_id, g_info.model_ms_pick_spheres_id, sobj_state);
 					Show_Window_with_Info(g_info.window_name_ms_view, g_info.model_scene_id, model_cam_id, g_info);
 				}
 			}
@@ -1066,14 +1299,8 @@ namespace var_settings
 
 	auto clear_record_info = [&]()
 	{
-		for (int i = 0; i < (int)record_rsimg.size(); i++)
-		{
-			delete[] record_rsimg[i];
-		}
-		record_trk_info.clear();
-		record_rsimg.clear();
+		recorder.Stop();
 		action_info.clear();
-		record_key.clear();
 	};
 
 	void ResetCalib()
@@ -1082,6 +1309,8 @@ namespace var_settings
 		g_info.otrk_data.stg_calib_pt_pairs.clear();
 		g_info.otrk_data.stg_calib_pt_pairs_2.clear();
 		g_info.otrk_data.tc_calib_pt_pairs.clear();
+		tc_calib.Reset();
+		tc_calib_mirrored = 0;
 		g_info.is_calib_stg_cam = g_info.is_calib_stg_cam_2 = g_info.is_calib_rs_cam = false;
 		g_info.model_predefined_pts.clear();
 		cout << "CLEAR calibration points" << endl;
@@ -1089,49 +1318,48 @@ namespace var_settings
 
 	void StoreRecordInfo()
 	{
-		const int w = g_info.rs_w;
-		const int h = g_info.rs_h;
-		cout << "WRITE RECODING INFO of " << record_trk_info.size() << " frames" << endl;
-
-		std::fstream file_imgdata;
-		file_imgdata.open("imgdata.bin", std::ios::app | std::ios::binary);
-		file_imgdata.clear();
-		file_imgdata.write(reinterpret_cast<char*>(&record_rsimg[0]), w * h * 3 * sizeof(char) * record_rsimg.size());
-		file_imgdata.close();
-
-		std::fstream file_trkdata;
-		file_trkdata.open("trkdata.bin", std::ios::app | std::ios::binary);
-		file_trkdata.clear();
-		for (int i = 0; i < (int)record_trk_info.size(); i++)
-		{
-			size_t buf_size_bytes;
-			char* _buf = record_trk_info[i].GetSerialBuffer(buf_size_bytes);
-			file_trkdata.write(_buf, buf_size_bytes);
-			delete[] _buf;
-		}
-		file_trkdata.close();
-
-		ofstream file_keydata("keyrecord.txt");
-		if (file_keydata.is_open())
-		{
-			file_keydata.clear();
-			file_keydata << to_string(record_key.size()) << endl;
-			for (int i = 0; i < (int)record_key.size(); i++)
-			{
-				file_keydata << to_string(record_key[i]) << endl;
-			}
-		}
-		file_keydata.close();
+		if (!recorder.IsRecording()) return;
+		recorder.Stop(); // the writer drains the pending slots, then the index is written
+		rec_stats stats = recorder.GetStats();
+		cout << "WRITE RECODING INFO of " << stats.written << " frames (dropped " << stats.dropped << ")" << endl;
+		if (stats.failed) cout << "RECORDING WRITE FAILED, the file ends at the last complete frame" << endl;
+	}
 
-		clear_record_info();
+	void GetRecordStats(long long& frames_written, long long& frames_dropped, int& frames_pending)
+	{
+		rec_stats stats = recorder.GetStats();
+		frames_written = stats.written;
+		frames_dropped = stats.dropped;
+		frames_pending = stats.pending;
 	}
 
 	static int probe_line_id = 0, probe_tip_id = 0;
-	void UpdateTrackInfo(const void* trk_info, const std::string& probe_specifier_rb_name, int _probe_mode)
+	void PushTrackSample(const void* trk_info)
 	{
+		trk_pose_hist.Push(*(track_info*)trk_info);
+	}
+
+	void UpdateTrackInfo(const void* trk_info, const std::string& probe_specifier_rb_name, int _probe_mode, double t_capture)
+	{
+		PROF_ZONE("UpdateTrackInfo");
 		PROBE_MODE probe_mode = (PROBE_MODE)_probe_mode;
 		g_info.probe_rb_name = probe_specifier_rb_name;
 		g_info.otrk_data.trk_info = *(track_info*)trk_info;
+		if (t_capture > 0)
+		{
+			// rigid body poses at the capture time of the paired color frame (markers stay as the latest sample)
+			track_info& cur_trk_info = g_info.otrk_data.trk_info;
+			if (memcmp(&cur_trk_info.rbs, &trk_pose_hist.rbs, sizeof(rb_registry)) == 0)
+			{
+				for (int i = 0; i < cur_trk_info.rbs.num_rbs; i++)
+				{
+					glm::fmat4x4 mat_lfrm2ws;
+					if (trk_pose_hist.Query(i, t_capture, mat_lfrm2ws))
+						cur_trk_info.mat_lfrm2ws[i] = mat_lfrm2ws;
+				}
+				cur_trk_info.time_stamp = t_capture;
+			}
+		}
 		is_rsrb_detected = g_info.otrk_data.trk_info.GetLFrmInfo("rs_cam", mat_clf2ws);
 		mat_ws2clf = glm::inverse(mat_clf2ws);
 
@@ -1172,30 +1400,22 @@ namespace var_settings
 
 			glm::fvec3 cyl_p01[2] = { probe_tip, probe_tip + probe_dir_se * 0.2f };
 			float cyl_r = 0.0015f;	// 0.002f
-			vzm::GenerateCylindersObject((float*)cyl_p01, &cyl_r, NULL, 1, probe_line_id);
 			vzm::ObjStates probe_state = default_obj_state;
+			__cm4__ probe_state.os2ws = g_info.prims.Cylinder(cyl_p01[0], cyl_p01[1], cyl_r, NULL, probe_line_id);
 			__cv4__ probe_state.color = glm::fvec4(0, 1, 1, 1);
-			vzm::ReplaceOrAddSceneObject(g_info.ws_scene_id, probe_line_id, probe_state);
-			vzm::ReplaceOrAddSceneObject(g_info.rs_scene_id, probe_line_id, probe_state);
-			vzm::ReplaceOrAddSceneObject(g_info.stg_scene_id, probe_line_id, probe_state);
+			scene_mirror::SetStates(MS_WS | MS_RS | MS_STG, probe_line_id, probe_state);
 
-			vzm::GenerateSpheresObject(__FP glm::fvec4(probe_tip, 0.0045f), NULL, 1, probe_tip_id);
+			__cm4__ probe_state.os2ws = g_info.prims.Sphere(probe_tip, 0.0045f, NULL, probe_tip_id);
 			__cv4__ probe_state.color = glm::fvec4(1, 1, 1, 1);
 
-			vzm::ReplaceOrAddSceneObject(g_info.ws_scene_id, probe_tip_id, probe_state);
-			vzm::ReplaceOrAddSceneObject(g_info.rs_scene_id, probe_tip_id, probe_state);
-			vzm::ReplaceOrAddSceneObject(g_info.stg_scene_id, probe_tip_id, probe_state);
+			scene_mirror::SetStates(MS_WS | MS_RS | MS_STG, probe_tip_id, probe_state);
 		}
 		else
 		{
 			vzm::ObjStates cobj_state = default_obj_state;
 			cobj_state.is_visible = false;
-			vzm::ReplaceOrAddSceneObject(g_info.ws_scene_id, probe_line_id, cobj_state);
-			vzm::ReplaceOrAddSceneObject(g_info.rs_scene_id, probe_line_id, cobj_state);
-			vzm::ReplaceOrAddSceneObject(g_info.stg_scene_id, probe_line_id, cobj_state);
-			vzm::ReplaceOrAddSceneObject(g_info.ws_scene_id, probe_tip_id, cobj_state);
-			vzm::ReplaceOrAddSceneObject(g_info.rs_scene_id, probe_tip_id, cobj_state);
-			vzm::ReplaceOrAddSceneObject(g_info.stg_scene_id, probe_tip_id, cobj_state);
+			scene_mirror::SetStates(MS_WS | MS_RS | MS_STG, probe_line_id, cobj_state);
+			scene_mirror::SetStates(MS_WS | MS_RS | MS_STG, probe_tip_id, cobj_state);
 		}
 
 		//g_info.is_probe_detected = g_info.otrk_data.trk_info.GetLFrmInfo(probe_specifier_rb_name, g_info.mat_probe2ws);
@@ -1213,27 +1433,43 @@ namespace var_settings
 		{
 			if (is_detected)
 			{
-				Axis_Gen(mat_frm2ws, 0.07, obj_id);
-				vzm::ReplaceOrAddSceneObject(g_info.ws_scene_id, obj_id, default_obj_state);
+				vzm::ObjStates ostate = default_obj_state;
+				__cm4__ ostate.os2ws = g_info.prims.Axis(mat_frm2ws, 0.07f, obj_id);
+				scene_mirror::SetState(g_info.ws_scene_id, obj_id, ostate);
 			}
 			else if (obj_id != 0)
 			{
 				vzm::ObjStates ostate = default_obj_state;
 				ostate.is_visible = false;
-				vzm::ReplaceOrAddSceneObject(g_info.ws_scene_id, obj_id, ostate);
+				scene_mirror::SetState(g_info.ws_scene_id, obj_id, ostate);
 			}
 		};
 		set_rb_axis(is_rsrb_detected, mat_clf2ws, g_info.otrk_data.rs_lf_axis_id);
 		//set_rb_axis(g_info.is_probe_detected, g_info.mat_probe2ws, g_info.otrk_data.probe_lf_axis_id);
 	}
 
-	void RecordInfo(const int key_pressed, const void* color_data)
+	void RecordInfo(const int key_pressed, const void* color_data, const double t_capture)
 	{
-		record_trk_info.push_back(g_info.otrk_data.trk_info);
-		char* img_data = new char[g_info.rs_w * g_info.rs_h * 3];
-		memcpy(img_data, color_data, sizeof(char) * 3 * g_info.rs_w * g_info.rs_h);
-		record_rsimg.push_back(img_data);
-		record_key.push_back(key_pressed);
+		if (!recorder.IsRecording())
+		{
+			char file_name[64];
+			time_t t_now = time(NULL);
+			struct tm tm_now;
+			localtime_s(&tm_now, &t_now);
+			strftime(file_name, sizeof(file_name), "record_%Y%m%d_%H%M%S.krec", &tm_now);
+			const float rgb_k[4] = { rs_settings::rgb_intrinsics.fx, rs_settings::rgb_intrinsics.fy, rs_settings::rgb_intrinsics.ppx, rs_settings::rgb_intrinsics.ppy };
+			if (!recorder.Start(file_name, g_info.rs_w, g_info.rs_h, 3, 32, rgb_k))
+			{
+				cout << "FAIL TO OPEN " << file_name << endl;
+				return;
+			}
+			cout << "RECORDING to " << file_name << endl;
+		}
+
+		const track_info& trk_info = g_info.otrk_data.trk_info;
+		record_trk_buf.resize(trk_info.GetSerialSize());
+		trk_info.WriteSerialBuffer(record_trk_buf.data());
+		recorder.Push(t_capture > 0 ? t_capture : GetMonotonicTimeMs(), key_pressed, color_data, record_trk_buf.data(), record_trk_buf.size());
 	}
 
 	void SetTcCalibMkPoints()
@@ -1250,15 +1486,15 @@ namespace var_settings
 		static int armk_frame_id = 0, cb_spheres_id = 0;
 		if (is_armk_detected)
 		{
-			Axis_Gen(mat_armklf2ws, 0.05f, armk_frame_id);
 			vzm::ObjStates cstate = default_obj_state;
-			vzm::ReplaceOrAddSceneObject(g_info.ws_scene_id, armk_frame_id, cstate);
+			__cm4__ cstate.os2ws = g_info.prims.Axis(mat_armklf2ws, 0.05f, armk_frame_id);
+			scene_mirror::SetState(g_info.ws_scene_id, armk_frame_id, cstate);
 		}
 		else
 		{
 			vzm::ObjStates cstate = default_obj_state;
 			cstate.is_visible = false;
-			vzm::ReplaceOrAddSceneObject(g_info.ws_scene_id, armk_frame_id, cstate);
+			scene_mirror::SetState(g_info.ws_scene_id, armk_frame_id, cstate);
 		}
 
 		if (is_visible && is_armk_detected)
@@ -1288,118 +1524,75 @@ namespace var_settings
 			{
 				vzm::GenerateSpheresObject(__FP sphers_xyzr[0], __FP sphers_rgb[0],
 					g_info.otrk_data.calib_3d_pts.size(), cb_spheres_id);
-				vzm::ReplaceOrAddSceneObject(g_info.ws_scene_id, cb_spheres_id, default_obj_state);
-				vzm::ReplaceOrAddSceneObject(g_info.rs_scene_id, cb_spheres_id, default_obj_state);
+				scene_mirror::SetStates(MS_WS | MS_RS, cb_spheres_id, default_obj_state);
 
 				for (int i = 0; i < (int)g_info.otrk_data.calib_3d_pts.size(); i++)
-					vzm::ReplaceOrAddSceneObject(g_info.ws_scene_id, g_info.otrk_data.armk_text_ids[i], default_obj_state);
+					scene_mirror::SetState(g_info.ws_scene_id, g_info.otrk_data.armk_text_ids[i], default_obj_state);
 				vzm::ObjStates cstate = default_obj_state;
 				cstate.is_visible = false;
 				for (int i = g_info.otrk_data.calib_3d_pts.size(); i < (int)g_info.otrk_data.armk_text_ids.size(); i++)
-					vzm::ReplaceOrAddSceneObject(g_info.ws_scene_id, g_info.otrk_data.armk_text_ids[i], cstate);
+					scene_mirror::SetState(g_info.ws_scene_id, g_info.otrk_data.armk_text_ids[i], cstate);
 			}
 			else
 			{
 				vzm::ObjStates cstate = default_obj_state;
 				cstate.is_visible = false;
-				vzm::ReplaceOrAddSceneObject(g_info.ws_scene_id, cb_spheres_id, cstate);
-				vzm::ReplaceOrAddSceneObject(g_info.rs_scene_id, cb_spheres_id, cstate);
+				scene_mirror::SetStates(MS_WS | MS_RS, cb_spheres_id, cstate);
 
 				for (int i = 0; i < (int)g_info.otrk_data.armk_text_ids.size(); i++)
-					vzm::ReplaceOrAddSceneObject(g_info.ws_scene_id, g_info.otrk_data.armk_text_ids[i], cstate);
+					scene_mirror::SetState(g_info.ws_scene_id, g_info.otrk_data.armk_text_ids[i], cstate);
 			}
 		}
 		else
 		{
 			vzm::ObjStates cstate = default_obj_state;
 			cstate.is_visible = false;
-			vzm::ReplaceOrAddSceneObject(g_info.ws_scene_id, cb_spheres_id, cstate);
-			vzm::ReplaceOrAddSceneObject(g_info.rs_scene_id, cb_spheres_id, cstate);
+			scene_mirror::SetStates(MS_WS | MS_RS, cb_spheres_id, cstate);
 
 			for (int i = 0; i < (int)g_info.otrk_data.armk_text_ids.size(); i++)
-				vzm::ReplaceOrAddSceneObject(g_info.ws_scene_id, g_info.otrk_data.armk_text_ids[i], cstate);
+				scene_mirror::SetState(g_info.ws_scene_id, g_info.otrk_data.armk_text_ids[i], cstate);
 		}
 	}
 
 	void SetMkSpheres(bool is_visible, bool is_pickable)
 	{
-		auto marker_color = [](int idx, int w)
-		{
-			return glm::fvec3(1, (idx % max(w, 1)) / (float)max(w - 1, 1), (idx / max(w, 1)) / (float)max(w - 1, 1));
-		};
-
-		auto register_mks = [](const glm::fvec3* pos_list, const glm::fvec3& color, const int num_mks, const float r, int& mks_id)
-		{
-			vector<glm::fvec4> sphers_xyzr;
-			vector<glm::fvec3> sphers_rgb;
-			for (int i = 0; i < num_mks; i++)
-			{
-				glm::fvec3 pt = pos_list[i];
-				sphers_xyzr.push_back(glm::fvec4(pt.x, pt.y, pt.z, r));
-				sphers_rgb.push_back(color);
-			}
-
-			if (num_mks > 0)
-				vzm::GenerateSpheresObject(__FP sphers_xyzr[0], __FP sphers_rgb[0], num_mks, mks_id);
-			else
-			{
-				vzm::DeleteObject(mks_id);
-				mks_id = 0;
-			}
-		};
-
 		is_pickable |= g_info.touch_mode == RsTouchMode::Calib_STG || g_info.touch_mode == RsTouchMode::Calib_STG2;
 
-		static int mks_spheres_id = 0;
+		// the instance states are set only for the moved markers, or when the visibility changes
+		static marker_vis_pool mks_pool(0.005f, glm::fvec3(1, 1, 0));
 		if (is_visible && !is_pickable)
 		{
-			register_mks((glm::fvec3*)&g_info.otrk_data.trk_info.mk_xyz_list[0], glm::fvec3(1, 1, 0), g_info.otrk_data.trk_info.mk_xyz_list.size() / 3, 0.005, mks_spheres_id);
-			if (mks_spheres_id != 0)
-			{
-				vzm::ReplaceOrAddSceneObject(g_info.ws_scene_id, mks_spheres_id, default_obj_state);
-				vzm::ReplaceOrAddSceneObject(g_info.rs_scene_id, mks_spheres_id, default_obj_state);
-				vzm::ReplaceOrAddSceneObject(g_info.stg_scene_id, mks_spheres_id, default_obj_state);
-			}
-		}
-		else
-		{
-			vzm::ObjStates cstate = default_obj_state;
-			cstate.is_visible = false;
-			{
-				vzm::ReplaceOrAddSceneObject(g_info.ws_scene_id, mks_spheres_id, cstate);
-				vzm::ReplaceOrAddSceneObject(g_info.rs_scene_id, mks_spheres_id, cstate);
-				vzm::ReplaceOrAddSceneObject(g_info.stg_scene_id, mks_spheres_id, cstate);
-			}
+			mks_pool.Update(g_info.otrk_data.trk_info);
+			mks_pool.Show(MS_WS | MS_RS | MS_STG, 0, default_obj_state);
 		}
+		else mks_pool.Hide();
 
+		// pickable markers : colored by the marker index, picked on the cpu (see event_handler.hpp)
+		// vzmobjid2pos (pick id -> position) is rebuilt only when the marker set changes
+		marker_vis_pool& pick_pool = g_info.otrk_data.mk_pickable_pool;
 		if (is_pickable)
 		{
-			int num_mks = g_info.otrk_data.trk_info.mk_xyz_list.size() / 3;
-			g_info.vzmobjid2pos.clear();
-			for (int i = 0; i < (int)g_info.otrk_data.mk_pickable_sphere_ids.size(); i++)
-				vzm::DeleteObject(g_info.otrk_data.mk_pickable_sphere_ids[i]);
-			g_info.otrk_data.mk_pickable_sphere_ids.clear();
-
-			for (int i = 0; i < num_mks; i++)
-			{
-				g_info.otrk_data.mk_pickable_sphere_ids.push_back(0);
-				int& pickable_mk_id = g_info.otrk_data.mk_pickable_sphere_ids[i];
-				glm::fvec3 pt = g_info.otrk_data.trk_info.GetMkPos(i);
-				vzm::GenerateSpheresObject(__FP glm::fvec4(pt.x, pt.y, pt.z, 0.015), __FP marker_color(i, 7), 1, pickable_mk_id);
-				g_info.vzmobjid2pos[pickable_mk_id] = pt;
-				vzm::ValidatePickTarget(pickable_mk_id);
-				vzm::ObjStates cstate = default_obj_state;
-				if (g_info.touch_mode == RsTouchMode::Calib_STG || g_info.touch_mode == RsTouchMode::Calib_STG2)
-					vzm::ReplaceOrAddSceneObject(g_info.rs_scene_id, pickable_mk_id, cstate);
-				else
-					vzm::ReplaceOrAddSceneObject(g_info.ws_scene_id, pickable_mk_id, cstate);
+			const int changes = pick_pool.Update(g_info.otrk_data.trk_info);
+			if (changes & MKVIS_SET_CHANGED)
+			{
+				g_info.vzmobjid2pos.clear();
+				for (int i = 0; i < pick_pool.num_mks; i++)
+					g_info.vzmobjid2pos[marker_vis_pool::GetPickId(i)] = pick_pool.pos[i];
+			}
+			else if (changes & MKVIS_MOVED)
+			{
+				for (int i = 0; i < pick_pool.num_mks; i++)
+					g_info.vzmobjid2pos[marker_vis_pool::GetPickId(i)] = pick_pool.pos[i];
 			}
+
+			const int pick_scene_id = g_info.touch_mode == RsTouchMode::Calib_STG || g_info.touch_mode == RsTouchMode::Calib_STG2 ? g_info.rs_scene_id : g_info.ws_scene_id;
+			pick_pool.Show(0, pick_scene_id, default_obj_state);
 		}
-		else
+		else if (pick_pool.num_shown > 0 || pick_pool.num_mks > 0)
 		{
-			for (int i = 0; i < (int)g_info.otrk_data.mk_pickable_sphere_ids.size(); i++)
-				vzm::DeleteObject(g_info.otrk_data.mk_pickable_sphere_ids[i]);
-			g_info.otrk_data.mk_pickable_sphere_ids.clear();
+			pick_pool.Hide();
+			// the next pickable frame starts from a new marker set
+			pick_pool.Clear();
 			g_info.vzmobjid2pos.clear();
 		}
 
@@ -1415,18 +1608,14 @@ namespace var_settings
 			{
 				hide_dst_custom_spheres = false;
 				register_mks((glm::fvec3*)&dst_pos_list[0], glm::fvec3(1, 0, 1), dst_pos_list.size(), 0.005, dst_custom_spheres_id);
-				vzm::ReplaceOrAddSceneObject(g_info.ws_scene_id, dst_custom_spheres_id, default_obj_state);
-				vzm::ReplaceOrAddSceneObject(g_info.rs_scene_id, dst_custom_spheres_id, default_obj_state);
-				vzm::ReplaceOrAddSceneObject(g_info.stg_scene_id, dst_custom_spheres_id, default_obj_state);
+				scene_mirror::SetStates(MS_WS | MS_RS | MS_STG, dst_custom_spheres_id, default_obj_state);
 			}
 		}
 		if (hide_dst_custom_spheres || (dst_custom_spheres_id == 0))
 		{
 			vzm::ObjStates cstate = default_obj_state;
 			cstate.is_visible = false;
-			vzm::ReplaceOrAddSceneObject(g_info.ws_scene_id, dst_custom_spheres_id, cstate);
-			vzm::ReplaceOrAddSceneObject(g_info.rs_scene_id, dst_custom_spheres_id, cstate);
-			vzm::ReplaceOrAddSceneObject(g_info.stg_scene_id, dst_custom_spheres_id, cstate);
+			scene_mirror::SetStates(MS_WS | MS_RS | MS_STG, dst_custom_spheres_id, cstate);
 		}
 	}
 
@@ -1447,18 +1636,61 @@ namespace var_settings
 
 	void TryCalibrationTC(Mat& imgColor)
 	{
+		PROF_ZONE("TryCalibrationTC");
 		auto marker_color = [](int idx, int w)
 		{
 			return glm::fvec3((idx % max(w, 1)) / (float)max(w - 1, 1), (idx / max(w, 1)) / (float)max(w - 1, 1), 1);
 		};
 		if (g_info.touch_mode == RsTouchMode::Calib_TC && is_rsrb_detected && g_info.otrk_data.calib_3d_pts.size() > 0)
 		{
+			tc_calib.SetCamera(imgColor.cols, imgColor.rows,
+				rs_settings::rgb_intrinsics.fx, rs_settings::rgb_intrinsics.fy, rs_settings::rgb_intrinsics.ppx, rs_settings::rgb_intrinsics.ppy);
+			if (!tc_calib.IsRunning())
+			{
+				tc_calib.Start();
+				// warm start from the calibration loaded from rs_calib, its pairs seed the reservoir
+				if (g_info.is_calib_rs_cam) tc_calib.SetPose(mat_rscs2clf);
+				vector<Point2f> seed_2d;
+				vector<Point3f> seed_3dclf;
+				for (const pair<Point2f, Point3f>& _pair : g_info.otrk_data.tc_calib_pt_pairs)
+				{
+					seed_2d.push_back(_pair.first);
+					seed_3dclf.push_back(_pair.second);
+				}
+				tc_calib.Push(seed_2d, seed_3dclf);
+				tc_calib_mirrored = (int)seed_2d.size();
+			}
+
 			// calibration routine
-			Mat viewGray;
-			cvtColor(imgColor, viewGray, COLOR_BGR2GRAY);
+			// image motion of the markers since the previous frame, from the rotation of the calibrated camera relative to the marker frame
+			static glm::fmat4x4 prev_mat_armk2rscs;
+			static bool has_prev_armk2rscs = false;
+			float mat_prev2cur[9];
+			bool has_armk_motion = false;
+			glm::fmat4x4 mat_armk2ws(1.f);
+			if (g_info.is_calib_rs_cam && (g_info.otrk_data.marker_rb_name == "" || g_info.otrk_data.trk_info.GetLFrmInfo(g_info.otrk_data.marker_rb_name, mat_armk2ws)))
+			{
+				const glm::fmat4x4 mat_armk2rscs = glm::inverse(mat_clf2ws * mat_rscs2clf) * mat_armk2ws;
+				if (has_prev_armk2rscs)
+				{
+					// rotation only homography K * R * K^-1 in the opencv camera frame (y and z flipped), the roi margin absorbs the translation
+					const glm::fmat3x3 mat_flip(1, 0, 0, 0, -1, 0, 0, 0, -1);
+					const glm::fmat3x3 mat_k(rs_settings::rgb_intrinsics.fx, 0, 0, 0, rs_settings::rgb_intrinsics.fy, 0,
+						rs_settings::rgb_intrinsics.ppx, rs_settings::rgb_intrinsics.ppy, 1);
+					const glm::fmat3x3 mat_rot = mat_flip * glm::fmat3x3(mat_armk2rscs) * glm::transpose(glm::fmat3x3(prev_mat_armk2rscs)) * mat_flip;
+					const glm::fmat3x3 mat_h = mat_k * mat_rot * glm::inverse(mat_k);
+					for (int r = 0; r < 3; r++)
+						for (int c = 0; c < 3; c++) mat_prev2cur[r * 3 + c] = mat_h[c][r];
+					has_armk_motion = true;
+				}
+				prev_mat_armk2rscs = mat_armk2rscs;
+				has_prev_armk2rscs = true;
+			}
+			else has_prev_armk2rscs = false;
 
+			// the color image is converted to gray inside the searched regions only
 			std::vector<__MarkerDetInfo> list_det_armks;
-			ar_marker.track_markers(list_det_armks, viewGray.data, viewGray.cols, viewGray.rows, mk_ids);
+			ar_marker.track_markers(list_det_armks, imgColor.data, imgColor.cols, imgColor.rows, 3, mk_ids, has_armk_motion ? mat_prev2cur : NULL);
 
 			for (int i = 0; i < (int)list_det_armks.size(); i++)
 			{
@@ -1522,57 +1754,67 @@ namespace var_settings
 				{
 					prev_mat_clf2ws = mat_clf2ws;
 					prev_mat_armklf2ws = mat_armklf2ws;
-					float pnp_err = -1.f;
-					int calib_samples = 0;
-					glm::fmat4x4 __mat_rscs2clf = mat_rscs2clf;
-
-					static int err_count = 0;
-					bool is_success = CalibrteCamLocalFrame(*(vector<glm::fvec2>*)&point2d, *(vector<glm::fvec3>*)&point3dws, mat_ws2clf,
-						rs_settings::rgb_intrinsics.fx, rs_settings::rgb_intrinsics.fy, rs_settings::rgb_intrinsics.ppx, rs_settings::rgb_intrinsics.ppy,
-						__mat_rscs2clf, &pnp_err, &calib_samples, g_info.otrk_data.tc_calib_pt_pairs);
-					if (pnp_err >= 5 && calib_samples >= 12)
+
+					// the samples go to the calibration worker, the result is polled below
+					vector<Point3f> point3dclf(point3dws.size());
+					for (int i = 0; i < (int)point3dws.size(); i++)
 					{
-						//calib_samples == 12 ? g_info.otrk_data.tc_calib_pt_pairs.clear() : 
-							g_info.otrk_data.tc_calib_pt_pairs.pop_back();
+						const glm::fvec3 pos_3dclf = tr_pt(mat_ws2clf, *(glm::fvec3*)&point3dws[i]);
+						point3dclf[i] = Point3f(pos_3dclf.x, pos_3dclf.y, pos_3dclf.z);
 					}
-					else if (is_success)
+					tc_calib.Push(point2d, point3dclf);
+				}
+			}
+		}
+
+		// results of the calibration worker
+		if (tc_calib.IsRunning())
+		{
+			calib_result calib_res;
+			if (g_info.otrk_data.tc_calib_pt_pairs.size() == 0 && tc_calib_mirrored > 0)
+			{
+				// Pair_Clear
+				tc_calib.Reset();
+				tc_calib_mirrored = 0;
+			}
+			else if (tc_calib.GetResult(tc_calib_version, calib_res))
+			{
+				tc_calib_version = calib_res.version;
+				cout << "PnP reprojection error : " << calib_res.rms_err << " pixels, # of point pairs : " << calib_res.num_samples
+					<< " (" << calib_res.num_rejected << " rejected, " << (calib_res.warm_started ? "warm start" : "cold start")
+					<< (calib_res.converged ? ", converged" : "") << ")" << endl;
+
+				g_info.otrk_data.tc_calib_pt_pairs.clear();
+				for (int i = 0; i < (int)calib_res.samples.size(); i++)
+					g_info.otrk_data.tc_calib_pt_pairs.push_back(PAIR_MAKE(calib_res.samples[i].p2d, calib_res.samples[i].p3d_clf));
+				tc_calib_mirrored = (int)g_info.otrk_data.tc_calib_pt_pairs.size();
+
+				mat_rscs2clf = calib_res.mat_rscs2clf;
+				g_info.is_calib_rs_cam = true;
+
+				ofstream outfile(g_info.rs_calib);
+				if (outfile.is_open())
+				{
+					outfile.clear();
+
+					outfile << to_string(g_info.otrk_data.tc_calib_pt_pairs.size()) << endl;
+					for (int i = 0; i < (int)g_info.otrk_data.tc_calib_pt_pairs.size(); i++)
 					{
-						//static int calib_frame_id = 0;
-						//Axis_Gen(mat_clf2ws, 0.05f, calib_frame_id);
-						//vzm::ObjStates cstate = default_obj_state;
-						//cstate.color[3] = 0.3f;
-						//vzm::ReplaceOrAddSceneObject(g_info.ws_scene_id, calib_frame_id, cstate);
-						//g_info.otrk_data.calib_trial_rs_cam_frame_ids.push_back(calib_frame_id);
-
-						mat_rscs2clf = __mat_rscs2clf;
-
-						g_info.is_calib_rs_cam = true;
-						// 
-						ofstream outfile(g_info.rs_calib);
-						if (outfile.is_open())
-						{
-							outfile.clear();
-
-							outfile << to_string(point2d.size()) << endl;
-							for (int i = 0; i < (int)point2d.size(); i++)
-							{
-								pair<Point2f, Point3f>& _pair = g_info.otrk_data.tc_calib_pt_pairs[i];
-								Point2d p2d = std::get<0>(_pair);
-								Point3d p3d_clf = std::get<1>(_pair);
-								string line = to_string(p2d.x) + " " + to_string(p2d.y) + " " + to_string(p3d_clf.x) + " " + to_string(p3d_clf.y) + " " + to_string(p3d_clf.z);
-								outfile << line << endl;
-							}
-
-							float* d = glm::value_ptr(mat_rscs2clf);
-							for (int i = 0; i < 16; i++)
-							{
-								string line = to_string(d[i]);
-								outfile << line << endl;
-							}
-						}
-						outfile.close();
+						pair<Point2f, Point3f>& _pair = g_info.otrk_data.tc_calib_pt_pairs[i];
+						Point2d p2d = std::get<0>(_pair);
+						Point3d p3d_clf = std::get<1>(_pair);
+						string line = to_string(p2d.x) + " " + to_string(p2d.y) + " " + to_string(p3d_clf.x) + " " + to_string(p3d_clf.y) + " " + to_string(p3d_clf.z);
+						outfile << line << endl;
+					}
+
+					float* d = glm::value_ptr(mat_rscs2clf);
+					for (int i = 0; i < 16; i++)
+					{
+						string line = to_string(d[i]);
+						outfile << line << endl;
 					}
 				}
+				outfile.close();
 			}
 		}
 
@@ -1584,9 +1826,9 @@ namespace var_settings
 				for (int i = 0; i < g_info.otrk_data.calib_trial_rs_cam_frame_ids.size(); i++)
 				{
 					vzm::ObjStates cstate;
-					vzm::GetSceneObjectState(g_info.ws_scene_id, g_info.otrk_data.calib_trial_rs_cam_frame_ids[i], cstate);
+					scene_mirror::GetState(g_info.ws_scene_id, g_info.otrk_data.calib_trial_rs_cam_frame_ids[i], cstate);
 					cstate.is_visible = true;
-					vzm::ReplaceOrAddSceneObject(g_info.ws_scene_id, g_info.otrk_data.calib_trial_rs_cam_frame_ids[i], cstate);
+					scene_mirror::SetState(g_info.ws_scene_id, g_info.otrk_data.calib_trial_rs_cam_frame_ids[i], cstate);
 				}
 			}
 			else if(g_info.otrk_data.tc_calib_pt_pairs.size() > 0)
@@ -1605,7 +1847,7 @@ namespace var_settings
 				vzm::GenerateSpheresObject(__FP ws_armk_spheres_xyzr[0], __FP ws_armk_spheres_rgb[0], g_info.otrk_data.tc_calib_pt_pairs.size(), calib_armks_id);
 				vzm::ObjStates cstate = default_obj_state;
 				cstate.color[3] = 0.3f;
-				vzm::ReplaceOrAddSceneObject(g_info.ws_scene_id, calib_armks_id, cstate);
+				scene_mirror::SetState(g_info.ws_scene_id, calib_armks_id, cstate);
 			}
 		}
 
@@ -1633,6 +1875,7 @@ namespace var_settings
 
 	void TryCalibrationSTG()
 	{
+		PROF_ZONE("TryCalibrationSTG");
 		static int mk_stg_calib_sphere_id = 0;
 		static int clf_mk_stg_calib_spheres_id = 0;
 		static int last_calib_pair = 0;
@@ -1649,16 +1892,14 @@ namespace var_settings
 			{
 				glm::fvec3 pos_stg_calib_mk = g_info.otrk_data.trk_info.GetMkPos(stg_calib_mk_idx);
 				vzm::GenerateSpheresObject(__FP glm::fvec4(pos_stg_calib_mk, 0.02), __FP glm::fvec3(1), 1, mk_stg_calib_sphere_id);
-				vzm::ReplaceOrAddSceneObject(g_info.ws_scene_id, mk_stg_calib_sphere_id, default_obj_state);
-				vzm::ReplaceOrAddSceneObject(g_info.rs_scene_id, mk_stg_calib_sphere_id, default_obj_state);
+				scene_mirror::SetStates(MS_WS | MS_RS, mk_stg_calib_sphere_id, default_obj_state);
 			}
 			else
 			{
 				vzm::ObjStates cstate;
-				vzm::GetSceneObjectState(g_info.ws_scene_id, mk_stg_calib_sphere_id, cstate);
+				scene_mirror::GetState(g_info.ws_scene_id, mk_stg_calib_sphere_id, cstate);
 				cstate.is_visible = false;
-				vzm::ReplaceOrAddSceneObject(g_info.ws_scene_id, mk_stg_calib_sphere_id, cstate);
-				vzm::ReplaceOrAddSceneObject(g_info.rs_scene_id, mk_stg_calib_sphere_id, cstate);
+				scene_mirror::SetStates(MS_WS | MS_RS, mk_stg_calib_sphere_id, cstate);
 			}
 
 			vector<glm::fvec4> ws_mk_spheres_xyzr;
@@ -1735,15 +1976,13 @@ namespace var_settings
 			if (ws_mk_spheres_xyzr.size() > 0)
 			{
 				vzm::GenerateSpheresObject(__FP ws_mk_spheres_xyzr[0], __FP ws_mk_spheres_rgb[0], ws_mk_spheres_xyzr.size(), clf_mk_stg_calib_spheres_id);
-				vzm::ReplaceOrAddSceneObject(g_info.ws_scene_id, clf_mk_stg_calib_spheres_id, default_obj_state);
-				vzm::ReplaceOrAddSceneObject(g_info.rs_scene_id, clf_mk_stg_calib_spheres_id, default_obj_state);
+				scene_mirror::SetStates(MS_WS | MS_RS, clf_mk_stg_calib_spheres_id, default_obj_state);
 			}
 			else
 			{
 				vzm::ObjStates cstate = default_obj_state;
 				cstate.is_visible = false;
-				vzm::ReplaceOrAddSceneObject(g_info.ws_scene_id, clf_mk_stg_calib_spheres_id, cstate);
-				vzm::ReplaceOrAddSceneObject(g_info.rs_scene_id, clf_mk_stg_calib_spheres_id, cstate);
+				scene_mirror::SetStates(MS_WS | MS_RS, clf_mk_stg_calib_spheres_id, cstate);
 			}
 		}
 		else
@@ -1751,11 +1990,9 @@ namespace var_settings
 			last_calib_pair = 0;
 			vzm::ObjStates cstate = default_obj_state;
 			cstate.is_visible = false;
-			vzm::ReplaceOrAddSceneObject(g_info.ws_scene_id, mk_stg_calib_sphere_id, cstate);
-			vzm::ReplaceOrAddSceneObject(g_info.rs_scene_id, mk_stg_calib_sphere_id, cstate);
+			scene_mirror::SetStates(MS_WS | MS_RS, mk_stg_calib_sphere_id, cstate);
 
-			vzm::ReplaceOrAddSceneObject(g_info.ws_scene_id, clf_mk_stg_calib_spheres_id, cstate);
-			vzm::ReplaceOrAddSceneObject(g_info.rs_scene_id, clf_mk_stg_calib_spheres_id, cstate);
+			scene_mirror::SetStates(MS_WS | MS_RS, clf_mk_stg_calib_spheres_id, cstate);
 		}
 
 		for (int i = 0; i < g_info.stg_display_num; i++)
@@ -1784,12 +2021,13 @@ namespace var_settings
 		cstate.is_visible = is_visible;
 		for (int i = 0; i < g_info.otrk_data.calib_trial_rs_cam_frame_ids.size(); i++)
 		{
-			vzm::ReplaceOrAddSceneObject(g_info.ws_scene_id, g_info.otrk_data.calib_trial_rs_cam_frame_ids[i], cstate);
+			scene_mirror::SetState(g_info.ws_scene_id, g_info.otrk_data.calib_trial_rs_cam_frame_ids[i], cstate);
 		}
 	}
 
 	void SetDepthMapPC(const bool is_visible, rs2::depth_frame& depth_frame, rs2::video_frame& color_frame)
 	{
+		PROF_ZONE("SetDepthMapPC");
 		if (is_visible && depth_frame)
 		{
 			//rs2::depth_frame depth_frame = depth_frame;// .get_depth_frame();
@@ -1799,144 +2037,73 @@ namespace var_settings
 			obj_state_pts.emission = 0.3f;
 			obj_state_pts.diffusion = 1.f;
 			obj_state_pts.surfel_size = 0.005f;
-			// Generate the pointcloud and texture mappings
-			rs_settings::pc.map_to(color_frame); // before pc.calculate, which generates texture_coordinates
-			rs_settings::points = rs_settings::pc.calculate(depth_frame);
-			if (rs_settings::points)
-			{
-				auto vertices = rs_settings::points.get_vertices();              // get vertices
-				auto tex_coords = rs_settings::points.get_texture_coordinates(); // and texture coordinates
-
-				vzm::CameraParameters _cam_params;
-				vzm::GetCameraParameters(g_info.ws_scene_id, _cam_params, ov_cam_id);
-
-				//vector<glm::fvec3> vtx;// (points.size());
-				//memcpy(&vtx[0], &vertices[0], sizeof(glm::fvec3) * points.size());
-				glm::fmat4x4 mat_r = glm::rotate(-glm::pi<float>(), glm::fvec3(1, 0, 0));
-				glm::fmat4x4 mat_rscs2ws = mat_clf2ws * mat_rscs2clf;
-				glm::fmat4x4 mat_os2ws;
 
+			glm::fmat4x4 mat_r = glm::rotate(-glm::pi<float>(), glm::fvec3(1, 0, 0));
+			glm::fmat4x4 mat_rscs2ws = mat_clf2ws * mat_rscs2clf;
+			glm::fmat4x4 mat_os2ws;
+			{
+				glm::fmat4x4 mat_rs2ws = mat_rscs2ws * mat_r;
+				const float *rv = rs_settings::rgb_extrinsics.rotation;
+				glm::fmat4x4 mat_rt(rv[0], rv[1], rv[2], 0, rv[3], rv[4], rv[5], 0, rv[6], rv[7], rv[8], 0,
+					rs_settings::rgb_extrinsics.translation[0], rs_settings::rgb_extrinsics.translation[1], rs_settings::rgb_extrinsics.translation[2], 1); // ignore 4th row 
+				mat_os2ws = mat_rs2ws * mat_rt; // depth to rgb (external)
+			}
+			// points stay in the depth camera space
+			*(glm::fmat4x4*) obj_state_pts.os2ws = mat_os2ws;
 
-				{
-					glm::fmat4x4 mat_rs2ws = mat_rscs2ws * mat_r;
-					const float *rv = rs_settings::rgb_extrinsics.rotation;
-					glm::fmat4x4 mat_rt(rv[0], rv[1], rv[2], 0, rv[3], rv[4], rv[5], 0, rv[6], rv[7], rv[8], 0,
-						rs_settings::rgb_extrinsics.translation[0], rs_settings::rgb_extrinsics.translation[1], rs_settings::rgb_extrinsics.translation[2], 1); // ignore 4th row 
-					//*(glm::fmat4x4*) obj_state_pts.os2ws = mat_rs2ws * mat_rt;
-					mat_os2ws = mat_rs2ws * mat_rt; // depth to rgb (external)
-				}
-				glm::fvec3* normalmap = NULL;
-				const int _w = depth_frame.as<rs2::video_frame>().get_width();
-				const int _h = depth_frame.as<rs2::video_frame>().get_height();
-				{
-					// compute face normal
-					normalmap = new glm::fvec3[_w * _h];
-					auto depth_color = depth_frame.apply_filter(rs_settings::color_map);
-					Mat image_depth(Size(_w, _h), CV_8UC3, (void*)depth_color.get_data(), Mat::AUTO_STEP);
-					imshow("test depth", image_depth);
+			const int _w = depth_frame.as<rs2::video_frame>().get_width();
+			const int _h = depth_frame.as<rs2::video_frame>().get_height();
+			{
+				auto depth_color = depth_frame.apply_filter(rs_settings::color_map);
+				Mat image_depth(Size(_w, _h), CV_8UC3, (void*)depth_color.get_data(), Mat::AUTO_STEP);
+				imshow("test depth", image_depth);
+			}
 
-					// 
-					glm::fmat4x4 mat_irss2os = mat_r * rs_settings::mat_irss2ircs;
-					glm::fmat4x4 mat_irss2ws = mat_os2ws * mat_irss2os;
-					glm::fvec3 pos_ir_cam_ws = tr_pt(mat_os2ws, glm::fvec3(0));
-					auto ComputePos_SSZ2WS = [](const int x, const int y, const float z, const glm::fvec3& pos_ir_cam_ws, const glm::fmat4x4& mat_irss2ws)
-					{
-						// g_cbCamState.mat_ss2ws
-						// g_cbCamState.dir_view_ws
-						// g_cbCamState.pos_cam_ws
-						// g_cbCamState.cam_flag & 0x1d
-						// g_cbCamState.rt_width
-						// deep_k_buf
-						glm::fvec3 pos_ip_ws = tr_pt(mat_irss2ws, glm::fvec3(x, y, 0));
-						// always perspective (do not consider orthogonal viewing)
-						glm::fvec3 view_dir_ws = pos_ip_ws - pos_ir_cam_ws;
-
-						view_dir_ws = normalize(view_dir_ws);
-						return pos_ip_ws + view_dir_ws * z;
-					};
-
-					//int z_valid_count = 0;
-					//float zmin = 1000000;
-					//float zmax = 0;
-					for (int i = 0; i < _h; i++)
-						for (int j = 0; j < _w; j++)
-						{
-							float z = depth_frame.get_distance(j, i);
-							//if (z > 0 && z < 100) 
-							//	z_valid_count++;
-							float z_dxR = depth_frame.get_distance(min(j + 1, _w - 1), i);
-							float z_dxL = depth_frame.get_distance(max(j - 1, 0), i);
-							float z_dyR = depth_frame.get_distance(j, min(i + 1, _h - 1));
-							float z_dyL = depth_frame.get_distance(j, max(i - 1, 0));
-							float zRx_diff = z - z_dxR;
-							float zLx_diff = z - z_dxL;
-							float zRy_diff = z - z_dyR;
-							float zLy_diff = z - z_dyL;
-							float z_dx = z_dxR, z_dy = z_dyR;
-							float x_offset = 1, y_offset = 1;
-							if (zRx_diff*zRx_diff > zLx_diff*zLx_diff)
-							{
-								z_dx = z_dxL;
-								x_offset *= -1;
-							}
-							if (zRy_diff*zRy_diff > zLy_diff*zLy_diff)
-							{
-								z_dy = z_dyL;
-								y_offset *= -1;
-							}
-							glm::fvec3 p = ComputePos_SSZ2WS(j, i, z, pos_ir_cam_ws, mat_irss2ws);
-							glm::fvec3 p_dx = ComputePos_SSZ2WS(j + x_offset, i, z_dx, pos_ir_cam_ws, mat_irss2ws);
-							glm::fvec3 p_dy = ComputePos_SSZ2WS(j, i + y_offset, z_dy, pos_ir_cam_ws, mat_irss2ws);
-							glm::fvec3 p_ddx = p_dx - p;
-							glm::fvec3 p_ddy = p_dy - p;
-							glm::fvec3 face_normal = glm::normalize(glm::cross(p_ddx, p_ddy));
-							normalmap[j + i * _w] = face_normal;
-						}
+			// positions and face normals (depth camera space) from the raw z16 buffer
+			// the intrinsics of the filtered (decimated) frame, not rs_settings::depth_intrinsics
+			rs2_intrinsics intr_depth = depth_frame.get_profile().as<rs2::video_stream_profile>().get_intrinsics();
+			depth_kernel.Compute((const uint16_t*)depth_frame.get_data(), depth_frame.get_stride_in_bytes(), intr_depth, depth_frame.get_units());
 
-				}
-				vector<glm::fvec2> tex(rs_settings::points.size());
-				memcpy(&tex[0], &tex_coords[0], sizeof(glm::fvec2) * rs_settings::points.size());
-				vector<glm::fvec3> color_pts(rs_settings::points.size());
-				vector<glm::fvec3> pos_pts(rs_settings::points.size());
-				vector<glm::fvec3> nrl_pts(rs_settings::points.size());
-				for (int i = 0; i < (int)rs_settings::points.size(); i++)
+			// zero-depth pixels are dropped (and the voxel decimation if set) before the upload
+			// color_frame is not used, the point cloud is uploaded without colors
+			if (!pc_stage.HasUploader())
+				pc_stage.SetUploader([](const float* xyz_list, const float* nrl_list, const float* rgb_list, const int num_pts)
 				{
-					float tx = tex[i].x * g_info.rs_w;
-					float ty = tex[i].y * g_info.rs_h;
-					int _tx = (int)tx;
-					int _ty = (int)ty;
-					if (_tx < 0 || _ty < 0 || _tx >= g_info.rs_w || _ty >= g_info.rs_h)
-						continue;
-					glm::u8vec3* _data = (glm::u8vec3*)color_frame.get_data();
-					glm::u8vec3 _color0 = _data[_tx + _ty * g_info.rs_w];
-					//glm::u8vec3 _color1 = _data[_tx + _ty * g_info.rs_w];
-					//glm::u8vec3 _color2 = _data[_tx + _ty * g_info.rs_w];
-					//glm::u8vec3 _color3 = _data[_tx + _ty * g_info.rs_w];
-					color_pts[i] = glm::fvec3(_color0.x / 255.f, _color0.y / 255.f, 1.f);// _color0.z / 255.f);
-					pos_pts[i] = tr_pt(mat_os2ws, *(glm::fvec3*)&vertices[i]);
-					if (normalmap) nrl_pts[i] = normalmap[i % _w + (i / _w) * _w];
-				}
-				if (normalmap) delete[] normalmap;
-				//vzm::GeneratePointCloudObject(__FP pos_pts[0], NULL, __FP color_pts[0], (int)points.size(), g_info.rs_pc_id);
-				vzm::GeneratePointCloudObject(__FP pos_pts[0], __FP nrl_pts[0], NULL, (int)rs_settings::points.size(), g_info.rs_pc_id);
-				vzm::ReplaceOrAddSceneObject(g_info.ws_scene_id, g_info.rs_pc_id, obj_state_pts);
-				vzm::ReplaceOrAddSceneObject(g_info.rs_scene_id, g_info.rs_pc_id, obj_state_pts);
-				vzm::ReplaceOrAddSceneObject(g_info.stg_scene_id, g_info.rs_pc_id, obj_state_pts);
+					vzm::GeneratePointCloudObject(xyz_list, nrl_list, rgb_list, num_pts, g_info.rs_pc_id);
+				});
+			pc_stage.Stage(depth_kernel);
+			mat_pc2ws = mat_os2ws;
+			if (pc_stage.Upload())
+			{
+				scene_mirror::SetStates(MS_WS | MS_RS | MS_STG, g_info.rs_pc_id, obj_state_pts);
 				bool foremost_surf_rendering = false;
 				vzm::SetRenderTestParam("_bool_OnlyForemostSurfaces", foremost_surf_rendering, sizeof(bool), g_info.ws_scene_id, ov_cam_id, g_info.rs_pc_id);
+				return;
 			}
 		}
-		else
+		if (g_info.rs_pc_id != 0)
 		{
 			vzm::ObjStates obj_state_pts;
-			vzm::GetSceneObjectState(g_info.ws_scene_id, g_info.rs_pc_id, obj_state_pts);
+			scene_mirror::GetState(g_info.ws_scene_id, g_info.rs_pc_id, obj_state_pts);
 			obj_state_pts.is_visible = false;
-			vzm::ReplaceOrAddSceneObject(g_info.ws_scene_id, g_info.rs_pc_id, obj_state_pts);
-			vzm::ReplaceOrAddSceneObject(g_info.rs_scene_id, g_info.rs_pc_id, obj_state_pts);
-			vzm::ReplaceOrAddSceneObject(g_info.stg_scene_id, g_info.rs_pc_id, obj_state_pts);
+			scene_mirror::SetStates(MS_WS | MS_RS | MS_STG, g_info.rs_pc_id, obj_state_pts);
 		}
 	}
 
+	void SetDepthMapPCVoxelSize(const float voxel_size)
+	{
+		pc_stage.SetVoxelSize(voxel_size);
+	}
+
+	void GetDepthMapPCStats(int& num_in, int& num_valid, int& num_out, long long& frames)
+	{
+		const pc_stage_stats& stats = pc_stage.GetStats();
+		num_in = stats.num_in;
+		num_valid = stats.num_valid;
+		num_out = stats.num_out;
+		frames = stats.frames;
+	}
+
 	void SetTargetModelAssets(const std::string& name, const int guide_line_idx)
 	{
 		g_info.match_model_rbs_name = name;
@@ -1962,9 +2129,7 @@ namespace var_settings
 				}
 				vzm::GenerateSpheresObject(__FP spheres_xyzr[0], __FP spheres_rgb[0], (int)g_info.model_rbs_pick_pts.size(), model_ws_pick_spheres_id);
 			}
-			vzm::ReplaceOrAddSceneObject(g_info.ws_scene_id, model_ws_pick_spheres_id, cstate);
-			vzm::ReplaceOrAddSceneObject(g_info.rs_scene_id, model_ws_pick_spheres_id, cstate);
-			vzm::ReplaceOrAddSceneObject(g_info.stg_scene_id, model_ws_pick_spheres_id, cstate);
+			scene_mirror::SetStates(MS_WS | MS_RS | MS_STG, model_ws_pick_spheres_id, cstate);
 		}
 
 		if (/*model_match_rb && */g_info.is_modelaligned)
@@ -1973,12 +2138,12 @@ namespace var_settings
 			vzm::ObjStates model_ws_obj_state;
 			vzm::ObjStates volume_ws_obj_state;
 			{
-				vzm::GetSceneObjectState(g_info.ws_scene_id, g_info.model_ws_obj_id, model_ws_obj_state);
+				scene_mirror::GetState(g_info.ws_scene_id, g_info.model_ws_obj_id, model_ws_obj_state);
 
 				__cm4__ model_ws_obj_state.os2ws = mat_matchmodelfrm2ws * g_info.mat_os2matchmodefrm;
 				//if (scenario == 1 || scenario == 2)
 				//{
-				vzm::GetSceneObjectState(g_info.ws_scene_id, g_info.model_volume_id, volume_ws_obj_state);
+				scene_mirror::GetState(g_info.ws_scene_id, g_info.model_volume_id, volume_ws_obj_state);
 
 				// TEMP
 				if (scenario == 0)
@@ -1994,9 +2159,7 @@ namespace var_settings
 
 				volume_ws_obj_state.is_visible = false;
 
-				vzm::ReplaceOrAddSceneObject(g_info.ws_scene_id, g_info.model_volume_id, volume_ws_obj_state);
-				vzm::ReplaceOrAddSceneObject(g_info.rs_scene_id, g_info.model_volume_id, volume_ws_obj_state);
-				vzm::ReplaceOrAddSceneObject(g_info.stg_scene_id, g_info.model_volume_id, volume_ws_obj_state);
+				scene_mirror::SetStates(MS_WS | MS_RS | MS_STG, g_info.model_volume_id, volume_ws_obj_state);
 				//
 				//	model_ws_obj_state.color[3] = 0.05f;
 				//	//model_ws_obj_state.point_thickness = 15;
@@ -2018,9 +2181,7 @@ namespace var_settings
 					vzm::SetRenderTestParam("_bool_IsOnlyHotSpotVisible", true, sizeof(bool), g_info.rs_scene_id, 1, g_info.model_ws_obj_id);
 				}
 
-				vzm::ReplaceOrAddSceneObject(g_info.ws_scene_id, g_info.model_ws_obj_id, model_ws_obj_state);
-				vzm::ReplaceOrAddSceneObject(g_info.rs_scene_id, g_info.model_ws_obj_id, model_ws_obj_state);
-				vzm::ReplaceOrAddSceneObject(g_info.stg_scene_id, g_info.model_ws_obj_id, model_ws_obj_state);
+				scene_mirror::SetStates(MS_WS | MS_RS | MS_STG, g_info.model_ws_obj_id, model_ws_obj_state);
 			}
 			// guide lines
 			g_info.guide_line_idx = guide_line_idx;
@@ -2040,11 +2201,7 @@ namespace var_settings
 				for (int i = 0; i < (int)(sizeof(guide_objs) / sizeof(int)); i++)
 				{
 					int obj_id = guide_objs[i];
-					vzm::ReplaceOrAddSceneObject(g_info.stg_scene_id, obj_id, guide_obj_state);
-					vzm::ReplaceOrAddSceneObject(g_info.rs_scene_id, obj_id, guide_obj_state);
-					vzm::ReplaceOrAddSceneObject(g_info.ws_scene_id, obj_id, guide_obj_state);
-					vzm::ReplaceOrAddSceneObject(g_info.znavi_rs_scene_id, obj_id, guide_obj_state);
-					vzm::ReplaceOrAddSceneObject(g_info.znavi_stg_scene_id, obj_id, guide_obj_state);
+					scene_mirror::SetStates(MS_WS | MS_RS | MS_STG | MS_ZNAVI_RS | MS_ZNAVI_STG, obj_id, guide_obj_state);
 				}
 
 				int num_guide_lines = (int)g_info.guide_lines_target_rbs.size();
@@ -2095,16 +2252,16 @@ namespace var_settings
 
 					glm::fvec3 line_pos[2] = { pos_guide_line, pos_guide_line + dir_guide_line * 1.f };
 					int& guide_line_id = guide_line_obj_ids[guide_line_idx];
-					vzm::GenerateLinesObject(__FP line_pos[0], NULL, 1, guide_line_id);
+					__cm4__ line_state.os2ws = g_info.prims.Line(line_pos[0], line_pos[1], NULL, guide_line_id);
 
 					glm::fvec3 cyl_pos[2] = { pos_guide_line, pos_guide_line + dir_guide_line * 0.3f };
 					float cyl_r = 0.004;
 					int& guide_cyl_id = guide_cylinder_obj_ids[guide_line_idx];
-					vzm::GenerateCylindersObject(__FP cyl_pos[0], __FP cyl_r, NULL, 1, guide_cyl_id);
+					__cm4__ cyl_state.os2ws = g_info.prims.Cylinder(cyl_pos[0], cyl_pos[1], cyl_r, NULL, guide_cyl_id);
 
 					static int guide_cyl_zoom_id = 0;
 					//cyl_r = 0.0015;
-					vzm::GenerateCylindersObject(__FP cyl_pos[0], __FP cyl_r, NULL, 1, guide_cyl_zoom_id);
+					g_info.prims.Cylinder(cyl_pos[0], cyl_pos[1], cyl_r, NULL, guide_cyl_zoom_id); // same os2ws as guide_cyl_id
 					
 					// 
 
@@ -2121,13 +2278,12 @@ namespace var_settings
 					//vzm::ReplaceOrAddSceneObject(g_info.ws_scene_id, guide_line_id, line_state);
 
 					// show dist line
-					g_info.closest_dist = MakeDistanceLine(-1, g_info.pos_probe_pin, closetPoint, 0.05, closest_dist_line_id, closest_dist_text_id);
+					g_info.closest_dist = MakeDistanceLine(g_info.prims, -1, g_info.pos_probe_pin, closetPoint, 0.05, closest_dist_line_id, closest_dist_text_id);
 					g_info.guide_probe_closest_point = closetPoint;
 					vzm::ObjStates closest_dist_line_state;
 					closest_dist_line_state.line_thickness = 5;
-					vzm::ReplaceOrAddSceneObject(g_info.stg_scene_id, closest_dist_line_id, closest_dist_line_state);
-					vzm::ReplaceOrAddSceneObject(g_info.rs_scene_id, closest_dist_line_id, closest_dist_line_state);
-					vzm::ReplaceOrAddSceneObject(g_info.ws_scene_id, closest_dist_line_id, closest_dist_line_state);
+					__cm4__ closest_dist_line_state.os2ws = g_info.prims.GetOs2Ws(closest_dist_line_id);
+					scene_mirror::SetStates(MS_WS | MS_RS | MS_STG, closest_dist_line_id, closest_dist_line_state);
 
 					SetDashEffectInRendering(g_info.stg_scene_id, 1, closest_dist_line_id, 0.01, true);
 					SetDashEffectInRendering(g_info.stg_scene_id, 2, closest_dist_line_id, 0.01, true);
@@ -2135,7 +2291,7 @@ namespace var_settings
 					SetDashEffectInRendering(g_info.ws_scene_id, 1, closest_dist_line_id, 0.01, true);
 
 					// show angle
-					g_info.angle = MakeAngle3(g_info.dir_probe_se, dir_guide_line, closetPoint, 0.05, 0.1, angle_id, 
+					g_info.angle = MakeAngle3(g_info.prims, g_info.dir_probe_se, dir_guide_line, closetPoint, 0.05, 0.1, angle_id, 
 						g_info.rs_scene_id, angle_text_id, g_info.stg_scene_id, angle_text_id_stg,
 						g_info.ws_scene_id, angle_text_id_ws);
 					vzm::ObjStates angle_state, angle_text_state;
@@ -2144,12 +2300,14 @@ namespace var_settings
 					angle_state.specular = 0.f;
 					angle_state.color[3] = 0.8;
 					__cv4__ angle_text_state.color = glm::fvec4(1);
-					vzm::ReplaceOrAddSceneObject(g_info.stg_scene_id, angle_id, angle_state);
-					vzm::ReplaceOrAddSceneObject(g_info.stg_scene_id, angle_text_id_stg, angle_text_state);
-					vzm::ReplaceOrAddSceneObject(g_info.ws_scene_id, angle_id, angle_state);
-					vzm::ReplaceOrAddSceneObject(g_info.ws_scene_id, angle_text_id_ws, angle_text_state);
-					vzm::ReplaceOrAddSceneObject(g_info.rs_scene_id, angle_id, angle_state);
-					vzm::ReplaceOrAddSceneObject(g_info.rs_scene_id, angle_text_id, angle_text_state);
+					__cm4__ angle_state.os2ws = g_info.prims.GetOs2Ws(angle_id);
+					scene_mirror::SetStates(MS_WS | MS_RS | MS_STG, angle_id, angle_state);
+					__cm4__ angle_text_state.os2ws = g_info.prims.GetOs2Ws(angle_text_id_stg);
+					scene_mirror::SetState(g_info.stg_scene_id, angle_text_id_stg, angle_text_state);
+					__cm4__ angle_text_state.os2ws = g_info.prims.GetOs2Ws(angle_text_id_ws);
+					scene_mirror::SetState(g_info.ws_scene_id, angle_text_id_ws, angle_text_state);
+					__cm4__ angle_text_state.os2ws = g_info.prims.GetOs2Ws(angle_text_id);
+					scene_mirror::SetState(g_info.rs_scene_id, angle_text_id, angle_text_state);
 
 
 					// color coding w.r.t. distance and angle. //
@@ -2179,7 +2337,8 @@ namespace var_settings
 					// tool tip
 					vzm::ObjStates tooltipState;
 					//cout << probe_tip_id << endl;
-					vzm::GetSceneObjectState(g_info.ws_scene_id, probe_tip_id, tooltipState);
+					scene_mirror::GetState(g_info.ws_scene_id, probe_tip_id, tooltipState);
+					__cm4__ tooltipState.os2ws = g_info.prims.GetOs2Ws(probe_tip_id);
 
 					if (g_info.closest_dist <= 0.004) {
 						float r = 0 / 255.0;
@@ -2197,9 +2356,7 @@ namespace var_settings
 						__cv3__ tooltipState.color = glm::fvec3(r, g, b);
 						tooltipState.color[3] =o;
 					}
-					vzm::ReplaceOrAddSceneObject(g_info.ws_scene_id, probe_tip_id, tooltipState);
-					vzm::ReplaceOrAddSceneObject(g_info.rs_scene_id, probe_tip_id, tooltipState);
-					vzm::ReplaceOrAddSceneObject(g_info.stg_scene_id, probe_tip_id, tooltipState);
+					scene_mirror::SetStates(MS_WS | MS_RS | MS_STG, probe_tip_id, tooltipState);
 					
 
 					SetDashEffectInRendering(g_info.stg_scene_id, 1, guide_line_id, 0.01, false);
@@ -2211,39 +2368,32 @@ namespace var_settings
 						int line_obj_id = guide_line_obj_ids[i];
 						line_state.is_visible = cyl_state.is_visible = i == guide_line_idx;
 	
-						vzm::ReplaceOrAddSceneObject(g_info.stg_scene_id, line_obj_id, line_state);
-						vzm::ReplaceOrAddSceneObject(g_info.rs_scene_id, line_obj_id, line_state);
-						vzm::ReplaceOrAddSceneObject(g_info.ws_scene_id, line_obj_id, line_state);
+						scene_mirror::SetStates(MS_WS | MS_RS | MS_STG, line_obj_id, line_state);
 						//vzm::ReplaceOrAddSceneObject(g_info.znavi_rs_scene_id, line_obj_id, line_state);
 						//vzm::ReplaceOrAddSceneObject(g_info.znavi_stg_scene_id, line_obj_id, line_state);
 
 						int cyl_obj_id = guide_cylinder_obj_ids[i];
-						vzm::ReplaceOrAddSceneObject(g_info.stg_scene_id, cyl_obj_id, cyl_state);
-						vzm::ReplaceOrAddSceneObject(g_info.rs_scene_id, cyl_obj_id, cyl_state);
-						vzm::ReplaceOrAddSceneObject(g_info.ws_scene_id, cyl_obj_id, cyl_state);
+						scene_mirror::SetStates(MS_WS | MS_RS | MS_STG, cyl_obj_id, cyl_state);
 						//vzm::ReplaceOrAddSceneObject(g_info.znavi_rs_scene_id, cyl_obj_id, cyl_state);
 						//vzm::ReplaceOrAddSceneObject(g_info.znavi_stg_scene_id, cyl_obj_id, cyl_state);
 
 						line_state.is_visible = true;
 						cyl_state.is_visible = true;
-						vzm::ReplaceOrAddSceneObject(g_info.znavi_rs_scene_id, guide_cyl_zoom_id, cyl_state);
-						vzm::ReplaceOrAddSceneObject(g_info.znavi_stg_scene_id, guide_cyl_zoom_id, cyl_state);
+						scene_mirror::SetStates(MS_ZNAVI_RS | MS_ZNAVI_STG, guide_cyl_zoom_id, cyl_state);
 					}
 
 					// zoom navi view //
 					{
 						// probe tip
-						vzm::ReplaceOrAddSceneObject(g_info.znavi_rs_scene_id, probe_tip_id, tooltipState);
-						vzm::ReplaceOrAddSceneObject(g_info.znavi_stg_scene_id, probe_tip_id, tooltipState);
+						scene_mirror::SetStates(MS_ZNAVI_RS | MS_ZNAVI_STG, probe_tip_id, tooltipState);
 
 						// displacement arrow
 						static int guide_dist_arrow_id = 0;
 						vzm::ObjStates guide_dist_arrow_state;
 						__cv4__ guide_dist_arrow_state.color = glm::fvec4(1, 0.5, 1, 0.5);
 
-						vzm::GenerateArrowObject(__FP g_info.pos_probe_pin, __FP closetPoint, 0.0015f, 0.003f, guide_dist_arrow_id);
-						vzm::ReplaceOrAddSceneObject(g_info.znavi_rs_scene_id, guide_dist_arrow_id, guide_dist_arrow_state);
-						vzm::ReplaceOrAddSceneObject(g_info.znavi_stg_scene_id, guide_dist_arrow_id, guide_dist_arrow_state);
+						__cm4__ guide_dist_arrow_state.os2ws = g_info.prims.Arrow(g_info.pos_probe_pin, closetPoint, 0.0015f, 0.003f, guide_dist_arrow_id);
+						scene_mirror::SetStates(MS_ZNAVI_RS | MS_ZNAVI_STG, guide_dist_arrow_id, guide_dist_arrow_state);
 					}
 				}
 			}
@@ -2263,15 +2413,15 @@ namespace var_settings
 			if (g_info.model_volume_id == 0)
 			{
 				vzm::ObjStates model_ws_obj_state;
-				vzm::GetSceneObjectState(g_info.ws_scene_id, g_info.model_ws_obj_id, model_ws_obj_state);
-				vzm::ReplaceOrAddSceneObject(g_info.csection_scene_id, g_info.model_ws_obj_id, model_ws_obj_state);
+				scene_mirror::GetState(g_info.ws_scene_id, g_info.model_ws_obj_id, model_ws_obj_state);
+				scene_mirror::SetState(g_info.csection_scene_id, g_info.model_ws_obj_id, model_ws_obj_state);
 			}
 			else
 			{
 				vzm::ObjStates volume_ws_obj_state;
-				vzm::GetSceneObjectState(g_info.ws_scene_id, g_info.model_volume_id, volume_ws_obj_state);
+				scene_mirror::GetState(g_info.ws_scene_id, g_info.model_volume_id, volume_ws_obj_state);
 				volume_ws_obj_state.is_visible = true;
-				vzm::ReplaceOrAddSceneObject(g_info.csection_scene_id, g_info.model_volume_id, volume_ws_obj_state);
+				scene_mirror::SetState(g_info.csection_scene_id, g_info.model_volume_id, volume_ws_obj_state);
 			}
 
 			vzm::CameraParameters csection_cam_params_model;
@@ -2301,352 +2451,594 @@ namespace var_settings
 		}
 	}
 
-	void RenderAndShowWindows(bool show_times, Mat& img_rs, bool skip_show_rs_window, int addtional_scene, int addtional_cam)
+	// views of RenderAndShowWindows, the worker threads are started at the first frame (not while the dll is loading)
+	view_graph* frame_views = NULL;
+	int ws_view_idx = -1, rs_view_idx = -1, stg_view_idx = -1;
+
+	// buffers passed from the Render stage of a view to its Process and Present stages
+	struct frame_view_buffers
 	{
-		auto DisplayTimes = [&show_times](const LARGE_INTEGER lIntCntStart, const string& _test)
-		{
-			return;
-			if (!show_times) return;
-			LARGE_INTEGER lIntFreq, lIntCntEnd;
-			QueryPerformanceFrequency(&lIntFreq);
-			QueryPerformanceCounter(&lIntCntEnd);
-			double dRunTime1 = (lIntCntEnd.QuadPart - lIntCntStart.QuadPart) / (double)(lIntFreq.QuadPart);
+		// ws
+		Mat img_ws;
+		string ws_text;
+		// rs
+		Mat* img_rs;
+		bool show_rs_window;
+		unsigned char* rs_rgba; // NULL : the camera image only
+		int rs_w, rs_h;
+		unsigned char* ms_rgba; // model view over the rs view (Align)
+		int ms_w, ms_h;
+		int num_cs; // sectional views
+		unsigned char* cs_rgba[2];
+		int cs_w[2], cs_h[2];
+		unsigned char* znavi_rgba; // NULL : no z-navigation view
+		int znavi_w, znavi_h;
+		float znavi_dist; // mm
+		// stg
+		bool is_stg_calibrated;
+		unsigned char* stg_rgba[2];
+		int stg_w[2], stg_h[2];
+		Mat img_stg, img_stg_fb; // img_stg : presented, img_stg_fb : stereo or not calibrated
+	};
+	frame_view_buffers view_bufs;
 
-			cout << _test << " : " << 1. / dRunTime1 << " fps" << endl;
-		};
-		auto GetPerformanceFreq = []() -> LARGE_INTEGER
-		{
-			LARGE_INTEGER lIntCntFreq;
-			QueryPerformanceCounter(&lIntCntFreq);
-			return lIntCntFreq;
-		};
+#define ENABLE_STG
+#define SHOW_WS_VIEW
+#define SHOW_RS_VIEW
+#define SHOW_MS_VIEW
+#define SHOW_SECTION_VIEW
+#define SHOW_STG_VIEW
 
-		auto RenderToolNavi = []()
+	bool RenderToolNavi()
+	{
+		using namespace glm;
+
+		bool draw_znavi = g_info.is_probe_detected && g_info.is_modelaligned && g_info.guide_lines_target_rbs.size() > 0 && g_info.guide_line_idx >= 0;
+		if (draw_znavi)
 		{
-			using namespace glm;
+			vzm::CameraParameters zoom_cam_params;
+
+			zoom_cam_params.fov_y = 3.141592654f / 4.f;
+			zoom_cam_params.aspect_ratio = (float)g_info.zn_w / (float)g_info.zn_h;
+			//cout << g_info.zn_w << ", " << g_info.zn_h << endl;
+			zoom_cam_params.projection_mode = 2;
+			zoom_cam_params.w = g_info.zn_w;
+			zoom_cam_params.h = g_info.zn_h;
+			zoom_cam_params.np = 0.01f;
+			zoom_cam_params.fp = 10.0f;
+			__cv3__ zoom_cam_params.pos = g_info.pos_probe_pin + g_info.dir_probe_se * 0.1f;
+			__cv3__ zoom_cam_params.view = -g_info.dir_probe_se;
+			glm::fvec3 right = glm::normalize(glm::cross(-g_info.dir_probe_se, glm::fvec3(0, 1, 0)));
+			__cv3__ zoom_cam_params.up = glm::normalize(glm::cross(right, -g_info.dir_probe_se));
+
+			vzm::SetCameraParameters(g_info.znavi_rs_scene_id, zoom_cam_params, znavi_cam_id);
+			vzm::SetCameraParameters(g_info.znavi_stg_scene_id, zoom_cam_params, znavi_cam_id);
+
+			vzm::RenderScene(g_info.znavi_rs_scene_id, znavi_cam_id);
+			vzm::RenderScene(g_info.znavi_stg_scene_id, znavi_cam_id);
+		}
+		return draw_znavi;
+	}
 
-			bool draw_znavi = g_info.is_probe_detected && g_info.is_modelaligned && g_info.guide_lines_target_rbs.size() > 0 && g_info.guide_line_idx >= 0;
-			if (draw_znavi)
-			{
-				vzm::CameraParameters zoom_cam_params;
+	void WorldCamSet()
+	{
+		using namespace glm;
+		fvec3 up = fvec3(0, 1, 0);
+		fvec3 view = -g_info.dir_probe_se;
+		fvec3 left = normalize(cross(up, view));
+		fvec3 pos_lookat = g_info.pos_probe_pin;// +g_info.dir_probe_se * 0.1f;
 
-				zoom_cam_params.fov_y = 3.141592654f / 4.f;
-				zoom_cam_params.aspect_ratio = (float)g_info.zn_w / (float)g_info.zn_h;
-				//cout << g_info.zn_w << ", " << g_info.zn_h << endl;
-				zoom_cam_params.projection_mode = 2;
-				zoom_cam_params.w = g_info.zn_w;
-				zoom_cam_params.h = g_info.zn_h;
-				zoom_cam_params.np = 0.01f;
-				zoom_cam_params.fp = 10.0f;
-				__cv3__ zoom_cam_params.pos = g_info.pos_probe_pin + g_info.dir_probe_se * 0.1f;
-				__cv3__ zoom_cam_params.view = -g_info.dir_probe_se;
-				glm::fvec3 right = glm::normalize(glm::cross(-g_info.dir_probe_se, glm::fvec3(0, 1, 0)));
-				__cv3__ zoom_cam_params.up = glm::normalize(glm::cross(right, -g_info.dir_probe_se));
+		vzm::CameraParameters cam_param;
+		vzm::GetCameraParameters(g_info.ws_scene_id, cam_param, ov_cam_id);
 
-				vzm::SetCameraParameters(g_info.znavi_rs_scene_id, zoom_cam_params, znavi_cam_id);
-				vzm::SetCameraParameters(g_info.znavi_stg_scene_id, zoom_cam_params, znavi_cam_id);
+		__cv3__ cam_param.pos = pos_lookat + left * 0.3f;
+		__cv3__ cam_param.up = up;
+		__cv3__ cam_param.view = -left;
 
-				vzm::RenderScene(g_info.znavi_rs_scene_id, znavi_cam_id);
-				vzm::RenderScene(g_info.znavi_stg_scene_id, znavi_cam_id);
-			}
-			return draw_znavi;
-		};
+		vzm::SetCameraParameters(g_info.ws_scene_id, cam_param, ov_cam_id);
+	}
 
-		auto WorldCamSet = []()
-		{
-			using namespace glm;
-			fvec3 up = fvec3(0, 1, 0);
-			fvec3 view = -g_info.dir_probe_se;
-			fvec3 left = normalize(cross(up, view));
-			fvec3 pos_lookat = g_info.pos_probe_pin;// +g_info.dir_probe_se * 0.1f;
+	// ws view
+	bool RenderWsView()
+	{
+		PROF_ZONE("ws render");
+		vzm::RenderScene(g_info.ws_scene_id, ov_cam_id);
+		unsigned char* ptr_rgba;
+		float* ptr_zdepth;
+		int w, h;
+		if (!vzm::GetRenderBufferPtrs(g_info.ws_scene_id, &ptr_rgba, &ptr_zdepth, &w, &h, ov_cam_id)) return false;
+		view_bufs.img_ws = Mat(h, w, CV_8UC4, ptr_rgba);
+		view_bufs.ws_text = "# of current 3D pick positions : " + to_string(g_info.otrk_data.calib_3d_pts.size());
+		return true;
+	}
 
-			vzm::CameraParameters cam_param;
-			vzm::GetCameraParameters(g_info.ws_scene_id, cam_param, ov_cam_id);
+	void ProcessWsView()
+	{
+		cv::putText(view_bufs.img_ws, view_bufs.ws_text, cv::Point(3, 30), cv::FONT_HERSHEY_DUPLEX, 0.5, CV_RGB(255, 185, 255), 1, LineTypes::LINE_AA);
+	}
 
-			__cv3__ cam_param.pos = pos_lookat + left * 0.3f;
-			__cv3__ cam_param.up = up;
-			__cv3__ cam_param.view = -left;
+	void PresentWsView()
+	{
+		imshow(g_info.window_name_ws_view, view_bufs.img_ws);
+	}
 
-			vzm::SetCameraParameters(g_info.ws_scene_id, cam_param, ov_cam_id);
-		};
+	// rs view (render buffers, sectional and z-navigation views over the camera image)
+	bool RenderRsView()
+	{
+		frame_view_buffers& vb = view_bufs;
+		vb.rs_rgba = vb.ms_rgba = vb.znavi_rgba = NULL;
+		vb.num_cs = 0;
+		if (!g_info.is_calib_rs_cam) return true;
 
-		if (!g_info.skip_call_render)
 		{
-#define ENABLE_STG
-#define SHOW_WS_VIEW
-#define SHOW_RS_VIEW
-#define SHOW_MS_VIEW
-#define SHOW_SECTION_VIEW
-#define SHOW_STG_VIEW
-#ifdef SHOW_WS_VIEW
-			LARGE_INTEGER frq_render_ws = GetPerformanceFreq();
-
-			if (g_info.is_modelaligned && g_info.is_probe_detected)
-				WorldCamSet();
+			PROF_ZONE("rs render");
+			vzm::RenderScene(g_info.rs_scene_id, rs_cam_id);
+		}
+		float* ptr_zdepth;
+		if (!vzm::GetRenderBufferPtrs(g_info.rs_scene_id, &vb.rs_rgba, &ptr_zdepth, &vb.rs_w, &vb.rs_h, rs_cam_id))
+		{
+			vb.rs_rgba = NULL;
+			return true;
+		}
 
-			string tc_calib_info = "# of current 3D pick positions : " + to_string(g_info.otrk_data.calib_3d_pts.size());
-			Show_Window(g_info.window_name_ws_view, g_info.ws_scene_id, ov_cam_id, &tc_calib_info);
-			DisplayTimes(frq_render_ws, "ws render : ");
-#endif
+		if (g_info.touch_mode == RsTouchMode::Align)
+		{
+			if (!vzm::GetRenderBufferPtrs(g_info.model_scene_id, &vb.ms_rgba, &ptr_zdepth, &vb.ms_w, &vb.ms_h, model_cam_id))
+				vb.ms_rgba = NULL;
+		}
+		else if (g_info.is_modelaligned)
+		{
+			if (_show_sectional_views)
+			{
+				vzm::RenderScene(g_info.csection_scene_id, 0);
+				vzm::RenderScene(g_info.csection_scene_id, 1);
+				for (int i = 0; i < 2; i++)
+					vzm::GetRenderBufferPtrs(g_info.csection_scene_id, &vb.cs_rgba[i], &ptr_zdepth, &vb.cs_w[i], &vb.cs_h[i], i);
+				vb.num_cs = 2;
+			}
 
-#ifdef SHOW_RS_VIEW
-			if (g_info.is_calib_rs_cam)
-			{
-				LARGE_INTEGER frq_render_rs = GetPerformanceFreq();
-				vzm::RenderScene(g_info.rs_scene_id, rs_cam_id);
-				DisplayTimes(frq_render_rs, "rs render : ");
-				unsigned char* ptr_rgba;
-				float* ptr_zdepth;
-				int rs_w, rs_h;
-				LARGE_INTEGER frq_render_cb = GetPerformanceFreq();
-				if (vzm::GetRenderBufferPtrs(g_info.rs_scene_id, &ptr_rgba, &ptr_zdepth, &rs_w, &rs_h, rs_cam_id))
-					copy_back_ui_buffer(img_rs.data, ptr_rgba, rs_w, rs_h, false);
+			if (RenderToolNavi())
+			{
+				vzm::GetRenderBufferPtrs(g_info.znavi_rs_scene_id, &vb.znavi_rgba, &ptr_zdepth, &vb.znavi_w, &vb.znavi_h, 1);
 
-				if (g_info.touch_mode == RsTouchMode::Align)
+				glm::fmat4x4 tr;
+				//{
+				//	glm::fmat4x4 mat_matchmodelfrm2ws;
+				//	g_info.otrk_data.trk_info.GetLFrmInfo(g_info.match_model_rbs_name, mat_matchmodelfrm2ws);
+				//	tr = mat_matchmodelfrm2ws * g_info.mat_os2matchmodefrm;
+				//	if (scenario == 0)
+				//	{
+				//		glm::fmat4x4 mat_s = glm::scale(glm::fvec3(-1, -1, 1));
+				//		glm::fmat4x4 mat_t = glm::translate(glm::fvec3(dicom_tr_x, dicom_tr_y, dicom_tr_z));
+				//		tr = tr * mat_t * mat_s;
+				//	}
+				//}
 				{
-					unsigned char* ms_ptr_rgba;
-					float* ms_ptr_zdepth;
-					int ms_w, ms_h;
-					if (vzm::GetRenderBufferPtrs(g_info.model_scene_id, &ms_ptr_rgba, &ms_ptr_zdepth, &ms_w, &ms_h, model_cam_id))
-					{
-						cv::Mat cs_cvmat(ms_h, ms_w, CV_8UC4, ms_ptr_rgba);
-
-						copy_back_ui_buffer_local(img_rs.data, rs_w, rs_h, ms_ptr_rgba, ms_w, ms_h, 10, 100, false, true, 0.2f, 50.f, false);
-					}
+					vzm::ObjStates volume_ws_obj_state;
+					scene_mirror::GetState(g_info.ws_scene_id, g_info.model_volume_id, volume_ws_obj_state);
+					tr = __cm4__ volume_ws_obj_state.os2ws;
 				}
-#ifdef SHOW_RS_VIEW
-				else if (g_info.is_modelaligned)
-				{
-					if (_show_sectional_views)
-					{
-						vzm::RenderScene(g_info.csection_scene_id, 0);
-						vzm::RenderScene(g_info.csection_scene_id, 1);
-
-						for (int i = 0; i < 2; i++)
-						{
-							unsigned char* cs_ptr_rgba;
-							float* cs_ptr_zdepth;
-							int cs_w, cs_h;
-							vzm::GetRenderBufferPtrs(g_info.csection_scene_id, &cs_ptr_rgba, &cs_ptr_zdepth, &cs_w, &cs_h, i);
-							cv::Mat cs_cvmat(cs_h, cs_w, CV_8UC4, cs_ptr_rgba);
-							cv::line(cs_cvmat, cv::Point(cs_w / 2, cs_h / 2), cv::Point(cs_w / 2, 0), cv::Scalar(255, 255, 0, 255), 2, LineTypes::LINE_AA);
-							cv::circle(cs_cvmat, cv::Point(cs_w / 2, cs_h / 2), 2, cv::Scalar(255, 0, 0, 255), 2, LineTypes::LINE_AA);
-							//cv::rectangle(cs_cvmat, Rect(10, 100, 10 + cs_w * (i + 1), 100 + cs_h), Scalar(200, 200, 200, 255), 1, LineTypes::LINE_AA);
-
-							copy_back_ui_buffer_local(img_rs.data, rs_w, rs_h, cs_ptr_rgba, cs_w, cs_h, 10 + cs_w * i, 100, false, true, 3.f, 5.f, true);
-						}
-					}
+				const pair< glm::fvec3, glm::fvec3>& guide_line = g_info.guide_lines_target_rbs[g_info.guide_line_idx];
+				glm::fvec3 pos_guide_line = tr_pt(tr, get<0>(guide_line));
 
-					if (RenderToolNavi())
-					{
-						unsigned char* znavi_rs_ptr_rgba;
-						float* znavi_rs_ptr_zdepth;
-						int znavi_rs_w, znavi_rs_h;
-						vzm::GetRenderBufferPtrs(g_info.znavi_rs_scene_id, &znavi_rs_ptr_rgba, &znavi_rs_ptr_zdepth, &znavi_rs_w, &znavi_rs_h, 1);
-						cv::Mat znavi_rs_cvmat(znavi_rs_w, znavi_rs_h, CV_8UC4, znavi_rs_ptr_rgba);
-
-						glm::fmat4x4 tr;
-						//{
-						//	glm::fmat4x4 mat_matchmodelfrm2ws;
-						//	g_info.otrk_data.trk_info.GetLFrmInfo(g_info.match_model_rbs_name, mat_matchmodelfrm2ws);
-						//	tr = mat_matchmodelfrm2ws * g_info.mat_os2matchmodefrm;
-						//	if (scenario == 0)
-						//	{
-						//		glm::fmat4x4 mat_s = glm::scale(glm::fvec3(-1, -1, 1));
-						//		glm::fmat4x4 mat_t = glm::translate(glm::fvec3(dicom_tr_x, dicom_tr_y, dicom_tr_z));
-						//		tr = tr * mat_t * mat_s;
-						//	}
-						//}
-						{
-							vzm::ObjStates volume_ws_obj_state;
-							vzm::GetSceneObjectState(g_info.ws_scene_id, g_info.model_volume_id, volume_ws_obj_state);
-							tr = __cm4__ volume_ws_obj_state.os2ws;
-						}
-						const pair< glm::fvec3, glm::fvec3>& guide_line = g_info.guide_lines_target_rbs[g_info.guide_line_idx];
-						glm::fvec3 pos_guide_line = tr_pt(tr, get<0>(guide_line));
-						glm::fvec3 dir_guide_line = glm::normalize(tr_vec2(tr, get<1>(guide_line)));
-
-						glm::fvec3 guide_probe_closest_point = g_info.guide_probe_closest_point;
-
-						float maxDistance = 99;
-						float currentDistance = glm::length(guide_probe_closest_point - pos_guide_line) * 1000;
-						if (currentDistance >= maxDistance) { currentDistance = maxDistance; }
-
-						int znavi_x_pos = 10;
-						int znavi_y_pos = 250;
-						int barX = 10 + znavi_x_pos, barY = 10 + znavi_y_pos, textOffset = 5;
-						float barMaxLength = 200;
-						float currentBarLength = (currentDistance / maxDistance) * barMaxLength;
-
-						//cv::line(znavi_rs_cvmat, cv::Point(barX, barY), cv::Point(barX, barY + barMaxLength), cv::Scalar(125, 125, 125, 255), 10, LineTypes::LINE_AA);
-						//cv::line(znavi_rs_cvmat, cv::Point(barX, barY), cv::Point(barX, barMaxLength - (barY + currentBarLength)), cv::Scalar(255, 255, 0, 255), 10, LineTypes::LINE_AA);
-						//string distanceText = to_string_with_precision(currentDistance, 2) + " mm";
-						//cv::putText(znavi_rs_cvmat, distanceText, cv::Point(barX + textOffset, barMaxLength - (barY + currentBarLength)), cv::FONT_HERSHEY_DUPLEX, 0.7, Scalar(255, 255, 255, 255), 1, LineTypes::LINE_AA);
-
-						copy_back_ui_buffer_local(img_rs.data, rs_w, rs_h, znavi_rs_ptr_rgba, znavi_rs_w, znavi_rs_h, znavi_x_pos, znavi_y_pos, false, true, 0.4f, 20.f, false);
-
-						cv::line(img_rs, cv::Point(barX, barY), cv::Point(barX, barY + barMaxLength), cv::Scalar(125, 125, 125, 255), 10, LineTypes::LINE_AA);
-						cv::line(img_rs, cv::Point(barX, barY), cv::Point(barX, barY + barMaxLength - currentBarLength), cv::Scalar(255, 255, 0, 255), 10, LineTypes::LINE_AA);
-						string distanceText = to_string_with_precision(currentDistance, 2) + " mm";
-						cv::putText(img_rs, distanceText, cv::Point(barX + textOffset, barY + barMaxLength - currentBarLength), cv::FONT_HERSHEY_DUPLEX, 0.7, Scalar(255, 255, 255, 255), 1, LineTypes::LINE_AA);
-					}
-				}
-#endif
+				glm::fvec3 guide_probe_closest_point = g_info.guide_probe_closest_point;
+				vb.znavi_dist = glm::length(guide_probe_closest_point - pos_guide_line) * 1000;
+			}
+		}
+		return true;
+	}
 
-				DisplayTimes(frq_render_rs, "rs copy-back : ");
+	void ProcessRsView()
+	{
+		frame_view_buffers& vb = view_bufs;
+		Mat& img_rs = *vb.img_rs;
+		if (vb.rs_rgba)
+		{
+			const int rs_w = vb.rs_w, rs_h = vb.rs_h;
+			{
+				PROF_ZONE("copy_back_ui_buffer");
+				copy_back_ui_buffer(img_rs.data, vb.rs_rgba, rs_w, rs_h, false);
 			}
 
-			// draw buttons
-			Draw_TouchButtons(img_rs, g_info.rs_buttons, g_info.touch_mode);
+			if (vb.ms_rgba)
+			{
+				PROF_ZONE("copy_back_ui_buffer_local");
+				copy_back_ui_buffer_local(img_rs.data, rs_w, rs_h, vb.ms_rgba, vb.ms_w, vb.ms_h, 10, 100, false, true, 0.2f, 50.f, false);
+			}
 
-			if (g_info.is_calib_rs_cam && !is_rsrb_detected)
-				cv::putText(img_rs, "RS Cam is out of tracking volume !!", cv::Point(0, 150), cv::FONT_HERSHEY_DUPLEX, 2.0, CV_RGB(255, 0, 0), 3, LineTypes::LINE_AA);
-			else
+			for (int i = 0; i < vb.num_cs; i++)
 			{
-				if (operation_name == "Picking AR Markers"
-					|| operation_name == "Picking Tool Tip and End")
+				const int cs_w = vb.cs_w[i], cs_h = vb.cs_h[i];
+				cv::Mat cs_cvmat(cs_h, cs_w, CV_8UC4, vb.cs_rgba[i]);
+				cv::line(cs_cvmat, cv::Point(cs_w / 2, cs_h / 2), cv::Point(cs_w / 2, 0), cv::Scalar(255, 255, 0, 255), 2, LineTypes::LINE_AA);
+				cv::circle(cs_cvmat, cv::Point(cs_w / 2, cs_h / 2), 2, cv::Scalar(255, 0, 0, 255), 2, LineTypes::LINE_AA);
+				//cv::rectangle(cs_cvmat, Rect(10, 100, 10 + cs_w * (i + 1), 100 + cs_h), Scalar(200, 200, 200, 255), 1, LineTypes::LINE_AA);
+
 				{
-					cv::putText(img_rs, operation_name, cv::Point(0, 150), cv::FONT_HERSHEY_DUPLEX, 2.0, CV_RGB(255, 0, 0), 2, LineTypes::LINE_AA);
+					PROF_ZONE("copy_back_ui_buffer_local");
+					copy_back_ui_buffer_local(img_rs.data, rs_w, rs_h, vb.cs_rgba[i], cs_w, cs_h, 10 + cs_w * i, 100, false, true, 3.f, 5.f, true);
 				}
 			}
 
-			if(!skip_show_rs_window)
-				imshow(g_info.window_name_rs_view, img_rs);
+			if (vb.znavi_rgba)
+			{
+				float maxDistance = 99;
+				float currentDistance = vb.znavi_dist;
+				if (currentDistance >= maxDistance) { currentDistance = maxDistance; }
+
+				int znavi_x_pos = 10;
+				int znavi_y_pos = 250;
+				int barX = 10 + znavi_x_pos, barY = 10 + znavi_y_pos, textOffset = 5;
+				float barMaxLength = 200;
+				float currentBarLength = (currentDistance / maxDistance) * barMaxLength;
 
-#ifdef __MIRRORS
-			//if(scenario != 0)
+				{
+					PROF_ZONE("copy_back_ui_buffer_local");
+					copy_back_ui_buffer_local(img_rs.data, rs_w, rs_h, vb.znavi_rgba, vb.znavi_w, vb.znavi_h, znavi_x_pos, znavi_y_pos, false, true, 0.4f, 20.f, false);
+				}
+
+				cv::line(img_rs, cv::Point(barX, barY), cv::Point(barX, barY + barMaxLength), cv::Scalar(125, 125, 125, 255), 10, LineTypes::LINE_AA);
+				cv::line(img_rs, cv::Point(barX, barY), cv::Point(barX, barY + barMaxLength - currentBarLength), cv::Scalar(255, 255, 0, 255), 10, LineTypes::LINE_AA);
+				string distanceText = to_string_with_precision(currentDistance, 2) + " mm";
+				cv::putText(img_rs, distanceText, cv::Point(barX + textOffset, barY + barMaxLength - currentBarLength), cv::FONT_HERSHEY_DUPLEX, 0.7, Scalar(255, 255, 255, 255), 1, LineTypes::LINE_AA);
+			}
+		}
+
+		// draw buttons
+		Draw_TouchButtons(img_rs, g_info.rs_buttons, g_info.touch_mode);
+
+		if (g_info.is_calib_rs_cam && !is_rsrb_detected)
+			cv::putText(img_rs, "RS Cam is out of tracking volume !!", cv::Point(0, 150), cv::FONT_HERSHEY_DUPLEX, 2.0, CV_RGB(255, 0, 0), 3, LineTypes::LINE_AA);
+		else
+		{
+			if (operation_name == "Picking AR Markers"
+				|| operation_name == "Picking Tool Tip and End")
 			{
-				cv::Mat img_rs_mirror(g_info.rs_h, g_info.rs_w, CV_8UC3, img_rs.data);
-				imshow("rs mirror", img_rs_mirror);
+				cv::putText(img_rs, operation_name, cv::Point(0, 150), cv::FONT_HERSHEY_DUPLEX, 2.0, CV_RGB(255, 0, 0), 2, LineTypes::LINE_AA);
 			}
+		}
+	}
+
+	void PresentRsView()
+	{
+		if (view_bufs.show_rs_window)
+			imshow(g_info.window_name_rs_view, *view_bufs.img_rs);
+
+#ifdef __MIRRORS
+		//if(scenario != 0)
+		{
+			cv::Mat img_rs_mirror(g_info.rs_h, g_info.rs_w, CV_8UC3, view_bufs.img_rs->data);
+			imshow("rs mirror", img_rs_mirror);
+		}
 #endif
-#endif
+	}
 
-#if defined(ENABLE_STG) && defined(SHOW_STG_VIEW)
-			auto Draw_STG_Calib_Point = [](Mat& img)
-			{
-				if (g_info.touch_mode == RsTouchMode::Calib_STG || g_info.touch_mode == RsTouchMode::Calib_STG2)
-				{
-					const int w = g_info.stg_w / g_info.stg_display_num;
-					const int h = g_info.stg_h;
-					static Point2f pos_2d_rs[30] = {
-						Point2f(w / 5.f, h / 4.f) , Point2f(w / 5.f * 2.f, h / 4.f) , Point2f(w / 5.f * 3.f, h / 4.f) , Point2f(w / 5.f * 4.f, h / 4.f),
-						Point2f(w / 8.f, h / 4.f * 2.f) , Point2f(w / 8.f * 2.f, h / 4.f * 2.f) , Point2f(w / 8.f * 3.f, h / 4.f * 2.f) , Point2f(w / 8.f * 4.f, h / 4.f * 2.f),
-						Point2f(w / 8.f * 5.f, h / 4.f * 2.f) , Point2f(w / 8.f * 6.f, h / 4.f * 2.f) , Point2f(w / 8.f * 7.f, h / 4.f * 2.f),
-						Point2f(w / 5.f, h / 4.f * 3.f) , Point2f(w / 5.f * 2.f, h / 4.f * 3.f) , Point2f(w / 5.f * 3.f, h / 4.f * 3.f) , Point2f(w / 5.f * 4.f, h / 4.f * 3.f),
+	// stg view
+	void Draw_STG_Calib_Point(Mat& img)
+	{
+		if (g_info.touch_mode == RsTouchMode::Calib_STG || g_info.touch_mode == RsTouchMode::Calib_STG2)
+		{
+			const int w = g_info.stg_w / g_info.stg_display_num;
+			const int h = g_info.stg_h;
+			static Point2f pos_2d_rs[30] = {
+				Point2f(w / 5.f, h / 4.f) , Point2f(w / 5.f * 2.f, h / 4.f) , Point2f(w / 5.f * 3.f, h / 4.f) , Point2f(w / 5.f * 4.f, h / 4.f),
+				Point2f(w / 8.f, h / 4.f * 2.f) , Point2f(w / 8.f * 2.f, h / 4.f * 2.f) , Point2f(w / 8.f * 3.f, h / 4.f * 2.f) , Point2f(w / 8.f * 4.f, h / 4.f * 2.f),
+				Point2f(w / 8.f * 5.f, h / 4.f * 2.f) , Point2f(w / 8.f * 6.f, h / 4.f * 2.f) , Point2f(w / 8.f * 7.f, h / 4.f * 2.f),
+				Point2f(w / 5.f, h / 4.f * 3.f) , Point2f(w / 5.f * 2.f, h / 4.f * 3.f) , Point2f(w / 5.f * 3.f, h / 4.f * 3.f) , Point2f(w / 5.f * 4.f, h / 4.f * 3.f),
 
-						Point2f(w / 5.f + w, h / 4.f) , Point2f(w / 5.f * 2.f + w, h / 4.f) , Point2f(w / 5.f * 3.f + w, h / 4.f) , Point2f(w / 5.f * 4.f + w, h / 4.f),
-						Point2f(w / 8.f + w, h / 4.f * 2.f) , Point2f(w / 8.f * 2.f + w, h / 4.f * 2.f) , Point2f(w / 8.f * 3.f + w, h / 4.f * 2.f) , Point2f(w / 8.f * 4.f + w, h / 4.f * 2.f),
-						Point2f(w / 8.f * 5.f + w, h / 4.f * 2.f) , Point2f(w / 8.f * 6.f + w, h / 4.f * 2.f) , Point2f(w / 8.f * 7.f + w, h / 4.f * 2.f),
-						Point2f(w / 5.f + w, h / 4.f * 3.f) , Point2f(w / 5.f * 2.f + w, h / 4.f * 3.f) , Point2f(w / 5.f * 3.f + w, h / 4.f * 3.f) , Point2f(w / 5.f * 4.f + w, h / 4.f * 3.f) };
+				Point2f(w / 5.f + w, h / 4.f) , Point2f(w / 5.f * 2.f + w, h / 4.f) , Point2f(w / 5.f * 3.f + w, h / 4.f) , Point2f(w / 5.f * 4.f + w, h / 4.f),
+				Point2f(w / 8.f + w, h / 4.f * 2.f) , Point2f(w / 8.f * 2.f + w, h / 4.f * 2.f) , Point2f(w / 8.f * 3.f + w, h / 4.f * 2.f) , Point2f(w / 8.f * 4.f + w, h / 4.f * 2.f),
+				Point2f(w / 8.f * 5.f + w, h / 4.f * 2.f) , Point2f(w / 8.f * 6.f + w, h / 4.f * 2.f) , Point2f(w / 8.f * 7.f + w, h / 4.f * 2.f),
+				Point2f(w / 5.f + w, h / 4.f * 3.f) , Point2f(w / 5.f * 2.f + w, h / 4.f * 3.f) , Point2f(w / 5.f * 3.f + w, h / 4.f * 3.f) , Point2f(w / 5.f * 4.f + w, h / 4.f * 3.f) };
 
 
-					for (int i = 0; i < g_info.stg_display_num; i++)
+			for (int i = 0; i < g_info.stg_display_num; i++)
+			{
+				vector<pair<Point2f, Point3f>>& stg_calib_pt_pairs = i == 0 ? g_info.otrk_data.stg_calib_pt_pairs : g_info.otrk_data.stg_calib_pt_pairs_2;
+				if (stg_calib_pt_pairs.size() < 15)
+					cv::drawMarker(img, pos_2d_rs[stg_calib_pt_pairs.size() + i * 15], Scalar(255, 100, 255), MARKER_CROSS, 30, 7);
+				else
+					for (int i = 0; i < stg_calib_pt_pairs.size(); i++)
 					{
-						vector<pair<Point2f, Point3f>>& stg_calib_pt_pairs = i == 0 ? g_info.otrk_data.stg_calib_pt_pairs : g_info.otrk_data.stg_calib_pt_pairs_2;
-						if (stg_calib_pt_pairs.size() < 15)
-							cv::drawMarker(img, pos_2d_rs[stg_calib_pt_pairs.size() + i * 15], Scalar(255, 100, 255), MARKER_CROSS, 30, 7);
-						else
-							for (int i = 0; i < stg_calib_pt_pairs.size(); i++)
-							{
-								pair<Point2f, Point3f>& pair_pts = stg_calib_pt_pairs[i];
-								cv::drawMarker(img, get<0>(pair_pts), Scalar(255, 255, 100), MARKER_STAR, 30, 3);
-							}
+						pair<Point2f, Point3f>& pair_pts = stg_calib_pt_pairs[i];
+						cv::drawMarker(img, get<0>(pair_pts), Scalar(255, 255, 100), MARKER_STAR, 30, 3);
 					}
+			}
 #ifdef STG_LINE_CALIB
-					cv::line(image_stg, pos_calib_lines[0], pos_calib_lines[1], Scalar(255, 255, 0), 2);
-					cv::line(image_stg, pos_calib_lines[2], pos_calib_lines[3], Scalar(255, 255, 0), 2);
+			cv::line(image_stg, pos_calib_lines[0], pos_calib_lines[1], Scalar(255, 255, 0), 2);
+			cv::line(image_stg, pos_calib_lines[2], pos_calib_lines[3], Scalar(255, 255, 0), 2);
 #endif
-				}
-			};
-			if (g_info.stg_display_num == 1 ? g_info.is_calib_stg_cam : g_info.is_calib_stg_cam && g_info.is_calib_stg_cam_2)
+		}
+	}
+
+	bool RenderStgView()
+	{
+		frame_view_buffers& vb = view_bufs;
+		vb.is_stg_calibrated = g_info.stg_display_num == 1 ? g_info.is_calib_stg_cam : g_info.is_calib_stg_cam && g_info.is_calib_stg_cam_2;
+		if (!vb.is_stg_calibrated) return true;
+
+		PROF_ZONE("stg render");
+		float* ptr_zdepth;
+		vzm::RenderScene(g_info.stg_scene_id, stg_cam_id);
+		if (g_info.stg_display_num == 1)
+			return vzm::GetRenderBufferPtrs(g_info.stg_scene_id, &vb.stg_rgba[0], &ptr_zdepth, &vb.stg_w[0], &vb.stg_h[0], stg_cam_id);
+
+		// g_info.stg_display_num == 2
+		vzm::RenderScene(g_info.stg_scene_id, stg2_cam_id);
+		return vzm::GetRenderBufferPtrs(g_info.stg_scene_id, &vb.stg_rgba[0], &ptr_zdepth, &vb.stg_w[0], &vb.stg_h[0], stg_cam_id)
+			&& vzm::GetRenderBufferPtrs(g_info.stg_scene_id, &vb.stg_rgba[1], &ptr_zdepth, &vb.stg_w[1], &vb.stg_h[1], stg2_cam_id);
+	}
+
+	void ProcessStgView()
+	{
+		frame_view_buffers& vb = view_bufs;
+		if (vb.is_stg_calibrated && g_info.stg_display_num == 1)
+		{
+			const int _stg_w = vb.stg_w[0], _stg_h = vb.stg_h[0];
+			vb.img_stg = Mat(Size(_stg_w, _stg_h), CV_8UC4, (void*)vb.stg_rgba[0], Mat::AUTO_STEP);
+			cv::drawMarker(vb.img_stg, Point(_stg_w / 2, _stg_h / 2), Scalar(255, 255, 255), MARKER_CROSS, 30, 3);
+			cv::rectangle(vb.img_stg, Point(0, 0), Point(g_info.stg_w - 10, g_info.stg_h - 5), Scalar(255, 255, 255), 3);
+		}
+		else if (vb.is_stg_calibrated) // g_info.stg_display_num == 2
+		{
+			const int* _stg_w = vb.stg_w;
+			vb.img_stg_fb.create(Size(g_info.stg_w, g_info.stg_h), CV_8UC4);
+			unsigned char* rgba_fb = vb.img_stg_fb.data;
+			for (int row = 0; row < g_info.stg_h; row++)
 			{
-				LARGE_INTEGER frq_render_stg = GetPerformanceFreq();
-				if (g_info.stg_display_num == 1)
-				{
-					vzm::RenderScene(g_info.stg_scene_id, stg_cam_id);
-					unsigned char* ptr_rgba;
-					float* ptr_zdepth;
-					int _stg_w, _stg_h;
-					if (vzm::GetRenderBufferPtrs(g_info.stg_scene_id, &ptr_rgba, &ptr_zdepth, &_stg_w, &_stg_h, stg_cam_id))
-					{
+				memcpy(&rgba_fb[row * g_info.stg_w * 4], &vb.stg_rgba[0][row * _stg_w[0] * 4], sizeof(int) * _stg_w[0]);
+				memcpy(&rgba_fb[row * g_info.stg_w * 4 + _stg_w[0] * 4], &vb.stg_rgba[1][row * _stg_w[1] * 4], sizeof(int) * _stg_w[1]);
+			}
+			vb.img_stg = vb.img_stg_fb;
 
-						Mat image_stg(Size(_stg_w, _stg_h), CV_8UC4, (void*)ptr_rgba, Mat::AUTO_STEP);
-						cv::drawMarker(image_stg, Point(_stg_w / 2, _stg_h / 2), Scalar(255, 255, 255), MARKER_CROSS, 30, 3);
-						cv::rectangle(image_stg, Point(0, 0), Point(g_info.stg_w - 10, g_info.stg_h - 5), Scalar(255, 255, 255), 3);
-						Draw_STG_Calib_Point(image_stg);
+			cv::drawMarker(vb.img_stg, Point(_stg_w[0] / 2 + g_info.stg_focus_offset_w, g_info.stg_h / 2), Scalar(255, 255, 255), MARKER_CROSS, 30, 3);
+			cv::drawMarker(vb.img_stg, Point(_stg_w[0] + _stg_w[1] / 2 - g_info.stg_focus_offset_w, g_info.stg_h / 2), Scalar(255, 255, 255), MARKER_CROSS, 30, 3);
 
-						imshow(g_info.window_name_stg_view, image_stg);
+			cv::rectangle(vb.img_stg, Point(2, 2), Point(_stg_w[0] - 2, g_info.stg_h - 2), Scalar(255, 255, 255), 3);
+			cv::rectangle(vb.img_stg, Point(_stg_w[0] + 2, 2), Point(_stg_w[0] + _stg_w[1] - 2, g_info.stg_h - 2), Scalar(255, 255, 255), 3);
+		}
+		else
+		{
+			vb.img_stg_fb.create(Size(g_info.stg_w, g_info.stg_h), CV_8UC4);
+			vb.img_stg_fb.setTo(Scalar::all(0));
+			vb.img_stg = vb.img_stg_fb;
+			if (g_info.stg_display_num == 1)
+			{
+				cv::drawMarker(vb.img_stg, Point(g_info.stg_w / 2, g_info.stg_h / 2), Scalar(100, 100, 255), MARKER_CROSS, 30, 3);
+				cv::rectangle(vb.img_stg, Point(0, 0), Point(g_info.stg_w - 10, g_info.stg_h - 5), Scalar(255, 255, 255), 3);
+			}
+			else
+			{
+				int w = g_info.stg_w / 2;
+				cv::drawMarker(vb.img_stg, Point(w / 2 + g_info.stg_focus_offset_w, g_info.stg_h / 2), Scalar(100, 100, 255), MARKER_CROSS, 30, 3);
+				cv::drawMarker(vb.img_stg, Point(w + w / 2 - g_info.stg_focus_offset_w, g_info.stg_h / 2), Scalar(100, 100, 255), MARKER_CROSS, 30, 3);
+
+				cv::rectangle(vb.img_stg, Point(2, 2), Point(w - 2, g_info.stg_h - 2), Scalar(255, 255, 255), 3);
+				cv::rectangle(vb.img_stg, Point(w + 2, 2), Point(w + w - 2, g_info.stg_h - 2), Scalar(255, 255, 255), 3);
+			}
+		}
+		Draw_STG_Calib_Point(vb.img_stg);
+	}
+
+	void PresentStgView()
+	{
+		imshow(g_info.window_name_stg_view, view_bufs.img_stg);
 
 #ifdef __MIRRORS
-						cv::Mat img_stg_mirror(Size(_stg_w, _stg_h), CV_8UC4, image_stg.data);
-						imshow("stg mirror", img_stg_mirror);
+		cv::Mat img_stg_mirror(view_bufs.img_stg.size(), CV_8UC4, view_bufs.img_stg.data);
+		imshow("stg mirror", img_stg_mirror);
 #endif
-					}
-				}
-				else // g_info.stg_display_num == 2
-				{
-					vzm::RenderScene(g_info.stg_scene_id, stg_cam_id);
-					vzm::RenderScene(g_info.stg_scene_id, stg2_cam_id);
-					unsigned char* ptr_rgba[2];
-					float* ptr_zdepth[2];
-					int _stg_w[2], _stg_h[2];
-					if (vzm::GetRenderBufferPtrs(g_info.stg_scene_id, &ptr_rgba[0], &ptr_zdepth[0], &_stg_w[0], &_stg_h[0], stg_cam_id)
-						&& vzm::GetRenderBufferPtrs(g_info.stg_scene_id, &ptr_rgba[1], &ptr_zdepth[1], &_stg_w[1], &_stg_h[1], stg2_cam_id))
-					{
-						Mat image_stg(Size(g_info.stg_w, g_info.stg_h), CV_8UC4);
-						unsigned char* rgba_fb = image_stg.data;
-						for (int row = 0; row < g_info.stg_h; row++)
-						{
-							memcpy(&rgba_fb[row * g_info.stg_w * 4], &ptr_rgba[0][row * _stg_w[0] * 4], sizeof(int) * _stg_w[0]);
-							memcpy(&rgba_fb[row * g_info.stg_w * 4 + _stg_w[0] * 4], &ptr_rgba[1][row * _stg_w[1] * 4], sizeof(int) * _stg_w[1]);
-						}
+	}
 
-						cv::drawMarker(image_stg, Point(_stg_w[0] / 2 + g_info.stg_focus_offset_w, g_info.stg_h / 2), Scalar(255, 255, 255), MARKER_CROSS, 30, 3);
-						cv::drawMarker(image_stg, Point(_stg_w[0] + _stg_w[1] / 2 - g_info.stg_focus_offset_w, g_info.stg_h / 2), Scalar(255, 255, 255), MARKER_CROSS, 30, 3);
+	void AddFrameViews()
+	{
+		frame_views = new view_graph(2);
 
-						cv::rectangle(image_stg, Point(2, 2), Point(_stg_w[0] - 2, g_info.stg_h - 2), Scalar(255, 255, 255), 3);
-						cv::rectangle(image_stg, Point(_stg_w[0] + 2, 2), Point(_stg_w[0] + _stg_w[1] - 2, g_info.stg_h - 2), Scalar(255, 255, 255), 3);
-						Draw_STG_Calib_Point(image_stg);
+#ifdef SHOW_WS_VIEW
+		view_node ws_view;
+		ws_view.name = "ws view";
+		ws_view.inputs = VG_IN_TRACK | VG_IN_CAMERA | VG_IN_SCENE | VG_IN_TOUCH;
+		ws_view.Render = RenderWsView;
+		ws_view.Process = ProcessWsView;
+		ws_view.Present = PresentWsView;
+		ws_view_idx = frame_views->AddView(ws_view);
+#endif
+#ifdef SHOW_RS_VIEW
+		view_node rs_view;
+		rs_view.name = "rs view";
+		rs_view.inputs = VG_IN_IMAGE | VG_IN_TRACK | VG_IN_CAMERA | VG_IN_MODEL | VG_IN_SCENE | VG_IN_TOUCH;
+		rs_view.Render = RenderRsView;
+		rs_view.Process = ProcessRsView;
+		rs_view.Present = PresentRsView;
+		rs_view_idx = frame_views->AddView(rs_view);
+#endif
+#if defined(ENABLE_STG) && defined(SHOW_STG_VIEW)
+		view_node stg_view;
+		stg_view.name = "stg view";
+		stg_view.inputs = VG_IN_TRACK | VG_IN_CAMERA | VG_IN_MODEL | VG_IN_SCENE | VG_IN_TOUCH;
+		stg_view.Render = RenderStgView;
+		stg_view.Process = ProcessStgView;
+		stg_view.Present = PresentStgView;
+		stg_view_idx = frame_views->AddView(stg_view);
+#endif
+	}
 
-						imshow(g_info.window_name_stg_view, image_stg);
+	// versions of the view inputs, num_state_calls : scene_mirror::FlushStates of the frame
+	void SetFrameViewInputs(const int num_state_calls)
+	{
+		static vector<char> trk_serial;
+		const track_info& trk_info = g_info.otrk_data.trk_info;
+		trk_serial.resize(trk_info.GetSerialSize());
+		trk_info.WriteSerialBuffer(trk_serial.data());
+		frame_views->SetInput(VG_IN_TRACK, view_graph::Hash(trk_serial.data(), trk_serial.size()));
 
-#ifdef __MIRRORS
-						cv::Mat img_stg_mirror(Size(g_info.stg_w, g_info.stg_h), CV_8UC4, image_stg.data);
-						imshow("stg mirror", img_stg_mirror);
-#endif
-					}
-				}
+		auto hash_camera = [](const int scene_id, const int cam_id, const uint64_t h)
+		{
+			vzm::CameraParameters cam_params;
+			if (!vzm::GetCameraParameters(scene_id, cam_params, cam_id)) return h;
+			float cam_values[] = { cam_params.pos[0], cam_params.pos[1], cam_params.pos[2],
+				cam_params.view[0], cam_params.view[1], cam_params.view[2], cam_params.up[0], cam_params.up[1], cam_params.up[2],
+				cam_params.np, cam_params.fp, (float)cam_params.projection_mode, (float)cam_params.w, (float)cam_params.h,
+				cam_params.fx, cam_params.fy, cam_params.sc, cam_params.cx, cam_params.cy };
+			// the projection union : 2 values (ip_w, ip_h or fov_y, aspect_ratio) but in the AR mode
+			const int num_values = cam_params.projection_mode == 3 ? 19 : 16;
+			return view_graph::Hash(cam_values, sizeof(float) * num_values, h);
+		};
+		uint64_t cam_version = view_graph::Hash(NULL, 0);
+		cam_version = hash_camera(g_info.ws_scene_id, ov_cam_id, cam_version);
+		cam_version = hash_camera(g_info.rs_scene_id, rs_cam_id, cam_version);
+		cam_version = hash_camera(g_info.stg_scene_id, stg_cam_id, cam_version);
+		if (g_info.stg_display_num == 2) cam_version = hash_camera(g_info.stg_scene_id, stg2_cam_id, cam_version);
+		frame_views->SetInput(VG_IN_CAMERA, cam_version);
+
+		struct
+		{
+			int is_modelaligned, guide_line_idx, show_sectional_views;
+			glm::fvec3 guide_probe_closest_point;
+		} model_values = { g_info.is_modelaligned, g_info.guide_line_idx, _show_sectional_views, g_info.guide_probe_closest_point };
+		frame_views->SetInput(VG_IN_MODEL, view_graph::Hash(&model_values, sizeof(model_values)));
+
+		int touch_values[] = { (int)g_info.touch_mode, (int)g_info.otrk_data.calib_3d_pts.size(),
+			(int)g_info.otrk_data.stg_calib_pt_pairs.size(), (int)g_info.otrk_data.stg_calib_pt_pairs_2.size(),
+			g_info.is_calib_rs_cam, g_info.is_calib_stg_cam, g_info.is_calib_stg_cam_2, is_rsrb_detected,
+			g_info.stg_display_num, g_info.stg_focus_offset_w };
+		frame_views->SetInput(VG_IN_TOUCH, view_graph::Hash(operation_name.data(), operation_name.size(), view_graph::Hash(touch_values, sizeof(touch_values))));
+
+		// the states pushed by the mirror and the primitives rebuilt in place (same states, new geometry)
+		static uint64_t scene_version = 0;
+		static long long prim_builds = 0;
+		if (num_state_calls > 0 || g_info.prims.num_builds != prim_builds) scene_version++;
+		prim_builds = g_info.prims.num_builds;
+		frame_views->SetInput(VG_IN_SCENE, scene_version);
+
+		// a new camera image every frame
+		static uint64_t image_version = 0;
+		frame_views->SetInput(VG_IN_IMAGE, ++image_version);
+	}
 
-				DisplayTimes(frq_render_stg, "stg render : ");
-			}
+	void UpdateModelICP()
+	{
+		PROF_ZONE("UpdateModelICP");
+		if (g_info.is_icp_requested)
+		{
+			g_info.is_icp_requested = false;
+			if (!g_info.is_modelaligned || g_info.model_ms_obj_id == 0)
+				cout << "model ICP needs a model alignment!" << endl;
 			else
-			{
-				static Mat image_stg(Size(g_info.stg_w, g_info.stg_h), CV_8UC4, Mat::AUTO_STEP);
-				image_stg = cv::Mat::zeros(image_stg.size(), image_stg.type());
-				if (g_info.stg_display_num == 1)
-				{
-					cv::drawMarker(image_stg, Point(g_info.stg_w / 2, g_info.stg_h / 2), Scalar(100, 100, 255), MARKER_CROSS, 30, 3);
-					cv::rectangle(image_stg, Point(0, 0), Point(g_info.stg_w - 10, g_info.stg_h - 5), Scalar(255, 255, 255), 3);
-				}
-				else
-				{
-					int w = g_info.stg_w / 2;
-					cv::drawMarker(image_stg, Point(w / 2 + g_info.stg_focus_offset_w, g_info.stg_h / 2), Scalar(100, 100, 255), MARKER_CROSS, 30, 3);
-					cv::drawMarker(image_stg, Point(w + w / 2 - g_info.stg_focus_offset_w, g_info.stg_h / 2), Scalar(100, 100, 255), MARKER_CROSS, 30, 3);
+				model_icp_pending = true;
+		}
+		if (!g_info.is_modelaligned || g_info.model_ms_obj_id == 0 || (!model_icp_continuous && !model_icp_pending))
+			return;
 
-					cv::rectangle(image_stg, Point(2, 2), Point(w - 2, g_info.stg_h - 2), Scalar(255, 255, 255), 3);
-					cv::rectangle(image_stg, Point(w + 2, 2), Point(w + w - 2, g_info.stg_h - 2), Scalar(255, 255, 255), 3);
-				}
-				Draw_STG_Calib_Point(image_stg);
-				imshow(g_info.window_name_stg_view, image_stg);
+		vzm::ObjStates model_obj_state;
+		scene_mirror::GetState(g_info.model_scene_id, g_info.model_ms_obj_id, model_obj_state);
+		const glm::fmat4x4 mat_model_os2ws = __cm4__ model_obj_state.os2ws;
 
-#ifdef __MIRRORS
-				cv::Mat img_stg_mirror(Size(g_info.stg_w, g_info.stg_h), CV_8UC4, image_stg.data);
-				imshow("stg mirror", img_stg_mirror);
-#endif
+		if (model_icp == NULL)
+			model_icp = new icp_tracker();
+		if (!model_icp->IsRunning())
+			model_icp->Start();
+		if (model_icp_src_id != g_info.model_ms_obj_id)
+		{
+			float *pos_vtx = NULL, *nrl_vtx = NULL, *rgb_vtx = NULL, *tex_vtx = NULL;
+			unsigned int *idx_prims = NULL;
+			int num_vtx = 0, num_prims = 0, stride_prim_idx = 0;
+			if (!vzm::GetPModelData(g_info.model_ms_obj_id, &pos_vtx, &nrl_vtx, &rgb_vtx, &tex_vtx, num_vtx, &idx_prims, num_prims, stride_prim_idx) || num_vtx == 0)
+				return;
+			// the icp distances are metric, the model os is not (e.g., mm scaled by its os2ws)
+			mat_ms2icp = glm::scale(glm::fvec3(glm::length(glm::fvec3(mat_model_os2ws[0])), glm::length(glm::fvec3(mat_model_os2ws[1])), glm::length(glm::fvec3(mat_model_os2ws[2]))));
+			vector<glm::fvec3> src_pts(num_vtx);
+			for (int i = 0; i < num_vtx; i++)
+				src_pts[i] = tr_pt(mat_ms2icp, ((glm::fvec3*)pos_vtx)[i]);
+			model_icp->SetSource(&src_pts[0], num_vtx);
+			model_icp_src_id = g_info.model_ms_obj_id;
+			model_icp_pose = glm::fmat4x4(0); // forces SetPose
+		}
+		// manual alignments (e.g., Align or a loaded registration) restart the refinements
+		if (g_info.mat_os2matchmodefrm != model_icp_pose)
+		{
+			model_icp_pose = g_info.mat_os2matchmodefrm;
+			model_icp->SetPose(model_icp_pose * glm::inverse(mat_ms2icp));
+		}
+
+		// the target points, in the match model frame (the rigid body moves with the model)
+		const long long pc_frame = pc_stage.GetStats().frames;
+		if (model_icp_pending && g_info.captured_model_ws_point_id != 0)
+		{
+			float *pos_vtx = NULL, *nrl_vtx = NULL, *rgb_vtx = NULL, *tex_vtx = NULL;
+			unsigned int *idx_prims = NULL;
+			int num_vtx = 0, num_prims = 0, stride_prim_idx = 0;
+			if (vzm::GetPModelData(g_info.captured_model_ws_point_id, &pos_vtx, &nrl_vtx, &rgb_vtx, &tex_vtx, num_vtx, &idx_prims, num_prims, stride_prim_idx)
+				&& num_vtx > 0 && nrl_vtx != NULL)
+			{
+				vzm::ObjStates captured_obj_state;
+				scene_mirror::GetState(g_info.ws_scene_id, g_info.captured_model_ws_point_id, captured_obj_state);
+				model_icp->PushTarget((glm::fvec3*)pos_vtx, (glm::fvec3*)nrl_vtx, num_vtx, g_info.mat_ws2matchmodelfrm * (__cm4__ captured_obj_state.os2ws));
+				model_icp_pc_frame = pc_frame;
 			}
-#endif
+		}
+		// the rs point cloud (normals of the depth kernel), once per depth frame
+		if (pc_frame != model_icp_pc_frame && pc_stage.GetNumPoints() > 0)
+		{
+			model_icp->PushTarget(pc_stage.GetPositions(), pc_stage.GetNormals(), pc_stage.GetNumPoints(), g_info.mat_ws2matchmodelfrm * mat_pc2ws);
+			model_icp_pc_frame = pc_frame;
+		}
+
+		icp_result icp_res;
+		if (model_icp->GetResult(model_icp_version, model_icp_version, icp_res))
+		{
+			// same as the manual ICP : os2matchmodefrm = ws2matchmodelfrm * matchtr * model os2ws
+			model_icp_pose = g_info.mat_os2matchmodefrm = icp_res.mat_src2tgt * mat_ms2icp;
+			g_info.mat_matchtr = glm::inverse(g_info.mat_ws2matchmodelfrm) * g_info.mat_os2matchmodefrm * glm::inverse(mat_model_os2ws);
+			if (model_icp_pending)
+				cout << "model ICP matching done! (rms " << icp_res.rms_err * 1000.f << " mm, " << icp_res.num_corrs << " points, " << icp_res.iterations << " iterations)" << endl;
+			model_icp_pending = false;
+		}
+	}
+
+	void SetContinuousICP(const bool continuous)
+	{
+		model_icp_continuous = continuous;
+	}
+
+	void GetICPStats(double& refinements_per_sec, double& iterations_per_sec, float& residual_mm, const bool reset)
+	{
+		refinements_per_sec = iterations_per_sec = 0;
+		residual_mm = 0;
+		if (model_icp == NULL || !model_icp->IsRunning()) return;
+		icp_stats stats = model_icp->GetStats(reset);
+		if (stats.elapsed_ms > 0)
+		{
+			refinements_per_sec = stats.refinements * 1000.0 / stats.elapsed_ms;
+			iterations_per_sec = stats.iterations * 1000.0 / stats.elapsed_ms;
+		}
+		residual_mm = stats.last_rms * 1000.f;
+	}
+
+	void RenderAndShowWindows(bool show_times, Mat& img_rs, bool skip_show_rs_window, int addtional_scene, int addtional_cam)
+	{
+		PROF_ZONE("RenderAndShowWindows");
+
+		// the registration refined since the last frame (and the target points of this frame)
+		UpdateModelICP();
+
+		// the object states of the frame (SetState / SetStates) go to the scenes once, before any rendering
+		const int num_state_calls = scene_mirror::FlushStates();
+		g_info.prims.num_frames++;
+
+		if (!g_info.skip_call_render)
+		{
+			if (frame_views == NULL) AddFrameViews();
+
+			// the camera of the ws view follows the probe (an input of the view)
+			if (g_info.is_modelaligned && g_info.is_probe_detected)
+				WorldCamSet();
+
+			view_bufs.img_rs = &img_rs;
+			view_bufs.show_rs_window = !skip_show_rs_window;
+			SetFrameViewInputs(num_state_calls);
+			// the views whose inputs changed are rendered here, processed by the workers and presented here
+			frame_views->Execute();
 		}
 
 		static bool once_prob_set = true;
@@ -2683,8 +3075,27 @@ namespace var_settings
 		}
 	}
 
+	void GetViewStats(long long& views_run, long long& views_skipped, const bool reset)
+	{
+		views_run = views_skipped = 0;
+		if (frame_views == NULL) return;
+		view_graph_stats stats = frame_views->GetStats(reset);
+		views_run = stats.views_run;
+		views_skipped = stats.views_skipped;
+	}
+
 	void DeinitializeVarSettings()
 	{
 		clear_record_info();
+		scene_mirror::ClearStates();
+		g_info.prims.Clear();
+		delete frame_views; // joins the workers
+		frame_views = NULL;
+		tc_calib.Stop();
+		delete model_icp; // stops the tracker and joins the solver pool
+		model_icp = NULL;
+		model_icp_version = 0;
+		model_icp_src_id = 0; // the source is set again on the next tracker
+		model_icp_pending = false;
 	}
 }
\ No newline at end of file
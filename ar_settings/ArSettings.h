@@ -18,12 +18,21 @@
 #include <librealsense2/rs.hpp> // Include RealSense Cross Platform API
 #include <librealsense2/rsutil.h>
 
+#include "Profiler.h"
+
 namespace rs_settings
 {
 	__dojostatic void InitializeRealsense(const bool use_depthsensor, const bool use_testeyecam, const int rs_w, const int rs_h, const int eye_w, const int eye_h);
+	// replay instead of the device : the color frames of a recorded session (.krec, see Recorder.h) come out of a software device,
+	// the frame of the optitrk replay cursor is fed (optitrk::InitOptiTrackReplay with the same file), no depth stream
+	__dojostatic bool InitializeRealsenseReplay(const std::string& file_replay, const int rs_w, const int rs_h);
+	// frames handed to original_data, and frames skipped (RECORDED : the clock went past them, or every slot still held by the consumer)
+	__dojostatic void GetReplayStats(long long& frames_fed, long long& frames_dropped);
 	__dojostatic void RunRsThread(rs2::frame_queue& original_data, rs2::frame_queue& filtered_data, rs2::frame_queue& eye_data);
 	__dojostatic void GetRsCamParams(rs2_intrinsics& rgb_intrinsics, rs2_intrinsics& depth_intrinsics, rs2_extrinsics& rgb_extrinsics);
 	__dojostatic void FinishRsThreads();
+	// capture time of the frame in GetMonotonicTimeMs() (kar_helpers.hpp) domain
+	__dojostatic double GetCaptureTimeMs(const rs2::frame& frame);
 	__dojostatic void DeinitializeRealsense();
 }
 
@@ -34,10 +43,18 @@ namespace var_settings
 	__dojostatic void SetCvWindows();
 	__dojostatic void LoadPresets();
 	__dojostatic void ResetCalib();
+	// finalizes the current recording (.krec, see Recorder.h), the next RecordInfo starts a new file
 	__dojostatic void StoreRecordInfo();
+	// frames on disk, dropped (the writer could not keep up) and waiting in the slot pool, of the current/last recording
+	__dojostatic void GetRecordStats(long long& frames_written, long long& frames_dropped, int& frames_pending);
+	// every sample of the tracker thread (drain-all), feeds the pose history used by UpdateTrackInfo
+	__dojostatic void PushTrackSample(const void* trk_info);
 	// probe_mode [0, 1, 2] => [DEFAULT, ONLY_PIN_POS, ONLY_RBFRAME]
-	__dojostatic void UpdateTrackInfo(const void* trk_info, const std::string& probe_specifier_rb_name = "probe", int probe_mode = 0);
-	__dojostatic void RecordInfo(const int key_pressed, const void* color_data);
+	// t_capture > 0 : rigid body poses are interpolated/extrapolated to t_capture (GetMonotonicTimeMs() domain)
+	__dojostatic void UpdateTrackInfo(const void* trk_info, const std::string& probe_specifier_rb_name = "probe", int probe_mode = 0, double t_capture = 0);
+	// color_data : rs_w * rs_h * 3 bytes, copied into a fixed slot pool and written by a background thread
+	// t_capture (GetMonotonicTimeMs() domain) <= 0 : the call time
+	__dojostatic void RecordInfo(const int key_pressed, const void* color_data, const double t_capture = 0);
 	__dojostatic void SetTcCalibMkPoints();
 	__dojostatic void SetMkSpheres(bool is_visible, bool is_pickable);
 	__dojostatic void GetVarInfo(void*);
@@ -47,9 +64,20 @@ namespace var_settings
 	__dojostatic void TryCalibrationSTG();
 	__dojostatic void SetCalibFrames(bool is_visible);
 	__dojostatic void SetDepthMapPC(const bool is_visible, rs2::depth_frame& depth_frame, rs2::video_frame& color_frame);
+	// voxel_size (meters) <= 0 : every valid depth pixel is uploaded
+	__dojostatic void SetDepthMapPCVoxelSize(const float voxel_size);
+	// points in (pixels) / valid (non-zero depth) / out (uploaded) of the last SetDepthMapPC, and the frame count
+	__dojostatic void GetDepthMapPCStats(int& num_in, int& num_valid, int& num_out, long long& frames);
 	__dojostatic void SetTargetModelAssets(const std::string& name, const int guide_line_idx = -1);
 	__dojostatic void SetSectionalImageAssets(const bool show_sectional_views, const float* pos_tip, const float* pos_end, const float rot_angle_rad = 0);
+	// the views (ws, rs, stg) are rendered and presented only when their inputs changed, the cpu work runs on worker threads
 	__dojostatic void RenderAndShowWindows(bool show_times, cv::Mat& img_rs, bool skip_show_rs_window = false, int addtional_scene = -1, int addtional_cam = -1);
+	// views run and skipped (inputs unchanged) by RenderAndShowWindows since the last reset
+	__dojostatic void GetViewStats(long long& views_run, long long& views_skipped, const bool reset = false);
+	// the model registration (mat_matchtr) is refined against every rs point cloud (ICP on a worker thread), false : only on an ICP click
+	__dojostatic void SetContinuousICP(const bool continuous);
+	// ICP refinements and iterations per second since the last reset, point to plane residual of the last refinement
+	__dojostatic void GetICPStats(double& refinements_per_sec, double& iterations_per_sec, float& residual_mm, const bool reset = false);
 	__dojostatic void DeinitializeVarSettings();
 
 	__dojostatic std::string GetDefaultFilePath();
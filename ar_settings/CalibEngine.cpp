@@ -0,0 +1,422 @@
+#include "CalibEngine.h"
+#include "Profiler.h"
+
+#include <opencv2/calib3d.hpp>
+#include <glm/gtc/matrix_inverse.hpp>
+#include <algorithm>
+#include <chrono>
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+#define CALIB_PI 3.14159265358979323846
+
+namespace
+{
+	// opencv camera frame (y down, z forward) to the rs camera space (y up, z backward), its own inverse
+	const glm::dmat4x4 mat_cvf2rscs(1, 0, 0, 0, 0, -1, 0, 0, 0, 0, -1, 0, 0, 0, 0, 1);
+
+	glm::fmat4x4 PoseToRsCs2Clf(const cv::Mat& rvec, const cv::Mat& tvec)
+	{
+		cv::Mat rot;
+		cv::Rodrigues(rvec, rot);
+		glm::dmat4x4 mat_clf2cvf(1.);
+		for (int r = 0; r < 3; r++)
+		{
+			for (int c = 0; c < 3; c++) mat_clf2cvf[c][r] = rot.at<double>(r, c);
+			mat_clf2cvf[3][r] = tvec.at<double>(r, 0);
+		}
+		return glm::fmat4x4(glm::inverse(mat_clf2cvf) * mat_cvf2rscs);
+	}
+
+	void RsCs2ClfToPose(const glm::fmat4x4& mat_rscs2clf, cv::Mat& rvec, cv::Mat& tvec)
+	{
+		const glm::dmat4x4 mat_clf2cvf = glm::inverse(glm::dmat4x4(mat_rscs2clf) * mat_cvf2rscs);
+		cv::Mat rot(3, 3, CV_64FC1);
+		tvec = cv::Mat(3, 1, CV_64FC1);
+		for (int r = 0; r < 3; r++)
+		{
+			for (int c = 0; c < 3; c++) rot.at<double>(r, c) = mat_clf2cvf[c][r];
+			tvec.at<double>(r, 0) = mat_clf2cvf[3][r];
+		}
+		cv::Rodrigues(rot, rvec);
+	}
+
+	// reprojection error of each sample
+	void ComputeResiduals(const std::vector<cv::Point3f>& points_3d, const std::vector<cv::Point2f>& points_2d,
+		const cv::Mat& rvec, const cv::Mat& tvec, const cv::Mat& cam_mat, std::vector<float>& residuals, float& rms_err)
+	{
+		std::vector<cv::Point2f> reproj_points;
+		cv::projectPoints(points_3d, rvec, tvec, cam_mat, cv::noArray(), reproj_points);
+		residuals.resize(points_2d.size());
+		double sq_sum = 0;
+		for (int i = 0; i < (int)points_2d.size(); i++)
+		{
+			const cv::Point2f diff = reproj_points[i] - points_2d[i];
+			const double sq_err = (double)diff.x * diff.x + (double)diff.y * diff.y;
+			residuals[i] = (float)sqrt(sq_err);
+			sq_sum += sq_err;
+		}
+		rms_err = points_2d.size() > 0 ? (float)sqrt(sq_sum / points_2d.size()) : 0;
+	}
+
+	float Median(std::vector<float> values)
+	{
+		std::nth_element(values.begin(), values.begin() + values.size() / 2, values.end());
+		return values[values.size() / 2];
+	}
+}
+
+calib_engine::calib_engine()
+{
+	max_per_bin = 4;
+	max_samples = 400;
+	min_outlier_px = 2.f;
+	has_pose = false;
+	rand_state = 2463534242u;
+	img_w = img_h = 0;
+	fx = fy = cx = cy = 0;
+	has_pending_pose = reset_requested = false;
+	epoch = result_epoch = 0;
+	result.version = 0;
+	result.rms_err = 0;
+	result.num_samples = result.num_rejected = 0;
+	result.warm_started = result.converged = false;
+	memset(&stats, 0, sizeof(stats));
+	worker_alive = stop_worker = false;
+}
+
+void calib_engine::Start(const int _max_per_bin, const int _max_samples, const float _min_outlier_px)
+{
+	Stop();
+	max_per_bin = _max_per_bin > 1 ? _max_per_bin : 1;
+	max_samples = _max_samples > CALIB_MIN_SAMPLES ? _max_samples : CALIB_MIN_SAMPLES;
+	min_outlier_px = _min_outlier_px;
+	stop_worker = false;
+	worker = std::thread(&calib_engine::WorkerLoop, this);
+	worker_alive = true;
+}
+
+void calib_engine::Stop()
+{
+	if (!worker_alive) return;
+	{
+		std::lock_guard<std::mutex> lock(calib_lock);
+		stop_worker = true;
+		pending.clear();
+	}
+	calib_pushed.notify_all();
+	worker.join();
+	worker_alive = false;
+}
+
+void calib_engine::SetCamera(const int _img_w, const int _img_h, const float _fx, const float _fy, const float _cx, const float _cy)
+{
+	std::lock_guard<std::mutex> lock(calib_lock);
+	if (img_w == _img_w && img_h == _img_h && fx == _fx && fy == _fy && cx == _cx && cy == _cy) return;
+	const bool restart = img_w > 0;
+	img_w = _img_w;
+	img_h = _img_h;
+	fx = _fx;
+	fy = _fy;
+	cx = _cx;
+	cy = _cy;
+	if (restart)
+	{
+		pending.clear();
+		reset_requested = true;
+		epoch++;
+	}
+}
+
+void calib_engine::SetPose(const glm::fmat4x4& mat_rscs2clf)
+{
+	{
+		std::lock_guard<std::mutex> lock(calib_lock);
+		pending_pose = mat_rscs2clf;
+		has_pending_pose = true;
+	}
+	calib_pushed.notify_one();
+}
+
+int calib_engine::ComputeBin(const cv::Point2f& p2d, const cv::Point3f& p3d_clf) const
+{
+	int cell_x = img_w > 0 ? (int)(p2d.x * CALIB_GRID_W / img_w) : 0;
+	int cell_y = img_h > 0 ? (int)(p2d.y * CALIB_GRID_H / img_h) : 0;
+	cell_x = cell_x < 0 ? 0 : (cell_x >= CALIB_GRID_W ? CALIB_GRID_W - 1 : cell_x);
+	cell_y = cell_y < 0 ? 0 : (cell_y >= CALIB_GRID_H ? CALIB_GRID_H - 1 : cell_y);
+
+	// pose bin : the point seen from the camera rigid body
+	const double dist = sqrt((double)p3d_clf.x * p3d_clf.x + (double)p3d_clf.y * p3d_clf.y + (double)p3d_clf.z * p3d_clf.z);
+	const double azimuth = atan2((double)p3d_clf.x, (double)p3d_clf.z) + CALIB_PI; // [0, 2pi]
+	const double elev = dist > DBL_EPSILON ? asin((double)p3d_clf.y / dist) + CALIB_PI * 0.5 : 0; // [0, pi]
+	int bin_az = (int)(azimuth / (2. * CALIB_PI) * CALIB_POSE_AZIMUTHS);
+	int bin_el = (int)(elev / CALIB_PI * CALIB_POSE_ELEVS);
+	int bin_dist = (int)(dist / 0.25);
+	bin_az = bin_az >= CALIB_POSE_AZIMUTHS ? CALIB_POSE_AZIMUTHS - 1 : bin_az;
+	bin_el = bin_el >= CALIB_POSE_ELEVS ? CALIB_POSE_ELEVS - 1 : bin_el;
+	bin_dist = bin_dist >= CALIB_POSE_DISTS ? CALIB_POSE_DISTS - 1 : bin_dist;
+
+	const int cell = cell_y * CALIB_GRID_W + cell_x;
+	const int pose_bin = (bin_az * CALIB_POSE_ELEVS + bin_el) * CALIB_POSE_DISTS + bin_dist;
+	return cell * (CALIB_POSE_AZIMUTHS * CALIB_POSE_ELEVS * CALIB_POSE_DISTS) + pose_bin;
+}
+
+void calib_engine::Push(const std::vector<cv::Point2f>& points_2d, const std::vector<cv::Point3f>& points_3d_clf)
+{
+	if (points_2d.size() == 0 || points_2d.size() != points_3d_clf.size()) return;
+	{
+		std::lock_guard<std::mutex> lock(calib_lock);
+		for (int i = 0; i < (int)points_2d.size(); i++)
+		{
+			calib_sample sample;
+			sample.p2d = points_2d[i];
+			sample.p3d_clf = points_3d_clf[i];
+			sample.bin = ComputeBin(sample.p2d, sample.p3d_clf);
+			pending.push_back(sample);
+		}
+		stats.pushed += (long long)points_2d.size();
+	}
+	calib_pushed.notify_one();
+}
+
+void calib_engine::Reset()
+{
+	{
+		std::lock_guard<std::mutex> lock(calib_lock);
+		pending.clear();
+		has_pending_pose = false;
+		reset_requested = true;
+		epoch++;
+	}
+	calib_pushed.notify_one();
+}
+
+bool calib_engine::GetResult(const uint64_t last_version, calib_result& _result)
+{
+	std::lock_guard<std::mutex> lock(calib_lock);
+	if (result.version <= last_version || result_epoch != epoch) return false;
+	_result = result;
+	return true;
+}
+
+calib_stats calib_engine::GetStats()
+{
+	std::lock_guard<std::mutex> lock(calib_lock);
+	return stats;
+}
+
+unsigned int calib_engine::Rand()
+{
+	// xorshift32
+	rand_state ^= rand_state << 13;
+	rand_state ^= rand_state >> 17;
+	rand_state ^= rand_state << 5;
+	return rand_state;
+}
+
+void calib_engine::ClearReservoir()
+{
+	reservoir.clear();
+	bin_counts.clear();
+	bin_seen.clear();
+	rms_history.clear();
+	has_pose = false;
+}
+
+void calib_engine::AddSample(calib_sample sample, calib_stats& _stats)
+{
+	int& count = bin_counts[sample.bin];
+	const int seen = ++bin_seen[sample.bin];
+	if (count < max_per_bin && (int)reservoir.size() < max_samples)
+	{
+		reservoir.push_back(sample);
+		count++;
+		_stats.binned++;
+		return;
+	}
+
+	int victim_bin = sample.bin;
+	if (count < max_per_bin)
+	{
+		// full reservoir : the most populated bin gives its slot to the less populated one
+		int max_count = 0;
+		for (const auto& it : bin_counts)
+			if (it.second > max_count) { max_count = it.second; victim_bin = it.first; }
+		if (max_count <= count + 1) { _stats.dropped++; return; }
+	}
+	else if ((int)(Rand() % (unsigned int)seen) >= max_per_bin)
+	{
+		// reservoir sampling : every sample seen by the bin is kept with the same probability
+		_stats.dropped++;
+		return;
+	}
+
+	int victim = (int)(Rand() % (unsigned int)bin_counts[victim_bin]);
+	for (calib_sample& s : reservoir)
+	{
+		if (s.bin != victim_bin || victim-- > 0) continue;
+		s = sample;
+		break;
+	}
+	bin_counts[victim_bin]--;
+	count++;
+	_stats.replaced++;
+}
+
+bool calib_engine::Solve(const cv::Mat& cam_mat, calib_result& _result, calib_stats& _stats)
+{
+	PROF_ZONE("calib solve");
+	if ((int)reservoir.size() < CALIB_MIN_SAMPLES) return false;
+	const auto t_start = std::chrono::steady_clock::now();
+
+	std::vector<cv::Point3f> points_3d(reservoir.size());
+	std::vector<cv::Point2f> points_2d(reservoir.size());
+	for (int i = 0; i < (int)reservoir.size(); i++)
+	{
+		points_3d[i] = reservoir[i].p3d_clf;
+		points_2d[i] = reservoir[i].p2d;
+	}
+
+	const cv::Mat dist_coeffs = cv::Mat::zeros(4, 1, CV_64FC1);
+	const cv::TermCriteria lm_criteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 20, FLT_EPSILON);
+	std::vector<float> residuals;
+	float rms_err = 0;
+
+	bool warm_started = has_pose;
+	if (has_pose)
+	{
+		cv::solvePnPRefineLM(points_3d, points_2d, cam_mat, dist_coeffs, rvec, tvec, lm_criteria);
+		ComputeResiduals(points_3d, points_2d, rvec, tvec, cam_mat, residuals, rms_err);
+		// the previous pose is not a valid start (e.g., the camera moved on its rigid body since the loaded calibration)
+		const float prev_rms = rms_history.empty() ? min_outlier_px : rms_history.back();
+		if (rms_err > 4.f * prev_rms + min_outlier_px) warm_started = false;
+	}
+	if (!warm_started)
+	{
+		rvec = cv::Mat::zeros(3, 1, CV_64FC1);
+		tvec = cv::Mat::zeros(3, 1, CV_64FC1);
+		cv::solvePnP(points_3d, points_2d, cam_mat, dist_coeffs, rvec, tvec, false, cv::SOLVEPNP_DLS);
+		cv::solvePnP(points_3d, points_2d, cam_mat, dist_coeffs, rvec, tvec, true, cv::SOLVEPNP_ITERATIVE);
+		ComputeResiduals(points_3d, points_2d, rvec, tvec, cam_mat, residuals, rms_err);
+		rms_history.clear();
+	}
+
+	// outlier rejection : residual above the median + 3 MAD (normal consistent), at most 2 rounds
+	int num_rejected = 0;
+	for (int round = 0; round < 2; round++)
+	{
+		const float med = Median(residuals);
+		std::vector<float> abs_devs(residuals.size());
+		for (int i = 0; i < (int)residuals.size(); i++) abs_devs[i] = fabs(residuals[i] - med);
+		float threshold = med + 3.f * 1.4826f * Median(abs_devs);
+		threshold = threshold > min_outlier_px ? threshold : min_outlier_px;
+
+		int num_inliers = 0;
+		for (const float r : residuals) if (r <= threshold) num_inliers++;
+		if (num_inliers == (int)residuals.size() || num_inliers < CALIB_MIN_SAMPLES) break;
+
+		int j = 0;
+		for (int i = 0; i < (int)reservoir.size(); i++)
+		{
+			if (residuals[i] > threshold)
+			{
+				bin_counts[reservoir[i].bin]--;
+				continue;
+			}
+			reservoir[j] = reservoir[i];
+			points_3d[j] = points_3d[i];
+			points_2d[j] = points_2d[i];
+			j++;
+		}
+		num_rejected += (int)reservoir.size() - j;
+		reservoir.resize(j);
+		points_3d.resize(j);
+		points_2d.resize(j);
+
+		cv::solvePnPRefineLM(points_3d, points_2d, cam_mat, dist_coeffs, rvec, tvec, lm_criteria);
+		ComputeResiduals(points_3d, points_2d, rvec, tvec, cam_mat, residuals, rms_err);
+	}
+	has_pose = true;
+
+	// convergence : the rms error changed by less than 2% (+ 0.01 pixel) over the last 3 solves
+	rms_history.push_back(rms_err);
+	if ((int)rms_history.size() > CALIB_HISTORY) rms_history.pop_front();
+	bool converged = rms_history.size() >= 4;
+	for (int i = (int)rms_history.size() - 3; converged && i < (int)rms_history.size(); i++)
+		converged = fabs(rms_history[i] - rms_history[i - 1]) <= 0.02f * rms_history[i - 1] + 0.01f;
+
+	_result.mat_rscs2clf = PoseToRsCs2Clf(rvec, tvec);
+	_result.rms_err = rms_err;
+	_result.num_samples = (int)reservoir.size();
+	_result.num_rejected = num_rejected;
+	_result.warm_started = warm_started;
+	_result.converged = converged;
+	_result.rms_history.assign(rms_history.begin(), rms_history.end());
+	_result.samples = reservoir;
+
+	_stats.rejected += num_rejected;
+	_stats.solves++;
+	_stats.solve_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t_start).count();
+	return true;
+}
+
+void calib_engine::WorkerLoop()
+{
+	profiler::SetThreadName("calib engine");
+	while (true)
+	{
+		std::vector<calib_sample> new_samples;
+		bool do_reset = false, set_pose = false;
+		glm::fmat4x4 mat_rscs2clf;
+		uint64_t job_epoch;
+		cv::Mat cam_mat = cv::Mat::zeros(3, 3, CV_64FC1);
+		{
+			std::unique_lock<std::mutex> lock(calib_lock);
+			calib_pushed.wait(lock, [this] { return stop_worker || reset_requested || has_pending_pose || !pending.empty(); });
+			if (stop_worker) return;
+			new_samples.swap(pending);
+			do_reset = reset_requested;
+			set_pose = has_pending_pose;
+			mat_rscs2clf = pending_pose;
+			reset_requested = has_pending_pose = false;
+			job_epoch = epoch;
+			cam_mat.at<double>(0, 0) = fx;
+			cam_mat.at<double>(1, 1) = fy;
+			cam_mat.at<double>(0, 2) = cx;
+			cam_mat.at<double>(1, 2) = cy;
+			cam_mat.at<double>(2, 2) = 1;
+		}
+
+		if (do_reset) ClearReservoir();
+		if (set_pose)
+		{
+			RsCs2ClfToPose(mat_rscs2clf, rvec, tvec);
+			has_pose = true;
+		}
+
+		calib_stats job_stats;
+		memset(&job_stats, 0, sizeof(job_stats));
+		for (const calib_sample& sample : new_samples) AddSample(sample, job_stats);
+
+		calib_result job_result;
+		const bool solved = new_samples.size() > 0 && Solve(cam_mat, job_result, job_stats);
+
+		std::lock_guard<std::mutex> lock(calib_lock);
+		stats.binned += job_stats.binned;
+		stats.replaced += job_stats.replaced;
+		stats.dropped += job_stats.dropped;
+		stats.rejected += job_stats.rejected;
+		stats.solves += job_stats.solves;
+		if (solved)
+		{
+			stats.solve_ms = job_stats.solve_ms;
+			if (job_epoch == epoch)
+			{
+				job_result.version = result.version + 1;
+				result = std::move(job_result);
+				result_epoch = job_epoch;
+			}
+		}
+	}
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <vector>
+#include <map>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdint.h>
+#include <glm/glm.hpp>
+#include <opencv2/core.hpp>
+
+// camera to rigid body (clf) calibration from 2d (pixel) - 3d (clf) point pairs
+// the samples are kept in a reservoir binned by image grid cell and pose bin (direction and distance of the 3d point from the camera rigid body),
+// each bin keeps at most max_per_bin samples (reservoir sampling), so the solve cost is bounded whatever the calibration length
+#define CALIB_GRID_W		8
+#define CALIB_GRID_H		6
+#define CALIB_POSE_AZIMUTHS	8		// 45 deg
+#define CALIB_POSE_ELEVS	4		// 45 deg
+#define CALIB_POSE_DISTS	4		// 0.25 m rings, the last one is open
+#define CALIB_MIN_SAMPLES	12
+#define CALIB_HISTORY		32		// published rms errors kept for the convergence report
+
+struct calib_sample
+{
+	cv::Point2f p2d;
+	cv::Point3f p3d_clf;
+	int bin;
+};
+
+struct calib_result
+{
+	uint64_t version;		// 0 : no result yet
+	glm::fmat4x4 mat_rscs2clf;
+	float rms_err;			// reprojection error (pixels) of the inliers
+	int num_samples;		// reservoir samples after the outlier rejection
+	int num_rejected;		// samples rejected by this solve
+	bool warm_started;		// refined from the previous pose
+	bool converged;			// rms_err stable over the last solves
+	std::vector<float> rms_history; // oldest first
+	std::vector<calib_sample> samples; // reservoir used by the solve
+};
+
+struct calib_stats
+{
+	long long pushed;		// samples given to Push
+	long long binned;		// samples added to a bin with a free slot
+	long long replaced;		// samples replacing a sample of a full bin
+	long long dropped;		// samples not kept by a full bin
+	long long rejected;		// samples removed as outliers
+	long long solves;
+	double solve_ms;		// last solve
+};
+
+// incremental calibration on a worker thread : the render thread pushes the samples of a frame and polls the published result,
+// the worker merges the pending samples into the reservoir, refines the pose (Levenberg-Marquardt warm-started from the previous pose,
+// cold start with DLS), removes the outliers (residual above the median + 3 MAD), and publishes the result
+// the pushes received during a solve are merged into the next one
+class calib_engine
+{
+private:
+	int max_per_bin, max_samples;
+	float min_outlier_px;
+
+	// worker data
+	std::vector<calib_sample> reservoir;
+	std::map<int, int> bin_counts, bin_seen; // key : bin
+	cv::Mat rvec, tvec; // clf to opencv camera frame
+	bool has_pose;
+	std::deque<float> rms_history;
+	unsigned int rand_state;
+
+	// shared data (guarded by calib_lock)
+	int img_w, img_h;
+	double fx, fy, cx, cy;
+	std::vector<calib_sample> pending;
+	glm::fmat4x4 pending_pose;
+	bool has_pending_pose, reset_requested;
+	uint64_t epoch, result_epoch; // Reset increases the epoch, a result of a previous epoch is neither published nor returned
+	calib_result result;
+	calib_stats stats;
+	std::mutex calib_lock;
+	std::condition_variable calib_pushed;
+
+	std::thread worker;
+	bool worker_alive, stop_worker;
+
+	void WorkerLoop();
+	int ComputeBin(const cv::Point2f& p2d, const cv::Point3f& p3d_clf) const;
+	void AddSample(calib_sample sample, calib_stats& _stats);
+	bool Solve(const cv::Mat& cam_mat, calib_result& _result, calib_stats& _stats);
+	void ClearReservoir();
+	unsigned int Rand();
+
+public:
+	calib_engine();
+	~calib_engine() { Stop(); }
+
+	// max_per_bin : samples per (image cell, pose bin), max_samples : reservoir size
+	// min_outlier_px : residuals below are never rejected
+	void Start(const int max_per_bin = 4, const int max_samples = 400, const float min_outlier_px = 2.f);
+	// the pending samples are dropped
+	void Stop();
+	bool IsRunning() const { return worker_alive; }
+
+	// intrinsics of the calibrated camera (no distortion), changing them restarts the calibration
+	void SetCamera(const int img_w, const int img_h, const float fx, const float fy, const float cx, const float cy);
+	// warm start pose (e.g., a calibration loaded from file)
+	void SetPose(const glm::fmat4x4& mat_rscs2clf);
+	// render thread, never blocks on a solve
+	void Push(const std::vector<cv::Point2f>& points_2d, const std::vector<cv::Point3f>& points_3d_clf);
+	// clears the reservoir and the pose
+	void Reset();
+
+	// true when a result newer than last_version was published since the last Reset
+	bool GetResult(const uint64_t last_version, calib_result& _result);
+	calib_stats GetStats();
+};
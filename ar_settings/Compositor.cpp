@@ -0,0 +1,290 @@
+#include "Compositor.h"
+
+#include <immintrin.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define COMP_SSE41
+#define COMP_AVX2
+#else
+#define COMP_SSE41 __attribute__((target("sse4.1")))
+#define COMP_AVX2 __attribute__((target("avx2")))
+#endif
+
+#define COMP_MAX_MASK_LUTS 8
+#define COMP_PARALLEL_PIXELS (64 * 1024) // smaller blends run on the calling thread
+
+// x / 255 rounded, exact for 0 <= x <= 255 * 255
+static inline unsigned int div255(const unsigned int x)
+{
+	const unsigned int t = x + 128;
+	return (t + (t >> 8)) >> 8;
+}
+
+static inline float radial_mask(const float r, const float a, const float b)
+{
+	const float m = (atan(a * (r - b)) + atan(a * 100.f)) / (atan(a * 1000.f) * 2.f);
+	if (!(m > 0)) return 0; // also a == 0 (nan)
+	return std::min(m, 1.f) * 0.8f;
+}
+
+// reference, the SIMD kernels match it bit for bit
+// col_mask == NULL : no mask, otherwise the mask of pixel j is min(row_mask, col_mask[j])
+static void BlendRowScalar(unsigned char* dst, const unsigned char* src, const int n, const uint8_t* col_mask, const uint8_t row_mask, const int flags)
+{
+	const int r_idx = flags & COMP_SWAP_RB ? 2 : 0;
+	const bool opaque = (flags & COMP_OPAQUE_SRC) != 0;
+	for (int j = 0; j < n; j++, dst += 3, src += 4)
+	{
+		unsigned int a = opaque ? 255 : src[3];
+		if (col_mask) a = div255(a * std::min(row_mask, col_mask[j]));
+		if (a == 0) continue;
+		const unsigned int ia = 255 - a;
+		dst[0] = (unsigned char)div255(src[r_idx] * a + dst[0] * ia);
+		dst[1] = (unsigned char)div255(src[1] * a + dst[1] * ia);
+		dst[2] = (unsigned char)div255(src[2 - r_idx] * a + dst[2] * ia);
+	}
+}
+
+// 16 pixels per step : 4 x RGBA (src) and 3 x 16 bytes of RGB (dst, expanded to RGB0 per 4 pixels)
+COMP_SSE41 static inline void LoadRgb16(const unsigned char* dst, __m128i e[4])
+{
+	const __m128i expand = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+	const __m128i d0 = _mm_loadu_si128((const __m128i*)dst);
+	const __m128i d1 = _mm_loadu_si128((const __m128i*)(dst + 16));
+	const __m128i d2 = _mm_loadu_si128((const __m128i*)(dst + 32));
+	e[0] = _mm_shuffle_epi8(d0, expand);
+	e[1] = _mm_shuffle_epi8(_mm_alignr_epi8(d1, d0, 12), expand);
+	e[2] = _mm_shuffle_epi8(_mm_alignr_epi8(d2, d1, 8), expand);
+	e[3] = _mm_shuffle_epi8(_mm_srli_si128(d2, 4), expand);
+}
+
+COMP_SSE41 static inline void StoreRgb16(unsigned char* dst, const __m128i o[4])
+{
+	const __m128i compress = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	const __m128i c0 = _mm_shuffle_epi8(o[0], compress);
+	const __m128i c1 = _mm_shuffle_epi8(o[1], compress);
+	const __m128i c2 = _mm_shuffle_epi8(o[2], compress);
+	const __m128i c3 = _mm_shuffle_epi8(o[3], compress);
+	_mm_storeu_si128((__m128i*)dst, _mm_or_si128(c0, _mm_slli_si128(c1, 12)));
+	_mm_storeu_si128((__m128i*)(dst + 16), _mm_or_si128(_mm_srli_si128(c1, 4), _mm_slli_si128(c2, 8)));
+	_mm_storeu_si128((__m128i*)(dst + 32), _mm_or_si128(_mm_srli_si128(c2, 8), _mm_slli_si128(c3, 4)));
+}
+
+// false : every pixel of the 16 is transparent (nothing to write)
+COMP_SSE41 static inline bool LoadRgba16(const unsigned char* src, const int flags, __m128i s[4])
+{
+	for (int k = 0; k < 4; k++) s[k] = _mm_loadu_si128((const __m128i*)(src + k * 16));
+	if (!(flags & COMP_OPAQUE_SRC))
+	{
+		const __m128i any = _mm_or_si128(_mm_or_si128(s[0], s[1]), _mm_or_si128(s[2], s[3]));
+		if (_mm_testz_si128(any, _mm_set1_epi32((int)0xFF000000))) return false;
+	}
+	if (flags & COMP_SWAP_RB)
+	{
+		const __m128i swap_rb = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+		for (int k = 0; k < 4; k++) s[k] = _mm_shuffle_epi8(s[k], swap_rb);
+	}
+	return true;
+}
+
+// mask bytes of the 16 pixels
+COMP_SSE41 static inline __m128i LoadMask16(const uint8_t* col_mask, const __m128i row_mask)
+{
+	return _mm_min_epu8(_mm_loadu_si128((const __m128i*)col_mask), row_mask);
+}
+
+COMP_SSE41 static inline __m128i div255_epi16(const __m128i x)
+{
+	const __m128i t = _mm_add_epi16(x, _mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+// 2 pixels (8 x u16) : s * a + e * (255 - a)
+COMP_SSE41 static inline __m128i Blend2(const __m128i s16, const __m128i e16, const __m128i a16)
+{
+	const __m128i ia16 = _mm_sub_epi16(_mm_set1_epi16(255), a16);
+	return div255_epi16(_mm_add_epi16(_mm_mullo_epi16(s16, a16), _mm_mullo_epi16(e16, ia16)));
+}
+
+COMP_SSE41 static void BlendRowSse41(unsigned char* dst, const unsigned char* src, const int n, const uint8_t* col_mask, const uint8_t row_mask, const int flags)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i alpha_lo = _mm_setr_epi8(3, -1, 3, -1, 3, -1, 3, -1, 7, -1, 7, -1, 7, -1, 7, -1);
+	const __m128i alpha_hi = _mm_setr_epi8(11, -1, 11, -1, 11, -1, 11, -1, 15, -1, 15, -1, 15, -1, 15, -1);
+	const __m128i mask_lo = _mm_setr_epi8(0, -1, 0, -1, 0, -1, 0, -1, 1, -1, 1, -1, 1, -1, 1, -1);
+	const __m128i mask_hi = _mm_setr_epi8(2, -1, 2, -1, 2, -1, 2, -1, 3, -1, 3, -1, 3, -1, 3, -1);
+	const __m128i opaque16 = _mm_set1_epi16(255);
+	const __m128i row_mask8 = _mm_set1_epi8((char)row_mask);
+	const bool opaque = (flags & COMP_OPAQUE_SRC) != 0;
+
+	int j = 0;
+	for (; j + 16 <= n; j += 16)
+	{
+		__m128i s[4], e[4];
+		if (!LoadRgba16(src + j * 4, flags, s)) continue;
+		LoadRgb16(dst + j * 3, e);
+		__m128i m = col_mask ? LoadMask16(col_mask + j, row_mask8) : zero;
+		for (int k = 0; k < 4; k++, m = _mm_srli_si128(m, 4))
+		{
+			__m128i a_lo = opaque ? opaque16 : _mm_shuffle_epi8(s[k], alpha_lo);
+			__m128i a_hi = opaque ? opaque16 : _mm_shuffle_epi8(s[k], alpha_hi);
+			if (col_mask)
+			{
+				a_lo = div255_epi16(_mm_mullo_epi16(a_lo, _mm_shuffle_epi8(m, mask_lo)));
+				a_hi = div255_epi16(_mm_mullo_epi16(a_hi, _mm_shuffle_epi8(m, mask_hi)));
+			}
+			const __m128i o_lo = Blend2(_mm_cvtepu8_epi16(s[k]), _mm_cvtepu8_epi16(e[k]), a_lo);
+			const __m128i o_hi = Blend2(_mm_unpackhi_epi8(s[k], zero), _mm_unpackhi_epi8(e[k], zero), a_hi);
+			e[k] = _mm_packus_epi16(o_lo, o_hi);
+		}
+		StoreRgb16(dst + j * 3, e);
+	}
+	BlendRowScalar(dst + j * 3, src + j * 4, n - j, col_mask ? col_mask + j : NULL, row_mask, flags);
+}
+
+// 4 pixels (16 x u16) per register, the RGB loads / stores are the SSE ones
+COMP_AVX2 static inline __m256i div255_epi16_avx2(const __m256i x)
+{
+	const __m256i t = _mm256_add_epi16(x, _mm256_set1_epi16(128));
+	return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+}
+
+COMP_AVX2 static void BlendRowAvx2(unsigned char* dst, const unsigned char* src, const int n, const uint8_t* col_mask, const uint8_t row_mask, const int flags)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i alpha16 = _mm256_setr_epi8(6, 7, 6, 7, 6, 7, 6, 7, 14, 15, 14, 15, 14, 15, 14, 15,
+		6, 7, 6, 7, 6, 7, 6, 7, 14, 15, 14, 15, 14, 15, 14, 15);
+	const __m128i mask4 = _mm_setr_epi8(0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3);
+	const __m256i c255 = _mm256_set1_epi16(255);
+	const __m128i row_mask8 = _mm_set1_epi8((char)row_mask);
+	const bool opaque = (flags & COMP_OPAQUE_SRC) != 0;
+
+	int j = 0;
+	for (; j + 16 <= n; j += 16)
+	{
+		__m128i s[4], e[4];
+		if (!LoadRgba16(src + j * 4, flags, s)) continue;
+		LoadRgb16(dst + j * 3, e);
+		__m128i m = col_mask ? LoadMask16(col_mask + j, row_mask8) : _mm_setzero_si128();
+		for (int k = 0; k < 4; k++, m = _mm_srli_si128(m, 4))
+		{
+			const __m256i s16 = _mm256_cvtepu8_epi16(s[k]);
+			const __m256i e16 = _mm256_cvtepu8_epi16(e[k]);
+			__m256i a16 = opaque ? c255 : _mm256_shuffle_epi8(s16, alpha16);
+			if (col_mask) a16 = div255_epi16_avx2(_mm256_mullo_epi16(a16, _mm256_cvtepu8_epi16(_mm_shuffle_epi8(m, mask4))));
+			const __m256i ia16 = _mm256_sub_epi16(c255, a16);
+			const __m256i o16 = div255_epi16_avx2(_mm256_add_epi16(_mm256_mullo_epi16(s16, a16), _mm256_mullo_epi16(e16, ia16)));
+			// lanes : pixels 0, 1 | pixels 2, 3
+			e[k] = _mm256_castsi256_si128(_mm256_permute4x64_epi64(_mm256_packus_epi16(o16, zero), 0x08));
+		}
+		StoreRgb16(dst + j * 3, e);
+	}
+	BlendRowScalar(dst + j * 3, src + j * 4, n - j, col_mask ? col_mask + j : NULL, row_mask, flags);
+}
+
+typedef void(*blend_row_func)(unsigned char* dst, const unsigned char* src, const int n, const uint8_t* col_mask, const uint8_t row_mask, const int flags);
+static const blend_row_func blend_rows[COMP_KERNEL_COUNT] = { BlendRowScalar, BlendRowSse41, BlendRowAvx2 };
+
+CompositorKernel ui_compositor::GetBestKernel()
+{
+	static CompositorKernel best = COMP_KERNEL_COUNT;
+	if (best != COMP_KERNEL_COUNT) return best;
+	bool sse41 = false, avx2 = false;
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	const int num_ids = info[0];
+	__cpuid(info, 1);
+	sse41 = (info[2] & (1 << 19)) != 0;
+	const bool os_avx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+	if (num_ids >= 7 && os_avx)
+	{
+		__cpuidex(info, 7, 0);
+		avx2 = (info[1] & (1 << 5)) != 0;
+	}
+#else
+	sse41 = __builtin_cpu_supports("sse4.1");
+	avx2 = __builtin_cpu_supports("avx2");
+#endif
+	best = avx2 ? COMP_KERNEL_AVX2 : sse41 ? COMP_KERNEL_SSE41 : COMP_KERNEL_SCALAR;
+	return best;
+}
+
+ui_compositor::ui_compositor()
+{
+	next_lut = 0;
+	kernel = GetBestKernel();
+}
+
+void ui_compositor::SetKernel(const CompositorKernel _kernel)
+{
+	kernel = (CompositorKernel)std::max(std::min((int)_kernel, (int)GetBestKernel()), 0);
+}
+
+std::shared_ptr<const ui_compositor::mask_lut> ui_compositor::GetMaskLut(const int w, const int h, const float a, const float b)
+{
+	std::lock_guard<std::mutex> lock(lut_mutex);
+	for (const std::shared_ptr<const mask_lut>& lut : mask_luts)
+		if (lut->w == w && lut->h == h && lut->a == a && lut->b == b) return lut;
+
+	std::shared_ptr<mask_lut> new_lut = std::make_shared<mask_lut>();
+	mask_lut& lut = *new_lut;
+	lut.w = w;
+	lut.h = h;
+	lut.a = a;
+	lut.b = b;
+	// distance to the border : min(i, h - i) and min(j, w - j), the mask grows with it (atan),
+	// so the mask of the nearer border is the min of the row and the column masks
+	lut.row.resize(h);
+	lut.col.resize(w);
+	for (int i = 0; i < h; i++)
+		lut.row[i] = (uint8_t)(radial_mask((float)std::min(i, h - i), a, b) * 255.f + 0.5f);
+	for (int j = 0; j < w; j++)
+		lut.col[j] = (uint8_t)(radial_mask((float)std::min(j, w - j), a, b) * 255.f + 0.5f);
+
+	// replaces the oldest one when full (a Blend still using it holds its own reference)
+	if ((int)mask_luts.size() < COMP_MAX_MASK_LUTS) mask_luts.push_back(new_lut);
+	else mask_luts[next_lut] = new_lut;
+	next_lut = (next_lut + 1) % COMP_MAX_MASK_LUTS;
+	return new_lut;
+}
+
+void ui_compositor::Blend(unsigned char* data_ui, const int w, const int h, const unsigned char* data_render_bf, const int w_bf, const int h_bf,
+	const int offset_x, const int offset_y, const int flags, const float mask_a, const float mask_b)
+{
+	// render buffer region inside data_ui
+	const int i_begin = std::max(-offset_y, 0), i_end = std::min(h_bf, h - offset_y);
+	const int j_begin = std::max(-offset_x, 0), j_end = std::min(w_bf, w - offset_x);
+	if (i_begin >= i_end || j_begin >= j_end) return;
+
+	const std::shared_ptr<const mask_lut> lut = flags & COMP_SMOOTH_MASK ? GetMaskLut(w_bf, h_bf, mask_a, mask_b) : NULL;
+	const uint8_t* col_mask = lut ? &lut->col[j_begin] : NULL;
+	const blend_row_func blend_row = blend_rows[kernel];
+	const int n = j_end - j_begin;
+	const int num_rows = i_end - i_begin;
+#pragma omp parallel for if (num_rows * n > COMP_PARALLEL_PIXELS)
+	for (int i = i_begin; i < i_end; i++)
+	{
+		const int y = flags & COMP_FLIP_V ? h_bf - 1 - i : i;
+		unsigned char* dst = data_ui + ((size_t)(i + offset_y) * w + j_begin + offset_x) * 3;
+		const unsigned char* src = data_render_bf + ((size_t)y * w_bf + j_begin) * 4;
+		blend_row(dst, src, n, col_mask, lut ? lut->row[i] : 255, flags);
+	}
+}
+
+static ui_compositor g_ui_compositor;
+
+void copy_back_ui_buffer(unsigned char* data_ui, unsigned char* data_render_bf, int w, int h, bool v_flib)
+{
+	g_ui_compositor.Blend(data_ui, w, h, data_render_bf, w, h, 0, 0, v_flib ? COMP_FLIP_V : 0);
+}
+
+void copy_back_ui_buffer_local(unsigned char* data_ui, int w, int h, unsigned char* data_render_bf, int w_bf, int h_bf, int offset_x, int offset_y, bool v_flib, bool smooth_mask, float _a, float _b, bool opaque_bg)
+{
+	const int flags = (v_flib ? COMP_FLIP_V : 0) | (smooth_mask ? COMP_SMOOTH_MASK : 0) | (opaque_bg ? COMP_OPAQUE_SRC : 0);
+	g_ui_compositor.Blend(data_ui, w, h, data_render_bf, w_bf, h_bf, offset_x, offset_y, flags, _a, _b);
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+
+// compositing of the RGBA render buffers (vzm) over the 3-channel camera image
+// integer blending : out = (src * a + dst * (255 - a)) / 255 (rounded), the vertical flip of the render buffer,
+// the R <-> B swap and the radial mask are applied in the same pass
+enum CompositorKernel
+{
+	COMP_KERNEL_SCALAR = 0,	// reference
+	COMP_KERNEL_SSE41,
+	COMP_KERNEL_AVX2,
+	COMP_KERNEL_COUNT
+};
+
+// flags of ui_compositor::Blend
+#define COMP_FLIP_V			0x1	// the render buffer is bottom-up
+#define COMP_SWAP_RB		0x2	// RGBA over BGR
+#define COMP_OPAQUE_SRC		0x4	// the alpha of the render buffer is ignored (255)
+#define COMP_SMOOTH_MASK	0x8	// the alpha fades out toward the border of the render buffer (mask_a, mask_b)
+
+class ui_compositor
+{
+private:
+	// mask of a pixel : min(row[y], col[x]), the mask is non-decreasing with the distance to the border
+	struct mask_lut
+	{
+		int w, h;
+		float a, b;
+		std::vector<uint8_t> row, col;
+	};
+	// one per (w, h, a, b), a few call sites
+	// a Blend keeps its LUT alive while another thread replaces the entry (shared_ptr), the list is locked
+	std::vector<std::shared_ptr<const mask_lut>> mask_luts;
+	int next_lut;
+	std::mutex lut_mutex;
+	CompositorKernel kernel;
+
+	std::shared_ptr<const mask_lut> GetMaskLut(const int w, const int h, const float a, const float b);
+
+public:
+	ui_compositor();
+
+	// the best kernel of the cpu is used by default, a kernel not supported falls back to the next one
+	static CompositorKernel GetBestKernel();
+	void SetKernel(const CompositorKernel _kernel);
+	CompositorKernel GetKernel() const { return kernel; }
+
+	// data_render_bf (w_bf x h_bf, 4 channels) over data_ui (w x h, 3 channels) at (offset_x, offset_y), clipped to data_ui
+	// thread-safe (blends of different threads into the same data_ui rows are not ordered)
+	void Blend(unsigned char* data_ui, const int w, const int h, const unsigned char* data_render_bf, const int w_bf, const int h_bf,
+		const int offset_x, const int offset_y, const int flags, const float mask_a = 0, const float mask_b = 0);
+};
+
+// the whole render buffer (same size as data_ui)
+void copy_back_ui_buffer(unsigned char* data_ui, unsigned char* data_render_bf, int w, int h, bool v_flib);
+// a smaller render buffer at (offset_x, offset_y), smooth_mask : alpha * 0.8 fading out over the border (_a : steepness, _b : distance in pixels)
+void copy_back_ui_buffer_local(unsigned char* data_ui, int w, int h, unsigned char* data_render_bf, int w_bf, int h_bf, int offset_x, int offset_y, bool v_flib, bool smooth_mask, float _a, float _b, bool opaque_bg);
@@ -0,0 +1,293 @@
+#include "DepthProc.h"
+
+#include <librealsense2/rsutil.h>
+#include <emmintrin.h>
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+static bool same_intrinsics(const rs2_intrinsics& a, const rs2_intrinsics& b)
+{
+	return a.width == b.width && a.height == b.height && a.fx == b.fx && a.fy == b.fy && a.ppx == b.ppx && a.ppy == b.ppy
+		&& a.model == b.model && memcmp(a.coeffs, b.coeffs, sizeof(a.coeffs)) == 0;
+}
+
+void depth_normal_kernel::UpdateRays(const rs2_intrinsics& intr)
+{
+	if (has_rays && same_intrinsics(ray_intrinsics, intr)) return;
+
+	ray_intrinsics = intr;
+	has_rays = true;
+	w = intr.width;
+	h = intr.height;
+	const int num_pixels = w * h;
+	ray_x.resize(num_pixels);
+	ray_y.resize(num_pixels);
+	pos_x.resize(num_pixels); pos_y.resize(num_pixels); pos_z.resize(num_pixels);
+	nrl_x.resize(num_pixels); nrl_y.resize(num_pixels); nrl_z.resize(num_pixels);
+	zero_row.assign(w, 0);
+
+	// the forward-distorted model cannot be deprojected, treat it as pinhole like the SDK pointcloud does
+	rs2_intrinsics ray_intr = intr;
+	if (ray_intr.model == RS2_DISTORTION_MODIFIED_BROWN_CONRADY) ray_intr.model = RS2_DISTORTION_NONE;
+	for (int y = 0; y < h; y++)
+		for (int x = 0; x < w; x++)
+		{
+			float pixel[2] = { (float)x, (float)y }, ray[3];
+			rs2_deproject_pixel_to_point(ray, &ray_intr, pixel, 1.f);
+			ray_x[x + y * w] = ray[0];
+			ray_y[x + y * w] = ray[1];
+		}
+}
+
+void depth_normal_kernel::ComputePosRow(const int y, const uint16_t* depth_row, const float depth_scale)
+{
+	const int offset = y * w;
+	int x = 0;
+	if (use_simd)
+	{
+		const __m128 scale = _mm_set1_ps(depth_scale);
+		const __m128i zero = _mm_setzero_si128();
+		for (; x + 4 <= w; x += 4)
+		{
+			__m128i d16 = _mm_loadl_epi64((const __m128i*)(depth_row + x));
+			__m128 z = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(d16, zero)), scale);
+			_mm_storeu_ps(&pos_x[offset + x], _mm_mul_ps(_mm_loadu_ps(&ray_x[offset + x]), z));
+			_mm_storeu_ps(&pos_y[offset + x], _mm_mul_ps(_mm_loadu_ps(&ray_y[offset + x]), z));
+			_mm_storeu_ps(&pos_z[offset + x], z);
+		}
+	}
+	for (; x < w; x++)
+	{
+		float z = depth_row[x] * depth_scale;
+		pos_x[offset + x] = ray_x[offset + x] * z;
+		pos_y[offset + x] = ray_y[offset + x] * z;
+		pos_z[offset + x] = z;
+	}
+}
+
+// scalar reference of the normal rule
+// tangent along each axis from the neighbor with the smaller depth difference (a zero-depth neighbor is never picked),
+// normal = cross(tangent_x, tangent_y) oriented toward the sensor, zero when the pixel or both neighbors of an axis are invalid
+static glm::fvec3 nrl_pixel(const glm::fvec3& p, const glm::fvec3& p_l, const glm::fvec3& p_r, const glm::fvec3& p_u, const glm::fvec3& p_d)
+{
+	if (p.z <= 0) return glm::fvec3(0);
+	float dl = p_l.z > 0 ? fabs(p.z - p_l.z) : FLT_MAX;
+	float dr = p_r.z > 0 ? fabs(p.z - p_r.z) : FLT_MAX;
+	float du = p_u.z > 0 ? fabs(p.z - p_u.z) : FLT_MAX;
+	float dd = p_d.z > 0 ? fabs(p.z - p_d.z) : FLT_MAX;
+	if ((dl == FLT_MAX && dr == FLT_MAX) || (du == FLT_MAX && dd == FLT_MAX)) return glm::fvec3(0);
+
+	glm::fvec3 tx = dl < dr ? p - p_l : p_r - p;
+	glm::fvec3 ty = du < dd ? p - p_u : p_d - p;
+	glm::fvec3 n = glm::cross(tx, ty);
+	if (glm::dot(n, p) > 0) n = -n;
+	float len2 = glm::dot(n, n);
+	return len2 > 0 ? n / sqrtf(len2) : glm::fvec3(0);
+}
+
+static inline __m128 sel_ps(const __m128 mask, const __m128 a, const __m128 b)
+{
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+void depth_normal_kernel::ComputeNrlRow(const int y)
+{
+	const int offset = y * w;
+	const float* px = &pos_x[offset], *py = &pos_y[offset], *pz = &pos_z[offset];
+	const float* ux = y > 0 ? px - w : &zero_row[0], *uy = y > 0 ? py - w : &zero_row[0], *uz = y > 0 ? pz - w : &zero_row[0];
+	const float* dx = y < h - 1 ? px + w : &zero_row[0], *dy = y < h - 1 ? py + w : &zero_row[0], *dz = y < h - 1 ? pz + w : &zero_row[0];
+	float* nx = &nrl_x[offset], *ny = &nrl_y[offset], *nz = &nrl_z[offset];
+
+	auto scalar_pixel = [&](const int x)
+	{
+		glm::fvec3 p(px[x], py[x], pz[x]);
+		glm::fvec3 p_l = x > 0 ? glm::fvec3(px[x - 1], py[x - 1], pz[x - 1]) : glm::fvec3(0);
+		glm::fvec3 p_r = x < w - 1 ? glm::fvec3(px[x + 1], py[x + 1], pz[x + 1]) : glm::fvec3(0);
+		glm::fvec3 n = nrl_pixel(p, p_l, p_r, glm::fvec3(ux[x], uy[x], uz[x]), glm::fvec3(dx[x], dy[x], dz[x]));
+		nx[x] = n.x; ny[x] = n.y; nz[x] = n.z;
+	};
+
+	if (!use_simd || w < 6)
+	{
+		for (int x = 0; x < w; x++) scalar_pixel(x);
+		return;
+	}
+
+	scalar_pixel(0);
+	const __m128 zero = _mm_setzero_ps(), inf = _mm_set1_ps(FLT_MAX), one = _mm_set1_ps(1.f);
+	const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	const __m128 sign_mask = _mm_castsi128_ps(_mm_set1_epi32(0x80000000));
+	int x = 1;
+	for (; x + 4 <= w - 1; x += 4)
+	{
+		__m128 cx = _mm_loadu_ps(px + x), cy = _mm_loadu_ps(py + x), cz = _mm_loadu_ps(pz + x);
+		__m128 lx = _mm_loadu_ps(px + x - 1), ly = _mm_loadu_ps(py + x - 1), lz = _mm_loadu_ps(pz + x - 1);
+		__m128 rx = _mm_loadu_ps(px + x + 1), ry = _mm_loadu_ps(py + x + 1), rz = _mm_loadu_ps(pz + x + 1);
+		__m128 vux = _mm_loadu_ps(ux + x), vuy = _mm_loadu_ps(uy + x), vuz = _mm_loadu_ps(uz + x);
+		__m128 vdx = _mm_loadu_ps(dx + x), vdy = _mm_loadu_ps(dy + x), vdz = _mm_loadu_ps(dz + x);
+
+		__m128 dl = sel_ps(_mm_cmpgt_ps(lz, zero), _mm_and_ps(_mm_sub_ps(cz, lz), abs_mask), inf);
+		__m128 dr = sel_ps(_mm_cmpgt_ps(rz, zero), _mm_and_ps(_mm_sub_ps(cz, rz), abs_mask), inf);
+		__m128 du = sel_ps(_mm_cmpgt_ps(vuz, zero), _mm_and_ps(_mm_sub_ps(cz, vuz), abs_mask), inf);
+		__m128 dd = sel_ps(_mm_cmpgt_ps(vdz, zero), _mm_and_ps(_mm_sub_ps(cz, vdz), abs_mask), inf);
+		__m128 valid = _mm_and_ps(_mm_cmpgt_ps(cz, zero),
+			_mm_and_ps(_mm_cmplt_ps(_mm_min_ps(dl, dr), inf), _mm_cmplt_ps(_mm_min_ps(du, dd), inf)));
+
+		__m128 use_l = _mm_cmplt_ps(dl, dr), use_u = _mm_cmplt_ps(du, dd);
+		__m128 tx_x = sel_ps(use_l, _mm_sub_ps(cx, lx), _mm_sub_ps(rx, cx));
+		__m128 tx_y = sel_ps(use_l, _mm_sub_ps(cy, ly), _mm_sub_ps(ry, cy));
+		__m128 tx_z = sel_ps(use_l, _mm_sub_ps(cz, lz), _mm_sub_ps(rz, cz));
+		__m128 ty_x = sel_ps(use_u, _mm_sub_ps(cx, vux), _mm_sub_ps(vdx, cx));
+		__m128 ty_y = sel_ps(use_u, _mm_sub_ps(cy, vuy), _mm_sub_ps(vdy, cy));
+		__m128 ty_z = sel_ps(use_u, _mm_sub_ps(cz, vuz), _mm_sub_ps(vdz, cz));
+
+		__m128 n_x = _mm_sub_ps(_mm_mul_ps(tx_y, ty_z), _mm_mul_ps(tx_z, ty_y));
+		__m128 n_y = _mm_sub_ps(_mm_mul_ps(tx_z, ty_x), _mm_mul_ps(tx_x, ty_z));
+		__m128 n_z = _mm_sub_ps(_mm_mul_ps(tx_x, ty_y), _mm_mul_ps(tx_y, ty_x));
+
+		// orient toward the sensor (camera at the origin)
+		__m128 n_dot_p = _mm_add_ps(_mm_add_ps(_mm_mul_ps(n_x, cx), _mm_mul_ps(n_y, cy)), _mm_mul_ps(n_z, cz));
+		__m128 flip = _mm_and_ps(_mm_cmpgt_ps(n_dot_p, zero), sign_mask);
+		n_x = _mm_xor_ps(n_x, flip);
+		n_y = _mm_xor_ps(n_y, flip);
+		n_z = _mm_xor_ps(n_z, flip);
+
+		__m128 len2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(n_x, n_x), _mm_mul_ps(n_y, n_y)), _mm_mul_ps(n_z, n_z));
+		valid = _mm_and_ps(valid, _mm_cmpgt_ps(len2, zero));
+		__m128 inv_len = _mm_and_ps(valid, _mm_div_ps(one, _mm_sqrt_ps(_mm_max_ps(len2, _mm_set1_ps(FLT_MIN)))));
+
+		_mm_storeu_ps(nx + x, _mm_mul_ps(n_x, inv_len));
+		_mm_storeu_ps(ny + x, _mm_mul_ps(n_y, inv_len));
+		_mm_storeu_ps(nz + x, _mm_mul_ps(n_z, inv_len));
+	}
+	for (; x < w; x++) scalar_pixel(x);
+}
+
+void depth_normal_kernel::Compute(const uint16_t* depth, const int stride_bytes, const rs2_intrinsics& intr, const float depth_scale)
+{
+	UpdateRays(intr);
+	if (w <= 0 || h <= 0) return;
+
+	// rows are independent in each pass, the normal pass reads the neighbor rows of the position pass
+#pragma omp parallel for schedule(static)
+	for (int y = 0; y < h; y++)
+		ComputePosRow(y, (const uint16_t*)((const uint8_t*)depth + (size_t)y * stride_bytes), depth_scale);
+
+#pragma omp parallel for schedule(static)
+	for (int y = 0; y < h; y++)
+		ComputeNrlRow(y);
+}
+
+int point_cloud_stage::Stage(const depth_normal_kernel& kernel)
+{
+	const int w = kernel.GetWidth(), h = kernel.GetHeight();
+	stage_buffer& buf = buffers[front ^ 1];
+	if ((int)buf.pos.size() < w * h)
+	{
+		buf.pos.resize(w * h);
+		buf.nrl.resize(w * h);
+	}
+
+	// per-row valid counts -> offsets, then every row writes its own range
+	row_offsets.resize(h + 1);
+	const float* pz = kernel.PosZ();
+#pragma omp parallel for schedule(static)
+	for (int y = 0; y < h; y++)
+	{
+		int count = 0;
+		for (int x = 0; x < w; x++) count += pz[x + y * w] > 0;
+		row_offsets[y + 1] = count;
+	}
+	row_offsets[0] = 0;
+	for (int y = 0; y < h; y++) row_offsets[y + 1] += row_offsets[y];
+
+	const float* px = kernel.PosX(), *py = kernel.PosY();
+	const float* nx = kernel.NrlX(), *ny = kernel.NrlY(), *nz = kernel.NrlZ();
+#pragma omp parallel for schedule(static)
+	for (int y = 0; y < h; y++)
+	{
+		int j = row_offsets[y];
+		for (int x = 0; x < w; x++)
+		{
+			int idx = x + y * w;
+			if (pz[idx] <= 0) continue;
+			buf.pos[j] = glm::fvec3(px[idx], py[idx], pz[idx]);
+			buf.nrl[j] = glm::fvec3(nx[idx], ny[idx], nz[idx]);
+			j++;
+		}
+	}
+	buf.num_pts = h > 0 ? row_offsets[h] : 0;
+	const int num_valid = buf.num_pts;
+
+	if (voxel_size > 0) Decimate(buf);
+	front ^= 1;
+
+	stats.num_in = w * h;
+	stats.num_valid = num_valid;
+	stats.num_out = buf.num_pts;
+	stats.frames++;
+	stats.total_in += stats.num_in;
+	stats.total_out += stats.num_out;
+	return buf.num_pts;
+}
+
+void point_cloud_stage::Decimate(stage_buffer& buf)
+{
+	const int n = buf.num_pts;
+	if (n == 0) return;
+	int table_size = 1;
+	while (table_size < n * 2) table_size <<= 1;
+	const unsigned long long empty_key = ~0ull;
+	voxel_keys.assign(table_size, empty_key);
+	voxel_slots.resize(table_size);
+	voxel_counts.resize(n);
+
+	// voxels are appended in the scan order, so the accumulation target is never ahead of the read index
+	const float inv_size = 1.f / voxel_size;
+	int num_voxels = 0;
+	for (int i = 0; i < n; i++)
+	{
+		glm::fvec3 p = buf.pos[i];
+		unsigned long long ix = (unsigned long long)((long long)floorf(p.x * inv_size) + (1 << 20)) & 0x1fffff;
+		unsigned long long iy = (unsigned long long)((long long)floorf(p.y * inv_size) + (1 << 20)) & 0x1fffff;
+		unsigned long long iz = (unsigned long long)((long long)floorf(p.z * inv_size) + (1 << 20)) & 0x1fffff;
+		unsigned long long key = ix | (iy << 21) | (iz << 42);
+		unsigned int slot = (unsigned int)((key * 0x9E3779B97F4A7C15ull) >> 32) & (table_size - 1);
+		while (voxel_keys[slot] != empty_key && voxel_keys[slot] != key) slot = (slot + 1) & (table_size - 1);
+
+		if (voxel_keys[slot] == empty_key)
+		{
+			voxel_keys[slot] = key;
+			voxel_slots[slot] = num_voxels;
+			voxel_counts[num_voxels] = 1;
+			buf.pos[num_voxels] = p;
+			buf.nrl[num_voxels] = buf.nrl[i];
+			num_voxels++;
+		}
+		else
+		{
+			int j = voxel_slots[slot];
+			voxel_counts[j]++;
+			buf.pos[j] += p;
+			buf.nrl[j] += buf.nrl[i];
+		}
+	}
+
+	for (int j = 0; j < num_voxels; j++)
+	{
+		if (voxel_counts[j] == 1) continue;
+		buf.pos[j] /= (float)voxel_counts[j];
+		float len2 = glm::dot(buf.nrl[j], buf.nrl[j]);
+		buf.nrl[j] = len2 > 0 ? buf.nrl[j] / sqrtf(len2) : glm::fvec3(0);
+	}
+	buf.num_pts = num_voxels;
+}
+
+bool point_cloud_stage::Upload()
+{
+	const stage_buffer& buf = buffers[front];
+	if (!upload_func || buf.num_pts == 0) return false;
+	upload_func((const float*)buf.pos.data(), (const float*)buf.nrl.data(), NULL, buf.num_pts);
+	return true;
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <vector>
+#include <functional>
+#include <stdint.h>
+#include <glm/glm.hpp>
+#include <librealsense2/h/rs_types.h> // rs2_intrinsics
+
+// raw z16 depth -> camera-space positions and face normals
+// positions and normals are kept as SoA planes (w * h each) and reused across frames
+class depth_normal_kernel
+{
+private:
+	// per-pixel ray (z = 1) cache, rebuilt only when the intrinsics change
+	rs2_intrinsics ray_intrinsics;
+	bool has_rays;
+	std::vector<float> ray_x, ray_y;
+
+	int w, h;
+	std::vector<float> pos_x, pos_y, pos_z;
+	std::vector<float> nrl_x, nrl_y, nrl_z;
+	std::vector<float> zero_row; // neighbor row outside the image (invalid depth)
+
+	bool use_simd;
+
+	void UpdateRays(const rs2_intrinsics& intr);
+	void ComputePosRow(const int y, const uint16_t* depth_row, const float depth_scale);
+	void ComputeNrlRow(const int y);
+
+public:
+	depth_normal_kernel() { has_rays = false; w = h = 0; use_simd = true; }
+
+	// depth : z16 buffer, stride_bytes : row pitch of the buffer, depth_scale : meters per unit (depth_frame.get_units())
+	// pixels with zero depth get a zero position and a zero normal
+	void Compute(const uint16_t* depth, const int stride_bytes, const rs2_intrinsics& intr, const float depth_scale);
+
+	// false runs the scalar reference path (for verifying the SIMD path)
+	void EnableSimd(const bool enable) { use_simd = enable; }
+
+	int GetWidth() const { return w; }
+	int GetHeight() const { return h; }
+	bool IsValid(const int idx) const { return pos_z[idx] > 0; }
+	glm::fvec3 GetPos(const int idx) const { return glm::fvec3(pos_x[idx], pos_y[idx], pos_z[idx]); }
+	glm::fvec3 GetNrl(const int idx) const { return glm::fvec3(nrl_x[idx], nrl_y[idx], nrl_z[idx]); }
+
+	const float* PosX() const { return pos_x.data(); }
+	const float* PosY() const { return pos_y.data(); }
+	const float* PosZ() const { return pos_z.data(); }
+	const float* NrlX() const { return nrl_x.data(); }
+	const float* NrlY() const { return nrl_y.data(); }
+	const float* NrlZ() const { return nrl_z.data(); }
+};
+
+struct pc_stage_stats
+{
+	int num_in;			// pixels of the last frame
+	int num_valid;		// non-zero depth pixels of the last frame
+	int num_out;		// uploaded points of the last frame (after the voxel decimation)
+	long long frames;
+	long long total_in, total_out;
+};
+
+// point cloud staging between depth_normal_kernel and the renderer
+// two persistent buffers (positions and normals as separate arrays), one is staged while the other is the last upload
+// points stay in the depth camera space, the world transform goes to the object (os2ws) instead of every vertex
+class point_cloud_stage
+{
+public:
+	// xyz_list, nrl_list : num_pts * 3 floats, rgb_list may be NULL
+	typedef std::function<void(const float* xyz_list, const float* nrl_list, const float* rgb_list, const int num_pts)> uploader;
+
+private:
+	struct stage_buffer
+	{
+		std::vector<glm::fvec3> pos, nrl;
+		int num_pts;
+	};
+	stage_buffer buffers[2];
+	int front; // buffer of the last Stage()
+
+	std::vector<int> row_offsets;
+	// voxel decimation (open addressing, reused)
+	float voxel_size;
+	std::vector<unsigned long long> voxel_keys;
+	std::vector<int> voxel_slots, voxel_counts;
+
+	uploader upload_func;
+	pc_stage_stats stats;
+
+	void Decimate(stage_buffer& buf);
+
+public:
+	point_cloud_stage() { front = 0; voxel_size = 0; buffers[0].num_pts = buffers[1].num_pts = 0; ResetStats(); }
+
+	void SetUploader(const uploader& func) { upload_func = func; }
+	bool HasUploader() const { return (bool)upload_func; }
+	// <= 0 : no decimation, otherwise points in a voxel (meters) are averaged into one
+	void SetVoxelSize(const float size) { voxel_size = size; }
+	float GetVoxelSize() const { return voxel_size; }
+
+	// compacts the valid pixels of the kernel into the back buffer, which becomes the front
+	// returns the number of staged points
+	int Stage(const depth_normal_kernel& kernel);
+	// passes the front buffer to the uploader, false when there is nothing to upload
+	bool Upload();
+
+	int GetNumPoints() const { return buffers[front].num_pts; }
+	const glm::fvec3* GetPositions() const { return buffers[front].pos.data(); }
+	const glm::fvec3* GetNormals() const { return buffers[front].nrl.data(); }
+
+	const pc_stage_stats& GetStats() const { return stats; }
+	void ResetStats() { stats = pc_stage_stats(); }
+};
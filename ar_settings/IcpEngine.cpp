@@ -0,0 +1,623 @@
+#include "IcpEngine.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+#define ICP_MIN_CORRS 12
+
+namespace
+{
+	double NowMs()
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// same voxel key as point_cloud_stage::Decimate (21 bits per axis)
+	inline unsigned long long PackKey(const long long x, const long long y, const long long z)
+	{
+		return ((unsigned long long)(x + (1 << 20)) & 0x1fffff) | (((unsigned long long)(y + (1 << 20)) & 0x1fffff) << 21)
+			| (((unsigned long long)(z + (1 << 20)) & 0x1fffff) << 42);
+	}
+
+	inline unsigned int HashSlot(const unsigned long long key, const unsigned int mask)
+	{
+		return (unsigned int)((key * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+	}
+
+	const unsigned long long empty_key = ~0ull;
+
+	// points (and normals) averaged per voxel, voxel <= 0 : copy
+	void VoxelAverage(const std::vector<glm::fvec3>& pos, const std::vector<glm::fvec3>* nrl, const float voxel,
+		std::vector<glm::fvec3>& out_pos, std::vector<glm::fvec3>* out_nrl)
+	{
+		const int n = (int)pos.size();
+		if (voxel <= 0 || n == 0)
+		{
+			out_pos = pos;
+			if (out_nrl) *out_nrl = *nrl;
+			return;
+		}
+		unsigned int table_size = 1;
+		while (table_size < (unsigned int)n * 2) table_size <<= 1;
+		std::vector<unsigned long long> keys(table_size, empty_key);
+		std::vector<int> slots(table_size), counts;
+		out_pos.clear();
+		if (out_nrl) out_nrl->clear();
+
+		const float inv_size = 1.f / voxel;
+		for (int i = 0; i < n; i++)
+		{
+			const glm::fvec3& p = pos[i];
+			const unsigned long long key = PackKey((long long)floorf(p.x * inv_size), (long long)floorf(p.y * inv_size), (long long)floorf(p.z * inv_size));
+			unsigned int slot = HashSlot(key, table_size - 1);
+			while (keys[slot] != empty_key && keys[slot] != key) slot = (slot + 1) & (table_size - 1);
+			if (keys[slot] == empty_key)
+			{
+				keys[slot] = key;
+				slots[slot] = (int)out_pos.size();
+				out_pos.push_back(p);
+				if (out_nrl) out_nrl->push_back((*nrl)[i]);
+				counts.push_back(1);
+			}
+			else
+			{
+				const int j = slots[slot];
+				out_pos[j] += p;
+				if (out_nrl) (*out_nrl)[j] += (*nrl)[i];
+				counts[j]++;
+			}
+		}
+		for (int j = 0; j < (int)out_pos.size(); j++)
+			if (counts[j] > 1) out_pos[j] /= (float)counts[j];
+	}
+
+	// a (6x6, symmetric positive definite) x = b, Cholesky
+	bool Solve6x6(double a[36], const double b[6], double x[6])
+	{
+		double l[36];
+		memset(l, 0, sizeof(l));
+		for (int i = 0; i < 6; i++)
+		{
+			for (int j = 0; j <= i; j++)
+			{
+				double sum = a[i * 6 + j];
+				for (int k = 0; k < j; k++) sum -= l[i * 6 + k] * l[j * 6 + k];
+				if (i == j)
+				{
+					if (sum <= 0) return false;
+					l[i * 6 + i] = sqrt(sum);
+				}
+				else l[i * 6 + j] = sum / l[j * 6 + j];
+			}
+		}
+		double y[6];
+		for (int i = 0; i < 6; i++)
+		{
+			double sum = b[i];
+			for (int k = 0; k < i; k++) sum -= l[i * 6 + k] * y[k];
+			y[i] = sum / l[i * 6 + i];
+		}
+		for (int i = 5; i >= 0; i--)
+		{
+			double sum = y[i];
+			for (int k = i + 1; k < 6; k++) sum -= l[k * 6 + i] * x[k];
+			x[i] = sum / l[i * 6 + i];
+		}
+		return true;
+	}
+
+	// rotation vector (radians) and translation to a rigid transform
+	glm::fmat4x4 RigidTransform(const double w[3], const double t[3])
+	{
+		const double angle = sqrt(w[0] * w[0] + w[1] * w[1] + w[2] * w[2]);
+		glm::dmat3x3 rot(1.);
+		if (angle > 1e-12)
+		{
+			const glm::dvec3 k = glm::dvec3(w[0], w[1], w[2]) / angle;
+			const glm::dmat3x3 mat_k(0, k.z, -k.y, -k.z, 0, k.x, k.y, -k.x, 0); // column major cross product matrix
+			rot = glm::dmat3x3(1.) + sin(angle) * mat_k + (1. - cos(angle)) * (mat_k * mat_k);
+		}
+		glm::fmat4x4 mat_tr = glm::fmat4x4(glm::fmat3x3(rot));
+		mat_tr[3] = glm::fvec4((float)t[0], (float)t[1], (float)t[2], 1.f);
+		return mat_tr;
+	}
+}
+
+icp_solver::icp_solver(const int num_threads)
+{
+	pool_job = NULL;
+	pool_n = pool_pending = 0;
+	pool_generation = 0;
+	pool_stop = false;
+	SetParams(icp_params());
+	for (int i = 0; i < num_threads - 1; i++)
+		workers.push_back(std::thread(&icp_solver::WorkerLoop, this, i));
+}
+
+icp_solver::~icp_solver()
+{
+	{
+		std::lock_guard<std::mutex> lock(pool_lock);
+		pool_stop = true;
+	}
+	pool_start.notify_all();
+	for (std::thread& worker : workers) worker.join();
+}
+
+void icp_solver::WorkerLoop(const int worker_idx)
+{
+	profiler::SetThreadName(("icp worker " + std::to_string(worker_idx)).c_str());
+	uint64_t generation = 0;
+	while (true)
+	{
+		const std::function<void(int, int, int)>* job;
+		int n;
+		{
+			std::unique_lock<std::mutex> lock(pool_lock);
+			pool_start.wait(lock, [&] { return pool_stop || pool_generation != generation; });
+			if (pool_stop) return;
+			generation = pool_generation;
+			job = pool_job;
+			n = pool_n;
+		}
+		const int chunk = worker_idx + 1;
+		(*job)(chunk, (int)((long long)n * chunk / NumChunks()), (int)((long long)n * (chunk + 1) / NumChunks()));
+		{
+			std::lock_guard<std::mutex> lock(pool_lock);
+			pool_pending--;
+		}
+		pool_done.notify_one();
+	}
+}
+
+void icp_solver::ParallelFor(const int n, const std::function<void(int chunk, int begin, int end)>& job)
+{
+	if (workers.empty() || n < 256)
+	{
+		job(0, 0, n);
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(pool_lock);
+		pool_job = &job;
+		pool_n = n;
+		pool_pending = (int)workers.size();
+		pool_generation++;
+	}
+	pool_start.notify_all();
+	job(0, 0, (int)((long long)n / NumChunks()));
+	std::unique_lock<std::mutex> lock(pool_lock);
+	pool_done.wait(lock, [this] { return pool_pending == 0; });
+}
+
+void icp_solver::SetParams(const icp_params& _params)
+{
+	params = _params;
+	params.num_levels = params.num_levels < 1 ? 1 : (params.num_levels > ICP_MAX_LEVELS ? ICP_MAX_LEVELS : params.num_levels);
+	params.trim_ratio = params.trim_ratio <= 0 || params.trim_ratio > 1.f ? 1.f : params.trim_ratio;
+	for (int l = 0; l < ICP_MAX_LEVELS; l++)
+	{
+		const float scale = (float)(1 << l);
+		levels[l].voxel = l == 0 ? params.voxel_size : (params.voxel_size > 0 ? params.voxel_size : params.max_corr_dist * 0.25f) * scale;
+		levels[l].cell = params.max_corr_dist * scale;
+		if (levels[l].cell < levels[l].voxel) levels[l].cell = levels[l].voxel;
+	}
+}
+
+void icp_solver::SetTarget(const glm::fvec3* pos, const glm::fvec3* nrl, const int num_pts)
+{
+	PROF_ZONE("icp target");
+	std::vector<glm::fvec3> in_pos, in_nrl;
+	in_pos.reserve(num_pts);
+	in_nrl.reserve(num_pts);
+	for (int i = 0; i < num_pts; i++)
+	{
+		const float len2 = glm::dot(nrl[i], nrl[i]);
+		if (len2 <= 0) continue;
+		in_pos.push_back(pos[i]);
+		in_nrl.push_back(nrl[i] / sqrtf(len2));
+	}
+
+	for (int l = 0; l < params.num_levels; l++)
+	{
+		icp_level& level = levels[l];
+		std::vector<glm::fvec3> lv_pos, lv_nrl;
+		VoxelAverage(in_pos, &in_nrl, level.voxel, lv_pos, &lv_nrl);
+
+		// sorted by cell
+		const int n = (int)lv_pos.size();
+		const float inv_cell = 1.f / level.cell;
+		std::vector<std::pair<unsigned long long, int>> keyed(n);
+		for (int i = 0; i < n; i++)
+		{
+			const glm::fvec3& p = lv_pos[i];
+			keyed[i] = std::make_pair(PackKey((long long)floorf(p.x * inv_cell), (long long)floorf(p.y * inv_cell), (long long)floorf(p.z * inv_cell)), i);
+		}
+		std::sort(keyed.begin(), keyed.end());
+		level.pos.resize(n);
+		level.nrl.resize(n);
+		int num_cells = 0;
+		for (int i = 0; i < n; i++)
+		{
+			level.pos[i] = lv_pos[keyed[i].second];
+			const float len2 = glm::dot(lv_nrl[keyed[i].second], lv_nrl[keyed[i].second]);
+			level.nrl[i] = len2 > 0 ? lv_nrl[keyed[i].second] / sqrtf(len2) : glm::fvec3(0);
+			if (i == 0 || keyed[i].first != keyed[i - 1].first) num_cells++;
+		}
+
+		unsigned int table_size = 1;
+		while (table_size < (unsigned int)num_cells * 2) table_size <<= 1;
+		level.cell_keys.assign(table_size, empty_key);
+		level.cell_first.resize(table_size);
+		level.cell_count.resize(table_size);
+		for (int i = 0; i < n; )
+		{
+			int j = i + 1;
+			while (j < n && keyed[j].first == keyed[i].first) j++;
+			unsigned int slot = HashSlot(keyed[i].first, table_size - 1);
+			while (level.cell_keys[slot] != empty_key) slot = (slot + 1) & (table_size - 1);
+			level.cell_keys[slot] = keyed[i].first;
+			level.cell_first[slot] = i;
+			level.cell_count[slot] = j - i;
+			i = j;
+		}
+	}
+}
+
+void icp_solver::SetSource(const glm::fvec3* pos, const int num_pts)
+{
+	src_points.assign(pos, pos + num_pts);
+	for (int l = 0; l < params.num_levels; l++)
+		VoxelAverage(src_points, NULL, levels[l].voxel, levels[l].src, NULL);
+}
+
+int icp_solver::FindNearest(const icp_level& level, const glm::fvec3& p) const
+{
+	const float inv_cell = 1.f / level.cell;
+	const long long cx = (long long)floorf(p.x * inv_cell), cy = (long long)floorf(p.y * inv_cell), cz = (long long)floorf(p.z * inv_cell);
+	// distance from p to the lower and the upper neighbor cells per axis
+	const glm::fvec3 d_lo = p - glm::fvec3((float)cx, (float)cy, (float)cz) * level.cell;
+	const glm::fvec3 d_hi = glm::fvec3(level.cell) - d_lo;
+	const unsigned int mask = (unsigned int)level.cell_keys.size() - 1;
+	const int offsets[3] = { 0, -1, 1 }; // the cell of p first, its points bound the search of the neighbors
+	int nearest = -1;
+	float min_dist2 = level.cell * level.cell;
+	for (int iz = 0; iz < 3; iz++)
+	{
+		const int dz = offsets[iz];
+		const float bz = dz == 0 ? 0 : (dz < 0 ? d_lo.z : d_hi.z);
+		for (int iy = 0; iy < 3; iy++)
+		{
+			const int dy = offsets[iy];
+			const float by = dy == 0 ? 0 : (dy < 0 ? d_lo.y : d_hi.y);
+			for (int ix = 0; ix < 3; ix++)
+			{
+				const int dx = offsets[ix];
+				const float bx = dx == 0 ? 0 : (dx < 0 ? d_lo.x : d_hi.x);
+				if (bx * bx + by * by + bz * bz >= min_dist2) continue;
+				const unsigned long long key = PackKey(cx + dx, cy + dy, cz + dz);
+				unsigned int slot = HashSlot(key, mask);
+				while (level.cell_keys[slot] != empty_key && level.cell_keys[slot] != key) slot = (slot + 1) & mask;
+				if (level.cell_keys[slot] == empty_key) continue;
+				const int first = level.cell_first[slot], last = first + level.cell_count[slot];
+				for (int i = first; i < last; i++)
+				{
+					const glm::fvec3 d = level.pos[i] - p;
+					const float dist2 = glm::dot(d, d);
+					if (dist2 < min_dist2)
+					{
+						min_dist2 = dist2;
+						nearest = i;
+					}
+				}
+			}
+		}
+	}
+	return nearest;
+}
+
+bool icp_solver::Iterate(const icp_level& level, glm::fmat4x4& mat_src2tgt, float& update, float& rms_err, int& num_corrs)
+{
+	const int n = (int)level.src.size();
+	corr_idx.resize(n);
+	corr_res.resize(n);
+	std::vector<glm::fvec3> src_moved(n);
+
+	// correspondences (parallel)
+	ParallelFor(n, [&](int, int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			const glm::fvec3 p = glm::fvec3(mat_src2tgt * glm::fvec4(level.src[i], 1.f));
+			const int j = FindNearest(level, p);
+			src_moved[i] = p;
+			corr_idx[i] = j;
+			corr_res[i] = j >= 0 ? glm::dot(level.nrl[j], p - level.pos[j]) : 0;
+		}
+	});
+
+	std::vector<float> abs_res;
+	abs_res.reserve(n);
+	for (int i = 0; i < n; i++)
+		if (corr_idx[i] >= 0) abs_res.push_back(fabs(corr_res[i]));
+	const int num_valid = (int)abs_res.size();
+	if (num_valid < ICP_MIN_CORRS) return false;
+
+	// Huber scale from the median residual (normal consistent), trimming threshold from the kept ratio
+	std::nth_element(abs_res.begin(), abs_res.begin() + num_valid / 2, abs_res.end());
+	const float sigma = 1.4826f * abs_res[num_valid / 2];
+	const float huber = 1.345f * sigma > 1e-7f ? 1.345f * sigma : 1e-7f;
+	int num_keep = (int)(num_valid * params.trim_ratio);
+	num_keep = num_keep < ICP_MIN_CORRS ? ICP_MIN_CORRS : num_keep;
+	std::nth_element(abs_res.begin(), abs_res.begin() + num_keep - 1, abs_res.end());
+	const float trim_thres = abs_res[num_keep - 1];
+
+	// normal equations of the point to plane residuals, per chunk then summed
+	const int acc_size = 36 + 6 + 2;
+	std::vector<double> acc(NumChunks() * acc_size, 0.);
+	ParallelFor(n, [&](int chunk, int begin, int end)
+	{
+		double* a = &acc[chunk * acc_size];
+		double* b = a + 36;
+		double* sq = b + 6;
+		for (int i = begin; i < end; i++)
+		{
+			if (corr_idx[i] < 0) continue;
+			const float r = corr_res[i];
+			const float abs_r = fabs(r);
+			if (abs_r > trim_thres) continue;
+			const double w = abs_r <= huber ? 1. : huber / abs_r;
+			const glm::fvec3& nrl = level.nrl[corr_idx[i]];
+			const glm::fvec3 pxn = glm::cross(src_moved[i], nrl);
+			const double jac[6] = { pxn.x, pxn.y, pxn.z, nrl.x, nrl.y, nrl.z };
+			for (int u = 0; u < 6; u++)
+			{
+				for (int v = u; v < 6; v++) a[u * 6 + v] += w * jac[u] * jac[v];
+				b[u] -= w * jac[u] * r;
+			}
+			sq[0] += (double)r * r;
+			sq[1] += 1.;
+		}
+	});
+	double a[36], b[6], sq_sum = 0, count = 0;
+	memset(a, 0, sizeof(a));
+	memset(b, 0, sizeof(b));
+	for (int c = 0; c < NumChunks(); c++)
+	{
+		const double* _acc = &acc[c * acc_size];
+		for (int k = 0; k < 36; k++) a[k] += _acc[k];
+		for (int k = 0; k < 6; k++) b[k] += _acc[36 + k];
+		sq_sum += _acc[42];
+		count += _acc[43];
+	}
+	if (count < ICP_MIN_CORRS) return false;
+	for (int u = 0; u < 6; u++)
+		for (int v = 0; v < u; v++) a[u * 6 + v] = a[v * 6 + u];
+	// light damping keeps the degenerate directions (e.g., a planar patch) in place
+	double trace = 0;
+	for (int u = 0; u < 6; u++) trace += a[u * 6 + u];
+	for (int u = 0; u < 6; u++) a[u * 6 + u] += 1e-9 * trace + 1e-12;
+
+	double x[6];
+	if (!Solve6x6(a, b, x)) return false;
+	mat_src2tgt = RigidTransform(x, x + 3) * mat_src2tgt;
+	update = (float)(sqrt(x[0] * x[0] + x[1] * x[1] + x[2] * x[2]) + sqrt(x[3] * x[3] + x[4] * x[4] + x[5] * x[5]));
+	rms_err = (float)sqrt(sq_sum / count);
+	num_corrs = (int)count;
+	return true;
+}
+
+icp_result icp_solver::Align(const glm::fmat4x4& mat_init_src2tgt)
+{
+	PROF_ZONE("icp align");
+	const double t_start = NowMs();
+	icp_result res;
+	res.mat_src2tgt = mat_init_src2tgt;
+	res.rms_err = 0;
+	res.num_corrs = 0;
+	res.iterations = 0;
+	res.converged = false;
+
+	for (int l = params.num_levels - 1; l >= 0; l--)
+	{
+		const icp_level& level = levels[l];
+		if (level.src.empty() || level.pos.empty()) continue;
+		for (int it = 0; it < params.max_iterations; it++)
+		{
+			float update = 0, rms_err = 0;
+			int num_corrs = 0;
+			if (!Iterate(level, res.mat_src2tgt, update, rms_err, num_corrs)) break;
+			res.iterations++;
+			if (l == 0)
+			{
+				res.rms_err = rms_err;
+				res.num_corrs = num_corrs;
+			}
+			if (update < params.min_update)
+			{
+				res.converged = l == 0;
+				break;
+			}
+		}
+	}
+	res.ms = NowMs() - t_start;
+	return res;
+}
+
+icp_tracker::icp_tracker(const int num_threads) : solver(num_threads)
+{
+	src_aabb_min = src_aabb_max = glm::fvec3(0);
+	mat_pose = pending_pose = pending_tgt2frm = glm::fmat4x4(1.f);
+	has_pending_target = has_pending_source = has_pending_pose = false;
+	epoch = result_epoch = result_version = 0;
+	result = icp_result{};
+	stats = icp_stats{};
+	t_reset_ms = NowMs();
+	worker_alive = stop_worker = false;
+}
+
+void icp_tracker::Start(const icp_params& params)
+{
+	Stop();
+	solver.SetParams(params);
+	if (src_points.size() > 0) solver.SetSource(src_points.data(), (int)src_points.size());
+	stop_worker = false;
+	worker = std::thread(&icp_tracker::WorkerLoop, this);
+	worker_alive = true;
+}
+
+void icp_tracker::Stop()
+{
+	if (!worker_alive) return;
+	{
+		std::lock_guard<std::mutex> lock(tracker_lock);
+		stop_worker = true;
+	}
+	target_pushed.notify_all();
+	worker.join();
+	worker_alive = false;
+}
+
+void icp_tracker::SetSource(const glm::fvec3* pos, const int num_pts)
+{
+	std::lock_guard<std::mutex> lock(tracker_lock);
+	pending_src.assign(pos, pos + num_pts);
+	has_pending_source = true;
+	epoch++;
+}
+
+void icp_tracker::SetPose(const glm::fmat4x4& mat_src2frm)
+{
+	std::lock_guard<std::mutex> lock(tracker_lock);
+	pending_pose = mat_src2frm;
+	has_pending_pose = true;
+	epoch++;
+}
+
+void icp_tracker::PushTarget(const glm::fvec3* pos, const glm::fvec3* nrl, const int num_pts, const glm::fmat4x4& mat_tgt2frm)
+{
+	{
+		std::lock_guard<std::mutex> lock(tracker_lock);
+		pending_pos.assign(pos, pos + num_pts);
+		pending_nrl.assign(nrl, nrl + num_pts);
+		pending_tgt2frm = mat_tgt2frm;
+		has_pending_target = true;
+	}
+	target_pushed.notify_one();
+}
+
+bool icp_tracker::GetResult(const uint64_t last_version, uint64_t& version, icp_result& _result)
+{
+	std::lock_guard<std::mutex> lock(tracker_lock);
+	if (result_version <= last_version || result_epoch != epoch) return false;
+	version = result_version;
+	_result = result;
+	return true;
+}
+
+icp_stats icp_tracker::GetStats(const bool reset)
+{
+	std::lock_guard<std::mutex> lock(tracker_lock);
+	const double t_now = NowMs();
+	icp_stats _stats = stats;
+	_stats.elapsed_ms = t_now - t_reset_ms;
+	if (reset)
+	{
+		stats = icp_stats{};
+		t_reset_ms = t_now;
+	}
+	return _stats;
+}
+
+void icp_tracker::WorkerLoop()
+{
+	profiler::SetThreadName("icp tracker");
+	std::vector<glm::fvec3> tgt_pos, tgt_nrl, crop_pos, crop_nrl;
+	while (true)
+	{
+		glm::fmat4x4 mat_tgt2frm;
+		bool new_source = false;
+		uint64_t job_epoch;
+		{
+			std::unique_lock<std::mutex> lock(tracker_lock);
+			target_pushed.wait(lock, [this] { return stop_worker || has_pending_target; });
+			if (stop_worker) return;
+			tgt_pos.swap(pending_pos);
+			tgt_nrl.swap(pending_nrl);
+			mat_tgt2frm = pending_tgt2frm;
+			has_pending_target = false;
+			if (has_pending_source)
+			{
+				src_points.swap(pending_src);
+				has_pending_source = false;
+				new_source = true;
+			}
+			if (has_pending_pose)
+			{
+				mat_pose = pending_pose;
+				has_pending_pose = false;
+			}
+			job_epoch = epoch;
+		}
+
+		if (new_source)
+		{
+			solver.SetSource(src_points.data(), (int)src_points.size());
+			src_aabb_min = glm::fvec3(FLT_MAX);
+			src_aabb_max = glm::fvec3(-FLT_MAX);
+			for (const glm::fvec3& p : src_points)
+			{
+				src_aabb_min = glm::fvec3(p.x < src_aabb_min.x ? p.x : src_aabb_min.x, p.y < src_aabb_min.y ? p.y : src_aabb_min.y, p.z < src_aabb_min.z ? p.z : src_aabb_min.z);
+				src_aabb_max = glm::fvec3(p.x > src_aabb_max.x ? p.x : src_aabb_max.x, p.y > src_aabb_max.y ? p.y : src_aabb_max.y, p.z > src_aabb_max.z ? p.z : src_aabb_max.z);
+			}
+		}
+		if (src_points.empty()) continue;
+
+		// target points in the frame, cropped to the posed source bounds (expanded by the coarsest correspondence distance)
+		const icp_params& params = solver.GetParams();
+		const float margin = params.max_corr_dist * (float)(1 << (params.num_levels - 1));
+		glm::fvec3 frm_min(FLT_MAX), frm_max(-FLT_MAX);
+		for (int i = 0; i < 8; i++)
+		{
+			const glm::fvec3 corner(i & 1 ? src_aabb_max.x : src_aabb_min.x, i & 2 ? src_aabb_max.y : src_aabb_min.y, i & 4 ? src_aabb_max.z : src_aabb_min.z);
+			const glm::fvec3 p = glm::fvec3(mat_pose * glm::fvec4(corner, 1.f));
+			frm_min = glm::fvec3(p.x < frm_min.x ? p.x : frm_min.x, p.y < frm_min.y ? p.y : frm_min.y, p.z < frm_min.z ? p.z : frm_min.z);
+			frm_max = glm::fvec3(p.x > frm_max.x ? p.x : frm_max.x, p.y > frm_max.y ? p.y : frm_max.y, p.z > frm_max.z ? p.z : frm_max.z);
+		}
+		frm_min -= glm::fvec3(margin);
+		frm_max += glm::fvec3(margin);
+		const glm::fmat3x3 mat_rot(mat_tgt2frm);
+		crop_pos.clear();
+		crop_nrl.clear();
+		for (int i = 0; i < (int)tgt_pos.size(); i++)
+		{
+			const glm::fvec3 p = glm::fvec3(mat_tgt2frm * glm::fvec4(tgt_pos[i], 1.f));
+			if (p.x < frm_min.x || p.y < frm_min.y || p.z < frm_min.z || p.x > frm_max.x || p.y > frm_max.y || p.z > frm_max.z) continue;
+			crop_pos.push_back(p);
+			crop_nrl.push_back(mat_rot * tgt_nrl[i]);
+		}
+		if ((int)crop_pos.size() < ICP_MIN_CORRS) continue;
+
+		solver.SetTarget(crop_pos.data(), crop_nrl.data(), (int)crop_pos.size());
+		const icp_result res = solver.Align(mat_pose);
+		const bool accepted = res.num_corrs >= ICP_MIN_CORRS;
+		if (accepted) mat_pose = res.mat_src2tgt;
+
+		std::lock_guard<std::mutex> lock(tracker_lock);
+		stats.refinements++;
+		stats.iterations += res.iterations;
+		stats.solve_ms += res.ms;
+		stats.last_rms = res.rms_err;
+		stats.last_corrs = res.num_corrs;
+		if (accepted && job_epoch == epoch)
+		{
+			result = res;
+			result_version++;
+			result_epoch = job_epoch;
+		}
+	}
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <vector>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdint.h>
+#include <glm/glm.hpp>
+
+// point to plane ICP : the source points are moved onto the target surface (target points with normals)
+// coarse to fine over a voxel pyramid (the voxel size and the correspondence distance double per coarser level),
+// nearest neighbors from a voxel hash of the target (cell = correspondence distance, the neighbor cells farther than the current nearest are skipped),
+// the correspondences with the largest residuals are trimmed and the others Huber weighted
+#define ICP_MAX_LEVELS 4
+
+struct icp_params
+{
+	int num_levels;			// [1, ICP_MAX_LEVELS]
+	float voxel_size;		// finest level decimation (meters), <= 0 : no decimation at the finest level
+	float max_corr_dist;	// finest level correspondence distance (meters)
+	int max_iterations;		// per level
+	float trim_ratio;		// (0, 1], fraction of the correspondences (smallest residuals) kept
+	float min_update;		// a level ends when the rotation (rad) + translation (m) update is below
+
+	icp_params() {
+		num_levels = 3;
+		voxel_size = 0.002f;
+		max_corr_dist = 0.01f;
+		max_iterations = 15;
+		trim_ratio = 0.8f;
+		min_update = 1e-5f;
+	}
+};
+
+struct icp_result
+{
+	glm::fmat4x4 mat_src2tgt;
+	float rms_err;		// point to plane residual (meters) of the kept correspondences of the finest level
+	int num_corrs;		// kept correspondences of the finest level
+	int iterations;		// over the levels
+	bool converged;		// the finest level ended by min_update
+	double ms;
+};
+
+class icp_solver
+{
+private:
+	struct icp_level
+	{
+		float voxel, cell;
+		std::vector<glm::fvec3> src;
+		// target points sorted by cell, the cell table is open addressing (key -> first point, count)
+		std::vector<glm::fvec3> pos, nrl;
+		std::vector<unsigned long long> cell_keys;
+		std::vector<int> cell_first, cell_count;
+	};
+	icp_params params;
+	icp_level levels[ICP_MAX_LEVELS];
+	std::vector<glm::fvec3> src_points;
+
+	// per source point of the current iteration
+	std::vector<int> corr_idx;
+	std::vector<float> corr_res;
+
+	// fork-join pool, the caller runs the first chunk
+	std::vector<std::thread> workers;
+	std::mutex pool_lock;
+	std::condition_variable pool_start, pool_done;
+	const std::function<void(int, int, int)>* pool_job;
+	int pool_n, pool_pending;
+	uint64_t pool_generation;
+	bool pool_stop;
+
+	void WorkerLoop(const int worker_idx);
+	void ParallelFor(const int n, const std::function<void(int chunk, int begin, int end)>& job);
+	int NumChunks() const { return (int)workers.size() + 1; }
+
+	void BuildLevels();
+	int FindNearest(const icp_level& level, const glm::fvec3& p) const;
+	// one Gauss-Newton step, false when there are too few correspondences
+	bool Iterate(const icp_level& level, glm::fmat4x4& mat_src2tgt, float& update, float& rms_err, int& num_corrs);
+
+public:
+	// num_threads : correspondence search threads (including the caller)
+	icp_solver(const int num_threads = 4);
+	~icp_solver();
+
+	void SetParams(const icp_params& _params);
+	const icp_params& GetParams() const { return params; }
+	// nrl : normals of pos (not necessarily normalized, zero normals are ignored)
+	void SetTarget(const glm::fvec3* pos, const glm::fvec3* nrl, const int num_pts);
+	void SetSource(const glm::fvec3* pos, const int num_pts);
+	bool HasData() const { return src_points.size() > 0 && levels[0].pos.size() > 0; }
+
+	icp_result Align(const glm::fmat4x4& mat_init_src2tgt);
+};
+
+struct icp_stats
+{
+	long long refinements;
+	long long iterations;
+	double solve_ms;		// time in Align
+	double elapsed_ms;		// since the last reset
+	float last_rms;			// meters
+	int last_corrs;
+};
+
+// background refinement of a source pose (source space to frame) against the targets pushed by the render thread
+// the latest pushed target wins, the target is cropped to the posed source bounds before the solve,
+// each refinement warm-starts from the previous one and is published with a version
+class icp_tracker
+{
+private:
+	icp_solver solver;
+	std::vector<glm::fvec3> src_points;
+	glm::fvec3 src_aabb_min, src_aabb_max;
+	glm::fmat4x4 mat_pose; // worker, source to frame
+
+	// shared data (guarded by tracker_lock)
+	std::vector<glm::fvec3> pending_pos, pending_nrl;
+	glm::fmat4x4 pending_tgt2frm;
+	bool has_pending_target, has_pending_source;
+	std::vector<glm::fvec3> pending_src;
+	glm::fmat4x4 pending_pose;
+	bool has_pending_pose;
+	uint64_t epoch, result_epoch; // SetPose / SetSource increase the epoch, a result of a previous epoch is not returned
+	uint64_t result_version;
+	icp_result result;
+	icp_stats stats;
+	double t_reset_ms;
+	std::mutex tracker_lock;
+	std::condition_variable target_pushed;
+
+	std::thread worker;
+	bool worker_alive, stop_worker;
+
+	void WorkerLoop();
+
+public:
+	icp_tracker(const int num_threads = 4);
+	~icp_tracker() { Stop(); }
+
+	void Start(const icp_params& params = icp_params());
+	void Stop();
+	bool IsRunning() const { return worker_alive; }
+
+	// source points (source space), the current pose is kept
+	void SetSource(const glm::fvec3* pos, const int num_pts);
+	// pose of the source in the frame (e.g., a manual alignment), the refinements continue from it
+	void SetPose(const glm::fmat4x4& mat_src2frm);
+	// render thread, copies the points, mat_tgt2frm : target points to the frame
+	void PushTarget(const glm::fvec3* pos, const glm::fvec3* nrl, const int num_pts, const glm::fmat4x4& mat_tgt2frm);
+
+	// true when a refinement newer than last_version was published since the last SetPose / SetSource
+	// _result.mat_src2tgt : the refined source to frame pose
+	bool GetResult(const uint64_t last_version, uint64_t& version, icp_result& _result);
+	icp_stats GetStats(const bool reset = false);
+};
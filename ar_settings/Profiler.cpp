@@ -0,0 +1,303 @@
+#include "Profiler.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+#define PROF_RING_SIZE (1 << 14)		// samples per thread between two Collect calls
+#define PROF_MAX_TRACE_EVENTS (1 << 19)	// 16 MB of trace
+#define PROF_BUCKETS_PER_OCTAVE 8		// histogram resolution ~9%
+#define PROF_NUM_BUCKETS (PROF_BUCKETS_PER_OCTAVE * 40) // up to 2^40 ns
+
+namespace profiler
+{
+	struct prof_event
+	{
+		int zone_id;
+		int tid;
+		long long t_begin, t_end; // ns
+	};
+
+	// single producer (the owning thread), single consumer (Collect)
+	struct prof_ring
+	{
+		prof_event events[PROF_RING_SIZE];
+		std::atomic<size_t> head, tail;
+		std::atomic<long long> dropped;
+		int tid;
+		std::string name;
+		prof_ring() { head = tail = 0; dropped = 0; tid = 0; }
+	};
+
+	struct prof_histogram
+	{
+		unsigned int counts[PROF_NUM_BUCKETS];
+		long long n;
+		double sum_ms, max_ms;
+		prof_histogram() { Reset(); }
+		void Reset() { memset(counts, 0, sizeof(counts)); n = 0; sum_ms = max_ms = 0; }
+		void Add(const long long dur_ns)
+		{
+			const int b = dur_ns > 1 ? std::min((int)(log2((double)dur_ns) * PROF_BUCKETS_PER_OCTAVE), PROF_NUM_BUCKETS - 1) : 0;
+			counts[b]++;
+			n++;
+			sum_ms += dur_ns * 1e-6;
+			max_ms = std::max(max_ms, dur_ns * 1e-6);
+		}
+		// geometric center of the bucket holding the p-quantile (ms)
+		double Percentile(const double p) const
+		{
+			const long long rank = std::max((long long)ceil(p * n), 1LL);
+			long long acc = 0;
+			for (int b = 0; b < PROF_NUM_BUCKETS; b++)
+			{
+				acc += counts[b];
+				if (acc >= rank) return std::min(pow(2.0, (b + 0.5) / PROF_BUCKETS_PER_OCTAVE) * 1e-6, max_ms);
+			}
+			return max_ms;
+		}
+	};
+
+	std::atomic_bool is_enabled{ false };
+	long long t_origin = 0;
+
+	std::mutex registry_lock; // zones and rings
+	std::vector<std::string> zone_names;
+	std::vector<std::unique_ptr<prof_ring>> rings;
+	thread_local prof_ring* thread_ring = NULL;
+
+	// Collect / Report / Export (main thread)
+	std::vector<prof_histogram> histograms;
+	std::vector<prof_event> trace_events;
+	long long trace_dropped = 0;
+
+	static long long NowNs()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	static prof_ring* ThreadRing()
+	{
+		if (thread_ring == NULL)
+		{
+			std::lock_guard<std::mutex> lock(registry_lock);
+			rings.push_back(std::unique_ptr<prof_ring>(new prof_ring()));
+			thread_ring = rings.back().get();
+			thread_ring->tid = (int)rings.size();
+			thread_ring->name = "thread " + std::to_string(thread_ring->tid);
+		}
+		return thread_ring;
+	}
+
+	int RegisterZone(const char* name)
+	{
+		std::lock_guard<std::mutex> lock(registry_lock);
+		for (int i = 0; i < (int)zone_names.size(); i++)
+			if (zone_names[i] == name) return i;
+		zone_names.push_back(name);
+		return (int)zone_names.size() - 1;
+	}
+
+	void SetThreadName(const char* name)
+	{
+		prof_ring* ring = ThreadRing();
+		std::lock_guard<std::mutex> lock(registry_lock);
+		ring->name = name;
+	}
+
+	void SetEnabled(const bool enabled)
+	{
+		if (enabled == is_enabled) return;
+		if (enabled)
+		{
+			// the samples recorded while disabled (zones open across the switch) are discarded
+			{
+				std::lock_guard<std::mutex> lock(registry_lock);
+				for (auto& ring : rings)
+					ring->tail.store(ring->head.load(std::memory_order_acquire), std::memory_order_release);
+			}
+			for (auto& histogram : histograms) histogram.Reset();
+			trace_events.clear();
+			trace_dropped = 0;
+			t_origin = NowNs();
+		}
+		is_enabled = enabled;
+	}
+
+	bool IsEnabled()
+	{
+		return is_enabled.load(std::memory_order_relaxed);
+	}
+
+	const std::atomic_bool* EnabledFlag()
+	{
+		return &is_enabled;
+	}
+
+	long long BeginZone()
+	{
+		if (!is_enabled.load(std::memory_order_relaxed)) return 0;
+		return NowNs();
+	}
+
+	void EndZone(const int zone_id, const long long t_begin)
+	{
+		const long long t_end = NowNs();
+		prof_ring* ring = ThreadRing();
+		const size_t h = ring->head.load(std::memory_order_relaxed);
+		if (h - ring->tail.load(std::memory_order_acquire) >= PROF_RING_SIZE)
+		{
+			ring->dropped++;
+			return;
+		}
+		prof_event& e = ring->events[h & (PROF_RING_SIZE - 1)];
+		e.zone_id = zone_id;
+		e.tid = ring->tid;
+		e.t_begin = t_begin;
+		e.t_end = t_end;
+		ring->head.store(h + 1, std::memory_order_release);
+	}
+
+	void Collect()
+	{
+		std::lock_guard<std::mutex> lock(registry_lock);
+		if (histograms.size() < zone_names.size()) histograms.resize(zone_names.size());
+		for (auto& ring : rings)
+		{
+			const size_t t = ring->tail.load(std::memory_order_relaxed);
+			const size_t h = ring->head.load(std::memory_order_acquire);
+			for (size_t i = t; i != h; i++)
+			{
+				const prof_event& e = ring->events[i & (PROF_RING_SIZE - 1)];
+				histograms[e.zone_id].Add(e.t_end - e.t_begin);
+				if (trace_events.size() < PROF_MAX_TRACE_EVENTS) trace_events.push_back(e);
+				else trace_dropped++;
+			}
+			ring->tail.store(h, std::memory_order_release);
+		}
+	}
+
+	static void ZoneStats(const prof_histogram& histogram, double* stats)
+	{
+		stats[0] = (double)histogram.n;
+		stats[1] = histogram.sum_ms / histogram.n;
+		stats[2] = histogram.Percentile(0.5);
+		stats[3] = histogram.Percentile(0.95);
+		stats[4] = histogram.Percentile(0.99);
+		stats[5] = histogram.max_ms;
+	}
+
+	void Report()
+	{
+		Collect();
+		std::lock_guard<std::mutex> lock(registry_lock);
+		printf("%-32s %8s %9s %9s %9s %9s %9s (ms)\n", "zone", "count", "mean", "p50", "p95", "p99", "max");
+		for (int i = 0; i < (int)histograms.size(); i++)
+		{
+			prof_histogram& histogram = histograms[i];
+			if (histogram.n == 0) continue;
+			double stats[6];
+			ZoneStats(histogram, stats);
+			printf("%-32s %8lld %9.3f %9.3f %9.3f %9.3f %9.3f\n", zone_names[i].c_str(), histogram.n, stats[1], stats[2], stats[3], stats[4], stats[5]);
+			histogram.Reset();
+		}
+		for (auto& ring : rings)
+		{
+			const long long dropped = ring->dropped.exchange(0);
+			if (dropped > 0) printf("%s : %lld samples dropped (ring full)\n", ring->name.c_str(), dropped);
+		}
+	}
+
+	bool GetZoneStats(const int zone_id, double* stats)
+	{
+		Collect();
+		std::lock_guard<std::mutex> lock(registry_lock);
+		if (zone_id < 0 || zone_id >= (int)histograms.size() || histograms[zone_id].n == 0) return false;
+		ZoneStats(histograms[zone_id], stats);
+		return true;
+	}
+
+	// JSON string body : quotes, backslashes and control characters escaped
+	static std::string JsonEscape(const std::string& str)
+	{
+		std::string out;
+		out.reserve(str.size());
+		for (const char c : str)
+		{
+			switch (c)
+			{
+			case '"': out += "\\\""; break;
+			case '\\': out += "\\\\"; break;
+			case '\n': out += "\\n"; break;
+			case '\r': out += "\\r"; break;
+			case '\t': out += "\\t"; break;
+			default:
+				if ((unsigned char)c < 0x20)
+				{
+					char code[8];
+					snprintf(code, sizeof(code), "\\u%04x", (unsigned char)c);
+					out += code;
+				}
+				else out += c;
+			}
+		}
+		return out;
+	}
+
+	bool ExportChromeTrace(const std::string& file_path)
+	{
+		Collect();
+		std::string path = file_path;
+		if (path.empty())
+		{
+			char file_name[64];
+			time_t t_now = time(NULL);
+			struct tm tm_now;
+#ifdef _WIN32
+			localtime_s(&tm_now, &t_now);
+#else
+			localtime_r(&t_now, &tm_now);
+#endif
+			strftime(file_name, sizeof(file_name), "profile_%Y%m%d_%H%M%S.json", &tm_now);
+			path = file_name;
+		}
+
+		FILE* fp = NULL;
+#ifdef _WIN32
+		if (fopen_s(&fp, path.c_str(), "w") != 0) fp = NULL;
+#else
+		fp = fopen(path.c_str(), "w");
+#endif
+		if (fp == NULL) return false;
+
+		std::lock_guard<std::mutex> lock(registry_lock);
+		fprintf(fp, "{\"traceEvents\":[\n");
+		bool first = true;
+		for (auto& ring : rings)
+		{
+			fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", first ? "" : ",\n", ring->tid,
+				JsonEscape(ring->name).c_str());
+			first = false;
+		}
+		// complete events, microseconds from the enabling
+		std::vector<std::string> json_names(zone_names.size());
+		for (size_t i = 0; i < zone_names.size(); i++) json_names[i] = JsonEscape(zone_names[i]);
+		for (const prof_event& e : trace_events)
+		{
+			fprintf(fp, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", first ? "" : ",\n",
+				json_names[e.zone_id].c_str(), e.tid, (e.t_begin - t_origin) * 1e-3, (e.t_end - e.t_begin) * 1e-3);
+			first = false;
+		}
+		fprintf(fp, "\n]}\n");
+		fclose(fp);
+		printf("profile trace : %s (%d events, %lld not stored)\n", path.c_str(), (int)trace_events.size(), trace_dropped);
+		return true;
+	}
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#ifndef __dojostatic
+#define __dojostatic extern "C" __declspec(dllexport)
+#endif
+
+#include <string>
+#include <atomic>
+
+// frame profiler
+// PROF_ZONE("name") times the enclosing scope, the samples go into a lock-free ring of the calling thread
+// (one writer, drained by Collect) and are reduced into per-zone duration histograms and a Chrome trace
+// disabled, a zone costs the initialized test of two function statics and an inline relaxed load of the
+// exported enabled flag, no call into the profiler (the destructor does nothing either)
+namespace profiler
+{
+	// once per call site (PROF_ZONE keeps the id in a function static)
+	__dojostatic int RegisterZone(const char* name);
+	// name of the calling thread in the trace
+	__dojostatic void SetThreadName(const char* name);
+
+	// enabling clears the histograms and the trace
+	__dojostatic void SetEnabled(const bool enabled);
+	__dojostatic bool IsEnabled();
+	// the flag itself, for the inline test of prof_scope (lives as long as the process)
+	__dojostatic const std::atomic_bool* EnabledFlag();
+
+	// 0 when disabled
+	__dojostatic long long BeginZone();
+	__dojostatic void EndZone(const int zone_id, const long long t_begin);
+
+	// drains the thread rings into the histograms and the trace (once per frame, main thread)
+	__dojostatic void Collect();
+	// count, mean, p50 / p95 / p99 and max (ms) per zone since the last report, then resets the histograms
+	__dojostatic void Report();
+	// stats (6 doubles) : count, mean, p50, p95, p99 and max (ms) of the zone since the last report, false : no sample
+	__dojostatic bool GetZoneStats(const int zone_id, double* stats);
+	// chrome://tracing (or ui.perfetto.dev) JSON of the samples collected since enabled, "" : profile_%Y%m%d_%H%M%S.json
+	__dojostatic bool ExportChromeTrace(const std::string& file_path = "");
+}
+
+inline const std::atomic_bool& prof_enabled_flag()
+{
+	static const std::atomic_bool* flag = profiler::EnabledFlag();
+	return *flag;
+}
+
+struct prof_scope
+{
+	int zone_id;
+	long long t_begin;
+	prof_scope(const int _zone_id) { zone_id = _zone_id; t_begin = prof_enabled_flag().load(std::memory_order_relaxed) ? profiler::BeginZone() : 0; }
+	~prof_scope() { if (t_begin != 0) profiler::EndZone(zone_id, t_begin); }
+};
+
+#define PROF_CONCAT_(A, B) A##B
+#define PROF_CONCAT(A, B) PROF_CONCAT_(A, B)
+#define PROF_ZONE(NAME) \
+	static const int PROF_CONCAT(prof_zone_id_, __LINE__) = profiler::RegisterZone(NAME); \
+	prof_scope PROF_CONCAT(prof_zone_, __LINE__)(PROF_CONCAT(prof_zone_id_, __LINE__))
@@ -0,0 +1,367 @@
+#include "Recorder.h"
+
+#include <string.h>
+#include <stddef.h>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <share.h>
+#define rec_fseek _fseeki64
+#define rec_ftell _ftelli64
+// shared read access, a session is read by the tracking and the image replay at the same time
+#define rec_fopen(path, mode) _fsopen(path, mode, _SH_DENYWR)
+#else
+#define rec_fseek fseeko
+#define rec_ftell ftello
+#define rec_fopen(path, mode) fopen(path, mode)
+#endif
+
+#define REC_FILE_BUFFER (4 << 20)
+#define REC_HEADER_V1_SIZE offsetof(rec_file_header, img_intrinsics)
+
+session_recorder::session_recorder()
+{
+	fp = NULL;
+	writer_alive = false;
+	free_head = free_count = filled_head = filled_count = 0;
+	file_offset = prev_index_offset = 0;
+	next_frame_idx = 0;
+	img_bytes = 0;
+	num_pushed = num_written = num_dropped = num_bytes = 0;
+	write_failed = false;
+	memset(&file_header, 0, sizeof(file_header));
+}
+
+bool session_recorder::Start(const std::string& file_path, const int img_w, const int img_h, const int img_channels, const int num_slots, const float* img_intrinsics)
+{
+	Stop();
+	fp = rec_fopen(file_path.c_str(), "wb");
+	if (fp == NULL) return false;
+	setvbuf(fp, NULL, _IOFBF, REC_FILE_BUFFER);
+
+	memset(&file_header, 0, sizeof(file_header));
+	memcpy(file_header.magic, REC_MAGIC, 8);
+	file_header.version = REC_VERSION;
+	file_header.img_w = img_w;
+	file_header.img_h = img_h;
+	file_header.img_channels = img_channels;
+	if (img_intrinsics) memcpy(file_header.img_intrinsics, img_intrinsics, sizeof(file_header.img_intrinsics));
+	if (Write(&file_header, sizeof(file_header), 1) != 1)
+	{
+		fclose(fp);
+		fp = NULL;
+		return false;
+	}
+	file_offset = sizeof(file_header);
+	prev_index_offset = 0;
+	index_entries.clear();
+	index_entries.reserve(REC_INDEX_CHUNK_FRAMES);
+
+	// the slot memory is allocated here once
+	img_bytes = (size_t)img_w * img_h * img_channels;
+	slots.resize(std::max(num_slots, 2));
+	free_slots.resize(slots.size());
+	filled_slots.resize(slots.size());
+	for (int i = 0; i < (int)slots.size(); i++)
+	{
+		slots[i].img.resize(img_bytes);
+		slots[i].trk.reserve(8 << 10);
+		free_slots[i] = i;
+	}
+	free_head = 0;
+	free_count = (int)slots.size();
+	filled_head = filled_count = 0;
+
+	next_frame_idx = 0;
+	num_pushed = num_written = num_dropped = num_bytes = 0;
+	write_failed = false;
+
+	writer_alive = true;
+	writer = std::thread(&session_recorder::WriterLoop, this);
+	return true;
+}
+
+bool session_recorder::Push(const double t_ms, const int key, const void* img_data, const char* trk_data, const size_t trk_bytes)
+{
+	if (fp == NULL) return false;
+	if (write_failed)
+	{
+		num_dropped++;
+		return false;
+	}
+
+	int slot_idx;
+	{
+		std::lock_guard<std::mutex> lock(slot_lock);
+		if (free_count == 0)
+		{
+			num_dropped++;
+			return false;
+		}
+		slot_idx = free_slots[free_head];
+		free_head = (free_head + 1) % (int)free_slots.size();
+		free_count--;
+	}
+
+	// the copies are done out of the lock, the slot belongs to this thread until it is queued
+	rec_slot& slot = slots[slot_idx];
+	memcpy(slot.img.data(), img_data, img_bytes);
+	slot.trk.assign(trk_data, trk_data + trk_bytes);
+	slot.fh.frame_idx = next_frame_idx++;
+	slot.fh.t_ms = t_ms;
+	slot.fh.key = key;
+	slot.fh.img_bytes = (uint32_t)img_bytes;
+	slot.fh.trk_bytes = (uint32_t)trk_bytes;
+	slot.fh.reserved = 0;
+
+	{
+		std::lock_guard<std::mutex> lock(slot_lock);
+		filled_slots[(filled_head + filled_count) % (int)filled_slots.size()] = slot_idx;
+		filled_count++;
+	}
+	slot_filled.notify_one();
+	num_pushed++;
+	return true;
+}
+
+void session_recorder::WriterLoop()
+{
+	while (true)
+	{
+		int slot_idx;
+		{
+			std::unique_lock<std::mutex> lock(slot_lock);
+			slot_filled.wait(lock, [this] { return filled_count > 0 || !writer_alive; });
+			if (filled_count == 0) break; // stopped and drained
+			slot_idx = filled_slots[filled_head];
+			filled_head = (filled_head + 1) % (int)filled_slots.size();
+			filled_count--;
+		}
+
+		// frames queued before a failed write are dropped as well
+		if (write_failed) num_dropped++;
+		else if (WriteFrame(slots[slot_idx])) num_written++;
+		else num_dropped++;
+
+		{
+			std::lock_guard<std::mutex> lock(slot_lock);
+			free_slots[(free_head + free_count) % (int)free_slots.size()] = slot_idx;
+			free_count++;
+		}
+	}
+}
+
+bool session_recorder::WriteFrame(const rec_slot& slot)
+{
+	rec_chunk_header ch;
+	ch.type = REC_CHUNK_FRAME;
+	ch.reserved = 0;
+	ch.size = sizeof(rec_frame_header) + slot.fh.img_bytes + slot.fh.trk_bytes;
+
+	rec_index_entry e;
+	e.frame_idx = slot.fh.frame_idx;
+	e.t_ms = slot.fh.t_ms;
+	e.key = slot.fh.key;
+	e.img_bytes = slot.fh.img_bytes;
+	e.trk_bytes = slot.fh.trk_bytes;
+	e.img_offset = file_offset + sizeof(rec_chunk_header) + sizeof(rec_frame_header);
+	e.trk_offset = e.img_offset + slot.fh.img_bytes;
+	e.reserved = 0;
+
+	bool ok = Write(&ch, sizeof(ch), 1) == 1;
+	ok = ok && Write(&slot.fh, sizeof(slot.fh), 1) == 1;
+	if (slot.fh.img_bytes > 0) ok = ok && Write(slot.img.data(), slot.fh.img_bytes, 1) == 1;
+	if (slot.fh.trk_bytes > 0) ok = ok && Write(slot.trk.data(), slot.fh.trk_bytes, 1) == 1;
+	if (!ok)
+	{
+		OnWriteFailed();
+		return false;
+	}
+
+	file_offset += sizeof(ch) + ch.size;
+	num_bytes += sizeof(ch) + ch.size;
+	file_header.num_frames++;
+
+	index_entries.push_back(e);
+	if (index_entries.size() >= REC_INDEX_CHUNK_FRAMES) WriteIndexChunk();
+	return true;
+}
+
+// the partial chunk is overwritten by the next write (the index chunk of Stop), the file ends at the last complete frame
+void session_recorder::OnWriteFailed()
+{
+	write_failed = true;
+	clearerr(fp);
+	rec_fseek(fp, file_offset, SEEK_SET);
+}
+
+// false (the entries are kept for a retry at Stop) when the chunk was not written
+bool session_recorder::WriteIndexChunk()
+{
+	if (index_entries.empty()) return true;
+
+	rec_chunk_header ch;
+	ch.type = REC_CHUNK_INDEX;
+	ch.reserved = 0;
+	ch.size = sizeof(rec_index_header) + sizeof(rec_index_entry) * index_entries.size();
+	rec_index_header ih;
+	ih.prev_index_offset = prev_index_offset;
+	ih.num_entries = (uint32_t)index_entries.size();
+	ih.reserved = 0;
+
+	bool ok = Write(&ch, sizeof(ch), 1) == 1;
+	ok = ok && Write(&ih, sizeof(ih), 1) == 1;
+	ok = ok && Write(index_entries.data(), sizeof(rec_index_entry), index_entries.size()) == index_entries.size();
+	if (!ok)
+	{
+		OnWriteFailed();
+		return false;
+	}
+
+	prev_index_offset = file_offset;
+	file_offset += sizeof(ch) + ch.size;
+	num_bytes += sizeof(ch) + ch.size;
+	index_entries.clear();
+	return true;
+}
+
+void session_recorder::Stop()
+{
+	if (fp == NULL) return;
+
+	{
+		std::lock_guard<std::mutex> lock(slot_lock);
+		writer_alive = false;
+	}
+	slot_filled.notify_one();
+	if (writer.joinable()) writer.join();
+
+	// without the last index chunk the file is left not finalized, the reader scans the frame chunks
+	file_header.last_index_offset = WriteIndexChunk() ? prev_index_offset : 0;
+	rec_fseek(fp, 0, SEEK_SET);
+	Write(&file_header, sizeof(file_header), 1);
+	fclose(fp);
+	fp = NULL;
+}
+
+rec_stats session_recorder::GetStats()
+{
+	rec_stats stats;
+	stats.pushed = num_pushed;
+	stats.written = num_written;
+	stats.dropped = num_dropped;
+	stats.bytes = num_bytes;
+	stats.failed = write_failed;
+	{
+		std::lock_guard<std::mutex> lock(slot_lock);
+		stats.pending = filled_count;
+	}
+	return stats;
+}
+
+bool session_reader::Open(const std::string& file_path)
+{
+	Close();
+	fp = rec_fopen(file_path.c_str(), "rb");
+	if (fp == NULL) return false;
+	memset(&file_header, 0, sizeof(file_header));
+	if (fread(&file_header, REC_HEADER_V1_SIZE, 1, fp) != 1 || memcmp(file_header.magic, REC_MAGIC, 8) != 0 || file_header.version > REC_VERSION)
+	{
+		Close();
+		return false;
+	}
+	uint64_t header_size = REC_HEADER_V1_SIZE;
+	if (file_header.version >= 2)
+	{
+		if (fread(file_header.img_intrinsics, sizeof(file_header.img_intrinsics), 1, fp) != 1)
+		{
+			Close();
+			return false;
+		}
+		header_size = sizeof(file_header);
+	}
+
+	if (file_header.last_index_offset != 0)
+	{
+		uint64_t offset = file_header.last_index_offset;
+		while (offset != 0)
+		{
+			rec_chunk_header ch;
+			rec_index_header ih;
+			rec_fseek(fp, offset, SEEK_SET);
+			if (fread(&ch, sizeof(ch), 1, fp) != 1 || ch.type != REC_CHUNK_INDEX || fread(&ih, sizeof(ih), 1, fp) != 1) break;
+			size_t n = entries.size();
+			entries.resize(n + ih.num_entries);
+			if (fread(&entries[n], sizeof(rec_index_entry), ih.num_entries, fp) != ih.num_entries)
+			{
+				entries.resize(n);
+				break;
+			}
+			offset = ih.prev_index_offset;
+		}
+	}
+	else
+	{
+		// not finalized : scan the frame chunks
+		rec_fseek(fp, 0, SEEK_END);
+		const uint64_t file_size = (uint64_t)rec_ftell(fp);
+		uint64_t offset = header_size;
+		rec_chunk_header ch;
+		rec_fseek(fp, offset, SEEK_SET);
+		while (fread(&ch, sizeof(ch), 1, fp) == 1)
+		{
+			if (ch.type == REC_CHUNK_FRAME)
+			{
+				rec_frame_header fh;
+				if (fread(&fh, sizeof(fh), 1, fp) != 1) break;
+				rec_index_entry e;
+				e.frame_idx = fh.frame_idx;
+				e.t_ms = fh.t_ms;
+				e.key = fh.key;
+				e.img_bytes = fh.img_bytes;
+				e.trk_bytes = fh.trk_bytes;
+				e.img_offset = offset + sizeof(ch) + sizeof(fh);
+				e.trk_offset = e.img_offset + fh.img_bytes;
+				e.reserved = 0;
+				entries.push_back(e);
+			}
+			offset += sizeof(ch) + ch.size;
+			if (rec_fseek(fp, offset, SEEK_SET) != 0) break;
+		}
+		// a truncated last frame is not readable
+		while (!entries.empty() && entries.back().trk_offset + entries.back().trk_bytes > file_size) entries.pop_back();
+	}
+
+	std::sort(entries.begin(), entries.end(), [](const rec_index_entry& a, const rec_index_entry& b) { return a.frame_idx < b.frame_idx; });
+	return true;
+}
+
+void session_reader::Close()
+{
+	if (fp) fclose(fp);
+	fp = NULL;
+	entries.clear();
+}
+
+int session_reader::FindFrame(const double t_ms) const
+{
+	auto it = std::lower_bound(entries.begin(), entries.end(), t_ms, [](const rec_index_entry& e, const double t) { return e.t_ms < t; });
+	return (int)(it - entries.begin());
+}
+
+bool session_reader::ReadImage(const int i, void* img_data)
+{
+	if (fp == NULL || i < 0 || i >= (int)entries.size()) return false;
+	const rec_index_entry& e = entries[i];
+	if (rec_fseek(fp, e.img_offset, SEEK_SET) != 0) return false;
+	return e.img_bytes == 0 || fread(img_data, e.img_bytes, 1, fp) == 1;
+}
+
+bool session_reader::ReadTrack(const int i, std::vector<char>& trk_data)
+{
+	if (fp == NULL || i < 0 || i >= (int)entries.size()) return false;
+	const rec_index_entry& e = entries[i];
+	trk_data.resize(e.trk_bytes);
+	if (rec_fseek(fp, e.trk_offset, SEEK_SET) != 0) return false;
+	return e.trk_bytes == 0 || fread(trk_data.data(), e.trk_bytes, 1, fp) == 1;
+}
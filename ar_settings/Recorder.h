@@ -0,0 +1,167 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <stdio.h>
+#include <stdint.h>
+
+// session recording container (.krec)
+// file : rec_file_header, then chunks of { rec_chunk_header, payload }
+//  REC_CHUNK_FRAME payload : rec_frame_header, image bytes, tracking bytes (track_info serial buffer)
+//  REC_CHUNK_INDEX payload : rec_index_header, rec_index_entry * num_entries (frames since the previous index chunk)
+// the index chunks are chained backward from rec_file_header::last_index_offset, which is patched when the recording stops
+// (0 : not finalized, the frame chunks can still be scanned from the start)
+// version 1 headers end before img_intrinsics
+#define REC_MAGIC "KARREC01"
+#define REC_VERSION 2
+#define REC_CHUNK_FRAME 0x4d415246 // 'FRAM'
+#define REC_CHUNK_INDEX 0x58444e49 // 'INDX'
+#define REC_INDEX_CHUNK_FRAMES 256
+
+#pragma pack(push, 4)
+struct rec_file_header
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t img_w, img_h, img_channels;
+	uint64_t last_index_offset;
+	uint64_t num_frames;
+	float img_intrinsics[4]; // fx, fy, ppx, ppy of the color stream (0 : unknown)
+};
+
+struct rec_chunk_header
+{
+	uint32_t type;
+	uint32_t reserved;
+	uint64_t size; // payload bytes
+};
+
+struct rec_frame_header
+{
+	uint64_t frame_idx;
+	double t_ms; // capture time (GetMonotonicTimeMs() domain)
+	int32_t key;
+	uint32_t img_bytes;
+	uint32_t trk_bytes;
+	uint32_t reserved;
+};
+
+struct rec_index_header
+{
+	uint64_t prev_index_offset; // 0 : first index chunk
+	uint32_t num_entries;
+	uint32_t reserved;
+};
+
+struct rec_index_entry
+{
+	uint64_t frame_idx;
+	double t_ms;
+	int32_t key;
+	uint32_t img_bytes;
+	uint64_t img_offset; // file offsets of the streams
+	uint64_t trk_offset;
+	uint32_t trk_bytes;
+	uint32_t reserved;
+};
+#pragma pack(pop)
+
+struct rec_stats
+{
+	long long pushed;		// frames accepted by Push
+	long long written;		// frames on disk
+	long long dropped;		// frames rejected because every slot was waiting for the writer, or after a failed write
+	long long bytes;		// bytes written
+	int pending;			// slots waiting for the writer
+	bool failed;			// a write failed (disk full, ...), the file ends at the last complete frame
+};
+
+// streaming recorder : fixed pool of frame slots filled by the render thread and drained by a writer thread
+// memory stays at num_slots frames whatever the recording length, a full pool drops (and counts) the new frame
+// after a failed write no frame is written any more (dropped), Stop still writes the index of the complete frames
+class session_recorder
+{
+public:
+	// fwrite signature, the file writes of the writer thread go through it (fwrite when not set)
+	typedef std::function<size_t(const void* data, size_t size, size_t count, FILE* fp)> file_writer;
+
+private:
+	struct rec_slot
+	{
+		std::vector<char> img, trk;
+		rec_frame_header fh;
+	};
+	std::vector<rec_slot> slots;
+	std::vector<int> free_slots, filled_slots; // fixed capacity queues of slot indices
+	int free_head, free_count, filled_head, filled_count;
+	std::mutex slot_lock;
+	std::condition_variable slot_filled;
+
+	FILE* fp;
+	rec_file_header file_header;
+	uint64_t file_offset;
+	uint64_t prev_index_offset;
+	std::vector<rec_index_entry> index_entries; // frames since the last index chunk (<= REC_INDEX_CHUNK_FRAMES)
+
+	std::thread writer;
+	bool writer_alive;
+	uint64_t next_frame_idx;
+	size_t img_bytes;
+
+	std::atomic<long long> num_pushed, num_written, num_dropped, num_bytes;
+	std::atomic<bool> write_failed;
+	file_writer write_func;
+
+	void WriterLoop();
+	bool WriteFrame(const rec_slot& slot);
+	bool WriteIndexChunk();
+	void OnWriteFailed();
+	size_t Write(const void* data, size_t size, size_t count) { return write_func ? write_func(data, size, count, fp) : fwrite(data, size, count, fp); }
+
+public:
+	session_recorder();
+	~session_recorder() { Stop(); }
+
+	// img_intrinsics (optional) : fx, fy, ppx, ppy
+	bool Start(const std::string& file_path, const int img_w, const int img_h, const int img_channels, const int num_slots = 32, const float* img_intrinsics = NULL);
+	// render thread, never blocks on the disk, false when the frame is dropped
+	bool Push(const double t_ms, const int key, const void* img_data, const char* trk_data, const size_t trk_bytes);
+	// writes the pending frames and the index, then closes the file
+	void Stop();
+	// a full disk or a failing device, set before Start
+	void SetFileWriter(const file_writer& func) { write_func = func; }
+
+	bool IsRecording() const { return fp != NULL; }
+	rec_stats GetStats();
+};
+
+// random access over a .krec file (index chunks, or a frame chunk scan when the file was not finalized)
+class session_reader
+{
+private:
+	FILE* fp;
+	rec_file_header file_header;
+	std::vector<rec_index_entry> entries; // frame order
+
+public:
+	session_reader() { fp = NULL; }
+	~session_reader() { Close(); }
+
+	bool Open(const std::string& file_path);
+	void Close();
+
+	const rec_file_header& GetHeader() const { return file_header; }
+	int GetNumFrames() const { return (int)entries.size(); }
+	const rec_index_entry& GetEntry(const int i) const { return entries[i]; }
+	// first frame with t_ms >= t (GetNumFrames() when none)
+	int FindFrame(const double t_ms) const;
+
+	// img_data : img_bytes of the entry
+	bool ReadImage(const int i, void* img_data);
+	bool ReadTrack(const int i, std::vector<char>& trk_data);
+};
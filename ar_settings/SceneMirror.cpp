@@ -0,0 +1,169 @@
+#include "SceneMirror.h"
+
+#include <string.h>
+#include <vector>
+#include <unordered_map>
+
+namespace scene_mirror
+{
+	struct mirror_entry
+	{
+		vzm::ObjStates pushed, pending;
+		bool has_pushed; // pushed is the state in the vzm scene
+		bool is_pending; // listed in pending_keys
+		mirror_entry() { has_pushed = is_pending = false; }
+	};
+
+	int scene_ids[MS_NUM_SLOTS] = {};
+	std::unordered_map<long long, mirror_entry> entries; // key : (scene_id, obj_id)
+	std::vector<long long> pending_keys; // in the order of the first SetState of the frame
+
+	long long calls_issued = 0, calls_elided = 0;
+	mirror_engine engine;
+
+	static bool EngineReplaceOrAdd(const int scene_id, const int obj_id, const vzm::ObjStates& obj_states)
+	{
+		return engine.replace_or_add ? engine.replace_or_add(scene_id, obj_id, obj_states) : vzm::ReplaceOrAddSceneObject(scene_id, obj_id, obj_states);
+	}
+
+	static bool EngineGetState(const int scene_id, const int obj_id, vzm::ObjStates& obj_states)
+	{
+		return engine.get_state ? engine.get_state(scene_id, obj_id, obj_states) : vzm::GetSceneObjectState(scene_id, obj_id, obj_states);
+	}
+
+	static bool EngineDelete(const int obj_id)
+	{
+		return engine.delete_object ? engine.delete_object(obj_id) : vzm::DeleteObject(obj_id);
+	}
+
+	static long long Key(const int scene_id, const int obj_id)
+	{
+		return ((long long)scene_id << 32) | (unsigned int)obj_id;
+	}
+
+	static bool IsSameState(const vzm::ObjStates& a, const vzm::ObjStates& b)
+	{
+		return memcmp(a.os2ws, b.os2ws, sizeof(a.os2ws)) == 0
+			&& a.emission == b.emission && a.diffusion == b.diffusion && a.specular == b.specular && a.sp_pow == b.sp_pow
+			&& a.is_visible == b.is_visible
+			&& memcmp(a.color, b.color, sizeof(a.color)) == 0
+			&& a.associated_obj_ids == b.associated_obj_ids
+			&& a.show_outline == b.show_outline
+			&& a.use_vertex_color == b.use_vertex_color
+			&& a.point_thickness == b.point_thickness
+			&& a.surfel_size == b.surfel_size
+			&& a.represent_points_to_surfels == b.represent_points_to_surfels
+			&& a.line_thickness == b.line_thickness
+			&& a.is_wireframe == b.is_wireframe
+			&& a.use_vertex_wirecolor == b.use_vertex_wirecolor
+			&& memcmp(a.wire_color, b.wire_color, sizeof(a.wire_color)) == 0
+			&& a.sample_rate == b.sample_rate;
+	}
+
+	void BindScene(const int scene_slot, const int scene_id)
+	{
+		for (int i = 0; i < MS_NUM_SLOTS; i++)
+			if (scene_slot == (1 << i)) scene_ids[i] = scene_id;
+	}
+
+	void SetState(const int scene_id, const int obj_id, const vzm::ObjStates& obj_states)
+	{
+		mirror_entry& entry = entries[Key(scene_id, obj_id)];
+		// a second state of the same frame replaces the first one, one call at most
+		if (entry.is_pending) calls_elided++;
+		else
+		{
+			entry.is_pending = true;
+			pending_keys.push_back(Key(scene_id, obj_id));
+		}
+		entry.pending = obj_states;
+	}
+
+	void SetStates(const int scene_mask, const int obj_id, const vzm::ObjStates& obj_states)
+	{
+		for (int i = 0; i < MS_NUM_SLOTS; i++)
+			if ((scene_mask & (1 << i)) && scene_ids[i] != 0) SetState(scene_ids[i], obj_id, obj_states);
+	}
+
+	bool GetState(const int scene_id, const int obj_id, vzm::ObjStates& obj_states)
+	{
+		auto it = entries.find(Key(scene_id, obj_id));
+		if (it != entries.end())
+		{
+			if (it->second.is_pending)
+			{
+				obj_states = it->second.pending;
+				calls_elided++;
+				return true;
+			}
+			if (it->second.has_pushed)
+			{
+				obj_states = it->second.pushed;
+				calls_elided++;
+				return true;
+			}
+		}
+		// not set through the mirror yet (e.g., added by the engine or a vzm call), the state is kept as pushed
+		calls_issued++;
+		if (!EngineGetState(scene_id, obj_id, obj_states)) return false;
+		mirror_entry& entry = entries[Key(scene_id, obj_id)];
+		entry.pushed = obj_states;
+		entry.has_pushed = true;
+		return true;
+	}
+
+	bool DeleteMirroredObject(const int obj_id)
+	{
+		if (obj_id == 0) return EngineDelete(obj_id);
+		for (auto it = entries.begin(); it != entries.end();)
+		{
+			if ((int)(it->first & 0xFFFFFFFF) == obj_id) it = entries.erase(it);
+			else it++;
+		}
+		// the pending keys of the object are skipped by FlushStates (no entry)
+		return EngineDelete(obj_id);
+	}
+
+	int FlushStates()
+	{
+		int num_calls = 0;
+		for (const long long key : pending_keys)
+		{
+			auto it = entries.find(key);
+			if (it == entries.end()) continue; // deleted
+			mirror_entry& entry = it->second;
+			entry.is_pending = false;
+			if (entry.has_pushed && IsSameState(entry.pushed, entry.pending))
+			{
+				calls_elided++;
+				continue;
+			}
+			EngineReplaceOrAdd((int)(key >> 32), (int)(key & 0xFFFFFFFF), entry.pending);
+			entry.pushed = entry.pending;
+			entry.has_pushed = true;
+			num_calls++;
+		}
+		pending_keys.clear();
+		calls_issued += num_calls;
+		return num_calls;
+	}
+
+	void GetMirrorStats(long long& _calls_issued, long long& _calls_elided, const bool reset)
+	{
+		_calls_issued = calls_issued;
+		_calls_elided = calls_elided;
+		if (reset) calls_issued = calls_elided = 0;
+	}
+
+	void ClearStates()
+	{
+		entries.clear();
+		pending_keys.clear();
+		memset(scene_ids, 0, sizeof(scene_ids));
+	}
+
+	void SetMirrorEngine(const mirror_engine* _engine)
+	{
+		engine = _engine ? *_engine : mirror_engine();
+	}
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#ifndef __dojostatic
+#define __dojostatic extern "C" __declspec(dllexport)
+#endif
+
+#include "VisMtvApi.h"
+
+#include <functional>
+
+// scene slots of the state masks (scene_mirror::SetStates), bound to the vzm scene ids by BindScene
+#define MS_WS			0x1
+#define MS_RS			0x2
+#define MS_STG			0x4
+#define MS_MODEL		0x8
+#define MS_CSECTION		0x10
+#define MS_ZNAVI_RS		0x20
+#define MS_ZNAVI_STG	0x40
+#define MS_USER_0		0x80	// application scenes (e.g., zoom views)
+#define MS_USER_1		0x100
+#define MS_NUM_SLOTS	9
+
+// client-side mirror of the object states of the vzm scenes
+// SetState records the state locally, FlushStates (once per frame, before rendering) pushes only the states differing from
+// the last pushed ones, GetState is answered from the mirror (no engine round trip once an object is known)
+// main thread only
+namespace scene_mirror
+{
+	// scene_slot : one MS_ bit
+	__dojostatic void BindScene(const int scene_slot, const int scene_id);
+
+	// same as vzm::ReplaceOrAddSceneObject, deferred to FlushStates
+	__dojostatic void SetState(const int scene_id, const int obj_id, const vzm::ObjStates& obj_states);
+	// one state to every bound scene of scene_mask (MS_ bits)
+	__dojostatic void SetStates(const int scene_mask, const int obj_id, const vzm::ObjStates& obj_states);
+	// same as vzm::GetSceneObjectState, the pending state if any
+	__dojostatic bool GetState(const int scene_id, const int obj_id, vzm::ObjStates& obj_states);
+	// vzm::DeleteObject and the states of the object are forgotten (the id may be reused)
+	__dojostatic bool DeleteMirroredObject(const int obj_id);
+
+	// pushes the changed states, returns the number of vzm calls issued
+	__dojostatic int FlushStates();
+	// vzm calls (ReplaceOrAddSceneObject, GetSceneObjectState) issued and elided since the last reset
+	__dojostatic void GetMirrorStats(long long& calls_issued, long long& calls_elided, const bool reset = false);
+	// forgets every state and the scene bindings (the vzm scenes are gone)
+	__dojostatic void ClearStates();
+
+	// the vzm calls of the mirror, an unset member calls vzm (a mock engine for the checks, no vzm scene needed)
+	struct mirror_engine
+	{
+		std::function<bool(const int scene_id, const int obj_id, const vzm::ObjStates& obj_states)> replace_or_add;
+		std::function<bool(const int scene_id, const int obj_id, vzm::ObjStates& obj_states)> get_state;
+		std::function<bool(const int obj_id)> delete_object;
+	};
+	// NULL : vzm
+	__dojostatic void SetMirrorEngine(const mirror_engine* engine);
+}
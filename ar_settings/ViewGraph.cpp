@@ -0,0 +1,160 @@
+#include "ViewGraph.h"
+#include "Profiler.h"
+
+#include <string.h>
+
+view_graph::view_graph(const int num_workers)
+{
+	memset(input_versions, 0, sizeof(input_versions));
+	memset(&stats, 0, sizeof(stats));
+	stop_workers = false;
+	for (int i = 0; i < num_workers; i++)
+		workers.push_back(std::thread(&view_graph::WorkerLoop, this, i));
+}
+
+view_graph::~view_graph()
+{
+	{
+		std::lock_guard<std::mutex> lock(task_lock);
+		stop_workers = true;
+	}
+	task_added.notify_all();
+	for (std::thread& worker : workers) worker.join();
+}
+
+int view_graph::AddView(const view_node& node)
+{
+	view_slot slot;
+	slot.node = node;
+	memset(slot.versions, 0, sizeof(slot.versions));
+	slot.has_run = slot.invalidated = false;
+	slot.rendered = slot.processed = false;
+	slot.zone_process = profiler::RegisterZone((node.name + " process").c_str());
+	views.push_back(slot);
+	return (int)views.size() - 1;
+}
+
+void view_graph::SetInput(const int input, const uint64_t version)
+{
+	for (int i = 0; i < VG_NUM_INPUTS; i++)
+		if (input == (1 << i)) input_versions[i] = version;
+}
+
+void view_graph::Invalidate(const int view_idx)
+{
+	if (view_idx >= 0 && view_idx < (int)views.size()) views[view_idx].invalidated = true;
+}
+
+void view_graph::InvalidateAll()
+{
+	for (view_slot& slot : views) slot.invalidated = true;
+}
+
+bool view_graph::IsDirty(const int view_idx) const
+{
+	const view_slot& slot = views[view_idx];
+	if (!slot.has_run || slot.invalidated) return true;
+	for (int i = 0; i < VG_NUM_INPUTS; i++)
+		if ((slot.node.inputs & (1 << i)) && slot.versions[i] != input_versions[i]) return true;
+	return false;
+}
+
+void view_graph::RunProcess(const int view_idx)
+{
+	view_slot& slot = views[view_idx];
+	prof_scope scope(slot.zone_process);
+	slot.node.Process();
+}
+
+void view_graph::WorkerLoop(const int worker_idx)
+{
+	profiler::SetThreadName(("view worker " + std::to_string(worker_idx)).c_str());
+	while (true)
+	{
+		int view_idx;
+		{
+			std::unique_lock<std::mutex> lock(task_lock);
+			task_added.wait(lock, [this] { return stop_workers || !tasks.empty(); });
+			if (tasks.empty()) return; // stop_workers
+			view_idx = tasks.front();
+			tasks.pop_front();
+		}
+		RunProcess(view_idx);
+		{
+			std::lock_guard<std::mutex> lock(task_lock);
+			views[view_idx].processed = true;
+		}
+		task_done.notify_all();
+	}
+}
+
+int view_graph::Execute()
+{
+	std::vector<int> dirty_views;
+	for (int i = 0; i < (int)views.size(); i++)
+	{
+		if (IsDirty(i)) dirty_views.push_back(i);
+		else stats.views_skipped++;
+	}
+
+	// render (caller thread), the processing of a view overlaps the rendering of the next ones
+	for (const int view_idx : dirty_views)
+	{
+		view_slot& slot = views[view_idx];
+		slot.rendered = slot.node.Render ? slot.node.Render() : true;
+		slot.has_run = true;
+		slot.invalidated = false;
+		memcpy(slot.versions, input_versions, sizeof(input_versions));
+
+		const bool to_process = slot.rendered && slot.node.Process;
+		if (to_process && !workers.empty())
+		{
+			{
+				std::lock_guard<std::mutex> lock(task_lock);
+				slot.processed = false;
+				tasks.push_back(view_idx);
+			}
+			task_added.notify_one();
+		}
+		else
+		{
+			if (to_process) RunProcess(view_idx);
+			std::lock_guard<std::mutex> lock(task_lock);
+			slot.processed = true;
+		}
+	}
+
+	// present in the view order
+	for (const int view_idx : dirty_views)
+	{
+		view_slot& slot = views[view_idx];
+		{
+			std::unique_lock<std::mutex> lock(task_lock);
+			task_done.wait(lock, [&slot] { return slot.processed; });
+		}
+		if (slot.rendered && slot.node.Present) slot.node.Present();
+	}
+
+	stats.frames++;
+	stats.views_run += (long long)dirty_views.size();
+	return (int)dirty_views.size();
+}
+
+view_graph_stats view_graph::GetStats(const bool reset)
+{
+	view_graph_stats _stats = stats;
+	if (reset) memset(&stats, 0, sizeof(stats));
+	return _stats;
+}
+
+uint64_t view_graph::Hash(const void* data, const size_t bytes, const uint64_t seed)
+{
+	uint64_t h = seed;
+	const unsigned char* p = (const unsigned char*)data;
+	for (size_t i = 0; i < bytes; i++)
+	{
+		h ^= p[i];
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
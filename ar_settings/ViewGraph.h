@@ -0,0 +1,91 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdint.h>
+
+// inputs of a view (view_node::inputs), a view runs only when the version of one of its inputs changed since its last run
+#define VG_IN_TRACK		0x1		// tracking frame (track_info contents)
+#define VG_IN_CAMERA	0x2		// camera parameters of the rendered scenes
+#define VG_IN_MODEL		0x4		// model alignment, guide and sectional view settings
+#define VG_IN_TOUCH		0x8		// touch mode, calibration picks, operation text
+#define VG_IN_SCENE		0x10	// object states and geometry pushed to the scenes
+#define VG_IN_IMAGE		0x20	// camera image
+#define VG_NUM_INPUTS	6
+
+// one view of the frame, the stages are optional
+//  Render : caller thread, the engine work (vzm::RenderScene, GetRenderBufferPtrs), false : nothing to process and present
+//  Process : worker thread, cpu work on the buffers of Render only (compositing, overlays, mirror conversion),
+//   no engine or window call, nothing shared with the Process of another view
+//  Present : caller thread, imshow (in the order of the views)
+struct view_node
+{
+	std::string name;
+	int inputs; // VG_IN_ bits
+	std::function<bool()> Render;
+	std::function<void()> Process;
+	std::function<void()> Present;
+};
+
+struct view_graph_stats
+{
+	long long frames;
+	long long views_run;		// views rendered, processed and presented
+	long long views_skipped;	// views whose inputs did not change
+};
+
+// per-frame view scheduler : the dirty views are rendered one by one on the caller thread, the processing of a rendered
+// view runs on the worker pool while the next views are rendered, then the views are presented as they complete
+// the stages are callbacks, a headless backend (e.g., a mock renderer in a test) only provides other callbacks
+class view_graph
+{
+private:
+	struct view_slot
+	{
+		view_node node;
+		uint64_t versions[VG_NUM_INPUTS]; // input versions of the last run
+		bool has_run, invalidated;
+		bool rendered, processed; // current frame, processed is guarded by task_lock
+		int zone_process;
+	};
+	std::vector<view_slot> views;
+	uint64_t input_versions[VG_NUM_INPUTS];
+
+	std::vector<std::thread> workers;
+	std::deque<int> tasks; // view indices to process
+	std::mutex task_lock;
+	std::condition_variable task_added, task_done;
+	bool stop_workers;
+
+	view_graph_stats stats;
+
+	void WorkerLoop(const int worker_idx);
+	void RunProcess(const int view_idx);
+
+public:
+	// num_workers 0 : the views are processed on the caller thread
+	view_graph(const int num_workers = 2);
+	~view_graph();
+
+	// returns the view index (presentation order is the order of AddView)
+	int AddView(const view_node& node);
+	// input : one VG_IN_ bit, any value different from the previous one marks the views declaring the input
+	void SetInput(const int input, const uint64_t version);
+	// the view runs at the next Execute whatever its inputs (e.g., the window was resized)
+	void Invalidate(const int view_idx);
+	void InvalidateAll();
+	bool IsDirty(const int view_idx) const;
+
+	// runs the dirty views, returns the number of views run
+	int Execute();
+
+	view_graph_stats GetStats(const bool reset = false);
+
+	// FNV-1a, for input versions from plain data
+	static uint64_t Hash(const void* data, const size_t bytes, const uint64_t seed = 14695981039346656037ULL);
+};
@@ -6,6 +6,7 @@
 #include <opencv2/calib3d.hpp>
 
 #include <map>
+#include <string.h>
 #define _USE_MATH_DEFINES
 #include <math.h>
 
@@ -34,11 +35,20 @@ struct DetMarkerPrimitives
 struct ArArucoMarkerInst
 {
 	Ptr<aruco::DetectorParameters> detectorParams;
+	Ptr<aruco::DetectorParameters> coarseParams; // downscaled full frame search, the corners are refined in the full resolution regions
 	map<int, double> markers_length;
 
 	DetMarkerPrimitives prev_markers;
 
+	__MarkerTrackParams track_params;
+	__MarkerTrackStats track_stats;
+	int calls_since_full_search;
+
 	ArArucoMarkerInst() {
+		memset(&track_stats, 0, sizeof(track_stats));
+		calls_since_full_search = 0;
+		coarseParams = aruco::DetectorParameters::create();
+		coarseParams->cornerRefinementMethod = aruco::CORNER_REFINE_NONE;
 		detectorParams = aruco::DetectorParameters::create();
 		detectorParams->cornerRefinementMethod =
 			aruco::CORNER_REFINE_CONTOUR;// |
@@ -79,27 +89,166 @@ int ArMarkerTracker::register_marker(const int markerId, const double marker_wid
 	return 0;
 }
 
+void ArMarkerTracker::set_track_params(const __MarkerTrackParams& params)
+{
+	ArArucoMarkerInst& marker_inst = g_map_aruco_marker_trackers[this];
+	marker_inst.track_params = params;
+	if (marker_inst.track_params.full_search_interval < 1) marker_inst.track_params.full_search_interval = 1;
+	if (marker_inst.track_params.full_search_scale <= 0 || marker_inst.track_params.full_search_scale > 1.f) marker_inst.track_params.full_search_scale = 1.f;
+	marker_inst.prev_markers.clear();
+	marker_inst.calls_since_full_search = 0;
+}
+
+__MarkerTrackStats ArMarkerTracker::get_track_stats(const bool reset)
+{
+	ArArucoMarkerInst& marker_inst = g_map_aruco_marker_trackers[this];
+	__MarkerTrackStats stats = marker_inst.track_stats;
+	if (reset) memset(&marker_inst.track_stats, 0, sizeof(__MarkerTrackStats));
+	return stats;
+}
+
+namespace
+{
+	void ToGray(const Mat& img, Mat& gray)
+	{
+		if (img.channels() == 3) cvtColor(img, gray, COLOR_BGR2GRAY);
+		else gray = img;
+	}
+
+	// bounding box of the corners expanded by margin (ratio of the marker size), empty when too small or outside the image
+	Rect MarkerRoi(const vector< Point2f >& corners, const float margin, const int w, const int h)
+	{
+		Rect2f box = boundingRect(corners);
+		const float expand = (box.width > box.height ? box.width : box.height) * margin + 4.f;
+		Rect roi(Point((int)floor(box.x - expand), (int)floor(box.y - expand)), Point((int)ceil(box.br().x + expand), (int)ceil(box.br().y + expand)));
+		roi &= Rect(0, 0, w, h);
+		if (roi.width < 16 || roi.height < 16) return Rect();
+		return roi;
+	}
+}
+
 int ArMarkerTracker::track_markers(std::vector<__MarkerDetInfo>& list_det_markers,
 	const unsigned char* gray_img, const int w, const int h, const std::set<int>& marker_IDs)
+{
+	return track_markers(list_det_markers, gray_img, w, h, 1, marker_IDs, NULL);
+}
+
+int ArMarkerTracker::track_markers(std::vector<__MarkerDetInfo>& list_det_markers,
+	const unsigned char* img, const int w, const int h, const int channels, const std::set<int>& marker_IDs, const float* mat_prev2cur)
 {
 	ArArucoMarkerInst& marker_inst = g_map_aruco_marker_trackers[this];
+	DetMarkerPrimitives prev_markers = marker_inst.prev_markers;
 	marker_inst.prev_markers.clear();
 	if (marker_inst.markers_length.size() == 0) return 0;
+	if (channels != 1 && channels != 3) return -1;
+
+	const int64 tick_start = getTickCount();
+	const __MarkerTrackParams& params = marker_inst.track_params;
+	__MarkerTrackStats& stats = marker_inst.track_stats;
+	stats.frames++;
 
-	Mat image(h, w, CV_8UC1, (unsigned char*)gray_img);
+	Mat image(h, w, channels == 3 ? CV_8UC3 : CV_8UC1, (unsigned char*)img);
 
 	vector< int > ids;
 	vector< vector< Point2f > > corners, rejected;
 
-	// detect markers and estimate pose
-	aruco::detectMarkers(image, g_dictionary, corners, ids, marker_inst.detectorParams, rejected);
-	if (ids.size() == 0) return 0;
+	auto is_tracked = [&](const int id)
+	{
+		return marker_IDs.find(id) != marker_IDs.end() && marker_inst.markers_length.find(id) != marker_inst.markers_length.end();
+	};
+
+	const bool full_search = !params.roi_tracking || prev_markers.id_markers.size() == 0
+		|| ++marker_inst.calls_since_full_search >= params.full_search_interval;
+	if (full_search)
+	{
+		marker_inst.calls_since_full_search = 0;
+		stats.full_searches++;
+	}
+
+	if (full_search && (!params.roi_tracking || params.full_search_scale >= 1.f))
+	{
+		// detect markers and estimate pose
+		Mat gray;
+		ToGray(image, gray);
+		aruco::detectMarkers(gray, g_dictionary, corners, ids, marker_inst.detectorParams, rejected);
+	}
+	else
+	{
+		// regions of the previous markers at their predicted positions
+		vector< Rect > rois;
+		for (size_t i = 0; i < prev_markers.corners_set.size(); i++)
+		{
+			vector< Point2f > pred_corners = prev_markers.corners_set[i];
+			if (mat_prev2cur)
+				perspectiveTransform(prev_markers.corners_set[i], pred_corners, Matx33f(mat_prev2cur));
+			Rect roi = MarkerRoi(pred_corners, params.roi_margin, w, h);
+			if (roi.area() > 0) rois.push_back(roi);
+		}
+
+		// regions of the markers found by the downscaled full frame search
+		if (full_search)
+		{
+			const float scale = params.full_search_scale;
+			Mat image_small, gray_small;
+			resize(image, image_small, Size(), scale, scale, INTER_AREA);
+			ToGray(image_small, gray_small);
+			vector< int > coarse_ids;
+			vector< vector< Point2f > > coarse_corners;
+			aruco::detectMarkers(gray_small, g_dictionary, coarse_corners, coarse_ids, marker_inst.coarseParams);
+			for (size_t i = 0; i < coarse_ids.size(); i++)
+			{
+				if (!is_tracked(coarse_ids[i])) continue;
+				for (Point2f& pt : coarse_corners[i]) pt *= 1.f / scale;
+				Rect roi = MarkerRoi(coarse_corners[i], params.roi_margin, w, h);
+				if (roi.area() > 0) rois.push_back(roi);
+			}
+		}
+
+		// overlapping regions are merged, so that a marker is detected in a single region
+		for (size_t i = 0; i < rois.size(); i++)
+		{
+			for (size_t j = i + 1; j < rois.size(); j++)
+			{
+				if ((rois[i] & rois[j]).area() == 0) continue;
+				rois[i] |= rois[j];
+				rois.erase(rois.begin() + j);
+				j = i; // the grown region is tested again against the others
+			}
+		}
+
+		// one detection per region, in parallel
+		vector< vector< int > > roi_ids(rois.size());
+		vector< vector< vector< Point2f > > > roi_corners(rois.size());
+		parallel_for_(Range(0, (int)rois.size()), [&](const Range& range)
+		{
+			for (int i = range.start; i < range.end; i++)
+			{
+				Mat roi_gray;
+				ToGray(image(rois[i]), roi_gray);
+				aruco::detectMarkers(roi_gray, g_dictionary, roi_corners[i], roi_ids[i], marker_inst.detectorParams);
+				const Point2f offset((float)rois[i].x, (float)rois[i].y);
+				for (vector< Point2f >& marker_corners : roi_corners[i])
+					for (Point2f& pt : marker_corners) pt += offset;
+			}
+		});
+		stats.roi_detections += (long long)rois.size();
+
+		set<int> found_ids;
+		for (size_t i = 0; i < rois.size(); i++)
+		{
+			for (size_t j = 0; j < roi_ids[i].size(); j++)
+			{
+				if (!found_ids.insert(roi_ids[i][j]).second) continue;
+				ids.push_back(roi_ids[i][j]);
+				corners.push_back(roi_corners[i][j]);
+			}
+		}
+	}
 
 	for (size_t i = 0; i < ids.size(); i++)
 	{
 		int id = ids[i];
-		if (marker_IDs.find(id) == marker_IDs.end()) continue;
-		if (marker_inst.markers_length.find(id) == marker_inst.markers_length.end()) continue;
+		if (!is_tracked(id)) continue;
 
 		__MarkerDetInfo marker_info;
 		marker_info.id = id;
@@ -120,5 +269,7 @@ int ArMarkerTracker::track_markers(std::vector<__MarkerDetInfo>& list_det_marker
 		list_det_markers.push_back(marker_info);
 	}
 
+	stats.last_ms = (double)(getTickCount() - tick_start) * 1000. / getTickFrequency();
+	stats.total_ms += stats.last_ms;
 	return (int)list_det_markers.size();
 }
\ No newline at end of file
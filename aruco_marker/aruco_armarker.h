@@ -14,6 +14,36 @@ struct __MarkerDetInfo
 	};
 };
 
+// tracking mode of track_markers
+struct __MarkerTrackParams
+{
+	// false : full frame detection at every call (default)
+	// true : detection inside the regions of the markers of the previous call, predicted by mat_prev2cur and expanded by roi_margin,
+	//  the regions are detected in parallel, a full frame search finds the new markers every full_search_interval calls (and when no marker is tracked)
+	bool roi_tracking;
+	int full_search_interval;
+	// scale of the full frame search image in the roi tracking mode (1 : full resolution), the markers found are refined in their full resolution regions
+	float full_search_scale;
+	// roi expansion on each side, ratio of the marker size
+	float roi_margin;
+
+	__MarkerTrackParams() {
+		roi_tracking = false;
+		full_search_interval = 10;
+		full_search_scale = 0.5f;
+		roi_margin = 0.5f;
+	};
+};
+
+struct __MarkerTrackStats
+{
+	long long frames;
+	long long full_searches;	// full frame searches (downscaled in the roi tracking mode)
+	long long roi_detections;	// detections in a region of the roi tracking mode
+	double total_ms;			// time of track_markers
+	double last_ms;
+};
+
 class __declspec(dllexport) ArMarkerTracker // must use this as a singleton class
 {
 public:
@@ -31,9 +61,20 @@ public:
 	// return value 0 : works okay, !0 L error
 	int register_marker(const int markerId, const double marker_width);
 
+	// :: set the tracking mode (the previous markers are forgotten)
+	void set_track_params(const __MarkerTrackParams& params);
+
 	// :: track the specified (by id) markers
 	// list_det_markers : output of the tracking process
 	// return value : > 0 ==> # of detected markers (same as list_det_markers.size()), < 0 ==> error exists
 	int track_markers(std::vector<__MarkerDetInfo>& list_det_markers,
 		const unsigned char* gray_img, const int w, const int h, const std::set<int>& marker_IDs);
+
+	// img : gray (channels 1) or BGR (channels 3) image, a BGR image is converted to gray inside the searched regions only
+	// mat_prev2cur : optional 3x3 homography (row major) of the image motion since the previous call (e.g., from the tracked camera motion),
+	//  used by the roi tracking mode to predict the regions
+	int track_markers(std::vector<__MarkerDetInfo>& list_det_markers,
+		const unsigned char* img, const int w, const int h, const int channels, const std::set<int>& marker_IDs, const float* mat_prev2cur = NULL);
+
+	__MarkerTrackStats get_track_stats(const bool reset = false);
 };
\ No newline at end of file
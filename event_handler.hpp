@@ -270,16 +270,14 @@ void CallBackFunc_RsMouse(int event, int x, int y, int flags, void* userdata)
 					vzm::ObjStates tool_screw;
 					int inserted_implant_id = 0;
 					vzm::GenerateCylindersObject((float*)cyl_p, &cyl_r, __FP cyl_rgb, 1, inserted_implant_id);
-					vzm::ReplaceOrAddSceneObject(eginfo->ginfo.stg_scene_id, inserted_implant_id, tool_screw);
-					vzm::ReplaceOrAddSceneObject(eginfo->ginfo.rs_scene_id, inserted_implant_id, tool_screw);
-					vzm::ReplaceOrAddSceneObject(eginfo->ginfo.ws_scene_id, inserted_implant_id, tool_screw);
+					scene_mirror::SetStates(MS_WS | MS_RS | MS_STG, inserted_implant_id, tool_screw);
 					inserted_implant_ids.push_back(inserted_implant_id);
 				}
 				else
 				{
 					if (inserted_implant_ids.size() > 0)
 					{
-						vzm::DeleteObject(inserted_implant_ids[inserted_implant_ids.size() - 1]);
+						scene_mirror::DeleteMirroredObject(inserted_implant_ids[inserted_implant_ids.size() - 1]);
 						inserted_implant_ids.pop_back();
 					}
 				}
@@ -304,32 +302,14 @@ void CallBackFunc_RsMouse(int event, int x, int y, int flags, void* userdata)
 
 			if (TouchOnButton(x, y)) return;
 
-			int pick_obj = 0;
-			glm::fvec3 pos_pick;
-			const int r = 10;
-			for (int ry = max(y - r, 0); ry < min(y + r, eginfo->ginfo.rs_h - 1); ry++)
-				for (int rx = max(x - r, 0); rx < min(x + r, eginfo->ginfo.rs_w - 1); rx++)
-				{
-					if (vzm::PickObject(pick_obj, __FP pos_pick, rx, ry, eginfo->scene_id, eginfo->cam_id))
-					{
-						ry = eginfo->ginfo.rs_h;
-						break;
-					}
-				}
+			// ray against the pickable markers (SetMkSpheres), the marker pool keeps the cid of each marker
+			marker_vis_pool& pick_pool = eginfo->ginfo.otrk_data.mk_pickable_pool;
+			int mk_idx = pick_pool.Pick(x, y, eginfo->scene_id, eginfo->cam_id);
 
-			cout << "Calib_STG PICK ID : " << x << ", " << y << " ==> " << pick_obj << endl;
-			if (pick_obj != 0)
+			cout << "Calib_STG PICK ID : " << x << ", " << y << " ==> " << marker_vis_pool::GetPickId(mk_idx) << endl;
+			if (mk_idx >= 0)
 			{
-				glm::fvec3 mk_pt = eginfo->ginfo.vzmobjid2pos[pick_obj];
-				for (int i = 0; i < (int)eginfo->ginfo.vzmobjid2pos.size(); i++)
-				{
-					glm::fvec3 mk_candi_pt = eginfo->ginfo.otrk_data.trk_info.GetMkPos(i);
-					if (glm::length(mk_candi_pt - mk_pt) < 0.005f)
-					{
-						eginfo->ginfo.otrk_data.stg_calib_mk_cid = eginfo->ginfo.otrk_data.trk_info.mk_cid_list[i];
-						break;
-					}
-				}
+				eginfo->ginfo.otrk_data.stg_calib_mk_cid = pick_pool.cid[mk_idx];
 				cout << "Calib_STG MARKER CID : " << eginfo->ginfo.otrk_data.stg_calib_mk_cid << " / total # : " << eginfo->ginfo.vzmobjid2pos.size() << endl;
 			}
 			else
@@ -459,12 +439,12 @@ void CallBackFunc_RsMouse(int event, int x, int y, int flags, void* userdata)
 				if (helpers::ComputeRigidTransform(__FP eginfo->ginfo.model_ms_pick_pts[0], __FP eginfo->ginfo.model_rbs_pick_pts[0], num_crrpts, __FP mat_ms2rbs[0]))
 				{
 					vzm::ObjStates model_obj_state;
-					vzm::GetSceneObjectState(eginfo->ginfo.model_scene_id, eginfo->ginfo.model_ms_obj_id, model_obj_state);
+					scene_mirror::GetState(eginfo->ginfo.model_scene_id, eginfo->ginfo.model_ms_obj_id, model_obj_state);
 
 					vzm::ObjStates model_ws_obj_state;
-					vzm::GetSceneObjectState(eginfo->ginfo.ws_scene_id, eginfo->ginfo.model_ws_obj_id, model_ws_obj_state);
+					scene_mirror::GetState(eginfo->ginfo.ws_scene_id, eginfo->ginfo.model_ws_obj_id, model_ws_obj_state);
 					model_ws_obj_state.is_visible = true;
-					vzm::ReplaceOrAddSceneObject(eginfo->ginfo.ws_scene_id, eginfo->ginfo.model_ws_obj_id, model_ws_obj_state);
+					scene_mirror::SetState(eginfo->ginfo.ws_scene_id, eginfo->ginfo.model_ws_obj_id, model_ws_obj_state);
 
 					glm::fmat4x4 mat_ms2ws = mat_rbs2ws * mat_ms2rbs;
 					glm::fmat4x4 mat_match_model2ws = mat_ms2ws * (__cm4__ model_obj_state.os2ws); // the latter include scale factors
@@ -503,28 +483,15 @@ void CallBackFunc_RsMouse(int event, int x, int y, int flags, void* userdata)
 		} break;
 		case RsTouchMode::ICP:
 		{
-			glm::fmat4x4 mat_tr;
-			vzm::ObjStates ori_obj_state;
-			vzm::GetSceneObjectState(eginfo->ginfo.model_scene_id, eginfo->ginfo.captured_model_ms_point_id, ori_obj_state);
-
-			vzm::ObjStates tmp_obj_state = ori_obj_state;
-			__cm4__ tmp_obj_state.os2ws = eginfo->ginfo.mat_matchtr;
-			vzm::ReplaceOrAddSceneObject(eginfo->ginfo.model_scene_id, eginfo->ginfo.captured_model_ms_point_id, tmp_obj_state);
-			vzmproc::ComputeMatchingTransform(eginfo->ginfo.captured_model_ms_point_id, eginfo->ginfo.captured_model_ws_point_id, __FP mat_tr);
-			vzm::ReplaceOrAddSceneObject(eginfo->ginfo.model_scene_id, eginfo->ginfo.captured_model_ms_point_id, ori_obj_state);
-
-			vzm::ObjStates model_obj_state;
-			vzm::GetSceneObjectState(eginfo->ginfo.model_scene_id, eginfo->ginfo.model_ms_obj_id, model_obj_state);
-			glm::fmat4x4 mat_match_model2ws = (mat_tr * eginfo->ginfo.mat_matchtr) * (__cm4__ model_obj_state.os2ws);
-			eginfo->ginfo.mat_os2matchmodefrm = eginfo->ginfo.mat_ws2matchmodelfrm * mat_match_model2ws;
-			eginfo->ginfo.mat_matchtr = mat_tr * eginfo->ginfo.mat_matchtr;
-			eginfo->ginfo.is_modelaligned = true;
-			cout << "model ICP matching done!" << endl;
+			// the model is registered to the captured points (or the rs point cloud) by the icp tracker,
+			// the result (mat_os2matchmodefrm, mat_matchtr) is applied by a following RenderAndShowWindows
+			eginfo->ginfo.is_icp_requested = true;
+			cout << "model ICP requested" << endl;
 		} break;
 		case RsTouchMode::Pair_Clear:
 		{
 			for (int i = 0; i < eginfo->ginfo.otrk_data.calib_trial_rs_cam_frame_ids.size(); i++)
-				vzm::DeleteObject(eginfo->ginfo.otrk_data.calib_trial_rs_cam_frame_ids[i]);
+				scene_mirror::DeleteMirroredObject(eginfo->ginfo.otrk_data.calib_trial_rs_cam_frame_ids[i]);
 			eginfo->ginfo.otrk_data.calib_trial_rs_cam_frame_ids.clear();
 			eginfo->ginfo.otrk_data.tc_calib_pt_pairs.clear();
 			cout << "Clear point pairs!!" << endl;
@@ -545,30 +512,25 @@ void CallBackFunc_RsMouse(int event, int x, int y, int flags, void* userdata)
 				glm::fvec3 pos_pick;
 				if(!otrk_data.trk_info.GetProbePinPoint(pos_pick)) return;
 
-				vzm::ObjStates model_obj_state;
-				vzm::GetSceneObjectState(eginfo->ginfo.ws_scene_id, eginfo->ginfo.rs_pc_id, model_obj_state);
-				glm::fmat4x4 mat_ws2os = glm::inverse(*(glm::fmat4x4*)model_obj_state.os2ws);
-
-				glm::fvec3 pos_pick_os = tr_pt(mat_ws2os, pos_pick);
+				// the rs point cloud is in the depth camera space (its os2ws), so are the samples
+				vzm::ObjStates model_obj_state, sobj_state;
+				scene_mirror::GetState(eginfo->ginfo.ws_scene_id, eginfo->ginfo.rs_pc_id, model_obj_state);
+				glm::fvec3 pos_pick_os = SetSampledPointsFrame(model_obj_state, pos_pick, sobj_state);
 
 				vzmproc::GenerateSamplePoints(eginfo->ginfo.rs_pc_id, (float*)&pos_pick_os, 0.02f, 0.0003f, eginfo->ginfo.captured_model_ws_point_id);
 				cout << "Capturing in RS PC" << endl;
 
-				vzm::ObjStates sobj_state;
 				__cv4__ sobj_state.color = glm::fvec4(1, 1, 0, 1);
 				sobj_state.emission = 0.5f;
 				sobj_state.diffusion = 0.5f;
 				sobj_state.specular = 0.0f;
 				//sobj_state.point_thickness = 10.f;
 				sobj_state.surfel_size = 0.005f;
-				//*(glm::fmat4x4*)sobj_state.os2ws = *(glm::fmat4x4*)model_obj_state.os2ws;
-				vzm::ReplaceOrAddSceneObject(eginfo->ginfo.ws_scene_id, eginfo->ginfo.captured_model_ws_point_id, sobj_state);
-				vzm::ReplaceOrAddSceneObject(eginfo->ginfo.rs_scene_id, eginfo->ginfo.captured_model_ws_point_id, sobj_state);
-				vzm::ReplaceOrAddSceneObject(eginfo->ginfo.stg_scene_id, eginfo->ginfo.captured_model_ws_point_id, sobj_state);
+				scene_mirror::SetStates(MS_WS | MS_RS | MS_STG, eginfo->ginfo.captured_model_ws_point_id, sobj_state);
 			}
 			else
 			{
-				vzm::DeleteObject(eginfo->ginfo.captured_model_ws_point_id);
+				scene_mirror::DeleteMirroredObject(eginfo->ginfo.captured_model_ws_point_id);
 				cout << "Clear capture points in WS" << endl;
 			}
 			//eginfo->ginfo.touch_mode = RsTouchMode::Align;
@@ -718,11 +680,11 @@ void CallBackFunc_ModelMouse(int event, int x, int y, int flags, void* userdata)
 					sobj_state.diffusion = 0.5f;
 					sobj_state.specular = 0.0f;
 					vzm::GenerateSpheresObject(__FP spheres_xyzr[0], __FP spheres_rgb[0], (int)eginfo->ginfo.model_ms_pick_pts.size(), eginfo->ginfo.model_ms_pick_spheres_id);
-					vzm::ReplaceOrAddSceneObject(eginfo->scene_id, eginfo->ginfo.model_ms_pick_spheres_id, sobj_state);
+					scene_mirror::SetState(eginfo->scene_id, eginfo->ginfo.model_ms_pick_spheres_id, sobj_state);
 				}
 				else
 				{
-					vzm::DeleteObject(eginfo->ginfo.model_ms_pick_spheres_id);
+					scene_mirror::DeleteMirroredObject(eginfo->ginfo.model_ms_pick_spheres_id);
 					eginfo->ginfo.model_ms_pick_spheres_id = 0;
 				}
 
@@ -755,28 +717,24 @@ void CallBackFunc_ModelMouse(int event, int x, int y, int flags, void* userdata)
 			glm::fvec3 pos_pick;
 			if (!GetSufacePickPos(pos_pick, eginfo->scene_id, eginfo->cam_id, eginfo->ginfo.model_volume_id == 0, x, y)) return;
 
-			vzm::ObjStates model_obj_state;
-			vzm::GetSceneObjectState(eginfo->scene_id, eginfo->ginfo.model_ms_obj_id, model_obj_state);
-			glm::fmat4x4 mat_ws2os = glm::inverse(*(glm::fmat4x4*)model_obj_state.os2ws);
-
-			glm::fvec3 pos_pick_os = tr_pt(mat_ws2os, pos_pick);
+			vzm::ObjStates model_obj_state, sobj_state;
+			scene_mirror::GetState(eginfo->scene_id, eginfo->ginfo.model_ms_obj_id, model_obj_state);
+			glm::fvec3 pos_pick_os = SetSampledPointsFrame(model_obj_state, pos_pick, sobj_state);
 			vzmproc::GenerateSamplePoints(eginfo->ginfo.model_ms_obj_id, (float*)&pos_pick_os, 20.f, 0.3f, eginfo->ginfo.captured_model_ms_point_id);
 
-			vzm::ObjStates sobj_state;
 			__cv4__ sobj_state.color = glm::fvec4(1, 1, 0, 1);
 			sobj_state.emission = 0.5f;
 			sobj_state.diffusion = 0.5f;
 			sobj_state.specular = 0.0f;
 			//sobj_state.point_thickness = 10.f;
 			sobj_state.surfel_size = 0.005f;
-			//*(glm::fmat4x4*)sobj_state.os2ws = *(glm::fmat4x4*)model_obj_state.os2ws;
-			vzm::ReplaceOrAddSceneObject(eginfo->scene_id, eginfo->ginfo.captured_model_ms_point_id, sobj_state);
+			scene_mirror::SetState(eginfo->scene_id, eginfo->ginfo.captured_model_ms_point_id, sobj_state);
 			
 			Show_Window_with_Info(eginfo->ginfo.window_name_ms_view, eginfo->scene_id, eginfo->cam_id, eginfo->ginfo);
 		}
 		else if(event == EVENT_RBUTTONDOWN)
 		{
-			vzm::DeleteObject(eginfo->ginfo.captured_model_ms_point_id);
+			scene_mirror::DeleteMirroredObject(eginfo->ginfo.captured_model_ms_point_id);
 
 			Show_Window_with_Info(eginfo->ginfo.window_name_ms_view, eginfo->scene_id, eginfo->cam_id, eginfo->ginfo);
 		}
@@ -4,10 +4,12 @@
 #include <windows.h>
 
 #include <queue>
+#include <functional>
 #include <bitset>
 #include <string>
 #include <sstream>
 #include <iomanip>
+#include <float.h>
 
 
 #include <glm/gtc/matrix_transform.hpp>
@@ -16,6 +18,7 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/vector_angle.hpp>
+#include <glm/gtx/quaternion.hpp>
 
 #include <opencv2/imgproc.hpp>
 #include <opencv2/highgui.hpp>
@@ -23,6 +26,8 @@
 #include <opencv2/calib3d.hpp>
 #include <opencv2/video/tracking.hpp>
 
+#include "ar_settings/SceneMirror.h"
+
 #define __cv3__ *(glm::fvec3*)
 #define __cv4__ *(glm::fvec4*)
 #define __cm4__ *(glm::fmat4x4*)
@@ -76,6 +81,11 @@ std::vector<std::string> name##Map = split(#__VA_ARGS__, ',');\
 
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/thread.hpp>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 // https://www.justsoftwaresolutions.co.uk/threading/implementing-a-thread-safe-queue-using-condition-variables.html
 template<typename Data>
 class concurrent_queue // single consumer
@@ -173,54 +183,262 @@ public:
 	}
 };
 
-struct track_info
+// lock-free single producer / single consumer ring of preallocated slots
+// producer : push(), or begin_write() + fill the slot in place + end_write()
+// consumer : pop_latest() / wait_latest() (latest-wins, older samples are skipped) or pop() / pop_all() (in push order)
+// when the ring is full, the oldest sample is overwritten; only when the consumer is reading the full ring at that moment
+// the new sample is rejected instead (not blocking), both are counted in num_dropped()
+template<typename Data>
+class spsc_ring
 {
-	//  "rs_cam" , "probe" , "ss_tool_v1" , "ss_head" , "breastbody" 
-	map<string, pair<bool, glm::fmat4x4>> map_lfrm2ws;
+private:
+	std::vector<Data> the_slots;
+	size_t mask;
 
-	bool GetLFrmInfo(const string& name, glm::fmat4x4& mat_lfrm2ws) const
+	alignas(64) std::atomic<size_t> head; // next slot to write, owned by the producer
+	// (next slot to read) << 1 | reading bit, advanced by the consumer, or by the producer when it overwrites the oldest slot
+	alignas(64) std::atomic<size_t> tail;
+	alignas(64) std::atomic<size_t> dropped;
+
+	// bounded wait of the consumer, the producer takes the mutex only while the consumer waits
+	std::atomic<bool> waiting;
+	std::mutex wait_mutex;
+	std::condition_variable wait_cv;
+
+	// consumer : claims the pending slots [t, h) (the producer does not overwrite them until end_read), false when empty
+	bool begin_read(size_t& t, size_t& h)
 	{
-		bool is_detected = false;
-		auto it = map_lfrm2ws.find(name);
-		if (it != map_lfrm2ws.end())
+		size_t v = tail.load(std::memory_order_acquire);
+		for (;;)
 		{
-			is_detected = get<0>(it->second);
-			mat_lfrm2ws = get<1>(it->second);
+			t = v >> 1;
+			h = head.load(std::memory_order_acquire);
+			if (t == h) return false;
+			if (tail.compare_exchange_weak(v, v | 1, std::memory_order_acq_rel, std::memory_order_acquire)) return true;
 		}
-		return is_detected;
 	}
 
-	void SetLFrmInfo(const string& name, const bool is_detected, const glm::fmat4x4& mat_lfrm2ws)
+	void end_read(const size_t t_next)
 	{
-		map_lfrm2ws[name] = pair<bool, glm::fmat4x4>(is_detected, mat_lfrm2ws);
+		tail.store(t_next << 1, std::memory_order_release);
+	}
+
+public:
+	spsc_ring(int cap = 16)
+	{
+		size_t n = 2;
+		while (n < (size_t)cap) n <<= 1;
+		the_slots.resize(n);
+		mask = n - 1;
+		head = 0;
+		tail = 0;
+		dropped = 0;
+		waiting = false;
+	}
+
+	// returns NULL only when the ring is full and the consumer is reading it
+	// the slot keeps the contents of an older sample (the slot memory is reused), so every field must be rewritten
+	Data* begin_write()
+	{
+		const size_t h = head.load(std::memory_order_relaxed);
+		size_t v = tail.load(std::memory_order_acquire);
+		for (;;)
+		{
+			if (h - (v >> 1) <= mask) return &the_slots[h & mask];
+			if (v & 1)
+			{
+				dropped.fetch_add(1, std::memory_order_relaxed);
+				return NULL;
+			}
+			// full : the oldest sample is dropped (fails when the consumer claimed it in the meantime)
+			if (tail.compare_exchange_weak(v, v + 2, std::memory_order_acq_rel, std::memory_order_acquire))
+			{
+				dropped.fetch_add(1, std::memory_order_relaxed);
+				return &the_slots[h & mask];
+			}
+		}
 	}
-	// when changing this, please consider the serialization
-	//"rs_cam"
-	//glm::fmat4x4 mat_rbcam2ws;
-	//bool is_detected_rscam;
-	//
-	////"probe"
-	//glm::fmat4x4 mat_probe2ws;
-	//bool is_detected_probe;
-	//
-	////"ss_tool_v1"
-	//glm::fmat4x4 mat_tfrm2ws;
-	//bool is_detected_sstool;
-	//
-	////"ss_head"
-	//glm::fmat4x4 mat_headfrm2ws;
-	//bool is_detected_sshead;
-	//
-	////"breastbody"
-	//glm::fmat4x4 mat_bodyfrm2ws;
-	//bool is_detected_brbody;
 
-	std::vector<float> mk_xyz_list;
-	std::vector<float> mk_residue_list;
-	std::vector<std::bitset<128>> mk_cid_list;
+	void end_write()
+	{
+		head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_seq_cst);
+		if (waiting.load(std::memory_order_seq_cst))
+		{
+			std::lock_guard<std::mutex> lock(wait_mutex);
+			wait_cv.notify_one();
+		}
+	}
 
+	bool push(const Data& data) //enque
+	{
+		Data* slot = begin_write();
+		if (slot == NULL) return false;
+		*slot = data;
+		end_write();
+		return true;
+	}
+
+	// latest-wins : takes the newest sample and discards the rest
+	// the slot receives the previous contents of popped_value (swap), so no allocation happens on either side
+	bool pop_latest(Data& popped_value)
+	{
+		size_t t, h;
+		if (!begin_read(t, h)) return false;
+		std::swap(popped_value, the_slots[(h - 1) & mask]);
+		end_read(h);
+		return true;
+	}
+
+	// fifo : takes the oldest sample
+	bool pop(Data& popped_value)
+	{
+		size_t t, h;
+		if (!begin_read(t, h)) return false;
+		std::swap(popped_value, the_slots[t & mask]);
+		end_read(t + 1);
+		return true;
+	}
+
+	// waits until a sample is pending or timeout_ms passed (the thread sleeps), false on timeout
+	bool wait(const int timeout_ms)
+	{
+		if (!empty()) return true;
+		std::unique_lock<std::mutex> lock(wait_mutex);
+		waiting.store(true, std::memory_order_seq_cst);
+		const bool pending = wait_cv.wait_for(lock, std::chrono::milliseconds(timeout_ms), [&]() { return !empty(); });
+		waiting.store(false, std::memory_order_relaxed);
+		return pending;
+	}
+
+	// latest-wins with a bounded wait
+	bool wait_latest(Data& popped_value, const int timeout_ms)
+	{
+		return wait(timeout_ms) && pop_latest(popped_value);
+	}
+
+	// drain-all : calls func(const Data&) for every pending sample in push order
+	template<typename Func>
+	int pop_all(Func func)
+	{
+		size_t t, h;
+		if (!begin_read(t, h)) return 0;
+		for (size_t i = t; i != h; i++)
+			func(the_slots[i & mask]);
+		end_read(h);
+		return (int)(h - t);
+	}
+
+	bool empty() const
+	{
+		return (tail.load(std::memory_order_seq_cst) >> 1) == head.load(std::memory_order_seq_cst);
+	}
+
+	size_t size() const
+	{
+		return head.load(std::memory_order_acquire) - (tail.load(std::memory_order_acquire) >> 1);
+	}
+
+	size_t capacity() const { return the_slots.size(); }
+	size_t num_dropped() const { return dropped.load(std::memory_order_relaxed); }
+};
+
+#define MAX_TRK_RBS 16
+#define MAX_TRK_MKS 128
+#define MAX_RB_NAME 32
+
+// rigid body name <-> handle (index), interned once at startup by the tracker thread
+// every frame carries a copy (POD), so the handles stay valid across the exe/dll boundary
+struct rb_registry
+{
+	int num_rbs;
+	char names[MAX_TRK_RBS][MAX_RB_NAME];
+
+	rb_registry() { num_rbs = 0; memset(names, 0, sizeof(names)); }
+
+	int Find(const char* name) const
+	{
+		for (int i = 0; i < num_rbs; i++)
+			if (strncmp(names[i], name, MAX_RB_NAME) == 0) return i;
+		return -1;
+	}
+	int Find(const string& name) const { return Find(name.c_str()); }
+
+	// -1 (reported) when the name does not fit MAX_RB_NAME or the registry is full
+	int Register(const string& name)
+	{
+		if (name.length() >= MAX_RB_NAME)
+		{
+			cout << "rb_registry : rigid body name \"" << name << "\" is longer than " << MAX_RB_NAME - 1 << " characters" << endl;
+			return -1;
+		}
+		int handle = Find(name);
+		if (handle >= 0) return handle;
+		if (num_rbs >= MAX_TRK_RBS)
+		{
+			cout << "rb_registry : more than " << MAX_TRK_RBS << " rigid bodies, \"" << name << "\" is not registered" << endl;
+			return -1;
+		}
+		strcpy_s(names[num_rbs], MAX_RB_NAME, name.c_str());
+		return num_rbs++;
+	}
+
+	const char* Name(const int handle) const { return handle >= 0 && handle < num_rbs ? names[handle] : ""; }
+};
+
+// track_info serial buffer (recordings), the version changes with the layout
+#define TRK_SERIAL_MAGIC 0x4b52544b // 'KTRK'
+#define TRK_SERIAL_VERSION 2
+#define TRK_SERIAL_HEADER_SIZE 16 // magic, version, num_mks, num_lfrms
+#define TRK_SERIAL_MK_UNIT (sizeof(glm::fvec3) + sizeof(float) + 128 / 8) // xyz, residue, cid
+#define TRK_SERIAL_RB_UNIT (100 + sizeof(bool) + sizeof(glm::fmat4x4)) // name[100], is_detected, mat_lfrm2ws
+
+// fixed-capacity, trivially copyable frame (no heap), copied by value through the track ring and into g_info
+struct track_info
+{
+	//  "rs_cam" , "probe" , "ss_tool_v1" , "ss_head" , "breastbody" 
+	rb_registry rbs;
+	glm::fmat4x4 mat_lfrm2ws[MAX_TRK_RBS];
+	bool is_detected[MAX_TRK_RBS];
+
+	int num_mks;
+	glm::fvec3 mk_xyz[MAX_TRK_MKS];
+	float mk_residue[MAX_TRK_MKS];
+	std::bitset<128> mk_cid[MAX_TRK_MKS];
+
+	double time_stamp; // ms
 	bool is_updated;
-	track_info() { is_updated = false; }
+	track_info() { num_mks = 0; time_stamp = 0; is_updated = false; memset(is_detected, 0, sizeof(is_detected)); }
+
+	int GetHandle(const string& name) const { return rbs.Find(name); }
+
+	bool GetLFrmInfo(const int handle, glm::fmat4x4& mat_lfrm2ws) const
+	{
+		if (handle < 0 || handle >= rbs.num_rbs) return false;
+		mat_lfrm2ws = this->mat_lfrm2ws[handle];
+		return is_detected[handle];
+	}
+
+	// compatibility accessors for name-based callers
+	bool GetLFrmInfo(const char* name, glm::fmat4x4& mat_lfrm2ws) const
+	{
+		return GetLFrmInfo(rbs.Find(name), mat_lfrm2ws);
+	}
+	bool GetLFrmInfo(const string& name, glm::fmat4x4& mat_lfrm2ws) const
+	{
+		return GetLFrmInfo(rbs.Find(name), mat_lfrm2ws);
+	}
+
+	void SetLFrmInfo(const int handle, const bool is_detected, const glm::fmat4x4& mat_lfrm2ws)
+	{
+		if (handle < 0 || handle >= rbs.num_rbs) return;
+		this->is_detected[handle] = is_detected;
+		this->mat_lfrm2ws[handle] = mat_lfrm2ws;
+	}
+
+	void SetLFrmInfo(const string& name, const bool is_detected, const glm::fmat4x4& mat_lfrm2ws)
+	{
+		SetLFrmInfo(rbs.Register(name), is_detected, mat_lfrm2ws);
+	}
 
 	bool GetProbePinPoint(glm::fvec3& pos)
 	{
@@ -235,69 +453,120 @@ struct track_info
 
 	glm::fvec3 GetMkPos(int idx)
 	{
-		if (idx < 0 || idx >= mk_xyz_list.size() / 3) return glm::fvec3(0);
-		return ((glm::fvec3*)&mk_xyz_list[0])[idx];
+		if (idx < 0 || idx >= num_mks) return glm::fvec3(0);
+		return mk_xyz[idx];
+	}
+
+	// layout (version 2) : magic, version, num_mks, num_lfrms, xyz (3 floats) * num_mks, residue * num_mks, cid (16 bytes) * num_mks,
+	// { name[100], bool, fmat4x4 } * num_lfrms
+	// SetFromSerialBuffer also reads the buffers without the magic : the same layout from num_mks on (recorded before the header),
+	// and the layout of the former trkdata.bin records (first int : 3 x num_mks, xyz, residue and cid each sized by it)
+	size_t GetSerialSize() const
+	{
+		return TRK_SERIAL_HEADER_SIZE + TRK_SERIAL_MK_UNIT * num_mks + TRK_SERIAL_RB_UNIT * rbs.num_rbs;
 	}
 
 	char* GetSerialBuffer(size_t& bytes_size)
 	{
-		int num_mks = (int)mk_xyz_list.size();
-		int num_lfrms = (int)map_lfrm2ws.size();
-		bytes_size = (sizeof(glm::fmat4x4) + sizeof(bool) + sizeof(char) * 100) * num_lfrms + (sizeof(float) * 2 + (128 / 8)) * num_mks + 4 * 2; // last 4 * 2 means num_mks, num_lfrms
+		bytes_size = GetSerialSize();
 		char* buf = new char[bytes_size];
-		memset(buf, 0, bytes_size);
-		*(int*)&buf[0] = num_mks;
-		*(int*)&buf[4] = num_lfrms;
-
-		memcpy(&buf[8], &mk_xyz_list[0], sizeof(float) * num_mks);
-		memcpy(&buf[8 + sizeof(float) * num_mks], &mk_residue_list[0], sizeof(float) * num_mks);
-		memcpy(&buf[8 + sizeof(float) * num_mks * 2], &mk_cid_list[0], (128 / 8) * num_mks);
-
-		int offset = 8 + sizeof(float) * num_mks * 2 + (128 / 8) * num_mks;
-		int unit_size = sizeof(bool) + sizeof(glm::fmat4x4) + sizeof(char) * 100;
-		int i = 0;
-		for (auto it = map_lfrm2ws.begin(); it != map_lfrm2ws.end(); it++, i++)
-		{
-			memcpy(&buf[offset + unit_size * i], it->first.c_str(), sizeof(char) * it->first.length());
-			*(bool*)&buf[offset + unit_size * i + 100] = get<0>(it->second);
-			*(glm::fmat4x4*)&buf[offset + unit_size * i + 100 + sizeof(bool)] = get<1>(it->second);
-		}
-
+		WriteSerialBuffer(buf);
 		return buf;
 	}
 
-	void SetFromSerialBuffer(const char* buf)
+	// buf : GetSerialSize() bytes
+	void WriteSerialBuffer(char* buf) const
 	{
-		int num_mks = *(int*)buf[0];
-		int num_lfrms = *(int*)buf[4];
-		mk_xyz_list.assign(num_mks, 0);
-		mk_residue_list.assign(num_mks, 0);
-		mk_cid_list.assign(num_mks, 0);
+		int num_lfrms = rbs.num_rbs;
+		int offset = TRK_SERIAL_HEADER_SIZE + TRK_SERIAL_MK_UNIT * num_mks;
+		memset(buf, 0, offset + TRK_SERIAL_RB_UNIT * num_lfrms);
+		*(int*)&buf[0] = TRK_SERIAL_MAGIC;
+		*(int*)&buf[4] = TRK_SERIAL_VERSION;
+		*(int*)&buf[8] = num_mks;
+		*(int*)&buf[12] = num_lfrms;
+
+		char* mk_buf = &buf[TRK_SERIAL_HEADER_SIZE];
+		memcpy(mk_buf, mk_xyz, sizeof(glm::fvec3) * num_mks);
+		memcpy(&mk_buf[sizeof(glm::fvec3) * num_mks], mk_residue, sizeof(float) * num_mks);
+		memcpy(&mk_buf[(sizeof(glm::fvec3) + sizeof(float)) * num_mks], mk_cid, (128 / 8) * num_mks);
 
-		memcpy(&mk_xyz_list[0], &buf[8], sizeof(float) * num_mks);
-		memcpy(&mk_residue_list[0], &buf[8 + sizeof(float) * num_mks], sizeof(float) * num_mks);
-		memcpy(&mk_cid_list[0], &buf[8 + sizeof(float) * num_mks * 2], (128 / 8) * num_mks);
+		for (int i = 0; i < num_lfrms; i++)
+		{
+			memcpy(&buf[offset + TRK_SERIAL_RB_UNIT * i], rbs.names[i], MAX_RB_NAME);
+			*(bool*)&buf[offset + TRK_SERIAL_RB_UNIT * i + 100] = is_detected[i];
+			*(glm::fmat4x4*)&buf[offset + TRK_SERIAL_RB_UNIT * i + 100 + sizeof(bool)] = mat_lfrm2ws[i];
+		}
+	}
 
-		int offset = 8 + sizeof(float) * num_mks * 2 + (128 / 8) * num_mks;
-		int unit_size = sizeof(bool) + sizeof(glm::fmat4x4) + sizeof(char) * 100;
+	// bytes : size of the buffer, false (the frame is not changed) when the buffer matches none of the layouts
+	// or is of a newer version
+	bool SetFromSerialBuffer(const char* buf, const size_t bytes)
+	{
+		if (bytes < 8) return false;
+		int head[4] = {};
+		memcpy(head, buf, min(bytes, sizeof(head)));
+
+		int num_mks_buf, num_lfrms, num_xyz, num_per_list;
+		size_t offset;
+		if (head[0] == TRK_SERIAL_MAGIC)
+		{
+			if (bytes < TRK_SERIAL_HEADER_SIZE || head[1] != TRK_SERIAL_VERSION) return false;
+			num_mks_buf = head[2];
+			num_lfrms = head[3];
+			num_xyz = num_per_list = num_mks_buf;
+			offset = TRK_SERIAL_HEADER_SIZE;
+		}
+		else
+		{
+			num_lfrms = head[1];
+			offset = 8;
+			if (head[0] < 0 || num_lfrms < 0) return false;
+			if (bytes == 8 + TRK_SERIAL_MK_UNIT * (size_t)head[0] + TRK_SERIAL_RB_UNIT * (size_t)num_lfrms)
+			{
+				num_mks_buf = num_xyz = num_per_list = head[0];
+			}
+			else if (head[0] % 3 == 0 && bytes == 8 + (sizeof(float) * 2 + 128 / 8) * (size_t)head[0] + TRK_SERIAL_RB_UNIT * (size_t)num_lfrms)
+			{
+				// trkdata.bin : head[0] floats of xyz, then head[0] residues and cids of which the first head[0] / 3 are the markers
+				num_mks_buf = head[0] / 3;
+				num_xyz = num_mks_buf;
+				num_per_list = head[0];
+			}
+			else return false;
+		}
+		if (num_mks_buf < 0 || num_lfrms < 0 || num_lfrms > MAX_TRK_RBS
+			|| bytes < offset + sizeof(glm::fvec3) * num_xyz + (sizeof(float) + 128 / 8) * (size_t)num_per_list + TRK_SERIAL_RB_UNIT * (size_t)num_lfrms) return false;
+
+		num_mks = min(num_mks_buf, MAX_TRK_MKS);
+		memcpy(mk_xyz, &buf[offset], sizeof(glm::fvec3) * num_mks);
+		offset += sizeof(glm::fvec3) * num_xyz;
+		memcpy(mk_residue, &buf[offset], sizeof(float) * num_mks);
+		offset += sizeof(float) * num_per_list;
+		memcpy(mk_cid, &buf[offset], (128 / 8) * num_mks);
+		offset += (128 / 8) * num_per_list;
+
+		rbs = rb_registry();
+		memset(is_detected, 0, sizeof(is_detected));
 		for (int i = 0; i < num_lfrms; i++)
 		{
 			char arry[100];
-			memcpy(arry, &buf[offset + unit_size * i], sizeof(char) * 100);
+			memcpy(arry, &buf[offset + TRK_SERIAL_RB_UNIT * i], sizeof(char) * 100);
+			arry[99] = 0;
 			string name = arry;
-			bool is_detected = *(bool*)&buf[offset + unit_size * i + 100];
-			glm::fmat4x4 mat_lfrm2ws = *(glm::fmat4x4*)&buf[offset + unit_size * i + 100 + sizeof(bool)];
+			bool is_detected = *(bool*)&buf[offset + TRK_SERIAL_RB_UNIT * i + 100];
+			glm::fmat4x4 mat_lfrm2ws = *(glm::fmat4x4*)&buf[offset + TRK_SERIAL_RB_UNIT * i + 100 + sizeof(bool)];
 			SetLFrmInfo(name, is_detected, mat_lfrm2ws);
 		}
+		return true;
 	}
 
 	bool CheckExistCID(const std::bitset<128>& cid, int* mk_idx = NULL)
 	{
 		bool exist_mk_cid = false;
 		if (mk_idx) *mk_idx = -1;
-		for (int i = 0; i < (int)mk_cid_list.size(); i++)
+		for (int i = 0; i < num_mks; i++)
 		{
-			if (mk_cid_list[i] == cid)
+			if (mk_cid[i] == cid)
 			{
 				exist_mk_cid = true;
 				if (mk_idx) *mk_idx = i;
@@ -309,6 +578,752 @@ struct track_info
 	}
 };
 
+// monotonic host clock (ms) shared by tracker samples and camera frame capture times
+double GetMonotonicTimeMs()
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// maps a device clock (ms) into the GetMonotonicTimeMs() domain
+// offset : the smallest (host arrival - device time) over the frames, the transport latency only adds to a sample so the smallest
+// one is the closest to the capture; it creeps up by drift_ppm of the elapsed host time to follow the drift of the device clock,
+// and is reset when a sample is off by more than reset_ms (device restart, clock jump)
+struct clock_offset_estimator
+{
+	double offset;
+	double t_last_arrival;
+	bool has_offset;
+	double drift_ppm;
+	double reset_ms;
+
+	clock_offset_estimator(const double _drift_ppm = 100.0, const double _reset_ms = 1000.0)
+	{
+		drift_ppm = _drift_ppm;
+		reset_ms = _reset_ms;
+		Reset();
+	}
+
+	void Reset()
+	{
+		offset = t_last_arrival = 0;
+		has_offset = false;
+	}
+
+	// t_device : device time of the frame, t_arrival : host time (GetMonotonicTimeMs() domain) it arrived at, returns the host time of t_device
+	double Map(const double t_device, const double t_arrival)
+	{
+		const double sample = t_arrival - t_device;
+		if (!has_offset || fabs(sample - offset) > reset_ms)
+		{
+			offset = sample;
+			has_offset = true;
+		}
+		else
+		{
+			offset += max(t_arrival - t_last_arrival, 0.0) * drift_ppm * 1e-6;
+			offset = min(offset, sample);
+		}
+		t_last_arrival = t_arrival;
+		return t_device + offset;
+	}
+};
+
+// throughput and capture-to-display latency of the main loop frames, reduced over windows of window_ms
+struct frame_latency_stats
+{
+	double window_ms;
+	double t_window;
+	int frames;
+	double sum_ms, max_ms;
+
+	// last complete window
+	float fps, mean_ms, peak_ms;
+
+	frame_latency_stats(const double _window_ms = 1000.0)
+	{
+		window_ms = _window_ms;
+		t_window = 0;
+		frames = 0;
+		sum_ms = max_ms = 0;
+		fps = mean_ms = peak_ms = 0;
+	}
+
+	// t_capture, t_done : GetMonotonicTimeMs() domain, true when a window is complete
+	bool Add(const double t_capture, const double t_done)
+	{
+		if (t_window == 0) t_window = t_done;
+		const double latency = t_done - t_capture;
+		frames++;
+		sum_ms += latency;
+		max_ms = max(max_ms, latency);
+		if (t_done - t_window < window_ms) return false;
+
+		fps = (float)(frames * 1000.0 / (t_done - t_window));
+		mean_ms = (float)(sum_ms / frames);
+		peak_ms = (float)max_ms;
+		t_window = t_done;
+		frames = 0;
+		sum_ms = max_ms = 0;
+		return true;
+	}
+};
+
+// per rigid body history of timestamped poses, indexed by the handles of the pushed frames
+// the pose at time t is interpolated (lerp + SLERP) between the bracketing samples,
+// and extrapolated with constant velocity up to max_extrapolation_ms past the newest sample
+#define POSE_HISTORY_SIZE 64
+struct pose_history
+{
+	struct pose_sample
+	{
+		double t;
+		glm::fvec3 pos;
+		glm::fquat q;
+		bool is_detected;
+	};
+
+	rb_registry rbs; // layout of the pushed frames
+	pose_sample samples[MAX_TRK_RBS][POSE_HISTORY_SIZE];
+	int num_samples[MAX_TRK_RBS];
+	int newest[MAX_TRK_RBS];
+	double max_extrapolation_ms;
+	double max_gap_ms; // samples farther apart than this are not blended
+
+	pose_history() { max_extrapolation_ms = 20.0; max_gap_ms = 50.0; Clear(); }
+
+	void Clear()
+	{
+		rbs = rb_registry();
+		memset(num_samples, 0, sizeof(num_samples));
+		memset(newest, 0, sizeof(newest));
+	}
+
+	void Push(const track_info& trk_info)
+	{
+		if (trk_info.time_stamp <= 0) return;
+		if (memcmp(&rbs, &trk_info.rbs, sizeof(rb_registry)) != 0)
+		{
+			Clear();
+			rbs = trk_info.rbs;
+		}
+
+		for (int i = 0; i < rbs.num_rbs; i++)
+		{
+			if (num_samples[i] > 0 && trk_info.time_stamp <= samples[i][newest[i]].t) continue;
+			int idx = num_samples[i] == 0 ? 0 : (newest[i] + 1) % POSE_HISTORY_SIZE;
+			pose_sample& s = samples[i][idx];
+			const glm::fmat4x4& mat = trk_info.mat_lfrm2ws[i];
+			s.t = trk_info.time_stamp;
+			s.pos = glm::fvec3(mat[3]);
+			s.q = glm::normalize(glm::quat_cast(glm::fmat3x3(mat)));
+			s.is_detected = trk_info.is_detected[i];
+			newest[i] = idx;
+			num_samples[i] = min(num_samples[i] + 1, POSE_HISTORY_SIZE);
+		}
+	}
+
+	// false when the rigid body is not detected around t (the caller keeps its latest pose)
+	bool Query(const int handle, const double t, glm::fmat4x4& mat_lfrm2ws) const
+	{
+		if (handle < 0 || handle >= rbs.num_rbs || num_samples[handle] == 0) return false;
+		const pose_sample* hist = samples[handle];
+		auto at = [&](int k) -> const pose_sample& { return hist[(newest[handle] - k + POSE_HISTORY_SIZE) % POSE_HISTORY_SIZE]; }; // k-th newest
+
+		glm::fvec3 pos;
+		glm::fquat q;
+		const pose_sample& s0 = at(0);
+		if (t >= s0.t)
+		{
+			if (!s0.is_detected) return false;
+			pos = s0.pos;
+			q = s0.q;
+			if (num_samples[handle] > 1)
+			{
+				const pose_sample& s1 = at(1);
+				double dt01 = s0.t - s1.t;
+				if (s1.is_detected && dt01 > 0 && dt01 < max_gap_ms)
+				{
+					float r = (float)(min(t - s0.t, max_extrapolation_ms) / dt01);
+					pos += (s0.pos - s1.pos) * r;
+					glm::fquat dq = s0.q * glm::inverse(s1.q);
+					if (dq.w < 0) dq = -dq;
+					float angle = glm::angle(dq);
+					if (angle > 1e-6f)
+						q = glm::normalize(glm::angleAxis(angle * r, glm::axis(dq)) * s0.q);
+				}
+			}
+		}
+		else
+		{
+			int k = 1;
+			while (k < num_samples[handle] && at(k).t > t) k++;
+			if (k == num_samples[handle])
+			{
+				// older than the history, use the oldest sample
+				const pose_sample& so = at(k - 1);
+				if (!so.is_detected) return false;
+				pos = so.pos;
+				q = so.q;
+			}
+			else
+			{
+				const pose_sample& sa = at(k);		// sa.t <= t
+				const pose_sample& sb = at(k - 1);	// t < sb.t
+				float a = (float)((t - sa.t) / (sb.t - sa.t));
+				if (sa.is_detected && sb.is_detected && sb.t - sa.t < max_gap_ms)
+				{
+					pos = glm::mix(sa.pos, sb.pos, a);
+					q = glm::slerp(sa.q, sb.q, a);
+				}
+				else
+				{
+					const pose_sample& sn = a < 0.5f ? sa : sb;
+					if (!sn.is_detected) return false;
+					pos = sn.pos;
+					q = sn.q;
+				}
+			}
+		}
+
+		mat_lfrm2ws = glm::translate(pos) * glm::toMat4(q);
+		return true;
+	}
+};
+
+// persistent marker spheres : one unit sphere object (instance) per marker slot, generated once and moved by its os2ws
+// only the markers that moved more than move_threshold (or changed slot) have their instance state set again,
+// the slots beyond the marker count are hidden (kept for the next frames)
+// picking runs on the cpu against the kept positions (ray walk through a small uniform grid), no pick object per marker
+#define MKVIS_SET_CHANGED 0x1
+#define MKVIS_MOVED 0x2
+struct marker_vis_pool
+{
+	float radius;
+	float move_threshold;
+	glm::fvec3 color;
+	int color_grid; // > 0 : color by the marker index (color_grid x color_grid ramp) instead of color
+
+	int num_mks;
+	glm::fvec3 pos[MAX_TRK_MKS]; // as shown
+	std::bitset<128> cid[MAX_TRK_MKS];
+	bool is_moved[MAX_TRK_MKS]; // the instance state is set at the next Show
+
+	vector<int> instance_ids; // engine object per slot, grows up to the largest marker count
+	int num_shown; // slots shown by the last Show
+	int shown_mask, shown_scene_id; // scenes of the last Show (0, 0 : hidden)
+
+	// pick index, rebuilt at the first pick after a change
+	bool has_index;
+	glm::fvec3 grid_min;
+	float cell;
+	int dims[3];
+	vector<int> cell_start, cell_items;
+
+	marker_vis_pool(const float _radius = 0.005f, const glm::fvec3& _color = glm::fvec3(1, 1, 0), const int _color_grid = 0)
+	{
+		radius = _radius;
+		move_threshold = 0.0005f;
+		color = _color;
+		color_grid = _color_grid;
+		num_shown = 0;
+		shown_mask = shown_scene_id = 0;
+		Clear();
+	}
+
+	void Clear()
+	{
+		num_mks = 0;
+		has_index = false;
+	}
+
+	glm::fvec3 GetColor(const int idx) const
+	{
+		if (color_grid <= 0) return color;
+		return glm::fvec3(1, (idx % max(color_grid, 1)) / (float)max(color_grid - 1, 1), (idx / max(color_grid, 1)) / (float)max(color_grid - 1, 1));
+	}
+
+	// pick id of a marker (vzmobjid2pos key), 0 is no pick
+	static int GetPickId(const int mk_idx) { return mk_idx + 1; }
+
+	// MKVIS_SET_CHANGED and / or MKVIS_MOVED, 0 : no instance to move
+	int Update(const track_info& trk_info)
+	{
+		const int n = trk_info.num_mks;
+		bool set_changed = n != num_mks;
+		for (int i = 0; i < n && !set_changed; i++)
+			set_changed = cid[i] != trk_info.mk_cid[i];
+
+		int changes = 0;
+		if (set_changed)
+		{
+			num_mks = n;
+			for (int i = 0; i < n; i++)
+			{
+				pos[i] = trk_info.mk_xyz[i];
+				cid[i] = trk_info.mk_cid[i];
+				is_moved[i] = true;
+			}
+			changes = MKVIS_SET_CHANGED;
+		}
+		else
+		{
+			const float th2 = move_threshold * move_threshold;
+			for (int i = 0; i < n; i++)
+			{
+				glm::fvec3 d = trk_info.mk_xyz[i] - pos[i];
+				if (glm::dot(d, d) <= th2) continue;
+				pos[i] = trk_info.mk_xyz[i];
+				is_moved[i] = true;
+				changes |= MKVIS_MOVED;
+			}
+		}
+		if (changes) has_index = false;
+		return changes;
+	}
+
+	// scene_mask : scene_mirror slots (MS_WS, ...), 0 : the scene scene_id
+	static void SetInstanceState(const int scene_mask, const int scene_id, const int obj_id, const vzm::ObjStates& obj_state)
+	{
+		if (scene_mask != 0) scene_mirror::SetStates(scene_mask, obj_id, obj_state);
+		else scene_mirror::SetState(scene_id, obj_id, obj_state);
+	}
+
+	// shows the markers in the scenes (see SetInstanceState) with base_state (its os2ws is replaced by the marker position)
+	// generates the missing instances, sets the state of the moved ones (all of them when the scenes changed) and hides the unused slots
+	// returns the number of instance states set
+	int Show(const int scene_mask, const int scene_id, const vzm::ObjStates& base_state)
+	{
+		if (shown_mask != scene_mask || shown_scene_id != scene_id) Hide();
+		const bool show_all = num_shown == 0;
+		int num_states = 0;
+		vzm::ObjStates cstate = base_state;
+		cstate.is_visible = true;
+		for (int i = 0; i < num_mks; i++)
+		{
+			if ((int)instance_ids.size() <= i)
+			{
+				const glm::fvec4 xyzr(0, 0, 0, radius);
+				const glm::fvec3 rgb = GetColor(i);
+				int obj_id = 0;
+				vzm::GenerateSpheresObject(__FP xyzr, __FP rgb, 1, obj_id);
+				instance_ids.push_back(obj_id);
+				is_moved[i] = true;
+			}
+			if (!is_moved[i] && !show_all && i < num_shown) continue;
+			__cm4__ cstate.os2ws = glm::translate(pos[i]);
+			SetInstanceState(scene_mask, scene_id, instance_ids[i], cstate);
+			is_moved[i] = false;
+			num_states++;
+		}
+		cstate.is_visible = false;
+		for (int i = num_mks; i < num_shown; i++, num_states++)
+			SetInstanceState(scene_mask, scene_id, instance_ids[i], cstate);
+		num_shown = num_mks;
+		shown_mask = scene_mask;
+		shown_scene_id = scene_id;
+		return num_states;
+	}
+
+	// hides the shown instances, the next Show sets every instance state
+	void Hide()
+	{
+		vzm::ObjStates cstate;
+		cstate.is_visible = false;
+		for (int i = 0; i < num_shown; i++)
+			SetInstanceState(shown_mask, shown_scene_id, instance_ids[i], cstate);
+		num_shown = 0;
+		shown_mask = shown_scene_id = 0;
+	}
+
+	void BuildIndex(const float pick_radius)
+	{
+		has_index = true;
+		cell_start.clear();
+		cell_items.clear();
+		if (num_mks == 0) return;
+
+		glm::fvec3 pos_max = pos[0];
+		grid_min = pos[0];
+		for (int i = 1; i < num_mks; i++)
+			for (int k = 0; k < 3; k++)
+			{
+				grid_min[k] = min(grid_min[k], pos[i][k]);
+				pos_max[k] = max(pos_max[k], pos[i][k]);
+			}
+		grid_min -= glm::fvec3(pick_radius);
+		pos_max += glm::fvec3(pick_radius);
+		const glm::fvec3 extent = pos_max - grid_min;
+		// a sphere overlaps at most 2 x 2 x 2 cells, at most 16 cells along an axis
+		cell = max(pick_radius * 2.f, max(extent.x, max(extent.y, extent.z)) / 16.f);
+		for (int k = 0; k < 3; k++)
+			dims[k] = max((int)ceil(extent[k] / cell), 1);
+
+		// CSR of the marker indices per cell (a marker is listed in every cell its pick sphere overlaps)
+		auto cell_range = [&](const int i, glm::ivec3& c0, glm::ivec3& c1)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				c0[k] = min(max((int)floor((pos[i][k] - pick_radius - grid_min[k]) / cell), 0), dims[k] - 1);
+				c1[k] = min(max((int)floor((pos[i][k] + pick_radius - grid_min[k]) / cell), 0), dims[k] - 1);
+			}
+		};
+		cell_start.assign(dims[0] * dims[1] * dims[2] + 1, 0);
+		for (int pass = 0; pass < 2; pass++)
+		{
+			vector<int> cell_fill;
+			if (pass == 1)
+			{
+				for (int c = 1; c < (int)cell_start.size(); c++) cell_start[c] += cell_start[c - 1];
+				cell_items.resize(cell_start.back());
+				cell_fill.assign(cell_start.begin(), cell_start.end() - 1);
+			}
+			for (int i = 0; i < num_mks; i++)
+			{
+				glm::ivec3 c0, c1;
+				cell_range(i, c0, c1);
+				for (int z = c0.z; z <= c1.z; z++)
+					for (int y = c0.y; y <= c1.y; y++)
+						for (int x = c0.x; x <= c1.x; x++)
+						{
+							const int c = x + dims[0] * (y + dims[1] * z);
+							if (pass == 0) cell_start[c + 1]++;
+							else cell_items[cell_fill[c]++] = i;
+						}
+			}
+		}
+	}
+
+	// nearest marker along the ray (dir normalized) within pick_radius, -1 : none
+	int PickRay(const glm::fvec3& origin, const glm::fvec3& dir, const float pick_radius)
+	{
+		if (!has_index) BuildIndex(pick_radius);
+		if (num_mks == 0) return -1;
+
+		// clip the ray to the grid
+		const glm::fvec3 grid_max = grid_min + glm::fvec3(dims[0], dims[1], dims[2]) * cell;
+		float t0 = 0, t1 = FLT_MAX;
+		for (int k = 0; k < 3; k++)
+		{
+			if (fabs(dir[k]) < 1e-12f)
+			{
+				if (origin[k] < grid_min[k] || origin[k] > grid_max[k]) return -1;
+				continue;
+			}
+			float ta = (grid_min[k] - origin[k]) / dir[k], tb = (grid_max[k] - origin[k]) / dir[k];
+			if (ta > tb) std::swap(ta, tb);
+			t0 = max(t0, ta);
+			t1 = min(t1, tb);
+		}
+		if (t0 > t1) return -1;
+
+		// cell walk (Amanatides & Woo)
+		glm::ivec3 c, step;
+		glm::fvec3 t_max, t_delta;
+		const glm::fvec3 p0 = origin + dir * t0;
+		for (int k = 0; k < 3; k++)
+		{
+			c[k] = min(max((int)floor((p0[k] - grid_min[k]) / cell), 0), dims[k] - 1);
+			step[k] = dir[k] > 0 ? 1 : -1;
+			if (fabs(dir[k]) < 1e-12f)
+			{
+				t_max[k] = t_delta[k] = FLT_MAX;
+				continue;
+			}
+			const float boundary = grid_min[k] + (c[k] + (dir[k] > 0 ? 1 : 0)) * cell;
+			t_max[k] = (boundary - origin[k]) / dir[k];
+			t_delta[k] = cell / fabs(dir[k]);
+		}
+
+		int best_mk = -1;
+		float best_t = FLT_MAX;
+		const float r2 = pick_radius * pick_radius;
+		while (true)
+		{
+			const int cell_idx = c.x + dims[0] * (c.y + dims[1] * c.z);
+			for (int k = cell_start[cell_idx]; k < cell_start[cell_idx + 1]; k++)
+			{
+				const int i = cell_items[k];
+				const glm::fvec3 oc = pos[i] - origin;
+				const float tc = glm::dot(oc, dir);
+				const float d2 = glm::dot(oc, oc) - tc * tc;
+				if (d2 > r2) continue;
+				const float t_hit = max(tc - sqrt(r2 - d2), 0.f);
+				if (tc + sqrt(r2 - d2) < 0 || t_hit >= best_t) continue;
+				best_t = t_hit;
+				best_mk = i;
+			}
+			const int axis = t_max.x < t_max.y ? (t_max.x < t_max.z ? 0 : 2) : (t_max.y < t_max.z ? 1 : 2);
+			// the hits of the next cells are farther than the exit of this one
+			if (best_t <= t_max[axis] || t_max[axis] > t1) break;
+			c[axis] += step[axis];
+			if (c[axis] < 0 || c[axis] >= dims[axis]) break;
+			t_max[axis] += t_delta[axis];
+		}
+		return best_mk;
+	}
+
+	// marker under the pixel (x, y) of the view (scene_id, cam_id), -1 : none
+	// the pick sphere is the rendered one with a margin (the former picking searched a 20 x 20 pixel window)
+	int Pick(const int x, const int y, const int scene_id, const int cam_id)
+	{
+		glm::fmat4x4 mat_ws2ss, mat_ss2ws;
+		vzm::CameraParameters cam_params;
+		if (!vzm::GetCamProjMatrix(scene_id, cam_id, __FP mat_ws2ss, __FP mat_ss2ws) || !vzm::GetCameraParameters(scene_id, cam_params, cam_id)) return -1;
+		glm::fvec3 p_a = tr_pt(mat_ss2ws, glm::fvec3(x, y, 0));
+		glm::fvec3 p_b = tr_pt(mat_ss2ws, glm::fvec3(x, y, 1));
+		const glm::fvec3 pos_cam = __cv3__ cam_params.pos;
+		if (glm::length(p_b - pos_cam) < glm::length(p_a - pos_cam)) std::swap(p_a, p_b); // p_a : near side
+		glm::fvec3 dir = p_b - p_a;
+		if (glm::length(dir) < 1e-12f) return -1;
+		return PickRay(p_a, glm::normalize(dir), radius * 1.5f);
+	}
+};
+
+// vzmproc::GenerateSamplePoints samples the source object in its object space : returns the world pick pos_pick_ws in that space,
+// and sampled_state takes the os2ws of the source so the samples land where they were picked in the world
+glm::fvec3 SetSampledPointsFrame(const vzm::ObjStates& src_state, const glm::fvec3& pos_pick_ws, vzm::ObjStates& sampled_state)
+{
+	const glm::fmat4x4 mat_os2ws = __cm4__ src_state.os2ws;
+	__cm4__ sampled_state.os2ws = mat_os2ws;
+	return tr_pt(glm::inverse(mat_os2ws), pos_pick_ws);
+}
+
+void Axis_Gen(const glm::fmat4x4& mat_frame2ws, const float axis_line_leng, int& axis_obj_id);
+
+// per-frame primitives (probe, guides, annotations) whose geometry is built once in a local frame and moved by ObjStates::os2ws
+// an object is rebuilt only when its shape (radius, color, text, ...) changes, each function returns the os2ws of the object
+// cylinders and lines are unit long along z (scaled by os2ws), texts face -z with +y up
+struct primitive_cache
+{
+	enum prim_type { PRIM_CYLINDER, PRIM_SPHERE, PRIM_LINE, PRIM_ARROW, PRIM_AXIS, PRIM_FAN, PRIM_TEXT };
+
+	long long num_requests; // geometry requests (one engine build each without the cache)
+	long long num_builds; // engine geometry builds
+	long long num_frames; // counted by the renderer (RenderAndShowWindows)
+
+	// builds the geometry of obj_id (a new id when 0) instead of vzm, for the checks without an engine
+	typedef std::function<void(const prim_type type, int& obj_id)> builder;
+
+private:
+	struct prim_entry
+	{
+		prim_type type;
+		glm::fvec4 shape; // shape parameters of the built geometry
+		std::string text;
+		glm::fmat4x4 mat_os2ws;
+	};
+	std::map<int, prim_entry> prims; // key : obj_id
+	builder build_func;
+
+	// false : the caller builds with vzm
+	bool BuildByHook(const prim_type type, int& obj_id)
+	{
+		if (!build_func) return false;
+		build_func(type, obj_id);
+		return true;
+	}
+
+	// rel_tol_w : relative tolerance of shape.w, true when obj_id has to be (re)built
+	bool IsStale(const int obj_id, const prim_type type, const glm::fvec4& shape, const std::string& text, const float rel_tol_w = 0)
+	{
+		num_requests++;
+		if (obj_id == 0) return true;
+		auto it = prims.find(obj_id);
+		if (it == prims.end()) return true;
+		const prim_entry& entry = it->second;
+		return entry.type != type || entry.text != text || glm::fvec3(entry.shape) != glm::fvec3(shape)
+			|| fabs(shape.w - entry.shape.w) > rel_tol_w * fabs(entry.shape.w);
+	}
+
+	void SetBuilt(const int obj_id, const prim_type type, const glm::fvec4& shape, const std::string& text)
+	{
+		num_builds++;
+		prim_entry& entry = prims[obj_id];
+		entry.type = type;
+		entry.shape = shape;
+		entry.text = text;
+	}
+
+	const glm::fmat4x4& SetOs2Ws(const int obj_id, const glm::fmat4x4& mat_os2ws)
+	{
+		return prims[obj_id].mat_os2ws = mat_os2ws;
+	}
+
+	// frame at pos whose z axis is vec_z (not normalized, the length scales the local z)
+	static glm::fmat4x4 FrameZ(const glm::fvec3& pos, const glm::fvec3& vec_z)
+	{
+		float leng = glm::length(vec_z);
+		glm::fvec3 dir_z = leng > 1e-6f ? vec_z / leng : glm::fvec3(0, 0, 1);
+		if (leng < 1e-6f) leng = 1e-6f; // keeps os2ws invertible
+		glm::fvec3 dir_x = glm::normalize(glm::cross(fabs(dir_z.y) < 0.9f ? glm::fvec3(0, 1, 0) : glm::fvec3(1, 0, 0), dir_z));
+		glm::fvec3 dir_y = glm::cross(dir_z, dir_x);
+		glm::fmat4x4 mat_frm2ws(1.f);
+		mat_frm2ws[0] = glm::fvec4(dir_x, 0);
+		mat_frm2ws[1] = glm::fvec4(dir_y, 0);
+		mat_frm2ws[2] = glm::fvec4(dir_z * leng, 0);
+		mat_frm2ws[3] = glm::fvec4(pos, 1);
+		return mat_frm2ws;
+	}
+
+	static glm::fvec4 ColorKey(const float r, const glm::fvec3* rgb)
+	{
+		return rgb ? glm::fvec4(*rgb, r) : glm::fvec4(-1, -1, -1, r);
+	}
+
+public:
+	primitive_cache()
+	{
+		num_requests = num_builds = num_frames = 0;
+	}
+
+	void SetBuilder(const builder& func) { build_func = func; }
+
+	// per frame since the last reset
+	void GetStats(double& requests_per_frame, double& builds_per_frame, const bool reset)
+	{
+		requests_per_frame = num_frames > 0 ? (double)num_requests / (double)num_frames : 0;
+		builds_per_frame = num_frames > 0 ? (double)num_builds / (double)num_frames : 0;
+		if (reset) num_requests = num_builds = num_frames = 0;
+	}
+
+	// rgb NULL : the color of the object state
+	glm::fmat4x4 Cylinder(const glm::fvec3& p0, const glm::fvec3& p1, const float r, const glm::fvec3* rgb, int& obj_id)
+	{
+		const glm::fvec4 shape = ColorKey(r, rgb);
+		if (IsStale(obj_id, PRIM_CYLINDER, shape, ""))
+		{
+			glm::fvec3 cyl_p01[2] = { glm::fvec3(0), glm::fvec3(0, 0, 1) };
+			if (!BuildByHook(PRIM_CYLINDER, obj_id)) vzm::GenerateCylindersObject(__FP cyl_p01[0], &r, rgb ? __FP *rgb : NULL, 1, obj_id);
+			SetBuilt(obj_id, PRIM_CYLINDER, shape, "");
+		}
+		return SetOs2Ws(obj_id, FrameZ(p0, p1 - p0));
+	}
+
+	glm::fmat4x4 Sphere(const glm::fvec3& pos, const float r, const glm::fvec3* rgb, int& obj_id)
+	{
+		const glm::fvec4 shape = ColorKey(r, rgb);
+		if (IsStale(obj_id, PRIM_SPHERE, shape, ""))
+		{
+			glm::fvec4 sphere_xyzr(0, 0, 0, r);
+			if (!BuildByHook(PRIM_SPHERE, obj_id)) vzm::GenerateSpheresObject(__FP sphere_xyzr, rgb ? __FP *rgb : NULL, 1, obj_id);
+			SetBuilt(obj_id, PRIM_SPHERE, shape, "");
+		}
+		return SetOs2Ws(obj_id, glm::translate(pos));
+	}
+
+	glm::fmat4x4 Line(const glm::fvec3& p0, const glm::fvec3& p1, const glm::fvec3* rgb, int& obj_id)
+	{
+		const glm::fvec4 shape = ColorKey(0, rgb);
+		if (IsStale(obj_id, PRIM_LINE, shape, ""))
+		{
+			glm::fvec3 line_p01[2] = { glm::fvec3(0), glm::fvec3(0, 0, 1) };
+			glm::fvec3 line_rgb01[2] = { rgb ? *rgb : glm::fvec3(1), rgb ? *rgb : glm::fvec3(1) };
+			if (!BuildByHook(PRIM_LINE, obj_id)) vzm::GenerateLinesObject(__FP line_p01[0], rgb ? __FP line_rgb01[0] : NULL, 1, obj_id);
+			SetBuilt(obj_id, PRIM_LINE, shape, "");
+		}
+		return SetOs2Ws(obj_id, FrameZ(p0, p1 - p0));
+	}
+
+	// the arrow is stretched along z while its length stays within 5% of the built one (the head scales with it)
+	glm::fmat4x4 Arrow(const glm::fvec3& p0, const glm::fvec3& p1, const float r_body, const float r_head, int& obj_id)
+	{
+		float leng = glm::length(p1 - p0);
+		if (leng < 1e-6f) leng = 1e-6f;
+		const glm::fvec4 shape(r_body, r_head, 0, leng);
+		if (IsStale(obj_id, PRIM_ARROW, shape, "", 0.05f))
+		{
+			glm::fvec3 pos_s(0), pos_e(0, 0, leng);
+			if (!BuildByHook(PRIM_ARROW, obj_id)) vzm::GenerateArrowObject(__FP pos_s, __FP pos_e, r_body, r_head, obj_id);
+			SetBuilt(obj_id, PRIM_ARROW, shape, "");
+		}
+		return SetOs2Ws(obj_id, FrameZ(p0, (p1 - p0) / prims[obj_id].shape.w));
+	}
+
+	// RGB axes of Axis_Gen
+	glm::fmat4x4 Axis(const glm::fmat4x4& mat_frame2ws, const float axis_line_leng, int& obj_id)
+	{
+		const glm::fvec4 shape(axis_line_leng, 0, 0, 0);
+		if (IsStale(obj_id, PRIM_AXIS, shape, ""))
+		{
+			if (!BuildByHook(PRIM_AXIS, obj_id)) Axis_Gen(glm::fmat4x4(1.f), axis_line_leng, obj_id);
+			SetBuilt(obj_id, PRIM_AXIS, shape, "");
+		}
+		glm::fmat4x4 mat_os2ws(1.f);
+		for (int i = 0; i < 3; i++) mat_os2ws[i] = glm::fvec4(glm::normalize(glm::fvec3(mat_frame2ws[i])), 0);
+		mat_os2ws[3] = mat_frame2ws[3];
+		return SetOs2Ws(obj_id, mat_os2ws);
+	}
+
+	// triangle fan from dir_from by angle_deg (quantized to 0.5 deg) around vec_axis, colored blue to red
+	glm::fmat4x4 AngleFan(const glm::fvec3& pos, const glm::fvec3& dir_from, const glm::fvec3& vec_axis, const float angle_deg, const float leng, int& obj_id)
+	{
+		const int num_angle_tris = 10;
+		const glm::fvec4 shape(std::round(angle_deg * 2.f) * 0.5f, leng, 0, 0);
+		if (IsStale(obj_id, PRIM_FAN, shape, ""))
+		{
+			std::vector<glm::fvec3> fan_pos(num_angle_tris + 2), fan_clr(num_angle_tris + 2);
+			std::vector<unsigned int> idx_prims(num_angle_tris * 3);
+			fan_pos[0] = glm::fvec3(0);
+			fan_clr[0] = glm::fvec3(1);
+			for (int i = 0; i < num_angle_tris + 1; i++)
+			{
+				const float angle = glm::radians(shape.x) / (float)num_angle_tris * (float)i;
+				fan_pos[1 + i] = glm::fvec3(cos(angle), sin(angle), 0) * leng;
+				fan_clr[1 + i] = glm::fvec3((float)i / (float)num_angle_tris, 0, 1.f - (float)i / (float)num_angle_tris);
+				if (i < num_angle_tris)
+				{
+					idx_prims[3 * i + 0] = 0;
+					idx_prims[3 * i + 1] = i + 1;
+					idx_prims[3 * i + 2] = i + 2;
+				}
+			}
+			if (!BuildByHook(PRIM_FAN, obj_id)) vzm::GeneratePrimitiveObject(__FP fan_pos[0], NULL, __FP fan_clr[0], NULL, num_angle_tris + 2, &idx_prims[0], num_angle_tris, 3, obj_id);
+			SetBuilt(obj_id, PRIM_FAN, shape, "");
+		}
+		// local x : dir_from, local z : vec_axis (glm::rotate around vec_axis turns x toward y)
+		const glm::fvec3 dir_x = glm::normalize(dir_from), dir_z = glm::normalize(vec_axis);
+		glm::fmat4x4 mat_os2ws(1.f);
+		mat_os2ws[0] = glm::fvec4(dir_x, 0);
+		mat_os2ws[1] = glm::fvec4(glm::cross(dir_z, dir_x), 0);
+		mat_os2ws[2] = glm::fvec4(dir_z, 0);
+		mat_os2ws[3] = glm::fvec4(pos, 1);
+		return SetOs2Ws(obj_id, mat_os2ws);
+	}
+
+	// same as vzm::GenerateTextObject, rebuilt only when the text (the displayed value) or the font changes
+	glm::fmat4x4 Text(const glm::fvec3& pos_lt, const glm::fvec3& view, const glm::fvec3& up, const std::string& text, const float font_height, int& obj_id)
+	{
+		const glm::fvec4 shape(font_height, 0, 0, 0);
+		if (IsStale(obj_id, PRIM_TEXT, shape, text))
+		{
+			glm::fvec3 xyz_LT_view_up[3] = { glm::fvec3(0), glm::fvec3(0, 0, -1), glm::fvec3(0, 1, 0) };
+			if (!BuildByHook(PRIM_TEXT, obj_id)) vzm::GenerateTextObject(__FP xyz_LT_view_up[0], text, font_height, true, false, obj_id);
+			SetBuilt(obj_id, PRIM_TEXT, shape, text);
+		}
+		const glm::fvec3 dir_v = glm::normalize(view);
+		const glm::fvec3 dir_u = glm::normalize(up - glm::dot(up, dir_v) * dir_v);
+		glm::fmat4x4 mat_os2ws(1.f);
+		mat_os2ws[0] = glm::fvec4(glm::cross(dir_v, dir_u), 0);
+		mat_os2ws[1] = glm::fvec4(dir_u, 0);
+		mat_os2ws[2] = glm::fvec4(-dir_v, 0);
+		mat_os2ws[3] = glm::fvec4(pos_lt, 1);
+		return SetOs2Ws(obj_id, mat_os2ws);
+	}
+
+	// the last os2ws returned for obj_id (identity if unknown)
+	glm::fmat4x4 GetOs2Ws(const int obj_id) const
+	{
+		auto it = prims.find(obj_id);
+		return it != prims.end() ? it->second.mat_os2ws : glm::fmat4x4(1.f);
+	}
+
+	// the objects are gone (e.g., the scenes are deinitialized)
+	void Clear()
+	{
+		prims.clear();
+	}
+};
+
 struct OpttrkData
 {
 	track_info trk_info; // available when USE_OPTITRACK
@@ -320,7 +1335,7 @@ struct OpttrkData
 	vector<pair<Point2f, Point3f>> stg_calib_pt_pairs_2;
 	bitset<128> stg_calib_mk_cid;
 	vector<int> calib_trial_rs_cam_frame_ids; // deprecated!!
-	vector<int> mk_pickable_sphere_ids;
+	marker_vis_pool mk_pickable_pool; // pickable markers (STG calibration)
 
 	map<string, vector<Point3f>> custom_pos_map;
 	string marker_rb_name;
@@ -331,6 +1346,7 @@ struct OpttrkData
 		marker_rb_name = "";
 		stg_calib_mk_cid = 0;
 		rs_lf_axis_id = probe_lf_axis_id = 0;
+		mk_pickable_pool = marker_vis_pool(0.015f, glm::fvec3(1), 7);
 		obj_state.emission = 0.4f;
 		obj_state.diffusion = 0.6f;
 		obj_state.specular = 0.2f;
@@ -407,6 +1423,7 @@ struct GlobalInfo
 	int guide_line_idx;
 	float closest_dist, angle;
 	glm::fvec3 guide_probe_closest_point;
+	primitive_cache prims; // probe, guide and annotation primitives (moved by os2ws)
 	
 	// model related
 	bool is_modelaligned;
@@ -418,6 +1435,7 @@ struct GlobalInfo
 	glm::fmat4x4 mat_matchtr;
 	int captured_model_ms_point_id;
 	int captured_model_ws_point_id;
+	bool is_icp_requested; // served by the icp tracker of RenderAndShowWindows
 	int rs_pc_id;
 
 	vector<glm::fvec3> model_ms_pick_pts;
@@ -480,6 +1498,8 @@ struct GlobalInfo
 		model_ms_obj_id = 0;
 		model_ws_obj_id = 0;
 		captured_model_ms_point_id = 0;
+		captured_model_ws_point_id = 0;
+		is_icp_requested = false;
 		is_modelaligned = false;
 		rs_pc_id = 0;
 		model_volume_id = 0;
@@ -658,12 +1678,12 @@ void Update_CamModel(const int scene_id, const glm::fmat4x4& mat_frm2ws, const s
 	__cv4__ obj_state.color = glm::fvec4(1.f, 1.f, 1.f, 1.f);
 	__cm4__ obj_state.os2ws = glm::fmat4x4();
 	
-	vzm::ReplaceOrAddSceneObject(scene_id, obj_ids_buf[3 * cam_id + 0], obj_state);
+	scene_mirror::SetState(scene_id, obj_ids_buf[3 * cam_id + 0], obj_state);
 
 	vzm::ObjStates thickline_state = obj_state;
 	thickline_state.line_thickness = 3;
-	vzm::ReplaceOrAddSceneObject(scene_id, obj_ids_buf[3 * cam_id + 1], thickline_state);
-	vzm::ReplaceOrAddSceneObject(scene_id, obj_ids_buf[3 * cam_id + 2], obj_state);
+	scene_mirror::SetState(scene_id, obj_ids_buf[3 * cam_id + 1], thickline_state);
+	scene_mirror::SetState(scene_id, obj_ids_buf[3 * cam_id + 2], obj_state);
 }
 
 void Axis_Gen(const glm::fmat4x4& mat_frame2ws, const float axis_line_leng, int& axis_obj_id)
@@ -765,15 +1785,15 @@ void GenWorldGrid(int ws_scene_id, int ws_cam_id)
 	vzm::ObjStates grid_obj_state;
 	grid_obj_state.color[3] = 0.7f;
 	grid_obj_state.line_thickness = 0;
-	vzm::ReplaceOrAddSceneObject(ws_scene_id, coord_grid_obj_id, grid_obj_state);
+	scene_mirror::SetState(ws_scene_id, coord_grid_obj_id, grid_obj_state);
 	bool foremost_surf_rendering = false;
 	vzm::SetRenderTestParam("_bool_OnlyForemostSurfaces", foremost_surf_rendering, sizeof(bool), ws_scene_id, ws_cam_id, coord_grid_obj_id);
 	grid_obj_state.color[3] = 0.9f;
-	vzm::ReplaceOrAddSceneObject(ws_scene_id, axis_lines_obj_id, grid_obj_state);
+	scene_mirror::SetState(ws_scene_id, axis_lines_obj_id, grid_obj_state);
 	*(glm::fvec4*) grid_obj_state.color = glm::fvec4(1, 0.3, 0.3, 0.6);
-	vzm::ReplaceOrAddSceneObject(ws_scene_id, axis_texX_obj_id, grid_obj_state);
+	scene_mirror::SetState(ws_scene_id, axis_texX_obj_id, grid_obj_state);
 	*(glm::fvec4*) grid_obj_state.color = glm::fvec4(0.3, 0.3, 1, 0.6);
-	vzm::ReplaceOrAddSceneObject(ws_scene_id, axis_texZ_obj_id, grid_obj_state);
+	scene_mirror::SetState(ws_scene_id, axis_texZ_obj_id, grid_obj_state);
 }
 
 void ComputeClosestPointBetweenLineAndPoint(const glm::fvec3& pos_line, const glm::fvec3& dir_line, const glm::fvec3& pos_point, glm::fvec3& pos_closest_point)
@@ -800,13 +1820,14 @@ void SetDashEffectInRendering(const int scene_id, const int cam_id, const int li
 	vzm::SetRenderTestParam("_double_LineDashInterval", dash_interval, sizeof(double), scene_id, cam_id, line_obj_id);
 }
 
-float MakeDistanceLine(const int scene_id, const glm::fvec3& pos_tool_tip, const glm::fvec3& pos_dst_point, const float font_size, int& closest_point_line_id, int& dist_text_id)
+// the os2ws of closest_point_line_id : prims.GetOs2Ws
+float MakeDistanceLine(primitive_cache& prims, const int scene_id, const glm::fvec3& pos_tool_tip, const glm::fvec3& pos_dst_point, const float font_size, int& closest_point_line_id, int& dist_text_id)
 {
 	//const float font_size = 30.f; // mm
 	//static int closest_point_line_id = 0, dist_text_id = 0;
 	glm::fvec3 pos_closest_line[2] = { pos_tool_tip, pos_dst_point };
-	glm::fvec3 clr_closest_line[2] = { glm::fvec3(1, 1, 0), glm::fvec3(1, 1, 0) };
-	vzm::GenerateLinesObject(__FP pos_closest_line, __FP clr_closest_line, 1, closest_point_line_id);
+	const glm::fvec3 clr_closest_line(1, 1, 0);
+	prims.Line(pos_closest_line[0], pos_closest_line[1], &clr_closest_line, closest_point_line_id);
 	//vzm::ObjStates obj_state_closest_point_line;
 	//obj_state_closest_point_line.line_thickness = 2;
 	//vzm::ReplaceOrAddSceneObject(0, closest_point_line_id, obj_state_closest_point_line);
@@ -919,14 +1940,14 @@ float MakeAngle2(const glm::fvec3& tool_tip2end_dir, const glm::fvec3& guide_dst
 	return angle;
 }
 
-float MakeAngle3(const glm::fvec3& tool_tip2end_dir, const glm::fvec3& guide_dst2end_dir, const glm::fvec3& pos_dst_point, const float font_size, const float angle_tris_length,
+// the os2ws of angle_tris_id and the angle texts : prims.GetOs2Ws
+float MakeAngle3(primitive_cache& prims, const glm::fvec3& tool_tip2end_dir, const glm::fvec3& guide_dst2end_dir, const glm::fvec3& pos_dst_point, const float font_size, const float angle_tris_length,
 	int& angle_tris_id,
 	const int scene0_id, int& angle_text0_id,
 	const int scene1_id, int& angle_text1_id,
 	const int scene2_id, int& angle_text2_id)
 {
 	//const float font_size = 30.f;
-	const int num_angle_tris = 10;
 	//const float angle_tris_length = 50.f;
 	glm::fvec3 vec_ref = glm::normalize(glm::cross(guide_dst2end_dir, tool_tip2end_dir));
 
@@ -936,25 +1957,7 @@ float MakeAngle3(const glm::fvec3& tool_tip2end_dir, const glm::fvec3& guide_dst
 		angle = glm::pi<float>() - angle;
 	}
 	//std::cout << angle << std::endl;
-	std::vector<glm::fvec3> anlge_polygon_pos(num_angle_tris + 2);
-	std::vector<glm::fvec3> anlge_polygon_clr(num_angle_tris + 2);
-	anlge_polygon_pos[0] = pos_dst_point;
-	anlge_polygon_clr[0] = glm::fvec3(1);
-	std::vector<unsigned int> idx_prims(num_angle_tris * 3);
-	for (int i = 0; i < num_angle_tris + 1; i++)
-	{
-		glm::fvec3 r_vec = glm::rotate(guide_dst2end_dir, angle / (float)num_angle_tris * (float)i, vec_ref);
-		anlge_polygon_pos[1 + i] = pos_dst_point + r_vec * angle_tris_length;
-		anlge_polygon_clr[1 + i] = glm::fvec3((float)i / (float)num_angle_tris, 0, 1.f - (float)i / (float)num_angle_tris);
-		if (i < num_angle_tris)
-		{
-			idx_prims[3 * i + 0] = 0;
-			idx_prims[3 * i + 1] = i + 1;
-			idx_prims[3 * i + 2] = i + 2;
-		}
-	}
-	//static int angle_tris_id = 0, angle_text_id = 0;
-	vzm::GeneratePrimitiveObject(__FP anlge_polygon_pos[0], NULL, __FP anlge_polygon_clr[0], NULL, num_angle_tris + 2, (unsigned int*)&idx_prims[0], num_angle_tris, 3, angle_tris_id);
+	prims.AngleFan(pos_dst_point, guide_dst2end_dir, vec_ref, angle * 180.f / glm::pi<float>(), angle_tris_length * glm::length(guide_dst2end_dir), angle_tris_id);
 	//vzm::ObjStates obj_state_angle_tris;
 	//obj_state_angle_tris.color[3] = 0.5f;
 	//vzm::ReplaceOrAddSceneObject(0, angle_tris_id, obj_state_angle_tris);
@@ -962,13 +1965,15 @@ float MakeAngle3(const glm::fvec3& tool_tip2end_dir, const glm::fvec3& guide_dst
 	int* ids[] = { &angle_text0_id , &angle_text1_id , &angle_text2_id };
 	int scene_ids[] = { scene0_id , scene1_id , scene2_id };
 
+	// the texts are rebuilt only when the displayed angle changes, they follow the cameras through os2ws
+	const glm::fvec3 pos_text = pos_dst_point + guide_dst2end_dir * angle_tris_length;
+	if (angle * 180.f / glm::pi<float>() < 0.1) angle = 0;
+	const std::string angle_str = to_string_with_precision(angle * 180.f / glm::pi<float>(), 3) + "";
 	for (int i = 0; i < 3; i++)
 	{
 		vzm::CameraParameters cam_params;
 		vzm::GetCameraParameters(scene_ids[i], cam_params, 1);
-		glm::fvec3 xyz_LT_view_up[3] = { anlge_polygon_pos[1], __cv3__ cam_params.view, __cv3__ cam_params.up };
-		if (angle * 180.f / glm::pi<float>() < 0.1) angle = 0;
-		vzm::GenerateTextObject(__FP xyz_LT_view_up, to_string_with_precision(angle * 180.f / glm::pi<float>(), 3) + "", font_size, true, false, *ids[i]);
+		prims.Text(pos_text, __cv3__ cam_params.view, __cv3__ cam_params.up, angle_str, font_size, *ids[i]);
 	}
 	//vzm::ObjStates obj_state_angle_text;
 	//vzm::ReplaceOrAddSceneObject(0, angle_text_id, obj_state_angle_text);
@@ -1068,16 +2073,14 @@ void SetManualProbe(const std::string& dst_tool_name, const std::string& src_too
 	}
 }
 
-void SetCustomTools(const std::string& tool_name, const PROBE_MODE probe_mode, const GlobalInfo& ginfo, const glm::fvec3& tool_color, const bool visible)
+void SetCustomTools(const std::string& tool_name, const PROBE_MODE probe_mode, GlobalInfo& ginfo, const glm::fvec3& tool_color, const bool visible)
 {
 	static map<std::string, int> tool_names;
 	for (auto it : tool_names)
 	{
 		vzm::ObjStates tool_state;
 		tool_state.is_visible = false;
-		vzm::ReplaceOrAddSceneObject(ginfo.stg_scene_id, it.second, tool_state);
-		vzm::ReplaceOrAddSceneObject(ginfo.rs_scene_id, it.second, tool_state);
-		vzm::ReplaceOrAddSceneObject(ginfo.ws_scene_id, it.second, tool_state);
+		scene_mirror::SetStates(MS_WS | MS_RS | MS_STG, it.second, tool_state);
 	}
 	if (!visible) return;
 	int& tool_id = tool_names[tool_name];
@@ -1091,16 +2094,11 @@ void SetCustomTools(const std::string& tool_name, const PROBE_MODE probe_mode, c
 		float cyl_r = tool_r;
 
 		vzm::ObjStates tool_line, tool_tip;
-		vzm::GenerateCylindersObject((float*)cyl_p, &cyl_r, __FP cyl_rgb, 1, tool_id);
-		glm::fvec4 tip_sphere_xyzr = glm::fvec4(pos_tool_tip, cyl_r);
-		vzm::GenerateSpheresObject(__FP tip_sphere_xyzr, NULL, 1, tool_tip_id);
-		vzm::ReplaceOrAddSceneObject(ginfo.stg_scene_id, tool_id, tool_line);
-		vzm::ReplaceOrAddSceneObject(ginfo.rs_scene_id, tool_id, tool_line);
-		vzm::ReplaceOrAddSceneObject(ginfo.ws_scene_id, tool_id, tool_line);
+		__cm4__ tool_line.os2ws = ginfo.prims.Cylinder(cyl_p[0], cyl_p[1], cyl_r, &cyl_rgb, tool_id);
+		__cm4__ tool_tip.os2ws = ginfo.prims.Sphere(pos_tool_tip, cyl_r, NULL, tool_tip_id);
+		scene_mirror::SetStates(MS_WS | MS_RS | MS_STG, tool_id, tool_line);
 		__cv4__ tool_tip.color = glm::fvec4(1, 0, 0, 1);
-		vzm::ReplaceOrAddSceneObject(ginfo.stg_scene_id, tool_tip_id, tool_tip);
-		vzm::ReplaceOrAddSceneObject(ginfo.rs_scene_id, tool_tip_id, tool_tip);
-		vzm::ReplaceOrAddSceneObject(ginfo.ws_scene_id, tool_tip_id, tool_tip);
+		scene_mirror::SetStates(MS_WS | MS_RS | MS_STG, tool_tip_id, tool_tip);
 	};
 
 	glm::fmat4x4 mat_lfrm2ws;
@@ -1177,6 +2175,7 @@ void Show_Window(const std::string& title, const int scene_id, const int cam_id,
 	uint count = std::get<0>(_data);
 	double times_sum = std::get<1>(_data);
 	DWORD _t = GetTickCount();
+	scene_mirror::FlushStates();
 	vzm::RenderScene(scene_id, cam_id);
 	//times_sum += (GetTickCount() - _t) / 1000.;
 	//std::cout << "rendering sec : " << times_sum / (double)(++count) << " s" << std::endl;
@@ -1233,123 +2232,6 @@ void Show_Window_with_Info(const std::string& title, const int scene_id, const i
 	}
 }
 
-int GL_CLR_CHANNELS = 4;
-void copy_back_ui_buffer(unsigned char* data_ui, unsigned char* data_render_bf, int w, int h, bool v_flib)
-{
-	// cpu mem ==> dataPtr
-	int width_uibuf_pitch = w * 3;
-	int width_fbbuf_pitch = w * GL_CLR_CHANNELS;
-#pragma omp parallel for 
-	for (int i = 0; i < h; i++)
-		for (int j = 0; j < w; j++)
-		{
-			int y = v_flib ? (h - 1 - i) : i;
-
-			unsigned int rgba;
-			memcpy(&rgba, &data_render_bf[y * width_fbbuf_pitch + j * GL_CLR_CHANNELS + 0], sizeof(int));
-			
-			//unsigned char r = data_render_bf[y * width_fbbuf_pitch + j * GL_CLR_CHANNELS + 0];
-			//unsigned char g = data_render_bf[y * width_fbbuf_pitch + j * GL_CLR_CHANNELS + 1];
-			//unsigned char b = data_render_bf[y * width_fbbuf_pitch + j * GL_CLR_CHANNELS + 2];
-			//unsigned char a = data_render_bf[y * width_fbbuf_pitch + j * GL_CLR_CHANNELS + 3];
-
-			unsigned char r = rgba & 0xFF;
-			unsigned char g = (rgba >> 8) & 0xFF;
-			unsigned char b = (rgba >> 16) & 0xFF;
-			unsigned char a = (rgba >> 24) & 0xFF;
-
-			if (a > 0)
-			{
-				unsigned int rgb;
-				memcpy(&rgb, &data_ui[i * width_uibuf_pitch + j * 3 + 0], 3);
-
-				//unsigned char _r = data_ui[i * width_uibuf_pitch + j * 3 + 0];
-				//unsigned char _g = data_ui[i * width_uibuf_pitch + j * 3 + 1];
-				//unsigned char _b = data_ui[i * width_uibuf_pitch + j * 3 + 2];
-
-				unsigned char _r = rgb & 0xFF;
-				unsigned char _g = (rgb >> 8) & 0xFF;
-				unsigned char _b = (rgb >> 16) & 0xFF;
-
-				float fa = (float)a / 255.f;
-				float fr = (1.f - fa) * (float)_r + (float)r * fa;
-				float fg = (1.f - fa) * (float)_g + (float)g * fa;
-				float fb = (1.f - fa) * (float)_b + (float)b * fa;
-
-				//data_ui[i * width_uibuf_pitch + j * 3 + 0] = (unsigned char)min((int)fr, (int)255);
-				//data_ui[i * width_uibuf_pitch + j * 3 + 1] = (unsigned char)min((int)fg, (int)255);
-				//data_ui[i * width_uibuf_pitch + j * 3 + 2] = (unsigned char)min((int)fb, (int)255);
-
-				rgb = (unsigned char)min((int)fr, (int)255) | ((unsigned char)min((int)fg, (int)255) << 8) | ((unsigned char)min((int)fb, (int)255) << 16);
-				memcpy(&data_ui[i * width_uibuf_pitch + j * 3 + 0], &rgb, 3);
-			}
-		}
-};
-
-void copy_back_ui_buffer_local(unsigned char* data_ui, int w, int h, unsigned char* data_render_bf, int w_bf, int h_bf, int offset_x, int offset_y, bool v_flib, bool smooth_mask, float _a, float _b, bool opaque_bg)
-{
-	auto alpha_mask = [&smooth_mask, &_a, &_b](float r) -> float
-	{
-		if (!smooth_mask) return 1.f;
-		//const float _a = 0.2;
-		return min(max((atan(_a * (r - _b)) + atan(_a * 100.f)) / (atan(_a * 1000.f) * 2.f), 0.f), 1.f) * 0.8f;
-	};
-	// cpu mem ==> dataPtr
-	int width_uibuf_pitch = w * 3;
-	int width_fbbuf_pitch = w_bf * GL_CLR_CHANNELS;
-	glm::fvec2 _c = glm::fvec2(w_bf * 0.5, h_bf * 0.5);
-#pragma omp parallel for 
-	for (int i = 0; i < h_bf; i++)
-		for (int j = 0; j < w_bf; j++)
-		{
-			min(offset_y + h_bf, h);
-			min(offset_x + w_bf, w);//
-
-			int y = v_flib ? (h - 1 - i) : i;
-
-			unsigned int rgba;
-			memcpy(&rgba, &data_render_bf[y * width_fbbuf_pitch + j * GL_CLR_CHANNELS + 0], sizeof(int));
-
-			unsigned char r = rgba & 0xFF;
-			unsigned char g = (rgba >> 8) & 0xFF;
-			unsigned char b = (rgba >> 16) & 0xFF;
-			unsigned char a = opaque_bg? 255 : (rgba >> 24) & 0xFF;
-
-			if ((a > 0) && (j + offset_y < w) && (i + offset_y < h))
-			{
-				unsigned int rgb;
-				int ui_x = j + offset_x;
-				int ui_y = i + offset_y;
-				memcpy(&rgb, &data_ui[ui_y * width_uibuf_pitch + ui_x * 3 + 0], 3);
-
-				//unsigned char _r = data_ui[ui_y * width_uibuf_pitch + ui_x * 3 + 0];
-				//unsigned char _g = data_ui[ui_y * width_uibuf_pitch + ui_x * 3 + 1];
-				//unsigned char _b = data_ui[ui_y * width_uibuf_pitch + ui_x * 3 + 2];
-
-				unsigned char _r = rgb & 0xFF;
-				unsigned char _g = (rgb >> 8) & 0xFF;
-				unsigned char _b = (rgb >> 16) & 0xFF;
-
-				//float _a = alpha_mask(glm::length(_c - glm::fvec2(j, i)));
-				int _x = min(min(i, j), min(w_bf - j, h_bf - i));
-				float _a = alpha_mask((float)_x);
-				//if (i % 20 == 1 && j % 20 == 1)
-				//	cout << _a << ", ";
-				float fa = (float)a / 255.f * _a;
-				float fr = (1.f - fa) * (float)_r + (float)r * fa;
-				float fg = (1.f - fa) * (float)_g + (float)g * fa;
-				float fb = (1.f - fa) * (float)_b + (float)b * fa;
-
-				//data_ui[ui_y * width_uibuf_pitch + ui_x * 3 + 0] = (unsigned char)min((int)fr, (int)255);
-				//data_ui[ui_y * width_uibuf_pitch + ui_x * 3 + 1] = (unsigned char)min((int)fg, (int)255);
-				//data_ui[ui_y * width_uibuf_pitch + ui_x * 3 + 2] = (unsigned char)min((int)fb, (int)255);
-
-				rgb = (unsigned char)min((int)fr, (int)255) | ((unsigned char)min((int)fg, (int)255) << 8) | ((unsigned char)min((int)fb, (int)255) << 16);
-				memcpy(&data_ui[ui_y * width_uibuf_pitch + ui_x * 3 + 0], &rgb, 3);
-			}
-		}
-};
-
 #define PAIR_MAKE(P2D, P3D) std::pair<cv::Point2f, cv::Point3f>(cv::Point2f(P2D.x, P2D.y), cv::Point3f(P3D.x, P3D.y, P3D.z))
 #define double_vec3(D) ((double*)D.data)[0], ((double*)D.data)[1], ((double*)D.data)[2]
 bool CalibrteCamLocalFrame(const vector<glm::fvec2>& points_2d, const vector<glm::fvec3>& points_3dws, const glm::fmat4x4& mat_ws2clf,
@@ -1529,6 +2411,7 @@ bool GetSufacePickPos(glm::fvec3& pos_pick_ws, const int scene_id, const int cam
 	{
 		int pick_obj = 0;
 		glm::fvec3 pos_pick;
+		scene_mirror::FlushStates();
 		vzm::PickObject(pick_obj, __FP pos_pick, x, y, scene_id, cam_id);
 		if (pick_obj != 0)
 		{
@@ -9,8 +9,11 @@
 #include <set>
 #include <queue>
 #include <iostream>
+#include <mutex>
 
 #include "NPTrackingTools.h"
+#include "rb_filter.h"
+#include "trk_replay.h"
 
 using namespace optitrk;
 using namespace std;
@@ -88,6 +91,7 @@ public:
 
 bool is_initialized = false;
 myListener listener;
+trk_replay replay;
 bool optitrk::InitOptiTrackLib()
 {
 	if (is_initialized) return false;
@@ -114,19 +118,52 @@ bool optitrk::InitOptiTrackLib()
 	return true;
 }
 
+bool optitrk::InitOptiTrackReplay(const std::string& file_replay, const TrkReplayMode mode, const float speed)
+{
+	if (is_initialized || replay.IsOpen()) return false;
+	if (!replay.Open(file_replay, mode, speed))
+	{
+		printf("Unable to open the replay file %s\n", file_replay.c_str());
+		return false;
+	}
+	printf("Replaying %s (%d frames)\n", file_replay.c_str(), replay.GetNumFrames());
+	return true;
+}
+
+int optitrk::GetReplayMode()
+{
+	return replay.IsOpen() ? (int)replay.GetMode() : -1;
+}
+
+int optitrk::StepReplay(const int num_frames)
+{
+	return replay.Step(num_frames);
+}
+
+int optitrk::GetReplayFrame(double* t_ms, int* num_frames)
+{
+	if (num_frames) *num_frames = replay.GetNumFrames();
+	return replay.GetCursor(t_ms);
+}
+
 bool optitrk::SetCameraSettings(int cam_idx, int video_type, int exposure, int threshold, int intensity)
 {
+	if (replay.IsOpen()) return false;
 	return TT_SetCameraSettings(cam_idx, video_type, exposure, threshold, intensity);
 }
 
 bool optitrk::SetCameraFrameRate(int cam_idx, int frameRate)
 {
+	if (replay.IsOpen()) return false;
 	return TT_SetCameraFrameRate(cam_idx, frameRate);
 }
 
 std::map<std::string, int> rb_id_map;
 bool optitrk::LoadProfileAndCalibInfo(const std::string& file_profile, const std::string& file_calib)
 {
+	// the recorded poses are already in the calibrated world space
+	if (replay.IsOpen()) return true;
+
 	// Do an update to pick up any recently-arrived cameras.
 	TT_Update();
 
@@ -167,6 +204,14 @@ bool CreateRigidBody(const std::string& name_rb, const int num_markers, const fl
 
 int optitrk::GetMarkersLocation(std::vector<float>* mk_xyz_list, std::vector<float>* mk_residual_list, std::vector<std::bitset<128>>* mk_cid_list)
 {
+	if (replay.IsOpen())
+	{
+		const trk_replay_frame& frame = replay.GetFrame();
+		*mk_xyz_list = frame.mk_xyz;
+		if (mk_residual_list) *mk_residual_list = frame.mk_residue;
+		if (mk_cid_list) *mk_cid_list = frame.mk_cid;
+		return (int)frame.mk_residue.size();
+	}
 	if (!is_initialized) return false;
 
 	int num_mks = TT_FrameMarkerCount();
@@ -198,8 +243,40 @@ int optitrk::GetMarkersLocation(std::vector<float>* mk_xyz_list, std::vector<flo
 	return num_mks;
 }
 
+int optitrk::GetMarkersLocationArray(const int max_mks, float* mk_xyz_array, float* mk_residual_array, std::bitset<128>* mk_cid_array)
+{
+	if (replay.IsOpen()) return replay.GetMarkers(max_mks, mk_xyz_array, mk_residual_array, mk_cid_array);
+	if (!is_initialized) return 0;
+
+	int num_mks = min(TT_FrameMarkerCount(), max_mks);
+	for (int i = 0; i < num_mks; i++)
+	{
+		mk_xyz_array[3 * i + 0] = TT_FrameMarkerX(i);
+		mk_xyz_array[3 * i + 1] = TT_FrameMarkerY(i);
+		mk_xyz_array[3 * i + 2] = TT_FrameMarkerZ(i);
+		if (mk_residual_array) mk_residual_array[i] = TT_FrameMarkerResidual(i);
+		if (mk_cid_array)
+		{
+			Core::cUID cid = TT_FrameMarkerLabel(i);
+			std::bitset<128> cid_bs;
+			cid_bs |= cid.HighBits();
+			cid_bs <<= 64;
+			cid_bs |= cid.LowBits();
+			mk_cid_array[i] = cid_bs;
+		}
+	}
+
+	return num_mks;
+}
+
 int optitrk::GetRigidBodies(std::vector<std::string>* rb_names)
 {
+	if (replay.IsOpen())
+	{
+		const std::vector<std::string>& names = replay.GetFrame().rb_names;
+		if (rb_names) rb_names->insert(rb_names->end(), names.begin(), names.end());
+		return (int)names.size();
+	}
 	int num_rbs = TT_RigidBodyCount();
 	if (rb_names)
 	{
@@ -209,17 +286,16 @@ int optitrk::GetRigidBodies(std::vector<std::string>* rb_names)
 	return num_rbs;
 }
 
-struct rb_tr_smooth_info
+struct rb_filter_state
 {
-	int fr_count;
-	std::deque<glm::fquat> qt_que;
-	std::deque<glm::fvec3> xyz_que;
-	rb_tr_smooth_info() {}
-	rb_tr_smooth_info(const int _fr_count) {
-		fr_count = _fr_count;
-	}
+	rb_pose_filter filter;
+	int last_frame_id;
+	glm::fvec3 pos;
+	glm::fquat q;
+	rb_filter_state() { last_frame_id = -1; }
 };
-std::map<int, rb_tr_smooth_info> rb_smooth_frcount;
+std::map<int, rb_filter_state> rb_filters;
+std::mutex rb_filters_mutex;
 bool optitrk::SetRigidBodyPropertyById(const int rb_idx, const float smooth_term, const int test_smooth_term)
 {
 	if (!is_initialized) return false;
@@ -229,7 +305,9 @@ bool optitrk::SetRigidBodyPropertyById(const int rb_idx, const float smooth_term
 	TT_RigidBodySettings(rb_idx, rb_settings);
 	std::cout << "target param of " << rb_idx << " : " << rb_settings.Smoothing << std::endl;
 	rb_settings.Smoothing = (double)smooth_term;
-	rb_smooth_frcount[rb_idx] = rb_tr_smooth_info(test_smooth_term);
+	// test_smooth_term : box average over the last test_smooth_term frames (> 1)
+	float window = (float)test_smooth_term;
+	SetRigidBodyFilterById(rb_idx, test_smooth_term > 1 ? RB_FILTER_BOX : RB_FILTER_NONE, &window, 1);
 	return TT_SetRigidBodySettings(rb_idx, rb_settings) == NPRESULT_SUCCESS;
 }
 
@@ -243,6 +321,60 @@ bool optitrk::SetRigidBodyPropertyByName(const std::string& name, const float sm
 	return SetRigidBodyPropertyById(rb_idx, smooth_term, test_smooth_term);
 }
 
+bool optitrk::SetRigidBodyFilterById(const int rb_idx, const int filter_type, const float* params, const int num_params)
+{
+	if (filter_type < RB_FILTER_NONE || filter_type >= RB_FILTER_COUNT) return false;
+
+	rb_filter_params fparams;
+	fparams.type = (RbFilterType)filter_type;
+	for (int i = 0; i < min(num_params, RB_FILTER_MAX_PARAMS); i++)
+		fparams.params[i] = params[i];
+
+	std::lock_guard<std::mutex> lock(rb_filters_mutex);
+	rb_filters[rb_idx].filter.Configure(fparams);
+	return true;
+}
+
+bool optitrk::SetRigidBodyFilterByName(const std::string& name, const int filter_type, const float* params, const int num_params)
+{
+	auto it = rb_id_map.find(name);
+	if (it == rb_id_map.end())
+		return false;
+	return SetRigidBodyFilterById(it->second, filter_type, params, num_params);
+}
+
+bool optitrk::EvaluateRigidBodyFilter(const int filter_type, const float* params, const int num_params,
+	const float* xyzq_list, const double* time_stamps, const int num_samples, float* report)
+{
+	if (filter_type < RB_FILTER_NONE || filter_type >= RB_FILTER_COUNT || num_samples < 3) return false;
+
+	rb_filter_params fparams;
+	fparams.type = (RbFilterType)filter_type;
+	for (int i = 0; i < min(num_params, RB_FILTER_MAX_PARAMS); i++)
+		fparams.params[i] = params[i];
+
+	std::vector<glm::fvec3> pos_list(num_samples);
+	std::vector<glm::fquat> q_list(num_samples);
+	for (int i = 0; i < num_samples; i++)
+	{
+		const float* xyzq = &xyzq_list[i * 7];
+		pos_list[i] = glm::fvec3(xyzq[0], xyzq[1], xyzq[2]);
+		q_list[i] = glm::fquat(xyzq[6], xyzq[3], xyzq[4], xyzq[5]);
+	}
+
+	rb_filter_report rep = EvaluateRbFilter(fparams, time_stamps, &pos_list[0], &q_list[0], num_samples);
+	if (report)
+	{
+		report[0] = rep.jitter_pos_mm;
+		report[1] = rep.jitter_ang_deg;
+		report[2] = rep.lag_ms;
+		report[3] = rep.rms_err_mm;
+	}
+	std::cout << "filter " << filter_type << " (" << fparams.params[0] << ", " << fparams.params[1] << ", " << fparams.params[2] << ", " << fparams.params[3] << ") : "
+		<< "jitter " << rep.jitter_pos_mm << " mm, " << rep.jitter_ang_deg << " deg / lag " << rep.lag_ms << " ms (rms " << rep.rms_err_mm << " mm)" << std::endl;
+	return true;
+}
+
 bool optitrk::SetRigidBodyEnabledbyId(const int rb_idx, const bool enabled)
 {
 	if (!is_initialized) return false;
@@ -266,6 +398,14 @@ bool optitrk::SetRigidBodyEnabledbyName(const std::string& name, const bool enab
 
 bool optitrk::GetRigidBodyLocationById(const int rb_idx, float* mat_rb2ws, std::vector<float>* rbmk_xyz_list, std::vector<float>* trmk_xyz_list, std::vector<bool>* tr_list, std::string* rb_name)
 {
+	if (replay.IsOpen())
+	{
+		// the rigid body markers are not recorded
+		if (rbmk_xyz_list) rbmk_xyz_list->clear();
+		if (trmk_xyz_list) trmk_xyz_list->clear();
+		if (tr_list) tr_list->clear();
+		return replay.GetRigidBody(rb_idx, mat_rb2ws, rb_name);
+	}
 	if (!is_initialized) return false;
 	if (rb_name) *rb_name = TT_RigidBodyName(rb_idx);
 	if (!TT_IsRigidBodyTracked(rb_idx)) return false;
@@ -275,44 +415,28 @@ bool optitrk::GetRigidBodyLocationById(const int rb_idx, float* mat_rb2ws, std::
 	float   qx, qy, qz, qw;
 	TT_RigidBodyLocation(rb_idx, &x, &y, &z, &qx, &qy, &qz, &qw, &yaw, &pitch, &roll); // frame info.
 
-	auto it = rb_smooth_frcount.find(rb_idx);
-	if (it != rb_smooth_frcount.end())
 	{
-		rb_tr_smooth_info& tr_smooth = it->second;
-		if (tr_smooth.fr_count > 1)
+		std::lock_guard<std::mutex> lock(rb_filters_mutex);
+		auto it = rb_filters.find(rb_idx);
+		if (it != rb_filters.end() && it->second.filter.GetParams().type != RB_FILTER_NONE)
 		{
-			if (tr_smooth.qt_que.size() < tr_smooth.fr_count)
+			// filtered once per frame, repeated queries of the same frame get the same pose
+			rb_filter_state& fstate = it->second;
+			int frame_id = TT_FrameID();
+			if (frame_id != fstate.last_frame_id)
 			{
-				tr_smooth.qt_que.push_back(glm::fquat(qw, qx, qy, qz));
-				tr_smooth.xyz_que.push_back(glm::fvec3(x, y, z));
+				fstate.last_frame_id = frame_id;
+				fstate.pos = glm::fvec3(x, y, z);
+				fstate.q = glm::fquat(qw, qx, qy, qz);
+				fstate.filter.Update(TT_FrameTimeStamp(), fstate.pos, fstate.q);
 			}
-			else
-			{
-				tr_smooth.qt_que.pop_front();
-				tr_smooth.qt_que.push_back(glm::fquat(qw, qx, qy, qz));
-				tr_smooth.xyz_que.pop_front();
-				tr_smooth.xyz_que.push_back(glm::fvec3(x, y, z));
-			}
-
-			float _weight = 1.f / (float)tr_smooth.qt_que.size();
-			glm::fvec3 __xyz_avr = tr_smooth.xyz_que[0];
-			glm::fquat __qt_avr = tr_smooth.qt_que[0];
-			for (int i = 1; i < (int)tr_smooth.qt_que.size(); i++)
-			{
-				__xyz_avr = (__xyz_avr + tr_smooth.xyz_que[i]) * 0.5f;
-				//glm::fvec3& _xyz = tr_smooth.xyz_que[i];
-				//x += _xyz.x * _weight;
-				//y += _xyz.y * _weight;
-				//z += _xyz.z * _weight;
-				__qt_avr = glm::slerp(__qt_avr, tr_smooth.qt_que[i], 0.5f);
-			}
-			x = __xyz_avr.x;
-			y = __xyz_avr.y;
-			z = __xyz_avr.z;
-			qx = __qt_avr.x;
-			qy = __qt_avr.y;
-			qz = __qt_avr.z;
-			qw = __qt_avr.w;
+			x = fstate.pos.x;
+			y = fstate.pos.y;
+			z = fstate.pos.z;
+			qx = fstate.q.x;
+			qy = fstate.q.y;
+			qz = fstate.q.z;
+			qw = fstate.q.w;
 		}
 	}
 
@@ -383,6 +507,13 @@ bool optitrk::GetRigidBodyLocationById(const int rb_idx, float* mat_rb2ws, std::
 
 bool optitrk::GetRigidBodyLocationByName(const string& name, float* mat_rb2ws, std::vector<float>* rbmk_xyz_list, std::vector<float>* trmk_xyz_list, std::vector<bool>* tr_list, int* rb_id)
 {
+	if (replay.IsOpen())
+	{
+		int rb_idx = replay.FindRigidBody(name);
+		if (rb_idx < 0) return false;
+		if (rb_id) *rb_id = rb_idx;
+		return GetRigidBodyLocationById(rb_idx, mat_rb2ws, rbmk_xyz_list, trmk_xyz_list, tr_list, NULL);
+	}
 	auto it = rb_id_map.find(name);
 	if (it == rb_id_map.end())
 		return false;
@@ -393,6 +524,7 @@ bool optitrk::GetRigidBodyLocationByName(const string& name, float* mat_rb2ws, s
 
 bool optitrk::SetRigidBodyByMkPositions(const std::string& name, const float* rbmk_xyz_array, const int num_mks, int* rb_idx)
 {
+	if (replay.IsOpen()) return false;
 	std::set<int, std::greater<int>> ids;
 	int dst_idx = -1;
 	for (auto it = rb_id_map.begin(); it != rb_id_map.end(); it++)
@@ -474,6 +606,7 @@ bool optitrk::GetCameraLocation(const int cam_idx, float* mat_cam2ws)
 
 bool optitrk::UpdateFrame(bool use_latest)
 {
+	if (replay.IsOpen()) return replay.UpdateFrame();
 	if (!is_initialized) return false;
 	//return use_latest ? TT_UpdateLastestFrame() == NPRESULT_SUCCESS : TT_Update() == NPRESULT_SUCCESS;
 	return TT_Update() == NPRESULT_SUCCESS;
@@ -500,6 +633,11 @@ bool optitrk::__test()
 
 bool optitrk::DeinitOptiTrackLib()
 {
+	if (replay.IsOpen())
+	{
+		replay.Close();
+		return true;
+	}
 	if (!is_initialized) return false;
 
 	// Detach listener
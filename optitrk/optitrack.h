@@ -8,9 +8,27 @@
 #include <vector>
 #include <bitset>
 
+// replay modes of InitOptiTrackReplay / GetReplayMode
+enum TrkReplayMode
+{
+	TRK_REPLAY_RECORDED = 0,	// the cursor follows the wall clock at the recorded timing (x speed), from the first UpdateFrame
+	TRK_REPLAY_FAST,			// the cursor is moved by StepReplay(), by the frame consumer as soon as it takes the previous frame
+	TRK_REPLAY_STEP,			// the cursor is moved by StepReplay() only, frame by frame
+	TRK_REPLAY_COUNT
+};
+
 namespace optitrk
 {
 	__dojostatic bool InitOptiTrackLib();
+	// replay backend instead of Motive (no license, no cameras) : UpdateFrame, GetMarkersLocation*, GetRigidBodyLocation* and GetRigidBodies
+	// serve the tracking stream of a recorded session (.krec, see ar_settings/Recorder.h), the poses are served as recorded (no filter)
+	__dojostatic bool InitOptiTrackReplay(const std::string& file_replay, const TrkReplayMode mode = TRK_REPLAY_RECORDED, const float speed = 1.f);
+	// TrkReplayMode, -1 : not replaying
+	__dojostatic int GetReplayMode();
+	// FAST / STEP : moves the replay cursor by num_frames, returns the frame index of the cursor
+	__dojostatic int StepReplay(const int num_frames = 1);
+	// frame index of the replay cursor (-1 : before the first frame), t_ms : its recorded time, num_frames : frames of the session
+	__dojostatic int GetReplayFrame(double* t_ms = NULL, int* num_frames = NULL);
 	// video_type
 	//==     0 = Segment Mode   
 	//==     1 = Grayscale Mode 
@@ -24,10 +42,20 @@ namespace optitrk
 
 	__dojostatic bool LoadProfileAndCalibInfo(const std::string& file_profile, const std::string& file_calib);
 	__dojostatic int GetMarkersLocation(std::vector<float>* mk_xyz_list, std::vector<float>* mk_residual_list = NULL, std::vector<std::bitset<128>>* mk_cid_list = NULL);
+	// fills up to max_mks markers into caller-owned arrays (xyz : 3 floats per marker), returns the number of filled markers
+	__dojostatic int GetMarkersLocationArray(const int max_mks, float* mk_xyz_array, float* mk_residual_array = NULL, std::bitset<128>* mk_cid_array = NULL);
 	__dojostatic int GetRigidBodies(std::vector<std::string>* rb_names = NULL);
 	// mat_rb2ws ==> glm::fmat4x4
 	__dojostatic bool SetRigidBodyPropertyById(const int rb_idx, const float smooth_term, const int test_smooth_term);
 	__dojostatic bool SetRigidBodyPropertyByName(const std::string& name, const float smooth_term, const int test_smooth_term);
+	// pose filter applied in GetRigidBodyLocationById (O(1) per sample, once per frame)
+	// filter_type [0, 1, 2, 3, 4] => [NONE, BOX, EMA, ONE_EURO, KALMAN_CV], params : see rb_filter.h
+	__dojostatic bool SetRigidBodyFilterById(const int rb_idx, const int filter_type, const float* params, const int num_params);
+	__dojostatic bool SetRigidBodyFilterByName(const std::string& name, const int filter_type, const float* params, const int num_params);
+	// offline harness : replays recorded poses (xyzq_list : x, y, z, qx, qy, qz, qw per sample, time_stamps in seconds)
+	// report (optional, 4 floats) : jitter (mm), jitter (deg), lag (ms), rms error at the lag (mm)
+	__dojostatic bool EvaluateRigidBodyFilter(const int filter_type, const float* params, const int num_params,
+		const float* xyzq_list, const double* time_stamps, const int num_samples, float* report = NULL);
 	__dojostatic bool GetRigidBodyLocationById(const int rb_idx, float* mat_rb2ws, std::vector<float>* rbmk_xyz_list = NULL, std::vector<float>* trmk_xyz_list = NULL, std::vector<bool>* tr_list = NULL, std::string* rb_name = NULL);
 	__dojostatic bool GetRigidBodyLocationByName(const std::string& name, float* mat_rb2ws, std::vector<float>* rbmk_xyz_list = NULL, std::vector<float>* trmk_xyz_list = NULL, std::vector<bool>* tr_list = NULL, int* rb_id = NULL);
 	__dojostatic bool SetRigidBodyByMkPositions(const std::string& name, const float* rbmk_xyz_array, const int num_mks, int* rb_idx = NULL);
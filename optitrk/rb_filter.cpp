@@ -0,0 +1,239 @@
+#include "rb_filter.h"
+
+#include <vector>
+#include <algorithm>
+#include <math.h>
+
+#define RB_FILTER_RESET_GAP 0.1 // seconds, restart the filter after a tracking loss longer than this
+
+static glm::fvec3 log_qt(glm::fquat dq)
+{
+	if (dq.w < 0) dq = -dq;
+	glm::fvec3 v(dq.x, dq.y, dq.z);
+	float s = glm::length(v);
+	if (s < 1e-7f) return glm::fvec3(0);
+	return v * (2.f * atan2f(s, dq.w) / s);
+}
+
+static glm::fquat exp_qt(const glm::fvec3& v)
+{
+	float angle = glm::length(v);
+	if (angle < 1e-7f) return glm::fquat(1, 0, 0, 0);
+	return glm::angleAxis(angle, v / angle);
+}
+
+static float smoothing_alpha(const float cutoff, const float dt)
+{
+	float tau = 1.f / (2.f * glm::pi<float>() * cutoff);
+	return 1.f / (1.f + tau / dt);
+}
+
+// constant-velocity kalman step for one axis, x is the predicted state (in/out), p = (p00, p01, p11)
+static void kalman_cv_axis(float& x, float& v, glm::fvec3& p, const float z, const float dt, const float sa, const float r)
+{
+	float dt2 = dt * dt;
+	float q00 = sa * sa * dt2 * dt2 * 0.25f, q01 = sa * sa * dt2 * dt * 0.5f, q11 = sa * sa * dt2;
+	float p00 = p.x + 2.f * dt * p.y + dt2 * p.z + q00;
+	float p01 = p.y + dt * p.z + q01;
+	float p11 = p.z + q11;
+
+	float y = z - x;
+	float s = p00 + r * r;
+	float k0 = p00 / s, k1 = p01 / s;
+	x += k0 * y;
+	v += k1 * y;
+	p = glm::fvec3((1.f - k0) * p00, (1.f - k0) * p01, p11 - k1 * p01);
+}
+
+void rb_pose_filter::Configure(const rb_filter_params& _fparams)
+{
+	fparams = _fparams;
+	is_first = true;
+	prev_t = 0;
+}
+
+void rb_pose_filter::Reset(const glm::fvec3& _pos, const glm::fquat& _q)
+{
+	pos = _pos;
+	q = _q;
+
+	box_count = box_next = 0;
+	box_pos_sum = glm::fvec3(0);
+	box_qt_sum = glm::fvec4(0);
+
+	oe_dpos = glm::fvec3(0);
+	oe_dang = 0;
+
+	kf_vel = kf_angvel = glm::fvec3(0);
+	float r = fparams.params[1] > 0 ? fparams.params[1] : 0.0005f;
+	float ar = fparams.params[3] > 0 ? fparams.params[3] : 0.002f;
+	for (int i = 0; i < 3; i++)
+	{
+		kf_p[i] = glm::fvec3(r * r, 0, 1.f);
+		kf_ap[i] = glm::fvec3(ar * ar, 0, 10.f);
+	}
+}
+
+void rb_pose_filter::Update(const double t, glm::fvec3& _pos, glm::fquat& _q)
+{
+	if (fparams.type == RB_FILTER_NONE) return;
+
+	if (is_first || t - prev_t > RB_FILTER_RESET_GAP || t < prev_t)
+	{
+		is_first = false;
+		prev_t = t;
+		Reset(_pos, _q);
+		if (fparams.type != RB_FILTER_BOX) return;
+	}
+	float dt = std::max((float)(t - prev_t), 1e-4f);
+	prev_t = t;
+
+	switch (fparams.type)
+	{
+	case RB_FILTER_BOX:
+	{
+		int n = std::min(std::max((int)fparams.params[0], 1), RB_FILTER_MAX_WINDOW);
+		glm::fvec4 qv(_q.x, _q.y, _q.z, _q.w);
+		glm::fvec4 q_ref = box_count > 0 ? box_qt_sum : qv;
+		if (glm::dot(qv, q_ref) < 0) qv = -qv; // same hemisphere as the running mean
+
+		if (box_count == n)
+		{
+			box_pos_sum -= box_pos[box_next];
+			box_qt_sum -= box_qt[box_next];
+		}
+		else box_count++;
+		box_pos[box_next] = _pos;
+		box_qt[box_next] = qv;
+		box_pos_sum += _pos;
+		box_qt_sum += qv;
+		box_next = (box_next + 1) % n;
+
+		if (box_next == 0)
+		{
+			// re-sum once per window to drop the float drift of the running sums (amortized O(1))
+			box_pos_sum = glm::fvec3(0);
+			box_qt_sum = glm::fvec4(0);
+			for (int i = 0; i < box_count; i++)
+			{
+				box_pos_sum += box_pos[i];
+				box_qt_sum += box_qt[i];
+			}
+		}
+
+		pos = box_pos_sum / (float)box_count;
+		glm::fvec4 qm = glm::normalize(box_qt_sum);
+		q = glm::fquat(qm.w, qm.x, qm.y, qm.z);
+		break;
+	}
+	case RB_FILTER_EMA:
+	{
+		float a = std::min(std::max(fparams.params[0], 0.001f), 1.f);
+		pos += (_pos - pos) * a;
+		q = glm::slerp(q, _q, a);
+		break;
+	}
+	case RB_FILTER_ONE_EURO:
+	{
+		float min_cutoff = fparams.params[0] > 0 ? fparams.params[0] : 1.f;
+		float beta = fparams.params[1];
+		float d_cutoff = fparams.params[2] > 0 ? fparams.params[2] : 1.f;
+		float a_d = smoothing_alpha(d_cutoff, dt);
+
+		oe_dpos += ((_pos - pos) / dt - oe_dpos) * a_d;
+		pos += (_pos - pos) * smoothing_alpha(min_cutoff + beta * glm::length(oe_dpos), dt);
+
+		oe_dang += (glm::length(log_qt(glm::inverse(q) * _q)) / dt - oe_dang) * a_d;
+		q = glm::slerp(q, _q, smoothing_alpha(min_cutoff + beta * oe_dang, dt));
+		break;
+	}
+	case RB_FILTER_KALMAN_CV:
+	{
+		float sa = fparams.params[0] > 0 ? fparams.params[0] : 5.f;
+		float r = fparams.params[1] > 0 ? fparams.params[1] : 0.0005f;
+		float asa = fparams.params[2] > 0 ? fparams.params[2] : 20.f;
+		float ar = fparams.params[3] > 0 ? fparams.params[3] : 0.002f;
+
+		for (int i = 0; i < 3; i++)
+		{
+			float x = pos[i] + kf_vel[i] * dt;
+			kalman_cv_axis(x, kf_vel[i], kf_p[i], _pos[i], dt, sa, r);
+			pos[i] = x;
+		}
+
+		// rotation : predicted with the body angular velocity, corrected in the tangent space of the prediction
+		glm::fquat q_pred = glm::normalize(q * exp_qt(kf_angvel * dt));
+		glm::fvec3 y = log_qt(glm::inverse(q_pred) * _q);
+		glm::fvec3 dtheta;
+		for (int i = 0; i < 3; i++)
+		{
+			float x = 0;
+			kalman_cv_axis(x, kf_angvel[i], kf_ap[i], y[i], dt, asa, ar);
+			dtheta[i] = x;
+		}
+		q = glm::normalize(q_pred * exp_qt(dtheta));
+		break;
+	}
+	default: return;
+	}
+
+	_pos = pos;
+	_q = q;
+}
+
+rb_filter_report EvaluateRbFilter(const rb_filter_params& fparams, const double* time_stamps, const glm::fvec3* pos_list, const glm::fquat* q_list, const int num_samples)
+{
+	rb_filter_report report = {};
+	if (num_samples < 3) return report;
+
+	rb_pose_filter filter(fparams);
+	std::vector<glm::fvec3> f_pos(num_samples);
+	std::vector<glm::fquat> f_q(num_samples);
+	for (int i = 0; i < num_samples; i++)
+	{
+		f_pos[i] = pos_list[i];
+		f_q[i] = q_list[i];
+		filter.Update(time_stamps[i], f_pos[i], f_q[i]);
+	}
+
+	double sum_pos = 0, sum_ang = 0;
+	glm::fvec3 prev_w = log_qt(glm::inverse(f_q[0]) * f_q[1]);
+	for (int i = 1; i < num_samples - 1; i++)
+	{
+		glm::fvec3 d2 = f_pos[i + 1] - 2.f * f_pos[i] + f_pos[i - 1];
+		sum_pos += glm::dot(d2, d2);
+		glm::fvec3 w = log_qt(glm::inverse(f_q[i]) * f_q[i + 1]);
+		sum_ang += glm::dot(w - prev_w, w - prev_w);
+		prev_w = w;
+	}
+	report.jitter_pos_mm = (float)(sqrt(sum_pos / (num_samples - 2)) * 1000.0);
+	report.jitter_ang_deg = (float)glm::degrees(sqrt(sum_ang / (num_samples - 2)));
+
+	// lag : shift (1 ms steps up to 200 ms) minimizing the RMS distance between filtered(t) and raw(t - shift)
+	report.lag_ms = 0;
+	report.rms_err_mm = 1e10f;
+	for (int shift_ms = 0; shift_ms <= 200; shift_ms++)
+	{
+		double shift = shift_ms * 0.001, sum_err = 0;
+		int count = 0, j = 0;
+		for (int i = 0; i < num_samples; i++)
+		{
+			double t = time_stamps[i] - shift;
+			if (t < time_stamps[0]) continue;
+			while (j + 1 < num_samples - 1 && time_stamps[j + 1] <= t) j++;
+			double dt = time_stamps[j + 1] - time_stamps[j];
+			float a = dt > 0 ? (float)std::min(std::max((t - time_stamps[j]) / dt, 0.0), 1.0) : 0.f;
+			glm::fvec3 d = f_pos[i] - glm::mix(pos_list[j], pos_list[j + 1], a);
+			sum_err += glm::dot(d, d);
+			count++;
+		}
+		if (count == 0) break;
+		float rms_err_mm = (float)(sqrt(sum_err / count) * 1000.0);
+		if (rms_err_mm < report.rms_err_mm)
+		{
+			report.rms_err_mm = rms_err_mm;
+			report.lag_ms = (float)shift_ms;
+		}
+	}
+	return report;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtx/quaternion.hpp>
+
+// rigid body pose filters, every filter is O(1) per sample (no re-folding of a window)
+enum RbFilterType
+{
+	RB_FILTER_NONE = 0,
+	RB_FILTER_BOX,			// params : { window size (samples, <= RB_FILTER_MAX_WINDOW) }
+	RB_FILTER_EMA,			// params : { alpha (0, 1] }
+	RB_FILTER_ONE_EURO,		// params : { min cutoff (Hz), beta, derivative cutoff (Hz) }
+	RB_FILTER_KALMAN_CV,	// params : { accel noise (m/s^2), meas. noise (m), angular accel noise (rad/s^2), angular meas. noise (rad) }
+	RB_FILTER_COUNT
+};
+
+#define RB_FILTER_MAX_WINDOW 64
+#define RB_FILTER_MAX_PARAMS 4
+
+struct rb_filter_params
+{
+	RbFilterType type;
+	float params[RB_FILTER_MAX_PARAMS];
+
+	rb_filter_params() { type = RB_FILTER_NONE; params[0] = params[1] = params[2] = params[3] = 0; }
+	rb_filter_params(const RbFilterType _type, const float p0 = 0, const float p1 = 0, const float p2 = 0, const float p3 = 0)
+	{
+		type = _type; params[0] = p0; params[1] = p1; params[2] = p2; params[3] = p3;
+	}
+};
+
+class rb_pose_filter
+{
+private:
+	rb_filter_params fparams;
+	bool is_first;
+	double prev_t;
+	glm::fvec3 pos;
+	glm::fquat q;
+
+	// BOX (running sums over a ring of the last n samples)
+	int box_count, box_next;
+	glm::fvec3 box_pos[RB_FILTER_MAX_WINDOW];
+	glm::fvec4 box_qt[RB_FILTER_MAX_WINDOW];
+	glm::fvec3 box_pos_sum;
+	glm::fvec4 box_qt_sum;
+
+	// ONE_EURO (filtered derivatives)
+	glm::fvec3 oe_dpos;
+	float oe_dang;
+
+	// KALMAN_CV (per axis [x, v] with 2x2 covariance, rotation in the tangent space of q)
+	glm::fvec3 kf_vel, kf_angvel;
+	glm::fvec3 kf_p[3], kf_ap[3]; // (p00, p01, p11) per axis
+
+	void Reset(const glm::fvec3& _pos, const glm::fquat& _q);
+
+public:
+	rb_pose_filter() { Configure(rb_filter_params()); }
+	rb_pose_filter(const rb_filter_params& _fparams) { Configure(_fparams); }
+
+	void Configure(const rb_filter_params& _fparams);
+	const rb_filter_params& GetParams() const { return fparams; }
+
+	// t : seconds (monotonic), in/out pose
+	void Update(const double t, glm::fvec3& _pos, glm::fquat& _q);
+};
+
+struct rb_filter_report
+{
+	float jitter_pos_mm;	// RMS of the second difference of the filtered positions
+	float jitter_ang_deg;	// RMS of the second difference of the filtered angles
+	float lag_ms;			// time shift that best aligns the filtered track to the raw track
+	float rms_err_mm;		// RMS distance to the raw track at that shift
+};
+
+// replays recorded poses through the filter (offline harness)
+rb_filter_report EvaluateRbFilter(const rb_filter_params& fparams, const double* time_stamps, const glm::fvec3* pos_list, const glm::fquat* q_list, const int num_samples);
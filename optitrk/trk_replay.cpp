@@ -0,0 +1,181 @@
+#include "trk_replay.h"
+
+#include <string.h>
+#include <chrono>
+#include <algorithm>
+
+// track_info serial buffer (kar_helpers.hpp) : magic, version, num_mks, num_lfrms, then the markers and the rigid bodies
+// the frames recorded before the header start at num_mks
+#define TRK_SERIAL_MAGIC 0x4b52544b // 'KTRK'
+#define TRK_SERIAL_VERSION 2
+// size of one rigid body record : name[100], bool, fmat4x4
+#define TRK_SERIAL_RB_UNIT (100 + sizeof(bool) + sizeof(float) * 16)
+
+static double ReplayClockMs()
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool trk_replay::Open(const std::string& file_path, const TrkReplayMode _mode, const double _speed)
+{
+	Close();
+	if (_mode < TRK_REPLAY_RECORDED || _mode >= TRK_REPLAY_COUNT) return false;
+	if (!reader.Open(file_path)) return false;
+	if (reader.GetNumFrames() == 0)
+	{
+		reader.Close();
+		return false;
+	}
+
+	mode = _mode;
+	speed = _speed > 0 ? _speed : 1.0;
+	num_frames = reader.GetNumFrames();
+	cursor = -1;
+	clock_started = false;
+	t_rec_start = reader.GetEntry(0).t_ms;
+	frame = trk_replay_frame();
+	return true;
+}
+
+void trk_replay::Close()
+{
+	reader.Close();
+	num_frames = 0;
+	cursor = -1;
+	clock_started = false;
+	frame = trk_replay_frame();
+}
+
+int trk_replay::UpdateCursor()
+{
+	if (mode != TRK_REPLAY_RECORDED) return cursor;
+
+	std::lock_guard<std::mutex> lock(clock_lock);
+	if (!clock_started) return -1;
+	// last frame recorded at or before the replay clock
+	const double t_rec = t_rec_start + (ReplayClockMs() - t_start) * speed;
+	int idx = reader.FindFrame(t_rec);
+	if (idx >= num_frames || reader.GetEntry(idx).t_ms > t_rec) idx--;
+	cursor = std::min(std::max(idx, 0), num_frames - 1);
+	return cursor;
+}
+
+int trk_replay::GetCursor(double* t_ms)
+{
+	const int idx = IsOpen() ? UpdateCursor() : -1;
+	if (t_ms) *t_ms = idx >= 0 ? reader.GetEntry(idx).t_ms : 0;
+	return idx;
+}
+
+int trk_replay::Step(const int num_steps)
+{
+	if (!IsOpen() || mode == TRK_REPLAY_RECORDED) return GetCursor();
+	int idx = cursor.load();
+	int next_idx;
+	do
+	{
+		next_idx = std::min(std::max(idx + num_steps, 0), num_frames - 1);
+	} while (!cursor.compare_exchange_weak(idx, next_idx));
+	return next_idx;
+}
+
+bool trk_replay::UpdateFrame()
+{
+	if (!IsOpen()) return false;
+	if (mode == TRK_REPLAY_RECORDED)
+	{
+		std::lock_guard<std::mutex> lock(clock_lock);
+		if (!clock_started)
+		{
+			clock_started = true;
+			t_start = ReplayClockMs();
+		}
+	}
+
+	const int idx = UpdateCursor();
+	if (idx < 0) return false;
+	if (idx == frame.frame_idx) return true;
+	return Decode(idx);
+}
+
+bool trk_replay::Decode(const int frame_idx)
+{
+	if (!reader.ReadTrack(frame_idx, trk_buf) || trk_buf.size() < 8) return false;
+	const char* buf = trk_buf.data();
+	size_t offset = 0;
+	int magic;
+	memcpy(&magic, &buf[0], sizeof(int));
+	if (magic == TRK_SERIAL_MAGIC)
+	{
+		int version = 0;
+		if (trk_buf.size() >= 16) memcpy(&version, &buf[4], sizeof(int));
+		if (version != TRK_SERIAL_VERSION) return false;
+		offset = 8;
+	}
+	int num_mks, num_rbs;
+	memcpy(&num_mks, &buf[offset], sizeof(int));
+	memcpy(&num_rbs, &buf[offset + 4], sizeof(int));
+	offset += 8;
+	const size_t mk_unit = sizeof(float) * 3 + sizeof(float) + 128 / 8;
+	if (num_mks < 0 || num_rbs < 0 || trk_buf.size() < offset + mk_unit * num_mks + TRK_SERIAL_RB_UNIT * num_rbs) return false;
+
+	frame.frame_idx = frame_idx;
+	frame.t_ms = reader.GetEntry(frame_idx).t_ms;
+
+	frame.mk_xyz.resize(num_mks * 3);
+	frame.mk_residue.resize(num_mks);
+	frame.mk_cid.resize(num_mks);
+	if (num_mks > 0)
+	{
+		memcpy(&frame.mk_xyz[0], &buf[offset], sizeof(float) * 3 * num_mks);
+		offset += sizeof(float) * 3 * num_mks;
+		memcpy(&frame.mk_residue[0], &buf[offset], sizeof(float) * num_mks);
+		offset += sizeof(float) * num_mks;
+		memcpy(&frame.mk_cid[0], &buf[offset], (128 / 8) * num_mks);
+		offset += (128 / 8) * num_mks;
+	}
+
+	frame.rb_names.resize(num_rbs);
+	frame.rb_detected.resize(num_rbs);
+	frame.rb_mats.resize(num_rbs * 16);
+	for (int i = 0; i < num_rbs; i++, offset += TRK_SERIAL_RB_UNIT)
+	{
+		char name[100];
+		memcpy(name, &buf[offset], sizeof(name));
+		name[99] = 0;
+		frame.rb_names[i] = name;
+		frame.rb_detected[i] = *(const bool*)&buf[offset + 100];
+		memcpy(&frame.rb_mats[i * 16], &buf[offset + 100 + sizeof(bool)], sizeof(float) * 16);
+	}
+	return true;
+}
+
+int trk_replay::FindRigidBody(const std::string& name) const
+{
+	for (int i = 0; i < (int)frame.rb_names.size(); i++)
+		if (frame.rb_names[i] == name) return i;
+	return -1;
+}
+
+bool trk_replay::GetRigidBody(const int rb_idx, float* mat_rb2ws, std::string* rb_name) const
+{
+	if (rb_idx < 0 || rb_idx >= (int)frame.rb_names.size()) return false;
+	if (rb_name) *rb_name = frame.rb_names[rb_idx];
+	if (!frame.rb_detected[rb_idx]) return false;
+	memcpy(mat_rb2ws, &frame.rb_mats[rb_idx * 16], sizeof(float) * 16);
+	return true;
+}
+
+int trk_replay::GetMarkers(const int max_mks, float* mk_xyz_array, float* mk_residual_array, std::bitset<128>* mk_cid_array) const
+{
+	const int num_mks = std::min((int)frame.mk_residue.size(), max_mks);
+	if (num_mks <= 0) return 0;
+	memcpy(mk_xyz_array, &frame.mk_xyz[0], sizeof(float) * 3 * num_mks);
+	if (mk_residual_array) memcpy(mk_residual_array, &frame.mk_residue[0], sizeof(float) * num_mks);
+	if (mk_cid_array)
+	{
+		for (int i = 0; i < num_mks; i++)
+			mk_cid_array[i] = frame.mk_cid[i];
+	}
+	return num_mks;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <bitset>
+#include <mutex>
+#include <atomic>
+
+#include "../ar_settings/Recorder.h"
+#include "optitrack.h" // TrkReplayMode
+
+// replay backend of optitrk : the tracking stream of a recorded session (.krec, ar_settings/Recorder.h) stands in for Motive
+// the replay cursor (frame index) is also followed by the image replay of rs_settings, both serve the same recorded frame
+
+// tracking part of one recorded frame (track_info serial layout, see kar_helpers.hpp)
+struct trk_replay_frame
+{
+	int frame_idx;
+	double t_ms;
+	std::vector<float> mk_xyz;		// 3 floats per marker
+	std::vector<float> mk_residue;
+	std::vector<std::bitset<128>> mk_cid;
+	std::vector<std::string> rb_names;
+	std::vector<bool> rb_detected;
+	std::vector<float> rb_mats;		// glm::fmat4x4 (16 floats) per rigid body
+
+	trk_replay_frame() { frame_idx = -1; t_ms = 0; }
+};
+
+class trk_replay
+{
+private:
+	session_reader reader;
+	TrkReplayMode mode;
+	double speed;
+	int num_frames;
+
+	std::atomic<int> cursor;		// -1 : before the first frame
+	std::mutex clock_lock;
+	bool clock_started;
+	double t_start;					// wall clock (ms) of the first UpdateFrame, RECORDED
+	double t_rec_start;				// recorded time of the first frame
+
+	// UpdateFrame / Get* (tracker thread)
+	trk_replay_frame frame;
+	std::vector<char> trk_buf;
+
+	int UpdateCursor();
+	bool Decode(const int frame_idx);
+
+public:
+	trk_replay() { mode = TRK_REPLAY_RECORDED; speed = 1.0; num_frames = 0; cursor = -1; clock_started = false; t_start = t_rec_start = 0; }
+
+	bool Open(const std::string& file_path, const TrkReplayMode _mode, const double _speed = 1.0);
+	void Close();
+	bool IsOpen() const { return num_frames > 0; }
+	TrkReplayMode GetMode() const { return mode; }
+	int GetNumFrames() const { return num_frames; }
+
+	// the cursor frame (RECORDED : moved to the replay clock), t_ms (optional) : its recorded time
+	int GetCursor(double* t_ms = NULL);
+	// FAST / STEP : moves the cursor by num_steps (clamped to the recorded frames), returns the new cursor
+	int Step(const int num_steps);
+
+	// decodes the cursor frame if it changed, false before the first frame
+	bool UpdateFrame();
+	const trk_replay_frame& GetFrame() const { return frame; }
+	int FindRigidBody(const std::string& name) const;
+	// false : not detected in the frame (mat_rb2ws is not written)
+	bool GetRigidBody(const int rb_idx, float* mat_rb2ws, std::string* rb_name) const;
+	int GetMarkers(const int max_mks, float* mk_xyz_array, float* mk_residual_array, std::bitset<128>* mk_cid_array) const;
+};
@@ -204,7 +204,7 @@ int main__()
 
 			//cout << cur_is_rsrb_detected << ", " << cur_is_probe_detected << endl;
 
-			optitrk::GetMarkersLocation(&cur_trk_info.mk_xyz_list, &cur_trk_info.mk_residue_list, &cur_trk_info.mk_cid_list);
+			cur_trk_info.num_mks = optitrk::GetMarkersLocationArray(MAX_TRK_MKS, (float*)cur_trk_info.mk_xyz, cur_trk_info.mk_residue, cur_trk_info.mk_cid);
 			cur_trk_info.is_updated = true;
 			track_que.push(cur_trk_info);
 		}
@@ -348,9 +348,7 @@ int main__()
 
 						vzm::ObjStates cobjstate;
 						*(glm::fmat4x4*) cobjstate.os2ws = mat_sstool2ws;
-						vzm::ReplaceOrAddSceneObject(ginfo.ws_scene_id, ss_tool_info.ss_tool_guide_points_id, cobjstate);
-						vzm::ReplaceOrAddSceneObject(ginfo.rs_scene_id, ss_tool_info.ss_tool_guide_points_id, cobjstate);
-						vzm::ReplaceOrAddSceneObject(ginfo.stg_scene_id, ss_tool_info.ss_tool_guide_points_id, cobjstate);
+						scene_mirror::SetStates(MS_WS | MS_RS | MS_STG, ss_tool_info.ss_tool_guide_points_id, cobjstate);
 					}
 				}
 			}
@@ -51,7 +51,7 @@ using namespace cv;
 #include <librealsense2/rs.hpp> // Include RealSense Cross Platform API
 #include <librealsense2/rsutil.h>
 
-int main()
+int main(int argc, char* argv[])
 {
 
 #if defined(_DEBUG) | defined(DEBUG)
@@ -59,7 +59,15 @@ int main()
 #endif	
 
 	vzm::InitEngineLib();
-	if (!optitrk::InitOptiTrackLib())
+	// replay of a recorded session instead of Motive and the RealSense : <exe> session.krec [recorded | fast | step]
+	const bool use_replay = argc > 1;
+	if (use_replay)
+	{
+		string replay_mode = argc > 2 ? argv[2] : "recorded";
+		if (!optitrk::InitOptiTrackReplay(argv[1], replay_mode == "fast" ? TRK_REPLAY_FAST : replay_mode == "step" ? TRK_REPLAY_STEP : TRK_REPLAY_RECORDED))
+			return 1;
+	}
+	else if (!optitrk::InitOptiTrackLib())
 	{
 		printf("Unable to license Motive API\n");
 		return 1;
@@ -86,7 +94,13 @@ int main()
 	const int ws_w = 640;
 	const int ws_h = 480;
 
-	rs_settings::InitializeRealsense(true, false, rs_w, rs_h, eye_w, eye_h);
+	if (use_replay)
+	{
+		if (!rs_settings::InitializeRealsenseReplay(argv[1], rs_w, rs_h))
+			return 1;
+	}
+	else
+		rs_settings::InitializeRealsense(true, false, rs_w, rs_h, eye_w, eye_h);
 	rs_settings::RunRsThread(original_data, filtered_data, eye_data);
 	//rs2_intrinsics rgb_intrinsics, depth_intrinsics;
 	//rs2_extrinsics rgb_extrinsics;
@@ -118,9 +132,11 @@ int main()
 	int operation_step = 0;
 #define NUM_RBS 7
 	std::thread tracker_processing_thread([&]() {
+		profiler::SetThreadName("tracker");
 		while (tracker_alive)
 		{
 			Sleep(postpone);
+			PROF_ZONE("tracker sample");
 			optitrk::UpdateFrame();
 			track_info cur_trk_info;
 			static string _rb_names[NUM_RBS] = { "rs_cam" , "marker", "probe" , "spine" , "tool_1" , "tool_2", "tool_3" };
@@ -140,7 +156,7 @@ int main()
 
 			//cout << cur_is_rsrb_detected << ", " << cur_is_probe_detected << endl;
 
-			optitrk::GetMarkersLocation(&cur_trk_info.mk_xyz_list, &cur_trk_info.mk_residue_list, &cur_trk_info.mk_cid_list);
+			cur_trk_info.num_mks = optitrk::GetMarkersLocationArray(MAX_TRK_MKS, (float*)cur_trk_info.mk_xyz, cur_trk_info.mk_residue, cur_trk_info.mk_cid);
 			cur_trk_info.is_updated = true;
 			track_que.push(cur_trk_info);
 		}
@@ -154,28 +170,12 @@ int main()
 	bool show_calib_frames = true;
 	bool record_info = false;
 	bool show_pc = false;
+	bool continuous_icp = false;
 	bool show_workload = false;
 	bool is_ws_pick = false;
 	string probe_name = "probe";
 	PROBE_MODE probe_mode = DEFAULT;
 
-	auto DisplayTimes = [&show_workload](const LARGE_INTEGER lIntCntStart, const string& _test)
-	{
-		if (!show_workload) return;
-		LARGE_INTEGER lIntFreq, lIntCntEnd;
-		QueryPerformanceFrequency(&lIntFreq);
-		QueryPerformanceCounter(&lIntCntEnd);
-		double dRunTime1 = (lIntCntEnd.QuadPart - lIntCntStart.QuadPart) / (double)(lIntFreq.QuadPart);
-
-		cout << _test << " : " << 1. / dRunTime1 << " fps" << endl;
-	};
-	auto GetPerformanceFreq = []() -> LARGE_INTEGER
-	{
-		LARGE_INTEGER lIntCntFreq;
-		QueryPerformanceCounter(&lIntCntFreq);
-		return lIntCntFreq;
-	};
-
 #ifdef __RECORD_VER
 	// fill record_trk_info and record_rsimg
 #endif
@@ -190,9 +190,13 @@ int main()
 	ginfo.custom_pos_file_paths["tool_3"] = preset_path + "..\\Preset\\tool_3_se.txt";
 	var_settings::LoadPresets();
 
+	frame_latency_stats replay_stats;
+	profiler::SetEnabled(show_workload);
 	while (key_pressed != 'q' && key_pressed != 27)
 	{
-		LARGE_INTEGER frq_begin = GetPerformanceFreq();
+		// the zones of the previous frame, all threads
+		profiler::Collect();
+		PROF_ZONE("frame");
 		bool reset_calib = false;
 		bool write_recoded_info = false;
 		bool recompile_hlsl = false;
@@ -204,13 +208,36 @@ int main()
 		case 'r': recompile_hlsl = true; cout << "Recompile Shader!" << endl; break;
 		case 'v': show_calib_frames = !show_calib_frames; break;
 		case 'p': show_pc = !show_pc; break;
+		case 'i': continuous_icp = !continuous_icp; var_settings::SetContinuousICP(continuous_icp);
+			cout << "continuous ICP : " << (continuous_icp ? "on (with the point cloud, 'p')" : "off") << endl; break;
 		case 'e': show_apis_console = !show_apis_console; break;
 		case 'm': show_mks = !show_mks; break;
 		case 's': show_csection = !show_csection; break;
 		case 'x': reset_calib = true; break;
 		case 'd': record_info = !record_info; break;
 		case 'w': write_recoded_info = true; break;
-		case 'f': show_workload = !show_workload; break;
+		case 'f': show_workload = !show_workload;
+			// profiling follows the workload display, the samples since enabled are reported and exported when it is turned off
+			profiler::SetEnabled(show_workload);
+			if (!show_workload)
+			{
+				profiler::Report();
+				profiler::ExportChromeTrace();
+				long long calls_issued, calls_elided;
+				scene_mirror::GetMirrorStats(calls_issued, calls_elided, true);
+				std::cout << "scene states : " << calls_issued << " vzm calls issued, " << calls_elided << " elided (since the last report)" << endl;
+				double prim_requests, prim_builds;
+				ginfo.prims.GetStats(prim_requests, prim_builds, true);
+				std::cout << "primitives : " << prim_builds << " geometry builds per frame (" << prim_requests << " without the cache)" << endl;
+				long long views_run, views_skipped;
+				var_settings::GetViewStats(views_run, views_skipped, true);
+				std::cout << "views : " << views_run << " run, " << views_skipped << " skipped (inputs unchanged)" << endl;
+				double icp_refinements, icp_iterations;
+				float icp_residual_mm;
+				var_settings::GetICPStats(icp_refinements, icp_iterations, icp_residual_mm, true);
+				std::cout << "icp : " << icp_refinements << " refinements/s, " << icp_iterations << " iterations/s, residual " << icp_residual_mm << " mm" << endl;
+			}
+			break;
 		case 'c': is_ws_pick = !is_ws_pick; break;
 		case '`':
 			optitrk::SetRigidBodyEnabledbyName("tool_1", false);
@@ -276,6 +303,7 @@ int main()
 			break; 
 		case ',': line_guide_idx = max(line_guide_idx - 1, 0); break;
 		case '.': line_guide_idx = min(line_guide_idx + 1, (int)ginfo.guide_lines_target_rbs.size() - 1); break;
+		case 'n': optitrk::StepReplay(1); break; // replay STEP mode
 		//case 'i': insert = true; break;
 		}
 		vzm::SetRenderTestParam("_bool_ReloadHLSLObjFiles", recompile_hlsl, sizeof(bool), -1, -1);
@@ -298,8 +326,6 @@ int main()
 
 		if (trk_info.is_updated && current_frameset)
 		{
-			DisplayTimes(frq_begin, "device_stream_load");
-
 			var_settings::UpdateTrackInfo(&trk_info, probe_name, probe_mode);
 
 			auto current_color_frame = current_frameset.get_color_frame();
@@ -332,6 +358,17 @@ int main()
 			SetCustomTools(ginfo.dst_tool_name, operation_step == 9 ? ONLY_RBFRAME : ONLY_PIN_POS, ginfo, glm::fvec3(1, 1, 0), operation_step >= 7);
 			
 			var_settings::RenderAndShowWindows(show_workload, image_rs_bgr);
+			if (use_replay)
+			{
+				// replay benchmark : frames per second and capture (injection) to display latency
+				if (replay_stats.Add(rs_settings::GetCaptureTimeMs(current_color_frame), GetMonotonicTimeMs()))
+				{
+					long long frames_fed, frames_dropped;
+					rs_settings::GetReplayStats(frames_fed, frames_dropped);
+					cout << "replay frame " << optitrk::GetReplayFrame() << " : " << replay_stats.fps << " fps, latency " << replay_stats.mean_ms << " ms (max "
+						<< replay_stats.peak_ms << " ms), fed " << frames_fed << ", dropped " << frames_dropped << endl;
+				}
+			}
 		}
 
 #ifdef EYE_VIS_RS
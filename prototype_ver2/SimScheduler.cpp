@@ -0,0 +1,123 @@
+#include "SimScheduler.h"
+#include "Simulation.h"
+
+#include <chrono>
+#include <thread>
+
+#define SCHED_MAX_SUB_STEPS 4
+#define SCHED_STATS_WINDOW 1.0		// seconds
+#define SCHED_SLEEP_MARGIN 0.002	// seconds, below this the wait yields instead of sleeping (sleep granularity)
+
+static double steadyClockSec()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void sleepSec(double sec)
+{
+	if (sec <= 0) { std::this_thread::yield(); }
+	else { std::this_thread::sleep_for(std::chrono::duration<double>(sec)); }
+}
+
+SimScheduler::SimScheduler(Simulation* sim)
+{
+	m_sim = sim;
+	m_clock = steadyClockSec;
+	m_sleep = sleepSec;
+	m_maxSubSteps = SCHED_MAX_SUB_STEPS;
+
+	m_running = false;
+	m_lastTime = m_accumulator = m_deadline = 0;
+
+	m_step = 0;
+	m_dropped = 0;
+	m_windowStart = 0;
+	m_windowSteps = 0;
+	m_windowStepTime = 0;
+	m_window = 0;
+	m_stepsPerSec = 0;
+	m_msPerStep = 0;
+
+	SimState init = {};
+	for (int i = 0; i < 3; i++) { m_states.buffer(i) = init; }
+}
+
+void SimScheduler::setClock(const ClockFunc& clock, const SleepFunc& sleep)
+{
+	m_clock = clock;
+	m_sleep = sleep;
+	m_running = false;
+}
+
+int SimScheduler::tick(bool enabled)
+{
+	const double timeStep = m_sim->getTimeStep();
+	const double now = m_clock();
+	if (!m_running) {
+		m_running = true;
+		m_lastTime = now;
+		m_windowStart = now;
+		m_accumulator = 0;
+	}
+	const double frameTime = now - m_lastTime;
+	m_lastTime = now;
+
+	int steps = 0;
+	if (!enabled) {
+		m_accumulator = 0;
+	}
+	else {
+		m_accumulator += frameTime;
+		while (m_accumulator >= timeStep && steps < m_maxSubSteps) {
+			const double t0 = m_clock();
+			m_sim->stepFixed();
+			m_windowStepTime += m_clock() - t0;
+			m_accumulator -= timeStep;
+			steps++;
+		}
+		// catch-up cap : the steps still due are dropped, the simulation runs slower than the wall clock
+		if (m_accumulator >= timeStep) {
+			long long n = (long long)(m_accumulator / timeStep);
+			m_dropped += n;
+			m_accumulator -= n * timeStep;
+		}
+	}
+	m_step += steps;
+	m_windowSteps += steps;
+	m_deadline = now + timeStep - m_accumulator;
+
+	if (now - m_windowStart >= SCHED_STATS_WINDOW) {
+		m_stepsPerSec = (float)(m_windowSteps / (now - m_windowStart));
+		m_msPerStep = m_windowSteps > 0 ? (float)(m_windowStepTime * 1000.0 / m_windowSteps) : 0.f;
+		m_windowStart = now;
+		m_windowSteps = 0;
+		m_windowStepTime = 0;
+		m_window++;
+		publishState();
+	}
+	else if (steps > 0) {
+		publishState();
+	}
+	return steps;
+}
+
+void SimScheduler::waitNextStep()
+{
+	for (;;) {
+		const double remain = m_deadline - m_clock();
+		if (remain <= 0) { break; }
+		m_sleep(remain > SCHED_SLEEP_MARGIN ? remain - SCHED_SLEEP_MARGIN * 0.5 : 0);
+	}
+}
+
+void SimScheduler::publishState()
+{
+	SimState& state = m_states.writeBuffer();
+	state.step = m_step;
+	state.simTime = m_step * (double)m_sim->getTimeStep();
+	state.stepsPerSec = m_stepsPerSec;
+	state.msPerStep = m_msPerStep;
+	state.dropped = m_dropped;
+	state.window = m_window;
+	m_states.publish();
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+
+class Simulation;	// forward declartions
+
+// single producer / single consumer triple buffer, neither side blocks
+// producer : fill writeBuffer() then publish(), consumer : acquire() then readBuffer()
+// the consumer always gets the newest published buffer, older ones are overwritten
+template <typename T>
+class TripleBuffer
+{
+private:
+	static const int FRESH_BIT = 4;
+
+	T m_buffers[3];
+	int m_write;					// owned by the producer
+	int m_read;						// owned by the consumer
+	std::atomic<int> m_middle;		// last published (FRESH_BIT : not acquired yet)
+
+public:
+	TripleBuffer() : m_write(0), m_read(1), m_middle(2) {}
+
+	T& writeBuffer() { return m_buffers[m_write]; }
+	void publish()
+	{
+		m_write = m_middle.exchange(m_write | FRESH_BIT, std::memory_order_acq_rel) & ~FRESH_BIT;
+	}
+
+	// false when nothing was published since the last acquire (readBuffer() keeps the previous one)
+	bool acquire()
+	{
+		if (!(m_middle.load(std::memory_order_relaxed) & FRESH_BIT)) { return false; }
+		m_read = m_middle.exchange(m_read, std::memory_order_acq_rel) & ~FRESH_BIT;
+		return true;
+	}
+	const T& readBuffer() const { return m_buffers[m_read]; }
+
+	// the three buffers, for the preallocation before the threads start
+	T& buffer(int i) { return m_buffers[i]; }
+};
+
+// published by the deform thread after each tick with steps
+struct SimState
+{
+	long long	step;			// completed steps
+	double		simTime;		// seconds, step * time step
+	// counters of the last full window (about one second)
+	float		stepsPerSec;
+	float		msPerStep;
+	long long	dropped;		// steps skipped by the catch-up cap (total)
+	int			window;			// incremented when the counters above are refreshed
+};
+
+// fixed-timestep scheduler of the deform thread
+// wall time is accumulated and consumed in steps of Simulation::getTimeStep(), at most m_maxSubSteps per tick,
+// the rest of a late tick is dropped (counted) instead of spiraling, then the thread sleeps until the next step is due
+class SimScheduler
+{
+public:
+	typedef std::function<double(void)> ClockFunc;		// seconds, monotonic
+	typedef std::function<void(double)> SleepFunc;		// seconds, <= 0 : yield
+
+private:
+	Simulation*				m_sim;
+	ClockFunc				m_clock;
+	SleepFunc				m_sleep;
+	int						m_maxSubSteps;
+
+	bool					m_running;
+	double					m_lastTime;
+	double					m_accumulator;
+	double					m_deadline;			// clock time of the next due step
+
+	long long				m_step;
+	long long				m_dropped;
+	double					m_windowStart;
+	int						m_windowSteps;
+	double					m_windowStepTime;
+	int						m_window;
+	float					m_stepsPerSec;
+	float					m_msPerStep;
+
+	TripleBuffer<SimState>	m_states;
+
+	void publishState();
+
+public:
+	SimScheduler(Simulation* sim);
+
+	// default : std::chrono::steady_clock and std::this_thread::sleep_for / yield
+	void setClock(const ClockFunc& clock, const SleepFunc& sleep);
+	void setMaxSubSteps(int n) { m_maxSubSteps = n > 0 ? n : 1; }
+	int getMaxSubSteps() const { return m_maxSubSteps; }
+
+	// runs the due steps (0 ~ max sub steps), returns the number of steps
+	// enabled == false : nothing is simulated and no catch-up is kept for the paused time
+	int tick(bool enabled = true);
+	// sleeps (coarse sleep, then yields) until the next step is due
+	void waitNextStep();
+
+	// render thread
+	bool acquireState() { return m_states.acquire(); }
+	const SimState& getState() const { return m_states.readBuffer(); }
+};
@@ -1,5 +1,10 @@
 #include "Simulation.h"
 
+#include "softBodyBake.h"
+#include "../ar_settings/Profiler.h"
+
+#include <chrono>
+
 Simulation::Simulation()
 {
 	fTimeStep = 1.0 / 60.0;
@@ -17,6 +22,7 @@ Simulation::~Simulation()
 void Simulation::destroySimulation()
 {
 	printf("destroySimulation\n");
+	surfaceExport.clear();
 	if(rigidBodies.size()) {
 		for(int i=0, ni=rigidBodies.size(); i<ni; i++) {
 			delete rigidBodies[i];
@@ -49,6 +55,12 @@ void Simulation::initSSUDeform(const char* pcDataRoot)
 	psb->setSimulationSpace(this);
 
 	softBodies.push_back(psb);
+
+	// exported surfaces
+	surfaceExport.addSurface(&psb, 1);
+	if (psb->m_child.size()) {
+		surfaceExport.addSurface(&psb->m_child[0], psb->m_child.size());
+	}
 }
 
 CiSoftBody* Simulation::initSoftBody(const char* pcDataRoot)
@@ -100,54 +112,77 @@ CiSoftBody* Simulation::initSoftBody(const char* pcDataRoot)
 	float kDamping = 0.3;
 
 
-	// material setting //
-	CiSoftBody::Material* pm[2];
-	for (int i = 0; i < 2; i++) {
-		pm[i] = new(btAlignedAlloc(sizeof(CiSoftBody::Material), 16)) CiSoftBody::Material();
-		pm[i]->m_kLST = kLSTg[i];
-		pm[i]->m_kAST = kASTg[i];
-		pm[i]->m_kVST = kVSTg[i];
-	}
-
-	
 	bool bFlipYZ = false;
 	int nStartIdx = 1;
-	
-	btVector3 center = CiSoftBodyHelpers::getCenter(node, nStartIdx, bFlipYZ);
-	btVector3 trans(0, 0, 0);
-	CiSoftBody*	psbTetra1 = CiSoftBodyHelpers::CreateFromTetGenFile(ele, face, node, link, false, true, true, fMassg[0], pm[0], nStartIdx, bFlipYZ, 1, true, center, trans);
-	CiSoftBody* psb1 = CiSoftBodyHelpers::generateHybridModel(psbTetra1, obj, bFlipYZ, 1, false, center, trans);
 
-	CiSoftBody*	psbTetra2 = CiSoftBodyHelpers::CreateFromTetGenFile(ele2, face2, node2, link2, false, true, true, fMassg[1], pm[1], nStartIdx, bFlipYZ, 1, false, center, trans);
-	CiSoftBody* psb2 = CiSoftBodyHelpers::generateHybridModel(psbTetra2, obj2, bFlipYZ, 1, false, center, trans);
+	// bake : the initialised model of the files and the parameters above, rebuilt when one of them changes
+	const float bakeParams[] = { fMassg[0], fMassg[1], kLSTg[0], kLSTg[1], kASTg[0], kASTg[1], kVSTg[0], kVSTg[1],
+		(float)nIterationCnt, kDamping, (float)bFlipYZ, (float)nStartIdx };
+	const char* bakeSources[] = { node, ele, face, link, obj, node2, ele2, face2, link2, obj2, hetero };
+	const int nBakeSources = sizeof(bakeSources) / sizeof(bakeSources[0]);
+	char bake[MAX_PATH];
+	sprintf_s(bake, sizeof(char)*MAX_PATH, "%s\\brain-ventricle.bake", pcDataRoot);
+
+	std::chrono::steady_clock::time_point tStart = std::chrono::steady_clock::now();
+	CiSoftBody* psb = CiSoftBodyBake::load(bake, CiSoftBodyBake::sourceKey(bakeSources, nBakeSources, bakeParams, sizeof(bakeParams)));
+	if (psb) {
+		printf("== baked model loaded (%.1f ms) ==\n", std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tStart).count());
+	}
+	else {
+		// material setting //
+		CiSoftBody::Material* pm[2];
+		for (int i = 0; i < 2; i++) {
+			pm[i] = new(btAlignedAlloc(sizeof(CiSoftBody::Material), 16)) CiSoftBody::Material();
+			pm[i]->m_kLST = kLSTg[i];
+			pm[i]->m_kAST = kASTg[i];
+			pm[i]->m_kVST = kVSTg[i];
+		}
 
-	CiSoftBody* psb = CiSoftBodyHelpers::mergeTetra(psbTetra1, psbTetra2, hetero);
-	
 	
-	/*
-	bool bFlipYZ = false;
-	int nStartIdx = 1;
-	btVector3 center = CiSoftBodyHelpers::getCenter(node, nStartIdx, bFlipYZ);
-	btVector3 trans(0, 0, 0);
-	CiSoftBody*	psb = CiSoftBodyHelpers::CreateFromTetGenFile(ele, face, node, link, false, true, true, fMassg[0], pm[0], nStartIdx, bFlipYZ, 1, true, center, trans);
-	*/
-
-	/// Properties //
-	psb->m_cfg.kDP = kDamping;			// [0-1] Damping Coefficient					  (ΰ ÿ ӵ )
-	psb->m_cfg.m_contactMargin = 1;
-
-	/// Pose Matching //
-	//psb->m_cfg.kMT = 0.02;				// Pose Matching Coefficient (0.02) [0,1]
-	//psb->setPose(false, true);			// When on, the soft body tries to maintain its original volume / shape.
-
-	/// iteration //
-	psb->m_cfg.timescale = 1;				// ð  (ü    ) (0̸ )
-	psb->m_cfg.piterations = nIterationCnt;	// 1϶, stiffness   ߹
-	psb->m_cfg.viterations = 0;
+		btVector3 center = CiSoftBodyHelpers::getCenter(node, nStartIdx, bFlipYZ);
+		btVector3 trans(0, 0, 0);
+		CiSoftBody*	psbTetra1 = CiSoftBodyHelpers::CreateFromTetGenFile(ele, face, node, link, false, true, true, fMassg[0], pm[0], nStartIdx, bFlipYZ, 1, true, center, trans);
+		CiSoftBody* psb1 = CiSoftBodyHelpers::generateHybridModel(psbTetra1, obj, bFlipYZ, 1, false, center, trans);
 
+		CiSoftBody*	psbTetra2 = CiSoftBodyHelpers::CreateFromTetGenFile(ele2, face2, node2, link2, false, true, true, fMassg[1], pm[1], nStartIdx, bFlipYZ, 1, false, center, trans);
+		CiSoftBody* psb2 = CiSoftBodyHelpers::generateHybridModel(psbTetra2, obj2, bFlipYZ, 1, false, center, trans);
 
-	printf("== Constraint ʱⰪ  ==\n");
-	psb->initConstraints();
+		psb = CiSoftBodyHelpers::mergeTetra(psbTetra1, psbTetra2, hetero);
+	
+	
+		/*
+		bool bFlipYZ = false;
+		int nStartIdx = 1;
+		btVector3 center = CiSoftBodyHelpers::getCenter(node, nStartIdx, bFlipYZ);
+		btVector3 trans(0, 0, 0);
+		CiSoftBody*	psb = CiSoftBodyHelpers::CreateFromTetGenFile(ele, face, node, link, false, true, true, fMassg[0], pm[0], nStartIdx, bFlipYZ, 1, true, center, trans);
+		*/
+
+		/// Properties //
+		psb->m_cfg.kDP = kDamping;			// [0-1] Damping Coefficient					  (ΰ ÿ ӵ )
+		psb->m_cfg.m_contactMargin = 1;
+
+		/// Pose Matching //
+		//psb->m_cfg.kMT = 0.02;				// Pose Matching Coefficient (0.02) [0,1]
+		//psb->setPose(false, true);			// When on, the soft body tries to maintain its original volume / shape.
+
+		/// iteration //
+		psb->m_cfg.timescale = 1;				// ð  (ü    ) (0̸ )
+		psb->m_cfg.piterations = nIterationCnt;	// 1϶, stiffness   ߹
+		psb->m_cfg.viterations = 0;
+
+
+		printf("== Constraint ʱⰪ  ==\n");
+		psb->initConstraints();
+		psb->initParallelSolver();	// graph colouring (softbodySolver.cpp), stored with the bake
+		printf("== model built (%.1f ms) ==\n", std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tStart).count());
+
+		// the face, link and het files written by the first build are sources too
+		if (CiSoftBodyBake::save(bake, psb, CiSoftBodyBake::sourceKey(bakeSources, nBakeSources, bakeParams, sizeof(bakeParams)))) {
+			printf("== baked to %s ==\n", bake);
+		}
+	}
+	psb->setSolverMode(CiSoftBody::cfgSolverMode::Parallel);	// graph-coloured batches (softbodySolver.cpp)
 
 	return psb;
 }
@@ -175,12 +210,18 @@ void Simulation::stepPhysics()
 	if (fAccumulator >= fTimeStep)
 	{
 		//printf("stepPhysics (%f %f)\n", fAccumulator, fTimeStep);
-		computeForces();
-		integrate(fTimeStep);
-		updateConstraints(fTimeStep);
+		stepFixed();
 		fAccumulator -= fTimeStep;
 	}
 }
+void Simulation::stepFixed()
+{
+	PROF_ZONE("Simulation::stepFixed");
+	computeForces();
+	integrate(fTimeStep);
+	updateConstraints(fTimeStep);
+	surfaceExport.write();
+}
 void Simulation::computeForces()
 {
 	// gravity //
@@ -191,12 +232,14 @@ void Simulation::computeForces()
 }
 void Simulation::updateConstraints(float fDeltaTime)
 {
+	PROF_ZONE("Simulation::updateConstraints");
 	for (int i = 0; i < softBodies.size(); i++) {
 		softBodies[i]->solveConstraints();
 	}
 }
 void Simulation::integrate(float fDeltaTime)
 {
+	PROF_ZONE("Simulation::integrate");
 	float dt = fDeltaTime;
 
 	for (int i = 0; i < softBodies.size(); i++) {
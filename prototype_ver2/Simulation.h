@@ -7,6 +7,7 @@
 #include "rigidBody.h"
 #include "softbody.h"
 #include "softBodyHelper.h"
+#include "SurfaceExport.h"
 
 #define PI 3.1415926536f
 #define EPSILON  0.0000001f
@@ -24,6 +25,7 @@ private:
 public:
 	btAlignedObjectArray<CiRigidBody*> rigidBodies;
 	btAlignedObjectArray<CiSoftBody*> softBodies;
+	SurfaceExport surfaceExport;	// deformed surfaces for the render thread (0 : brain, 1 : ventricle)
 
 public:
 	Simulation();
@@ -32,6 +34,7 @@ public:
 
 
 	void stepPhysics(void);
+	void stepFixed(void);	// one fTimeStep step, the caller owns the time accumulation (SimScheduler)
 	void computeForces(void);
 	void integrate(float fDeltaTime);
 	void updateConstraints(float fDeltaTime);
@@ -0,0 +1,92 @@
+#include "SurfaceExport.h"
+
+#include <unordered_map>
+
+SurfaceExport::SurfaceExport()
+{
+	m_frame = 0;
+}
+
+void SurfaceExport::clear()
+{
+	m_surfaces.clear();
+	for (int i = 0; i < 3; i++) {
+		m_frames.buffer(i).pos.clear();
+		m_frames.buffer(i).nrl.clear();
+	}
+	m_frame = 0;
+}
+
+int SurfaceExport::addSurface(CiSoftBody* const* bodies, int numBodies)
+{
+	Surface surface;
+	std::unordered_map<const CiSoftBody::Node*, unsigned int> vertexOf;
+	for (int b = 0; b < numBodies; b++) {
+		const CiSoftBody::tFaceArray& faces = bodies[b]->m_surfaceMeshFace;
+		for (int i = 0, ni = faces.size(); i < ni; i++) {
+			for (int j = 0; j < 3; j++) {
+				const CiSoftBody::Node* n = faces[i].m_n[j];
+				auto it = vertexOf.find(n);
+				if (it == vertexOf.end()) {
+					it = vertexOf.insert(std::make_pair(n, (unsigned int)surface.nodes.size())).first;
+					surface.nodes.push_back(n);
+				}
+				surface.indices.push_back(it->second);
+			}
+		}
+	}
+	m_surfaces.push_back(surface);
+
+	// the three frames are sized here, write() does not allocate
+	const size_t numFloats = surface.nodes.size() * 3;
+	for (int i = 0; i < 3; i++) {
+		SurfaceFrame& f = m_frames.buffer(i);
+		f.frame = 0;
+		f.pos.push_back(std::vector<float>(numFloats, 0.f));
+		f.nrl.push_back(std::vector<float>(numFloats, 0.f));
+	}
+	return (int)m_surfaces.size() - 1;
+}
+
+void SurfaceExport::write()
+{
+	if (m_surfaces.empty()) { return; }
+
+	SurfaceFrame& f = m_frames.writeBuffer();
+	for (int s = 0, ns = (int)m_surfaces.size(); s < ns; s++) {
+		const Surface& surface = m_surfaces[s];
+		float* pos = f.pos[s].data();
+		float* nrl = f.nrl[s].data();
+
+		const int nVtx = (int)surface.nodes.size();
+		for (int i = 0; i < nVtx; i++) {
+			const btVector3& x = surface.nodes[i]->m_x;
+			pos[i * 3 + 0] = x.x();
+			pos[i * 3 + 1] = x.y();
+			pos[i * 3 + 2] = x.z();
+			nrl[i * 3 + 0] = nrl[i * 3 + 1] = nrl[i * 3 + 2] = 0;
+		}
+
+		// area weighted vertex normals
+		const unsigned int* idx = surface.indices.data();
+		for (int t = 0, nt = (int)surface.indices.size() / 3; t < nt; t++) {
+			const unsigned int i0 = idx[t * 3] * 3, i1 = idx[t * 3 + 1] * 3, i2 = idx[t * 3 + 2] * 3;
+			const btVector3 a(pos[i0], pos[i0 + 1], pos[i0 + 2]);
+			const btVector3 e1 = btVector3(pos[i1], pos[i1 + 1], pos[i1 + 2]) - a;
+			const btVector3 e2 = btVector3(pos[i2], pos[i2 + 1], pos[i2 + 2]) - a;
+			const btVector3 n = btCross(e1, e2);
+			for (int k = 0; k < 3; k++) {
+				nrl[i0 + k] += n[k];
+				nrl[i1 + k] += n[k];
+				nrl[i2 + k] += n[k];
+			}
+		}
+		for (int i = 0; i < nVtx; i++) {
+			float* v = nrl + i * 3;
+			const float len = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+			if (len > SIMD_EPSILON) { v[0] /= len; v[1] /= len; v[2] /= len; }
+		}
+	}
+	f.frame = ++m_frame;
+	m_frames.publish();
+}
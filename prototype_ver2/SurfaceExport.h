@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vector>
+
+#include "softbody.h"
+#include "SimScheduler.h"	// TripleBuffer
+
+// deformed surfaces of one completed step, xyz per vertex (surface order of SurfaceExport)
+struct SurfaceFrame
+{
+	long long							frame;		// export count
+	std::vector<std::vector<float> >	pos;
+	std::vector<std::vector<float> >	nrl;
+};
+
+// surface export stage of the simulation
+// the deform thread writes the surface vertices (shared nodes merged) and their normals after each step into
+// one of three preallocated frames, the render thread takes the latest finished one without locks
+// the topology (node list, triangle indices) is built once in addSurface() and does not change afterwards
+class SurfaceExport
+{
+private:
+	struct Surface
+	{
+		std::vector<const CiSoftBody::Node*>	nodes;		// unique vertices
+		std::vector<unsigned int>				indices;	// 3 per triangle, into nodes
+	};
+	std::vector<Surface>		m_surfaces;
+	TripleBuffer<SurfaceFrame>	m_frames;
+	long long					m_frame;
+
+public:
+	SurfaceExport();
+
+	// before the deform thread starts
+	// the surface faces (m_surfaceMeshFace) of the bodies become one mesh, returns the surface index
+	int addSurface(CiSoftBody* const* bodies, int numBodies);
+	void clear();
+
+	// deform thread, after a completed step
+	void write();
+
+	// render thread
+	bool acquire() { return m_frames.acquire(); }
+	const SurfaceFrame& getFrame() const { return m_frames.readBuffer(); }
+
+	int getNumSurfaces() const { return (int)m_surfaces.size(); }
+	int getNumVertices(int surface) const { return (int)m_surfaces[surface].nodes.size(); }
+	int getNumTriangles(int surface) const { return (int)m_surfaces[surface].indices.size() / 3; }
+	const unsigned int* getIndices(int surface) const { return m_surfaces[surface].indices.data(); }
+};
@@ -38,6 +38,7 @@ using namespace cv;
 #include "../ar_settings/ArSettings.h"
 
 #include "Simulation.h"
+#include "SimScheduler.h"
 
 // This example will require several standard data-structures and algorithms:
 #define _USE_MATH_DEFINES
@@ -84,6 +85,10 @@ void InitializeVarSettings(GlobalInfo& ginfo)
 	zoom_cam_stg_id = 1;
 	zoom_stg_w = 300;
 	zoom_stg_h = 300;
+
+	// zoom scenes in the state masks of the scene mirror
+	scene_mirror::BindScene(MS_USER_0, zoom_scene_id);
+	scene_mirror::BindScene(MS_USER_1, zoom_scene_stg_id);
 }
 void SetCvWindows(GlobalInfo& ginfo)
 {
@@ -151,58 +156,21 @@ void UpdateModel(GlobalInfo& ginfo, Simulation& s, bool bDrawWireFrame)
 {
 	if (ginfo.is_modelaligned) {
 		// deform ݿ ////////////////////////////////////////////////////////////////////////////////////////////
-		glm::fvec3 *pos_xyz_list, *nrl_xyz_list;
-		unsigned int* idx_prims;
-		int num_vtx, num_prims, stride_idx;
-		glm::fmat3x3 mat_s;
-
-		// brain
-		vzm::GetPModelData(brain_ws_obj_id, (float**)&pos_xyz_list, (float**)&nrl_xyz_list, nullptr, nullptr, num_vtx, &idx_prims, num_prims, stride_idx);
-
-		for (int i = 0, ni = s.softBodies[0]->m_surfaceMeshFace.size(); i < ni; i++) {
-			const CiSoftBody::Face&	f = s.softBodies[0]->m_surfaceMeshFace[i];
-			const btVector3			x[] = { f.m_n[0]->m_x,f.m_n[1]->m_x,f.m_n[2]->m_x };
-
-			glm::fvec3 v0 = glm::fvec3(x[0].getX(), x[0].getY(), x[0].getZ());
-			glm::fvec3 v1 = glm::fvec3(x[1].getX(), x[1].getY(), x[1].getZ());
-			glm::fvec3 v2 = glm::fvec3(x[2].getX(), x[2].getY(), x[2].getZ());
-
-			int j = i * 3;
-			pos_xyz_list[j] = v0;
-			pos_xyz_list[j + 1] = v1;
-			pos_xyz_list[j + 2] = v2;
-		}
-		vzm::GeneratePrimitiveObject((float*)pos_xyz_list, (float*)nrl_xyz_list, NULL, NULL, num_vtx, idx_prims, num_prims, stride_idx, brain_ws_obj_id);
-		delete[] pos_xyz_list;
-		delete[] nrl_xyz_list;
-		delete[] idx_prims;
-
-		// ventricle
-		vzm::GetPModelData(ventricle_ws_obj_id, (float**)&pos_xyz_list, (float**)&nrl_xyz_list, nullptr, nullptr, num_vtx, &idx_prims, num_prims, stride_idx);
-		for (int c = 0; c < s.softBodies[0]->m_child.size(); c++) {
-			for (int i = 0, ni = s.softBodies[0]->m_child[c]->m_surfaceMeshFace.size(); i < ni; i++) {
-				const CiSoftBody::Face&	f = s.softBodies[0]->m_child[c]->m_surfaceMeshFace[i];
-				const btVector3			x[] = { f.m_n[0]->m_x,f.m_n[1]->m_x,f.m_n[2]->m_x };
-
-				glm::fvec3 v0 = glm::fvec3(x[0].getX(), x[0].getY(), x[0].getZ());
-				glm::fvec3 v1 = glm::fvec3(x[1].getX(), x[1].getY(), x[1].getZ());
-				glm::fvec3 v2 = glm::fvec3(x[2].getX(), x[2].getY(), x[2].getZ());
-
-				int j = i * 3;
-				pos_xyz_list[j] = v0;
-				pos_xyz_list[j + 1] = v1;
-				pos_xyz_list[j + 2] = v2;
+		// latest finished surfaces of the deform thread (no lock, the topology is fixed at init)
+		SurfaceExport& surface_export = s.surfaceExport;
+		if (surface_export.acquire()) {
+			const SurfaceFrame& surface_frame = surface_export.getFrame();
+			int surface_obj_ids[2] = { brain_ws_obj_id, ventricle_ws_obj_id };
+			for (int i = 0; i < min(surface_export.getNumSurfaces(), 2); i++) {
+				vzm::GeneratePrimitiveObject(surface_frame.pos[i].data(), surface_frame.nrl[i].data(), NULL, NULL, surface_export.getNumVertices(i),
+					surface_export.getIndices(i), surface_export.getNumTriangles(i), 3, surface_obj_ids[i]);
 			}
 		}
-		vzm::GeneratePrimitiveObject((float*)pos_xyz_list, (float*)nrl_xyz_list, NULL, NULL, num_vtx, idx_prims, num_prims, stride_idx, ventricle_ws_obj_id);
-		delete[] pos_xyz_list;
-		delete[] nrl_xyz_list;
-		delete[] idx_prims;
 
 		// rendering ////////////////////////////////////////////////////////////////////////////////////////////
 		// realsense scene (20201111 -  rs scene state ghost effect Ǿ )
 		vzm::ObjStates model_rs_states, brain_rs_states, ventricle_rs_states;
-		vzm::GetSceneObjectState(ginfo.ws_scene_id, ginfo.model_ws_obj_id, model_rs_states);
+		scene_mirror::GetState(ginfo.ws_scene_id, ginfo.model_ws_obj_id, model_rs_states);
 
 		model_rs_states.color[0] = 1.0; model_rs_states.color[1] = 1.0; model_rs_states.color[2] = 1.0;
 		model_rs_states.color[3] = 1;// 0.1;
@@ -229,8 +197,8 @@ void UpdateModel(GlobalInfo& ginfo, Simulation& s, bool bDrawWireFrame)
 
 		// realsense scene
 		//vzm::ReplaceOrAddSceneObject(ginfo.rs_scene_id, ginfo.model_ws_obj_id, model_rs_states);
-		vzm::ReplaceOrAddSceneObject(ginfo.rs_scene_id, brain_ws_obj_id, brain_rs_states);
-		vzm::ReplaceOrAddSceneObject(ginfo.rs_scene_id, ventricle_ws_obj_id, ventricle_rs_states);
+		scene_mirror::SetState(ginfo.rs_scene_id, brain_ws_obj_id, brain_rs_states);
+		scene_mirror::SetState(ginfo.rs_scene_id, ventricle_ws_obj_id, ventricle_rs_states);
 
 		// world scene
 		vzm::ObjStates model_ws_states, brain_ws_states, ventricle_ws_states;
@@ -257,9 +225,9 @@ void UpdateModel(GlobalInfo& ginfo, Simulation& s, bool bDrawWireFrame)
 		ventricle_ws_states.wire_color[0] = 0.9;	ventricle_ws_states.wire_color[1] = 0.5;	ventricle_ws_states.wire_color[2] = 0.5; ventricle_ws_states.wire_color[3] = 0.2;
 		ventricle_ws_states.color[0] = 1.0; ventricle_ws_states.color[1] = 0; ventricle_ws_states.color[2] = 0; ventricle_ws_states.color[3] = 1.0;
 
-		vzm::ReplaceOrAddSceneObject(ginfo.ws_scene_id, ginfo.model_ws_obj_id, model_ws_states);
-		vzm::ReplaceOrAddSceneObject(ginfo.ws_scene_id, brain_ws_obj_id, brain_ws_states);
-		vzm::ReplaceOrAddSceneObject(ginfo.ws_scene_id, ventricle_ws_obj_id, ventricle_ws_states);
+		scene_mirror::SetState(ginfo.ws_scene_id, ginfo.model_ws_obj_id, model_ws_states);
+		scene_mirror::SetState(ginfo.ws_scene_id, brain_ws_obj_id, brain_ws_states);
+		scene_mirror::SetState(ginfo.ws_scene_id, ventricle_ws_obj_id, ventricle_ws_states);
 
 		// smartglass scene
 		vzm::ObjStates model_stg_states, brain_stg_states, ventricle_stg_states;
@@ -271,13 +239,13 @@ void UpdateModel(GlobalInfo& ginfo, Simulation& s, bool bDrawWireFrame)
 		brain_stg_states.color[3] = 0.8;
 		ventricle_stg_states.color[3] = 1.0;
 
-		vzm::ReplaceOrAddSceneObject(ginfo.stg_scene_id, ginfo.model_ws_obj_id, model_stg_states);
-		vzm::ReplaceOrAddSceneObject(ginfo.stg_scene_id, brain_ws_obj_id, brain_stg_states);
-		vzm::ReplaceOrAddSceneObject(ginfo.stg_scene_id, ventricle_ws_obj_id, ventricle_stg_states);
+		scene_mirror::SetState(ginfo.stg_scene_id, ginfo.model_ws_obj_id, model_stg_states);
+		scene_mirror::SetState(ginfo.stg_scene_id, brain_ws_obj_id, brain_stg_states);
+		scene_mirror::SetState(ginfo.stg_scene_id, ventricle_ws_obj_id, ventricle_stg_states);
 
 		// zoom scene
 		vzm::ObjStates model_zs_states, brain_zs_states, ventricle_zs_states;
-		vzm::GetSceneObjectState(ginfo.ws_scene_id, ginfo.model_ws_obj_id, model_zs_states);
+		scene_mirror::GetState(ginfo.ws_scene_id, ginfo.model_ws_obj_id, model_zs_states);
 
 		//-- model state
 		__cv4__ model_zs_states.color = glm::fvec4(1, 1, 1, 0.2);				
@@ -304,9 +272,9 @@ void UpdateModel(GlobalInfo& ginfo, Simulation& s, bool bDrawWireFrame)
 			ventricle_zs_states.is_wireframe = false;
 		}
 
-		vzm::ReplaceOrAddSceneObject(ginfo.znavi_rs_scene_id, ginfo.model_ws_obj_id, model_zs_states);
-		vzm::ReplaceOrAddSceneObject(ginfo.znavi_rs_scene_id, brain_ws_obj_id, brain_zs_states);
-		vzm::ReplaceOrAddSceneObject(ginfo.znavi_rs_scene_id, ventricle_ws_obj_id, ventricle_zs_states);
+		scene_mirror::SetState(ginfo.znavi_rs_scene_id, ginfo.model_ws_obj_id, model_zs_states);
+		scene_mirror::SetState(ginfo.znavi_rs_scene_id, brain_ws_obj_id, brain_zs_states);
+		scene_mirror::SetState(ginfo.znavi_rs_scene_id, ventricle_ws_obj_id, ventricle_zs_states);
 
 		/*
 		// zoom scene
@@ -399,7 +367,7 @@ void UpdateZoomNavigation(GlobalInfo& ginfo)
 		glm::fvec3 sstool_dir = ginfo.dir_probe_se;
 
 		vzm::ObjStates model_ws_obj_state;
-		vzm::GetSceneObjectState(ginfo.ws_scene_id, ginfo.model_ws_obj_id, model_ws_obj_state);
+		scene_mirror::GetState(ginfo.ws_scene_id, ginfo.model_ws_obj_id, model_ws_obj_state);
 		glm::fmat4x4& tr = __cm4__ model_ws_obj_state.os2ws;
 		glm::fmat4x4 mat_s = glm::scale(glm::fvec3(-1, -1, 1));
 		glm::fmat4x4 mat_t = glm::translate(glm::fvec3(112.896, 112.896, 91.5));
@@ -448,10 +416,10 @@ void UpdateZoomNavigation(GlobalInfo& ginfo)
 			vzm::ObjStates toolEndState;
 			toolEndState.color[3] = 0.3;
 
-			vzm::GenerateSpheresObject(__FP glm::fvec4(sstool_p1_ws, 0.0015f), __FP glm::fvec3(0, 1, 1), 1, ssu_tool_end_id);
+			const glm::fvec3 tool_end_rgb(0, 1, 1);
+			__cm4__ toolEndState.os2ws = ginfo.prims.Sphere(sstool_p1_ws, 0.0015f, &tool_end_rgb, ssu_tool_end_id);
 
-			vzm::ReplaceOrAddSceneObject(zoom_scene_id, ssu_tool_end_id, toolEndState);
-			vzm::ReplaceOrAddSceneObject(zoom_scene_stg_id, ssu_tool_end_id, toolEndState);
+			scene_mirror::SetStates(MS_USER_0 | MS_USER_1, ssu_tool_end_id, toolEndState);
 		}
 		
 		// draw guide /////////////////////////////////////////////////////////////////////////
@@ -463,11 +431,10 @@ void UpdateZoomNavigation(GlobalInfo& ginfo)
 			float cyl_r = 0.0015f;
 			glm::fvec3 cyl_rgb = glm::fvec3(0, 1, 0);
 
-			vzm::GenerateCylindersObject((float*)cyl_p, &cyl_r, __FP cyl_rgb, 1, ssu_tool_guide_line_id);
+			__cm4__ guideLineState.os2ws = ginfo.prims.Cylinder(cyl_p[0], cyl_p[1], cyl_r, &cyl_rgb, ssu_tool_guide_line_id);
 			guideLineState.color[3] = 0.3;
 
-			vzm::ReplaceOrAddSceneObject(zoom_scene_id, ssu_tool_guide_line_id, guideLineState);
-			vzm::ReplaceOrAddSceneObject(zoom_scene_stg_id, ssu_tool_guide_line_id, guideLineState);
+			scene_mirror::SetStates(MS_USER_0 | MS_USER_1, ssu_tool_guide_line_id, guideLineState);
 		}
 
 		// draw direction line  ///////////////////////////////////////////////////////////////
@@ -481,12 +448,10 @@ void UpdateZoomNavigation(GlobalInfo& ginfo)
 			vzm::ObjStates angleArrowState;
 
 			glm::fvec4 color = glm::fvec4(1, 0.5, 1, 0.5);
-			__cm4__ angleArrowState.os2ws = glm::fmat4(1.f);
 			__cv4__ angleArrowState.color = color;
 
-			vzm::GenerateArrowObject((float*)&sstool_p1_ws, (float*)&closetPoint, 0.001f, 0.002f, ssu_tool_guide_angleArrow_id);
-			vzm::ReplaceOrAddSceneObject(zoom_scene_id, ssu_tool_guide_angleArrow_id, angleArrowState);
-			vzm::ReplaceOrAddSceneObject(zoom_scene_stg_id, ssu_tool_guide_angleArrow_id, angleArrowState);
+			__cm4__ angleArrowState.os2ws = ginfo.prims.Arrow(sstool_p1_ws, closetPoint, 0.001f, 0.002f, ssu_tool_guide_angleArrow_id);
+			scene_mirror::SetStates(MS_USER_0 | MS_USER_1, ssu_tool_guide_angleArrow_id, angleArrowState);
 
 			// Text Dist
 			static int ssu_tool_guide_distance_text_id, ssu_tool_guide_angle_text_id;
@@ -497,35 +462,26 @@ void UpdateZoomNavigation(GlobalInfo& ginfo)
 
 			float right_offset = -0.03f;
 
+			// the texts are rebuilt only when the displayed (integer) values change
 			string dist_str = std::to_string((int)(fGuideDist * 1000));
-			auto MakeDistTextWidget = [&dist_str](const glm::fvec3 pos_lt, const vzm::CameraParameters& cam_param, const float size_font, int& text_id) {
-				vector<glm::fvec3> text_xyzlt_view_up(3);
-				text_xyzlt_view_up[0] = pos_lt;
-				text_xyzlt_view_up[1] = __cv3__ cam_param.view;
-				text_xyzlt_view_up[2] = __cv3__ cam_param.up;
-				vzm::GenerateTextObject((float*)&text_xyzlt_view_up[0], dist_str, size_font, true, false, text_id);
+			auto MakeDistTextWidget = [&dist_str, &ginfo](const glm::fvec3 pos_lt, const vzm::CameraParameters& cam_param, const float size_font, int& text_id) {
+				return ginfo.prims.Text(pos_lt, __cv3__ cam_param.view, __cv3__ cam_param.up, dist_str, size_font, text_id);
 			};
 
-			MakeDistTextWidget(tool_tip_ws + right_offset * tool_right_ws, zoom_cam_params, 0.01f, ssu_tool_guide_distance_text_id);
-			vzm::ReplaceOrAddSceneObject(zoom_scene_id, ssu_tool_guide_distance_text_id, textState);
-			vzm::ReplaceOrAddSceneObject(zoom_scene_stg_id, ssu_tool_guide_distance_text_id, textState);
+			__cm4__ textState.os2ws = MakeDistTextWidget(tool_tip_ws + right_offset * tool_right_ws, zoom_cam_params, 0.01f, ssu_tool_guide_distance_text_id);
+			scene_mirror::SetStates(MS_USER_0 | MS_USER_1, ssu_tool_guide_distance_text_id, textState);
 
 			// Text Angle
 			string angle_str = std::to_string((int)fGuideAngle) + "";
 
-			auto MakeAngleTextWidget = [&angle_str](const glm::fvec3 pos_lt, const vzm::CameraParameters& cam_param, const float size_font, int& text_id) {
-				vector<glm::fvec3> text_xyzlt_view_up(3);
-				text_xyzlt_view_up[0] = pos_lt;
-				text_xyzlt_view_up[1] = __cv3__ cam_param.view;
-				text_xyzlt_view_up[2] = __cv3__ cam_param.up;
-				vzm::GenerateTextObject((float*)&text_xyzlt_view_up[0], angle_str, size_font, true, false, text_id);
+			auto MakeAngleTextWidget = [&angle_str, &ginfo](const glm::fvec3 pos_lt, const vzm::CameraParameters& cam_param, const float size_font, int& text_id) {
+				return ginfo.prims.Text(pos_lt, __cv3__ cam_param.view, __cv3__ cam_param.up, angle_str, size_font, text_id);
 			};
 
 			// Text			
 			right_offset = -0.02f;
-			MakeAngleTextWidget(tool_tip_ws + right_offset * tool_right_ws, zoom_cam_params, 0.01f, ssu_tool_guide_angle_text_id);
-			vzm::ReplaceOrAddSceneObject(zoom_scene_id, ssu_tool_guide_angle_text_id, textState);
-			vzm::ReplaceOrAddSceneObject(zoom_scene_stg_id, ssu_tool_guide_angle_text_id, textState);
+			__cm4__ textState.os2ws = MakeAngleTextWidget(tool_tip_ws + right_offset * tool_right_ws, zoom_cam_params, 0.01f, ssu_tool_guide_angle_text_id);
+			scene_mirror::SetStates(MS_USER_0 | MS_USER_1, ssu_tool_guide_angle_text_id, textState);
 		}
 	}
 }
@@ -565,7 +521,7 @@ void UpdateSectionalImage(GlobalInfo& ginfo)
 	}
 }
 
-int main()
+int main(int argc, char* argv[])
 {
 
 #if defined(_DEBUG) | defined(DEBUG)
@@ -573,7 +529,15 @@ int main()
 #endif	
 
 	vzm::InitEngineLib();
-	if (!optitrk::InitOptiTrackLib())
+	// replay of a recorded session instead of Motive and the RealSense : <exe> session.krec [recorded | fast | step]
+	const bool use_replay = argc > 1;
+	if (use_replay)
+	{
+		string replay_mode = argc > 2 ? argv[2] : "recorded";
+		if (!optitrk::InitOptiTrackReplay(argv[1], replay_mode == "fast" ? TRK_REPLAY_FAST : replay_mode == "step" ? TRK_REPLAY_STEP : TRK_REPLAY_RECORDED))
+			return 1;
+	}
+	else if (!optitrk::InitOptiTrackLib())
 	{
 		printf("Unable to license Motive API\n");
 		return 1;
@@ -593,7 +557,13 @@ int main()
 	const int rs_w = 960;
 	const int rs_h = 540;
 
-	rs_settings::InitializeRealsense(true, false, rs_w, rs_h, eye_w, eye_h);
+	if (use_replay)
+	{
+		if (!rs_settings::InitializeRealsenseReplay(argv[1], rs_w, rs_h))
+			return 1;
+	}
+	else
+		rs_settings::InitializeRealsense(true, false, rs_w, rs_h, eye_w, eye_h);
 	rs_settings::RunRsThread(original_data, filtered_data, eye_data);
 	//rs2_intrinsics rgb_intrinsics, depth_intrinsics;
 	//rs2_extrinsics rgb_extrinsics;
@@ -628,28 +598,43 @@ int main()
 
 	int postpone = 3;
 #define NUM_RBS 5
-	concurrent_queue<track_info> track_que(10);
+	spsc_ring<track_info> track_que(16);
 	std::atomic_bool tracker_alive{ true };
 	std::thread tracker_processing_thread([&]() {
+		profiler::SetThreadName("tracker");
+		string _rb_names[NUM_RBS] = { "rs_cam" , "probe" , pin_tool_name, "ss_head" , "marker" };
+		rb_registry trk_rbs;
+		int rb_handles[NUM_RBS]; // -1 : not registered (reported by Register), the body is not tracked
+		for (int i = 0; i < NUM_RBS; i++)
+			rb_handles[i] = trk_rbs.Register(_rb_names[i]);
+		const int ss_head_handle = trk_rbs.Find("ss_head");
+
 		while (tracker_alive)
 		{
 			Sleep(postpone);
+			PROF_ZONE("tracker sample");
+			// taken before the update : TT_Update solves the camera frames already received, so the pose is not younger than the call
+			double t_sample = GetMonotonicTimeMs();
 			optitrk::UpdateFrame();
 
-			track_info cur_trk_info;
-			static string _rb_names[NUM_RBS] = { "rs_cam" , "probe" , pin_tool_name, "ss_head" , "marker" };
+			track_info* slot = track_que.begin_write();
+			if (slot == NULL) continue; // the render thread is draining the full ring, this sample is dropped
+			track_info& cur_trk_info = *slot;
+			cur_trk_info.rbs = trk_rbs;
+			cur_trk_info.time_stamp = t_sample;
 			for (int i = 0; i < NUM_RBS; i++)
 			{
+				if (rb_handles[i] < 0) continue;
 				glm::fmat4x4 mat_lfrm2ws;
 				bool is_detected = optitrk::GetRigidBodyLocationByName(_rb_names[i], (float*)&mat_lfrm2ws);
-				cur_trk_info.SetLFrmInfo(_rb_names[i], is_detected, mat_lfrm2ws);
-				if (_rb_names[i] == "ss_head")
-					cur_trk_info.SetLFrmInfo(_rb_names[i], true, glm::fmat4x4());
+				cur_trk_info.SetLFrmInfo(rb_handles[i], is_detected, mat_lfrm2ws);
+				if (rb_handles[i] == ss_head_handle)
+					cur_trk_info.SetLFrmInfo(rb_handles[i], true, glm::fmat4x4());
 			}
 
-			optitrk::GetMarkersLocation(&cur_trk_info.mk_xyz_list, &cur_trk_info.mk_residue_list, &cur_trk_info.mk_cid_list);
+			cur_trk_info.num_mks = optitrk::GetMarkersLocationArray(MAX_TRK_MKS, (float*)cur_trk_info.mk_xyz, cur_trk_info.mk_residue, cur_trk_info.mk_cid);
 			cur_trk_info.is_updated = true;
-			track_que.push(cur_trk_info);
+			track_que.end_write();
 		}
 	});
 
@@ -668,27 +653,14 @@ int main()
 	s.initSSUDeform(modelRootPath.c_str());
 	s.initTool(modelRootPath.c_str());
 
-	double dTimeStepMilliSecond = s.getTimeStep() * 1000.0;
-	LARGE_INTEGER iT1, iT2;
-	LARGE_INTEGER iTFrequency;
-	QueryPerformanceFrequency(&iTFrequency);
-
+	// fixed time step on the wall clock, sleeps between the steps (and while the model is not aligned)
+	SimScheduler deform_sched(&s);
 	std::atomic_bool ssu_deform_alive{ true };
 	std::thread deform_processing_thread([&]() {
+		profiler::SetThreadName("deform");
 		while (ssu_deform_alive) {
-			if (ginfo.is_modelaligned) {
-				// Simulation
-				QueryPerformanceCounter(&iT1);
-				s.stepPhysics();
-
-				QueryPerformanceCounter(&iT2);
-				// 
-				double dSimulationTime = (iT2.QuadPart - iT1.QuadPart) * 1000.0 / iTFrequency.QuadPart;
-				double dt = dTimeStepMilliSecond - dSimulationTime;
-				iT1 = iT2;
-
-				s.accumulateTime(dSimulationTime);
-			}
+			deform_sched.tick(ginfo.is_modelaligned);
+			deform_sched.waitNextStep();
 		}
 	});
 
@@ -701,26 +673,10 @@ int main()
 	bool show_calib_frames = true;
 	bool record_info = false;
 	bool show_pc = false;
+	bool continuous_icp = false;
 	bool show_workload = true;
 	bool is_ws_pick = false;
 
-	auto DisplayTimes = [&show_workload](const LARGE_INTEGER lIntCntStart, const string& _test)
-	{
-		if (!show_workload) return;
-		LARGE_INTEGER lIntFreq, lIntCntEnd;
-		QueryPerformanceFrequency(&lIntFreq);
-		QueryPerformanceCounter(&lIntCntEnd);
-		double dRunTime1 = (lIntCntEnd.QuadPart - lIntCntStart.QuadPart) / (double)(lIntFreq.QuadPart);
-
-		std::cout << _test << " : " << 1. / dRunTime1 << " fps" << endl;
-	};
-	auto GetPerformanceFreq = []() -> LARGE_INTEGER
-	{
-		LARGE_INTEGER lIntCntFreq;
-		QueryPerformanceCounter(&lIntCntFreq);
-		return lIntCntFreq;
-	};
-
 #ifdef __RECORD_VER
 	// fill record_trk_info and record_rsimg
 #endif
@@ -762,9 +718,14 @@ int main()
 
 	//optitrk::SetCameraSettings(0, 2, 50, 150);
 	//optitrk::SetCameraSettings(1, 2, 50, 150);
+	track_info trk_info;
+	frame_latency_stats replay_stats;
+	profiler::SetEnabled(show_workload);
 	while (key_pressed != 'q' && key_pressed != 27)
 	{
-		LARGE_INTEGER frq_begin = GetPerformanceFreq();
+		// the zones of the previous frame, all threads
+		profiler::Collect();
+		PROF_ZONE("frame");
 
 		bool load_calib_info = false;
 		bool load_stg_calib_info = false;
@@ -780,15 +741,39 @@ int main()
 			case 'g': load_stg_calib_info = true; break;
 			case 'v': show_calib_frames = !show_calib_frames; break;
 			case 'p': show_pc = !show_pc; break;
+			case 'i': continuous_icp = !continuous_icp; var_settings::SetContinuousICP(continuous_icp);
+				std::cout << "continuous ICP : " << (continuous_icp ? "on (with the point cloud, 'p')" : "off") << endl; break;
 			case 'e': show_apis_console = !show_apis_console; break;
 			case 'm': show_mks = !show_mks; break;
 			case 's': show_csection = !show_csection; break;
 			case 'x': reset_calib = true; break;
 			case 'd': record_info = !record_info; break;
 			case 'w': write_recoded_info = true; break;
-			case 'f': show_workload = !show_workload; break;
+			case 'f': show_workload = !show_workload;
+				// profiling follows the workload display, the samples since enabled are reported and exported when it is turned off
+				profiler::SetEnabled(show_workload);
+				if (!show_workload)
+				{
+					profiler::Report();
+					profiler::ExportChromeTrace();
+					long long calls_issued, calls_elided;
+					scene_mirror::GetMirrorStats(calls_issued, calls_elided, true);
+					std::cout << "scene states : " << calls_issued << " vzm calls issued, " << calls_elided << " elided (since the last report)" << endl;
+					double prim_requests, prim_builds;
+					ginfo.prims.GetStats(prim_requests, prim_builds, true);
+					std::cout << "primitives : " << prim_builds << " geometry builds per frame (" << prim_requests << " without the cache)" << endl;
+					long long views_run, views_skipped;
+					var_settings::GetViewStats(views_run, views_skipped, true);
+					std::cout << "views : " << views_run << " run, " << views_skipped << " skipped (inputs unchanged)" << endl;
+					double icp_refinements, icp_iterations;
+					float icp_residual_mm;
+					var_settings::GetICPStats(icp_refinements, icp_iterations, icp_residual_mm, true);
+					std::cout << "icp : " << icp_refinements << " refinements/s, " << icp_iterations << " iterations/s, residual " << icp_residual_mm << " mm" << endl;
+				}
+				break;
 			case 'c': is_ws_pick = !is_ws_pick; break;
 			case 'o': vzm::SetRenderTestParam("_bool_UseSpinLock", false, sizeof(bool), -1, -1); break;
+			case 'n': optitrk::StepReplay(1); break; // replay STEP mode
 			case '1': operation_step = 1; probe_name = "probe"; probe_mode = PROBE_MODE::DEFAULT;
 				optitrk::SetRigidBodyEnabledbyName("probe", true);
 				optitrk::SetRigidBodyEnabledbyName(pin_tool_name, false);
@@ -819,12 +804,28 @@ int main()
 		rs2::frame current_filtered_frame;
 		filtered_data.poll_for_frame(&current_filtered_frame);
 
-		track_info trk_info;
-		track_que.wait_and_pop(trk_info);
+		// bounded wait for the next tracker sample (about 4 ms at 240 Hz), the loop sleeps instead of spinning a core
+		// when neither the tracker nor the camera has anything new
+		track_que.wait(5);
+
+		// drain-all, every sample feeds the pose history and trk_info keeps the newest one
+		// (keeps the previous sample when the tracker has nothing new)
+		track_que.pop_all([&](const track_info& trk_sample)
+		{
+			var_settings::PushTrackSample(&trk_sample);
+			trk_info = trk_sample;
+		});
+
+		static int deform_stats_window = 0;
+		if (deform_sched.acquireState() && show_workload && deform_sched.getState().window != deform_stats_window)
+		{
+			const SimState& sim_state = deform_sched.getState();
+			deform_stats_window = sim_state.window;
+			std::cout << "deform : " << sim_state.stepsPerSec << " steps/s, " << sim_state.msPerStep << " ms/step, dropped " << sim_state.dropped << endl;
+		}
 
 		if (trk_info.is_updated && current_frameset)
 		{
-			//DisplayTimes(frq_begin, "device_stream_load");
 			/*
 			if (ginfo.is_modelaligned) {
 				probe_name = pin_tool_name;
@@ -835,12 +836,12 @@ int main()
 			}
 			*/
 			//var_settings::UpdateTrackInfo(&trk_info);
-			var_settings::UpdateTrackInfo(&trk_info, probe_name, probe_mode);
-
 			auto current_color_frame = current_frameset.get_color_frame();
+			const double t_capture = rs_settings::GetCaptureTimeMs(current_color_frame);
+			var_settings::UpdateTrackInfo(&trk_info, probe_name, probe_mode, t_capture);
 			//auto colorized_depth = current_frameset.first(RS2_STREAM_DEPTH, RS2_FORMAT_RGB8);
 
-			if (record_info) var_settings::RecordInfo(key_pressed, current_color_frame.get_data());
+			if (record_info) var_settings::RecordInfo(key_pressed, current_color_frame.get_data(), t_capture);
 
 			//const int w = color.as<rs2::video_frame>().get_width(); // rs_w
 			//const int h = color.as<rs2::video_frame>().get_height(); // rs_h
@@ -939,6 +940,17 @@ int main()
 			{
 				var_settings::RenderAndShowWindows(show_workload, image_rs_bgr, false);
 			}
+			if (use_replay)
+			{
+				// replay benchmark : frames per second and capture (injection) to display latency
+				if (replay_stats.Add(t_capture, GetMonotonicTimeMs()))
+				{
+					long long frames_fed, frames_dropped;
+					rs_settings::GetReplayStats(frames_fed, frames_dropped);
+					std::cout << "replay frame " << optitrk::GetReplayFrame() << " : " << replay_stats.fps << " fps, latency " << replay_stats.mean_ms << " ms (max "
+						<< replay_stats.peak_ms << " ms), fed " << frames_fed << ", dropped " << frames_dropped << endl;
+				}
+			}
 			//cv::Mat img_rs_mirror(ginfo.rs_h, ginfo.rs_w, CV_8UC3, image_rs_bgr.data);
 			//imshow("rs mirror", img_rs_mirror);
 			//Show_Window(window_name_zs_view, zoom_scene_id, zoom_cam_id);
@@ -0,0 +1,664 @@
+#include "softBodyBake.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+struct BakeHeader
+{
+	char				magic[8];		// "CISBBAKE"
+	unsigned int		version;		// SOFTBODY_BAKE_VERSION
+	unsigned int		layout[8];		// sizes of the stored structs (compiler, btScalar precision)
+	unsigned long long	sourceKey;
+	unsigned long long	payloadBytes;
+	unsigned long long	checksum;		// of the payload
+};
+static const char		kMagic[8] = { 'C', 'I', 'S', 'B', 'B', 'A', 'K', 'E' };
+static const size_t		kPayloadOffset = (sizeof(BakeHeader) + 15) & ~(size_t)15;
+
+// FNV-1a over 64-bit words (folded after each word), the tail bytes one by one
+static unsigned long long hashBytes(const void* data, size_t bytes, unsigned long long h = 14695981039346656037ull)
+{
+	const unsigned char* p = (const unsigned char*)data;
+	const size_t nWords = bytes / 8;
+	for (size_t i = 0; i < nWords; i++) {
+		unsigned long long w;
+		memcpy(&w, p + i * 8, 8);
+		h = (h ^ w) * 1099511628211ull;
+		h ^= h >> 32;
+	}
+	for (size_t i = nWords * 8; i < bytes; i++) {
+		h = (h ^ p[i]) * 1099511628211ull;
+	}
+	return h;
+}
+
+static void layoutOf(unsigned int layout[8])
+{
+	layout[0] = sizeof(void*);
+	layout[1] = sizeof(btScalar);
+	layout[2] = sizeof(CiSoftBody::Material);
+	layout[3] = sizeof(CiSoftBody::Node);
+	layout[4] = sizeof(CiSoftBody::Link);
+	layout[5] = sizeof(CiSoftBody::Face);
+	layout[6] = sizeof(CiSoftBody::Tetra);
+	layout[7] = sizeof(btMatrix3x3);
+}
+
+// pointers of the stored structs hold indices (-1 : NULL)
+template <typename T>
+static inline T* toIndex(int idx)
+{
+	return (T*)(intptr_t)idx;
+}
+template <typename T>
+static inline int fromIndex(const T* p)
+{
+	return (int)(intptr_t)p;
+}
+
+// the constraint node pointers (m_n, m_nodeCnt) become a range of the node index pool
+struct BakedConstraint
+{
+	int			m_isUse;
+	int			m_nodeCnt;
+	int			m_first;
+	btScalar	m_rest;
+	btScalar	m_im;
+	btScalar	m_prime;
+};
+
+// payload writer, every array starts 16 bytes aligned (as in the mapped file)
+class BakeWriter
+{
+public:
+	std::vector<char>	m_buf;
+	bool				m_ok;
+
+	BakeWriter() : m_ok(true) {}
+
+	void align()
+	{
+		m_buf.resize((m_buf.size() + 15) & ~(size_t)15, 0);
+	}
+	void write(const void* p, size_t bytes)
+	{
+		const char* c = (const char*)p;
+		m_buf.insert(m_buf.end(), c, c + bytes);
+	}
+	template <typename T> void value(const T& v)
+	{
+		write(&v, sizeof(T));
+	}
+	template <typename T> void array(const btAlignedObjectArray<T>& a)
+	{
+		const int n = a.size();
+		value(n);
+		align();
+		if (n > 0) { write(&a[0], sizeof(T) * n); }
+	}
+	void check(bool ok)
+	{
+		m_ok = m_ok && ok;
+	}
+};
+
+// payload reader over the mapped file, fails on any read past the payload
+class BakeReader
+{
+public:
+	const char*	m_p;
+	size_t		m_size;
+	size_t		m_pos;
+
+	BakeReader(const char* p, size_t size) : m_p(p), m_size(size), m_pos(0) {}
+
+	bool align()
+	{
+		m_pos = (m_pos + 15) & ~(size_t)15;
+		return m_pos <= m_size;
+	}
+	template <typename T> bool value(T& v)
+	{
+		if (m_pos + sizeof(T) > m_size) { return false; }
+		memcpy(&v, m_p + m_pos, sizeof(T));
+		m_pos += sizeof(T);
+		return true;
+	}
+	template <typename T> bool array(btAlignedObjectArray<T>& a)
+	{
+		int n = 0;
+		if (!value(n) || n < 0 || !align()) { return false; }
+		const size_t bytes = sizeof(T) * (size_t)n;
+		if (m_pos + bytes > m_size) { return false; }
+		a.resizeNoInitialize(n);
+		if (n > 0) { memcpy(&a[0], m_p + m_pos, bytes); }
+		m_pos += bytes;
+		return true;
+	}
+};
+
+// read only view of a whole file
+class MappedFile
+{
+public:
+	const char*	m_data;
+	size_t		m_size;
+#ifdef _WIN32
+	HANDLE		m_file;
+	HANDLE		m_mapping;
+#else
+	int			m_fd;
+#endif
+
+	MappedFile() : m_data(NULL), m_size(0)
+	{
+#ifdef _WIN32
+		m_file = INVALID_HANDLE_VALUE;
+		m_mapping = NULL;
+#else
+		m_fd = -1;
+#endif
+	}
+	~MappedFile()
+	{
+#ifdef _WIN32
+		if (m_data) { UnmapViewOfFile(m_data); }
+		if (m_mapping) { CloseHandle(m_mapping); }
+		if (m_file != INVALID_HANDLE_VALUE) { CloseHandle(m_file); }
+#else
+		if (m_data) { munmap((void*)m_data, m_size); }
+		if (m_fd >= 0) { close(m_fd); }
+#endif
+	}
+	bool open(const char* path)
+	{
+#ifdef _WIN32
+		m_file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (m_file == INVALID_HANDLE_VALUE) { return false; }
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0) { return false; }
+		m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (m_mapping == NULL) { return false; }
+		m_data = (const char*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+		m_size = (size_t)size.QuadPart;
+#else
+		m_fd = ::open(path, O_RDONLY);
+		if (m_fd < 0) { return false; }
+		struct stat st;
+		if (fstat(m_fd, &st) != 0 || st.st_size == 0) { return false; }
+		void* p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+		if (p == MAP_FAILED) { return false; }
+		m_data = (const char*)p;
+		m_size = (size_t)st.st_size;
+#endif
+		return m_data != NULL;
+	}
+};
+
+// pointer -> index ////////////////////////////////////////////////////////////////////////////
+
+template <typename T>
+static bool indexOf(const btAlignedObjectArray<T>& a, const T* p, int& idx)
+{
+	idx = -1;
+	if (p == NULL) { return true; }
+	if (a.size() == 0) { return false; }
+	const T* first = &a[0];
+	if (p < first || p >= first + a.size()) { return false; }
+	idx = (int)(p - first);
+	return true;
+}
+static bool materialIndex(const CiSoftBody* psb, const CiSoftBody::Material* m, int& idx)
+{
+	idx = -1;
+	if (m == NULL) { return true; }
+	for (int i = 0, ni = psb->m_materials.size(); i < ni; i++) {
+		if (psb->m_materials[i] == m) { idx = i; return true; }
+	}
+	return false;
+}
+
+static void putNodes(BakeWriter& w, const CiSoftBody* psb, const CiSoftBody::tNodeArray& nodes)
+{
+	CiSoftBody::tNodeArray out;
+	out.resizeNoInitialize(nodes.size());
+	for (int i = 0, ni = nodes.size(); i < ni; i++) {
+		int m;
+		w.check(materialIndex(psb, nodes[i].m_mat, m));
+		out[i] = nodes[i];
+		out[i].m_mat = toIndex<CiSoftBody::Material>(m);
+	}
+	w.array(out);
+}
+static void putLinks(BakeWriter& w, const CiSoftBody* psb)
+{
+	CiSoftBody::tLinkArray out;
+	out.resizeNoInitialize(psb->m_links.size());
+	for (int i = 0, ni = psb->m_links.size(); i < ni; i++) {
+		const CiSoftBody::Link& l = psb->m_links[i];
+		int idx;
+		out[i] = l;
+		for (int j = 0; j < 2; j++) {
+			w.check(indexOf(psb->m_nodes, (const CiSoftBody::Node*)l.m_n[j], idx));
+			out[i].m_n[j] = toIndex<CiSoftBody::Node>(idx);
+		}
+		w.check(materialIndex(psb, l.m_mat, idx));
+		out[i].m_mat = toIndex<CiSoftBody::Material>(idx);
+	}
+	w.array(out);
+}
+// nodes : the array the face nodes belong to
+static void putFaces(BakeWriter& w, const CiSoftBody* psb, const CiSoftBody::tFaceArray& faces, const CiSoftBody::tNodeArray& nodes)
+{
+	CiSoftBody::tFaceArray out;
+	out.resizeNoInitialize(faces.size());
+	for (int i = 0, ni = faces.size(); i < ni; i++) {
+		const CiSoftBody::Face& f = faces[i];
+		int idx;
+		out[i] = f;
+		for (int j = 0; j < 3; j++) {
+			w.check(indexOf(nodes, (const CiSoftBody::Node*)f.m_n[j], idx));
+			out[i].m_n[j] = toIndex<CiSoftBody::Node>(idx);
+		}
+		w.check(materialIndex(psb, f.m_mat, idx));
+		out[i].m_mat = toIndex<CiSoftBody::Material>(idx);
+	}
+	w.array(out);
+}
+static void putTetras(BakeWriter& w, const CiSoftBody* psb)
+{
+	CiSoftBody::tTetraArray out;
+	out.resizeNoInitialize(psb->m_tetras.size());
+	for (int i = 0, ni = psb->m_tetras.size(); i < ni; i++) {
+		const CiSoftBody::Tetra& t = psb->m_tetras[i];
+		int idx;
+		out[i] = t;
+		for (int j = 0; j < 4; j++) {
+			w.check(indexOf(psb->m_nodes, (const CiSoftBody::Node*)t.m_n[j], idx));
+			out[i].m_n[j] = toIndex<CiSoftBody::Node>(idx);
+		}
+		w.check(materialIndex(psb, t.m_mat, idx));
+		out[i].m_mat = toIndex<CiSoftBody::Material>(idx);
+	}
+	w.array(out);
+}
+static void putConstraints(BakeWriter& w, const CiSoftBody* psb, const CiSoftBody::tConstraintArray& cs)
+{
+	btAlignedObjectArray<BakedConstraint> out;
+	btAlignedObjectArray<int> pool;
+	out.resizeNoInitialize(cs.size());
+	for (int i = 0, ni = cs.size(); i < ni; i++) {
+		const CiSoftBody::Constraint& c = cs[i];
+		out[i].m_isUse = c.m_isUse;
+		out[i].m_nodeCnt = c.m_n ? c.m_nodeCnt : 0;
+		out[i].m_first = pool.size();
+		out[i].m_rest = c.m_rest;
+		out[i].m_im = c.m_im;
+		out[i].m_prime = c.m_prime;
+		for (int j = 0; j < out[i].m_nodeCnt; j++) {
+			int idx;
+			w.check(indexOf(psb->m_nodes, (const CiSoftBody::Node*)c.m_n[j], idx) && idx >= 0);
+			pool.push_back(idx);
+		}
+	}
+	w.array(out);
+	w.array(pool);
+}
+static void putColored(BakeWriter& w, const CiSoftBody::ColoredConstraints& cc)
+{
+	w.value(cc.m_nodeCnt);
+	w.array(cc.m_colorStart);
+	w.array(cc.m_nodeIdx);
+	w.array(cc.m_rest);
+	w.array(cc.m_im);
+	w.array(cc.m_prime);
+}
+
+static void putBody(BakeWriter& w, const CiSoftBody* psb)
+{
+	const CiSoftBody::Config& cfg = psb->m_cfg;
+	w.value(cfg.m_meshType);
+	w.value(cfg.m_contactMargin);
+	w.value(cfg.timescale);
+	w.value(cfg.piterations);
+	w.value(cfg.viterations);
+	w.value(cfg.m_draw);
+	w.value(cfg.kDP);
+	w.value(cfg.kMT);
+	w.value(cfg.m_solverMode);
+	w.array(cfg.m_psequence);
+	w.array(cfg.m_vsequence);
+
+	btAlignedObjectArray<CiSoftBody::Material> materials;
+	materials.resizeNoInitialize(psb->m_materials.size());
+	for (int i = 0, ni = psb->m_materials.size(); i < ni; i++) {
+		materials[i] = *psb->m_materials[i];
+	}
+	w.array(materials);
+	w.value(psb->m_oriCenter);
+	w.value(psb->m_avgSurfaceMargin);
+
+	// tetra model
+	putNodes(w, psb, psb->m_nodes);
+	putLinks(w, psb);
+	putFaces(w, psb, psb->m_faces, psb->m_nodes);
+	putTetras(w, psb);
+	putFaces(w, psb, psb->m_tetrasFaces, psb->m_nodes);
+	putFaces(w, psb, psb->m_tetrasSurface, psb->m_nodes);
+
+	// surface mesh and its attachment
+	putNodes(w, psb, psb->m_surfaceMeshNode);
+	putFaces(w, psb, psb->m_surfaceMeshFace, psb->m_surfaceMeshNode);
+	w.array(psb->m_attachedTetraIdx);
+	w.array(psb->m_bary);
+	btAlignedObjectArray<int> boundary;
+	for (int i = 0, ni = psb->m_boundaryTetras.size(); i < ni; i++) {
+		int idx;
+		w.check(indexOf(psb->m_tetras, (const CiSoftBody::Tetra*)psb->m_boundaryTetras[i], idx) && idx >= 0);
+		boundary.push_back(idx);
+	}
+	w.array(boundary);
+
+	// constraints
+	const CiSoftBody::Pose& pose = psb->m_pose;
+	w.value(pose.m_bvolume);
+	w.value(pose.m_bframe);
+	w.value(pose.m_volume);
+	w.array(pose.m_pos);
+	w.array(pose.m_wgh);
+	w.value(pose.m_com);
+	w.value(pose.m_rot);
+	w.value(pose.m_scl);
+	w.value(pose.m_aqq);
+	putConstraints(w, psb, psb->m_stretchConstraints);
+	putConstraints(w, psb, psb->m_bendingConstraints_dihedral);
+	putConstraints(w, psb, psb->m_bendingConstraints_triangle);
+	putConstraints(w, psb, psb->m_volumeConstraints_surface);
+	putConstraints(w, psb, psb->m_volumeConstraints);
+
+	// colour batches of the parallel solver
+	w.value(psb->m_parallelReady);
+	if (psb->m_parallelReady) {
+		putColored(w, psb->m_parStretch);
+		putColored(w, psb->m_parVolume);
+		putColored(w, psb->m_parBending);
+	}
+
+	const int nChild = psb->m_child.size();
+	w.value(nChild);
+	for (int i = 0; i < nChild; i++) {
+		putBody(w, psb->m_child[i]);
+	}
+}
+
+// index -> pointer ////////////////////////////////////////////////////////////////////////////
+
+template <typename T>
+static bool relocate(btAlignedObjectArray<T>& a, T*& p)
+{
+	const int idx = fromIndex(p);
+	if (idx < -1 || idx >= a.size()) { return false; }
+	p = idx < 0 ? NULL : &a[idx];
+	return true;
+}
+static bool getMaterial(CiSoftBody* psb, CiSoftBody::Material*& p)
+{
+	const int m = fromIndex(p);
+	if (m < -1 || m >= psb->m_materials.size()) { return false; }
+	p = m < 0 ? NULL : psb->m_materials[m];
+	return true;
+}
+static bool getNodes(BakeReader& r, CiSoftBody* psb, CiSoftBody::tNodeArray& nodes)
+{
+	if (!r.array(nodes)) { return false; }
+	for (int i = 0, ni = nodes.size(); i < ni; i++) {
+		if (!getMaterial(psb, nodes[i].m_mat)) { return false; }
+	}
+	return true;
+}
+static bool getLinks(BakeReader& r, CiSoftBody* psb)
+{
+	if (!r.array(psb->m_links)) { return false; }
+	for (int i = 0, ni = psb->m_links.size(); i < ni; i++) {
+		CiSoftBody::Link& l = psb->m_links[i];
+		if (!relocate(psb->m_nodes, l.m_n[0]) || !relocate(psb->m_nodes, l.m_n[1]) || !getMaterial(psb, l.m_mat)) { return false; }
+	}
+	return true;
+}
+static bool getFaces(BakeReader& r, CiSoftBody* psb, CiSoftBody::tFaceArray& faces, CiSoftBody::tNodeArray& nodes)
+{
+	if (!r.array(faces)) { return false; }
+	for (int i = 0, ni = faces.size(); i < ni; i++) {
+		CiSoftBody::Face& f = faces[i];
+		for (int j = 0; j < 3; j++) {
+			if (!relocate(nodes, f.m_n[j])) { return false; }
+		}
+		if (!getMaterial(psb, f.m_mat)) { return false; }
+	}
+	return true;
+}
+static bool getTetras(BakeReader& r, CiSoftBody* psb)
+{
+	if (!r.array(psb->m_tetras)) { return false; }
+	for (int i = 0, ni = psb->m_tetras.size(); i < ni; i++) {
+		CiSoftBody::Tetra& t = psb->m_tetras[i];
+		for (int j = 0; j < 4; j++) {
+			if (!relocate(psb->m_nodes, t.m_n[j])) { return false; }
+		}
+		if (!getMaterial(psb, t.m_mat)) { return false; }
+	}
+	return true;
+}
+static bool getConstraints(BakeReader& r, CiSoftBody* psb, CiSoftBody::tConstraintArray& cs)
+{
+	btAlignedObjectArray<BakedConstraint> in;
+	btAlignedObjectArray<int> pool;
+	if (!r.array(in) || !r.array(pool)) { return false; }
+	cs.resizeNoInitialize(in.size());
+	for (int i = 0, ni = in.size(); i < ni; i++) {
+		cs[i].m_n = NULL;	// destroySoftBody deletes the node lists
+	}
+	const int nNodes = psb->m_nodes.size();
+	for (int i = 0, ni = in.size(); i < ni; i++) {
+		const BakedConstraint& b = in[i];
+		CiSoftBody::Constraint& c = cs[i];
+		if (b.m_nodeCnt < 0 || b.m_first < 0 || b.m_first + b.m_nodeCnt > pool.size()) { return false; }
+		c.m_isUse = b.m_isUse != 0;
+		c.m_nodeCnt = b.m_nodeCnt;
+		c.m_rest = b.m_rest;
+		c.m_im = b.m_im;
+		c.m_prime = b.m_prime;
+		if (b.m_nodeCnt > 0) {
+			c.m_n = new CiSoftBody::Node*[b.m_nodeCnt];
+			for (int j = 0; j < b.m_nodeCnt; j++) {
+				const int idx = pool[b.m_first + j];
+				if (idx < 0 || idx >= nNodes) { return false; }
+				c.m_n[j] = &psb->m_nodes[idx];
+			}
+		}
+	}
+	return true;
+}
+static bool getColored(BakeReader& r, CiSoftBody* psb, CiSoftBody::ColoredConstraints& cc)
+{
+	if (!r.value(cc.m_nodeCnt) || !r.array(cc.m_colorStart) || !r.array(cc.m_nodeIdx)
+		|| !r.array(cc.m_rest) || !r.array(cc.m_im) || !r.array(cc.m_prime)) {
+		return false;
+	}
+	const int nNodes = psb->m_nodes.size();
+	for (int i = 0, ni = cc.m_nodeIdx.size(); i < ni; i++) {
+		if (cc.m_nodeIdx[i] < 0 || cc.m_nodeIdx[i] >= nNodes) { return false; }
+	}
+	return true;
+}
+
+static bool getBody(BakeReader& r, CiSoftBody* psb)
+{
+	CiSoftBody::Config& cfg = psb->m_cfg;
+	if (!r.value(cfg.m_meshType) || !r.value(cfg.m_contactMargin) || !r.value(cfg.timescale) || !r.value(cfg.piterations)
+		|| !r.value(cfg.viterations) || !r.value(cfg.m_draw) || !r.value(cfg.kDP) || !r.value(cfg.kMT) || !r.value(cfg.m_solverMode)
+		|| !r.array(cfg.m_psequence) || !r.array(cfg.m_vsequence)) {
+		return false;
+	}
+
+	btAlignedObjectArray<CiSoftBody::Material> materials;
+	if (!r.array(materials)) { return false; }
+	for (int i = 0, ni = materials.size(); i < ni; i++) {
+		CiSoftBody::Material* pm = psb->appendMaterial();
+		*pm = materials[i];
+	}
+	if (!r.value(psb->m_oriCenter) || !r.value(psb->m_avgSurfaceMargin)) { return false; }
+
+	// tetra model
+	if (!getNodes(r, psb, psb->m_nodes) || !getLinks(r, psb) || !getFaces(r, psb, psb->m_faces, psb->m_nodes)
+		|| !getTetras(r, psb) || !getFaces(r, psb, psb->m_tetrasFaces, psb->m_nodes) || !getFaces(r, psb, psb->m_tetrasSurface, psb->m_nodes)) {
+		return false;
+	}
+
+	// surface mesh and its attachment
+	if (!getNodes(r, psb, psb->m_surfaceMeshNode) || !getFaces(r, psb, psb->m_surfaceMeshFace, psb->m_surfaceMeshNode)
+		|| !r.array(psb->m_attachedTetraIdx) || !r.array(psb->m_bary)) {
+		return false;
+	}
+	btAlignedObjectArray<int> boundary;
+	if (!r.array(boundary)) { return false; }
+	for (int i = 0, ni = boundary.size(); i < ni; i++) {
+		if (boundary[i] < 0 || boundary[i] >= psb->m_tetras.size()) { return false; }
+		psb->m_boundaryTetras.push_back(&psb->m_tetras[boundary[i]]);
+	}
+
+	// constraints
+	CiSoftBody::Pose& pose = psb->m_pose;
+	if (!r.value(pose.m_bvolume) || !r.value(pose.m_bframe) || !r.value(pose.m_volume) || !r.array(pose.m_pos) || !r.array(pose.m_wgh)
+		|| !r.value(pose.m_com) || !r.value(pose.m_rot) || !r.value(pose.m_scl) || !r.value(pose.m_aqq)) {
+		return false;
+	}
+	if (!getConstraints(r, psb, psb->m_stretchConstraints) || !getConstraints(r, psb, psb->m_bendingConstraints_dihedral)
+		|| !getConstraints(r, psb, psb->m_bendingConstraints_triangle) || !getConstraints(r, psb, psb->m_volumeConstraints_surface)
+		|| !getConstraints(r, psb, psb->m_volumeConstraints)) {
+		return false;
+	}
+
+	// colour batches of the parallel solver (as initParallelSolver leaves them)
+	bool parallelReady = false;
+	if (!r.value(parallelReady)) { return false; }
+	if (parallelReady) {
+		if (!getColored(r, psb, psb->m_parStretch) || !getColored(r, psb, psb->m_parVolume) || !getColored(r, psb, psb->m_parBending)) {
+			return false;
+		}
+		const int nNodes = psb->m_nodes.size();
+		psb->m_soa.m_x.resize(nNodes);
+		psb->m_soa.m_y.resize(nNodes);
+		psb->m_soa.m_z.resize(nNodes);
+		psb->m_soa.m_im.resize(nNodes);
+	}
+	psb->m_parallelReady = parallelReady;
+	psb->buildAdjacency();	// derived from the links / tetras, not stored
+
+	int nChild = 0;
+	if (!r.value(nChild) || nChild < 0) { return false; }
+	for (int i = 0; i < nChild; i++) {
+		CiSoftBody* child = new CiSoftBody();
+		psb->m_child.push_back(child);	// deleted with psb on a failure
+		if (!getBody(r, child)) { return false; }
+	}
+	return true;
+}
+
+}	// namespace
+
+unsigned long long CiSoftBodyBake::sourceKey(const char* const* files, int numFiles, const void* params, size_t paramBytes)
+{
+	unsigned long long h = hashBytes(params, paramBytes);
+	for (int i = 0; i < numFiles; i++) {
+		long long stamp[2] = { -1, -1 };	// size, modification time
+#ifdef _WIN32
+		struct _stat64 st;
+		if (_stat64(files[i], &st) == 0) {
+#else
+		struct stat st;
+		if (stat(files[i], &st) == 0) {
+#endif
+			stamp[0] = (long long)st.st_size;
+			stamp[1] = (long long)st.st_mtime;
+		}
+		h = hashBytes(stamp, sizeof(stamp), h);
+	}
+	return h;
+}
+
+bool CiSoftBodyBake::save(const char* path, const CiSoftBody* psb, unsigned long long sourceKey)
+{
+	BakeWriter w;
+	putBody(w, psb);
+	if (!w.m_ok) {
+		printf("bake : pointer outside of the body arrays, %s is not written\n", path);
+		return false;
+	}
+
+	BakeHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, kMagic, sizeof(kMagic));
+	header.version = SOFTBODY_BAKE_VERSION;
+	layoutOf(header.layout);
+	header.sourceKey = sourceKey;
+	header.payloadBytes = w.m_buf.size();
+	header.checksum = hashBytes(w.m_buf.data(), w.m_buf.size());
+
+	FILE* fp = NULL;
+	fopen_s(&fp, path, "wb");
+	if (fp == NULL) { return false; }
+	char pad[kPayloadOffset] = { 0 };
+	memcpy(pad, &header, sizeof(header));
+	bool ok = fwrite(pad, 1, kPayloadOffset, fp) == kPayloadOffset;
+	ok = ok && fwrite(w.m_buf.data(), 1, w.m_buf.size(), fp) == w.m_buf.size();
+	fclose(fp);
+	if (!ok) { remove(path); }
+	return ok;
+}
+
+CiSoftBody* CiSoftBodyBake::load(const char* path, unsigned long long sourceKey)
+{
+	MappedFile file;
+	if (!file.open(path) || file.m_size < kPayloadOffset) { return NULL; }
+
+	BakeHeader header;
+	memcpy(&header, file.m_data, sizeof(header));
+	unsigned int layout[8];
+	layoutOf(layout);
+	const char* payload = file.m_data + kPayloadOffset;
+	if (memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != SOFTBODY_BAKE_VERSION || memcmp(header.layout, layout, sizeof(layout)) != 0) {
+		printf("bake : %s has another version or layout\n", path);
+		return NULL;
+	}
+	if (header.sourceKey != sourceKey) {
+		printf("bake : %s is older than its sources\n", path);
+		return NULL;
+	}
+	if (header.payloadBytes != file.m_size - kPayloadOffset || header.checksum != hashBytes(payload, (size_t)header.payloadBytes)) {
+		printf("bake : %s is corrupted\n", path);
+		return NULL;
+	}
+
+	CiSoftBody* psb = new CiSoftBody();
+	BakeReader r(payload, (size_t)header.payloadBytes);
+	if (!getBody(r, psb) || r.m_pos != r.m_size) {
+		printf("bake : %s could not be read\n", path);
+		psb->destroySoftBody();	// the node lists (new[]) of the constraints read so far, the children and the materials
+		delete psb;
+		return NULL;
+	}
+	return psb;
+}
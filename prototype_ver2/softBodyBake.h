@@ -0,0 +1,23 @@
+#pragma once
+
+#include "softbody.h"
+
+// baked soft bodies : a fully initialised CiSoftBody (and its children) stored as its solver arrays
+// nodes, links, faces, tetras (heterogeneity flags and materials), surface mesh with its tetra attachments (barycentrics),
+// pose, constraints with their rest values and the colour batches of the parallel solver
+// the pointers are stored as indices, the arrays are copied from the mapped file and the indices relocated to pointers,
+// nothing is parsed or recomputed
+// a file is rejected (load returns NULL) when its version, the struct layout, the source key or the checksum differ
+// 2 : surface mesh attached to the containing tetras (embedSurfaceMesh)
+#define SOFTBODY_BAKE_VERSION	2
+
+struct CiSoftBodyBake
+{
+	// key of the inputs of a bake : size and modification time of the files (a missing file counts too) and the parameter bytes
+	static unsigned long long sourceKey(const char* const* files, int numFiles, const void* params, size_t paramBytes);
+
+	// false when the body holds a pointer outside of its arrays (nothing is written)
+	static bool save(const char* path, const CiSoftBody* psb, unsigned long long sourceKey);
+	// NULL when the file is missing, stale or corrupted
+	static CiSoftBody* load(const char* path, unsigned long long sourceKey);
+};
@@ -1,4 +1,7 @@
 #include "softBodyHelper.h"
+#include "tetraGrid.h"
+
+#include <chrono>
 
 CiRigidBody* CiSoftBodyHelpers::CreateFromTriMeshFile(
 	const char* objPath,
@@ -158,25 +161,33 @@ CiSoftBody * CiSoftBodyHelpers::CreateFromTetGenFile(
 
 
 	// ǥ ߺ˻ //
+	//  ǥ  , ó    ( ״)
 	btAlignedObjectArray<int>	posIdx;
 	btAlignedObjectArray<btVector3> newPos;
 
 	posIdx.resize(nnode);
-	int nDupCnt = 0;
-	for (int i = 0; i < nnode; i++) {
-		bool isDup = false;
-
-		for (int j = 0, nj = newPos.size(); j < nj; j++) {
-			if (pos[i] == newPos[j]) {
-				isDup = true;
-				posIdx[i] = j;
-				break;
-			}
+	{
+		std::vector<int> order(nnode), firstIdx(nnode);
+		for (int i = 0; i < nnode; i++) {
+			order[i] = i;
 		}
-
-		if (!isDup) {
-			newPos.push_back(pos[i]);
-			posIdx[i] = newPos.size() - 1;
+		std::sort(order.begin(), order.end(), [&](const int a, const int b) {
+			if (pos[a].x() != pos[b].x()) return pos[a].x() < pos[b].x();
+			if (pos[a].y() != pos[b].y()) return pos[a].y() < pos[b].y();
+			if (pos[a].z() != pos[b].z()) return pos[a].z() < pos[b].z();
+			return a < b;
+		});
+		for (int i = 0; i < nnode; i++) {
+			firstIdx[order[i]] = (i > 0 && pos[order[i]] == pos[order[i - 1]]) ? firstIdx[order[i - 1]] : order[i];
+		}
+		for (int i = 0; i < nnode; i++) {
+			if (firstIdx[i] == i) {
+				newPos.push_back(pos[i]);
+				posIdx[i] = newPos.size() - 1;
+			}
+			else {
+				posIdx[i] = posIdx[firstIdx[i]];
+			}
 		}
 	}
 
@@ -265,12 +276,6 @@ CiSoftBody * CiSoftBodyHelpers::CreateFromTetGenFile(
 
 	}
 	else {
-#define IDX(_x_,_y_) ((_y_)*nodeCnt + (_x_))	
-		bool* chks = new bool[nodeCnt * nodeCnt];
-		for (int i = 0; i < nodeCnt*nodeCnt; i++) {
-			chks[i] = false;
-		}
-
 		for (int i = 0; i < ntetra; ++i) {
 			int	index = 0;
 			int	ni[4];
@@ -297,19 +302,13 @@ CiSoftBody * CiSoftBodyHelpers::CreateFromTetGenFile(
 					n[1] = ni[idx2[j]];
 					//printf("n[0]:%d n[1]:%d\n", n[0], n[1]);
 
-					if (chks[IDX(n[0], n[1])] == false) {
-						chks[IDX(n[0], n[1])] = true;
-						chks[IDX(n[1], n[0])] = true;
-						psb->appendLink(n[0], n[1], pm, true);
-					}
+					psb->appendLink(n[0], n[1], pm, true);
 				}
 			}
 
 			// Tetra   //
 			psb->appendFaceTet(ni[0], ni[1], ni[2], ni[3]);
 		}
-		delete[] chks;
-#undef IDX
 
 		fopen_s(&linkfp, link, "w");
 		fprintf(linkfp, "%d\n", psb->m_links.size());
@@ -359,9 +358,6 @@ CiSoftBody * CiSoftBodyHelpers::CreateFromTetGenFile(
 		int nTetraSize = psb->m_tetras.size();
 		int nTetraFaceSize = psb->m_tetrasFaces.size();
 		int* tetraFaceIdx = new int[nTetraFaceSize];
-		int* tetraFaceNodeList0 = new int[nTetraFaceSize];
-		int* tetraFaceNodeList1 = new int[nTetraFaceSize];
-		int* tetraFaceNodeList2 = new int[nTetraFaceSize];
 		int* tetraFaceNodeNotSort0 = new int[nTetraFaceSize];
 		int* tetraFaceNodeNotSort1 = new int[nTetraFaceSize];
 		int* tetraFaceNodeNotSort2 = new int[nTetraFaceSize];
@@ -373,6 +369,8 @@ CiSoftBody * CiSoftBodyHelpers::CreateFromTetGenFile(
 		}
 
 		int nodeIdx[3];
+		CiSoftBody::TopologyTable faceTable;	// ĵ node ȣ -> յ face ȣ
+		faceTable.reset(3, nTetraFaceSize / 2);
 
 		printf("----ߺ Face \n");
 		for (int i = 0; i < nTetraFaceSize; i++) {
@@ -381,20 +379,12 @@ CiSoftBody * CiSoftBodyHelpers::CreateFromTetGenFile(
 			nodeIdx[2] = psb->m_tetrasFaces[i].m_n[2]->m_idx;
 			std::sort(nodeIdx, nodeIdx + 3);
 
-			bool dup = false;
-			for (int j = 0; j < nFaceNodeListIdx; j++) {			// !!!!check
-				if ((tetraFaceNodeList0[j] == nodeIdx[0]) && (tetraFaceNodeList1[j] == nodeIdx[1]) && (tetraFaceNodeList2[j] == nodeIdx[2]))
-				{
-					dup = true;
-					tetraFaceIdx[i] = j;
-					break;
-				}
+			int j = faceTable.find(nodeIdx);
+			if (j != -1) {
+				tetraFaceIdx[i] = j;
 			}
-
-			if (dup == false) {
-				tetraFaceNodeList0[nFaceNodeListIdx] = nodeIdx[0];
-				tetraFaceNodeList1[nFaceNodeListIdx] = nodeIdx[1];
-				tetraFaceNodeList2[nFaceNodeListIdx] = nodeIdx[2];
+			else {
+				faceTable.insert(nodeIdx, nFaceNodeListIdx);
 				tetraFaceNodeNotSort0[nFaceNodeListIdx] = psb->m_tetrasFaces[i].m_n[0]->m_idx;
 				tetraFaceNodeNotSort1[nFaceNodeListIdx] = psb->m_tetrasFaces[i].m_n[1]->m_idx;
 				tetraFaceNodeNotSort2[nFaceNodeListIdx] = psb->m_tetrasFaces[i].m_n[2]->m_idx;
@@ -444,9 +434,6 @@ CiSoftBody * CiSoftBodyHelpers::CreateFromTetGenFile(
 		piFaceCnt = NULL;
 
 		delete[] tetraFaceIdx;
-		delete[] tetraFaceNodeList0;
-		delete[] tetraFaceNodeList1;
-		delete[] tetraFaceNodeList2;
 		delete[] tetraFaceNodeNotSort0;
 		delete[] tetraFaceNodeNotSort1;
 		delete[] tetraFaceNodeNotSort2;
@@ -462,15 +449,7 @@ CiSoftBody * CiSoftBodyHelpers::CreateFromTetGenFile(
 	printf("(surface node)%d / (surface face)%d \n", nSurfaceNodeCnt, psb->m_tetrasSurface.size());
 
 	int nNodes = psb->m_nodes.size();
-	int nLinks = psb->m_links.size();
-	for (int i = 0; i < nNodes; i++) {
-		psb->m_nodes[i].m_nAdjLinkCnt = 0;
-	}
-
-	for (int i = 0; i < nLinks; i++) {
-		psb->m_links[i].m_n[0]->m_nAdjLinkCnt++;
-		psb->m_links[i].m_n[1]->m_nAdjLinkCnt++;
-	}
+	psb->buildAdjacency();
 
 	int nCount = 0;
 	for (int i = 0; i < nNodes; i++) {
@@ -643,7 +622,6 @@ CiSoftBody* CiSoftBodyHelpers::generateHybridModel(CiSoftBody* psbTetra, const c
 
 	// generate Hybrid Model ////////////////////////////////////////////////////////////////////
 	btAlignedObjectArray<CiSoftBody::Tetra*> boundaryTetras;
-	btAlignedObjectArray<btVector3> centroidTetras;
 
 	for (int i = 0, ni = psbTetra->m_tetras.size(); i < ni; i++) {
 		int nBoundary = 0;
@@ -659,14 +637,6 @@ CiSoftBody* CiSoftBodyHelpers::generateHybridModel(CiSoftBody* psbTetra, const c
 
 		if (nBoundary >= 3) {
 			boundaryTetras.push_back(t);
-			btVector3 centroid;
-			centroid.setZero();
-
-			for (int j = 0; j < 4; j++) {
-				centroid += p[j]->m_x;
-			}
-			centroid /= 4.0;
-			centroidTetras.push_back(centroid);
 		}
 
 		btVector4 v0(p[0]->m_x.x(), p[0]->m_x.y(), p[0]->m_x.z(), 1);
@@ -682,47 +652,8 @@ CiSoftBody* CiSoftBodyHelpers::generateHybridModel(CiSoftBody* psbTetra, const c
 	}
 
 	/////  1  /////
-	btScalar avgLen = 0.0;
-	int nTetraSize = psbTetra->m_tetras.size();
-
-	for (int i = 0, ni = nMeshNodeCnt; i < ni; i++) {
-		btVector3& p = psbTetra->m_surfaceMeshNode[i].m_x;
-		btScalar minD = FLT_MAX;
-		int minTetIdx = -1;
-
-		// find closest mesh point tet centroid
-		for (int j = 0, nj = boundaryTetras.size(); j < nj; j++) {
-			btVector3& centroid = centroidTetras[j];
-			btScalar d = (centroid - p).length();
-			if (minD >= d) {
-				minD = d;
-				minTetIdx = boundaryTetras[j]->m_idx;
-			}
-		}
-
-		//   tet õǾ , ش tetra barycentric coordinate ǥ
-		if (minTetIdx != -1 && minTetIdx < nTetraSize) {
-			CiSoftBody::Tetra* t = &psbTetra->m_tetras[minTetIdx];
-			CiSoftBody::Node* n[4];
-			for (int j = 0; j < 4; j++) {
-				n[j] = t->m_n[j];
-			}
-
-			btVector4 b = GetBarycentricCoordinate(n[0]->m_x, n[1]->m_x, n[2]->m_x, n[3]->m_x, p);
-			psbTetra->m_bary[i] = b;
-			psbTetra->m_attachedTetraIdx[i] = minTetIdx;
-			avgLen += minD;
-		}
-		else {
-			printf("generateHybridModel: minTetIdx: -1\n");
-			printf("stop");
-			system("pause");
-		}
-	}
-	avgLen /= nMeshNodeCnt;
-	psbTetra->m_avgSurfaceMargin = avgLen;
+	psbTetra->m_avgSurfaceMargin = embedSurfaceMesh(boundaryTetras, psbTetra->m_surfaceMeshNode, psbTetra->m_attachedTetraIdx, psbTetra->m_bary);
 
-	centroidTetras.clear();
 	boundaryTetras.clear();
 
 	return psbTetra;
@@ -742,6 +673,7 @@ CiSoftBody* CiSoftBodyHelpers::mergeTetra(CiSoftBody* psb, CiSoftBody* psb2, con
 			FILE* heterofp = NULL;
 			fopen_s(&heterofp, hetero, "r");
 
+			bool bHeteroLoaded = false;
 			if (heterofp != NULL) {
 				char pcBuf[1024] = { 0 };
 
@@ -749,59 +681,87 @@ CiSoftBody* CiSoftBodyHelpers::mergeTetra(CiSoftBody* psb, CiSoftBody* psb2, con
 				fgets(pcBuf, sizeof(pcBuf), heterofp);
 				sscanf_s(pcBuf, "%d", &nTetraSize);
 
-				int nIdx = 0, nBool = 0;
-				for (int i = 0; i < nTetraSize; i++) {
-					CiSoftBody::Tetra& t = psb->m_tetras[i];
+				// ٸ model ̸ ٽ 
+				if (nTetraSize == psb->m_tetras.size()) {
+					int nIdx = 0, nBool = 0;
+					for (int i = 0; i < nTetraSize; i++) {
+						CiSoftBody::Tetra& t = psb->m_tetras[i];
 
-					fgets(pcBuf, sizeof(pcBuf), heterofp);
-					sscanf_s(pcBuf, "%d %d", &nIdx, &nBool);
+						fgets(pcBuf, sizeof(pcBuf), heterofp);
+						sscanf_s(pcBuf, "%d %d", &nIdx, &nBool);
 
-					t.m_hetero = nBool;
+						t.m_hetero = nBool;
+					}
+					bHeteroLoaded = true;
+				}
+				else {
+					printf("----hetero file : %d tetras, the model has %d\n", nTetraSize, psb->m_tetras.size());
 				}
 
 				fclose(heterofp);
 			}
-			else {
+			if (!bHeteroLoaded) {
 				// input
-				for (int i = 0, ni = psb->m_tetras.size(); i < ni; i++) {
-					//printf("L1 %d<%d\n", i, psb->m_tetras.size());
-
-					CiSoftBody::Tetra& t = psb->m_tetras[i];
-					btVector3 n[4];
-					for (int j = 0; j < 4; j++) {
-						n[j] = t.m_n[j]->m_x0;
-					}
-
-					int nInterpolationCnt = 2;
-					for (int j = 0, nj = psb2->m_links.size(); j < nj; j++) {
-						btVector3 node[2];
-						node[0] = psb2->m_links[j].m_n[0]->m_x0;
-						node[1] = psb2->m_links[j].m_n[1]->m_x0;
-
-						for (int k = 0; k <= nInterpolationCnt; k++) {
-							btVector3 p = node[0].lerp(node[1], k / (float)nInterpolationCnt);
+				// link  sample  ( , ߰),  cell ġ tetra ˻
+				std::chrono::steady_clock::time_point tStart = std::chrono::steady_clock::now();
+				int nTetras = psb->m_tetras.size();
+				btAlignedObjectArray<CiSoftBody::Tetra*> tetras;
+				tetras.resize(nTetras);
+				for (int i = 0; i < nTetras; i++) {
+					tetras[i] = &psb->m_tetras[i];
+				}
+				CiTetraGrid grid;
+				grid.build(tetras, true);
 
-							bool isInTetrahedron =
-								pointInTetrahedron(n[0], n[1], n[2], n[3], p) &&
-								pointInTetrahedron(n[1], n[2], n[3], n[0], p) &&
-								pointInTetrahedron(n[2], n[3], n[0], n[1], p) &&
-								pointInTetrahedron(n[3], n[0], n[1], n[2], p);
+				btAlignedObjectArray<int> isHetero;
+				isHetero.resize(nTetras);
+				for (int i = 0; i < nTetras; i++) {
+					isHetero[i] = 0;
+				}
 
-							if (isInTetrahedron) {
-								t.m_hetero = true;
-							}
+				const int nInterpolationCnt = 2;
+				const int nSamples = psb2->m_links.size() * (nInterpolationCnt + 1);
+#pragma omp parallel for schedule(dynamic, 256)
+				for (int s = 0; s < nSamples; s++) {
+					const int j = s / (nInterpolationCnt + 1), k = s % (nInterpolationCnt + 1);
+					btVector3 node[2];
+					node[0] = psb2->m_links[j].m_n[0]->m_x0;
+					node[1] = psb2->m_links[j].m_n[1]->m_x0;
+					btVector3 p = node[0].lerp(node[1], k / (float)nInterpolationCnt);
+
+					const int* candidates = NULL;
+					for (int c = 0, nc = grid.candidates(p, &candidates); c < nc; c++) {
+						const btVector3* n = grid.m_entries[candidates[c]].m_x;
+
+						bool isInTetrahedron =
+							pointInTetrahedron(n[0], n[1], n[2], n[3], p) &&
+							pointInTetrahedron(n[1], n[2], n[3], n[0], p) &&
+							pointInTetrahedron(n[2], n[3], n[0], n[1], p) &&
+							pointInTetrahedron(n[3], n[0], n[1], n[2], p);
+
+						if (isInTetrahedron) {
+#pragma omp atomic
+							isHetero[candidates[c]] |= 1;
 						}
 					}
 				}
+				for (int i = 0; i < nTetras; i++) {
+					if (isHetero[i]) {
+						psb->m_tetras[i].m_hetero = true;
+					}
+				}
+				printf("----hetero : %d samples (%.1f ms)\n", nSamples, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tStart).count());
 
 				fopen_s(&heterofp, hetero, "w");
-				fprintf(heterofp, "%d\n", psb->m_tetras.size());
+				if (heterofp != NULL) {
+					fprintf(heterofp, "%d\n", psb->m_tetras.size());
 
-				for (int i = 0, ni = psb->m_tetras.size(); i < ni; i++) {
-					CiSoftBody::Tetra& t = psb->m_tetras[i];
-					fprintf(heterofp, "%d %d\n", i + 1, t.m_hetero);
+					for (int i = 0, ni = psb->m_tetras.size(); i < ni; i++) {
+						CiSoftBody::Tetra& t = psb->m_tetras[i];
+						fprintf(heterofp, "%d %d\n", i + 1, t.m_hetero);
+					}
+					fclose(heterofp);
 				}
-				fclose(heterofp);
 			}
 
 
@@ -862,15 +822,14 @@ CiSoftBody* CiSoftBodyHelpers::mergeTetra(CiSoftBody* psb, CiSoftBody* psb2, con
 					for (int k = 0; k < 4; k++) {
 						if (j == k) { continue; }
 
+						// n[0], n[1] link (  link)
 						CiSoftBody::Link* l = NULL;
-						for (int s = 0, ns = psb->m_links.size(); s < ns; ++s)
-						{
+						int s = psb->findLink(n[0], n[1]);
+						if (s != -1) {
 							l = &psb->m_links[s];
-							if ((l->m_n[0] == n[0] && l->m_n[1] == n[1]) ||
-								(l->m_n[0] == n[1] && l->m_n[1] == n[0]))
-							{
-								break;
-							}
+						}
+						else if (psb->m_links.size() > 0) {
+							l = &psb->m_links[psb->m_links.size() - 1];
 						}
 						if (l != NULL) {
 							l->m_mat = m;
@@ -918,20 +877,11 @@ CiSoftBody* CiSoftBodyHelpers::mergeTetra(CiSoftBody* psb, CiSoftBody* psb2, con
 		if (psb2->m_surfaceMeshNode.size()) {
 			// node, face ״, ̿   յ Tetra  
 			btAlignedObjectArray<CiSoftBody::Tetra*> heteroTetras;
-			btAlignedObjectArray<btVector3> centroidTetras;
 
 			for (int i = 0, ni = psb->m_tetras.size(); i < ni; i++) {
 				CiSoftBody::Tetra* t = &psb->m_tetras[i];
 				if (t->m_hetero) {
 					heteroTetras.push_back(t);
-					btVector3 centroid;
-					centroid.setZero();
-
-					for (int j = 0; j < 4; j++) {
-						centroid += t->m_n[j]->m_x;
-					}
-					centroid /= 4.0;
-					centroidTetras.push_back(centroid);
 
 					btVector4 v0(t->m_n[0]->m_x, 1);
 					btVector4 v1(t->m_n[1]->m_x, 1);
@@ -942,57 +892,66 @@ CiSoftBody* CiSoftBodyHelpers::mergeTetra(CiSoftBody* psb, CiSoftBody* psb2, con
 				}
 			}
 
-			int nMeshNodeCount = psb2->m_surfaceMeshNode.size();
-			int nMeshFaceCount = psb2->m_surfaceMeshFace.size();
-			int nheteroTetrasCount = heteroTetras.size();
-			psb2->m_attachedTetraIdx.clear();
-			psb2->m_attachedTetraIdx.resize(nMeshNodeCount);
-			for (int i = 0; i < nMeshNodeCount; i++) {
-				psb2->m_attachedTetraIdx[i] = -1;
-			}
-
-			btScalar avgLen = 0.0;
-			for (int i = 0; i < nMeshNodeCount; i++) {
-				btVector3& p = psb2->m_surfaceMeshNode[i].m_x;
-				btScalar minD = FLT_MAX;
-				int minTetIdx = -1;
-
-				// find closest mesh point tet centroid
-				for (int j = 0, nj = nheteroTetrasCount; j < nj; j++) {
-					btVector3& centroid = centroidTetras[j];
-					btScalar d = (centroid - p).length();
-					if (minD >= d) {
-						minD = d;
-						minTetIdx = heteroTetras[j]->m_idx;
-					}
-				}
+			psb2->m_avgSurfaceMargin = embedSurfaceMesh(heteroTetras, psb2->m_surfaceMeshNode, psb2->m_attachedTetraIdx, psb2->m_bary);
+		}
+	}
 
-				if (minTetIdx != -1) {
-					CiSoftBody::Tetra* t = &psb->m_tetras[minTetIdx];
-					CiSoftBody::Node* n[4];
-					for (int j = 0; j < 4; j++) {
-						n[j] = t->m_n[j];
-					}
+	return psb;
+}
 
-					btVector4 b = GetBarycentricCoordinate(n[0]->m_x, n[1]->m_x, n[2]->m_x, n[3]->m_x, p);
+btScalar CiSoftBodyHelpers::embedSurfaceMesh(const btAlignedObjectArray<CiSoftBody::Tetra*>& tetras, const btAlignedObjectArray<CiSoftBody::Node>& meshNodes,
+	btAlignedObjectArray<int>& attachedTetraIdx, btAlignedObjectArray<btVector4>& bary)
+{
+	const int nMeshNodeCnt = meshNodes.size();
+	attachedTetraIdx.resize(nMeshNodeCnt);
+	bary.resize(nMeshNodeCnt);
+	for (int i = 0; i < nMeshNodeCnt; i++) {
+		attachedTetraIdx[i] = -1;
+	}
+	if (tetras.size() == 0) {
+		printf("generateHybridModel: minTetIdx: -1\n");
+		printf("stop");
+		system("pause");
+		return 0;
+	}
 
-					psb2->m_bary[i] = b;
-					psb2->m_attachedTetraIdx[i] = minTetIdx;
-					avgLen += minD;
-				}
-				else {
-					printf("generateHybridModel: minTetIdx: -1\n");
-					printf("stop");
-					system("pause");
-				}
-			}
+	auto t0 = std::chrono::steady_clock::now();
+	CiTetraGrid grid;
+	grid.build(tetras, false);
 
-			avgLen /= nMeshNodeCount;
-			psb2->m_avgSurfaceMargin = avgLen;
+	// ϴ tetra  (mesh tetra )   ߽ tetra
+	btAlignedObjectArray<btScalar> margin;
+	margin.resize(nMeshNodeCnt);
+	int nContained = 0;
+#pragma omp parallel for schedule(dynamic, 256) reduction(+:nContained)
+	for (int i = 0; i < nMeshNodeCnt; i++) {
+		const btVector3& p = meshNodes[i].m_x;
+		// the margin stays the distance to the nearest centroid (as the former scan), whatever the attached tetra
+		btScalar d = 0;
+		const int nearest = grid.findNearestCentroid(p, d);
+		int e = grid.findContaining(p, 1e-4f);
+		if (e != -1) {
+			nContained++;
+		}
+		else {
+			e = nearest;
 		}
+
+		const CiSoftBody::Tetra* t = tetras[e];
+		bary[i] = GetBarycentricCoordinate(t->m_n[0]->m_x, t->m_n[1]->m_x, t->m_n[2]->m_x, t->m_n[3]->m_x, p);
+		attachedTetraIdx[i] = t->m_idx;
+		margin[i] = d;
 	}
 
-	return psb;
+	btScalar avgLen = 0.0;
+	for (int i = 0; i < nMeshNodeCnt; i++) {
+		avgLen += margin[i];
+	}
+	avgLen /= nMeshNodeCnt;
+
+	printf("embedding : %d surface nodes, %d inside a tetra, %d to the nearest tetra (%.1f ms)\n", nMeshNodeCnt, nContained, nMeshNodeCnt - nContained,
+		std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count());
+	return avgLen;
 }
 
 btVector3 CiSoftBodyHelpers::getCenter(const char * node, int nStartIndexNum, bool bFlipYZAxis)
@@ -50,6 +50,10 @@ struct CiSoftBodyHelpers
 
 	static CiSoftBody* generateHybridModel(CiSoftBody* psbTetra, const char* meshFile, bool bFlipYZAxis, float fScale, bool bAlignObjectCenter, btVector3& center, btVector3& trans);
 	static CiSoftBody* mergeTetra(CiSoftBody* psb, CiSoftBody* psb2, const char* hetero);
+	// attaches the mesh nodes to the tetras (barycentric coordinates) : the tetra containing the node, else the tetra of the nearest centroid
+	// returns the average distance of the nodes to the nearest tetra centroid (m_avgSurfaceMargin)
+	static btScalar embedSurfaceMesh(const btAlignedObjectArray<CiSoftBody::Tetra*>& tetras, const btAlignedObjectArray<CiSoftBody::Node>& meshNodes,
+		btAlignedObjectArray<int>& attachedTetraIdx, btAlignedObjectArray<btVector4>& bary);
 
 	static btVector3 getCenter(const char * node, int nStartIndexNum, bool bFlipYZAxis);
 };
@@ -45,6 +45,10 @@ void CiSoftBody::initDefaults()
 	m_cfg.kMT			=	0.1;
 	m_cfg.kDP			=	0.05;
 	m_cfg.m_draw		=	DRAW_INIT_PROCESS;
+	m_cfg.m_solverMode	=	cfgSolverMode::Serial;
+	m_parallelReady		=	false;
+	resetToolBroadphase();
+	resetTopology();
 	
 
 	m_pose.m_bframe		=	false;
@@ -77,6 +81,7 @@ void CiSoftBody::destroySoftBody()
 	m_nodes.clear();
 	m_links.clear();
 	m_faces.clear();
+	resetTopology();
 	
 
 	for(int i=0;i<m_materials.size();++i) {
@@ -165,36 +170,11 @@ bool CiSoftBody::checkLink(int node0,int node1)
 }
 bool CiSoftBody::checkLink(const Node* node0,const Node* node1)
 {
-	const Node*	n[]={node0,node1};
-	for(int i=0,ni=m_links.size();i<ni;++i)
-	{
-		const Link&	l=m_links[i];
-		if(	(l.m_n[0]==n[0]&&l.m_n[1]==n[1])||
-			(l.m_n[0]==n[1]&&l.m_n[1]==n[0]))
-		{
-			return(true);
-		}
-	}
-	return(false);
+	return(findLink(node0,node1)!=-1);
 }
 bool CiSoftBody::checkFace(int node0,int node1,int node2)
 {
-	const Node*	n[]={	&m_nodes[node0],
-		&m_nodes[node1],
-		&m_nodes[node2]};
-	for(int i=0,ni=m_faces.size();i<ni;++i)
-	{
-		const Face&	f=m_faces[i];
-		int			c=0;
-		for(int j=0;j<3;++j)
-		{
-			if(	(f.m_n[j]==n[0])||
-				(f.m_n[j]==n[1])||
-				(f.m_n[j]==n[2])) c|=1<<j; else break;
-		}
-		if(c==7) return(true);
-	}
-	return(false);
+	return(findFace(node0,node1,node2)!=-1);
 }
 
 CiSoftBody::Material* CiSoftBody::appendMaterial()
@@ -916,6 +896,25 @@ void CiSoftBody::setConstraint(Constraint& c, Node** n, int nodeCnt, btScalar im
 	c.m_im = imSum;
 }
 
+void CiSoftBody::getConstraintResidual(btScalar& stretch, btScalar& volume)
+{
+	double sum = 0;
+	for (int i = 0, ni = m_stretchConstraints.size(); i < ni; i++) {
+		Constraint& c = m_stretchConstraints[i];
+		btScalar d = (c.m_n[0]->m_x - c.m_n[1]->m_x).length() - c.m_rest;
+		sum += d * d;
+	}
+	stretch = m_stretchConstraints.size() > 0 ? (btScalar)sqrt(sum / m_stretchConstraints.size()) : 0;
+
+	sum = 0;
+	for (int i = 0, ni = m_volumeConstraints.size(); i < ni; i++) {
+		Constraint& c = m_volumeConstraints[i];
+		btScalar d = VolumeOf(c.m_n[0]->m_x, c.m_n[1]->m_x, c.m_n[2]->m_x, c.m_n[3]->m_x) - c.m_rest;
+		sum += d * d;
+	}
+	volume = m_volumeConstraints.size() > 0 ? (btScalar)sqrt(sum / m_volumeConstraints.size()) : 0;
+}
+
 void CiSoftBody::initPose()
 {
 	int i, ni;
@@ -1022,6 +1021,17 @@ void CiSoftBody::initConstraints()
 	initBending();
 	initVolume();
 	initPose();
+	m_parallelReady = false;
+	resetToolBroadphase();
+}
+// flags (1 : the element makes a constraint) -> position of the constraint in the array (-1 : none), in the element order
+// the flags past the size of the array are dropped
+static void constraintSlots(btAlignedObjectArray<int>& slot, int nSize)
+{
+	int nNext = 0;
+	for (int i = 0, ni = slot.size(); i < ni; i++) {
+		slot[i] = (slot[i] && nNext < nSize) ? nNext++ : -1;
+	}
 }
 void CiSoftBody::initStretch()
 {
@@ -1068,15 +1078,20 @@ void CiSoftBody::initStretch()
 	case cfgMeshType::Tetra:
 	{
 		int nConstraintCnt = 0;
-		int nConstraintIdx_stretch = 0;
+		int nLinks = psb->m_links.size();
+		btAlignedObjectArray<int> slot;
+		slot.resize(nLinks);
 
 		// memory allocation //
-		for (int i = 0, ni = psb->m_links.size(); i < ni; i++) {
+#pragma omp parallel for schedule(static) reduction(+:nConstraintCnt)
+		for (int i = 0; i < nLinks; i++) {
 			Link&	l = psb->m_links[i];
 			Node* p[2];
 			p[0] = l.m_n[0];
 			p[1] = l.m_n[1];
 
+			slot[i] = (p[0]->m_im + p[1]->m_im > SIMD_EPSILON);
+
 			if (p[0]->m_im < 0) { continue; }
 			if (p[1]->m_im < 0) { continue; }
 
@@ -1084,8 +1099,12 @@ void CiSoftBody::initStretch()
 		}
 
 		psb->m_stretchConstraints.resize(nConstraintCnt);
+		constraintSlots(slot, nConstraintCnt);
+
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < nLinks; i++) {
+			if (slot[i] == -1) { continue; }
 
-		for (int i = 0, ni = psb->m_links.size(); i < ni; i++) {
 			Link&	l = psb->m_links[i];
 			Node* p[2];
 			p[0] = l.m_n[0];
@@ -1095,11 +1114,7 @@ void CiSoftBody::initStretch()
 			btScalar dirLength = dir.length();
 
 			btScalar imSum = p[0]->m_im + p[1]->m_im;
-
-			if (imSum > SIMD_EPSILON) {
-				setConstraint(psb->m_stretchConstraints[nConstraintIdx_stretch], p, 2, imSum, dirLength, p[0]->m_mat->m_kLST);
-				nConstraintIdx_stretch++;
-			}
+			setConstraint(psb->m_stretchConstraints[slot[i]], p, 2, imSum, dirLength, p[0]->m_mat->m_kLST);
 		}
 
 		break;
@@ -1147,9 +1162,10 @@ void CiSoftBody::initBending()
 		}
 
 		// dihedral angle      Ȯ //////////////////////////////////////////////
-#define IDX(_x_,_y_) ((_y_)*nNodes + (_x_))
-		btAlignedObjectArray<int> chks;
-		chks.resize(nNodes*nNodes, -1);
+		// edge (sorted node indices) -> link number in the order of appearance
+		TopologyTable chks;
+		chks.reset(2, nLinks);
+#define EDGE(_x_,_y_) ((_x_) < (_y_) ? (_x_) : (_y_)), ((_x_) < (_y_) ? (_y_) : (_x_))
 
 		int nLinkIdx = 0;
 		for (int i = 0, ni = nFaces; i < ni; i++)
@@ -1162,19 +1178,22 @@ void CiSoftBody::initBending()
 
 			for (int j = 2, k = 0; k < 3; j = k++)
 			{
-				if (chks[IDX(idx[j], idx[k])] == -1)
+				const int key[2] = { EDGE(idx[j], idx[k]) };
+				if (chks.find(key) == -1)
 				{
-					chks[IDX(idx[j], idx[k])] = nLinkIdx;
-					chks[IDX(idx[k], idx[j])] = nLinkIdx;
+					chks.insert(key, nLinkIdx);
 					nLinkIdx++;
 				}
 			}
 		}
 		for (int i = 0; i < nFaces; i++) {
+			const int e0[2] = { EDGE(psb->m_faces.at(i).m_n[2]->m_idx, psb->m_faces.at(i).m_n[0]->m_idx) };
+			const int e1[2] = { EDGE(psb->m_faces.at(i).m_n[0]->m_idx, psb->m_faces.at(i).m_n[1]->m_idx) };
+			const int e2[2] = { EDGE(psb->m_faces.at(i).m_n[1]->m_idx, psb->m_faces.at(i).m_n[2]->m_idx) };
 			int I[3] = { 0 };
-			I[0] = chks[IDX(psb->m_faces.at(i).m_n[2]->m_idx, psb->m_faces.at(i).m_n[0]->m_idx)];
-			I[1] = chks[IDX(psb->m_faces.at(i).m_n[0]->m_idx, psb->m_faces.at(i).m_n[1]->m_idx)];
-			I[2] = chks[IDX(psb->m_faces.at(i).m_n[1]->m_idx, psb->m_faces.at(i).m_n[2]->m_idx)];
+			I[0] = chks.find(e0);
+			I[1] = chks.find(e1);
+			I[2] = chks.find(e2);
 
 			m_linkIdx[i][0] = I[0];
 			m_linkIdx[i][1] = I[1];
@@ -1209,7 +1228,7 @@ void CiSoftBody::initBending()
 				}
 			}
 		}
-#undef IDX
+#undef EDGE
 
 		// init diherdral, triangle //////////////////////////////////////////////
 		int nConstraintCnt = 0;
@@ -1297,16 +1316,20 @@ void CiSoftBody::initBending()
 	{
 		// memory allocation //
 		int nConstraintCnt = 0;
-		int nConstraintIdx_bending = 0;
+		int nTetras = psb->m_tetras.size();
+		btAlignedObjectArray<int> slot;
+		slot.resize(nTetras * 4);
 
-		for (int i = 0; i < psb->m_tetras.size(); i++) {
-			Tetra* t = &psb->m_tetras[i];
+#pragma omp parallel for schedule(static) reduction(+:nConstraintCnt)
+		for (int i = 0; i < nTetras; i++) {
 			for (int j = 0; j < 4; j++) {
 				Node* p[3];
 				p[0] = psb->m_tetrasFaces[i * 4 + j].m_n[0];
 				p[1] = psb->m_tetrasFaces[i * 4 + j].m_n[1];
 				p[2] = psb->m_tetrasFaces[i * 4 + j].m_n[2];
 
+				slot[i * 4 + j] = (p[0]->m_im + p[1]->m_im + 2 * p[2]->m_im > SIMD_EPSILON);
+
 				if (p[0]->m_im < 0) { continue; }
 				if (p[1]->m_im < 0) { continue; }
 				if (p[2]->m_im < 0) { continue; }
@@ -1316,10 +1339,13 @@ void CiSoftBody::initBending()
 		}
 
 		psb->m_bendingConstraints_triangle.resize(nConstraintCnt);
+		constraintSlots(slot, nConstraintCnt);
 
-		for (int i = 0; i < psb->m_tetras.size(); i++) {
-			Tetra* t = &psb->m_tetras[i];
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < nTetras; i++) {
 			for (int j = 0; j < 4; j++) {
+				if (slot[i * 4 + j] == -1) { continue; }
+
 				Node* p[3];
 				p[0] = psb->m_tetrasFaces[i * 4 + j].m_n[0];
 				p[1] = psb->m_tetrasFaces[i * 4 + j].m_n[1];
@@ -1329,11 +1355,7 @@ void CiSoftBody::initBending()
 				btVector3 center = (p[0]->m_x0 + p[1]->m_x0 + p[2]->m_x0) / 3.0;
 				btVector3 dirCenter = p[2]->m_x0 - center;
 				btScalar dirLength = dirCenter.length();
-
-				if (imSum > SIMD_EPSILON) {
-					setConstraint(psb->m_bendingConstraints_triangle[nConstraintIdx_bending], p, 3, imSum, dirLength, p[0]->m_mat->m_kAST);
-					nConstraintIdx_bending++;
-				}
+				setConstraint(psb->m_bendingConstraints_triangle[slot[i * 4 + j]], p, 3, imSum, dirLength, p[0]->m_mat->m_kAST);
 			}
 		}
 		break;
@@ -1362,11 +1384,16 @@ void CiSoftBody::initVolume()
 	{
 		// memory allocation //
 		int nConstraintCnt = 0;
-		int nConstraintIdx_volume = 0;
+		int nTetras = psb->m_tetras.size();
+		btAlignedObjectArray<int> slot;
+		slot.resize(nTetras);
 
-		for (int i = 0; i < psb->m_tetras.size(); i++) {
+#pragma omp parallel for schedule(static) reduction(+:nConstraintCnt)
+		for (int i = 0; i < nTetras; i++) {
 			Tetra* t = &psb->m_tetras[i];
 
+			slot[i] = (t->m_n[0]->m_im + t->m_n[1]->m_im + 2 * t->m_n[2]->m_im > SIMD_EPSILON);
+
 			bool isUse = true;
 			for (int j = 0; j < 4; j++) {
 				if (t->m_n[j]->m_im < 0) {
@@ -1379,8 +1406,12 @@ void CiSoftBody::initVolume()
 		}
 
 		psb->m_volumeConstraints.resize(nConstraintCnt);
+		constraintSlots(slot, nConstraintCnt);
+
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < nTetras; i++) {
+			if (slot[i] == -1) { continue; }
 
-		for (int i = 0; i < psb->m_tetras.size(); i++) {
 			Tetra* t = &psb->m_tetras[i];
 			Node* p[4];
 
@@ -1390,11 +1421,7 @@ void CiSoftBody::initVolume()
 
 			btScalar imSum = p[0]->m_im + p[1]->m_im + 2 * p[2]->m_im;
 			btScalar volume = (VolumeOf(p[0]->m_x, p[1]->m_x, p[2]->m_x, p[3]->m_x));
-
-			if (imSum > SIMD_EPSILON) {
-				setConstraint(psb->m_volumeConstraints[nConstraintIdx_volume], p, 4, imSum, volume, p[0]->m_mat->m_kVST);
-				nConstraintIdx_volume++;
-			}
+			setConstraint(psb->m_volumeConstraints[slot[i]], p, 4, imSum, volume, p[0]->m_mat->m_kVST);
 		}
 		break;
 	}
@@ -1861,31 +1888,27 @@ void CiSoftBody::PSolveSelfCollision(CiSoftBody* psb)
 {
 
 }
-void CiSoftBody::PSolveToolCollision(CiSoftBody* psb)
-{
-	btScalar toolContactRange = 3.5;			// tool 浹ó 	2.0
-	btScalar toolRepulsiveStrength = 1.5;	// tool о  (  ũ Ͼ, Ҿ) 0.5
-	btScalar toolCorrectionRange = 0.1;		// tool о   frame ؼ  Ÿ(toolCorrectionRange)   ϰ  x
-	float marginOrigin = 1.7;	// 1.5
-	float shapeMargin = marginOrigin * toolContactRange * psb->m_cfg.m_contactMargin;
-
-	int nToolIdx = -1;
-	for (int i = 0, ni = psb->m_simulationSpace->rigidBodies.size(); i < ni; i++) {
-		if (psb->m_simulationSpace->rigidBodies[i]->getType() == CiRigidBody::bodyType::TOOL) {
-			nToolIdx = i;
-			break;
-		}
-	}
-	if (nToolIdx == -1) {
-		return;
-	}
+// tool collision //
+static const btScalar toolContactRange = 3.5;			// tool 浹ó 	2.0
+static const btScalar toolRepulsiveStrength = 1.5;	// tool о  (  ũ Ͼ, Ҿ) 0.5
+static const btScalar toolCorrectionRange = 0.1;		// tool о   frame ؼ  Ÿ(toolCorrectionRange)   ϰ  x
+static const float marginOrigin = 1.7;	// 1.5
 
-	btVector3 toolCollision1 = psb->m_simulationSpace->rigidBodies[nToolIdx]->m_visFiducialPoint[0];
-	btVector3 toolCollision2 = psb->m_simulationSpace->rigidBodies[nToolIdx]->m_visFiducialPoint[1];
+// acos(c) <= 90 deg without the acos (false out of [-1, 1] and for NaN, like the acos test)
+static inline bool isAcuteCos(const btScalar c)
+{
+	return c >= 0 && c <= 1;
+}
 
-	btVector3 toolDir = (toolCollision2 - toolCollision1);
-	btScalar toolLen = toolDir.length();
+btScalar CiSoftBody::getToolShapeMargin() const
+{
+	return marginOrigin * toolContactRange * m_cfg.m_contactMargin;
+}
 
+// narrow-phase of one node against the tool segment, toolDir : normalized (toolCollision2 - toolCollision1)
+static void solveToolCollisionNode(CiSoftBody::Node& node, const btVector3& toolCollision1, const btVector3& toolCollision2,
+	const btVector3& toolDir, const btScalar toolLen, const btScalar margin)
+{
 	btScalar tc1_x = toolCollision1.x();
 	btScalar tc1_y = toolCollision1.y();
 	btScalar tc1_z = toolCollision1.z();
@@ -1893,51 +1916,111 @@ void CiSoftBody::PSolveToolCollision(CiSoftBody* psb)
 	btScalar tc2_y = toolCollision2.y();
 	btScalar tc2_z = toolCollision2.z();
 
-	//printf("toolCollision1 : %f %f %f\n", tc1_x, tc1_y, tc1_z);
-	//printf("toolCollision2 : %f %f %f\n", tc2_x, tc2_y, tc2_z);
-
-	for (int i = 0, ni = psb->m_nodes.size(); i < ni; i++) {
-		Node& node = psb->m_nodes[i];
-		btVector3 nodeDir = (toolCollision1 - node.m_x);
-		btVector3 toolNodeCross = btCross(toolDir, nodeDir);
-		btScalar distance = toolNodeCross.length() / toolDir.length();
-		btScalar margin = shapeMargin;
-
-		if (distance < margin) {
-			// tempP (node    =  )
-			btScalar toolToTempPLen = sqrt(nodeDir.length2() - distance * distance);
-			toolDir.normalize();
-
-			//   ظ ߽ (P, Q),  r,  A  ,
-			// (1) ﰢ APQ ̰ PQ * r * 0.5 ۾ƾ
-			// (2) APQ AQP  90 ۾ƾ
-			btScalar PA_length = distance;
-			btScalar PQ_length = toolLen;
-			btScalar deg_length = distance * toolLen;
-			btVector3 PA = -nodeDir; // node.m_x - toolCollision1
-			btVector3 PQ = toolDir;  // toolCollision2 - toolCollision1
-			btScalar APQ_deg = acos(btDot(PA, PQ) / deg_length);
-			btVector3 QA = node.m_x - toolCollision2;
-			btVector3 QP = -toolDir; // toolCollsion1 - toolCollision2
-			btScalar AQP_deg = acos(btDot(QA, QP) / deg_length);
-
-			btScalar x, y, z;
-
-			x = toolDir.x()*toolToTempPLen + toolCollision1.x();
-			y = toolDir.y()*toolToTempPLen + toolCollision1.y();
-			z = toolDir.z()*toolToTempPLen + toolCollision1.z();
-			btVector3 tempP(x, y, z);
-
-			if (deg_length < SIMD_EPSILON) {
-				continue;
-			}
+	btVector3 nodeDir = (toolCollision1 - node.m_x);
+	btVector3 toolNodeCross = btCross(toolDir, nodeDir);
+	btScalar distance = toolNodeCross.length();
+
+	if (distance < margin) {
+		// tempP (node    =  )
+		btScalar toolToTempPLen = sqrt(nodeDir.length2() - distance * distance);
+
+		//   ظ ߽ (P, Q),  r,  A  ,
+		// (1) ﰢ APQ ̰ PQ * r * 0.5 ۾ƾ
+		// (2) APQ AQP  90 ۾ƾ
+		btScalar PA_length = distance;
+		btScalar PQ_length = toolLen;
+		btScalar deg_length = distance * toolLen;
+		btVector3 PA = -nodeDir; // node.m_x - toolCollision1
+		btVector3 PQ = toolDir;  // toolCollision2 - toolCollision1
+		btScalar APQ_cos = (btDot(PA, PQ) / deg_length);
+		btVector3 QA = node.m_x - toolCollision2;
+		btVector3 QP = -toolDir; // toolCollsion1 - toolCollision2
+		btScalar AQP_cos = (btDot(QA, QP) / deg_length);
+
+		btScalar x, y, z;
+
+		x = toolDir.x()*toolToTempPLen + toolCollision1.x();
+		y = toolDir.y()*toolToTempPLen + toolCollision1.y();
+		z = toolDir.z()*toolToTempPLen + toolCollision1.z();
+		btVector3 tempP(x, y, z);
+
+		if (deg_length < SIMD_EPSILON) {
+			return;
+		}
+
+		if (isAcuteCos(APQ_cos)) {
+			if (isAcuteCos(AQP_cos)) {
+				if (((tc1_x <= x && x <= tc2_x) || (tc2_x <= x && x <= tc1_x)) &&
+					((tc1_y <= y && y <= tc2_y) || (tc2_y <= y && y <= tc1_y)) &&
+					((tc1_z <= z && z <= tc2_z) || (tc2_z <= z && z <= tc1_z))) {
+					//  2 ġ   ̻ϰ  Ҷ ־ Ʒ ǽ ߰
+					btVector3 tempPToNode = node.m_x - tempP;	// 
+					btScalar tempPToNodeLen = tempPToNode.length();
+
+					if (tempPToNodeLen >= SIMD_EPSILON) {
+						tempPToNode /= tempPToNodeLen;
+						btVector3 newPos = tempPToNode * margin*0.5 + tempP;
+
+						if ((node.m_x - node.m_q).length() > margin*toolCorrectionRange) {
+
+						}
+						else {
+							btScalar lengthBefore = (node.m_x - tempP).length();
 
-			if (fabs(APQ_deg) <= 1.570796) {
-				if (fabs(AQP_deg) <= 1.570796) {
-					if (((tc1_x <= x && x <= tc2_x) || (tc2_x <= x && x <= tc1_x)) &&
-						((tc1_y <= y && y <= tc2_y) || (tc2_y <= y && y <= tc1_y)) &&
-						((tc1_z <= z && z <= tc2_z) || (tc2_z <= z && z <= tc1_z))) {
-						//  2 ġ   ̻ϰ  Ҷ ־ Ʒ ǽ ߰
+							if (lengthBefore > margin*0.5) {
+								node.m_x = tempPToNode * lengthBefore + tempP;
+								node.m_collision = true;
+							}
+							else {
+								if (tempPToNodeLen < margin*0.25) {
+									node.m_x = tempPToNode * margin*0.25 + tempP;
+									node.m_collision = true;
+								}
+								else {
+									node.m_x = newPos;
+									node.m_collision = true;
+								}
+							}
+
+						}
+					}
+
+				}
+			}
+		}
+		else {
+			btVector3 tempPCol1 = tempP - toolCollision1;
+			btVector3 tempPCol2 = toolCollision2 - toolCollision1;
+			btScalar tempPCol1Len = (tempPCol1).length();
+			if (tempPCol1Len < margin * 0.5) {
+				// 
+				btVector3 tempPToNode = node.m_x - tempP;	// 
+				btScalar tempPToNodeLen = tempPToNode.length();
+
+				if (tempPToNodeLen >= SIMD_EPSILON) {
+					tempPToNode /= tempPToNodeLen;
+					btVector3 newPos = tempPToNode * margin*0.5 + toolCollision1;
+
+					btScalar x = newPos.x();
+					btScalar y = newPos.y();
+					btScalar z = newPos.z();
+
+					//if ((toolCollision1 - newPos).length() > margin*0.5) { return; }
+
+					btVector3 nodeDir = (toolCollision1 - newPos);
+					btVector3 toolNodeCross = btCross(toolDir, nodeDir);
+					btScalar distance = toolNodeCross.length();
+					btScalar PA_length = distance;
+					btScalar PQ_length = toolLen;
+					btScalar deg_length = distance * toolLen;
+					btVector3 PA = -nodeDir; // node.m_x - toolCollision1
+					btVector3 PQ = toolDir;  // toolCollision2 - toolCollision1
+					btScalar APQ_cos = (btDot(PA, PQ) / deg_length);
+					btVector3 QA = node.m_x - toolCollision2;
+					btVector3 QP = -toolDir; // toolCollsion1 - toolCollision2
+					btScalar AQP_cos = (btDot(QA, QP) / deg_length);
+
+					if (isAcuteCos(APQ_cos) && isAcuteCos(AQP_cos)) {
 						btVector3 tempPToNode = node.m_x - tempP;	// 
 						btScalar tempPToNodeLen = tempPToNode.length();
 
@@ -1946,11 +2029,11 @@ void CiSoftBody::PSolveToolCollision(CiSoftBody* psb)
 							btVector3 newPos = tempPToNode * margin*0.5 + tempP;
 
 							if ((node.m_x - node.m_q).length() > margin*toolCorrectionRange) {
-
+								//node.m_x = tempPToNode * margin*toolCorrectionRange + tempP;
+								node.m_collision = true;
 							}
 							else {
 								btScalar lengthBefore = (node.m_x - tempP).length();
-
 								if (lengthBefore > margin*0.5) {
 									node.m_x = tempPToNode * lengthBefore + tempP;
 									node.m_collision = true;
@@ -1965,91 +2048,23 @@ void CiSoftBody::PSolveToolCollision(CiSoftBody* psb)
 										node.m_collision = true;
 									}
 								}
-
 							}
 						}
-
 					}
-				}
-			}
-			else {
-				btVector3 tempPCol1 = tempP - toolCollision1;
-				btVector3 tempPCol2 = toolCollision2 - toolCollision1;
-				btScalar tempPCol1Len = (tempPCol1).length();
-				if (tempPCol1Len < margin * 0.5) {
-					// 
-					btVector3 tempPToNode = node.m_x - tempP;	// 
-					btScalar tempPToNodeLen = tempPToNode.length();
-
-					if (tempPToNodeLen >= SIMD_EPSILON) {
-						tempPToNode /= tempPToNodeLen;
-						btVector3 newPos = tempPToNode * margin*0.5 + toolCollision1;
-
-						btScalar x = newPos.x();
-						btScalar y = newPos.y();
-						btScalar z = newPos.z();
-
-						//if ((toolCollision1 - newPos).length() > margin*0.5) { continue; }
-
-						btVector3 nodeDir = (toolCollision1 - newPos);
-						btVector3 toolNodeCross = btCross(toolDir, nodeDir);
-						btScalar distance = toolNodeCross.length() / toolDir.length();
-						btScalar PA_length = distance;
-						btScalar PQ_length = toolLen;
-						btScalar deg_length = distance * toolLen;
-						btVector3 PA = -nodeDir; // node.m_x - toolCollision1
-						btVector3 PQ = toolDir;  // toolCollision2 - toolCollision1
-						btScalar APQ_deg = acos(btDot(PA, PQ) / deg_length);
-						btVector3 QA = node.m_x - toolCollision2;
-						btVector3 QP = -toolDir; // toolCollsion1 - toolCollision2
-						btScalar AQP_deg = acos(btDot(QA, QP) / deg_length);
-
-						if (fabs(APQ_deg) <= 1.570796 && fabs(AQP_deg) <= 1.570796) {
-							btVector3 tempPToNode = node.m_x - tempP;	// 
-							btScalar tempPToNodeLen = tempPToNode.length();
-
-							if (tempPToNodeLen >= SIMD_EPSILON) {
-								tempPToNode /= tempPToNodeLen;
-								btVector3 newPos = tempPToNode * margin*0.5 + tempP;
-
-								if ((node.m_x - node.m_q).length() > margin*toolCorrectionRange) {
-									//node.m_x = tempPToNode * margin*toolCorrectionRange + tempP;
-									node.m_collision = true;
-								}
-								else {
-									btScalar lengthBefore = (node.m_x - tempP).length();
-									if (lengthBefore > margin*0.5) {
-										node.m_x = tempPToNode * lengthBefore + tempP;
-										node.m_collision = true;
-									}
-									else {
-										if (tempPToNodeLen < margin*0.25) {
-											node.m_x = tempPToNode * margin*0.25 + tempP;
-											node.m_collision = true;
-										}
-										else {
-											node.m_x = newPos;
-											node.m_collision = true;
-										}
-									}
-								}
-							}
+					else {
+						if (tempPToNodeLen < margin*0.25) {
+							node.m_x = tempPToNode * margin*0.25 + tempP;
+							node.m_collision = true;
 						}
 						else {
-							if (tempPToNodeLen < margin*0.25) {
-								node.m_x = tempPToNode * margin*0.25 + tempP;
+							btScalar lengthBefore = (node.m_x - toolCollision1).length();
+							if (lengthBefore > margin*0.5) {
+								node.m_x = tempPToNode * lengthBefore + toolCollision1;
 								node.m_collision = true;
 							}
 							else {
-								btScalar lengthBefore = (node.m_x - toolCollision1).length();
-								if (lengthBefore > margin*0.5) {
-									node.m_x = tempPToNode * lengthBefore + toolCollision1;
-									node.m_collision = true;
-								}
-								else {
-									node.m_x = newPos;
-									node.m_collision = true;
-								}
+								node.m_x = newPos;
+								node.m_collision = true;
 							}
 						}
 					}
@@ -2059,6 +2074,33 @@ void CiSoftBody::PSolveToolCollision(CiSoftBody* psb)
 	}
 }
 
+void CiSoftBody::PSolveToolCollision(CiSoftBody* psb)
+{
+	ToolBroadphase& bp = psb->m_toolBp;
+	if (!bp.m_ready) {
+		psb->updateToolBroadphase();
+	}
+	if (bp.m_toolIdx == -1) {
+		return;
+	}
+
+	// fiducials of the broad-phase, the tool does not move inside a step
+	btVector3 toolCollision1 = bp.m_tool[0];
+	btVector3 toolCollision2 = bp.m_tool[1];
+
+	btVector3 toolDir = (toolCollision2 - toolCollision1);
+	btScalar toolLen = toolDir.length();
+	if (toolLen < SIMD_EPSILON) {
+		return;
+	}
+	toolDir /= toolLen;
+
+	btScalar margin = psb->getToolShapeMargin();
+	for (int i = 0, ni = bp.m_candidates.size(); i < ni; i++) {
+		solveToolCollisionNode(psb->m_nodes[bp.m_candidates[i]], toolCollision1, toolCollision2, toolDir, toolLen, margin);
+	}
+}
+
 void CiSoftBody::solveConstraints()
 {
 	/* Prepare links		*/
@@ -2083,12 +2125,20 @@ void CiSoftBody::solveConstraints()
 		}
 	}
 
+	// tool collision candidates of this step //
+	updateToolBroadphase();
+
 	// position solver //
 	if (m_cfg.piterations > 0) {
 		// iteration //
-		for (int iSolve = 0; iSolve < m_cfg.piterations; iSolve++) {
-			for (int iSeq = 0; iSeq < m_cfg.m_psequence.size(); iSeq++) {
-				getSolver(m_cfg.m_psequence[iSeq])(this);
+		if (m_cfg.m_solverMode == cfgSolverMode::Parallel && m_cfg.m_meshType == cfgMeshType::Tetra) {
+			solvePositionsParallel();
+		}
+		else {
+			for (int iSolve = 0; iSolve < m_cfg.piterations; iSolve++) {
+				for (int iSeq = 0; iSeq < m_cfg.m_psequence.size(); iSeq++) {
+					getSolver(m_cfg.m_psequence[iSeq])(this);
+				}
 			}
 		}
 
@@ -2102,6 +2152,7 @@ void CiSoftBody::solveConstraints()
 	}
 
 	PSolveToolCollision(this);
+	m_toolBp.m_ready = false;
 
 	updateNormals();
 	updateSurfaceVertices();
@@ -132,6 +132,10 @@ public:
 		Mesh,		
 		Tetra
 	};};
+	struct	cfgSolverMode { enum _ {
+		Serial,			// gauss-seidel over the constraint arrays (Node pointers)
+		Parallel		// graph-coloured batches over the SoA node state (Tetra only)
+	};};
 	struct Config
 	{
 		int						m_meshType;
@@ -145,6 +149,7 @@ public:
 
 		btScalar				kDP;
 		btScalar				kMT;
+		int						m_solverMode;		// cfgSolverMode
 	};
 	struct Constraint
 	{
@@ -170,6 +175,59 @@ public:
 		btMatrix3x3				m_aqq;			// Base scaling
 	};
 
+	// constraints of one type, reordered so that constraints of a colour share no node
+	struct ColoredConstraints
+	{
+		int							m_nodeCnt;		// nodes per constraint
+		btAlignedObjectArray<int>	m_colorStart;	// colour c = [m_colorStart[c], m_colorStart[c+1])
+		btAlignedObjectArray<int>	m_nodeIdx;		// m_nodeCnt node indices per constraint
+		btAlignedObjectArray<btScalar>	m_rest;
+		btAlignedObjectArray<btScalar>	m_im;
+		btAlignedObjectArray<btScalar>	m_prime;
+	};
+	// hot node state of the parallel solver
+	struct SolverState_SoA
+	{
+		btAlignedObjectArray<btScalar>	m_x, m_y, m_z;	// positions
+		btAlignedObjectArray<btScalar>	m_im;			// 1/mass
+	};
+	// tool collision broad-phase : hashed uniform grid over the nodes, refit once per step
+	struct ToolBroadphase
+	{
+		int							m_toolIdx;		// cached index of the TOOL rigid body (-1 : none)
+		bool						m_ready;		// candidates are valid for the current step
+		bool						m_hasPrev;
+		btVector3					m_tool[2];		// fiducials of the current step
+		btVector3					m_prev[2];		// fiducials of the previous step (swept capsule)
+		btScalar					m_cellSize;
+		btAlignedObjectArray<int>	m_nodeCell;		// hashed cell per node
+		btAlignedObjectArray<int>	m_cellStart;	// cell c = m_cellNodes[m_cellStart[c], m_cellStart[c+1])
+		btAlignedObjectArray<int>	m_cellNodes;
+		btAlignedObjectArray<int>	m_stamp;		// per node, dedup of the query
+		int							m_curStamp;
+		btAlignedObjectArray<int>	m_candidates;	// nodes narrow-phase tested in this step
+		int							m_numRebinned;	// nodes that changed cell in the last refit
+	};
+	// sorted node indices of an element (link : 2, face : 3) -> element index, open addressing
+	struct TopologyTable
+	{
+		int							m_keyCnt;		// node indices per key
+		int							m_size;			// keys in the table
+		int							m_indexed;		// the elements [0, m_indexed) of the array are in the table (findLink / findFace)
+		btAlignedObjectArray<int>	m_keys;			// m_keyCnt per slot, -1 : empty slot
+		btAlignedObjectArray<int>	m_values;
+
+		void reset(int keyCnt, int expected = 0);
+		int find(const int* key) const;				// -1 : none
+		void insert(const int* key, int value);		// the first value of a key is kept
+	};
+	// node -> elements (compressed sparse rows) : node n = m_items[m_start[n], m_start[n+1])
+	struct Adjacency
+	{
+		btAlignedObjectArray<int>	m_start;
+		btAlignedObjectArray<int>	m_items;
+	};
+
 	typedef btAlignedObjectArray<Constraint>	tConstraintArray;
 	typedef btAlignedObjectArray<Node>			tNodeArray;
 	typedef btAlignedObjectArray<Link>			tLinkArray;
@@ -217,6 +275,22 @@ public:
 	tConstraintArray		m_volumeConstraints_surface;
 	tConstraintArray		m_volumeConstraints;
 
+	// parallel solver //
+	bool					m_parallelReady;
+	ColoredConstraints		m_parStretch;
+	ColoredConstraints		m_parVolume;
+	ColoredConstraints		m_parBending;
+	SolverState_SoA			m_soa;
+
+	// tool collision //
+	ToolBroadphase			m_toolBp;
+
+	// topology //
+	TopologyTable			m_linkTable;
+	TopologyTable			m_faceTable;
+	Adjacency				m_nodeLinks;		// node -> links
+	Adjacency				m_nodeTetras;		// node -> tetras
+
 
 	/// constructor /////////////////////////////////////////////////////////////////////////////////////////
 	CiSoftBody();
@@ -236,6 +310,12 @@ public:
 	bool checkLink(const Node* node0,const Node* node1);
 	bool checkFace(int node0,int node1, int node2);
 
+	// topology (softbodyTopology.cpp) ////////////////////////////////////////////////////////////
+	int findLink(const Node* node0, const Node* node1);	// link index, -1 : none
+	int findFace(int node0, int node1, int node2);		// face index, -1 : none
+	void resetTopology();
+	void buildAdjacency();								// m_nodeLinks, m_nodeTetras and m_nAdjLinkCnt
+
 	Material* appendMaterial();
 	Material* appendMaterial(Material* m);
 	void appendNode(const btVector3& x, btScalar m);
@@ -286,6 +366,17 @@ public:
 	void initConstraints();
 	void solveConstraints();
 	void setConstraint(Constraint& c, Node** n, int nodeCnt, btScalar imSum, btScalar rest, btScalar prime);
+	void getConstraintResidual(btScalar& stretch, btScalar& volume);	// RMS of (length - rest), (volume - rest)
+
+	// parallel solver (softbodySolver.cpp) ////////////////////////////////////////////////////
+	void setSolverMode(int mode);
+	void initParallelSolver();
+	void solvePositionsParallel();
+	void gatherSoA();
+	void scatterSoA();
+	void PSolveStretchParallel();
+	void PSolveVolumeParallel();
+	void PSolveBendingParallel();
 
 	// constraint //////////////////////////////////////////////////////////////////////////////
 	void initStretch();
@@ -299,6 +390,12 @@ public:
 	static void PSolveSelfCollision(CiSoftBody* psb);
 	static void PSolveGroundCollision(CiSoftBody* psb);
 	static void PSolveToolCollision(CiSoftBody* psb);
+	btScalar getToolShapeMargin() const;	// tool radius of the narrow-phase
+
+	// tool collision broad-phase (softbodyCollision.cpp) ////////////////////////////////////////
+	void resetToolBroadphase();
+	void updateToolBroadphase();
+	void getToolBroadphaseStats(int& tested, int& rebinned);	// nodes tested / re-binned in the last step
 };
 
 
@@ -0,0 +1,173 @@
+#include "softbody.h"
+#include "Simulation.h"
+
+#include <math.h>
+
+// capsule radius of the broad-phase = narrow-phase margin * this, the slack covers the node motion inside the position iterations
+#define TOOL_BROADPHASE_SLACK 1.5
+
+static inline int hashCell(const int ix, const int iy, const int iz, const int mask)
+{
+	return (int)(((unsigned)ix * 73856093u) ^ ((unsigned)iy * 19349663u) ^ ((unsigned)iz * 83492791u)) & mask;
+}
+
+static inline int cellCoord(const btScalar v, const btScalar invCell)
+{
+	return (int)floor(v * invCell);
+}
+
+// squared distance from p to the surface swept by the segment (p0, q0) -> (p1, q1), early out at maxSqd
+static inline btScalar sweptSegmentSqd(const btVector3& p, const btVector3& p0, const btVector3& q0,
+	const btVector3& p1, const btVector3& q1, const btScalar maxSqd)
+{
+	btVector3 prj;
+	btScalar sqd = maxSqd;
+	ProjectOrigin(p1 - p, q1 - p, prj, sqd);
+	if (sqd < maxSqd) { return sqd; }
+	// the ruled surface between the two segments, split in two triangles
+	ProjectOrigin(p0 - p, q0 - p, q1 - p, prj, sqd);
+	if (sqd < maxSqd) { return sqd; }
+	ProjectOrigin(p0 - p, q1 - p, p1 - p, prj, sqd);
+	return sqd;
+}
+
+void CiSoftBody::resetToolBroadphase()
+{
+	ToolBroadphase& bp = m_toolBp;
+	bp.m_toolIdx = -1;
+	bp.m_ready = false;
+	bp.m_hasPrev = false;
+	bp.m_cellSize = 0;
+	bp.m_nodeCell.clear();
+	bp.m_cellStart.clear();
+	bp.m_cellNodes.clear();
+	bp.m_stamp.clear();
+	bp.m_curStamp = 0;
+	bp.m_candidates.clear();
+	bp.m_numRebinned = 0;
+}
+
+void CiSoftBody::updateToolBroadphase()
+{
+	ToolBroadphase& bp = m_toolBp;
+	bp.m_ready = true;
+	bp.m_candidates.resize(0);
+
+	// tool index (cached, searched again only when the rigid body list changed)
+	btAlignedObjectArray<CiRigidBody*>& rigidBodies = m_simulationSpace->rigidBodies;
+	if (bp.m_toolIdx < 0 || bp.m_toolIdx >= rigidBodies.size() || rigidBodies[bp.m_toolIdx]->getType() != CiRigidBody::bodyType::TOOL) {
+		bp.m_toolIdx = -1;
+		for (int i = 0, ni = rigidBodies.size(); i < ni; i++) {
+			if (rigidBodies[i]->getType() == CiRigidBody::bodyType::TOOL) {
+				bp.m_toolIdx = i;
+				break;
+			}
+		}
+	}
+	if (bp.m_toolIdx == -1 || rigidBodies[bp.m_toolIdx]->m_visFiducialPoint.size() < 2) {
+		bp.m_toolIdx = -1;
+		bp.m_hasPrev = false;
+		return;
+	}
+
+	const int nNodes = m_nodes.size();
+	if (nNodes == 0) { return; }
+
+	bp.m_tool[0] = rigidBodies[bp.m_toolIdx]->m_visFiducialPoint[0];
+	bp.m_tool[1] = rigidBodies[bp.m_toolIdx]->m_visFiducialPoint[1];
+	if (!bp.m_hasPrev) {
+		bp.m_prev[0] = bp.m_tool[0];
+		bp.m_prev[1] = bp.m_tool[1];
+	}
+	const btVector3 p0 = bp.m_prev[0], q0 = bp.m_prev[1], p1 = bp.m_tool[0], q1 = bp.m_tool[1];
+	bp.m_prev[0] = p1;
+	bp.m_prev[1] = q1;
+	bp.m_hasPrev = true;
+
+	const btScalar radius = getToolShapeMargin() * TOOL_BROADPHASE_SLACK;
+	if (radius <= SIMD_EPSILON) { return; }
+
+	// refit : re-bin the nodes, the CSR is rebuilt only when a node changed cell
+	int tableSize = 1;
+	while (tableSize < nNodes * 2) { tableSize <<= 1; }
+	const int mask = tableSize - 1;
+	bool rebuild = bp.m_cellSize != radius || bp.m_nodeCell.size() != nNodes || bp.m_cellStart.size() != tableSize + 1;
+	if (rebuild) {
+		bp.m_cellSize = radius;
+		bp.m_nodeCell.resize(nNodes);
+		bp.m_cellStart.resize(tableSize + 1);
+		bp.m_cellNodes.resize(nNodes);
+		bp.m_stamp.resize(nNodes);
+		for (int i = 0; i < nNodes; i++) { bp.m_stamp[i] = 0; }
+		bp.m_curStamp = 0;
+	}
+	const btScalar invCell = 1 / bp.m_cellSize;
+	int numRebinned = 0;
+	for (int i = 0; i < nNodes; i++) {
+		const btVector3& x = m_nodes[i].m_x;
+		int c = hashCell(cellCoord(x.x(), invCell), cellCoord(x.y(), invCell), cellCoord(x.z(), invCell), mask);
+		if (rebuild || bp.m_nodeCell[i] != c) {
+			bp.m_nodeCell[i] = c;
+			numRebinned++;
+		}
+	}
+	bp.m_numRebinned = numRebinned;
+	if (rebuild || numRebinned > 0) {
+		// counting sort, m_cellStart[c] holds the end of cell c until the fill moves it to the start
+		for (int c = 0; c <= tableSize; c++) { bp.m_cellStart[c] = 0; }
+		for (int i = 0; i < nNodes; i++) { bp.m_cellStart[bp.m_nodeCell[i]]++; }
+		for (int c = 1; c < tableSize; c++) { bp.m_cellStart[c] += bp.m_cellStart[c - 1]; }
+		bp.m_cellStart[tableSize] = nNodes;
+		for (int i = nNodes - 1; i >= 0; i--) { bp.m_cellNodes[--bp.m_cellStart[bp.m_nodeCell[i]]] = i; }
+	}
+
+	// query : cells overlapping the bounds of the swept capsule
+	btVector3 bmin = p0, bmax = p0;
+	bmin.setMin(q0); bmin.setMin(p1); bmin.setMin(q1);
+	bmax.setMax(q0); bmax.setMax(p1); bmax.setMax(q1);
+	const btVector3 r(radius, radius, radius);
+	bmin -= r;
+	bmax += r;
+
+	const btScalar maxSqd = radius * radius;
+	int c0[3], c1[3];
+	double numCells = 1;
+	for (int k = 0; k < 3; k++) {
+		c0[k] = cellCoord(bmin[k], invCell);
+		c1[k] = cellCoord(bmax[k], invCell);
+		numCells *= (double)(c1[k] - c0[k] + 1);
+	}
+	if (numCells >= tableSize) {
+		// the tool sweeps most of the grid (fast motion, first step), test every node
+		for (int i = 0; i < nNodes; i++) {
+			if (sweptSegmentSqd(m_nodes[i].m_x, p0, q0, p1, q1, maxSqd) < maxSqd) { bp.m_candidates.push_back(i); }
+		}
+		return;
+	}
+
+	// hashed cells may alias, a node is tested once per query
+	if (++bp.m_curStamp == 0x7fffffff) {
+		for (int i = 0; i < nNodes; i++) { bp.m_stamp[i] = 0; }
+		bp.m_curStamp = 1;
+	}
+	const int stamp = bp.m_curStamp;
+	for (int iz = c0[2]; iz <= c1[2]; iz++) {
+		for (int iy = c0[1]; iy <= c1[1]; iy++) {
+			for (int ix = c0[0]; ix <= c1[0]; ix++) {
+				const int c = hashCell(ix, iy, iz, mask);
+				for (int k = bp.m_cellStart[c], nk = bp.m_cellStart[c + 1]; k < nk; k++) {
+					const int i = bp.m_cellNodes[k];
+					if (bp.m_stamp[i] == stamp) { continue; }
+					bp.m_stamp[i] = stamp;
+					if (sweptSegmentSqd(m_nodes[i].m_x, p0, q0, p1, q1, maxSqd) < maxSqd) { bp.m_candidates.push_back(i); }
+				}
+			}
+		}
+	}
+}
+
+void CiSoftBody::getToolBroadphaseStats(int& tested, int& rebinned)
+{
+	tested = m_toolBp.m_candidates.size();
+	rebinned = m_toolBp.m_numRebinned;
+}
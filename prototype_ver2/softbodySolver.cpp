@@ -0,0 +1,392 @@
+#include "softbody.h"
+
+#include <stdio.h>
+#include <vector>
+#include <algorithm>
+#include <emmintrin.h>
+
+// colours with fewer constraints than this are solved on the calling thread
+#define PARALLEL_MIN_BATCH 256
+
+// greedy colouring by rounds : a round takes every remaining constraint whose nodes are not used yet in the round
+static void buildColoredConstraints(CiSoftBody* psb, const CiSoftBody::tConstraintArray& cs, const int nodeCnt, const bool imFromNodes, CiSoftBody::ColoredConstraints& out)
+{
+	out.m_nodeCnt = nodeCnt;
+	out.m_colorStart.clear();
+	out.m_nodeIdx.clear();
+	out.m_rest.clear();
+	out.m_im.clear();
+	out.m_prime.clear();
+	if (psb->m_nodes.size() == 0) return;
+
+	const CiSoftBody::Node* n0 = &psb->m_nodes[0];
+	std::vector<int> remaining, batch, rest;
+	for (int i = 0, ni = cs.size(); i < ni; i++) {
+		if (cs[i].m_isUse && cs[i].m_nodeCnt == nodeCnt) { remaining.push_back(i); }
+	}
+
+	std::vector<int> stamp(psb->m_nodes.size(), -1);
+	for (int color = 0; !remaining.empty(); color++) {
+		batch.clear();
+		rest.clear();
+		for (int k = 0; k < (int)remaining.size(); k++) {
+			const CiSoftBody::Constraint& c = cs[remaining[k]];
+			bool isFree = true;
+			for (int j = 0; j < nodeCnt; j++) {
+				if (stamp[c.m_n[j] - n0] == color) { isFree = false; break; }
+			}
+			if (!isFree) { rest.push_back(remaining[k]); continue; }
+			for (int j = 0; j < nodeCnt; j++) {
+				stamp[c.m_n[j] - n0] = color;
+			}
+			batch.push_back(remaining[k]);
+		}
+
+		// inside a colour the order is free, follow the node memory order
+		std::sort(batch.begin(), batch.end(), [&](const int a, const int b) { return cs[a].m_n[0] < cs[b].m_n[0]; });
+
+		out.m_colorStart.push_back(out.m_rest.size());
+		for (int k = 0; k < (int)batch.size(); k++) {
+			const CiSoftBody::Constraint& c = cs[batch[k]];
+			btScalar imSum = 0;
+			for (int j = 0; j < nodeCnt; j++) {
+				out.m_nodeIdx.push_back((int)(c.m_n[j] - n0));
+				imSum += c.m_n[j]->m_im;
+			}
+			out.m_rest.push_back(c.m_rest);
+			out.m_im.push_back(imFromNodes ? imSum : c.m_im);
+			out.m_prime.push_back(c.m_prime);
+		}
+		remaining.swap(rest);
+	}
+	out.m_colorStart.push_back(out.m_rest.size());
+}
+
+// sums of the current 1/mass of the constraint nodes (pinning or setMass after the colouring)
+static void refreshColoredIm(CiSoftBody::ColoredConstraints& cc, const btScalar* im)
+{
+	const int nodeCnt = cc.m_nodeCnt, nCons = cc.m_im.size();
+	if (nCons == 0) return;
+	const int* idx = &cc.m_nodeIdx[0];
+	btScalar* imSum = &cc.m_im[0];
+#pragma omp parallel for schedule(static) if (nCons >= PARALLEL_MIN_BATCH)
+	for (int k = 0; k < nCons; k++) {
+		btScalar s = 0;
+		for (int j = 0; j < nodeCnt; j++) {
+			s += im[idx[k * nodeCnt + j]];
+		}
+		imSum[k] = s;
+	}
+}
+
+void CiSoftBody::setSolverMode(int mode)
+{
+	m_cfg.m_solverMode = mode;
+	if (mode == cfgSolverMode::Parallel && m_cfg.m_meshType != cfgMeshType::Tetra) {
+		printf("parallel solver : only for the tetra mesh, the serial solver is used\n");
+	}
+}
+
+void CiSoftBody::initParallelSolver()
+{
+	// same per-type rules as PSolveStretch / PSolveVolume / PSolveBending (Tetra)
+	buildColoredConstraints(this, m_stretchConstraints, 2, false, m_parStretch);
+	buildColoredConstraints(this, m_volumeConstraints, 4, true, m_parVolume);
+	buildColoredConstraints(this, m_bendingConstraints_triangle, 3, false, m_parBending);
+
+	int nNodes = m_nodes.size();
+	m_soa.m_x.resize(nNodes);
+	m_soa.m_y.resize(nNodes);
+	m_soa.m_z.resize(nNodes);
+	m_soa.m_im.resize(nNodes);
+	m_parallelReady = true;
+
+	printf("parallel solver : colours (stretch %d, volume %d, bending %d)\n",
+		m_parStretch.m_colorStart.size() - 1, m_parVolume.m_colorStart.size() - 1, m_parBending.m_colorStart.size() - 1);
+}
+
+void CiSoftBody::gatherSoA()
+{
+	int nNodes = m_nodes.size();
+	btScalar* x = &m_soa.m_x[0], *y = &m_soa.m_y[0], *z = &m_soa.m_z[0];
+#pragma omp parallel for schedule(static)
+	for (int i = 0; i < nNodes; i++) {
+		const btVector3& p = m_nodes[i].m_x;
+		x[i] = p.x();
+		y[i] = p.y();
+		z[i] = p.z();
+	}
+}
+
+void CiSoftBody::scatterSoA()
+{
+	int nNodes = m_nodes.size();
+	const btScalar* x = &m_soa.m_x[0], *y = &m_soa.m_y[0], *z = &m_soa.m_z[0];
+#pragma omp parallel for schedule(static)
+	for (int i = 0; i < nNodes; i++) {
+		m_nodes[i].m_x.setValue(x[i], y[i], z[i]);
+	}
+}
+
+void CiSoftBody::solvePositionsParallel()
+{
+	if (!m_parallelReady) { initParallelSolver(); }
+	if (m_nodes.size() == 0) { return; }
+
+	for (int i = 0, ni = m_nodes.size(); i < ni; i++) {
+		m_soa.m_im[i] = m_nodes[i].m_im;
+	}
+	// PSolveVolume sums the node masses on each solve, stretch and bending keep Constraint::m_im as the serial solvers
+	refreshColoredIm(m_parVolume, &m_soa.m_im[0]);
+	gatherSoA();
+
+	for (int iSolve = 0; iSolve < m_cfg.piterations; iSolve++) {
+		for (int iSeq = 0; iSeq < m_cfg.m_psequence.size(); iSeq++) {
+			switch (m_cfg.m_psequence[iSeq]) {
+			case ePSolver::Stretch:		PSolveStretchParallel(); break;
+			case ePSolver::Volume:		PSolveVolumeParallel(); break;
+			case ePSolver::Bending:		PSolveBendingParallel(); break;
+			case ePSolver::ToolCollision:
+			{
+				// only the broad-phase candidates can move
+				btScalar* x = &m_soa.m_x[0], *y = &m_soa.m_y[0], *z = &m_soa.m_z[0];
+				const btAlignedObjectArray<int>& cand = m_toolBp.m_candidates;
+				for (int k = 0, nk = cand.size(); k < nk; k++) {
+					m_nodes[cand[k]].m_x.setValue(x[cand[k]], y[cand[k]], z[cand[k]]);
+				}
+				PSolveToolCollision(this);
+				for (int k = 0, nk = cand.size(); k < nk; k++) {
+					const btVector3& p = m_nodes[cand[k]].m_x;
+					x[cand[k]] = p.x(); y[cand[k]] = p.y(); z[cand[k]] = p.z();
+				}
+				break;
+			}
+			default:
+			{
+				// solvers working on the Node array (tool collision, ...)
+				scatterSoA();
+				getSolver(m_cfg.m_psequence[iSeq])(this);
+				gatherSoA();
+			}
+			}
+		}
+	}
+	scatterSoA();
+}
+
+// stretch //////////////////////////////////////////////////////////////////////////////////
+static inline void solveStretch1(const int k, const int* idx, const btScalar* rest, const btScalar* imSum, const btScalar* prime,
+	btScalar* x, btScalar* y, btScalar* z, const btScalar* im)
+{
+	int a = idx[k * 2], b = idx[k * 2 + 1];
+	btScalar dx = x[a] - x[b], dy = y[a] - y[b], dz = z[a] - z[b];
+	btScalar len = btSqrt(dx * dx + dy * dy + dz * dz);
+	if (len <= SIMD_EPSILON || imSum[k] <= SIMD_EPSILON) { return; }
+
+	btScalar s = -(len - rest[k]) * prime[k] / (imSum[k] * len);
+	if (im[a] > 0) { x[a] += s * dx * im[a]; y[a] += s * dy * im[a]; z[a] += s * dz * im[a]; }
+	if (im[b] > 0) { x[b] -= s * dx * im[b]; y[b] -= s * dy * im[b]; z[b] -= s * dz * im[b]; }
+}
+
+#ifndef BT_USE_DOUBLE_PRECISION
+#define GATHER4(arr, i0, i1, i2, i3) _mm_set_ps(arr[i3], arr[i2], arr[i1], arr[i0])
+#define SCATTER4(arr, i0, i1, i2, i3, v) { float _t[4]; _mm_storeu_ps(_t, v); arr[i0] = _t[0]; arr[i1] = _t[1]; arr[i2] = _t[2]; arr[i3] = _t[3]; }
+
+// 4 constraints of the same colour (no shared node) per call
+static inline void solveStretch4(const int k, const int* idx, const btScalar* rest, const btScalar* imSum, const btScalar* prime,
+	btScalar* x, btScalar* y, btScalar* z, const btScalar* im)
+{
+	const int* ci = idx + k * 2;
+	const int a0 = ci[0], b0 = ci[1], a1 = ci[2], b1 = ci[3], a2 = ci[4], b2 = ci[5], a3 = ci[6], b3 = ci[7];
+	const __m128 zero = _mm_setzero_ps(), eps = _mm_set1_ps(SIMD_EPSILON);
+
+	__m128 ax = GATHER4(x, a0, a1, a2, a3), ay = GATHER4(y, a0, a1, a2, a3), az = GATHER4(z, a0, a1, a2, a3);
+	__m128 bx = GATHER4(x, b0, b1, b2, b3), by = GATHER4(y, b0, b1, b2, b3), bz = GATHER4(z, b0, b1, b2, b3);
+	__m128 ima = GATHER4(im, a0, a1, a2, a3), imb = GATHER4(im, b0, b1, b2, b3);
+	__m128 vrest = _mm_loadu_ps(rest + k), vim = _mm_loadu_ps(imSum + k), vprime = _mm_loadu_ps(prime + k);
+
+	__m128 dx = _mm_sub_ps(ax, bx), dy = _mm_sub_ps(ay, by), dz = _mm_sub_ps(az, bz);
+	__m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+	__m128 valid = _mm_and_ps(_mm_cmpgt_ps(len, eps), _mm_cmpgt_ps(vim, eps));
+	__m128 s = _mm_div_ps(_mm_mul_ps(_mm_sub_ps(vrest, len), vprime), _mm_mul_ps(vim, len));
+	s = _mm_and_ps(valid, s);
+	__m128 wa = _mm_and_ps(_mm_cmpgt_ps(ima, zero), _mm_mul_ps(s, ima));
+	__m128 wb = _mm_and_ps(_mm_cmpgt_ps(imb, zero), _mm_mul_ps(s, imb));
+
+	ax = _mm_add_ps(ax, _mm_mul_ps(dx, wa)); ay = _mm_add_ps(ay, _mm_mul_ps(dy, wa)); az = _mm_add_ps(az, _mm_mul_ps(dz, wa));
+	bx = _mm_sub_ps(bx, _mm_mul_ps(dx, wb)); by = _mm_sub_ps(by, _mm_mul_ps(dy, wb)); bz = _mm_sub_ps(bz, _mm_mul_ps(dz, wb));
+	SCATTER4(x, a0, a1, a2, a3, ax); SCATTER4(y, a0, a1, a2, a3, ay); SCATTER4(z, a0, a1, a2, a3, az);
+	SCATTER4(x, b0, b1, b2, b3, bx); SCATTER4(y, b0, b1, b2, b3, by); SCATTER4(z, b0, b1, b2, b3, bz);
+}
+#endif
+
+void CiSoftBody::PSolveStretchParallel()
+{
+	ColoredConstraints& cc = m_parStretch;
+	if (cc.m_rest.size() == 0) { return; }
+	const int* idx = &cc.m_nodeIdx[0];
+	const btScalar* rest = &cc.m_rest[0], *imSum = &cc.m_im[0], *prime = &cc.m_prime[0];
+	btScalar* x = &m_soa.m_x[0], *y = &m_soa.m_y[0], *z = &m_soa.m_z[0];
+	const btScalar* im = &m_soa.m_im[0];
+
+	for (int c = 0; c + 1 < cc.m_colorStart.size(); c++) {
+		const int start = cc.m_colorStart[c], end = cc.m_colorStart[c + 1];
+#ifndef BT_USE_DOUBLE_PRECISION
+		const int nQuads = (end - start) / 4;
+#pragma omp parallel for schedule(static) if (end - start >= PARALLEL_MIN_BATCH)
+		for (int q = 0; q < nQuads; q++) {
+			solveStretch4(start + q * 4, idx, rest, imSum, prime, x, y, z, im);
+		}
+		for (int k = start + nQuads * 4; k < end; k++) {
+			solveStretch1(k, idx, rest, imSum, prime, x, y, z, im);
+		}
+#else
+#pragma omp parallel for schedule(static) if (end - start >= PARALLEL_MIN_BATCH)
+		for (int k = start; k < end; k++) {
+			solveStretch1(k, idx, rest, imSum, prime, x, y, z, im);
+		}
+#endif
+	}
+}
+
+// volume ///////////////////////////////////////////////////////////////////////////////////
+static inline void solveVolume1(const int k, const int* idx, const btScalar* rest, const btScalar* imSum, const btScalar* prime,
+	btScalar* x, btScalar* y, btScalar* z, const btScalar* im)
+{
+	const int* ci = idx + k * 4;
+	btVector3 p[4];
+	for (int j = 0; j < 4; j++) {
+		p[j].setValue(x[ci[j]], y[ci[j]], z[ci[j]]);
+	}
+	btVector3 p2p1 = p[1] - p[0], p3p1 = p[2] - p[0], p4p1 = p[3] - p[0];
+	btVector3 g[4];
+	g[1] = btCross(p3p1, p4p1) / 6.0;
+	g[2] = btCross(p4p1, p2p1) / 6.0;
+	g[3] = btCross(p2p1, p3p1) / 6.0;
+	g[0] = -(g[1] + g[2] + g[3]);
+
+	btScalar dVolume = btDot(g[3], p4p1) - rest[k];
+	btScalar gSum = g[0].length2() + g[1].length2() + g[2].length2() + g[3].length2();
+	btScalar s = -4 / gSum / imSum[k] * dVolume * prime[k] / 2.5;
+	if (s > SIMD_EPSILON) {
+		for (int j = 0; j < 4; j++) {
+			btVector3 d = s * g[j] * im[ci[j]];
+			x[ci[j]] += d.x(); y[ci[j]] += d.y(); z[ci[j]] += d.z();
+		}
+	}
+}
+
+#ifndef BT_USE_DOUBLE_PRECISION
+static inline void solveVolume4(const int k, const int* idx, const btScalar* rest, const btScalar* imSum, const btScalar* prime,
+	btScalar* x, btScalar* y, btScalar* z, const btScalar* im)
+{
+	const int* ci = idx + k * 4;
+	int n[4][4]; // [node of the constraint][lane]
+	for (int l = 0; l < 4; l++)
+		for (int j = 0; j < 4; j++)
+			n[j][l] = ci[l * 4 + j];
+
+	__m128 px[4], py[4], pz[4], pim[4];
+	for (int j = 0; j < 4; j++) {
+		px[j] = GATHER4(x, n[j][0], n[j][1], n[j][2], n[j][3]);
+		py[j] = GATHER4(y, n[j][0], n[j][1], n[j][2], n[j][3]);
+		pz[j] = GATHER4(z, n[j][0], n[j][1], n[j][2], n[j][3]);
+		pim[j] = GATHER4(im, n[j][0], n[j][1], n[j][2], n[j][3]);
+	}
+	__m128 e1x = _mm_sub_ps(px[1], px[0]), e1y = _mm_sub_ps(py[1], py[0]), e1z = _mm_sub_ps(pz[1], pz[0]);
+	__m128 e2x = _mm_sub_ps(px[2], px[0]), e2y = _mm_sub_ps(py[2], py[0]), e2z = _mm_sub_ps(pz[2], pz[0]);
+	__m128 e3x = _mm_sub_ps(px[3], px[0]), e3y = _mm_sub_ps(py[3], py[0]), e3z = _mm_sub_ps(pz[3], pz[0]);
+
+	const __m128 sixth = _mm_set1_ps(1.f / 6.f);
+	__m128 gx[4], gy[4], gz[4];
+	// g1 = (e2 x e3) / 6, g2 = (e3 x e1) / 6, g3 = (e1 x e2) / 6, g0 = -(g1 + g2 + g3)
+	gx[1] = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(e2y, e3z), _mm_mul_ps(e2z, e3y)), sixth);
+	gy[1] = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(e2z, e3x), _mm_mul_ps(e2x, e3z)), sixth);
+	gz[1] = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(e2x, e3y), _mm_mul_ps(e2y, e3x)), sixth);
+	gx[2] = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(e3y, e1z), _mm_mul_ps(e3z, e1y)), sixth);
+	gy[2] = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(e3z, e1x), _mm_mul_ps(e3x, e1z)), sixth);
+	gz[2] = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(e3x, e1y), _mm_mul_ps(e3y, e1x)), sixth);
+	gx[3] = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(e1y, e2z), _mm_mul_ps(e1z, e2y)), sixth);
+	gy[3] = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(e1z, e2x), _mm_mul_ps(e1x, e2z)), sixth);
+	gz[3] = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(e1x, e2y), _mm_mul_ps(e1y, e2x)), sixth);
+	const __m128 zero = _mm_setzero_ps();
+	gx[0] = _mm_sub_ps(zero, _mm_add_ps(_mm_add_ps(gx[1], gx[2]), gx[3]));
+	gy[0] = _mm_sub_ps(zero, _mm_add_ps(_mm_add_ps(gy[1], gy[2]), gy[3]));
+	gz[0] = _mm_sub_ps(zero, _mm_add_ps(_mm_add_ps(gz[1], gz[2]), gz[3]));
+
+	// volume = (e1 x e2) . e3 / 6 = g3 . e3
+	__m128 vol = _mm_add_ps(_mm_add_ps(_mm_mul_ps(gx[3], e3x), _mm_mul_ps(gy[3], e3y)), _mm_mul_ps(gz[3], e3z));
+	__m128 dVolume = _mm_sub_ps(vol, _mm_loadu_ps(rest + k));
+	__m128 gSum = zero;
+	for (int j = 0; j < 4; j++) {
+		gSum = _mm_add_ps(gSum, _mm_add_ps(_mm_add_ps(_mm_mul_ps(gx[j], gx[j]), _mm_mul_ps(gy[j], gy[j])), _mm_mul_ps(gz[j], gz[j])));
+	}
+	// s = -4 / gSum / imSum * dVolume * prime / 2.5
+	__m128 s = _mm_div_ps(_mm_mul_ps(_mm_mul_ps(_mm_set1_ps(-4.f / 2.5f), dVolume), _mm_loadu_ps(prime + k)), _mm_mul_ps(gSum, _mm_loadu_ps(imSum + k)));
+	s = _mm_and_ps(_mm_cmpgt_ps(s, _mm_set1_ps(SIMD_EPSILON)), s);
+
+	for (int j = 0; j < 4; j++) {
+		__m128 w = _mm_mul_ps(s, pim[j]);
+		SCATTER4(x, n[j][0], n[j][1], n[j][2], n[j][3], _mm_add_ps(px[j], _mm_mul_ps(gx[j], w)));
+		SCATTER4(y, n[j][0], n[j][1], n[j][2], n[j][3], _mm_add_ps(py[j], _mm_mul_ps(gy[j], w)));
+		SCATTER4(z, n[j][0], n[j][1], n[j][2], n[j][3], _mm_add_ps(pz[j], _mm_mul_ps(gz[j], w)));
+	}
+}
+#endif
+
+void CiSoftBody::PSolveVolumeParallel()
+{
+	ColoredConstraints& cc = m_parVolume;
+	if (cc.m_rest.size() == 0) { return; }
+	const int* idx = &cc.m_nodeIdx[0];
+	const btScalar* rest = &cc.m_rest[0], *imSum = &cc.m_im[0], *prime = &cc.m_prime[0];
+	btScalar* x = &m_soa.m_x[0], *y = &m_soa.m_y[0], *z = &m_soa.m_z[0];
+	const btScalar* im = &m_soa.m_im[0];
+
+	for (int c = 0; c + 1 < cc.m_colorStart.size(); c++) {
+		const int start = cc.m_colorStart[c], end = cc.m_colorStart[c + 1];
+#ifndef BT_USE_DOUBLE_PRECISION
+		const int nQuads = (end - start) / 4;
+#pragma omp parallel for schedule(static) if (end - start >= PARALLEL_MIN_BATCH)
+		for (int q = 0; q < nQuads; q++) {
+			solveVolume4(start + q * 4, idx, rest, imSum, prime, x, y, z, im);
+		}
+		for (int k = start + nQuads * 4; k < end; k++) {
+			solveVolume1(k, idx, rest, imSum, prime, x, y, z, im);
+		}
+#else
+#pragma omp parallel for schedule(static) if (end - start >= PARALLEL_MIN_BATCH)
+		for (int k = start; k < end; k++) {
+			solveVolume1(k, idx, rest, imSum, prime, x, y, z, im);
+		}
+#endif
+	}
+}
+
+// bending (triangle) ///////////////////////////////////////////////////////////////////////
+void CiSoftBody::PSolveBendingParallel()
+{
+	ColoredConstraints& cc = m_parBending;
+	if (cc.m_rest.size() == 0) { return; }
+	const int* idx = &cc.m_nodeIdx[0];
+	const btScalar* rest = &cc.m_rest[0], *imSum = &cc.m_im[0], *prime = &cc.m_prime[0];
+	btScalar* x = &m_soa.m_x[0], *y = &m_soa.m_y[0], *z = &m_soa.m_z[0];
+	const btScalar* im = &m_soa.m_im[0];
+
+	for (int c = 0; c + 1 < cc.m_colorStart.size(); c++) {
+		const int start = cc.m_colorStart[c], end = cc.m_colorStart[c + 1];
+#pragma omp parallel for schedule(static) if (end - start >= PARALLEL_MIN_BATCH)
+		for (int k = start; k < end; k++) {
+			const int a = idx[k * 3], b = idx[k * 3 + 1], d = idx[k * 3 + 2];
+			btScalar cx = (x[a] + x[b] + x[d]) / 3, cy = (y[a] + y[b] + y[d]) / 3, cz = (z[a] + z[b] + z[d]) / 3;
+			btScalar dx = x[d] - cx, dy = y[d] - cy, dz = z[d] - cz;
+			btScalar len = btSqrt(dx * dx + dy * dy + dz * dz);
+			if (len <= SIMD_EPSILON) { continue; }
+
+			btScalar w = 2 * prime[k] * (1 - rest[k] / len) / imSum[k];
+			x[a] += dx * w * im[a]; y[a] += dy * w * im[a]; z[a] += dz * w * im[a];
+			x[b] += dx * w * im[b]; y[b] += dy * w * im[b]; z[b] += dz * w * im[b];
+			x[d] -= dx * w * 2 * im[d]; y[d] -= dy * w * 2 * im[d]; z[d] -= dz * w * 2 * im[d];
+		}
+	}
+}
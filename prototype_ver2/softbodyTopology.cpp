@@ -0,0 +1,228 @@
+#include "softbody.h"
+
+#include <algorithm>
+
+static inline unsigned int hashKey(const int* key, const int keyCnt)
+{
+	unsigned long long h = 14695981039346656037ull;
+	for (int i = 0; i < keyCnt; i++) {
+		h = (h ^ (unsigned int)key[i]) * 1099511628211ull;
+		h ^= h >> 29;
+	}
+	return (unsigned int)(h ^ (h >> 32));
+}
+
+static inline bool sameKey(const int* a, const int* b, const int keyCnt)
+{
+	for (int i = 0; i < keyCnt; i++) {
+		if (a[i] != b[i]) { return false; }
+	}
+	return true;
+}
+
+// key of a link / face : its node indices in increasing order
+static inline void linkKey(const CiSoftBody::Node* n0, const CiSoftBody::Node* node0, const CiSoftBody::Node* node1, int key[2])
+{
+	key[0] = (int)(node0 - n0);
+	key[1] = (int)(node1 - n0);
+	if (key[0] > key[1]) { std::swap(key[0], key[1]); }
+}
+static inline void faceKey(const CiSoftBody::Node* n0, const CiSoftBody::Node* node0, const CiSoftBody::Node* node1, const CiSoftBody::Node* node2, int key[3])
+{
+	key[0] = (int)(node0 - n0);
+	key[1] = (int)(node1 - n0);
+	key[2] = (int)(node2 - n0);
+	std::sort(key, key + 3);
+}
+
+// topology table ////////////////////////////////////////////////////////////////////////////
+void CiSoftBody::TopologyTable::reset(int keyCnt, int expected)
+{
+	int nSlots = 64;
+	while (nSlots < expected * 2) {
+		nSlots <<= 1;
+	}
+	m_keyCnt = keyCnt;
+	m_size = 0;
+	m_indexed = 0;
+	m_keys.resize(nSlots * keyCnt);
+	m_values.resize(nSlots);
+	for (int i = 0; i < nSlots; i++) {
+		m_keys[i * keyCnt] = -1;
+	}
+}
+
+int CiSoftBody::TopologyTable::find(const int* key) const
+{
+	const int nSlots = m_values.size();
+	if (nSlots == 0) { return -1; }
+
+	unsigned int slot = hashKey(key, m_keyCnt) & (nSlots - 1);
+	while (m_keys[slot * m_keyCnt] != -1) {
+		if (sameKey(&m_keys[slot * m_keyCnt], key, m_keyCnt)) {
+			return m_values[slot];
+		}
+		slot = (slot + 1) & (nSlots - 1);
+	}
+	return -1;
+}
+
+void CiSoftBody::TopologyTable::insert(const int* key, int value)
+{
+	// at most half full
+	if ((m_size + 1) * 2 > m_values.size()) {
+		btAlignedObjectArray<int> keys(m_keys), values(m_values);
+		const int indexed = m_indexed;
+		reset(m_keyCnt, m_size + 1);
+		m_indexed = indexed;
+		for (int i = 0, ni = values.size(); i < ni; i++) {
+			if (keys[i * m_keyCnt] != -1) {
+				insert(&keys[i * m_keyCnt], values[i]);
+			}
+		}
+	}
+
+	const int nSlots = m_values.size();
+	unsigned int slot = hashKey(key, m_keyCnt) & (nSlots - 1);
+	while (m_keys[slot * m_keyCnt] != -1) {
+		if (sameKey(&m_keys[slot * m_keyCnt], key, m_keyCnt)) {
+			return;
+		}
+		slot = (slot + 1) & (nSlots - 1);
+	}
+	for (int i = 0; i < m_keyCnt; i++) {
+		m_keys[slot * m_keyCnt + i] = key[i];
+	}
+	m_values[slot] = value;
+	m_size++;
+}
+
+// links / faces /////////////////////////////////////////////////////////////////////////////
+void CiSoftBody::resetTopology()
+{
+	m_linkTable.reset(2);
+	m_faceTable.reset(3);
+	m_nodeLinks.m_start.clear();
+	m_nodeLinks.m_items.clear();
+	m_nodeTetras.m_start.clear();
+	m_nodeTetras.m_items.clear();
+}
+
+// the tables index the links / faces appended since the last call (the arrays may also grow without appendLink / appendFace),
+// an array that shrank or an element edited in place (found under another key) rebuilds the table
+int CiSoftBody::findLink(const Node* node0, const Node* node1)
+{
+	if (m_nodes.size() == 0) { return -1; }
+	const Node* n0 = &m_nodes[0];
+
+	for (int pass = 0; pass < 2; pass++) {
+		TopologyTable& t = m_linkTable;
+		if (pass > 0 || t.m_indexed > m_links.size()) {
+			t.reset(2, m_links.size());
+		}
+		for (int i = t.m_indexed, ni = m_links.size(); i < ni; i++) {
+			int key[2];
+			linkKey(n0, m_links[i].m_n[0], m_links[i].m_n[1], key);
+			t.insert(key, i);
+		}
+		t.m_indexed = m_links.size();
+
+		int key[2];
+		linkKey(n0, node0, node1, key);
+		const int idx = t.find(key);
+		if (idx == -1) { return -1; }
+
+		const Link& l = m_links[idx];
+		if ((l.m_n[0] == node0 && l.m_n[1] == node1) || (l.m_n[0] == node1 && l.m_n[1] == node0)) {
+			return idx;
+		}
+	}
+	return -1;
+}
+
+int CiSoftBody::findFace(int node0, int node1, int node2)
+{
+	if (m_nodes.size() == 0) { return -1; }
+	const Node* n0 = &m_nodes[0];
+
+	int key[3];
+	faceKey(n0, &m_nodes[node0], &m_nodes[node1], &m_nodes[node2], key);
+	for (int pass = 0; pass < 2; pass++) {
+		TopologyTable& t = m_faceTable;
+		if (pass > 0 || t.m_indexed > m_faces.size()) {
+			t.reset(3, m_faces.size());
+		}
+		for (int i = t.m_indexed, ni = m_faces.size(); i < ni; i++) {
+			int fkey[3];
+			faceKey(n0, m_faces[i].m_n[0], m_faces[i].m_n[1], m_faces[i].m_n[2], fkey);
+			t.insert(fkey, i);
+		}
+		t.m_indexed = m_faces.size();
+
+		const int idx = t.find(key);
+		if (idx == -1) { return -1; }
+
+		const Face& f = m_faces[idx];
+		int fkey[3];
+		faceKey(n0, f.m_n[0], f.m_n[1], f.m_n[2], fkey);
+		if (sameKey(fkey, key, 3)) {
+			return idx;
+		}
+	}
+	return -1;
+}
+
+// adjacency /////////////////////////////////////////////////////////////////////////////////
+static void buildRows(CiSoftBody::Adjacency& adj, const int nNodes, const int nElements, const int elementNodeCnt, const int* elementNodes)
+{
+	adj.m_start.resize(nNodes + 1);
+	for (int i = 0; i <= nNodes; i++) {
+		adj.m_start[i] = 0;
+	}
+	for (int i = 0; i < nElements * elementNodeCnt; i++) {
+		adj.m_start[elementNodes[i] + 1]++;
+	}
+	for (int i = 0; i < nNodes; i++) {
+		adj.m_start[i + 1] += adj.m_start[i];
+	}
+
+	// items of a node in the element order
+	btAlignedObjectArray<int> fill;
+	fill.resize(nNodes);
+	for (int i = 0; i < nNodes; i++) {
+		fill[i] = adj.m_start[i];
+	}
+	adj.m_items.resize(nElements * elementNodeCnt);
+	for (int i = 0; i < nElements; i++) {
+		for (int j = 0; j < elementNodeCnt; j++) {
+			adj.m_items[fill[elementNodes[i * elementNodeCnt + j]]++] = i;
+		}
+	}
+}
+
+void CiSoftBody::buildAdjacency()
+{
+	const int nNodes = m_nodes.size();
+	if (nNodes == 0) { return; }
+	const Node* n0 = &m_nodes[0];
+
+	btAlignedObjectArray<int> elementNodes;
+	elementNodes.resize(m_links.size() * 2);
+	for (int i = 0, ni = m_links.size(); i < ni; i++) {
+		elementNodes[i * 2 + 0] = (int)(m_links[i].m_n[0] - n0);
+		elementNodes[i * 2 + 1] = (int)(m_links[i].m_n[1] - n0);
+	}
+	buildRows(m_nodeLinks, nNodes, m_links.size(), 2, elementNodes.size() ? &elementNodes[0] : NULL);
+
+	elementNodes.resize(m_tetras.size() * 4);
+	for (int i = 0, ni = m_tetras.size(); i < ni; i++) {
+		for (int j = 0; j < 4; j++) {
+			elementNodes[i * 4 + j] = (int)(m_tetras[i].m_n[j] - n0);
+		}
+	}
+	buildRows(m_nodeTetras, nNodes, m_tetras.size(), 4, elementNodes.size() ? &elementNodes[0] : NULL);
+
+	for (int i = 0; i < nNodes; i++) {
+		m_nodes[i].m_nAdjLinkCnt = m_nodeLinks.m_start[i + 1] - m_nodeLinks.m_start[i];
+	}
+}
@@ -0,0 +1,279 @@
+#include "tetraGrid.h"
+
+#include <float.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+
+namespace {
+
+static const unsigned long long kEmptyKey = ~0ull;
+
+static inline unsigned int hashKey(unsigned long long key)
+{
+	key *= 0x9E3779B97F4A7C15ull;
+	return (unsigned int)(key ^ (key >> 32));
+}
+
+// (key, entry) pairs sorted by key -> open addressing table of the keys, each key with its range of the entries
+static void buildTable(std::vector<std::pair<unsigned long long, int> >& pairs,
+	btAlignedObjectArray<unsigned long long>& keys, btAlignedObjectArray<int>& first, btAlignedObjectArray<int>& count, btAlignedObjectArray<int>& entries)
+{
+	std::sort(pairs.begin(), pairs.end());
+
+	int nUnique = 0;
+	for (size_t i = 0; i < pairs.size(); i++) {
+		if (i == 0 || pairs[i].first != pairs[i - 1].first) {
+			nUnique++;
+		}
+	}
+	int nTable = 16;
+	while (nTable < nUnique * 2) {
+		nTable <<= 1;
+	}
+	keys.resize(nTable);
+	first.resize(nTable);
+	count.resize(nTable);
+	for (int i = 0; i < nTable; i++) {
+		keys[i] = kEmptyKey;
+		count[i] = 0;
+	}
+	entries.resize((int)pairs.size());
+
+	for (size_t i = 0; i < pairs.size(); i++) {
+		entries[(int)i] = pairs[i].second;
+		if (i > 0 && pairs[i].first == pairs[i - 1].first) {
+			continue;
+		}
+		size_t j = i + 1;
+		while (j < pairs.size() && pairs[j].first == pairs[i].first) {
+			j++;
+		}
+		unsigned int slot = hashKey(pairs[i].first) & (nTable - 1);
+		while (keys[slot] != kEmptyKey) {
+			slot = (slot + 1) & (nTable - 1);
+		}
+		keys[slot] = pairs[i].first;
+		first[slot] = (int)i;
+		count[slot] = (int)(j - i);
+	}
+}
+
+static inline bool lookup(const btAlignedObjectArray<unsigned long long>& keys, const btAlignedObjectArray<int>& first, const btAlignedObjectArray<int>& count,
+	unsigned long long key, int& f, int& c)
+{
+	const int nTable = keys.size();
+	if (nTable == 0) {
+		return false;
+	}
+	unsigned int slot = hashKey(key) & (nTable - 1);
+	while (keys[slot] != kEmptyKey) {
+		if (keys[slot] == key) {
+			f = first[slot];
+			c = count[slot];
+			return true;
+		}
+		slot = (slot + 1) & (nTable - 1);
+	}
+	return false;
+}
+
+}
+
+void CiTetraGrid::build(const btAlignedObjectArray<CiSoftBody::Tetra*>& tetras, bool bRestPositions)
+{
+	const int nTetras = tetras.size();
+	m_entries.resize(nTetras);
+	m_min.setValue(0, 0, 0);
+	m_cell = 1;
+	m_dims[0] = m_dims[1] = m_dims[2] = 1;
+
+	btVector3 vMin(BT_LARGE_FLOAT, BT_LARGE_FLOAT, BT_LARGE_FLOAT), vMax(-BT_LARGE_FLOAT, -BT_LARGE_FLOAT, -BT_LARGE_FLOAT);
+	double sumExtent = 0;
+	for (int i = 0; i < nTetras; i++) {
+		const CiSoftBody::Tetra* t = tetras[i];
+		Entry& e = m_entries[i];
+
+		btVector3 centroid;
+		centroid.setZero();
+		btVector3 tMin = bRestPositions ? t->m_n[0]->m_x0 : t->m_n[0]->m_x, tMax = tMin;
+		for (int j = 0; j < 4; j++) {
+			e.m_x[j] = bRestPositions ? t->m_n[j]->m_x0 : t->m_n[j]->m_x;
+			centroid += e.m_x[j];
+			tMin.setMin(e.m_x[j]);
+			tMax.setMax(e.m_x[j]);
+		}
+		centroid /= 4.0;
+		e.m_centroid = centroid;
+		vMin.setMin(tMin);
+		vMax.setMax(tMax);
+
+		const btVector3 extent = tMax - tMin;
+		const btScalar maxExtent = btMax(extent.x(), btMax(extent.y(), extent.z()));
+		sumExtent += maxExtent;
+
+		const btVector3 c0 = e.m_x[0] - e.m_x[3], c1 = e.m_x[1] - e.m_x[3], c2 = e.m_x[2] - e.m_x[3];
+		const btMatrix3x3 T(
+			c0.x(), c1.x(), c2.x(),
+			c0.y(), c1.y(), c2.y(),
+			c0.z(), c1.z(), c2.z());
+		const btScalar det = T.determinant();
+		e.m_valid = maxExtent > 0 && btFabs(det) > 1e-7f * maxExtent * maxExtent * maxExtent;
+		if (e.m_valid) {
+			e.m_invT = T.inverse();
+		}
+		else {
+			e.m_invT.setIdentity();
+		}
+	}
+
+	std::vector<std::pair<unsigned long long, int> > boxPairs, centroidPairs;
+	if (nTetras > 0) {
+		// about one tetra per cell along each axis, fewer cells when the key space would overflow
+		m_min = vMin;
+		m_cell = (btScalar)(sumExtent / nTetras);
+		if (m_cell <= 0) {
+			m_cell = 1;
+		}
+		const btVector3 size = vMax - vMin;
+		for (;;) {
+			for (int k = 0; k < 3; k++) {
+				m_dims[k] = (int)(size[k] / m_cell) + 1;
+			}
+			if ((double)m_dims[0] * m_dims[1] * m_dims[2] < 1e18 && m_dims[0] < (1 << 20) && m_dims[1] < (1 << 20) && m_dims[2] < (1 << 20)) {
+				break;
+			}
+			m_cell *= 2;
+		}
+
+		for (int i = 0; i < nTetras; i++) {
+			const Entry& e = m_entries[i];
+			btVector3 tMin = e.m_x[0], tMax = e.m_x[0];
+			for (int j = 1; j < 4; j++) {
+				tMin.setMin(e.m_x[j]);
+				tMax.setMax(e.m_x[j]);
+			}
+			int c0[3], c1[3];
+			cellOf(tMin, c0);
+			cellOf(tMax, c1);
+			for (int z = c0[2]; z <= c1[2]; z++) {
+				for (int y = c0[1]; y <= c1[1]; y++) {
+					for (int x = c0[0]; x <= c1[0]; x++) {
+						boxPairs.push_back(std::make_pair(((unsigned long long)z * m_dims[1] + y) * m_dims[0] + x, i));
+					}
+				}
+			}
+
+			int c[3];
+			cellOf(e.m_centroid, c);
+			centroidPairs.push_back(std::make_pair(((unsigned long long)c[2] * m_dims[1] + c[1]) * m_dims[0] + c[0], i));
+		}
+	}
+	buildTable(boxPairs, m_boxKeys, m_boxFirst, m_boxCount, m_boxEntries);
+	buildTable(centroidPairs, m_centroidKeys, m_centroidFirst, m_centroidCount, m_centroidEntries);
+}
+
+bool CiTetraGrid::cellOf(const btVector3& p, int c[3]) const
+{
+	bool bInside = true;
+	for (int k = 0; k < 3; k++) {
+		const btScalar f = floor((p[k] - m_min[k]) / m_cell);
+		if (f < 0) {
+			c[k] = 0;
+			bInside = false;
+		}
+		else if (f >= m_dims[k]) {
+			c[k] = m_dims[k] - 1;
+			bInside = false;
+		}
+		else {
+			c[k] = (int)f;
+		}
+	}
+	return bInside;
+}
+
+int CiTetraGrid::candidates(const btVector3& p, const int** entries) const
+{
+	int c[3];
+	if (m_entries.size() == 0 || !cellOf(p, c)) {
+		return 0;
+	}
+	int f = 0, n = 0;
+	if (!lookup(m_boxKeys, m_boxFirst, m_boxCount, ((unsigned long long)c[2] * m_dims[1] + c[1]) * m_dims[0] + c[0], f, n)) {
+		return 0;
+	}
+	*entries = &m_boxEntries[f];
+	return n;
+}
+
+int CiTetraGrid::findContaining(const btVector3& p, btScalar tolerance) const
+{
+	const int* entries = NULL;
+	const int n = candidates(p, &entries);
+
+	int best = -1;
+	btScalar bestMin = -tolerance;
+	for (int i = 0; i < n; i++) {
+		const Entry& e = m_entries[entries[i]];
+		if (!e.m_valid) {
+			continue;
+		}
+		const btVector3 b = e.m_invT * (p - e.m_x[3]);
+		const btScalar b3 = 1 - b.x() - b.y() - b.z();
+		const btScalar bMin = btMin(btMin(b.x(), b.y()), btMin(b.z(), b3));
+		if (bMin >= bestMin) {
+			bestMin = bMin;
+			best = entries[i];
+		}
+	}
+	return best;
+}
+
+int CiTetraGrid::findNearestCentroid(const btVector3& p, btScalar& dist) const
+{
+	dist = FLT_MAX;
+	if (m_entries.size() == 0) {
+		return -1;
+	}
+
+	// rings of cells around the cell of p (clamped), the cells of ring r + 1 are at least r cells away from p
+	int c[3];
+	cellOf(p, c);
+	const int maxRing = btMax(m_dims[0], btMax(m_dims[1], m_dims[2]));
+	int best = -1;
+	for (int r = 0; r <= maxRing; r++) {
+		for (int z = c[2] - r; z <= c[2] + r; z++) {
+			if (z < 0 || z >= m_dims[2]) {
+				continue;
+			}
+			for (int y = c[1] - r; y <= c[1] + r; y++) {
+				if (y < 0 || y >= m_dims[1]) {
+					continue;
+				}
+				const bool bShell = (z == c[2] - r || z == c[2] + r || y == c[1] - r || y == c[1] + r);
+				for (int x = c[0] - r; x <= c[0] + r; x += (bShell || r == 0) ? 1 : 2 * r) {
+					if (x < 0 || x >= m_dims[0]) {
+						continue;
+					}
+					int f = 0, n = 0;
+					if (!lookup(m_centroidKeys, m_centroidFirst, m_centroidCount, ((unsigned long long)z * m_dims[1] + y) * m_dims[0] + x, f, n)) {
+						continue;
+					}
+					for (int i = f; i < f + n; i++) {
+						const int idx = m_centroidEntries[i];
+						const btScalar d = (m_entries[idx].m_centroid - p).length();
+						if (d < dist || (d == dist && idx > best)) {
+							dist = d;
+							best = idx;
+						}
+					}
+				}
+			}
+		}
+		if (best != -1 && dist < r * m_cell * 0.999f) {
+			break;
+		}
+	}
+	return best;
+}
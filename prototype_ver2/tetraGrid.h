@@ -0,0 +1,41 @@
+#pragma once
+
+#include "softbody.h"
+
+// uniform grid over a set of tetrahedra (positions captured by build, later node moves are not seen)
+// a tetra is listed in every cell its bounding box overlaps, its centroid in the one cell holding it
+// the occupied cells are kept in an open addressing table (cell key -> range of the sorted entries),
+// so a thin shell of tetras (e.g. the boundary tetras) costs memory for its occupied cells only
+struct CiTetraGrid
+{
+	struct Entry
+	{
+		btVector3		m_x[4];
+		btVector3		m_centroid;
+		btMatrix3x3		m_invT;			// barycentric (b0, b1, b2) = m_invT * (p - m_x[3])
+		bool			m_valid;		// false for a degenerate tetra (never contains a point)
+	};
+
+	btAlignedObjectArray<Entry>		m_entries;		// in the order of the tetras given to build
+	btVector3						m_min;
+	btScalar						m_cell;
+	int								m_dims[3];
+
+	// cells of the tetra boxes and of the centroids
+	btAlignedObjectArray<unsigned long long>	m_boxKeys, m_centroidKeys;
+	btAlignedObjectArray<int>					m_boxFirst, m_boxCount, m_boxEntries;
+	btAlignedObjectArray<int>					m_centroidFirst, m_centroidCount, m_centroidEntries;
+
+	// bRestPositions : m_x0 of the nodes instead of m_x
+	void build(const btAlignedObjectArray<CiSoftBody::Tetra*>& tetras, bool bRestPositions);
+
+	// entries whose tetra box overlaps the cell of p (every tetra containing p is one of them), 0 when p is outside of the grid
+	int candidates(const btVector3& p, const int** entries) const;
+	// entry of the tetra containing p (all barycentrics >= -tolerance), the most interior one when several do, -1 when none
+	int findContaining(const btVector3& p, btScalar tolerance) const;
+	// entry of the nearest centroid (ties : the later entry), -1 when the grid is empty
+	int findNearestCentroid(const btVector3& p, btScalar& dist) const;
+
+	// false (c clamped to the grid) when p is outside of the grid
+	bool cellOf(const btVector3& p, int c[3]) const;
+};
@@ -52,7 +52,7 @@ using namespace cv;
 #include <librealsense2/rsutil.h>
 
 
-int main()
+int main(int argc, char* argv[])
 {
 
 #if defined(_DEBUG) | defined(DEBUG)
@@ -60,7 +60,15 @@ int main()
 #endif	
 
 	vzm::InitEngineLib();
-	if (!optitrk::InitOptiTrackLib())
+	// replay of a recorded session instead of Motive and the RealSense : <exe> session.krec [recorded | fast | step]
+	const bool use_replay = argc > 1;
+	if (use_replay)
+	{
+		string replay_mode = argc > 2 ? argv[2] : "recorded";
+		if (!optitrk::InitOptiTrackReplay(argv[1], replay_mode == "fast" ? TRK_REPLAY_FAST : replay_mode == "step" ? TRK_REPLAY_STEP : TRK_REPLAY_RECORDED))
+			return 1;
+	}
+	else if (!optitrk::InitOptiTrackLib())
 	{
 		printf("Unable to license Motive API\n");
 		return 1;
@@ -84,7 +92,13 @@ int main()
 	string breast_bone_path = "..\\Data\\breast\\inner_organs_bone2\\inner_organs_bone2.stl";
 	vzm::LoadModelFile(breast_bone_path, breast_bone_id);
 
-	rs_settings::InitializeRealsense(true, false, rs_w, rs_h, eye_w, eye_h);
+	if (use_replay)
+	{
+		if (!rs_settings::InitializeRealsenseReplay(argv[1], rs_w, rs_h))
+			return 1;
+	}
+	else
+		rs_settings::InitializeRealsense(true, false, rs_w, rs_h, eye_w, eye_h);
 	rs_settings::RunRsThread(original_data, filtered_data, eye_data);
 	//rs2_intrinsics rgb_intrinsics, depth_intrinsics;
 	//rs2_extrinsics rgb_extrinsics;
@@ -114,28 +128,42 @@ int main()
 
 	int postpone = 3;
 #define NUM_RBS 5
-	concurrent_queue<track_info> track_que(10);
+	spsc_ring<track_info> track_que(16);
 	std::atomic_bool tracker_alive{ true };
 	std::thread tracker_processing_thread([&]() {
+		profiler::SetThreadName("tracker");
+		string _rb_names[NUM_RBS] = { "rs_cam" , "probe", "marker" , pin_tool_name , "breastbody" };
+		rb_registry trk_rbs;
+		int rb_handles[NUM_RBS]; // -1 : not registered (reported by Register), the body is not tracked
+		for (int i = 0; i < NUM_RBS; i++)
+			rb_handles[i] = trk_rbs.Register(_rb_names[i]);
+
 		while (tracker_alive)
 		{
 			Sleep(postpone);
+			PROF_ZONE("tracker sample");
+			// taken before the update : TT_Update solves the camera frames already received, so the pose is not younger than the call
+			double t_sample = GetMonotonicTimeMs();
 			optitrk::UpdateFrame();
 
-			track_info cur_trk_info;
-			static string _rb_names[NUM_RBS] = { "rs_cam" , "probe", "marker" , pin_tool_name , "breastbody" };
+			track_info* slot = track_que.begin_write();
+			if (slot == NULL) continue; // the render thread is draining the full ring, this sample is dropped
+			track_info& cur_trk_info = *slot;
+			cur_trk_info.rbs = trk_rbs;
+			cur_trk_info.time_stamp = t_sample;
 			for (int i = 0; i < NUM_RBS; i++)
 			{
+				if (rb_handles[i] < 0) continue;
 				glm::fmat4x4 mat_lfrm2ws;
 				bool is_detected = optitrk::GetRigidBodyLocationByName(_rb_names[i], (float*)&mat_lfrm2ws);
-				cur_trk_info.SetLFrmInfo(_rb_names[i], is_detected, mat_lfrm2ws);
+				cur_trk_info.SetLFrmInfo(rb_handles[i], is_detected, mat_lfrm2ws);
 			}
 
 			//cout << cur_is_rsrb_detected << ", " << cur_is_probe_detected << endl;
 
-			optitrk::GetMarkersLocation(&cur_trk_info.mk_xyz_list, &cur_trk_info.mk_residue_list, &cur_trk_info.mk_cid_list);
+			cur_trk_info.num_mks = optitrk::GetMarkersLocationArray(MAX_TRK_MKS, (float*)cur_trk_info.mk_xyz, cur_trk_info.mk_residue, cur_trk_info.mk_cid);
 			cur_trk_info.is_updated = true;
-			track_que.push(cur_trk_info);
+			track_que.end_write();
 		}
 		});
 
@@ -151,26 +179,10 @@ int main()
 	bool show_calib_frames = true;
 	bool record_info = false;
 	bool show_pc = false;
+	bool continuous_icp = false;
 	bool show_workload = false;
 	bool is_ws_pick = false;
 
-	auto DisplayTimes = [&show_workload](const LARGE_INTEGER lIntCntStart, const string& _test)
-	{
-		if (!show_workload) return;
-		LARGE_INTEGER lIntFreq, lIntCntEnd;
-		QueryPerformanceFrequency(&lIntFreq);
-		QueryPerformanceCounter(&lIntCntEnd);
-		double dRunTime1 = (lIntCntEnd.QuadPart - lIntCntStart.QuadPart) / (double)(lIntFreq.QuadPart);
-
-		cout << _test << " : " << 1. / dRunTime1 << " fps" << endl;
-	};
-	auto GetPerformanceFreq = []() -> LARGE_INTEGER
-	{
-		LARGE_INTEGER lIntCntFreq;
-		QueryPerformanceCounter(&lIntCntFreq);
-		return lIntCntFreq;
-	};
-
 #ifdef __RECORD_VER
 	// fill record_trk_info and record_rsimg
 #endif
@@ -203,9 +215,14 @@ int main()
 	std::string probe_name = "probe";
 	PROBE_MODE probe_mode = PROBE_MODE::DEFAULT;
 
+	track_info trk_info;
+	frame_latency_stats replay_stats;
+	profiler::SetEnabled(show_workload);
 	while (key_pressed != 'q' && key_pressed != 27)
 	{
-		LARGE_INTEGER frq_begin = GetPerformanceFreq();
+		// the zones of the previous frame, all threads
+		profiler::Collect();
+		PROF_ZONE("frame");
 		bool reset_calib = false;
 		bool write_recoded_info = false;
 		bool recompile_hlsl = false;
@@ -216,13 +233,36 @@ int main()
 		case 'r': recompile_hlsl = true; cout << "Recompile Shader!" << endl; break;
 		case 'v': show_calib_frames = !show_calib_frames; break;
 		case 'p': show_pc = !show_pc; break;
+		case 'i': continuous_icp = !continuous_icp; var_settings::SetContinuousICP(continuous_icp);
+			cout << "continuous ICP : " << (continuous_icp ? "on (with the point cloud, 'p')" : "off") << endl; break;
 		case 'e': show_apis_console = !show_apis_console; break;
 		case 'm': show_mks = !show_mks; break;
 		case 's': show_csection = !show_csection; break;
 		case 'x': reset_calib = true; break;
 		case 'd': record_info = !record_info; break;
 		case 'w': write_recoded_info = true; break;
-		case 'f': show_workload = !show_workload; break;
+		case 'f': show_workload = !show_workload;
+			// profiling follows the workload display, the samples since enabled are reported and exported when it is turned off
+			profiler::SetEnabled(show_workload);
+			if (!show_workload)
+			{
+				profiler::Report();
+				profiler::ExportChromeTrace();
+				long long calls_issued, calls_elided;
+				scene_mirror::GetMirrorStats(calls_issued, calls_elided, true);
+				std::cout << "scene states : " << calls_issued << " vzm calls issued, " << calls_elided << " elided (since the last report)" << endl;
+				double prim_requests, prim_builds;
+				ginfo.prims.GetStats(prim_requests, prim_builds, true);
+				std::cout << "primitives : " << prim_builds << " geometry builds per frame (" << prim_requests << " without the cache)" << endl;
+				long long views_run, views_skipped;
+				var_settings::GetViewStats(views_run, views_skipped, true);
+				std::cout << "views : " << views_run << " run, " << views_skipped << " skipped (inputs unchanged)" << endl;
+				double icp_refinements, icp_iterations;
+				float icp_residual_mm;
+				var_settings::GetICPStats(icp_refinements, icp_iterations, icp_residual_mm, true);
+				std::cout << "icp : " << icp_refinements << " refinements/s, " << icp_iterations << " iterations/s, residual " << icp_residual_mm << " mm" << endl;
+			}
+			break;
 		case 'c': is_ws_pick = !is_ws_pick; break;
 		case '1': operation_step = 1; probe_name = "probe"; probe_mode = PROBE_MODE::DEFAULT;
 			optitrk::SetRigidBodyEnabledbyName("probe", true);
@@ -242,6 +282,7 @@ int main()
 		case '.': line_guide_idx = min(line_guide_idx + 1, (int)ginfo.guide_lines_target_rbs.size() - 1); break;
 		case '-': ginfo.stg_focus_offset_w = max(ginfo.stg_focus_offset_w - 5, 0); break;
 		case '=': ginfo.stg_focus_offset_w = min(ginfo.stg_focus_offset_w + 5, 200); break;
+		case 'n': optitrk::StepReplay(1); break; // replay STEP mode
 		}
 		vzm::SetRenderTestParam("_bool_ReloadHLSLObjFiles", recompile_hlsl, sizeof(bool), -1, -1);
 		vzm::SetRenderTestParam("_bool_PrintOutRoutineObjs", show_apis_console, sizeof(bool), -1, -1);
@@ -258,16 +299,23 @@ int main()
 		rs2::frame current_filtered_frame;
 		filtered_data.poll_for_frame(&current_filtered_frame);
 
-		track_info trk_info;
-		track_que.wait_and_pop(trk_info);
+		// bounded wait for the next tracker sample (about 4 ms at 240 Hz), the loop sleeps instead of spinning a core
+		// when neither the tracker nor the camera has anything new
+		track_que.wait(5);
 
-		if (trk_info.is_updated && current_frameset)
+		// drain-all, every sample feeds the pose history and trk_info keeps the newest one
+		// (keeps the previous sample when the tracker has nothing new)
+		track_que.pop_all([&](const track_info& trk_sample)
 		{
-			DisplayTimes(frq_begin, "device_stream_load");
-
-			var_settings::UpdateTrackInfo(&trk_info, probe_name, probe_mode);
+			var_settings::PushTrackSample(&trk_sample);
+			trk_info = trk_sample;
+		});
 
+		if (trk_info.is_updated && current_frameset)
+		{
 			auto current_color_frame = current_frameset.get_color_frame();
+			const double t_capture = rs_settings::GetCaptureTimeMs(current_color_frame);
+			var_settings::UpdateTrackInfo(&trk_info, probe_name, probe_mode, t_capture);
 			//auto colorized_depth = current_frameset.first(RS2_STREAM_DEPTH, RS2_FORMAT_RGB8);
 
 			if (record_info) var_settings::RecordInfo(key_pressed, current_color_frame.get_data());
@@ -303,22 +351,30 @@ int main()
 					if (ginfo.otrk_data.trk_info.GetLFrmInfo("breastbody", mat_matchmodelfrm2ws))
 					{
 						vzm::ObjStates model_ws_obj_state;
-						vzm::GetSceneObjectState(ginfo.ws_scene_id, ginfo.model_ws_obj_id, model_ws_obj_state);
+						scene_mirror::GetState(ginfo.ws_scene_id, ginfo.model_ws_obj_id, model_ws_obj_state);
 						__cm4__ model_ws_obj_state.os2ws = mat_matchmodelfrm2ws * ginfo.mat_os2matchmodefrm;
 
 						__cv4__ model_ws_obj_state.color = glm::fvec4(1, 0, 0, 1);
-						vzm::ReplaceOrAddSceneObject(ginfo.ws_scene_id, tumor_id, model_ws_obj_state);
-						vzm::ReplaceOrAddSceneObject(ginfo.rs_scene_id, tumor_id, model_ws_obj_state);
-						vzm::ReplaceOrAddSceneObject(ginfo.stg_scene_id, tumor_id, model_ws_obj_state);
-						vzm::ReplaceOrAddSceneObject(ginfo.csection_scene_id, tumor_id, model_ws_obj_state);
+						scene_mirror::SetStates(MS_WS | MS_RS | MS_STG | MS_CSECTION, tumor_id, model_ws_obj_state);
 
 						__cm4__ brest_bone_states.os2ws = __cm4__ model_ws_obj_state.os2ws;
-						vzm::ReplaceOrAddSceneObject(ginfo.rs_scene_id, breast_bone_id, brest_bone_states);
+						scene_mirror::SetState(ginfo.rs_scene_id, breast_bone_id, brest_bone_states);
 					}
 				}
 			}
 
 			var_settings::RenderAndShowWindows(show_workload, image_rs_bgr);
+			if (use_replay)
+			{
+				// replay benchmark : frames per second and capture (injection) to display latency
+				if (replay_stats.Add(t_capture, GetMonotonicTimeMs()))
+				{
+					long long frames_fed, frames_dropped;
+					rs_settings::GetReplayStats(frames_fed, frames_dropped);
+					cout << "replay frame " << optitrk::GetReplayFrame() << " : " << replay_stats.fps << " fps, latency " << replay_stats.mean_ms << " ms (max "
+						<< replay_stats.peak_ms << " ms), fed " << frames_fed << ", dropped " << frames_dropped << endl;
+				}
+			}
 		}
 
 		key_pressed = cv::waitKey(1);
@@ -0,0 +1,256 @@
+#include "test_util.h"
+
+#include "../aruco_marker/aruco_armarker.h"
+
+#include <opencv2/imgproc.hpp>
+#include <opencv2/aruco.hpp>
+
+#include <math.h>
+#include <set>
+#include <algorithm>
+
+// roi tracking mode of aruco_armarker.cpp against the full frame detection, on a synthetic sequence :
+// a board of markers (DICT_4X4_50, the dictionary of the tracker) seen by a panning, rolling and zooming camera,
+// the markers leave the frame and come back (new markers of the full frame searches)
+
+using namespace kar_test;
+
+namespace
+{
+	const int num_markers = 4;
+
+	cv::Matx33d Translation(const double tx, const double ty)
+	{
+		return cv::Matx33d(1, 0, tx, 0, 1, ty, 0, 0, 1);
+	}
+
+	cv::Matx33d RotationScale(const double angle, const double scale)
+	{
+		const double c = cos(angle) * scale, s = sin(angle) * scale;
+		return cv::Matx33d(c, -s, 0, s, c, 0, 0, 0, 1);
+	}
+
+	struct synthetic_sequence
+	{
+		int w, h;
+		std::vector<cv::Mat> frames;			// gray
+		std::vector<cv::Mat> frames_bgr;
+		std::vector<cv::Matx33d> board2img;		// camera of each frame
+		std::vector<cv::Matx33d> marker2board;	// marker image (with its quiet zone) to the board
+		std::vector<std::vector<cv::Point2f>> marker_corners; // outer corners of the black border in the marker image
+
+		// ground truth corners of a marker in a frame
+		std::vector<cv::Point2f> Corners(const int frame, const int marker) const
+		{
+			std::vector<cv::Point2f> pts;
+			cv::perspectiveTransform(marker_corners[marker], pts, cv::Matx33f(board2img[frame] * marker2board[marker]));
+			return pts;
+		}
+
+		bool IsVisible(const int frame, const int marker) const
+		{
+			for (const cv::Point2f& pt : Corners(frame, marker))
+				if (pt.x < 2 || pt.y < 2 || pt.x > w - 3 || pt.y > h - 3) return false;
+			return true;
+		}
+
+		// image motion since the previous frame (row major, the mat_prev2cur of track_markers)
+		cv::Matx33f Prev2Cur(const int frame) const
+		{
+			return cv::Matx33f(board2img[frame] * board2img[frame - 1].inv());
+		}
+	};
+
+	synthetic_sequence MakeSequence(const int w, const int h, const int num_frames)
+	{
+		synthetic_sequence seq;
+		seq.w = w;
+		seq.h = h;
+		const double unit = w / 1280.0;
+
+		// the markers on a 2 x 2 grid of the board, board center at (0, 0)
+		cv::Ptr<cv::aruco::Dictionary> dictionary = cv::aruco::getPredefinedDictionary(cv::aruco::DICT_4X4_50);
+		std::vector<cv::Mat> marker_imgs;
+		for (int i = 0; i < num_markers; i++)
+		{
+			const int side = (int)((100 + 10 * i) * unit), quiet = side / 4;
+			cv::Mat marker, canvas(side + 2 * quiet, side + 2 * quiet, CV_8UC1, cv::Scalar(255));
+			cv::aruco::drawMarker(dictionary, i, side, marker, 1);
+			marker.copyTo(canvas(cv::Rect(quiet, quiet, side, side)));
+			marker_imgs.push_back(canvas);
+
+			// pixel centers : the border of the black square is half a pixel outside of its first and last pixels
+			const float lo = quiet - 0.5f, hi = quiet + side - 0.5f;
+			seq.marker_corners.push_back({ cv::Point2f(lo, lo), cv::Point2f(hi, lo), cv::Point2f(hi, hi), cv::Point2f(lo, hi) });
+			const double cx = (i % 2 ? 1 : -1) * 0.2 * w, cy = (i / 2 ? 1 : -1) * 0.2 * h;
+			seq.marker2board.push_back(Translation(cx - canvas.cols * 0.5, cy - canvas.rows * 0.5));
+		}
+
+		// textured background, fixed in the image
+		cv::Mat background(h, w, CV_8UC1), noise(h, w, CV_16SC1);	// sensor noise, signed
+		cv::randu(background, cv::Scalar(40), cv::Scalar(200));
+		cv::GaussianBlur(background, background, cv::Size(0, 0), 6.0 * unit);
+
+		cv::RNG rng(17);
+		for (int f = 0; f < num_frames; f++)
+		{
+			// up to ~40 px per frame of pan at 1280, the side markers leave the frame
+			const double t = 2 * CV_PI * f / num_frames;
+			const cv::Matx33d board2img = Translation(w * (0.5 + 0.45 * sin(t)), h * (0.5 + 0.3 * sin(2 * t)))
+				* RotationScale(0.3 * sin(t * 1.5), 1 + 0.15 * sin(t * 3));
+			seq.board2img.push_back(board2img);
+
+			cv::Mat frame = background.clone();
+			for (int i = 0; i < num_markers; i++)
+				cv::warpPerspective(marker_imgs[i], frame, board2img * seq.marker2board[i], frame.size(), cv::INTER_LINEAR, cv::BORDER_TRANSPARENT);
+			rng.fill(noise, cv::RNG::NORMAL, 0, 3);
+			cv::Mat noisy;
+			cv::add(frame, noise, noisy, cv::noArray(), CV_8U);
+			seq.frames.push_back(noisy);
+
+			cv::Mat bgr;
+			cv::cvtColor(noisy, bgr, cv::COLOR_GRAY2BGR);
+			seq.frames_bgr.push_back(bgr);
+		}
+		return seq;
+	}
+
+	struct track_result
+	{
+		int visible, hits, wrong;	// visible markers, found within max_err px, detections farther than max_err
+		double err_sum;				// mean corner error of the hits, summed
+		std::vector<double> ms;
+		__MarkerTrackStats stats;
+
+		double Recall() const { return visible ? (double)hits / visible : 0; }
+		double MeanErr() const { return hits ? err_sum / hits : 0; }
+	};
+
+	track_result RunTracker(const synthetic_sequence& seq, const __MarkerTrackParams& params, const bool predict, const bool bgr)
+	{
+		const float max_err = 2.f;
+		ArMarkerTracker tracker;
+		std::set<int> marker_ids;
+		for (int i = 0; i < num_markers; i++)
+		{
+			tracker.register_marker(i, 50.0);
+			marker_ids.insert(i);
+		}
+		tracker.set_track_params(params);
+		tracker.get_track_stats(true);
+
+		track_result res;
+		res.visible = res.hits = res.wrong = 0;
+		res.err_sum = 0;
+		for (int f = 0; f < (int)seq.frames.size(); f++)
+		{
+			const cv::Mat& img = bgr ? seq.frames_bgr[f] : seq.frames[f];
+			const cv::Matx33f prev2cur = f > 0 ? seq.Prev2Cur(f) : cv::Matx33f::eye();
+			std::vector<__MarkerDetInfo> dets;
+			const double t0 = NowMs();
+			tracker.track_markers(dets, img.data, seq.w, seq.h, img.channels(), marker_ids, predict && f > 0 ? prev2cur.val : NULL);
+			res.ms.push_back(NowMs() - t0);
+
+			std::vector<char> found(num_markers, 0);
+			for (const __MarkerDetInfo& det : dets)
+			{
+				if (det.id < 0 || det.id >= num_markers || det.corners2d.size() != 8) { res.wrong++; continue; }
+				const std::vector<cv::Point2f> gt = seq.Corners(f, det.id);
+				float err_max = 0, err_sum = 0;
+				for (int k = 0; k < 4; k++)
+				{
+					const float err = (float)cv::norm(cv::Point2f(det.corners2d[k * 2], det.corners2d[k * 2 + 1]) - gt[k]);
+					err_max = std::max(err_max, err);
+					err_sum += err;
+				}
+				if (err_max >= max_err) { res.wrong++; continue; }
+				if (!seq.IsVisible(f, det.id)) continue;
+				found[det.id] = 1;
+				res.err_sum += err_sum / 4;
+			}
+			for (int i = 0; i < num_markers; i++)
+			{
+				if (!seq.IsVisible(f, i)) continue;
+				res.visible++;
+				res.hits += found[i];
+			}
+		}
+		res.stats = tracker.get_track_stats();
+		return res;
+	}
+
+	__MarkerTrackParams RoiParams()
+	{
+		__MarkerTrackParams params;
+		params.roi_tracking = true;
+		params.full_search_interval = 10;
+		params.full_search_scale = 0.5f;
+		params.roi_margin = 0.5f;
+		return params;
+	}
+}
+
+KAR_TEST(aruco_roi_tracking_recall)
+{
+	const int num_frames = 90;
+	const synthetic_sequence seq = MakeSequence(1280, 720, num_frames);
+
+	const track_result full = RunTracker(seq, __MarkerTrackParams(), false, false);
+	const track_result roi = RunTracker(seq, RoiParams(), false, false);
+	const track_result roi_pred = RunTracker(seq, RoiParams(), true, false);
+	const track_result roi_bgr = RunTracker(seq, RoiParams(), true, true);
+	printf("  visible %d : recall full %.3f, roi %.3f, roi predicted %.3f, roi bgr %.3f\n",
+		full.visible, full.Recall(), roi.Recall(), roi_pred.Recall(), roi_bgr.Recall());
+	printf("  mean corner error (px) full %.3f, roi %.3f, roi predicted %.3f\n", full.MeanErr(), roi.MeanErr(), roi_pred.MeanErr());
+
+	// markers leave the frame : some frames have fewer than all of them
+	KAR_CHECK(full.visible < num_frames * num_markers && full.visible > num_frames * num_markers / 2);
+	KAR_CHECK(full.Recall() > 0.97);
+	KAR_CHECK(full.wrong == 0);
+
+	// the roi mode finds what the full frame detection finds (a marker coming back waits for the next full search,
+	// at most full_search_interval frames), with the full resolution corners
+	KAR_CHECK(roi.Recall() >= full.Recall() - 0.05);
+	KAR_CHECK(roi_pred.Recall() >= full.Recall() - 0.03);
+	KAR_CHECK(roi_bgr.hits == roi_pred.hits);
+	KAR_CHECK(roi.wrong == 0 && roi_pred.wrong == 0 && roi_bgr.wrong == 0);
+	KAR_CHECK(roi_pred.MeanErr() < full.MeanErr() + 0.1);
+
+	// full searches every full_search_interval calls (more when no marker is tracked), the rest in the regions
+	KAR_CHECK(full.stats.full_searches == num_frames && full.stats.roi_detections == 0);
+	KAR_CHECK(roi_pred.stats.full_searches >= num_frames / 10 && roi_pred.stats.full_searches < num_frames / 3);
+	KAR_CHECK(roi_pred.stats.roi_detections > 0);
+}
+
+KAR_BENCH(aruco_roi_tracking_runtime)
+{
+	const int sizes[2][2] = { { 1280, 720 }, { 1920, 1080 } };
+	printf("  %9s %14s | %9s %9s | %7s %8s %6s\n", "frame", "mode", "ms/frame", "p95", "recall", "searches", "rois");
+	for (int s = 0; s < 2; s++)
+	{
+		const int num_frames = 120;
+		const synthetic_sequence seq = MakeSequence(sizes[s][0], sizes[s][1], num_frames);
+		struct mode { const char* name; bool roi, predict, bgr; };
+		const mode modes[] = {
+			{ "full", false, false, false },
+			{ "full bgr", false, false, true },
+			{ "roi", true, false, false },
+			{ "roi predicted", true, true, false },
+			{ "roi bgr", true, true, true },
+		};
+		double full_ms = 0, full_recall = 0;
+		for (const mode& m : modes)
+		{
+			const track_result res = RunTracker(seq, m.roi ? RoiParams() : __MarkerTrackParams(), m.predict, m.bgr);
+			const double ms = Percentile(res.ms, 0.5);
+			printf("  %4dx%-4d %14s | %9.3f %9.3f | %7.3f %8lld %6lld\n", seq.w, seq.h, m.name, ms, Percentile(res.ms, 0.95),
+				res.Recall(), res.stats.full_searches, res.stats.roi_detections);
+			if (!m.roi && !m.bgr) { full_ms = ms; full_recall = res.Recall(); }
+			if (m.roi && m.predict)
+			{
+				KAR_CHECK(res.Recall() >= full_recall - 0.03);
+				KAR_CHECK(ms < full_ms);
+			}
+		}
+	}
+}
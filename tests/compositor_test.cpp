@@ -0,0 +1,122 @@
+#include "test_util.h"
+
+#include "../ar_settings/Compositor.h"
+
+#include <string.h>
+
+// SSE4.1 / AVX2 blend kernels of Compositor.cpp against the scalar reference, byte for byte
+
+using namespace kar_test;
+
+namespace
+{
+	const int frame_sizes[3][2] = { { 960, 540 }, { 1280, 720 }, { 1920, 1080 } };
+
+	// camera image : random bytes
+	std::vector<unsigned char> random_ui(const int w, const int h, const unsigned int seed)
+	{
+		lcg rng(seed);
+		std::vector<unsigned char> img((size_t)w * h * 3);
+		for (size_t k = 0; k < img.size(); k++) img[k] = (unsigned char)rng.Next();
+		return img;
+	}
+
+	// render buffer : runs of transparent, opaque and random alpha (the kernels skip the fully transparent 16 pixels)
+	std::vector<unsigned char> random_rgba(const int w, const int h, const unsigned int seed)
+	{
+		lcg rng(seed);
+		std::vector<unsigned char> img((size_t)w * h * 4);
+		int run = 0, kind = 0;
+		for (size_t p = 0; p < (size_t)w * h; p++)
+		{
+			if (run-- <= 0) { run = 1 + rng.Next() % 64; kind = rng.Next() % 4; }
+			unsigned char* px = &img[p * 4];
+			for (int c = 0; c < 3; c++) px[c] = (unsigned char)rng.Next();
+			px[3] = kind == 0 ? 0 : kind == 1 ? 255 : (unsigned char)rng.Next();
+		}
+		return img;
+	}
+
+	struct blend_case
+	{
+		int w_bf, h_bf, offset_x, offset_y, flags;
+		float mask_a, mask_b;
+	};
+
+	// first differing byte, -1 : same
+	long long first_diff(const std::vector<unsigned char>& a, const std::vector<unsigned char>& b)
+	{
+		for (size_t k = 0; k < a.size(); k++) if (a[k] != b[k]) return (long long)k;
+		return -1;
+	}
+}
+
+KAR_TEST(compositor_kernels_bit_exact)
+{
+	const CompositorKernel best = ui_compositor::GetBestKernel();
+	ui_compositor comp;
+
+	for (int s = 0; s < 3; s++)
+	{
+		const int w = frame_sizes[s][0], h = frame_sizes[s][1];
+		const std::vector<unsigned char> ui = random_ui(w, h, 3 + s);
+		const std::vector<unsigned char> rgba = random_rgba(w, h, 5 + s);
+
+		// the call sites of ArSettings : the whole frame, and local buffers with the smooth mask (clipped ones included),
+		// odd widths for the scalar tails
+		const blend_case cases[] = {
+			{ w, h, 0, 0, 0, 0, 0 },
+			{ w, h, 0, 0, COMP_FLIP_V, 0, 0 },
+			{ w, h, 0, 0, COMP_SWAP_RB | COMP_OPAQUE_SRC, 0, 0 },
+			{ w / 3 + 1, h / 3, 10, 100, COMP_SMOOTH_MASK, 0.2f, 50.f },
+			{ w / 5 + 7, h / 4, 10 + w / 5, 100, COMP_SMOOTH_MASK | COMP_OPAQUE_SRC, 3.f, 5.f },
+			{ w / 4 + 3, h / 3 + 1, w - w / 8, h - h / 6, COMP_SMOOTH_MASK | COMP_FLIP_V | COMP_SWAP_RB, 0.4f, 20.f },
+			{ w / 4, h / 4, -w / 10 - 1, -h / 10, COMP_SMOOTH_MASK, 0.4f, 20.f },
+		};
+		for (const blend_case& c : cases)
+		{
+			std::vector<unsigned char> ref = ui;
+			comp.SetKernel(COMP_KERNEL_SCALAR);
+			comp.Blend(&ref[0], w, h, &rgba[0], c.w_bf, c.h_bf, c.offset_x, c.offset_y, c.flags, c.mask_a, c.mask_b);
+			KAR_CHECK(ref != ui);
+
+			for (int k = COMP_KERNEL_SCALAR + 1; k <= (int)best; k++)
+			{
+				std::vector<unsigned char> out = ui;
+				comp.SetKernel((CompositorKernel)k);
+				comp.Blend(&out[0], w, h, &rgba[0], c.w_bf, c.h_bf, c.offset_x, c.offset_y, c.flags, c.mask_a, c.mask_b);
+				const long long diff = first_diff(ref, out);
+				if (diff >= 0) printf("  %dx%d kernel %d flags %d : byte %lld is %d, reference %d\n", w, h, k, c.flags, diff, out[diff], ref[diff]);
+				KAR_CHECK(diff < 0);
+			}
+		}
+	}
+}
+
+KAR_BENCH(compositor_kernels)
+{
+	const CompositorKernel best = ui_compositor::GetBestKernel();
+	const char* names[COMP_KERNEL_COUNT] = { "scalar", "sse4.1", "avx2" };
+	ui_compositor comp;
+	printf("  best kernel of this cpu : %s\n", names[best]);
+	printf("  %9s %7s | %10s %10s\n", "frame", "kernel", "full ms", "local ms");
+	for (int s = 0; s < 3; s++)
+	{
+		const int w = frame_sizes[s][0], h = frame_sizes[s][1];
+		std::vector<unsigned char> ui = random_ui(w, h, 3);
+		const std::vector<unsigned char> rgba = random_rgba(w, h, 5);
+		for (int k = 0; k <= (int)best; k++)
+		{
+			comp.SetKernel((CompositorKernel)k);
+			// the whole render buffer, then the three local buffers of a frame (model, slices, navigation)
+			const double ms_full = TimeMs([&]() { comp.Blend(&ui[0], w, h, &rgba[0], w, h, 0, 0, 0); }, 20);
+			const double ms_local = TimeMs([&]() {
+				comp.Blend(&ui[0], w, h, &rgba[0], w / 3, h / 3, 10, 100, COMP_SMOOTH_MASK, 0.2f, 50.f);
+				for (int i = 0; i < 2; i++)
+					comp.Blend(&ui[0], w, h, &rgba[0], w / 5, h / 4, 10 + w / 5 * i, 100, COMP_SMOOTH_MASK | COMP_OPAQUE_SRC, 3.f, 5.f);
+				comp.Blend(&ui[0], w, h, &rgba[0], w / 4, h / 3, w - w / 4 - 10, h - h / 3 - 10, COMP_SMOOTH_MASK, 0.4f, 20.f);
+			}, 20);
+			printf("  %4dx%-4d %7s | %10.3f %10.3f\n", w, h, names[k], ms_full, ms_local);
+		}
+	}
+}
@@ -0,0 +1,295 @@
+#include "test_util.h"
+
+#include "../ar_settings/DepthProc.h"
+
+#include <librealsense2/rsutil.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// synthetic depth images //////////////////////////////////////////////////////////////////
+
+static rs2_intrinsics pinhole_intrinsics(const int w, const int h)
+{
+	rs2_intrinsics intr;
+	memset(&intr, 0, sizeof(intr));
+	intr.width = w;
+	intr.height = h;
+	intr.fx = intr.fy = 0.8f * w;
+	intr.ppx = 0.5f * w;
+	intr.ppy = 0.5f * h;
+	intr.model = RS2_DISTORTION_NONE;
+	return intr;
+}
+
+// plane dot(n, p) = d seen through the pixel rays, depth in depth_scale units, a rectangular hole of zero depth
+static std::vector<uint16_t> plane_depth(const rs2_intrinsics& intr, const glm::fvec3& n, const float d, const float depth_scale)
+{
+	std::vector<uint16_t> depth(intr.width * intr.height);
+	for (int y = 0; y < intr.height; y++)
+		for (int x = 0; x < intr.width; x++)
+		{
+			float pixel[2] = { (float)x, (float)y }, ray[3];
+			rs2_deproject_pixel_to_point(ray, &intr, pixel, 1.f);
+			float z = d / glm::dot(n, glm::fvec3(ray[0], ray[1], ray[2]));
+			bool in_hole = x >= intr.width / 4 && x < intr.width / 4 + 9 && y >= intr.height / 3 && y < intr.height / 3 + 5;
+			depth[x + y * intr.width] = in_hole ? 0 : (uint16_t)(z / depth_scale + 0.5f);
+		}
+	return depth;
+}
+
+// plane with a bump and a few isolated zero pixels, exercises both neighbor choices
+static std::vector<uint16_t> bumpy_depth(const rs2_intrinsics& intr)
+{
+	std::vector<uint16_t> depth(intr.width * intr.height);
+	kar_test::lcg rng(11);
+	for (int y = 0; y < intr.height; y++)
+		for (int x = 0; x < intr.width; x++)
+		{
+			float fx = (x - intr.ppx) / intr.width, fy = (y - intr.ppy) / intr.height;
+			float z = 1000.f + 300.f * fx + 200.f * expf(-40.f * (fx * fx + fy * fy)) + rng.Uniform(0, 3.f);
+			depth[x + y * intr.width] = rng.Next() % 50 == 0 ? 0 : (uint16_t)z;
+		}
+	return depth;
+}
+
+// depth_normal_kernel ////////////////////////////////////////////////////////////////////////
+
+// positions are ray * depth, normals of a plane are the plane normal toward the sensor, holes are zero
+KAR_TEST(depth_normal_kernel_plane)
+{
+	const rs2_intrinsics intr = pinhole_intrinsics(160, 90);
+	const float depth_scale = 0.0001f;
+	const glm::fvec3 plane_n = glm::normalize(glm::fvec3(0.3f, -0.2f, -1.f)); // facing the camera
+	const std::vector<uint16_t> depth = plane_depth(intr, plane_n, glm::dot(plane_n, glm::fvec3(0, 0, 0.8f)), depth_scale); // through (0, 0, 0.8 m)
+
+	depth_normal_kernel kernel;
+	kernel.Compute(&depth[0], intr.width * 2, intr, depth_scale);
+	KAR_CHECK(kernel.GetWidth() == intr.width && kernel.GetHeight() == intr.height);
+
+	int num_checked = 0, num_bad = 0;
+	float max_pos_err = 0;
+	for (int y = 0; y < intr.height; y++)
+		for (int x = 0; x < intr.width; x++)
+		{
+			const int idx = x + y * intr.width;
+			if (depth[idx] == 0)
+			{
+				KAR_CHECK(!kernel.IsValid(idx) && kernel.GetPos(idx) == glm::fvec3(0) && kernel.GetNrl(idx) == glm::fvec3(0));
+				continue;
+			}
+			float pixel[2] = { (float)x, (float)y }, p[3];
+			rs2_deproject_pixel_to_point(p, &intr, pixel, depth[idx] * depth_scale);
+			max_pos_err = std::max(max_pos_err, glm::length(kernel.GetPos(idx) - glm::fvec3(p[0], p[1], p[2])));
+
+			glm::fvec3 n = kernel.GetNrl(idx);
+			KAR_CHECK(fabs(glm::length(n) - 1.f) < 1e-4f);
+			num_checked++;
+			if (glm::dot(n, plane_n) < 0.99f) num_bad++;
+		}
+	KAR_CHECK(max_pos_err < 1e-5f);
+	KAR_CHECK(num_checked > intr.width * intr.height * 9 / 10);
+	KAR_CHECK(num_bad == 0);
+}
+
+// the SSE path matches the scalar reference, odd sizes run the scalar tails and borders
+KAR_TEST(depth_normal_kernel_simd_vs_scalar)
+{
+	const int sizes[3][2] = { { 160, 90 }, { 37, 23 }, { 5, 4 } };
+	for (int s = 0; s < 3; s++)
+	{
+		const rs2_intrinsics intr = pinhole_intrinsics(sizes[s][0], sizes[s][1]);
+		const std::vector<uint16_t> depth = bumpy_depth(intr);
+
+		depth_normal_kernel simd, scalar;
+		scalar.EnableSimd(false);
+		simd.Compute(&depth[0], intr.width * 2, intr, 0.001f);
+		scalar.Compute(&depth[0], intr.width * 2, intr, 0.001f);
+
+		float max_pos_err = 0, max_nrl_err = 0;
+		for (int i = 0; i < intr.width * intr.height; i++)
+		{
+			max_pos_err = std::max(max_pos_err, glm::length(simd.GetPos(i) - scalar.GetPos(i)));
+			max_nrl_err = std::max(max_nrl_err, glm::length(simd.GetNrl(i) - scalar.GetNrl(i)));
+			KAR_CHECK(simd.IsValid(i) == (depth[i] != 0));
+		}
+		KAR_CHECK(max_pos_err == 0);
+		KAR_CHECK(max_nrl_err < 1e-6f);
+	}
+}
+
+// a row pitch wider than the image, and the ray cache following an intrinsics change
+KAR_TEST(depth_normal_kernel_stride_and_intrinsics)
+{
+	rs2_intrinsics intr = pinhole_intrinsics(64, 48);
+	const std::vector<uint16_t> depth = bumpy_depth(intr);
+	const int pitch = 80;
+	std::vector<uint16_t> padded(pitch * intr.height, 0xffff);
+	for (int y = 0; y < intr.height; y++)
+		memcpy(&padded[y * pitch], &depth[y * intr.width], intr.width * 2);
+
+	depth_normal_kernel a, b;
+	a.Compute(&depth[0], intr.width * 2, intr, 0.001f);
+	b.Compute(&padded[0], pitch * 2, intr, 0.001f);
+	bool same = true;
+	for (int i = 0; i < intr.width * intr.height; i++)
+		same = same && a.GetPos(i) == b.GetPos(i) && a.GetNrl(i) == b.GetNrl(i);
+	KAR_CHECK(same);
+
+	intr.fx *= 2;
+	b.Compute(&depth[0], intr.width * 2, intr, 0.001f);
+	const int idx = 3 + 5 * intr.width;
+	float pixel[2] = { 3, 5 }, p[3];
+	rs2_deproject_pixel_to_point(p, &intr, pixel, depth[idx] * 0.001f);
+	KAR_CHECK(depth[idx] == 0 || fabs(b.GetPos(idx).x - p[0]) < 1e-6f);
+}
+
+// ms per frame of the scalar reference and the SSE path, on one thread and on the OpenMP team
+KAR_BENCH(depth_normal_kernel_timing)
+{
+	const int sizes[2][2] = { { 960, 540 }, { 1280, 720 } };
+	for (int s = 0; s < 2; s++)
+	{
+		const rs2_intrinsics intr = pinhole_intrinsics(sizes[s][0], sizes[s][1]);
+		const std::vector<uint16_t> depth = bumpy_depth(intr);
+		depth_normal_kernel kernel;
+		kernel.Compute(&depth[0], intr.width * 2, intr, 0.001f); // rays
+
+		int max_threads = 1;
+#ifdef _OPENMP
+		max_threads = omp_get_max_threads();
+#endif
+		for (int t = 0; t < 2; t++)
+		{
+			const int num_threads = t == 0 ? 1 : max_threads;
+			if (t == 1 && max_threads == 1) break;
+#ifdef _OPENMP
+			omp_set_num_threads(num_threads);
+#endif
+			kernel.EnableSimd(false);
+			double t_scalar = kar_test::TimeMs([&]() { kernel.Compute(&depth[0], intr.width * 2, intr, 0.001f); }, 10);
+			kernel.EnableSimd(true);
+			double t_simd = kar_test::TimeMs([&]() { kernel.Compute(&depth[0], intr.width * 2, intr, 0.001f); }, 10);
+			printf("  %dx%d, %d thread(s) : scalar %.2f ms, sse %.2f ms\n", intr.width, intr.height, num_threads, t_scalar, t_simd);
+		}
+#ifdef _OPENMP
+		omp_set_num_threads(max_threads);
+#endif
+	}
+}
+
+// point_cloud_stage ////////////////////////////////////////////////////////////////////////
+
+// uploader standing in for vzm::GeneratePointCloudObject
+struct mock_upload
+{
+	int calls;
+	int num_pts;
+	const float* xyz_ptr;
+	std::vector<glm::fvec3> pos, nrl;
+	mock_upload() { calls = 0; num_pts = 0; xyz_ptr = NULL; }
+
+	point_cloud_stage::uploader Func()
+	{
+		return [this](const float* xyz_list, const float* nrl_list, const float*, const int n)
+		{
+			calls++;
+			num_pts = n;
+			xyz_ptr = xyz_list;
+			pos.assign((const glm::fvec3*)xyz_list, (const glm::fvec3*)xyz_list + n);
+			nrl.assign((const glm::fvec3*)nrl_list, (const glm::fvec3*)nrl_list + n);
+		};
+	}
+};
+
+// zero depths are compacted out in scan order, the two buffers alternate, the stats count the points
+KAR_TEST(point_cloud_stage_compaction)
+{
+	const rs2_intrinsics intr = pinhole_intrinsics(64, 48);
+	const std::vector<uint16_t> depth = bumpy_depth(intr);
+	depth_normal_kernel kernel;
+	kernel.Compute(&depth[0], intr.width * 2, intr, 0.001f);
+
+	point_cloud_stage stage;
+	mock_upload mock;
+	KAR_CHECK(!stage.Upload()); // no uploader
+	stage.SetUploader(mock.Func());
+	KAR_CHECK(!stage.Upload()); // nothing staged
+
+	int num_valid = 0;
+	for (int i = 0; i < intr.width * intr.height; i++) num_valid += depth[i] != 0;
+	KAR_CHECK(num_valid < intr.width * intr.height);
+	KAR_CHECK(stage.Stage(kernel) == num_valid);
+	KAR_CHECK(stage.Upload() && mock.calls == 1 && mock.num_pts == num_valid);
+
+	bool same = true;
+	for (int i = 0, j = 0; i < intr.width * intr.height; i++)
+	{
+		if (depth[i] == 0) continue;
+		same = same && mock.pos[j] == kernel.GetPos(i) && mock.nrl[j] == kernel.GetNrl(i);
+		j++;
+	}
+	KAR_CHECK(same);
+
+	const float* first_buffer = mock.xyz_ptr;
+	stage.Stage(kernel);
+	stage.Upload();
+	KAR_CHECK(mock.xyz_ptr != first_buffer);
+	stage.Stage(kernel);
+	stage.Upload();
+	KAR_CHECK(mock.xyz_ptr == first_buffer);
+
+	const pc_stage_stats& stats = stage.GetStats();
+	KAR_CHECK(stats.frames == 3 && stats.num_in == intr.width * intr.height && stats.num_valid == num_valid && stats.num_out == num_valid);
+	KAR_CHECK(stats.total_in == 3ll * intr.width * intr.height && stats.total_out == 3ll * num_valid);
+
+	// an empty frame uploads nothing
+	std::vector<uint16_t> empty(intr.width * intr.height, 0);
+	kernel.Compute(&empty[0], intr.width * 2, intr, 0.001f);
+	KAR_CHECK(stage.Stage(kernel) == 0 && !stage.Upload() && mock.calls == 3);
+}
+
+// one averaged point per occupied voxel, the averages of a plane stay on the plane
+KAR_TEST(point_cloud_stage_voxel_decimation)
+{
+	const rs2_intrinsics intr = pinhole_intrinsics(160, 90);
+	const glm::fvec3 plane_n = glm::normalize(glm::fvec3(0.3f, -0.2f, -1.f));
+	const float plane_d = glm::dot(plane_n, glm::fvec3(0, 0, 0.8f));
+	const std::vector<uint16_t> depth = plane_depth(intr, plane_n, plane_d, 0.0001f);
+	depth_normal_kernel kernel;
+	kernel.Compute(&depth[0], intr.width * 2, intr, 0.0001f);
+
+	const float voxel = 0.02f;
+	point_cloud_stage stage;
+	mock_upload mock;
+	stage.SetUploader(mock.Func());
+	stage.SetVoxelSize(voxel);
+	const int num_out = stage.Stage(kernel);
+	KAR_CHECK(stage.Upload() && mock.num_pts == num_out);
+
+	// same cell rounding as the stage (p * (1 / size))
+	const float inv_voxel = 1.f / voxel;
+	std::vector<unsigned long long> keys;
+	for (int i = 0; i < intr.width * intr.height; i++)
+	{
+		if (!kernel.IsValid(i)) continue;
+		glm::fvec3 p = kernel.GetPos(i) * inv_voxel;
+		keys.push_back(((unsigned long long)(floorf(p.x) + 4096) << 26) | ((unsigned long long)(floorf(p.y) + 4096) << 13) | (unsigned long long)(floorf(p.z) + 4096));
+	}
+	std::sort(keys.begin(), keys.end());
+	const int num_voxels = (int)(std::unique(keys.begin(), keys.end()) - keys.begin());
+	KAR_CHECK(num_out == num_voxels);
+	KAR_CHECK(num_out < stage.GetStats().num_valid / 4);
+
+	float max_plane_err = 0, max_nrl_err = 0;
+	for (int j = 0; j < num_out; j++)
+	{
+		max_plane_err = std::max(max_plane_err, fabsf(glm::dot(plane_n, mock.pos[j]) - plane_d));
+		max_nrl_err = std::max(max_nrl_err, glm::length(mock.nrl[j] - plane_n));
+	}
+	KAR_CHECK(max_plane_err < 1e-4f);
+	KAR_CHECK(max_nrl_err < 0.05f);
+}
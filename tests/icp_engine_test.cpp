@@ -0,0 +1,179 @@
+#include "test_util.h"
+
+#include "../ar_settings/IcpEngine.h"
+
+#include <glm/gtx/transform.hpp>
+#include <math.h>
+#include <thread>
+
+// point to plane ICP of IcpEngine.cpp on a synthetic surface : known transforms recovered from noisy targets with outliers
+
+using namespace kar_test;
+
+namespace
+{
+	// half sphere (r 8 cm) on a bumpy 30 cm plane, points and normals
+	void SampleSurface(lcg& rng, const int n, std::vector<glm::fvec3>& pos, std::vector<glm::fvec3>& nrl)
+	{
+		for (int i = 0; i < n; i++)
+		{
+			if (rng.Uniform(0, 1) < 0.5f)
+			{
+				const float th = rng.Uniform(0, 6.2831f), ph = rng.Uniform(0, 1.5f);
+				const glm::fvec3 d(cos(th) * sin(ph), sin(th) * sin(ph), cos(ph));
+				pos.push_back(d * 0.08f);
+				nrl.push_back(d);
+			}
+			else
+			{
+				const float x = rng.Uniform(-0.15f, 0.15f), y = rng.Uniform(-0.15f, 0.15f);
+				pos.push_back(glm::fvec3(x, y, 0.01f * sin(x * 40) * cos(y * 30)));
+				nrl.push_back(glm::normalize(glm::fvec3(-0.4f * cos(x * 40) * cos(y * 30), 0.3f * sin(x * 40) * sin(y * 30), 1)));
+			}
+		}
+	}
+
+	// target : the surface moved by mat, noise of +-noise meters, num_outliers points in a 40 cm box
+	void MakeTarget(lcg& rng, const std::vector<glm::fvec3>& pos, const std::vector<glm::fvec3>& nrl, const glm::fmat4x4& mat,
+		const float noise, const int num_outliers, std::vector<glm::fvec3>& tgt_pos, std::vector<glm::fvec3>& tgt_nrl)
+	{
+		tgt_pos.resize(pos.size());
+		tgt_nrl.resize(nrl.size());
+		for (size_t i = 0; i < pos.size(); i++)
+		{
+			const glm::fvec3 n(rng.Uniform(-noise, noise), rng.Uniform(-noise, noise), rng.Uniform(-noise, noise));
+			tgt_pos[i] = glm::fvec3(mat * glm::fvec4(pos[i], 1)) + n;
+			tgt_nrl[i] = glm::fmat3x3(mat) * nrl[i];
+		}
+		for (int i = 0; i < num_outliers; i++)
+		{
+			tgt_pos.push_back(glm::fvec3(rng.Uniform(-0.2f, 0.2f), rng.Uniform(-0.2f, 0.2f), rng.Uniform(0, 0.08f)));
+			tgt_nrl.push_back(glm::fvec3(0, 0, 1));
+		}
+	}
+
+	// translation (m) and rotation (deg) of mat_est relative to mat_gt
+	void PoseError(const glm::fmat4x4& mat_gt, const glm::fmat4x4& mat_est, float& t_err, float& r_err)
+	{
+		const glm::fmat4x4 err = glm::inverse(mat_gt) * mat_est;
+		t_err = glm::length(glm::fvec3(err[3]));
+		// sin of the angle from the skew part (acos of the trace is not accurate near 0 in float)
+		const glm::fvec3 skew(err[1][2] - err[2][1], err[2][0] - err[0][2], err[0][1] - err[1][0]);
+		r_err = glm::degrees(asin(glm::min(glm::length(skew) * 0.5f, 1.f)));
+	}
+
+	glm::fmat4x4 TrialTransform(const int trial)
+	{
+		return glm::translate(glm::fvec3(0.006f * (trial + 1), -0.004f, 0.003f))
+			* glm::rotate(glm::radians(3.f * (trial + 1)), glm::normalize(glm::fvec3(1, 2, 0.5f + trial)));
+	}
+}
+
+KAR_TEST(icp_solver_recovers_transform)
+{
+	lcg rng(3);
+	std::vector<glm::fvec3> src_pos, src_nrl, surf_pos, surf_nrl;
+	SampleSurface(rng, 8000, src_pos, src_nrl);
+	SampleSurface(rng, 60000, surf_pos, surf_nrl);
+
+	icp_solver solver(4);
+	for (int trial = 0; trial < 4; trial++)
+	{
+		// up to 2.5 cm and 12 deg from the initial pose
+		const glm::fmat4x4 mat_gt = TrialTransform(trial);
+		std::vector<glm::fvec3> tgt_pos, tgt_nrl;
+		MakeTarget(rng, surf_pos, surf_nrl, mat_gt, 0.0005f, 3000, tgt_pos, tgt_nrl);
+		solver.SetTarget(&tgt_pos[0], &tgt_nrl[0], (int)tgt_pos.size());
+		solver.SetSource(&src_pos[0], (int)src_pos.size());
+		KAR_CHECK(solver.HasData());
+
+		const icp_result res = solver.Align(glm::fmat4x4(1.f));
+		float t_err, r_err;
+		PoseError(mat_gt, res.mat_src2tgt, t_err, r_err);
+		printf("  trial %d : %.3f mm, %.4f deg, rms %.3f mm, %d points, %d iterations, %.1f ms\n",
+			trial, t_err * 1000, r_err, res.rms_err * 1000, res.num_corrs, res.iterations, res.ms);
+		KAR_CHECK(t_err < 0.0002f);
+		KAR_CHECK(r_err < 0.1f);
+		KAR_CHECK(res.rms_err < 0.0005f);
+		KAR_CHECK(res.num_corrs > (int)src_pos.size() / 2);
+	}
+}
+
+KAR_TEST(icp_tracker_follows_moving_target)
+{
+	lcg rng(5);
+	std::vector<glm::fvec3> src_pos, src_nrl, surf_pos, surf_nrl;
+	SampleSurface(rng, 4000, src_pos, src_nrl);
+	SampleSurface(rng, 30000, surf_pos, surf_nrl);
+
+	icp_tracker tracker(2);
+	KAR_CHECK(!tracker.IsRunning());
+	tracker.Start();
+	KAR_CHECK(tracker.IsRunning());
+	tracker.SetSource(&src_pos[0], (int)src_pos.size());
+	tracker.SetPose(glm::fmat4x4(1.f));
+
+	// 1 mm and 0.5 deg per frame, the targets are given in a frame moved by mat_tgt2frm
+	const glm::fmat4x4 mat_tgt2frm = glm::translate(glm::fvec3(0.1f, 0, 0));
+	glm::fmat4x4 mat_gt(1.f);
+	uint64_t version = 0;
+	icp_result res;
+	int num_results = 0;
+	for (int f = 0; f < 30; f++)
+	{
+		mat_gt = glm::translate(glm::fvec3(0.001f, 0.0005f, 0)) * glm::rotate(glm::radians(0.5f), glm::fvec3(0, 0, 1)) * mat_gt;
+		std::vector<glm::fvec3> tgt_pos, tgt_nrl;
+		MakeTarget(rng, surf_pos, surf_nrl, glm::inverse(mat_tgt2frm) * mat_gt, 0, 0, tgt_pos, tgt_nrl);
+		tracker.PushTarget(&tgt_pos[0], &tgt_nrl[0], (int)tgt_pos.size(), mat_tgt2frm);
+		std::this_thread::sleep_for(std::chrono::milliseconds(33));
+		while (tracker.GetResult(version, version, res)) num_results++;
+	}
+	// the last target refined
+	for (int i = 0; i < 20; i++)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		while (tracker.GetResult(version, version, res)) num_results++;
+	}
+	float t_err, r_err;
+	PoseError(mat_gt, res.mat_src2tgt, t_err, r_err);
+	const icp_stats stats = tracker.GetStats();
+	printf("  %.3f mm, %.4f deg, %d results, %lld refinements, %.1f iterations/s\n",
+		t_err * 1000, r_err, num_results, stats.refinements, stats.iterations * 1000.0 / stats.elapsed_ms);
+	KAR_CHECK(num_results > 0);
+	KAR_CHECK(t_err < 0.0005f);
+	KAR_CHECK(r_err < 0.1f);
+
+	// a new pose starts a new epoch : no result of the previous one
+	tracker.SetPose(glm::fmat4x4(1.f));
+	icp_result stale;
+	const uint64_t last = version;
+	if (tracker.GetResult(last, version, stale)) KAR_CHECK(version > last);
+
+	tracker.Stop();
+	KAR_CHECK(!tracker.IsRunning());
+}
+
+KAR_BENCH(icp_solver_align)
+{
+	printf("  %7s %7s | %9s %9s %10s\n", "source", "target", "ms", "mm", "iterations");
+	const int sizes[3][2] = { { 2000, 20000 }, { 8000, 60000 }, { 20000, 200000 } };
+	for (int s = 0; s < 3; s++)
+	{
+		lcg rng(7);
+		std::vector<glm::fvec3> src_pos, src_nrl, surf_pos, surf_nrl, tgt_pos, tgt_nrl;
+		SampleSurface(rng, sizes[s][0], src_pos, src_nrl);
+		SampleSurface(rng, sizes[s][1], surf_pos, surf_nrl);
+		const glm::fmat4x4 mat_gt = TrialTransform(1);
+		MakeTarget(rng, surf_pos, surf_nrl, mat_gt, 0.0005f, sizes[s][1] / 20, tgt_pos, tgt_nrl);
+
+		icp_solver solver(4);
+		solver.SetTarget(&tgt_pos[0], &tgt_nrl[0], (int)tgt_pos.size());
+		solver.SetSource(&src_pos[0], (int)src_pos.size());
+		icp_result res;
+		const double ms = TimeMs([&]() { res = solver.Align(glm::fmat4x4(1.f)); });
+		float t_err, r_err;
+		PoseError(mat_gt, res.mat_src2tgt, t_err, r_err);
+		printf("  %7d %7d | %9.2f %9.3f %10d\n", sizes[s][0], (int)tgt_pos.size(), ms, t_err * 1000, res.iterations);
+		KAR_CHECK(t_err < 0.0005f);
+	}
+}
@@ -0,0 +1,960 @@
+#include "test_util.h"
+
+// kar_helpers.hpp defines non-inline functions, so this is the only test unit including it
+#include "../kar_helpers.hpp"
+
+#include <thread>
+#include <functional>
+
+// spsc_ring ////////////////////////////////////////////////////////////////////////////////
+
+KAR_TEST(spsc_ring_modes)
+{
+	spsc_ring<int> ring(4);
+	KAR_CHECK(ring.capacity() == 4);
+	KAR_CHECK(ring.empty());
+
+	for (int i = 0; i < 4; i++) KAR_CHECK(ring.push(i));
+	KAR_CHECK(ring.push(4)); // full : the oldest sample (0) is overwritten, not blocking
+	KAR_CHECK(ring.num_dropped() == 1 && ring.size() == 4);
+
+	// fifo
+	int v = -1;
+	KAR_CHECK(ring.pop(v) && v == 1);
+	KAR_CHECK(ring.size() == 3);
+
+	// drain-all in push order
+	std::vector<int> drained;
+	KAR_CHECK(ring.pop_all([&](const int& x) { drained.push_back(x); }) == 3);
+	KAR_CHECK(drained.size() == 3 && drained[0] == 2 && drained[1] == 3 && drained[2] == 4);
+	KAR_CHECK(ring.empty());
+
+	// latest-wins
+	for (int i = 10; i < 13; i++) ring.push(i);
+	KAR_CHECK(ring.pop_latest(v) && v == 12);
+	KAR_CHECK(ring.empty());
+	KAR_CHECK(!ring.pop_latest(v) && v == 12);
+	KAR_CHECK(!ring.wait_latest(v, 1));
+
+	// the slots the consumer is reading are not overwritten : a push into the full ring during pop_all is rejected
+	for (int i = 20; i < 24; i++) ring.push(i);
+	drained.clear();
+	bool rejected = false;
+	ring.pop_all([&](const int& x)
+	{
+		if (drained.empty()) rejected = !ring.push(99);
+		drained.push_back(x);
+	});
+	KAR_CHECK(rejected && ring.num_dropped() == 2);
+	KAR_CHECK(drained.size() == 4 && drained[0] == 20 && drained[3] == 23);
+	KAR_CHECK(ring.empty());
+}
+
+// the consumer sleeps in wait_latest until the producer pushes, and gives up after the timeout
+KAR_TEST(spsc_ring_wait)
+{
+	spsc_ring<int> ring(4);
+	int v = -1;
+	double t0 = kar_test::NowMs();
+	KAR_CHECK(!ring.wait_latest(v, 20));
+	const double waited = kar_test::NowMs() - t0;
+	KAR_CHECK(waited >= 15 && waited < 1000);
+
+	std::thread producer([&]()
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		ring.push(7);
+	});
+	t0 = kar_test::NowMs();
+	KAR_CHECK(ring.wait_latest(v, 5000) && v == 7);
+	KAR_CHECK(kar_test::NowMs() - t0 < 1000);
+	producer.join();
+}
+
+// one producer, one consumer thread : the samples arrive in order and once, every sample is received or counted as dropped
+KAR_TEST(spsc_ring_threads)
+{
+	const int num_samples = 200000;
+	spsc_ring<std::vector<int>> ring(16);
+	std::atomic<bool> done{ false };
+	std::thread producer([&]()
+	{
+		for (int i = 0; i < num_samples; i++)
+		{
+			std::vector<int>* slot = ring.begin_write();
+			if (slot == NULL) continue; // the consumer is reading the full ring, i is dropped
+			slot->assign(3, i);
+			ring.end_write();
+			if (i % 64 == 0) std::this_thread::yield(); // lets the consumer interleave on a single core
+		}
+		done = true;
+	});
+
+	int last = -1, received = 0;
+	bool in_order = true;
+	for (;;)
+	{
+		const bool finished = done;
+		int n = ring.pop_all([&](const std::vector<int>& x)
+		{
+			if (x.size() != 3 || x[0] <= last || x[2] != x[0]) in_order = false;
+			last = x[0];
+			received++;
+		});
+		if (n == 0)
+		{
+			if (finished) break;
+			std::this_thread::yield();
+		}
+	}
+	producer.join();
+	printf("  %d received, %d dropped\n", received, (int)ring.num_dropped());
+	KAR_CHECK(in_order);
+	KAR_CHECK(received + (int)ring.num_dropped() == num_samples);
+	KAR_CHECK(ring.empty());
+}
+
+// push -> pop latency and throughput of the track ring against concurrent_queue, track_info frames
+// latency : 240 Hz producer (the tracker rate), the consumer polls (ring, pop_latest) or blocks (queue, wait_and_pop)
+// throughput : unpaced producer, the consumer drains in order
+KAR_BENCH(spsc_ring_vs_concurrent_queue)
+{
+	const int num_paced = 480; // 2 s at 240 Hz
+	const int num_burst = 100000;
+	const double period_ms = 1000.0 / 240.0;
+
+	auto paced_producer = [&](std::function<void(const track_info&)> push)
+	{
+		track_info frame;
+		frame.num_mks = 16;
+		double t_next = kar_test::NowMs();
+		for (int i = 0; i < num_paced; i++)
+		{
+			t_next += period_ms;
+			while (kar_test::NowMs() < t_next) std::this_thread::yield();
+			frame.time_stamp = kar_test::NowMs();
+			push(frame);
+		}
+		frame.time_stamp = -1; // end
+		push(frame);
+	};
+	auto print_latency = [](const char* name, const std::vector<double>& latency)
+	{
+		double sum = 0;
+		for (double l : latency) sum += l;
+		printf("  %-16s 240 Hz : %d frames, latency mean %.4f ms, p99 %.4f ms, max %.4f ms\n", name, (int)latency.size(),
+			latency.empty() ? 0 : sum / latency.size(), kar_test::Percentile(latency, 0.99), kar_test::Percentile(latency, 1.0));
+	};
+
+	{
+		spsc_ring<track_info> ring(16);
+		std::vector<double> latency;
+		latency.reserve(num_paced);
+		std::thread producer([&]() { paced_producer([&](const track_info& f) { while (!ring.push(f)) std::this_thread::yield(); }); });
+		track_info frame;
+		for (;;)
+		{
+			if (!ring.pop_latest(frame)) { std::this_thread::yield(); continue; }
+			if (frame.time_stamp < 0) break;
+			latency.push_back(kar_test::NowMs() - frame.time_stamp);
+		}
+		producer.join();
+		print_latency("spsc_ring", latency);
+		KAR_CHECK(latency.size() > num_paced / 2);
+	}
+	{
+		concurrent_queue<track_info> queue(10);
+		std::vector<double> latency;
+		latency.reserve(num_paced);
+		std::thread producer([&]() { paced_producer([&](const track_info& f) { queue.push(f); }); });
+		track_info frame;
+		for (;;)
+		{
+			queue.wait_and_pop(frame);
+			if (frame.time_stamp < 0) break;
+			latency.push_back(kar_test::NowMs() - frame.time_stamp);
+		}
+		producer.join();
+		print_latency("concurrent_queue", latency);
+	}
+
+	{
+		spsc_ring<track_info> ring(16);
+		int received = 0;
+		double t0 = kar_test::NowMs();
+		std::thread producer([&]()
+		{
+			track_info frame;
+			for (int i = 0; i < num_burst; i++)
+			{
+				track_info* slot = ring.begin_write();
+				if (slot == NULL) continue;
+				slot->time_stamp = i;
+				ring.end_write();
+			}
+			frame.time_stamp = -1;
+			while (!ring.push(frame)) std::this_thread::yield();
+		});
+		track_info frame;
+		for (;;)
+		{
+			if (!ring.pop(frame)) { std::this_thread::yield(); continue; }
+			if (frame.time_stamp < 0) break;
+			received++;
+		}
+		producer.join();
+		double t = kar_test::NowMs() - t0;
+		printf("  %-16s burst  : %d frames in %.1f ms (%.0f frames/s), dropped %d\n", "spsc_ring", received, t, received / t * 1000.0, (int)ring.num_dropped());
+	}
+	{
+		// the queue drops its oldest frame beyond the capacity, the consumer counts what it received
+		concurrent_queue<track_info> queue(10);
+		int received = 0;
+		double t0 = kar_test::NowMs();
+		std::thread producer([&]()
+		{
+			track_info frame;
+			for (int i = 0; i < num_burst; i++)
+			{
+				frame.time_stamp = i;
+				queue.push(frame);
+			}
+			frame.time_stamp = -1;
+			queue.push(frame);
+		});
+		track_info frame;
+		for (;;)
+		{
+			queue.wait_and_pop(frame);
+			if (frame.time_stamp < 0) break;
+			received++;
+		}
+		producer.join();
+		double t = kar_test::NowMs() - t0;
+		printf("  %-16s burst  : %d frames in %.1f ms (%.0f frames/s), %d dropped\n", "concurrent_queue", received, t, received / t * 1000.0, num_burst - received);
+	}
+}
+
+// rb_registry / track_info //////////////////////////////////////////////////////////////////
+
+KAR_TEST(rb_registry_handles)
+{
+	rb_registry rbs;
+	KAR_CHECK(rbs.Register("rs_cam") == 0);
+	KAR_CHECK(rbs.Register("probe") == 1);
+	KAR_CHECK(rbs.Register("rs_cam") == 0);
+	KAR_CHECK(rbs.Find("probe") == 1 && rbs.Find("marker") == -1);
+	KAR_CHECK(strcmp(rbs.Name(1), "probe") == 0 && strcmp(rbs.Name(5), "") == 0);
+
+	// over-long names are refused and not truncated into another body's name
+	const string long_name(MAX_RB_NAME, 'x');
+	KAR_CHECK(rbs.Register(long_name) == -1);
+	KAR_CHECK(rbs.Register(long_name.substr(0, MAX_RB_NAME - 1)) == 2);
+	KAR_CHECK(rbs.num_rbs == 3);
+
+	rb_registry full;
+	for (int i = 0; i < MAX_TRK_RBS; i++) KAR_CHECK(full.Register("rb" + to_string(i)) == i);
+	KAR_CHECK(full.Register("one_more") == -1);
+	KAR_CHECK(full.Register("rb3") == 3);
+}
+
+KAR_TEST(track_info_lookup_and_serial)
+{
+	// registration order differs from the tracker's name list, the poses go through the handles
+	track_info frame;
+	const string names[3] = { "probe", "rs_cam", "marker" };
+	int handles[3];
+	frame.rbs.Register("marker");
+	for (int i = 0; i < 3; i++) handles[i] = frame.rbs.Register(names[i]);
+	for (int i = 0; i < 3; i++)
+		frame.SetLFrmInfo(handles[i], i != 2, glm::translate(glm::fvec3((float)i, 0, 0)));
+	frame.num_mks = 2;
+	frame.mk_xyz[0] = glm::fvec3(1, 2, 3);
+	frame.mk_xyz[1] = glm::fvec3(4, 5, 6);
+	frame.mk_residue[1] = 0.5f;
+	frame.mk_cid[1].set(100);
+
+	glm::fmat4x4 mat;
+	KAR_CHECK(frame.GetLFrmInfo("rs_cam", mat) && mat[3][0] == 1.f);
+	KAR_CHECK(!frame.GetLFrmInfo("marker", mat) && mat[3][0] == 2.f);
+	KAR_CHECK(!frame.GetLFrmInfo("ss_head", mat));
+	KAR_CHECK(!frame.GetLFrmInfo(-1, mat) && !frame.GetLFrmInfo(MAX_TRK_RBS, mat));
+
+	std::vector<char> buf(frame.GetSerialSize());
+	frame.WriteSerialBuffer(&buf[0]);
+	track_info read;
+	KAR_CHECK(read.SetFromSerialBuffer(&buf[0], buf.size()));
+	KAR_CHECK(read.num_mks == 2 && read.mk_xyz[1] == glm::fvec3(4, 5, 6) && read.mk_residue[1] == 0.5f && read.mk_cid[1].test(100));
+	for (int i = 0; i < 3; i++)
+	{
+		bool is_detected = read.GetLFrmInfo(names[i], mat);
+		KAR_CHECK(is_detected == (i != 2) && mat[3][0] == (float)i);
+	}
+}
+
+// the serial buffer starts with the magic and the version, the buffers of the former layouts are still read
+// and a buffer of a newer version or a truncated one is rejected without touching the frame
+KAR_TEST(track_info_serial_versions)
+{
+	track_info frame;
+	frame.rbs.Register("probe");
+	frame.rbs.Register("rs_cam");
+	frame.SetLFrmInfo(0, true, glm::translate(glm::fvec3(7, 0, 0)));
+	frame.SetLFrmInfo(1, false, glm::translate(glm::fvec3(8, 0, 0)));
+	frame.num_mks = 3;
+	for (int i = 0; i < 3; i++)
+	{
+		frame.mk_xyz[i] = glm::fvec3((float)i, (float)i + 0.25f, (float)i + 0.5f);
+		frame.mk_residue[i] = 0.1f * i;
+		frame.mk_cid[i].set(10 + i);
+	}
+	std::vector<char> buf(frame.GetSerialSize());
+	frame.WriteSerialBuffer(&buf[0]);
+	KAR_CHECK(*(int*)&buf[0] == TRK_SERIAL_MAGIC && *(int*)&buf[4] == TRK_SERIAL_VERSION);
+
+	auto same_as_frame = [&](const track_info& read, const int num_xyz_checked)
+	{
+		bool same = read.num_mks == frame.num_mks && read.rbs.num_rbs == 2;
+		for (int i = 0; i < num_xyz_checked && same; i++)
+			same = read.mk_xyz[i] == frame.mk_xyz[i] && read.mk_residue[i] == frame.mk_residue[i] && read.mk_cid[i] == frame.mk_cid[i];
+		glm::fmat4x4 mat;
+		same = same && read.GetLFrmInfo("probe", mat) && mat[3][0] == 7.f;
+		same = same && !read.GetLFrmInfo("rs_cam", mat) && mat[3][0] == 8.f;
+		return same;
+	};
+
+	// frames recorded before the header : the same layout from num_mks on
+	{
+		track_info read;
+		KAR_CHECK(read.SetFromSerialBuffer(&buf[8], buf.size() - 8));
+		KAR_CHECK(same_as_frame(read, 3));
+	}
+
+	// former trkdata.bin record : first int 3 x num_mks, xyz then residue and cid lists of that length
+	{
+		const int n = frame.num_mks * 3;
+		std::vector<char> old_buf(8 + (sizeof(float) * 2 + 16) * n + TRK_SERIAL_RB_UNIT * 2, 0);
+		*(int*)&old_buf[0] = n;
+		*(int*)&old_buf[4] = 2;
+		memcpy(&old_buf[8], frame.mk_xyz, sizeof(float) * n);
+		memcpy(&old_buf[8 + sizeof(float) * n], frame.mk_residue, sizeof(float) * frame.num_mks);
+		memcpy(&old_buf[8 + sizeof(float) * n * 2], frame.mk_cid, 16 * frame.num_mks);
+		const size_t offset = 8 + (sizeof(float) * 2 + 16) * n;
+		for (int i = 0; i < 2; i++)
+			memcpy(&old_buf[offset + TRK_SERIAL_RB_UNIT * i], &buf[TRK_SERIAL_HEADER_SIZE + TRK_SERIAL_MK_UNIT * 3 + TRK_SERIAL_RB_UNIT * i], TRK_SERIAL_RB_UNIT);
+		track_info read;
+		KAR_CHECK(read.SetFromSerialBuffer(&old_buf[0], old_buf.size()));
+		KAR_CHECK(same_as_frame(read, 3));
+	}
+
+	// rejected : newer version, truncated, not a track buffer
+	track_info read;
+	read.num_mks = 5;
+	std::vector<char> newer = buf;
+	*(int*)&newer[4] = TRK_SERIAL_VERSION + 1;
+	KAR_CHECK(!read.SetFromSerialBuffer(&newer[0], newer.size()));
+	KAR_CHECK(!read.SetFromSerialBuffer(&buf[0], buf.size() - 1));
+	KAR_CHECK(!read.SetFromSerialBuffer(&buf[0], 4));
+	std::vector<char> junk(100, 0x7f);
+	KAR_CHECK(!read.SetFromSerialBuffer(&junk[0], junk.size()));
+	KAR_CHECK(read.num_mks == 5 && read.rbs.num_rbs == 0);
+}
+
+// the track frame before the registry : string-keyed map and heap marker lists
+struct legacy_track_info
+{
+	map<string, pair<bool, glm::fmat4x4>> map_lfrm2ws;
+	std::vector<float> mk_xyz_list;
+	std::vector<float> mk_residue_list;
+	std::vector<std::bitset<128>> mk_cid_list;
+	bool is_updated;
+
+	bool GetLFrmInfo(const string& name, glm::fmat4x4& mat_lfrm2ws) const
+	{
+		bool is_detected = false;
+		auto it = map_lfrm2ws.find(name);
+		if (it != map_lfrm2ws.end())
+		{
+			is_detected = get<0>(it->second);
+			mat_lfrm2ws = get<1>(it->second);
+		}
+		return is_detected;
+	}
+};
+
+// per-frame cost of the copies (tracker -> queue / ring slot -> render thread -> g_info -> record) and of 30 pose lookups,
+// 5 rigid bodies and 40 markers
+KAR_BENCH(track_info_copy_and_lookup)
+{
+	const int num_frames = 20000;
+	const string names[5] = { "rs_cam", "probe", "ss_tool_v1", "ss_head", "marker" };
+	const int num_mks = 40;
+
+	legacy_track_info legacy;
+	track_info flat;
+	for (int i = 0; i < 5; i++)
+	{
+		legacy.map_lfrm2ws[names[i]] = pair<bool, glm::fmat4x4>(true, glm::translate(glm::fvec3((float)i)));
+		flat.SetLFrmInfo(names[i], true, glm::translate(glm::fvec3((float)i)));
+	}
+	legacy.mk_xyz_list.assign(num_mks * 3, 1.f);
+	legacy.mk_residue_list.assign(num_mks, 0.1f);
+	legacy.mk_cid_list.assign(num_mks, std::bitset<128>(7));
+	flat.num_mks = num_mks;
+	const int rs_cam = flat.GetHandle("rs_cam");
+
+	volatile float sink = 0;
+	// queue push (copy construction), pop into the render thread's frame, g_info, the record copy
+	legacy_track_info legacy_popped, legacy_ginfo;
+	double t_legacy_copy = kar_test::TimeMs([&]()
+	{
+		for (int f = 0; f < num_frames; f++)
+		{
+			legacy.is_updated = (f & 1) != 0;
+			legacy_track_info queued(legacy);
+			legacy_popped = queued;
+			legacy_ginfo = legacy_popped;
+			legacy_track_info recorded(legacy_ginfo);
+			sink = sink + recorded.mk_xyz_list[0];
+		}
+	});
+	static track_info flat_copies_slot, flat_popped, flat_ginfo, flat_recorded;
+	double t_flat_copy = kar_test::TimeMs([&]()
+	{
+		for (int f = 0; f < num_frames; f++)
+		{
+			flat.is_updated = (f & 1) != 0;
+			track_info* queued = &flat_copies_slot;
+			*queued = flat;
+			flat_popped = *queued;
+			flat_ginfo = flat_popped;
+			flat_recorded = flat_ginfo;
+			sink = sink + flat_recorded.mk_xyz[0].x;
+		}
+	});
+
+	glm::fmat4x4 mat;
+	double t_legacy_lookup = kar_test::TimeMs([&]()
+	{
+		for (int f = 0; f < num_frames; f++)
+			for (int l = 0; l < 30; l++)
+			{
+				legacy.GetLFrmInfo("rs_cam", mat);
+				sink = sink + mat[3][0];
+			}
+	});
+	double t_flat_name_lookup = kar_test::TimeMs([&]()
+	{
+		for (int f = 0; f < num_frames; f++)
+			for (int l = 0; l < 30; l++)
+			{
+				flat.GetLFrmInfo("rs_cam", mat);
+				sink = sink + mat[3][0];
+			}
+	});
+	double t_flat_handle_lookup = kar_test::TimeMs([&]()
+	{
+		for (int f = 0; f < num_frames; f++)
+			for (int l = 0; l < 30; l++)
+			{
+				flat.GetLFrmInfo(rs_cam, mat);
+				sink = sink + mat[3][0];
+			}
+	});
+
+	const double to_us = 1000.0 / num_frames;
+	printf("  copies / frame  : map-based %.2f us, flat %.2f us (%d bytes)\n", t_legacy_copy * to_us, t_flat_copy * to_us, (int)sizeof(track_info));
+	printf("  lookups / frame : map-based %.2f us, flat by name %.2f us, flat by handle %.2f us\n", t_legacy_lookup * to_us, t_flat_name_lookup * to_us, t_flat_handle_lookup * to_us);
+	KAR_CHECK(flat_recorded.GetLFrmInfo(rs_cam, mat) && mat[3][0] == 0.f);
+}
+
+// pose_history / clock_offset_estimator ///////////////////////////////////////////////////////
+
+namespace
+{
+	// one rigid body "probe" at pos, rotated by angle_deg around z, sampled at t
+	track_info PoseSample(const double t, const glm::fvec3& pos, const float angle_deg, const bool is_detected = true)
+	{
+		track_info frame;
+		frame.rbs.Register("probe");
+		frame.time_stamp = t;
+		frame.SetLFrmInfo(0, is_detected, glm::translate(pos) * glm::rotate(glm::radians(angle_deg), glm::fvec3(0, 0, 1)));
+		return frame;
+	}
+
+	float AngleZDeg(const glm::fmat4x4& mat)
+	{
+		return glm::degrees(atan2(mat[0][1], mat[0][0]));
+	}
+
+	bool Near(const float a, const float b, const float eps = 1e-3f) { return fabs(a - b) < eps; }
+}
+
+// lerp of the position and SLERP of the rotation between the bracketing samples
+KAR_TEST(pose_history_interpolation)
+{
+	pose_history history;
+	history.Push(PoseSample(100, glm::fvec3(0, 0, 0), 0));
+	history.Push(PoseSample(110, glm::fvec3(10, 0, 0), 40));
+	history.Push(PoseSample(120, glm::fvec3(20, 10, 0), 80));
+
+	glm::fmat4x4 mat;
+	KAR_CHECK(history.Query(0, 105, mat));
+	KAR_CHECK(Near(mat[3][0], 5) && Near(mat[3][1], 0) && Near(AngleZDeg(mat), 20));
+	KAR_CHECK(history.Query(0, 117.5, mat));
+	KAR_CHECK(Near(mat[3][0], 17.5f) && Near(mat[3][1], 7.5f) && Near(AngleZDeg(mat), 70));
+	// on a sample
+	KAR_CHECK(history.Query(0, 110, mat) && Near(mat[3][0], 10) && Near(AngleZDeg(mat), 40));
+
+	// the rotation stays a rotation (SLERP, not a matrix lerp)
+	KAR_CHECK(history.Query(0, 114, mat));
+	KAR_CHECK(Near(glm::length(glm::fvec3(mat[0])), 1) && Near(glm::dot(glm::fvec3(mat[0]), glm::fvec3(mat[1])), 0));
+
+	// the shorter arc across +-180 deg
+	pose_history wrap;
+	wrap.Push(PoseSample(10, glm::fvec3(0), 170));
+	wrap.Push(PoseSample(20, glm::fvec3(0), -170));
+	KAR_CHECK(wrap.Query(0, 15, mat) && Near(fabs(AngleZDeg(mat)), 180, 1e-2f));
+}
+
+// constant velocity past the newest sample, held after max_extrapolation_ms
+KAR_TEST(pose_history_extrapolation)
+{
+	pose_history history;
+	history.Push(PoseSample(100, glm::fvec3(0, 0, 0), 0));
+	history.Push(PoseSample(110, glm::fvec3(10, 0, 0), 10));
+
+	glm::fmat4x4 mat;
+	KAR_CHECK(history.Query(0, 115, mat));
+	KAR_CHECK(Near(mat[3][0], 15) && Near(AngleZDeg(mat), 15));
+	KAR_CHECK(history.Query(0, 110 + history.max_extrapolation_ms, mat));
+	const float x_max = 10 + (float)history.max_extrapolation_ms;
+	KAR_CHECK(Near(mat[3][0], x_max));
+	KAR_CHECK(history.Query(0, 500, mat) && Near(mat[3][0], x_max)); // capped
+
+	// no velocity across a gap, nor from a single sample
+	pose_history gap;
+	gap.Push(PoseSample(10, glm::fvec3(0), 0));
+	gap.Push(PoseSample(gap.max_gap_ms + 20, glm::fvec3(10, 0, 0), 0));
+	KAR_CHECK(gap.Query(0, gap.max_gap_ms + 25, mat) && Near(mat[3][0], 10));
+	pose_history single;
+	single.Push(PoseSample(10, glm::fvec3(3, 0, 0), 0));
+	KAR_CHECK(single.Query(0, 20, mat) && Near(mat[3][0], 3));
+}
+
+// the edges of the history : older than the oldest kept sample, undetected samples, gaps, wrap of the ring, invalid handles
+KAR_TEST(pose_history_edges)
+{
+	pose_history history;
+	glm::fmat4x4 mat;
+	KAR_CHECK(!history.Query(0, 0, mat)); // empty
+
+	const int num = POSE_HISTORY_SIZE + 10;
+	for (int i = 0; i < num; i++)
+		history.Push(PoseSample(10.0 + i * 10.0, glm::fvec3((float)i, 0, 0), 0));
+	KAR_CHECK(history.num_samples[0] == POSE_HISTORY_SIZE);
+	// the oldest kept sample is num - POSE_HISTORY_SIZE, older queries get it
+	KAR_CHECK(history.Query(0, 0, mat) && Near(mat[3][0], (float)(num - POSE_HISTORY_SIZE)));
+	KAR_CHECK(history.Query(0, 10.0 + (num - 1.5) * 10.0, mat) && Near(mat[3][0], num - 1.5f));
+
+	// out of order and unstamped samples are ignored
+	history.Push(PoseSample(5, glm::fvec3(-1, 0, 0), 0));
+	history.Push(PoseSample(0, glm::fvec3(-1, 0, 0), 0));
+	KAR_CHECK(history.Query(0, 10.0 + (num - 1) * 10.0, mat) && Near(mat[3][0], (float)(num - 1)));
+
+	KAR_CHECK(!history.Query(-1, 0, mat) && !history.Query(1, 0, mat));
+
+	// undetected : no blending with it, the nearest sample decides
+	pose_history lost;
+	lost.Push(PoseSample(10, glm::fvec3(0), 0));
+	lost.Push(PoseSample(20, glm::fvec3(10, 0, 0), 0, false));
+	KAR_CHECK(lost.Query(0, 12, mat) && Near(mat[3][0], 0));
+	KAR_CHECK(!lost.Query(0, 18, mat));
+	KAR_CHECK(!lost.Query(0, 22, mat)); // newest undetected
+
+	// samples farther apart than max_gap_ms are not blended
+	pose_history gap;
+	gap.Push(PoseSample(10, glm::fvec3(0), 0));
+	gap.Push(PoseSample(110, glm::fvec3(10, 0, 0), 0));
+	KAR_CHECK(gap.Query(0, 40, mat) && Near(mat[3][0], 0));
+	KAR_CHECK(gap.Query(0, 80, mat) && Near(mat[3][0], 10));
+
+	// a frame with another rigid body layout restarts the history
+	track_info other = PoseSample(1000, glm::fvec3(5, 0, 0), 0);
+	other.rbs = rb_registry();
+	other.rbs.Register("rs_cam");
+	other.rbs.Register("probe");
+	other.SetLFrmInfo(1, true, glm::translate(glm::fvec3(5, 0, 0)));
+	history.Push(other);
+	KAR_CHECK(history.num_samples[0] == 1 && history.Query(1, 0, mat) && Near(mat[3][0], 5));
+}
+
+// a device clock with an offset, a 50 ppm drift and a random transport latency >= 2 ms : the mapped capture times stay within
+// a few ms of the true ones, and a clock jump restarts the estimate
+KAR_TEST(clock_offset_estimator_device_clock)
+{
+	clock_offset_estimator clock;
+	kar_test::lcg rng(7);
+	const double t_offset = 123456.0;
+	double max_err = 0, max_err_late = 0;
+	for (int i = 0; i < 30 * 60; i++) // 60 s at 30 fps
+	{
+		const double t_capture = 1000.0 + i * 33.3;
+		const double t_device = (t_capture - t_offset) * (1.0 + 50e-6);
+		const double t_arrival = t_capture + 2.0 + rng.Uniform(0, 1) * rng.Uniform(0, 20);
+		const double t_mapped = clock.Map(t_device, t_arrival);
+		KAR_CHECK(t_mapped <= t_arrival + 1e-6);
+		const double err = t_mapped - t_capture;
+		max_err = max(max_err, fabs(err));
+		if (i > 30) max_err_late = max(max_err_late, fabs(err));
+	}
+	printf("  capture time error : max %.2f ms, after 1 s %.2f ms\n", max_err, max_err_late);
+	KAR_CHECK(max_err_late < 2.0 + 1.0); // the smallest latency, plus the drift between the fastest frames
+
+	const double t_mapped = clock.Map(5.0, 200000.0); // device restarted
+	KAR_CHECK(t_mapped == 200000.0);
+	KAR_CHECK(Near((float)(clock.Map(38.3, 200033.3 + 2.0) - 200033.3), 0, 0.01f));
+}
+
+// captured points (vzmproc::GenerateSamplePoints) //////////////////////////////////////////////
+
+// the source point cloud lives in the depth camera space (os2ws) : a point picked in the world is sampled in that space,
+// and the sampled points object shows and hands it (ICP targets) at the same world position
+KAR_TEST(sampled_points_world_position)
+{
+	vzm::ObjStates pc_state;
+	const glm::fmat4x4 mat_pc2ws = glm::translate(glm::fvec3(0.3f, -0.2f, 1.1f)) * glm::rotate(glm::radians(35.f), glm::normalize(glm::fvec3(1, 2, 0.5f)));
+	__cm4__ pc_state.os2ws = mat_pc2ws;
+
+	// a depth-camera-space cloud, the pick is one of its points seen in the world
+	kar_test::lcg rng(3);
+	std::vector<glm::fvec3> pc_os(500);
+	for (glm::fvec3& p : pc_os) p = glm::fvec3(rng.Uniform(-0.2f, 0.2f), rng.Uniform(-0.2f, 0.2f), rng.Uniform(0.4f, 0.8f));
+	const glm::fvec3 src_os = pc_os[17];
+	const glm::fvec3 pick_ws = tr_pt(mat_pc2ws, src_os);
+
+	vzm::ObjStates sampled_state;
+	const glm::fvec3 pick_os = SetSampledPointsFrame(pc_state, pick_ws, sampled_state);
+	KAR_CHECK(glm::length(pick_os - src_os) < 1e-5f);
+
+	// GenerateSamplePoints : the source points within r of the pick, copied in the source object space
+	std::vector<glm::fvec3> samples;
+	for (const glm::fvec3& p : pc_os) if (glm::length(p - pick_os) < 0.05f) samples.push_back(p);
+	KAR_CHECK(!samples.empty());
+	float max_err = 0;
+	for (const glm::fvec3& p : samples)
+		max_err = max(max_err, glm::length(tr_pt(__cm4__ sampled_state.os2ws, p) - tr_pt(mat_pc2ws, p)));
+	KAR_CHECK(max_err < 1e-6f);
+	KAR_CHECK(glm::length(tr_pt(__cm4__ sampled_state.os2ws, src_os) - pick_ws) < 1e-5f);
+	// with the identity os2ws of a default state, the samples would be off by the camera pose
+	KAR_CHECK(glm::length(src_os - pick_ws) > 0.1f);
+}
+
+// marker_vis_pool ////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+	// nearest pick sphere along the ray, every marker tested (the reference of the grid walk), t_hit : entry distance (0 inside)
+	int PickBruteForce(const marker_vis_pool& pool, const glm::fvec3& origin, const glm::fvec3& dir, const float pick_radius, float& t_hit)
+	{
+		int best_mk = -1;
+		t_hit = FLT_MAX;
+		const float r2 = pick_radius * pick_radius;
+		for (int i = 0; i < pool.num_mks; i++)
+		{
+			const glm::fvec3 oc = pool.pos[i] - origin;
+			const float tc = glm::dot(oc, dir);
+			const float d2 = glm::dot(oc, oc) - tc * tc;
+			if (d2 > r2 || tc + sqrt(r2 - d2) < 0) continue;
+			const float t = max(tc - sqrt(r2 - d2), 0.f);
+			if (t < t_hit)
+			{
+				t_hit = t;
+				best_mk = i;
+			}
+		}
+		return best_mk;
+	}
+
+	// num_mks markers in clusters (tools of 4 markers a few cm apart) spread over a 1 m box
+	void RandomMarkers(kar_test::lcg& rng, const int num_mks, track_info& frame)
+	{
+		frame.num_mks = num_mks;
+		glm::fvec3 center(0);
+		for (int i = 0; i < num_mks; i++)
+		{
+			if (i % 4 == 0) center = glm::fvec3(rng.Uniform(-0.5f, 0.5f), rng.Uniform(-0.5f, 0.5f), rng.Uniform(1.f, 2.f));
+			frame.mk_xyz[i] = center + glm::fvec3(rng.Uniform(-0.05f, 0.05f), rng.Uniform(-0.05f, 0.05f), rng.Uniform(-0.05f, 0.05f));
+			frame.mk_cid[i] = 0;
+			frame.mk_cid[i].set(i);
+		}
+	}
+}
+
+// the grid walk of PickRay against every marker : rays aimed at markers (hits, overlapping spheres), random rays (mostly misses),
+// axis-aligned rays and origins inside a pick sphere, over marker sets from 1 to MAX_TRK_MKS markers
+KAR_TEST(marker_vis_pick_ray_vs_brute_force)
+{
+	kar_test::lcg rng(5);
+	const float pick_radius = 0.015f * 1.5f;
+	int num_rays = 0, num_hits = 0, num_mismatch = 0;
+	for (const int num_mks : { 1, 3, 8, 40, MAX_TRK_MKS })
+	{
+		for (int set = 0; set < 20; set++)
+		{
+			track_info frame;
+			RandomMarkers(rng, num_mks, frame);
+			marker_vis_pool pool(0.015f);
+			pool.Update(frame);
+
+			for (int r = 0; r < 200; r++)
+			{
+				glm::fvec3 origin(rng.Uniform(-1.f, 1.f), rng.Uniform(-1.f, 1.f), rng.Uniform(-0.5f, 0.5f)), target;
+				const int kind = r % 4;
+				if (kind == 0 || kind == 1) // at a marker, off by up to 2 pick radii
+				{
+					target = pool.pos[rng.Next() % num_mks] + glm::fvec3(rng.Uniform(-1.f, 1.f), rng.Uniform(-1.f, 1.f), rng.Uniform(-1.f, 1.f)) * pick_radius * 2.f;
+				}
+				else if (kind == 2) // random
+				{
+					target = glm::fvec3(rng.Uniform(-1.f, 1.f), rng.Uniform(-1.f, 1.f), rng.Uniform(0.5f, 2.5f));
+				}
+				else // axis-aligned through a marker, or from inside its pick sphere
+				{
+					const int mk = rng.Next() % num_mks, axis = rng.Next() % 3;
+					origin = pool.pos[mk];
+					if (r % 8 == 3) origin[axis] -= 1.f;
+					else origin += glm::fvec3(rng.Uniform(-0.5f, 0.5f)) * pick_radius;
+					target = origin;
+					target[axis] += 1.f;
+				}
+				const glm::fvec3 dir = glm::normalize(target - origin);
+				float t_ref;
+				const int mk_ref = PickBruteForce(pool, origin, dir, pick_radius, t_ref);
+				const int mk = pool.PickRay(origin, dir, pick_radius);
+				// the same marker, or one entered at the same distance (two spheres around the origin)
+				float t_mk = -1;
+				if (mk >= 0)
+				{
+					const glm::fvec3 oc = pool.pos[mk] - origin;
+					const float tc = glm::dot(oc, dir), d2 = glm::dot(oc, oc) - tc * tc;
+					t_mk = max(tc - sqrt(max(pick_radius * pick_radius - d2, 0.f)), 0.f);
+				}
+				const bool same = mk == mk_ref || (mk >= 0 && mk_ref >= 0 && fabs(t_mk - t_ref) < 1e-6f);
+				if (!same && num_mismatch++ < 5)
+					printf("  %d markers : grid %d (t %f), brute force %d (t %f)\n", num_mks, mk, t_mk, mk_ref, t_ref);
+				num_rays++;
+				num_hits += mk_ref >= 0;
+			}
+		}
+	}
+	printf("  %d rays, %d hits, %d mismatches\n", num_rays, num_hits, num_mismatch);
+	KAR_CHECK(num_mismatch == 0);
+	KAR_CHECK(num_hits > num_rays / 3 && num_hits < num_rays);
+}
+
+// the pool keeps the instance of a marker until it moves more than move_threshold, the pick index follows the moves
+KAR_TEST(marker_vis_update_moved_instances)
+{
+	kar_test::lcg rng(9);
+	track_info frame;
+	RandomMarkers(rng, 12, frame);
+	marker_vis_pool pool(0.015f);
+	KAR_CHECK(pool.Update(frame) == MKVIS_SET_CHANGED);
+	int num_moved = 0;
+	for (int i = 0; i < pool.num_mks; i++) num_moved += pool.is_moved[i];
+	KAR_CHECK(pool.num_mks == 12 && num_moved == 12);
+	for (int i = 0; i < pool.num_mks; i++) pool.is_moved[i] = false; // as after Show
+
+	// jitter below the threshold : nothing to move
+	track_info jittered = frame;
+	for (int i = 0; i < jittered.num_mks; i++) jittered.mk_xyz[i] += glm::fvec3(pool.move_threshold * 0.5f, 0, 0);
+	KAR_CHECK(pool.Update(jittered) == 0);
+
+	// two markers moved : only their instances
+	track_info moved = frame;
+	moved.mk_xyz[3] += glm::fvec3(0, 0.01f, 0);
+	moved.mk_xyz[7] += glm::fvec3(0.2f, 0, 0);
+	KAR_CHECK(pool.Update(moved) == MKVIS_MOVED);
+	num_moved = 0;
+	for (int i = 0; i < pool.num_mks; i++) num_moved += pool.is_moved[i];
+	KAR_CHECK(num_moved == 2 && pool.is_moved[3] && pool.is_moved[7]);
+	KAR_CHECK(pool.pos[7] == moved.mk_xyz[7] && pool.pos[0] == frame.mk_xyz[0]);
+
+	// the pick index is rebuilt for the moved marker
+	const glm::fvec3 dir(0, 0, 1);
+	KAR_CHECK(pool.PickRay(moved.mk_xyz[7] - glm::fvec3(0, 0, 1), dir, 0.0225f) == 7);
+
+	// another cid or count : a new set
+	moved.mk_cid[5].set(100);
+	KAR_CHECK(pool.Update(moved) == MKVIS_SET_CHANGED);
+	moved.num_mks = 10;
+	KAR_CHECK(pool.Update(moved) == MKVIS_SET_CHANGED && pool.num_mks == 10);
+	pool.Clear();
+	KAR_CHECK(pool.num_mks == 0 && pool.PickRay(glm::fvec3(0), dir, 0.0225f) == -1);
+}
+
+// primitive_cache ////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+	// the engine builds of a primitive_cache : a new id for obj_id 0, the builds counted per type
+	struct mock_builder
+	{
+		int next_id;
+		int builds[primitive_cache::PRIM_TEXT + 1];
+		mock_builder() { next_id = 100; memset(builds, 0, sizeof(builds)); }
+		primitive_cache::builder Func()
+		{
+			return [this](const primitive_cache::prim_type type, int& obj_id)
+			{
+				if (obj_id == 0) obj_id = next_id++;
+				builds[type]++;
+			};
+		}
+		int Total() const { int n = 0; for (const int b : builds) n += b; return n; }
+	};
+}
+
+// a hit moves the object (os2ws) without a build, a changed shape misses, Clear invalidates every object
+KAR_TEST(primitive_cache_hits_and_misses)
+{
+	primitive_cache prims;
+	mock_builder mock;
+	prims.SetBuilder(mock.Func());
+	const glm::fvec3 red(1, 0, 0), green(0, 1, 0);
+
+	// first request : a build and a new id
+	int cyl_id = 0;
+	glm::fmat4x4 mat = prims.Cylinder(glm::fvec3(0), glm::fvec3(0, 0, 0.1f), 0.002f, &red, cyl_id);
+	KAR_CHECK(cyl_id == 100 && mock.builds[primitive_cache::PRIM_CYLINDER] == 1);
+	KAR_CHECK(glm::length(tr_pt(mat, glm::fvec3(0, 0, 1)) - glm::fvec3(0, 0, 0.1f)) < 1e-6f);
+
+	// moved, the same shape : hits, the unit cylinder is stretched onto the new ends
+	for (int f = 1; f <= 20; f++)
+	{
+		const glm::fvec3 p0(0.01f * f, 0, 0), p1(0.01f * f, 0.2f, 0.05f);
+		mat = prims.Cylinder(p0, p1, 0.002f, &red, cyl_id);
+		KAR_CHECK(glm::length(tr_pt(mat, glm::fvec3(0)) - p0) < 1e-6f && glm::length(tr_pt(mat, glm::fvec3(0, 0, 1)) - p1) < 1e-6f);
+	}
+	KAR_CHECK(cyl_id == 100 && mock.Total() == 1);
+	KAR_CHECK(prims.GetOs2Ws(cyl_id) == mat);
+
+	// misses : the color, the radius, no color (the state color), another type on the same id
+	prims.Cylinder(glm::fvec3(0), glm::fvec3(1), 0.002f, &green, cyl_id);
+	prims.Cylinder(glm::fvec3(0), glm::fvec3(1), 0.003f, &green, cyl_id);
+	prims.Cylinder(glm::fvec3(0), glm::fvec3(1), 0.003f, NULL, cyl_id);
+	prims.Cylinder(glm::fvec3(0), glm::fvec3(1), 0.003f, NULL, cyl_id);
+	KAR_CHECK(mock.builds[primitive_cache::PRIM_CYLINDER] == 4 && cyl_id == 100);
+	prims.Sphere(glm::fvec3(0.1f), 0.003f, NULL, cyl_id);
+	KAR_CHECK(mock.builds[primitive_cache::PRIM_SPHERE] == 1 && cyl_id == 100);
+
+	// arrow : stretched while the length stays within 5%, rebuilt past it
+	int arrow_id = 0;
+	prims.Arrow(glm::fvec3(0), glm::fvec3(0, 0, 0.1f), 0.001f, 0.003f, arrow_id);
+	mat = prims.Arrow(glm::fvec3(0), glm::fvec3(0, 0.104f, 0), 0.001f, 0.003f, arrow_id);
+	KAR_CHECK(mock.builds[primitive_cache::PRIM_ARROW] == 1);
+	KAR_CHECK(glm::length(tr_pt(mat, glm::fvec3(0, 0, 0.1f)) - glm::fvec3(0, 0.104f, 0)) < 1e-6f);
+	prims.Arrow(glm::fvec3(0), glm::fvec3(0, 0.11f, 0), 0.001f, 0.003f, arrow_id);
+	KAR_CHECK(mock.builds[primitive_cache::PRIM_ARROW] == 2);
+
+	// angle fan : quantized to 0.5 deg
+	int fan_id = 0;
+	prims.AngleFan(glm::fvec3(0), glm::fvec3(1, 0, 0), glm::fvec3(0, 0, 1), 30.1f, 0.05f, fan_id);
+	prims.AngleFan(glm::fvec3(0.2f), glm::fvec3(0, 1, 0), glm::fvec3(0, 0, 1), 29.9f, 0.05f, fan_id);
+	KAR_CHECK(mock.builds[primitive_cache::PRIM_FAN] == 1);
+	prims.AngleFan(glm::fvec3(0.2f), glm::fvec3(0, 1, 0), glm::fvec3(0, 0, 1), 30.4f, 0.05f, fan_id);
+	KAR_CHECK(mock.builds[primitive_cache::PRIM_FAN] == 2);
+
+	// text : rebuilt when the displayed value changes only
+	int text_id = 0;
+	const glm::fvec3 view(0, 0, -1), up(0, 1, 0);
+	prims.Text(glm::fvec3(0), view, up, "12.5 mm", 0.03f, text_id);
+	mat = prims.Text(glm::fvec3(0.1f, 0, 0), view, glm::fvec3(0, 1, 0.3f), "12.5 mm", 0.03f, text_id);
+	KAR_CHECK(mock.builds[primitive_cache::PRIM_TEXT] == 1);
+	KAR_CHECK(glm::length(tr_pt(mat, glm::fvec3(0, 1, 0)) - glm::fvec3(0.1f, 1, 0)) < 1e-6f);
+	prims.Text(glm::fvec3(0), view, up, "12.6 mm", 0.03f, text_id);
+	prims.Text(glm::fvec3(0), view, up, "12.6 mm", 0.04f, text_id);
+	KAR_CHECK(mock.builds[primitive_cache::PRIM_TEXT] == 3);
+
+	// axis and line hits
+	int axis_id = 0, line_id = 0;
+	for (int f = 0; f < 5; f++)
+	{
+		prims.Axis(glm::translate(glm::fvec3(0.01f * f)), 0.05f, axis_id);
+		prims.Line(glm::fvec3(0), glm::fvec3(0.01f * f + 0.1f), &red, line_id);
+	}
+	KAR_CHECK(mock.builds[primitive_cache::PRIM_AXIS] == 1 && mock.builds[primitive_cache::PRIM_LINE] == 1);
+
+	// Clear (the scenes are gone) : every object is built again, on its id
+	const int num_builds = mock.Total();
+	prims.Clear();
+	KAR_CHECK(prims.GetOs2Ws(axis_id) == glm::fmat4x4(1.f));
+	prims.Axis(glm::fmat4x4(1.f), 0.05f, axis_id);
+	prims.Line(glm::fvec3(0), glm::fvec3(1), &red, line_id);
+	KAR_CHECK(mock.Total() == num_builds + 2 && axis_id != 0 && line_id != 0);
+
+	// the counters : one request per call, the builds of the mock
+	prims.num_frames = 10;
+	double requests_per_frame, builds_per_frame;
+	prims.GetStats(requests_per_frame, builds_per_frame, true);
+	KAR_CHECK(builds_per_frame == mock.Total() / 10.0 && requests_per_frame > builds_per_frame);
+	prims.GetStats(requests_per_frame, builds_per_frame, false);
+	KAR_CHECK(requests_per_frame == 0 && builds_per_frame == 0);
+}
+
+// a navigation sequence (the probe and its guides follow the tool, the distance and angle annotations change with it) :
+// the engine builds per frame with the cache against the requests (one build each without it), and the cache cost per request
+KAR_BENCH(primitive_cache_rebuilds)
+{
+	const int num_frames = 3000;
+	primitive_cache prims;
+	mock_builder mock;
+	prims.SetBuilder(mock.Func());
+	int probe_id = 0, tip_id = 0, line_id = 0, text_id = 0, arrow_id = 0, fan_id = 0, axis_id = 0, angle_text_id = 0;
+	const glm::fvec3 probe_rgb(0.2f, 0.8f, 1.f), line_rgb(1, 1, 0), pos_dst(0.05f, 0.02f, 0.5f);
+
+	auto frame = [&](const int f)
+	{
+		// the tool sweeps toward the target and back (4 s at 60 Hz), with a hand tremor
+		const float s = 0.5f + 0.5f * (float)sin(f * 2.0 * glm::pi<double>() / 240.0);
+		const glm::fvec3 tip = pos_dst + glm::fvec3(0.1f * s, 0.05f * s, 0.15f * s) + glm::fvec3(0.0003f * (float)sin(f * 1.7), 0.0003f * (float)cos(f * 2.3), 0);
+		const glm::fvec3 tool_dir = glm::normalize(glm::fvec3(0.2f * s, 0.1f, 1.f));
+		prims.Cylinder(tip, tip + tool_dir * 0.15f, 0.0015f, &probe_rgb, probe_id);
+		prims.Sphere(tip, 0.002f, &probe_rgb, tip_id);
+		prims.Axis(glm::translate(tip), 0.03f, axis_id);
+		// distance line and its text (0.1 mm display)
+		prims.Line(tip, pos_dst, &line_rgb, line_id);
+		char dist_text[32];
+		snprintf(dist_text, sizeof(dist_text), "%.1f mm", glm::length(tip - pos_dst) * 1000.f);
+		prims.Text(tip, glm::fvec3(0, 0, -1), glm::fvec3(0, 1, 0), dist_text, 0.02f, text_id);
+		// guide arrow to the target and the angle fan of the tool against the guide
+		prims.Arrow(tip, pos_dst, 0.0008f, 0.002f, arrow_id);
+		const glm::fvec3 guide_dir = glm::normalize(glm::fvec3(0, 0.1f, 1.f));
+		const float angle = glm::degrees(acos(min(glm::dot(tool_dir, guide_dir), 1.f)));
+		const glm::fvec3 axis = glm::length(glm::cross(guide_dir, tool_dir)) > 1e-6f ? glm::cross(guide_dir, tool_dir) : glm::fvec3(1, 0, 0);
+		prims.AngleFan(tip, guide_dir, axis, angle, 0.03f, fan_id);
+		char angle_text[32];
+		snprintf(angle_text, sizeof(angle_text), "%.1f deg", angle);
+		prims.Text(tip + glm::fvec3(0.02f, 0, 0), glm::fvec3(0, 0, -1), glm::fvec3(0, 1, 0), angle_text, 0.02f, angle_text_id);
+		prims.num_frames++;
+	};
+
+	const double t0 = kar_test::NowMs();
+	for (int f = 0; f < num_frames; f++) frame(f);
+	const double ms = kar_test::NowMs() - t0;
+	double requests_per_frame, builds_per_frame;
+	prims.GetStats(requests_per_frame, builds_per_frame, false);
+
+	const char* names[primitive_cache::PRIM_TEXT + 1] = { "cylinder", "sphere", "line", "arrow", "axis", "fan", "text" };
+	printf("  %d frames, %.0f primitives per frame\n", num_frames, requests_per_frame);
+	printf("  builds / frame : without the cache %.2f, with the cache %.3f (%.1f%%)\n", requests_per_frame, builds_per_frame,
+		100.0 * builds_per_frame / requests_per_frame);
+	for (int t = 0; t <= primitive_cache::PRIM_TEXT; t++) printf("    %-9s %6d builds\n", names[t], mock.builds[t]);
+	printf("  cache cost : %.3f us per request\n", ms * 1000.0 / prims.num_requests);
+	KAR_CHECK(prims.num_builds == mock.Total());
+	KAR_CHECK(builds_per_frame < 0.5 * requests_per_frame);
+	// the shapes that never change are built once
+	KAR_CHECK(mock.builds[primitive_cache::PRIM_CYLINDER] == 1 && mock.builds[primitive_cache::PRIM_SPHERE] == 1);
+	KAR_CHECK(mock.builds[primitive_cache::PRIM_AXIS] == 1 && mock.builds[primitive_cache::PRIM_LINE] == 1);
+}
@@ -0,0 +1,201 @@
+#include "test_util.h"
+#include "../ar_settings/Profiler.h"
+
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <thread>
+
+// frame profiler of ar_settings : the histogram percentiles against known durations, and the Chrome trace export
+// (valid JSON whatever the zone and thread names, one complete event per sample)
+
+using namespace kar_test;
+
+namespace
+{
+	long long NowNs()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// a sample of dur_ms ending now (the profiler clock is steady_clock)
+	void AddSample(const int zone_id, const double dur_ms)
+	{
+		profiler::EndZone(zone_id, NowNs() - (long long)(dur_ms * 1e6));
+	}
+
+	// JSON grammar check (RFC 8259 values), the position of the first error or -1
+	struct json_checker
+	{
+		const std::string& s;
+		size_t i;
+		json_checker(const std::string& _s) : s(_s) { i = 0; }
+
+		void Space() { while (i < s.size() && (s[i] == ' ' || s[i] == '\n' || s[i] == '\r' || s[i] == '\t')) i++; }
+		bool Literal(const char* lit) { const size_t n = strlen(lit); if (s.compare(i, n, lit) != 0) return false; i += n; return true; }
+		bool String()
+		{
+			if (s[i] != '"') return false;
+			for (i++; i < s.size(); i++)
+			{
+				const unsigned char c = s[i];
+				if (c == '"') { i++; return true; }
+				if (c < 0x20) return false;
+				if (c != '\\') continue;
+				if (++i >= s.size()) return false;
+				if (s[i] == 'u')
+				{
+					for (int k = 0; k < 4; k++) if (++i >= s.size() || !isxdigit((unsigned char)s[i])) return false;
+				}
+				else if (strchr("\"\\/bfnrt", s[i]) == NULL) return false;
+			}
+			return false;
+		}
+		bool Number()
+		{
+			const size_t i0 = i;
+			if (s[i] == '-') i++;
+			while (i < s.size() && (isdigit((unsigned char)s[i]) || strchr(".eE+-", s[i]))) i++;
+			return i > i0 && isdigit((unsigned char)s[i - 1]);
+		}
+		bool Value()
+		{
+			Space();
+			if (i >= s.size()) return false;
+			bool ok;
+			if (s[i] == '{' || s[i] == '[')
+			{
+				const char close = s[i] == '{' ? '}' : ']';
+				const bool is_object = s[i] == '{';
+				i++;
+				Space();
+				if (i < s.size() && s[i] == close) { i++; return true; }
+				for (;;)
+				{
+					if (is_object)
+					{
+						Space();
+						if (i >= s.size() || !String()) return false;
+						Space();
+						if (i >= s.size() || s[i++] != ':') return false;
+					}
+					if (!Value()) return false;
+					Space();
+					if (i >= s.size()) return false;
+					if (s[i] == close) { i++; return true; }
+					if (s[i++] != ',') return false;
+				}
+			}
+			else if (s[i] == '"') ok = String();
+			else if (s[i] == 't') ok = Literal("true");
+			else if (s[i] == 'f') ok = Literal("false");
+			else if (s[i] == 'n') ok = Literal("null");
+			else ok = Number();
+			return ok;
+		}
+		long long Check() { const bool ok = Value(); Space(); return ok && i == s.size() ? -1 : (long long)i; }
+	};
+
+	std::string ReadText(const std::string& path)
+	{
+		std::string text;
+		FILE* fp = fopen(path.c_str(), "rb");
+		if (fp == NULL) return text;
+		char buf[4096];
+		size_t n;
+		while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) text.append(buf, n);
+		fclose(fp);
+		return text;
+	}
+
+	int Count(const std::string& text, const std::string& pattern)
+	{
+		int n = 0;
+		for (size_t pos = text.find(pattern); pos != std::string::npos; pos = text.find(pattern, pos + pattern.size())) n++;
+		return n;
+	}
+}
+
+// 1..100 ms in 0.1 ms steps (shuffled) : the percentiles within the ~9% of a histogram bucket
+KAR_TEST(profiler_percentiles)
+{
+	const int zone_uniform = profiler::RegisterZone("test uniform"), zone_const = profiler::RegisterZone("test constant");
+	KAR_CHECK(profiler::RegisterZone("test uniform") == zone_uniform);
+	profiler::SetEnabled(false);
+	profiler::SetEnabled(true);
+	KAR_CHECK(profiler::IsEnabled());
+
+	std::vector<double> durs;
+	for (int k = 10; k <= 1000; k++) durs.push_back(k * 0.1);
+	lcg rng(3);
+	for (size_t k = durs.size() - 1; k > 0; k--) std::swap(durs[k], durs[rng.Next() % (k + 1)]);
+	for (const double d : durs)
+	{
+		AddSample(zone_uniform, d);
+		AddSample(zone_const, 2.0);
+	}
+
+	double stats[6];
+	KAR_CHECK(profiler::GetZoneStats(zone_uniform, stats));
+	printf("  uniform 1..100 ms : n %.0f, mean %.2f, p50 %.2f, p95 %.2f, p99 %.2f, max %.2f\n", stats[0], stats[1], stats[2], stats[3], stats[4], stats[5]);
+	KAR_CHECK(stats[0] == (double)durs.size());
+	KAR_CHECK(fabs(stats[1] - 50.5) < 0.1);
+	const double p[3] = { 0.5, 0.95, 0.99 };
+	for (int k = 0; k < 3; k++)
+	{
+		const double ref = Percentile(durs, p[k]);
+		KAR_CHECK(fabs(stats[2 + k] - ref) < 0.09 * ref);
+	}
+	KAR_CHECK(stats[5] >= 100.0 && stats[5] < 100.5);
+	KAR_CHECK(stats[2] <= stats[3] && stats[3] <= stats[4] && stats[4] <= stats[5]);
+
+	// one duration : every percentile is its bucket, clamped to the max
+	KAR_CHECK(profiler::GetZoneStats(zone_const, stats));
+	KAR_CHECK(fabs(stats[1] - 2.0) < 0.01 && fabs(stats[2] - 2.0) < 0.09 * 2.0 && stats[4] <= stats[5]);
+
+	// Report resets the histograms, a zone with no sample has no stats
+	profiler::Report();
+	KAR_CHECK(!profiler::GetZoneStats(zone_uniform, stats));
+	KAR_CHECK(!profiler::GetZoneStats(-1, stats) && !profiler::GetZoneStats(1 << 20, stats));
+	profiler::SetEnabled(false);
+	KAR_CHECK(profiler::BeginZone() == 0);
+}
+
+// names with quotes, backslashes and control characters : the trace is still valid JSON and keeps every sample
+KAR_TEST(profiler_chrome_trace_export)
+{
+	const int zone_plain = profiler::RegisterZone("test export"), zone_odd = profiler::RegisterZone("test \"quoted\" C:\\path\n\ttab\x01");
+	profiler::SetEnabled(true);
+	const int num_samples = 50;
+	std::thread worker([&]()
+	{
+		profiler::SetThreadName("worker \"1\"\\");
+		for (int k = 0; k < num_samples; k++) AddSample(zone_odd, 0.5);
+	});
+	worker.join();
+	for (int k = 0; k < num_samples; k++)
+	{
+		PROF_ZONE("test export");
+		AddSample(zone_plain, 0.25);
+	}
+
+	const std::string path = TempPath("kar_test_profile.json");
+	KAR_CHECK(profiler::ExportChromeTrace(path));
+	profiler::SetEnabled(false);
+	const std::string json = ReadText(path);
+	KAR_CHECK(!json.empty());
+	json_checker checker(json);
+	const long long err = checker.Check();
+	if (err >= 0) printf("  invalid JSON at %lld : %s\n", err, json.substr((size_t)err, 40).c_str());
+	KAR_CHECK(err < 0);
+
+	KAR_CHECK(Count(json, "\"name\":\"test \\\"quoted\\\" C:\\\\path\\n\\ttab\\u0001\"") == num_samples);
+	KAR_CHECK(Count(json, "\"name\":\"worker \\\"1\\\"\\\\\"") == 1);
+	// the samples of AddSample and the PROF_ZONE around them
+	KAR_CHECK(Count(json, "\"name\":\"test export\"") == num_samples * 2);
+	KAR_CHECK(Count(json, "\"ph\":\"X\"") == num_samples * 3);
+	remove(path.c_str());
+
+	// an unwritable path
+	KAR_CHECK(!profiler::ExportChromeTrace(TempPath("kar_test_missing_dir") + "/trace.json"));
+}
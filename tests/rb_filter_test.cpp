@@ -0,0 +1,170 @@
+#include "test_util.h"
+#include "../optitrk/rb_filter.h"
+
+#include <math.h>
+
+// rigid body pose filters of optitrk : a synthetic 240 Hz tracker stream (smooth motion plus measurement noise) replayed through
+// every filter with EvaluateRbFilter, the jitter has to drop below the raw stream and the lag has to match the filter
+
+using namespace kar_test;
+
+namespace
+{
+	struct pose_stream
+	{
+		std::vector<double> t;
+		std::vector<glm::fvec3> pos;
+		std::vector<glm::fquat> q;
+	};
+
+	// roughly gaussian noise of standard deviation sigma (sum of 4 uniforms)
+	float Noise(lcg& rng, const float sigma)
+	{
+		float s = 0;
+		for (int i = 0; i < 4; i++) s += rng.Uniform(-1.f, 1.f);
+		return s * sigma * 0.866f;
+	}
+
+	// circle of radius_m at freq_hz in xy, rotation about z swinging by amp_deg at the same frequency
+	pose_stream MakeStream(const int num_samples, const double rate_hz, const float radius_m, const float freq_hz, const float amp_deg,
+		const float noise_pos_m, const float noise_ang_deg, const unsigned int seed = 7)
+	{
+		pose_stream s;
+		lcg rng(seed);
+		for (int i = 0; i < num_samples; i++)
+		{
+			const double t = i / rate_hz;
+			const float w = (float)(2.0 * glm::pi<double>() * freq_hz * t);
+			glm::fvec3 pos(radius_m * cos(w), radius_m * sin(w), 0.5f);
+			pos += glm::fvec3(Noise(rng, noise_pos_m), Noise(rng, noise_pos_m), Noise(rng, noise_pos_m));
+			const float angle = glm::radians(amp_deg * sin(w) + Noise(rng, noise_ang_deg));
+			glm::fvec3 axis = glm::normalize(glm::fvec3(Noise(rng, 0.02f), Noise(rng, 0.02f), 1.f));
+			s.t.push_back(t);
+			s.pos.push_back(pos);
+			s.q.push_back(glm::angleAxis(angle, axis));
+		}
+		return s;
+	}
+
+	rb_filter_report Evaluate(const rb_filter_params& fparams, const pose_stream& s)
+	{
+		return EvaluateRbFilter(fparams, &s.t[0], &s.pos[0], &s.q[0], (int)s.t.size());
+	}
+
+	const char* filter_names[RB_FILTER_COUNT] = { "none", "box", "ema", "one euro", "kalman cv" };
+
+	// the configurations of the comparison, one per filter type
+	rb_filter_params FilterConfig(const int type)
+	{
+		switch (type)
+		{
+		case RB_FILTER_BOX: return rb_filter_params(RB_FILTER_BOX, 8);
+		case RB_FILTER_EMA: return rb_filter_params(RB_FILTER_EMA, 0.2f);
+		case RB_FILTER_ONE_EURO: return rb_filter_params(RB_FILTER_ONE_EURO, 1.f, 10.f, 1.f);
+		case RB_FILTER_KALMAN_CV: return rb_filter_params(RB_FILTER_KALMAN_CV, 5.f, 0.0003f, 20.f, 0.002f);
+		default: return rb_filter_params();
+		}
+	}
+}
+
+// 10 s at 240 Hz, 50 mm circle at 0.5 Hz, 0.3 mm / 0.1 deg noise
+KAR_TEST(rb_filter_jitter_and_lag)
+{
+	const double rate = 240.0, dt_ms = 1000.0 / rate;
+	const pose_stream s = MakeStream(2400, rate, 0.05f, 0.5f, 20.f, 0.0003f, 0.1f);
+
+	rb_filter_report rep[RB_FILTER_COUNT];
+	for (int type = 0; type < RB_FILTER_COUNT; type++)
+	{
+		rep[type] = Evaluate(FilterConfig(type), s);
+		printf("  %-10s jitter %.4f mm %.4f deg, lag %.0f ms, rms %.3f mm\n", filter_names[type],
+			rep[type].jitter_pos_mm, rep[type].jitter_ang_deg, rep[type].lag_ms, rep[type].rms_err_mm);
+	}
+
+	// raw : no lag
+	KAR_CHECK(rep[RB_FILTER_NONE].lag_ms == 0 && rep[RB_FILTER_NONE].rms_err_mm < 1e-3f);
+
+	for (int type = RB_FILTER_BOX; type < RB_FILTER_COUNT; type++)
+	{
+		KAR_CHECK(rep[type].jitter_pos_mm < rep[RB_FILTER_NONE].jitter_pos_mm * 0.5f);
+		KAR_CHECK(rep[type].jitter_ang_deg < rep[RB_FILTER_NONE].jitter_ang_deg * 0.5f);
+	}
+
+	// box of n samples : (n - 1) / 2 samples late, ema of alpha : (1 - alpha) / alpha samples late
+	KAR_CHECK(fabs(rep[RB_FILTER_BOX].lag_ms - 3.5 * dt_ms) <= 2.0);
+	KAR_CHECK(fabs(rep[RB_FILTER_EMA].lag_ms - 4.0 * dt_ms) <= 2.0);
+	// the constant velocity model follows the motion without lag
+	KAR_CHECK(rep[RB_FILTER_KALMAN_CV].lag_ms <= dt_ms);
+
+	// one euro : the cutoff rises with the speed, a faster motion lags less (the fixed filters lag the same)
+	const pose_stream fast = MakeStream(2400, rate, 0.1f, 2.f, 45.f, 0.0003f, 0.1f);
+	const rb_filter_report fast_one_euro = Evaluate(FilterConfig(RB_FILTER_ONE_EURO), fast);
+	const rb_filter_report fast_box = Evaluate(FilterConfig(RB_FILTER_BOX), fast);
+	printf("  fast motion : one euro lag %.0f ms, box lag %.0f ms\n", fast_one_euro.lag_ms, fast_box.lag_ms);
+	KAR_CHECK(fast_one_euro.lag_ms < rep[RB_FILTER_ONE_EURO].lag_ms * 0.5f);
+	KAR_CHECK(fabs(fast_box.lag_ms - rep[RB_FILTER_BOX].lag_ms) <= 2.0);
+}
+
+// a tracking loss longer than RB_FILTER_RESET_GAP restarts the filter on the first sample after it (no blend with the old pose)
+KAR_TEST(rb_filter_reset_after_loss)
+{
+	for (int type = RB_FILTER_EMA; type < RB_FILTER_COUNT; type++)
+	{
+		rb_pose_filter filter(FilterConfig(type));
+		glm::fvec3 pos;
+		glm::fquat q;
+		for (int i = 0; i < 100; i++)
+		{
+			pos = glm::fvec3(0, 0, 0);
+			q = glm::fquat(1, 0, 0, 0);
+			filter.Update(i / 240.0, pos, q);
+		}
+		pos = glm::fvec3(0.1f, 0, 0);
+		q = glm::angleAxis(glm::radians(30.f), glm::fvec3(0, 0, 1));
+		const glm::fvec3 pos_in = pos;
+		filter.Update(99 / 240.0 + 0.2, pos, q);
+		KAR_CHECK(pos == pos_in && fabs(glm::degrees(glm::angle(q)) - 30.f) < 1e-3f);
+
+		// and a short gap is filtered
+		pos = glm::fvec3(0.2f, 0, 0);
+		filter.Update(99 / 240.0 + 0.2 + 1 / 240.0, pos, q);
+		KAR_CHECK(pos.x < 0.2f);
+	}
+}
+
+// jitter / lag of every filter over slow and fast motions, and the cost of one update
+KAR_BENCH(rb_filter_evaluation)
+{
+	const double rate = 240.0;
+	struct motion { const char* name; float radius, freq, amp_deg; } motions[] = {
+		{ "hold (static)", 0.f, 0.5f, 0.f },
+		{ "slow (50 mm, 0.5 Hz)", 0.05f, 0.5f, 20.f },
+		{ "fast (100 mm, 2 Hz)", 0.1f, 2.f, 45.f },
+	};
+	printf("  %-22s %-10s %12s %12s %8s %10s\n", "motion", "filter", "jitter mm", "jitter deg", "lag ms", "rms mm");
+	for (const motion& m : motions)
+	{
+		const pose_stream s = MakeStream(2400, rate, m.radius, m.freq, m.amp_deg, 0.0003f, 0.1f);
+		for (int type = 0; type < RB_FILTER_COUNT; type++)
+		{
+			const rb_filter_report rep = Evaluate(FilterConfig(type), s);
+			printf("  %-22s %-10s %12.4f %12.4f %8.0f %10.3f\n", m.name, filter_names[type], rep.jitter_pos_mm, rep.jitter_ang_deg, rep.lag_ms, rep.rms_err_mm);
+		}
+	}
+
+	const pose_stream s = MakeStream(100000, rate, 0.05f, 0.5f, 20.f, 0.0003f, 0.1f);
+	for (int type = 0; type < RB_FILTER_COUNT; type++)
+	{
+		const double ms = TimeMs([&]()
+		{
+			rb_pose_filter filter(FilterConfig(type));
+			for (size_t i = 0; i < s.t.size(); i++)
+			{
+				glm::fvec3 pos = s.pos[i];
+				glm::fquat q = s.q[i];
+				filter.Update(s.t[i], pos, q);
+			}
+		});
+		printf("  %-10s %.1f ns / update\n", filter_names[type], ms * 1e6 / s.t.size());
+	}
+}
@@ -0,0 +1,266 @@
+#include "test_util.h"
+
+#include "../ar_settings/Recorder.h"
+
+#include <string.h>
+#include <stddef.h>
+#include <thread>
+
+// session_recorder / session_reader of Recorder.cpp : the .krec round trip, a file cut before it was finalized,
+// a disk that fills up during the recording and the version 1 header
+
+using namespace kar_test;
+
+namespace
+{
+	const int img_w = 64, img_h = 48, img_channels = 3;
+	const size_t img_bytes = (size_t)img_w * img_h * img_channels;
+
+	// the image and tracking bytes of frame f, different for every frame (the tracking size too)
+	void FrameImage(const int f, std::vector<char>& img)
+	{
+		img.resize(img_bytes);
+		for (size_t k = 0; k < img_bytes; k++) img[k] = (char)(f * 7 + k * 13);
+	}
+	void FrameTrack(const int f, std::vector<char>& trk)
+	{
+		trk.resize(16 + f % 50);
+		for (size_t k = 0; k < trk.size(); k++) trk[k] = (char)(f + k * 3);
+	}
+	double FrameTime(const int f) { return 1000. + f * 16.5; }
+	int FrameKey(const int f) { return f % 10 == 0 ? 'a' + f / 10 % 26 : 0; }
+
+	// pushes the frames, waiting for a free slot (a full pool drops the frame otherwise), until the recording fails
+	void PushFrames(session_recorder& rec, const int num_frames)
+	{
+		std::vector<char> img, trk;
+		for (int f = 0; f < num_frames; f++)
+		{
+			FrameImage(f, img);
+			FrameTrack(f, trk);
+			while (!rec.Push(FrameTime(f), FrameKey(f), img.data(), trk.data(), trk.size()))
+			{
+				if (rec.GetStats().failed) break;
+				std::this_thread::yield();
+			}
+		}
+	}
+
+	// number of entries of the reader that are frames 0, 1, ... with their bytes intact
+	int NumIntactFrames(session_reader& reader)
+	{
+		std::vector<char> img(img_bytes), trk, ref_img, ref_trk;
+		for (int i = 0; i < reader.GetNumFrames(); i++)
+		{
+			const rec_index_entry& e = reader.GetEntry(i);
+			FrameImage(i, ref_img);
+			FrameTrack(i, ref_trk);
+			if (e.frame_idx != (uint64_t)i || e.t_ms != FrameTime(i) || e.key != FrameKey(i) || e.img_bytes != img_bytes) return i;
+			if (!reader.ReadImage(i, img.data()) || img != ref_img) return i;
+			if (!reader.ReadTrack(i, trk) || trk != ref_trk) return i;
+		}
+		return reader.GetNumFrames();
+	}
+
+	std::vector<char> ReadFile(const std::string& path)
+	{
+		std::vector<char> bytes;
+		FILE* fp = fopen(path.c_str(), "rb");
+		if (fp == NULL) return bytes;
+		fseek(fp, 0, SEEK_END);
+		bytes.resize(ftell(fp));
+		fseek(fp, 0, SEEK_SET);
+		if (bytes.size() > 0 && fread(bytes.data(), bytes.size(), 1, fp) != 1) bytes.clear();
+		fclose(fp);
+		return bytes;
+	}
+	void WriteFile(const std::string& path, const char* data, const size_t bytes)
+	{
+		FILE* fp = fopen(path.c_str(), "wb");
+		fwrite(data, 1, bytes, fp);
+		fclose(fp);
+	}
+
+	const float intrinsics[4] = { 612.5f, 611.f, 320.25f, 241.75f };
+}
+
+// more frames than an index chunk holds, read back through the index chain
+KAR_TEST(recorder_round_trip)
+{
+	const std::string path = TempPath("kar_test_round_trip.krec");
+	const int num_frames = REC_INDEX_CHUNK_FRAMES * 2 + 100;
+	{
+		session_recorder rec;
+		KAR_CHECK(rec.Start(path, img_w, img_h, img_channels, 8, intrinsics));
+		KAR_CHECK(rec.IsRecording());
+		PushFrames(rec, num_frames);
+		rec.Stop();
+		KAR_CHECK(!rec.IsRecording());
+		const rec_stats stats = rec.GetStats();
+		KAR_CHECK(stats.written == num_frames && stats.pushed == num_frames && stats.pending == 0 && !stats.failed);
+	}
+
+	session_reader reader;
+	KAR_CHECK(reader.Open(path));
+	const rec_file_header& h = reader.GetHeader();
+	KAR_CHECK(h.version == REC_VERSION && h.img_w == img_w && h.img_h == img_h && h.img_channels == img_channels);
+	KAR_CHECK(h.last_index_offset != 0 && h.num_frames == num_frames);
+	KAR_CHECK(memcmp(h.img_intrinsics, intrinsics, sizeof(intrinsics)) == 0);
+	KAR_CHECK(reader.GetNumFrames() == num_frames);
+	KAR_CHECK(NumIntactFrames(reader) == num_frames);
+
+	KAR_CHECK(reader.FindFrame(0) == 0);
+	KAR_CHECK(reader.FindFrame(FrameTime(200)) == 200);
+	KAR_CHECK(reader.FindFrame(FrameTime(200) - 1) == 200);
+	KAR_CHECK(reader.FindFrame(FrameTime(num_frames)) == num_frames);
+	std::vector<char> trk;
+	KAR_CHECK(!reader.ReadTrack(num_frames, trk) && !reader.ReadTrack(-1, trk));
+	reader.Close();
+	remove(path.c_str());
+}
+
+// a recording that was never stopped (no index chain in the header) and ends in the middle of a frame :
+// the frame chunks are scanned and the cut frame is left out
+KAR_TEST(recorder_truncated_file)
+{
+	const std::string path = TempPath("kar_test_truncated.krec"), cut_path = TempPath("kar_test_truncated_cut.krec");
+	const int num_frames = REC_INDEX_CHUNK_FRAMES + 50, num_kept = REC_INDEX_CHUNK_FRAMES + 20;
+	{
+		session_recorder rec;
+		KAR_CHECK(rec.Start(path, img_w, img_h, img_channels, 8, intrinsics));
+		PushFrames(rec, num_frames);
+	}
+
+	uint64_t cut_offset = 0;
+	{
+		session_reader reader;
+		KAR_CHECK(reader.Open(path) && reader.GetNumFrames() == num_frames);
+		cut_offset = reader.GetEntry(num_kept).img_offset + img_bytes / 2;
+	}
+	std::vector<char> bytes = ReadFile(path);
+	KAR_CHECK(bytes.size() > cut_offset);
+	rec_file_header h;
+	memcpy(&h, bytes.data(), sizeof(h));
+	h.last_index_offset = 0;
+	h.num_frames = 0;
+	memcpy(bytes.data(), &h, sizeof(h));
+	WriteFile(cut_path, bytes.data(), (size_t)cut_offset);
+
+	session_reader reader;
+	KAR_CHECK(reader.Open(cut_path));
+	KAR_CHECK(reader.GetNumFrames() == num_kept);
+	KAR_CHECK(NumIntactFrames(reader) == num_kept);
+
+	// cut inside the chunk header of the next frame
+	reader.Close();
+	WriteFile(cut_path, bytes.data(), (size_t)(cut_offset - img_bytes / 2 - sizeof(rec_frame_header) - 4));
+	KAR_CHECK(reader.Open(cut_path) && reader.GetNumFrames() == num_kept && NumIntactFrames(reader) == num_kept);
+
+	// only the file header
+	reader.Close();
+	WriteFile(cut_path, bytes.data(), sizeof(rec_file_header));
+	KAR_CHECK(reader.Open(cut_path) && reader.GetNumFrames() == 0);
+	reader.Close();
+	remove(cut_path.c_str());
+	remove(path.c_str());
+}
+
+// the disk fills up during the recording : the write that does not fit leaves a partial chunk, the later frames are dropped
+// and the file reads back the complete frames written before the failure
+KAR_TEST(recorder_failed_write)
+{
+	const std::string path = TempPath("kar_test_failed_write.krec");
+	const int num_frames = 300;
+	const size_t frame_chunk_bytes = sizeof(rec_chunk_header) + sizeof(rec_frame_header) + img_bytes + 40;
+	for (const int full_at : { 100, REC_INDEX_CHUNK_FRAMES })
+	{
+		// bytes past disk_size are not written (a partial fwrite), the header patch of Stop is within it
+		const long long disk_size = (long long)(sizeof(rec_file_header) + frame_chunk_bytes * full_at);
+		session_recorder rec;
+		rec.SetFileWriter([disk_size](const void* data, size_t size, size_t count, FILE* fp) -> size_t
+		{
+			const long long pos = ftell(fp), bytes = (long long)(size * count);
+			if (pos + bytes <= disk_size) return fwrite(data, size, count, fp);
+			if (pos < disk_size) fwrite(data, 1, (size_t)(disk_size - pos), fp);
+			return 0;
+		});
+		// every frame fits in the pool, the drops are the ones of the failure
+		KAR_CHECK(rec.Start(path, img_w, img_h, img_channels, num_frames, intrinsics));
+		PushFrames(rec, num_frames);
+		rec.Stop();
+		const rec_stats stats = rec.GetStats();
+		printf("  disk full near frame %d : %lld written, %lld dropped\n", full_at, stats.written, stats.dropped);
+		KAR_CHECK(stats.failed);
+		KAR_CHECK(stats.written > 0 && stats.written <= full_at);
+		KAR_CHECK(stats.written + stats.dropped == num_frames);
+
+		session_reader reader;
+		KAR_CHECK(reader.Open(path));
+		KAR_CHECK(reader.GetNumFrames() == stats.written);
+		KAR_CHECK(NumIntactFrames(reader) == stats.written);
+		reader.Close();
+
+		// Start without a writable header
+		session_recorder rec_no_disk;
+		rec_no_disk.SetFileWriter([](const void*, size_t, size_t, FILE*) -> size_t { return 0; });
+		KAR_CHECK(!rec_no_disk.Start(path, img_w, img_h, img_channels, 8));
+		KAR_CHECK(!rec_no_disk.IsRecording());
+		std::vector<char> img(img_bytes);
+		KAR_CHECK(!rec_no_disk.Push(0, 0, img.data(), img.data(), 16));
+	}
+	remove(path.c_str());
+}
+
+// version 1 files (header without img_intrinsics) are read, newer versions and other files are not
+KAR_TEST(recorder_header_versions)
+{
+	const std::string path = TempPath("kar_test_v2.krec"), v1_path = TempPath("kar_test_v1.krec");
+	const int num_frames = 20;
+	{
+		session_recorder rec;
+		KAR_CHECK(rec.Start(path, img_w, img_h, img_channels, 8, intrinsics));
+		PushFrames(rec, num_frames);
+	}
+	std::vector<char> bytes = ReadFile(path);
+	KAR_CHECK(bytes.size() > sizeof(rec_file_header));
+
+	// version 1 : the v2 chunks after the shorter header, not finalized (the index offsets are the ones of the v2 file)
+	const size_t v1_header_size = offsetof(rec_file_header, img_intrinsics);
+	rec_file_header h;
+	memcpy(&h, bytes.data(), sizeof(h));
+	h.version = 1;
+	h.last_index_offset = 0;
+	std::vector<char> v1(bytes.size() - sizeof(h) + v1_header_size);
+	memcpy(v1.data(), &h, v1_header_size);
+	memcpy(v1.data() + v1_header_size, bytes.data() + sizeof(h), bytes.size() - sizeof(h));
+	WriteFile(v1_path, v1.data(), v1.size());
+
+	session_reader reader;
+	KAR_CHECK(reader.Open(v1_path));
+	KAR_CHECK(reader.GetHeader().version == 1 && reader.GetHeader().img_w == img_w);
+	const float no_intrinsics[4] = { 0, 0, 0, 0 };
+	KAR_CHECK(memcmp(reader.GetHeader().img_intrinsics, no_intrinsics, sizeof(no_intrinsics)) == 0);
+	KAR_CHECK(reader.GetNumFrames() == num_frames && NumIntactFrames(reader) == num_frames);
+	reader.Close();
+
+	// version 2 header of the recorder
+	KAR_CHECK(reader.Open(path) && reader.GetHeader().version == 2 && reader.GetNumFrames() == num_frames);
+	KAR_CHECK(memcmp(reader.GetHeader().img_intrinsics, intrinsics, sizeof(intrinsics)) == 0);
+	reader.Close();
+
+	// a newer version, another magic and a file shorter than the v1 header
+	h.version = REC_VERSION + 1;
+	memcpy(bytes.data(), &h, v1_header_size);
+	WriteFile(v1_path, bytes.data(), bytes.size());
+	KAR_CHECK(!reader.Open(v1_path));
+	h.version = REC_VERSION;
+	h.magic[7] = 'X';
+	memcpy(bytes.data(), &h, v1_header_size);
+	WriteFile(v1_path, bytes.data(), bytes.size());
+	KAR_CHECK(!reader.Open(v1_path));
+	WriteFile(v1_path, REC_MAGIC, 8);
+	KAR_CHECK(!reader.Open(v1_path));
+	KAR_CHECK(!reader.Open(TempPath("kar_test_missing.krec")));
+	remove(v1_path.c_str());
+	remove(path.c_str());
+}
@@ -0,0 +1,225 @@
+#include "test_util.h"
+#include "../ar_settings/SceneMirror.h"
+
+#include <map>
+
+// scene_mirror of ar_settings against a mock engine (SetMirrorEngine) : the state calls elided at FlushStates, the deleted objects
+// and the issued / elided counters
+
+using namespace kar_test;
+
+namespace
+{
+	// the vzm scenes as the engine would hold them, and the calls it received
+	struct mock_engine
+	{
+		std::map<std::pair<int, int>, vzm::ObjStates> scene_objs;
+		int num_replace, num_get, num_delete;
+
+		mock_engine() { num_replace = num_get = num_delete = 0; }
+
+		scene_mirror::mirror_engine Calls()
+		{
+			scene_mirror::mirror_engine engine;
+			engine.replace_or_add = [this](const int scene_id, const int obj_id, const vzm::ObjStates& obj_states)
+			{
+				num_replace++;
+				scene_objs[std::make_pair(scene_id, obj_id)] = obj_states;
+				return true;
+			};
+			engine.get_state = [this](const int scene_id, const int obj_id, vzm::ObjStates& obj_states)
+			{
+				num_get++;
+				auto it = scene_objs.find(std::make_pair(scene_id, obj_id));
+				if (it == scene_objs.end()) return false;
+				obj_states = it->second;
+				return true;
+			};
+			engine.delete_object = [this](const int obj_id)
+			{
+				num_delete++;
+				for (auto it = scene_objs.begin(); it != scene_objs.end();)
+				{
+					if (it->first.second == obj_id) it = scene_objs.erase(it);
+					else it++;
+				}
+				return true;
+			};
+			return engine;
+		}
+
+		bool IsVisible(const int scene_id, const int obj_id) const
+		{
+			auto it = scene_objs.find(std::make_pair(scene_id, obj_id));
+			return it != scene_objs.end() && it->second.is_visible;
+		}
+	};
+
+	vzm::ObjStates MovedState(const float x)
+	{
+		vzm::ObjStates state;
+		state.os2ws[12] = x;
+		return state;
+	}
+
+	struct mirror_scope
+	{
+		mock_engine mock;
+		mirror_scope()
+		{
+			const scene_mirror::mirror_engine engine = mock.Calls();
+			scene_mirror::SetMirrorEngine(&engine);
+			scene_mirror::ClearStates();
+			long long issued, elided;
+			scene_mirror::GetMirrorStats(issued, elided, true);
+		}
+		~mirror_scope()
+		{
+			scene_mirror::ClearStates();
+			scene_mirror::SetMirrorEngine(NULL);
+		}
+	};
+}
+
+// the same state frame after frame is pushed once, a second state in a frame replaces the first one
+KAR_TEST(scene_mirror_elides_unchanged_states)
+{
+	mirror_scope scope;
+	mock_engine& mock = scope.mock;
+	const int ws_scene = 11, rs_scene = 12;
+	scene_mirror::BindScene(MS_WS, ws_scene);
+	scene_mirror::BindScene(MS_RS, rs_scene);
+
+	// first frame : one call per scene of the mask, the unbound slot (MS_STG) is skipped
+	scene_mirror::SetStates(MS_WS | MS_RS | MS_STG, 5, MovedState(0));
+	KAR_CHECK(mock.num_replace == 0); // deferred
+	KAR_CHECK(scene_mirror::FlushStates() == 2);
+	KAR_CHECK(mock.num_replace == 2 && mock.scene_objs.size() == 2);
+
+	// the same state for 10 frames : no call
+	for (int f = 0; f < 10; f++)
+	{
+		scene_mirror::SetStates(MS_WS | MS_RS, 5, MovedState(0));
+		KAR_CHECK(scene_mirror::FlushStates() == 0);
+	}
+	KAR_CHECK(mock.num_replace == 2);
+
+	// moved in one scene only
+	scene_mirror::SetState(ws_scene, 5, MovedState(0.1f));
+	scene_mirror::SetState(rs_scene, 5, MovedState(0));
+	KAR_CHECK(scene_mirror::FlushStates() == 1);
+	KAR_CHECK(mock.scene_objs[std::make_pair(ws_scene, 5)].os2ws[12] == 0.1f);
+
+	// three states in a frame : the last one, one call
+	scene_mirror::SetState(ws_scene, 5, MovedState(0.2f));
+	scene_mirror::SetState(ws_scene, 5, MovedState(0.3f));
+	vzm::ObjStates hidden = MovedState(0.3f);
+	hidden.is_visible = false;
+	scene_mirror::SetState(ws_scene, 5, hidden);
+	KAR_CHECK(scene_mirror::FlushStates() == 1);
+	KAR_CHECK(!mock.IsVisible(ws_scene, 5) && mock.IsVisible(rs_scene, 5));
+	KAR_CHECK(mock.scene_objs[std::make_pair(ws_scene, 5)].os2ws[12] == 0.3f);
+
+	// a state differing in one field only is pushed
+	vzm::ObjStates colored = MovedState(0);
+	colored.color[1] = 0.5f;
+	scene_mirror::SetState(rs_scene, 5, colored);
+	KAR_CHECK(scene_mirror::FlushStates() == 1 && mock.num_replace == 5);
+}
+
+// GetState : the engine is asked once per unknown object, then the mirror answers (the pending state first)
+KAR_TEST(scene_mirror_get_state)
+{
+	mirror_scope scope;
+	mock_engine& mock = scope.mock;
+	const int scene = 21;
+	mock.scene_objs[std::make_pair(scene, 8)] = MovedState(0.5f); // added outside of the mirror
+
+	vzm::ObjStates state;
+	KAR_CHECK(scene_mirror::GetState(scene, 8, state) && state.os2ws[12] == 0.5f && mock.num_get == 1);
+	KAR_CHECK(scene_mirror::GetState(scene, 8, state) && mock.num_get == 1);
+	// the known state is not pushed again
+	scene_mirror::SetState(scene, 8, MovedState(0.5f));
+	KAR_CHECK(scene_mirror::FlushStates() == 0 && mock.num_replace == 0);
+
+	scene_mirror::SetState(scene, 8, MovedState(0.7f));
+	KAR_CHECK(scene_mirror::GetState(scene, 8, state) && state.os2ws[12] == 0.7f && mock.num_get == 1);
+	KAR_CHECK(scene_mirror::FlushStates() == 1);
+
+	// not in the engine either
+	KAR_CHECK(!scene_mirror::GetState(scene, 9, state) && mock.num_get == 2);
+}
+
+// DeleteMirroredObject : the object is deleted once, its pending states are dropped, a reused id starts over
+KAR_TEST(scene_mirror_deleted_objects)
+{
+	mirror_scope scope;
+	mock_engine& mock = scope.mock;
+	const int ws_scene = 31, rs_scene = 32;
+	scene_mirror::BindScene(MS_WS, ws_scene);
+	scene_mirror::BindScene(MS_RS, rs_scene);
+
+	scene_mirror::SetStates(MS_WS | MS_RS, 3, MovedState(0));
+	scene_mirror::SetStates(MS_WS | MS_RS, 4, MovedState(0));
+	KAR_CHECK(scene_mirror::FlushStates() == 4);
+
+	// a pending state of the deleted object is not pushed, the other object is not touched
+	scene_mirror::SetStates(MS_WS | MS_RS, 3, MovedState(1));
+	scene_mirror::SetStates(MS_WS, 4, MovedState(1));
+	KAR_CHECK(scene_mirror::DeleteMirroredObject(3));
+	KAR_CHECK(mock.num_delete == 1 && mock.scene_objs.size() == 2);
+	KAR_CHECK(scene_mirror::FlushStates() == 1);
+	KAR_CHECK(mock.scene_objs.count(std::make_pair(ws_scene, 3)) == 0 && mock.scene_objs[std::make_pair(ws_scene, 4)].os2ws[12] == 1.f);
+
+	// the engine gives the id to a new object : its first state is pushed even when equal to the former one
+	scene_mirror::SetStates(MS_WS | MS_RS, 3, MovedState(0));
+	KAR_CHECK(scene_mirror::FlushStates() == 2);
+	KAR_CHECK(mock.IsVisible(ws_scene, 3) && mock.IsVisible(rs_scene, 3));
+
+	// id 0 (no object) goes to the engine as is
+	scene_mirror::DeleteMirroredObject(0);
+	KAR_CHECK(mock.num_delete == 2);
+
+	// ClearStates : the scenes are gone, nothing is mirrored or bound
+	scene_mirror::ClearStates();
+	scene_mirror::SetStates(MS_WS, 4, MovedState(1));
+	KAR_CHECK(scene_mirror::FlushStates() == 0);
+	scene_mirror::SetState(ws_scene, 4, MovedState(1));
+	KAR_CHECK(scene_mirror::FlushStates() == 1);
+}
+
+// the counters : every engine state call is issued, every call saved by the mirror is elided
+KAR_TEST(scene_mirror_counters)
+{
+	mirror_scope scope;
+	mock_engine& mock = scope.mock;
+	const int scene = 41;
+	const int num_objs = 20, num_frames = 30;
+
+	// a frame of the renderer : every object set every frame, one in four moved
+	for (int f = 0; f < num_frames; f++)
+	{
+		for (int i = 1; i <= num_objs; i++) scene_mirror::SetState(scene, i, MovedState(i % 4 == 0 ? (float)f : 0.f));
+		scene_mirror::SetState(scene, 1, MovedState(0)); // set twice in the frame
+		scene_mirror::FlushStates();
+	}
+	vzm::ObjStates state;
+	scene_mirror::GetState(scene, 2, state);
+	scene_mirror::GetState(scene, 100, state);
+
+	long long issued, elided;
+	scene_mirror::GetMirrorStats(issued, elided);
+	const int num_moving = num_objs / 4;
+	const long long num_sets = (long long)num_frames * (num_objs + 1);
+	printf("  %lld states set, %lld vzm calls issued, %lld elided\n", num_sets, issued, elided);
+	KAR_CHECK(issued == mock.num_replace + mock.num_get);
+	KAR_CHECK(mock.num_replace == num_objs + num_moving * (num_frames - 1));
+	KAR_CHECK(mock.num_get == 1); // the object 100 only
+	// the unchanged states at the flush, the second set of the frame and the GetState of a known object
+	KAR_CHECK(elided == (long long)(num_objs - num_moving) * (num_frames - 1) + num_frames + 1);
+	KAR_CHECK(issued + elided == num_sets + 2);
+
+	scene_mirror::GetMirrorStats(issued, elided, true);
+	scene_mirror::GetMirrorStats(issued, elided);
+	KAR_CHECK(issued == 0 && elided == 0);
+}
@@ -0,0 +1,173 @@
+#include "test_util.h"
+#include "prototype_ver2/SimScheduler.h"
+#include "prototype_ver2/Simulation.h"
+
+#include <math.h>
+#include <thread>
+#include <atomic>
+
+// fixed-timestep scheduler of the deform thread, driven by a fake clock (no wall time, no sleeping)
+
+using namespace kar_test;
+
+namespace
+{
+	// every call of the clock costs call_cost seconds, sleeping moves the clock forward (a yield by 10 us)
+	// the time step of the tests is 1 / 64 s, the clock sums are exact
+	struct fake_clock
+	{
+		double now;
+		double call_cost;
+		double slept;
+		int num_sleeps, num_yields;
+
+		fake_clock() { now = 100.0; call_cost = 0; slept = 0; num_sleeps = num_yields = 0; }
+
+		void Attach(SimScheduler& sched)
+		{
+			sched.setClock(
+				[this]() { double t = now; now += call_cost; return t; },
+				[this](double sec) { if (sec > 0) { now += sec; slept += sec; num_sleeps++; } else { now += 1e-5; num_yields++; } });
+		}
+	};
+}
+
+KAR_TEST(sim_scheduler_fixed_steps)
+{
+	Simulation sim;
+	sim.setTimeStep(1.0f / 64);
+	const double dt = sim.getTimeStep();
+	SimScheduler sched(&sim);
+	fake_clock clock;
+	clock.Attach(sched);
+
+	// the first tick only starts the clock
+	KAR_CHECK(sched.tick() == 0);
+
+	// ticks at the step rate : one step each
+	int steps = 0;
+	for (int i = 0; i < 30; i++) { clock.now += dt; steps += sched.tick(); }
+	KAR_CHECK(steps == 30);
+
+	// ticks at twice the step rate : a step every second tick, the remainder is carried
+	int zero_ticks = 0;
+	for (int i = 0; i < 30; i++) { clock.now += dt * 0.5; int n = sched.tick(); steps += n; zero_ticks += n == 0; }
+	KAR_CHECK(steps == 45);
+	KAR_CHECK(zero_ticks == 15);
+
+	// ticks at half the step rate : two steps each
+	for (int i = 0; i < 10; i++) { clock.now += dt * 2; KAR_CHECK(sched.tick() == 2); }
+
+	// the simulation time follows the wall time, not the cost of the steps
+	KAR_CHECK(sched.acquireState());
+	KAR_CHECK(sched.getState().step == 65);
+	KAR_CHECK(fabs(sched.getState().simTime - 65 * dt) < 1e-9);
+	KAR_CHECK(sched.getState().dropped == 0);
+}
+
+KAR_TEST(sim_scheduler_catch_up_cap)
+{
+	Simulation sim;
+	sim.setTimeStep(1.0f / 64);
+	const double dt = sim.getTimeStep();
+	SimScheduler sched(&sim);
+	sched.setMaxSubSteps(4);
+	fake_clock clock;
+	clock.Attach(sched);
+	sched.tick();
+
+	// a stall of about 0.5 s : 4 steps run, the other 26 due steps are dropped instead of spiraling
+	clock.now += 30 * dt + dt * 0.25;
+	KAR_CHECK(sched.tick() == 4);
+	KAR_CHECK(sched.acquireState());
+	KAR_CHECK(sched.getState().dropped == 26);
+	KAR_CHECK(sched.tick() == 0);
+
+	// paused : no step and no catch-up kept for the paused time
+	clock.now += 10 * dt;
+	KAR_CHECK(sched.tick(false) == 0);
+	clock.now += dt;
+	KAR_CHECK(sched.tick() == 1);
+	KAR_CHECK(sched.acquireState());
+	KAR_CHECK(sched.getState().step == 5);
+	KAR_CHECK(sched.getState().dropped == 26);
+}
+
+KAR_TEST(sim_scheduler_wait_and_counters)
+{
+	Simulation sim;
+	sim.setTimeStep(1.0f / 64);
+	const double dt = sim.getTimeStep();
+	SimScheduler sched(&sim);
+	fake_clock clock;
+	clock.call_cost = 1.0 / 1024;	// a step measures one call of the clock
+	clock.Attach(sched);
+
+	// the loop of the deform thread for 2 s of clock : tick then wait
+	const double t_end = clock.now + 2.0;
+	int steps = 0, ticks = 0;
+	while (clock.now < t_end)
+	{
+		steps += sched.tick();
+		sched.waitNextStep();
+		ticks++;
+	}
+	// about one step per tick and per time step, a wait is one coarse sleep and a few yields, not a spin
+	// (the clock calls cost the rest of the time here)
+	KAR_CHECK(fabs(steps - 2.0 / dt) <= 2);
+	KAR_CHECK(ticks <= steps + 2);
+	KAR_CHECK(clock.num_sleeps >= steps - 2 && clock.num_sleeps <= ticks);
+	KAR_CHECK(clock.num_yields <= 2 * ticks);
+	KAR_CHECK(clock.slept >= 2.0 * 0.5);
+
+	KAR_CHECK(sched.acquireState());
+	const SimState& state = sched.getState();
+	KAR_CHECK(state.window >= 1);
+	KAR_CHECK(fabs(state.stepsPerSec - 1.0 / dt) < 2.0);
+	KAR_CHECK(fabs(state.msPerStep - 1000.0 / 1024) < 1e-3);
+	KAR_CHECK(state.dropped == 0);
+	KAR_CHECK(!sched.acquireState());	// nothing new since
+}
+
+KAR_TEST(sim_scheduler_triple_buffer_threads)
+{
+	struct frame { long long v[8]; };
+	TripleBuffer<frame> tb;
+	for (int i = 0; i < 3; i++) for (int j = 0; j < 8; j++) tb.buffer(i).v[j] = 0;
+
+	const long long num_frames = 20000;
+	std::atomic<bool> done(false);
+	std::thread producer([&]() {
+		for (long long f = 1; f <= num_frames; f++)
+		{
+			frame& w = tb.writeBuffer();
+			for (int j = 0; j < 8; j++) w.v[j] = f;
+			tb.publish();
+			if ((f & 63) == 0) std::this_thread::yield();
+		}
+		done = true;
+	});
+
+	// newest frame only, never torn, never older than the previous one
+	long long last = 0;
+	int num_torn = 0, num_back = 0, num_acquired = 0;
+	for (;;)
+	{
+		const bool finished = done;
+		if (tb.acquire())
+		{
+			const frame& r = tb.readBuffer();
+			for (int j = 1; j < 8; j++) num_torn += r.v[j] != r.v[0];
+			num_back += r.v[0] < last;
+			last = r.v[0];
+			num_acquired++;
+		}
+		else if (finished) break;
+		else std::this_thread::yield();
+	}
+	producer.join();
+	KAR_CHECK(num_torn == 0);
+	KAR_CHECK(num_back == 0);
+	KAR_CHECK(last == num_frames);
+	KAR_CHECK(num_acquired > 0);
+}
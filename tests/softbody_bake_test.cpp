@@ -0,0 +1,175 @@
+#include "softbody_test_util.h"
+#include "prototype_ver2/softBodyBake.h"
+
+#include <math.h>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+// startup bake of softBodyBake.cpp through Simulation::initSoftBody : a synthetic brain (grid box) and ventricle (inner box)
+// cold : built from the tetgen files and baked, warm : mapped back from the bake
+
+using namespace kar_test;
+
+namespace
+{
+	struct bake_data
+	{
+		std::string root;
+
+		// the file names of initSoftBody ("<root>\brain.node", ...)
+		bake_data(const char* _root, const int n)
+		{
+			root = TempPath(_root);
+#ifdef _WIN32
+			_mkdir(root.c_str());
+#else
+			mkdir(root.c_str(), 0755);
+#endif
+			Remove();
+			WriteTetGrid(Path("brain"), n, 0.f, 100.f, 0.3f);
+			WriteBoxObj(Path("brain"), n * 2, 0.f, 100.f);
+			WriteTetGrid(Path("ventricle"), btMax(2, n / 3), 35.f, 65.f, 0.3f);
+			WriteBoxObj(Path("ventricle"), btMax(2, n / 3) * 2, 35.f, 65.f);
+		}
+		~bake_data()
+		{
+			Remove();
+#ifdef _WIN32
+			_rmdir(root.c_str());
+#else
+			rmdir(root.c_str());
+#endif
+		}
+
+		std::string Path(const char* name) const { return root + "\\" + name; }
+		std::string BakePath() const { return Path("brain-ventricle.bake"); }
+
+		void Remove()
+		{
+			RemoveTetGrid(Path("brain"));
+			RemoveTetGrid(Path("ventricle"));
+			remove((Path("brain") + ".obj").c_str());
+			remove((Path("ventricle") + ".obj").c_str());
+			remove(Path("brain-ventricle.het").c_str());
+			remove(BakePath().c_str());
+		}
+
+		long long BakeBytes() const
+		{
+			FILE* fp = fopen(BakePath().c_str(), "rb");
+			if (fp == NULL) return 0;
+			fseek(fp, 0, SEEK_END);
+			const long long bytes = ftell(fp);
+			fclose(fp);
+			return bytes;
+		}
+	};
+
+	// the same push on the top layer of both bodies, then steps
+	void PushAndStep(CiSoftBody* psb, Simulation& sim, const int steps)
+	{
+		psb->setSimulationSpace(&sim);
+		sim.softBodies.push_back(psb);	// deleted by the Simulation
+		for (int i = 0; i < psb->m_nodes.size(); i++)
+		{
+			CiSoftBody::Node& n = psb->m_nodes[i];
+			if (n.m_x.y() > 90.f) n.m_x += btVector3(0, -3.f, 0.2f * (i % 3));
+		}
+		for (int s = 0; s < steps; s++) sim.stepFixed();
+	}
+
+	int NumConstraints(const CiSoftBody* psb)
+	{
+		return psb->m_stretchConstraints.size() + psb->m_bendingConstraints_dihedral.size() + psb->m_bendingConstraints_triangle.size()
+			+ psb->m_volumeConstraints_surface.size() + psb->m_volumeConstraints.size();
+	}
+}
+
+KAR_TEST(softbody_bake_round_trip)
+{
+	bake_data data("kar_test_bake", 6);
+	Simulation loader;
+
+	CiSoftBody* cold = loader.initSoftBody(data.root.c_str());
+	KAR_CHECK(data.BakeBytes() > 0);
+	CiSoftBody* warm = loader.initSoftBody(data.root.c_str());
+	KAR_CHECK(cold != NULL && warm != NULL);
+	if (!cold || !warm) return;
+
+	// the baked body is the built one
+	KAR_CHECK(warm->m_nodes.size() == cold->m_nodes.size());
+	KAR_CHECK(warm->m_tetras.size() == cold->m_tetras.size());
+	KAR_CHECK(warm->m_child.size() == cold->m_child.size() && cold->m_child.size() > 0);
+	KAR_CHECK(NumConstraints(warm) == NumConstraints(cold) && NumConstraints(cold) > 0);
+	KAR_CHECK(warm->m_parallelReady == cold->m_parallelReady);
+	int num_diff = 0;
+	for (int i = 0; i < cold->m_nodes.size() && i < warm->m_nodes.size(); i++)
+		num_diff += !(cold->m_nodes[i].m_x == warm->m_nodes[i].m_x) || cold->m_nodes[i].m_im != warm->m_nodes[i].m_im;
+	for (int i = 0; i < cold->m_tetras.size() && i < warm->m_tetras.size(); i++)
+		for (int j = 0; j < 4; j++)
+			num_diff += (cold->m_tetras[i].m_n[j] - &cold->m_nodes[0]) != (warm->m_tetras[i].m_n[j] - &warm->m_nodes[0]);
+	for (int i = 0; i < cold->m_volumeConstraints.size() && i < warm->m_volumeConstraints.size(); i++)
+		num_diff += cold->m_volumeConstraints[i].m_rest != warm->m_volumeConstraints[i].m_rest;
+	KAR_CHECK(num_diff == 0);
+
+	// and steps the same, bit for bit
+	Simulation sim_cold, sim_warm;
+	PushAndStep(cold, sim_cold, 20);
+	PushAndStep(warm, sim_warm, 20);
+	btScalar max_diff = 0;
+	for (int i = 0; i < cold->m_nodes.size() && i < warm->m_nodes.size(); i++)
+		max_diff = btMax(max_diff, (cold->m_nodes[i].m_x - warm->m_nodes[i].m_x).length());
+	KAR_CHECK(max_diff == 0);
+
+	// a stale key or a flipped byte : no body, the startup builds again
+	KAR_CHECK(CiSoftBodyBake::load(data.BakePath().c_str(), 1234) == NULL);
+	FILE* fp = fopen(data.BakePath().c_str(), "r+b");
+	fseek(fp, -100, SEEK_END);
+	const int c = fgetc(fp);
+	fseek(fp, -100, SEEK_END);
+	fputc(c ^ 1, fp);
+	fclose(fp);
+	CiSoftBody* rebuilt = loader.initSoftBody(data.root.c_str());
+	KAR_CHECK(rebuilt != NULL && rebuilt->m_nodes.size() == cold->m_nodes.size());
+	delete rebuilt;
+}
+
+KAR_BENCH(softbody_bake_startup)
+{
+	const int grid_n[] = { 8, 14, 20 };
+	printf("  %8s %8s | %10s %10s %8s | %10s\n", "nodes", "tetras", "cold ms", "warm ms", "speedup", "bake MB");
+	for (int g = 0; g < 3; g++)
+	{
+		bake_data data("kar_test_bake", grid_n[g]);
+		Simulation loader;
+
+		// cold : no bake yet, the model is built and baked
+		double t0 = NowMs();
+		CiSoftBody* cold = loader.initSoftBody(data.root.c_str());
+		const double ms_cold = NowMs() - t0;
+
+		// warm : the bake of the cold start
+		std::vector<double> ms_warm;
+		CiSoftBody* warm = NULL;
+		for (int r = 0; r < 5; r++)
+		{
+			delete warm;
+			t0 = NowMs();
+			warm = loader.initSoftBody(data.root.c_str());
+			ms_warm.push_back(NowMs() - t0);
+		}
+		KAR_CHECK(cold != NULL && warm != NULL);
+		if (cold && warm)
+		{
+			printf("  %8d %8d | %10.1f %10.2f %7.0fx | %10.2f\n", cold->m_nodes.size(), cold->m_tetras.size(), ms_cold, Percentile(ms_warm, 0.5),
+				ms_cold / Percentile(ms_warm, 0.5), data.BakeBytes() / (1024.0 * 1024.0));
+			KAR_CHECK(warm->m_nodes.size() == cold->m_nodes.size());
+			KAR_CHECK(Percentile(ms_warm, 0.5) < ms_cold);
+		}
+		delete cold;
+		delete warm;
+	}
+}
@@ -0,0 +1,164 @@
+#include "softbody_test_util.h"
+
+#include <math.h>
+
+// tool collision broad-phase of softbodyCollision.cpp : a synthetic tool (two fiducials) moved through a tetra body
+// (windows.h of softBodyHelper.h defines min / max, btMin / btMax below)
+
+using namespace kar_test;
+
+namespace
+{
+	struct tool_scene
+	{
+		Simulation sim;
+		CiSoftBody* psb;
+		CiRigidBody* tool;
+		btVector3 bmin, bmax;
+		std::string grid_base;	// "" : not a synthetic grid
+
+		// the brain model of the Data folder when found, else a synthetic grid of n^3 cubes
+		tool_scene(const char* data_base, const int n)
+		{
+			std::string base = data_base ? data_base : "";
+			FILE* fp = base.empty() ? NULL : fopen((base + ".node").c_str(), "r");
+			if (fp) fclose(fp);
+			else
+			{
+				grid_base = base = TempPath("kar_test_tool_grid");
+				WriteTetGrid(base, n, -40.f, 40.f, 0.3f);
+			}
+			psb = LoadTetGrid(base);
+			psb->m_cfg.m_contactMargin = 1;
+			psb->setSolverMode(CiSoftBody::cfgSolverMode::Parallel);
+			psb->setSimulationSpace(&sim);
+			sim.softBodies.push_back(psb);
+
+			tool = new CiRigidBody();
+			tool->setSimulationSpace(&sim);
+			tool->setType(CiRigidBody::bodyType::TOOL);
+			tool->addFiducialPoint(btVector3(0, 1000, 0));
+			tool->addFiducialPoint(btVector3(0, 1100, 0));
+			sim.rigidBodies.push_back(tool);
+
+			bmin = bmax = psb->m_nodes[0].m_x;
+			for (int i = 0; i < psb->m_nodes.size(); i++)
+			{
+				bmin.setMin(psb->m_nodes[i].m_x);
+				bmax.setMax(psb->m_nodes[i].m_x);
+			}
+		}
+		~tool_scene() { if (!grid_base.empty()) RemoveTetGrid(grid_base); }
+
+		// vertical tool of the given tip at t in [0, 1] of a sweep along x through the middle of the body
+		void PlaceTool(const float t, const float depth)
+		{
+			const btVector3 c = (bmin + bmax) * 0.5f, ext = bmax - bmin;
+			btVector3 tip(bmin.x() + ext.x() * (0.1f + 0.8f * t), bmax.y() - ext.y() * depth, c.z());
+			tool->m_visFiducialPoint[0] = tip;
+			tool->m_visFiducialPoint[1] = tip + btVector3(0, ext.y(), 0);
+		}
+	};
+
+	btScalar segmentSqd(const btVector3& p, const btVector3& a, const btVector3& b)
+	{
+		btVector3 ab = b - a;
+		btScalar t = btDot(p - a, ab) / btMax(ab.length2(), (btScalar)SIMD_EPSILON);
+		t = btMax((btScalar)0, btMin((btScalar)1, t));
+		return (a + ab * t - p).length2();
+	}
+}
+
+KAR_TEST(softbody_tool_broadphase_covers_sweep)
+{
+	tool_scene scene(NULL, 8);
+	CiSoftBody* psb = scene.psb;
+	const btScalar margin = psb->getToolShapeMargin();
+	const int num_nodes = psb->m_nodes.size();
+
+	// from outside, then steps of growing length through the body (the last ones cover most of the grid)
+	const float ts[] = { 0.f, 0.02f, 0.05f, 0.1f, 0.2f, 0.35f, 0.6f, 1.f };
+	scene.PlaceTool(0, -0.5f);
+	psb->updateToolBroadphase();
+	KAR_CHECK(psb->m_toolBp.m_candidates.size() == 0);
+	int num_missed = 0, max_tested = 0;
+	for (int s = 0; s < 8; s++)
+	{
+		const btVector3 p0 = scene.tool->m_visFiducialPoint[0], q0 = scene.tool->m_visFiducialPoint[1];
+		scene.PlaceTool(ts[s], 0.5f);
+		const btVector3 p1 = scene.tool->m_visFiducialPoint[0], q1 = scene.tool->m_visFiducialPoint[1];
+		psb->updateToolBroadphase();
+		KAR_CHECK(psb->m_toolBp.m_toolIdx == 0);
+
+		std::vector<char> is_candidate(num_nodes, 0);
+		const btAlignedObjectArray<int>& cand = psb->m_toolBp.m_candidates;
+		for (int k = 0; k < cand.size(); k++) is_candidate[cand[k]] = 1;
+		max_tested = btMax(max_tested, (int)cand.size());
+
+		// every node the narrow-phase can move at an intermediate tool position is a candidate
+		for (int i = 0; i < num_nodes; i++)
+		{
+			if (is_candidate[i]) continue;
+			for (int j = 0; j <= 16; j++)
+			{
+				const float u = j / 16.f;
+				if (segmentSqd(psb->m_nodes[i].m_x, p0 + (p1 - p0) * u, q0 + (q1 - q0) * u) < margin * margin) { num_missed++; break; }
+			}
+		}
+	}
+	KAR_CHECK(num_missed == 0);
+	KAR_CHECK(max_tested > 0 && max_tested < num_nodes);
+}
+
+KAR_BENCH(softbody_tool_broadphase_sweep)
+{
+	// the brain model of the Data folder of the solution
+	const std::string data = DataDir("brain.node");
+	const std::string brain = data.empty() ? "" : (std::filesystem::path(data) / "brain").string();
+	tool_scene scene(brain.c_str(), 20);
+	CiSoftBody* psb = scene.psb;
+	const int num_steps = 120;
+
+	// no tool in reach : solver cost of a step
+	scene.PlaceTool(0, -0.5f);
+	std::vector<double> ms_idle;
+	for (int s = 0; s < 20; s++)
+	{
+		double t0 = NowMs();
+		scene.sim.stepFixed();
+		ms_idle.push_back(NowMs() - t0);
+	}
+
+	// tool pushed to half depth, then swept across
+	std::vector<double> ms_tool, ms_bp;
+	double sum_tested = 0, sum_rebinned = 0;
+	int max_tested = 0;
+	for (int s = 0; s < num_steps; s++)
+	{
+		const float t = (float)s / (num_steps - 1);
+		scene.PlaceTool(btMin(1.f, t * 2), btMin(0.5f, t * 4));
+		double t0 = NowMs();
+		scene.sim.stepFixed();
+		ms_tool.push_back(NowMs() - t0);
+
+		int tested, rebinned;
+		psb->getToolBroadphaseStats(tested, rebinned);
+		sum_tested += tested;
+		sum_rebinned += rebinned;
+		max_tested = btMax(max_tested, tested);
+
+		// broad-phase alone : refit of the nodes moved by the solver and the query at the current fiducials
+		// (the previous fiducials are the current ones after the step, the next step is not changed)
+		t0 = NowMs();
+		psb->updateToolBroadphase();
+		ms_bp.push_back(NowMs() - t0);
+	}
+
+	printf("  nodes %d, tetras %d, tool margin %.2f\n", psb->m_nodes.size(), psb->m_tetras.size(), psb->getToolShapeMargin());
+	printf("  nodes tested / step : mean %.1f, max %d (%.2f%% of the nodes), re-binned mean %.1f\n",
+		sum_tested / num_steps, max_tested, 100.0 * max_tested / psb->m_nodes.size(), sum_rebinned / num_steps);
+	printf("  ms/step without tool %.3f (p95 %.3f), with tool %.3f (p95 %.3f), broad-phase %.3f (p95 %.3f)\n",
+		Percentile(ms_idle, 0.5), Percentile(ms_idle, 0.95), Percentile(ms_tool, 0.5), Percentile(ms_tool, 0.95),
+		Percentile(ms_bp, 0.5), Percentile(ms_bp, 0.95));
+	KAR_CHECK(max_tested < psb->m_nodes.size());
+}
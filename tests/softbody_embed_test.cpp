@@ -0,0 +1,150 @@
+#include "softbody_test_util.h"
+#include "prototype_ver2/softBodyHelper.h"
+
+#include <math.h>
+
+// surface mesh embedding of CiSoftBodyHelpers::embedSurfaceMesh (tetra grid) against the former scan of every centroid
+
+using namespace kar_test;
+
+namespace
+{
+	// the former embedding of generateHybridModel / mergeTetra : the tetra of the nearest centroid (ties : the later tetra),
+	// returns the average distance to the nearest centroid
+	btScalar ScanNearestCentroid(const btAlignedObjectArray<CiSoftBody::Tetra*>& tetras, const btAlignedObjectArray<CiSoftBody::Node>& meshNodes,
+		btAlignedObjectArray<int>& attachedTetraIdx, btAlignedObjectArray<btVector4>& bary)
+	{
+		btAlignedObjectArray<btVector3> centroids;
+		for (int j = 0; j < tetras.size(); j++)
+		{
+			btVector3 centroid;
+			centroid.setZero();
+			for (int k = 0; k < 4; k++) centroid += tetras[j]->m_n[k]->m_x;
+			centroid /= 4.0;
+			centroids.push_back(centroid);
+		}
+		attachedTetraIdx.resize(meshNodes.size());
+		bary.resize(meshNodes.size());
+		btScalar avgLen = 0;
+		for (int i = 0; i < meshNodes.size(); i++)
+		{
+			const btVector3& p = meshNodes[i].m_x;
+			btScalar minD = FLT_MAX;
+			int minJ = -1;
+			for (int j = 0; j < tetras.size(); j++)
+			{
+				const btScalar d = (centroids[j] - p).length();
+				if (minD >= d) { minD = d; minJ = j; }
+			}
+			const CiSoftBody::Tetra* t = tetras[minJ];
+			bary[i] = GetBarycentricCoordinate(t->m_n[0]->m_x, t->m_n[1]->m_x, t->m_n[2]->m_x, t->m_n[3]->m_x, p);
+			attachedTetraIdx[i] = t->m_idx;
+			avgLen += minD;
+		}
+		return avgLen / meshNodes.size();
+	}
+
+	btScalar MinBary(const btVector4& b)
+	{
+		return btMin(btMin(b.x(), b.y()), btMin(b.z(), b.w()));
+	}
+
+	struct embed_scene
+	{
+		std::string base;
+		CiSoftBody* psb;
+		btAlignedObjectArray<CiSoftBody::Tetra*> boundary;	// the candidates of generateHybridModel (3 surface nodes or more)
+		btAlignedObjectArray<CiSoftBody::Node> mesh;		// surface mesh nodes
+
+		// grid of n^3 cubes over [0, 100]^3, the mesh nodes near its border (inside, on and just outside of it)
+		embed_scene(const char* _base, const int n, const int num_mesh_nodes)
+		{
+			base = TempPath(_base);
+			WriteTetGrid(base, n, 0.f, 100.f, 0.3f);
+			psb = LoadTetGrid(base);
+			for (int i = 0; i < psb->m_tetras.size(); i++)
+			{
+				CiSoftBody::Tetra* t = &psb->m_tetras[i];
+				int num_surface = 0;
+				for (int j = 0; j < 4; j++) num_surface += t->m_n[j]->m_surface;
+				if (num_surface >= 3) boundary.push_back(t);
+			}
+			lcg rng(9);
+			mesh.resize(num_mesh_nodes);
+			for (int i = 0; i < num_mesh_nodes; i++)
+			{
+				// a face of the box, at a depth of [-1, 3] % of its size
+				btScalar p[3];
+				const int axis = rng.Next() % 3;
+				for (int a = 0; a < 3; a++) p[a] = rng.Uniform(0, 100.f);
+				const btScalar depth = rng.Uniform(-1.f, 3.f);
+				p[axis] = rng.Next() % 2 ? depth : 100.f - depth;
+				mesh[i].m_x = btVector3(p[0], p[1], p[2]);
+			}
+		}
+		~embed_scene()
+		{
+			delete psb;
+			RemoveTetGrid(base);
+		}
+	};
+}
+
+KAR_TEST(softbody_embed_matches_scan)
+{
+	embed_scene scene("kar_test_embed", 8, 4000);
+	const btScalar tol = 1e-4f;
+
+	btAlignedObjectArray<int> idx_old, idx_new;
+	btAlignedObjectArray<btVector4> bary_old, bary_new;
+	const btScalar margin_old = ScanNearestCentroid(scene.boundary, scene.mesh, idx_old, bary_old);
+	const btScalar margin_new = CiSoftBodyHelpers::embedSurfaceMesh(scene.boundary, scene.mesh, idx_new, bary_new);
+
+	// the same margin (nearest centroid distances summed in the node order)
+	KAR_CHECK(margin_new == margin_old);
+
+	int num_inside_old = 0, num_kept = 0, num_changed = 0, num_changed_outside = 0, num_lost = 0;
+	btScalar worst_old = 1, worst_new = 1;
+	for (int i = 0; i < scene.mesh.size(); i++)
+	{
+		const bool inside_old = MinBary(bary_old[i]) >= -tol, inside_new = MinBary(bary_new[i]) >= -tol;
+		num_inside_old += inside_old;
+		worst_old = btMin(worst_old, MinBary(bary_old[i]));
+		worst_new = btMin(worst_new, MinBary(bary_new[i]));
+		if (idx_new[i] == idx_old[i]) { num_kept++; continue; }
+		// a changed attachment is a containing tetra (a node on a shared face may go to the more interior one)
+		num_changed++;
+		num_changed_outside += !inside_new;
+		num_lost += inside_old && !inside_new;
+	}
+	printf("  %d mesh nodes, %d boundary tetras : %d kept, %d changed, inside before %d, worst barycentric %.3f -> %.3f\n",
+		scene.mesh.size(), scene.boundary.size(), num_kept, num_changed, num_inside_old, worst_old, worst_new);
+	KAR_CHECK(num_changed_outside == 0);
+	KAR_CHECK(num_lost == 0);
+	KAR_CHECK(num_changed > 0);	// the scan attaches some nodes to a tetra not containing them
+	KAR_CHECK(worst_new >= worst_old);
+
+	// a node outside of every tetra keeps the tetra of the scan
+	for (int i = 0; i < scene.mesh.size(); i++)
+		if (MinBary(bary_new[i]) < -tol) KAR_CHECK(idx_new[i] == idx_old[i]);
+}
+
+KAR_BENCH(softbody_embed_scaling)
+{
+	const int grid_n[] = { 8, 14, 20, 28 };
+	printf("  %8s %8s | %10s %10s %8s\n", "tetras", "nodes", "scan ms", "grid ms", "speedup");
+	for (int g = 0; g < 4; g++)
+	{
+		const int n = grid_n[g];
+		embed_scene scene("kar_test_embed", n, 6 * (4 * n) * (4 * n));	// about the density of a surface obj of the box
+		btAlignedObjectArray<int> idx_old, idx_new;
+		btAlignedObjectArray<btVector4> bary_old, bary_new;
+		double t0 = NowMs();
+		const btScalar margin_old = ScanNearestCentroid(scene.boundary, scene.mesh, idx_old, bary_old);
+		const double ms_old = NowMs() - t0;
+		btScalar margin_new = 0;
+		const double ms_new = TimeMs([&]() { margin_new = CiSoftBodyHelpers::embedSurfaceMesh(scene.boundary, scene.mesh, idx_new, bary_new); }, 3);
+		printf("  %8d %8d | %10.1f %10.2f %7.0fx\n", scene.boundary.size(), scene.mesh.size(), ms_old, ms_new, ms_old / ms_new);
+		KAR_CHECK(margin_new == margin_old);
+	}
+}
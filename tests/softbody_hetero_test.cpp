@@ -0,0 +1,277 @@
+#include "softbody_test_util.h"
+#include "prototype_ver2/softBodyHelper.h"
+
+#ifdef _WIN32
+#include <direct.h>
+#include <io.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+// hetero (ventricle) tetras of CiSoftBodyHelpers::mergeTetra : the .het written without a .het file against the committed
+// Data\...\brain-ventricle.het files and the former scan of every parent tetra per link sample
+
+using namespace kar_test;
+
+namespace
+{
+#ifdef _WIN32
+	const char* path_sep = "\\";
+#else
+	const char* path_sep = "/";
+#endif
+
+	std::string Join(const std::string& dir, const std::string& name)
+	{
+		return dir + path_sep + name;
+	}
+
+	bool Exists(const std::string& path)
+	{
+		FILE* fp = fopen(path.c_str(), "rb");
+		if (fp) fclose(fp);
+		return fp != NULL;
+	}
+
+	// the text of a file without its carriage returns (text=auto checkouts, text mode writes)
+	std::string ReadText(const std::string& path)
+	{
+		std::string text;
+		FILE* fp = fopen(path.c_str(), "rb");
+		if (fp == NULL) return text;
+		int c;
+		while ((c = fgetc(fp)) != EOF) if (c != '\r') text += (char)c;
+		fclose(fp);
+		return text;
+	}
+
+	// the Data folder of the solution and its datasets with a committed .het, none without a Data folder
+	std::vector<std::string> HeteroDataRoots()
+	{
+		std::vector<std::string> roots;
+		const std::string data = DataDir("brain-ventricle.het");
+		if (data.empty())
+		{
+			printf("  no Data folder with brain-ventricle.het found, skipped\n");
+			return roots;
+		}
+		roots.push_back(data);
+
+		std::vector<std::string> dirs;
+#ifdef _WIN32
+		_finddata_t fd;
+		intptr_t h = _findfirst(Join(data, "*").c_str(), &fd);
+		if (h != -1)
+		{
+			do if (fd.attrib & _A_SUBDIR) dirs.push_back(fd.name); while (_findnext(h, &fd) == 0);
+			_findclose(h);
+		}
+#else
+		if (DIR* dir = opendir(data.c_str()))
+		{
+			while (dirent* e = readdir(dir)) dirs.push_back(e->d_name);
+			closedir(dir);
+		}
+#endif
+		std::sort(dirs.begin(), dirs.end());
+		for (const std::string& d : dirs)
+		{
+			if (d == "." || d == "..") continue;
+			const std::string root = Join(data, d);
+			if (Exists(Join(root, "brain-ventricle.het")) && Exists(Join(root, "brain.node")) && Exists(Join(root, "ventricle.node"))) roots.push_back(root);
+		}
+		return roots;
+	}
+
+	// brain and ventricle tetras with the parameters of Simulation::initSoftBody (no surface mesh)
+	struct hetero_pair
+	{
+		CiSoftBody* brain;
+		CiSoftBody* ventricle;
+
+		hetero_pair(const std::string& root)
+		{
+			const float mass[2] = { 1.5f, 0.1f }, kLST[2] = { 0.05f, 0.01f }, kAST[2] = { 0.01f, 0.01f }, kVST[2] = { 0.05f, 0.01f };
+			CiSoftBody::Material* pm[2];
+			for (int i = 0; i < 2; i++)
+			{
+				pm[i] = new(btAlignedAlloc(sizeof(CiSoftBody::Material), 16)) CiSoftBody::Material();
+				pm[i]->m_kLST = kLST[i];
+				pm[i]->m_kAST = kAST[i];
+				pm[i]->m_kVST = kVST[i];
+			}
+			const std::string b = Join(root, "brain"), v = Join(root, "ventricle");
+			btVector3 center = CiSoftBodyHelpers::getCenter((b + ".node").c_str(), 1, false), trans(0, 0, 0);
+			brain = CiSoftBodyHelpers::CreateFromTetGenFile((b + ".ele").c_str(), (b + ".face").c_str(), (b + ".node").c_str(), (b + ".link").c_str(),
+				false, true, true, mass[0], pm[0], 1, false, 1, true, center, trans);
+			ventricle = CiSoftBodyHelpers::CreateFromTetGenFile((v + ".ele").c_str(), (v + ".face").c_str(), (v + ".node").c_str(), (v + ".link").c_str(),
+				false, true, true, mass[1], pm[1], 1, false, 1, false, center, trans);
+		}
+
+		// brain with the ventricle as its child, the .het read or computed and written
+		CiSoftBody* Merge(const std::string& het)
+		{
+			CiSoftBody* psb = CiSoftBodyHelpers::mergeTetra(brain, ventricle, het.c_str());
+			brain = ventricle = NULL;
+			return psb;
+		}
+		~hetero_pair()
+		{
+			delete ventricle;
+			delete brain;
+		}
+	};
+
+	// the former classification of mergeTetra : every parent tetra against the ends and middle of every child link, as a .het
+	std::string ScanHetero(const CiSoftBody* psb, const CiSoftBody* psb2)
+	{
+		std::string het;
+		char line[64];
+		sprintf(line, "%d\n", psb->m_tetras.size());
+		het += line;
+		for (int i = 0; i < psb->m_tetras.size(); i++)
+		{
+			const CiSoftBody::Tetra& t = psb->m_tetras[i];
+			btVector3 n[4];
+			for (int j = 0; j < 4; j++) n[j] = t.m_n[j]->m_x0;
+
+			bool hetero = false;
+			const int nInterpolationCnt = 2;
+			for (int j = 0; j < psb2->m_links.size(); j++)
+			{
+				for (int k = 0; k <= nInterpolationCnt; k++)
+				{
+					const btVector3 p = psb2->m_links[j].m_n[0]->m_x0.lerp(psb2->m_links[j].m_n[1]->m_x0, k / (float)nInterpolationCnt);
+					if (pointInTetrahedron(n[0], n[1], n[2], n[3], p) && pointInTetrahedron(n[1], n[2], n[3], n[0], p) &&
+						pointInTetrahedron(n[2], n[3], n[0], n[1], p) && pointInTetrahedron(n[3], n[0], n[1], n[2], p)) hetero = true;
+				}
+			}
+			sprintf(line, "%d %d\n", i + 1, hetero ? 1 : 0);
+			het += line;
+		}
+		return het;
+	}
+
+	int NumHetero(const std::string& het)
+	{
+		int n = 0;
+		for (size_t i = 1; i < het.size(); i++) n += het[i] == '\n' && het[i - 1] == '1';
+		return n;
+	}
+
+	// the .het written by the checks, in the temp folder
+	std::string HetOut()
+	{
+		return TempPath("kar_test_hetero.het");
+	}
+}
+
+KAR_TEST(softbody_hetero_matches_scan)
+{
+	// a ventricle grid across the middle of a brain grid, the tetras differ in size and orientation
+	const std::string root = TempPath("kar_test_hetero"), het_out = HetOut();
+#ifdef _WIN32
+	_mkdir(root.c_str());
+#else
+	mkdir(root.c_str(), 0755);
+#endif
+	WriteTetGrid(Join(root, "brain"), 10, 0.f, 100.f, 0.3f);
+	WriteTetGrid(Join(root, "ventricle"), 4, 32.f, 61.f, 0.3f);
+	hetero_pair pair(root);
+	const std::string scan = ScanHetero(pair.brain, pair.ventricle);
+	remove(het_out.c_str());
+	delete pair.Merge(het_out);
+	const std::string het = ReadText(het_out);
+	printf("  %d of %d tetras hetero\n", NumHetero(scan), 6 * 10 * 10 * 10);
+	KAR_CHECK(NumHetero(scan) > 0);
+	KAR_CHECK(het == scan);
+	remove(het_out.c_str());
+	RemoveTetGrid(Join(root, "brain"));
+	RemoveTetGrid(Join(root, "ventricle"));
+#ifdef _WIN32
+	_rmdir(root.c_str());
+#else
+	rmdir(root.c_str());
+#endif
+}
+
+KAR_TEST(softbody_hetero_matches_committed)
+{
+	const std::vector<std::string> roots = HeteroDataRoots();
+	const std::string het_out = HetOut();
+	for (const std::string& root : roots)
+	{
+		const std::string committed = ReadText(Join(root, "brain-ventricle.het"));
+
+		// no .het : computed and written
+		remove(het_out.c_str());
+		{
+			hetero_pair pair(root);
+			delete pair.Merge(het_out);
+		}
+		const std::string het = ReadText(het_out);
+		printf("  %s : %d hetero tetras, %s\n", root.c_str(), NumHetero(het), het == committed ? "same as the committed .het" : "DIFFERENT");
+		KAR_CHECK(het == committed);
+	}
+
+	// a .het of another model (tetra count) : computed again and written over
+	if (roots.size() > 0)
+	{
+		FILE* fp = fopen(het_out.c_str(), "w");
+		fprintf(fp, "5\n1 1\n2 1\n3 1\n4 1\n5 1\n");
+		fclose(fp);
+		{
+			hetero_pair pair(roots[0]);
+			delete pair.Merge(het_out);
+		}
+		KAR_CHECK(ReadText(het_out) == ReadText(Join(roots[0], "brain-ventricle.het")));
+	}
+	remove(het_out.c_str());
+}
+
+KAR_BENCH(softbody_hetero_timing)
+{
+	const std::vector<std::string> roots = HeteroDataRoots();
+	if (roots.empty()) return;
+	const std::string het_out = HetOut();
+	printf("  %-40s %7s %7s | %10s %10s %10s %8s | %s\n", "dataset", "tetras", "links", "scan ms", "merge ms", "read ms", "speedup", ".het");
+	for (const std::string& root : roots)
+	{
+		const std::string committed = ReadText(Join(root, "brain-ventricle.het"));
+
+		// computed : the former scan, then mergeTetra without a .het
+		std::string scan, het;
+		double ms_scan = 0, ms_merge = 0, ms_read = 0;
+		int num_tetras = 0, num_links = 0;
+		{
+			hetero_pair pair(root);
+			num_tetras = pair.brain->m_tetras.size();
+			num_links = pair.ventricle->m_links.size();
+			double t0 = NowMs();
+			scan = ScanHetero(pair.brain, pair.ventricle);
+			ms_scan = NowMs() - t0;
+
+			remove(het_out.c_str());
+			t0 = NowMs();
+			CiSoftBody* psb = pair.Merge(het_out);
+			ms_merge = NowMs() - t0;
+			delete psb;
+			het = ReadText(het_out);
+		}
+		// read : mergeTetra with the committed .het
+		{
+			hetero_pair pair(root);
+			const double t0 = NowMs();
+			CiSoftBody* psb = pair.Merge(Join(root, "brain-ventricle.het"));
+			ms_read = NowMs() - t0;
+			delete psb;
+		}
+		const bool same = het == committed && scan == committed;
+		printf("  %-40s %7d %7d | %10.1f %10.1f %10.1f %7.0fx | %s\n", root.c_str(), num_tetras, num_links, ms_scan, ms_merge, ms_read,
+			ms_scan / ms_merge, same ? "identical" : "DIFFERENT");
+		KAR_CHECK(same);
+		KAR_CHECK(ms_merge < ms_scan);
+	}
+	remove(het_out.c_str());
+}
@@ -0,0 +1,129 @@
+#include "softbody_test_util.h"
+
+#include <math.h>
+
+// parallel (graph-coloured) position solver of softbodySolver.cpp against the serial one
+
+using namespace kar_test;
+
+namespace
+{
+	struct grid_scene
+	{
+		Simulation sim;
+		CiSoftBody* psb;
+		float lo;
+		btAlignedObjectArray<btVector3> rest_x;
+
+		std::string base;
+
+		grid_scene(const char* _base, const int n)
+		{
+			base = TempPath(_base);
+			lo = -40.f;
+			WriteTetGrid(base, n, lo, 40.f, 0.3f);
+			psb = LoadTetGrid(base);
+			psb->setSimulationSpace(&sim);
+			sim.softBodies.push_back(psb);	// deleted by the Simulation
+			rest_x.resize(psb->m_nodes.size());
+			for (int i = 0; i < psb->m_nodes.size(); i++) rest_x[i] = psb->m_nodes[i].m_x;
+		}
+		~grid_scene() { RemoveTetGrid(base); }
+
+		// bottom layer pinned, the body squashed to 85% of its height, at rest
+		void Squash()
+		{
+			for (int i = 0; i < psb->m_nodes.size(); i++)
+			{
+				CiSoftBody::Node& n = psb->m_nodes[i];
+				btVector3 x = rest_x[i];
+				x.setY(lo + (x.y() - lo) * 0.85f);
+				n.m_x = n.m_q = x;
+				n.m_v = btVector3(0, 0, 0);
+				n.m_f = btVector3(0, 0, 0);
+				if (rest_x[i].y() < lo + 1e-3f) psb->setMass(i, 0);
+			}
+		}
+
+		// ms of each step
+		std::vector<double> Run(const int mode, const int steps)
+		{
+			psb->setSolverMode(mode);
+			std::vector<double> ms;
+			for (int s = 0; s < steps; s++)
+			{
+				double t0 = NowMs();
+				sim.stepFixed();
+				ms.push_back(NowMs() - t0);
+			}
+			return ms;
+		}
+	};
+}
+
+KAR_TEST(softbody_parallel_solver_mass_change)
+{
+	grid_scene scene("kar_test_grid4", 4);
+	CiSoftBody* psb = scene.psb;
+
+	// colours (and their inverse mass sums) made with the loaded masses
+	scene.Run(CiSoftBody::cfgSolverMode::Parallel, 1);
+	KAR_CHECK(psb->m_parallelReady);
+
+	// pinning and setMass after the colouring
+	scene.Squash();
+	for (int i = 0; i < psb->m_nodes.size(); i++)
+	{
+		if (psb->m_nodes[i].m_im > 0 && (i % 3) == 0) psb->setMass(i, psb->getMass(i) * 4);
+	}
+	scene.Run(CiSoftBody::cfgSolverMode::Parallel, 5);
+
+	const CiSoftBody::ColoredConstraints& cc = psb->m_parVolume;
+	int num_stale = 0;
+	for (int k = 0; k < cc.m_im.size(); k++)
+	{
+		btScalar im_sum = 0;
+		for (int j = 0; j < 4; j++) im_sum += psb->m_nodes[cc.m_nodeIdx[k * 4 + j]].m_im;
+		if (fabs(im_sum - cc.m_im[k]) > 1e-5f * (1 + im_sum)) num_stale++;
+	}
+	KAR_CHECK(cc.m_im.size() == psb->m_volumeConstraints.size());
+	KAR_CHECK(num_stale == 0);
+
+	int num_pinned = 0, num_moved = 0;
+	for (int i = 0; i < psb->m_nodes.size(); i++)
+	{
+		if (psb->m_nodes[i].m_im > 0) continue;
+		num_pinned++;
+		if ((psb->m_nodes[i].m_x - scene.rest_x[i]).length() > 1e-5f) num_moved++;
+	}
+	KAR_CHECK(num_pinned == 5 * 5);
+	KAR_CHECK(num_moved == 0);
+}
+
+KAR_BENCH(softbody_solver_serial_vs_parallel)
+{
+	const int grid_n[] = { 8, 14, 20 };
+	const int num_steps = 30;
+	printf("  %8s %6s | %9s %9s | %12s %12s\n", "tetras", "solver", "ms/step", "p95", "stretch rms", "volume rms");
+	for (int g = 0; g < 3; g++)
+	{
+		char base[64];
+		sprintf(base, "kar_test_grid%d", grid_n[g]);
+		grid_scene scene(base, grid_n[g]);
+
+		btScalar residual[2][2];
+		for (int mode = 0; mode < 2; mode++)
+		{
+			const int solver_mode = mode == 0 ? CiSoftBody::cfgSolverMode::Serial : CiSoftBody::cfgSolverMode::Parallel;
+			scene.Squash();
+			if (solver_mode == CiSoftBody::cfgSolverMode::Parallel) scene.psb->initParallelSolver();	// colouring outside of the timing
+			std::vector<double> ms = scene.Run(solver_mode, num_steps);
+			scene.psb->getConstraintResidual(residual[mode][0], residual[mode][1]);
+			printf("  %8d %6s | %9.3f %9.3f | %12.5f %12.5f\n", scene.psb->m_tetras.size(), mode == 0 ? "serial" : "par",
+				Percentile(ms, 0.5), Percentile(ms, 0.95), residual[mode][0], residual[mode][1]);
+		}
+		// the colour order converges as well as the serial order
+		KAR_CHECK(residual[1][0] <= residual[0][0] * 1.5f + 1e-4f);
+		KAR_CHECK(residual[1][1] <= residual[0][1] * 1.5f + 1e-4f);
+	}
+}
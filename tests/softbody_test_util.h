@@ -0,0 +1,102 @@
+#pragma once
+
+#include "test_util.h"
+#include "prototype_ver2/Simulation.h"
+
+#include <stdio.h>
+#include <string>
+
+// synthetic tetgen models for the soft-body checks (no Data folder needed)
+namespace kar_test
+{
+	// box [lo, hi]^3 of n^3 cubes, 6 tetras per cube (tetgen .node / .ele, 1-based), inner nodes jittered by jitter * cube size
+	// the .face and .link files of an older run are removed, CreateFromTetGenFile writes them again
+	inline void WriteTetGrid(const std::string& base, const int n, const float lo, const float hi, const float jitter)
+	{
+		auto id = [n](int i, int j, int k) { return (k * (n + 1) + j) * (n + 1) + i; };
+		const float h = (hi - lo) / n;
+		lcg rng(11);
+
+		FILE* fp = fopen((base + ".node").c_str(), "w");
+		fprintf(fp, "%d 3 0 0\n", (n + 1) * (n + 1) * (n + 1));
+		for (int k = 0; k <= n; k++) for (int j = 0; j <= n; j++) for (int i = 0; i <= n; i++)
+		{
+			const bool inner = i > 0 && i < n && j > 0 && j < n && k > 0 && k < n;
+			float d[3] = { 0, 0, 0 };
+			if (inner) for (int a = 0; a < 3; a++) d[a] = rng.Uniform(-0.5f, 0.5f) * jitter * h;
+			fprintf(fp, "%d %.6f %.6f %.6f\n", id(i, j, k) + 1, lo + i * h + d[0], lo + j * h + d[1], lo + k * h + d[2]);
+		}
+		fclose(fp);
+
+		// Kuhn subdivision : one tetra per axis order, the cubes share their faces
+		const int order[6][3] = { { 0, 1, 2 }, { 0, 2, 1 }, { 1, 0, 2 }, { 1, 2, 0 }, { 2, 0, 1 }, { 2, 1, 0 } };
+		fp = fopen((base + ".ele").c_str(), "w");
+		fprintf(fp, "%d 4 0\n", n * n * n * 6);
+		int t = 1;
+		for (int k = 0; k < n; k++) for (int j = 0; j < n; j++) for (int i = 0; i < n; i++)
+		{
+			for (int p = 0; p < 6; p++)
+			{
+				int c[3] = { i, j, k }, v[4];
+				v[0] = id(i, j, k);
+				for (int q = 0; q < 3; q++) { c[order[p][q]]++; v[q + 1] = id(c[0], c[1], c[2]); }
+				fprintf(fp, "%d %d %d %d %d\n", t++, v[0] + 1, v[1] + 1, v[2] + 1, v[3] + 1);
+			}
+		}
+		fclose(fp);
+
+		remove((base + ".face").c_str());
+		remove((base + ".link").c_str());
+	}
+
+	// surface mesh (.obj) of the box [lo, hi]^3 moved 1% inside, m x m quads per side
+	inline void WriteBoxObj(const std::string& base, const int m, const float lo, const float hi)
+	{
+		const float inset = 0.01f * (hi - lo), h = (hi - lo) / m;
+		FILE* fp = fopen((base + ".obj").c_str(), "w");
+		int num_vtx = 0;
+		for (int axis = 0; axis < 3; axis++) for (int side = 0; side < 2; side++)
+		{
+			const int first = num_vtx;
+			for (int b = 0; b <= m; b++) for (int a = 0; a <= m; a++)
+			{
+				float p[3];
+				p[axis] = side ? hi - inset : lo + inset;
+				p[(axis + 1) % 3] = lo + a * h;
+				p[(axis + 2) % 3] = lo + b * h;
+				fprintf(fp, "v %f %f %f\n", p[0], p[1], p[2]);
+				num_vtx++;
+			}
+			for (int b = 0; b < m; b++) for (int a = 0; a < m; a++)
+			{
+				const int v0 = first + b * (m + 1) + a + 1;
+				fprintf(fp, "f %d %d %d\nf %d %d %d\n", v0, v0 + 1, v0 + m + 2, v0, v0 + m + 2, v0 + m + 1);
+			}
+		}
+		fclose(fp);
+	}
+
+	inline void RemoveTetGrid(const std::string& base)
+	{
+		const char* ext[] = { ".node", ".ele", ".face", ".link" };
+		for (int i = 0; i < 4; i++) remove((base + ext[i]).c_str());
+	}
+
+	// tetra body of the files of WriteTetGrid with the brain parameters of Simulation::initSoftBody, constraints initialised
+	inline CiSoftBody* LoadTetGrid(const std::string& base, const float mass = 1.5f)
+	{
+		CiSoftBody::Material* pm = new(btAlignedAlloc(sizeof(CiSoftBody::Material), 16)) CiSoftBody::Material();
+		pm->m_kLST = 0.05f;
+		pm->m_kAST = 0.01f;
+		pm->m_kVST = 0.05f;
+
+		btVector3 center(0, 0, 0), trans(0, 0, 0);
+		CiSoftBody* psb = CiSoftBodyHelpers::CreateFromTetGenFile((base + ".ele").c_str(), (base + ".face").c_str(), (base + ".node").c_str(), (base + ".link").c_str(),
+			false, true, true, mass, pm, 1, false, 1, true, center, trans);
+		psb->m_cfg.kDP = 0.3f;
+		psb->m_cfg.piterations = 10;
+		psb->m_cfg.viterations = 0;
+		psb->initConstraints();
+		return psb;
+	}
+}
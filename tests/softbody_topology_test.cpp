@@ -0,0 +1,359 @@
+#include "softbody_test_util.h"
+#include "prototype_ver2/softBodyHelper.h"
+
+#include <math.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// topology of CiSoftBodyHelpers::CreateFromTetGenFile and the constraints of initConstraints (softbodyTopology.cpp)
+// against the former scans : position merge, link dedup matrix, face merge, checkLink / checkFace
+
+using namespace kar_test;
+
+namespace
+{
+	// FNV-1a, topology : node indices of every element and constraint, geometry : positions, masses and rest values
+	struct fingerprint
+	{
+		unsigned long long topology, geometry;
+
+		static void Mix(unsigned long long& h, const void* p, const size_t n)
+		{
+			const unsigned char* c = (const unsigned char*)p;
+			for (size_t i = 0; i < n; i++) h = (h ^ c[i]) * 1099511628211ull;
+		}
+		void MixIdx(const CiSoftBody* psb, const CiSoftBody::Node* n)
+		{
+			const int idx = (int)(n - &psb->m_nodes[0]);
+			Mix(topology, &idx, 4);
+		}
+		void MixConstraints(const CiSoftBody* psb, const CiSoftBody::tConstraintArray& a)
+		{
+			const int size = a.size();
+			Mix(topology, &size, 4);
+			for (int i = 0; i < a.size(); i++)
+			{
+				const int is_use = a[i].m_isUse;
+				Mix(topology, &is_use, 4);
+				if (!a[i].m_isUse) continue;
+				Mix(topology, &a[i].m_nodeCnt, 4);
+				for (int j = 0; j < a[i].m_nodeCnt; j++) MixIdx(psb, a[i].m_n[j]);
+				Mix(geometry, &a[i].m_rest, 4);
+				Mix(geometry, &a[i].m_im, 4);
+				Mix(geometry, &a[i].m_prime, 4);
+			}
+		}
+
+		// the rest lengths of the links are left out, the load from the .link file sets them later
+		explicit fingerprint(const CiSoftBody* psb)
+		{
+			topology = geometry = 14695981039346656037ull;
+			const int sizes[3] = { psb->m_nodes.size(), psb->m_links.size(), psb->m_tetrasSurface.size() };
+			Mix(topology, sizes, sizeof(sizes));
+			for (int i = 0; i < psb->m_nodes.size(); i++)
+			{
+				const CiSoftBody::Node& n = psb->m_nodes[i];
+				const int surface = n.m_surface;
+				Mix(topology, &surface, 4);
+				Mix(topology, &n.m_nAdjLinkCnt, 4);
+				Mix(geometry, &n.m_x, 12);
+				Mix(geometry, &n.m_im, 4);
+			}
+			for (int i = 0; i < psb->m_links.size(); i++) for (int j = 0; j < 2; j++) MixIdx(psb, psb->m_links[i].m_n[j]);
+			for (int i = 0; i < psb->m_tetras.size(); i++) for (int j = 0; j < 4; j++) MixIdx(psb, psb->m_tetras[i].m_n[j]);
+			for (int i = 0; i < psb->m_tetrasSurface.size(); i++) for (int j = 0; j < 3; j++) MixIdx(psb, psb->m_tetrasSurface[i].m_n[j]);
+			MixConstraints(psb, psb->m_stretchConstraints);
+			MixConstraints(psb, psb->m_bendingConstraints_dihedral);
+			MixConstraints(psb, psb->m_bendingConstraints_triangle);
+			MixConstraints(psb, psb->m_volumeConstraints_surface);
+			MixConstraints(psb, psb->m_volumeConstraints);
+		}
+		bool operator==(const fingerprint& o) const { return topology == o.topology && geometry == o.geometry; }
+	};
+
+	// topology fingerprint of the 6^3 grid (jitter 0.3) with the former CreateFromTetGenFile / initConstraints (node indices only, the same on every compiler)
+	const unsigned long long former_grid6_topology = 0x0fbbdeb830903ed3ull;
+
+	// the brain parameters of Simulation::initSoftBody without the centering (the positions of the files, bit for bit)
+	CiSoftBody* LoadTopology(const std::string& base)
+	{
+		CiSoftBody::Material* pm = new(btAlignedAlloc(sizeof(CiSoftBody::Material), 16)) CiSoftBody::Material();
+		pm->m_kLST = 0.05f;
+		pm->m_kAST = 0.01f;
+		pm->m_kVST = 0.05f;
+
+		btVector3 center(0, 0, 0), trans(0, 0, 0);
+		CiSoftBody* psb = CiSoftBodyHelpers::CreateFromTetGenFile((base + ".ele").c_str(), (base + ".face").c_str(), (base + ".node").c_str(), (base + ".link").c_str(),
+			false, true, true, 1.5f, pm, 1, false, 1, false, center, trans);
+		psb->initConstraints();
+		return psb;
+	}
+
+	// the grid of base with every node written twice (the copies in the reverse order), the odd tetras on the copies
+	void WriteDuplicatedGrid(const std::string& base, const std::string& dup)
+	{
+		char line[256];
+		std::vector<std::string> nodes;
+		FILE* fp = fopen((base + ".node").c_str(), "r");
+		fgets(line, sizeof(line), fp);
+		while (fgets(line, sizeof(line), fp))
+		{
+			int idx;
+			char xyz[200];
+			if (sscanf(line, "%d %199[^\n]", &idx, xyz) == 2) nodes.push_back(xyz);
+		}
+		fclose(fp);
+		const int num_nodes = (int)nodes.size();
+		fp = fopen((dup + ".node").c_str(), "w");
+		fprintf(fp, "%d 3 0 0\n", num_nodes * 2);
+		for (int i = 0; i < num_nodes; i++) fprintf(fp, "%d %s\n", i + 1, nodes[i].c_str());
+		for (int i = 0; i < num_nodes; i++) fprintf(fp, "%d %s\n", num_nodes + i + 1, nodes[num_nodes - 1 - i].c_str());
+		fclose(fp);
+
+		FILE* in = fopen((base + ".ele").c_str(), "r");
+		fp = fopen((dup + ".ele").c_str(), "w");
+		fgets(line, sizeof(line), in);
+		fputs(line, fp);
+		int t, v[4];
+		while (fscanf(in, "%d %d %d %d %d", &t, &v[0], &v[1], &v[2], &v[3]) == 5)
+		{
+			if (t % 2) for (int j = 0; j < 4; j++) v[j] = 2 * num_nodes - v[j] + 1;
+			fprintf(fp, "%d %d %d %d %d\n", t, v[0], v[1], v[2], v[3]);
+		}
+		fclose(in);
+		fclose(fp);
+		remove((dup + ".face").c_str());
+		remove((dup + ".link").c_str());
+	}
+
+	int NodeIdx(const CiSoftBody* psb, const CiSoftBody::Node* n)
+	{
+		return (int)(n - &psb->m_nodes[0]);
+	}
+
+	// the former checkLink / checkFace : a scan of every link / face
+	bool ScanLink(const CiSoftBody* psb, const CiSoftBody::Node* n0, const CiSoftBody::Node* n1)
+	{
+		for (int i = 0; i < psb->m_links.size(); i++)
+		{
+			const CiSoftBody::Link& l = psb->m_links[i];
+			if ((l.m_n[0] == n0 && l.m_n[1] == n1) || (l.m_n[0] == n1 && l.m_n[1] == n0)) return true;
+		}
+		return false;
+	}
+	bool ScanFace(const CiSoftBody* psb, const int n0, const int n1, const int n2)
+	{
+		const CiSoftBody::Node* n[] = { &psb->m_nodes[n0], &psb->m_nodes[n1], &psb->m_nodes[n2] };
+		for (int i = 0; i < psb->m_faces.size(); i++)
+		{
+			int c = 0;
+			for (int j = 0; j < 3; j++)
+			{
+				const CiSoftBody::Node* fn = psb->m_faces[i].m_n[j];
+				if (fn == n[0] || fn == n[1] || fn == n[2]) c |= 1 << j; else break;
+			}
+			if (c == 7) return true;
+		}
+		return false;
+	}
+
+	// the former link dedup of CreateFromTetGenFile : the edges of the tetras in order, a nodes x nodes matrix
+	std::vector<int> ScanLinks(const CiSoftBody* psb)
+	{
+		const int num_nodes = psb->m_nodes.size();
+		const int idx1[6] = { 0, 1, 2, 0, 1, 2 }, idx2[6] = { 1, 2, 0, 3, 3, 3 };
+		std::vector<char> chks((size_t)num_nodes * num_nodes, 0);
+		std::vector<int> links;
+		for (int i = 0; i < psb->m_tetras.size(); i++)
+		{
+			for (int j = 0; j < 6; j++)
+			{
+				const int n0 = NodeIdx(psb, psb->m_tetras[i].m_n[idx1[j]]), n1 = NodeIdx(psb, psb->m_tetras[i].m_n[idx2[j]]);
+				if (chks[(size_t)n1 * num_nodes + n0]) continue;
+				chks[(size_t)n1 * num_nodes + n0] = chks[(size_t)n0 * num_nodes + n1] = 1;
+				links.push_back(n0);
+				links.push_back(n1);
+			}
+		}
+		return links;
+	}
+
+	// the former face merge : every tetra face against the merged ones, a merged face keeps the node order of its first tetra face
+	std::vector<int> ScanSurfaceFaces(const CiSoftBody* psb)
+	{
+		std::vector<int> sorted, first, count;
+		for (int i = 0; i < psb->m_tetrasFaces.size(); i++)
+		{
+			int key[3], j;
+			for (int k = 0; k < 3; k++) key[k] = NodeIdx(psb, psb->m_tetrasFaces[i].m_n[k]);
+			std::sort(key, key + 3);
+			for (j = 0; j < (int)count.size(); j++)
+				if (sorted[j * 3] == key[0] && sorted[j * 3 + 1] == key[1] && sorted[j * 3 + 2] == key[2]) break;
+			if (j == (int)count.size())
+			{
+				sorted.insert(sorted.end(), key, key + 3);
+				for (int k = 0; k < 3; k++) first.push_back(NodeIdx(psb, psb->m_tetrasFaces[i].m_n[k]));
+				count.push_back(0);
+			}
+			count[j]++;
+		}
+		std::vector<int> surface;
+		for (size_t j = 0; j < count.size(); j++)
+			if (count[j] == 1) surface.insert(surface.end(), first.begin() + j * 3, first.begin() + j * 3 + 3);
+		return surface;
+	}
+}
+
+KAR_TEST(softbody_topology_matches_scan)
+{
+	const int n = 6;
+	const std::string base = TempPath("kar_test_topo"), dup_base = TempPath("kar_test_topo_dup");
+	WriteTetGrid(base, n, 0.f, 100.f, 0.3f);
+	WriteDuplicatedGrid(base, dup_base);
+	CiSoftBody* psb = LoadTopology(base);
+	const fingerprint built(psb);
+
+	// the same grid from the files written by the first load (.link, .face)
+	CiSoftBody* cached = LoadTopology(base);
+	KAR_CHECK(fingerprint(cached) == built);
+	delete cached;
+
+	// duplicated positions merged to their first node
+	CiSoftBody* dup = LoadTopology(dup_base);
+	KAR_CHECK(dup->m_nodes.size() == (n + 1) * (n + 1) * (n + 1));
+	KAR_CHECK(fingerprint(dup) == built);
+	delete dup;
+
+	printf("  %d nodes, %d links, %d surface faces, fingerprint %016llx %016llx\n",
+		psb->m_nodes.size(), psb->m_links.size(), psb->m_tetrasSurface.size(), built.topology, built.geometry);
+	KAR_CHECK(built.topology == former_grid6_topology);
+
+	// links and surface faces in the order of the former scans
+	const std::vector<int> links = ScanLinks(psb);
+	KAR_CHECK((int)links.size() == psb->m_links.size() * 2);
+	int num_diff = 0;
+	for (int i = 0; i < psb->m_links.size() && i * 2 < (int)links.size(); i++)
+	{
+		const CiSoftBody::Link& l = psb->m_links[i];
+		num_diff += NodeIdx(psb, l.m_n[0]) != links[i * 2] || NodeIdx(psb, l.m_n[1]) != links[i * 2 + 1];
+		num_diff += l.m_rl != (l.m_n[0]->m_x - l.m_n[1]->m_x).length();
+	}
+	const std::vector<int> surface = ScanSurfaceFaces(psb);
+	KAR_CHECK((int)surface.size() == psb->m_tetrasSurface.size() * 3);
+	for (int i = 0; i < psb->m_tetrasSurface.size() && i * 3 < (int)surface.size(); i++)
+		for (int j = 0; j < 3; j++) num_diff += NodeIdx(psb, psb->m_tetrasSurface[i].m_n[j]) != surface[i * 3 + j];
+	std::vector<int> adj_cnt(psb->m_nodes.size(), 0);
+	for (int i = 0; i < psb->m_links.size(); i++) for (int j = 0; j < 2; j++) adj_cnt[NodeIdx(psb, psb->m_links[i].m_n[j])]++;
+	for (int i = 0; i < psb->m_nodes.size(); i++) num_diff += psb->m_nodes[i].m_nAdjLinkCnt != adj_cnt[i];
+	KAR_CHECK(num_diff == 0);
+
+	// checkLink : the links of the tetras (both orders) and random pairs, then after a link is added and removed
+	lcg rng(5);
+	const int num_nodes = psb->m_nodes.size();
+	int num_checks = 0, num_wrong = 0;
+	auto check_links = [&]()
+	{
+		for (int i = 0; i < 600; i++)
+		{
+			const CiSoftBody::Tetra& t = psb->m_tetras[rng.Next() % psb->m_tetras.size()];
+			const int a = rng.Next() % 4, b = (a + 1 + rng.Next() % 3) % 4;
+			const int r0 = rng.Next() % num_nodes, r1 = rng.Next() % num_nodes;
+			num_wrong += psb->checkLink(t.m_n[a], t.m_n[b]) != ScanLink(psb, t.m_n[a], t.m_n[b]);
+			num_wrong += psb->checkLink(r0, r1) != ScanLink(psb, &psb->m_nodes[r0], &psb->m_nodes[r1]);
+			num_checks += 2;
+		}
+	};
+	check_links();
+	int far0 = 0, far1 = num_nodes - 1;		// opposite corners of the box : no link
+	KAR_CHECK(!psb->checkLink(far0, far1));
+	psb->appendLink(far0, far1, psb->m_materials[0], true);
+	KAR_CHECK(psb->checkLink(far1, far0));
+	psb->appendLink(far1, far0, psb->m_materials[0], true);
+	KAR_CHECK(psb->m_links.size() * 2 == (int)links.size() + 2);
+	check_links();
+	psb->m_links.resize(psb->m_links.size() - 1);
+	KAR_CHECK(!psb->checkLink(far0, far1));
+	check_links();
+
+	// checkFace : the surface faces appended as faces (any node order), then one of them edited in place
+	for (int i = 0; i < psb->m_tetrasSurface.size(); i += 3)
+	{
+		const CiSoftBody::Face& f = psb->m_tetrasSurface[i];
+		psb->appendFace(NodeIdx(psb, f.m_n[0]), NodeIdx(psb, f.m_n[1]), NodeIdx(psb, f.m_n[2]), psb->m_materials[0]);
+	}
+	auto check_faces = [&]()
+	{
+		for (int i = 0; i < 600; i++)
+		{
+			const CiSoftBody::Face& f = psb->m_tetrasSurface[rng.Next() % psb->m_tetrasSurface.size()];
+			const int v[3] = { NodeIdx(psb, f.m_n[0]), NodeIdx(psb, f.m_n[1]), NodeIdx(psb, f.m_n[2]) };
+			const int r = rng.Next() % 3;
+			num_wrong += psb->checkFace(v[r], v[(r + 2) % 3], v[(r + 1) % 3]) != ScanFace(psb, v[r], v[(r + 2) % 3], v[(r + 1) % 3]);
+			num_checks++;
+		}
+	};
+	check_faces();
+	psb->m_faces[0].m_n[2] = &psb->m_nodes[far1];
+	check_faces();
+	printf("  %d checkLink / checkFace calls against the scans\n", num_checks);
+	KAR_CHECK(num_wrong == 0);
+	delete psb;
+
+#ifdef _OPENMP
+	// the constraints of one thread and of all of them
+	const int num_threads = omp_get_max_threads();
+	omp_set_num_threads(1);
+	CiSoftBody* serial = LoadTopology(base);
+	omp_set_num_threads(num_threads);
+	KAR_CHECK(fingerprint(serial) == built);
+	delete serial;
+#endif
+
+	RemoveTetGrid(base);
+	RemoveTetGrid(dup_base);
+}
+
+KAR_BENCH(softbody_topology_build)
+{
+	// 10k to 1M tetras
+	const int grid_n[] = { 12, 26, 38, 55 };
+	printf("  %8s %8s %8s | %10s %10s %12s | %8s %10s\n", "tetras", "nodes", "links", "build ms", "cached ms", "constraint ms", "us/tet", "scan ms");
+	double us_first = 0;
+	const std::string base = TempPath("kar_test_topo");
+	for (int g = 0; g < 4; g++)
+	{
+		const int n = grid_n[g];
+		WriteTetGrid(base, n, 0.f, 100.f, 0.3f);
+
+		// first load : links and surface faces from the tetras, the files written
+		double t0 = NowMs();
+		CiSoftBody* psb = LoadTopology(base);
+		const double ms_build = NowMs() - t0;
+		const double ms_constraints = TimeMs([&]() { psb->initConstraints(); }, 3);
+		t0 = NowMs();
+		CiSoftBody* cached = LoadTopology(base);
+		const double ms_cached = NowMs() - t0;
+		KAR_CHECK(fingerprint(cached).topology == fingerprint(psb).topology);
+
+		// the former link and face merges, quadratic : the smallest grid only
+		char scan[32] = "-";
+		if (g == 0)
+		{
+			t0 = NowMs();
+			const size_t num_scanned = ScanLinks(psb).size() + ScanSurfaceFaces(psb).size();
+			sprintf(scan, "%.1f", NowMs() - t0);
+			KAR_CHECK(num_scanned == (size_t)(psb->m_links.size() * 2 + psb->m_tetrasSurface.size() * 3));
+		}
+
+		const double us = ms_build * 1000.0 / psb->m_tetras.size();
+		printf("  %8d %8d %8d | %10.1f %10.1f %12.1f | %8.2f %10s\n", psb->m_tetras.size(), psb->m_nodes.size(), psb->m_links.size(),
+			ms_build, ms_cached, ms_constraints, us, scan);
+		// linear : about the same time per tetra from 10k to 1M (the former merges grew with the square)
+		if (g == 0) us_first = us;
+		else KAR_CHECK(us < us_first * 4);
+		delete cached;
+		delete psb;
+	}
+	RemoveTetGrid(base);
+}
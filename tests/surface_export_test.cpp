@@ -0,0 +1,172 @@
+#include "softbody_test_util.h"
+#include "prototype_ver2/SurfaceExport.h"
+
+#include <thread>
+#include <atomic>
+
+// SurfaceExport : the surface faces of the bodies as one indexed mesh (shared nodes merged), area weighted vertex normals,
+// and the frames handed from the deform thread to the render thread through the triple buffer
+
+using namespace kar_test;
+
+namespace
+{
+	// body of the given nodes whose surface faces are tris (3 node indices per face)
+	CiSoftBody* MakeSurfaceBody(const std::vector<btVector3>& x, const std::vector<int>& tris)
+	{
+		CiSoftBody* psb = new CiSoftBody((int)x.size(), &x[0], NULL);
+		for (size_t i = 0; i < tris.size(); i += 3)
+		{
+			CiSoftBody::Face f;
+			memset(&f, 0, sizeof(CiSoftBody::Face));
+			for (int j = 0; j < 3; j++) f.m_n[j] = &psb->m_nodes[tris[i + j]];
+			psb->m_surfaceMeshFace.push_back(f);
+		}
+		return psb;
+	}
+
+	// unit octahedron, outward (counter-clockwise) faces
+	CiSoftBody* MakeOctahedron(const btVector3& center)
+	{
+		std::vector<btVector3> x = { btVector3(1, 0, 0), btVector3(-1, 0, 0), btVector3(0, 1, 0), btVector3(0, -1, 0), btVector3(0, 0, 1), btVector3(0, 0, -1) };
+		for (btVector3& p : x) p += center;
+		const std::vector<int> tris = { 0, 2, 4, 2, 1, 4, 1, 3, 4, 3, 0, 4, 2, 0, 5, 1, 2, 5, 3, 1, 5, 0, 3, 5 };
+		return MakeSurfaceBody(x, tris);
+	}
+
+	btVector3 Vec3(const float* v) { return btVector3(v[0], v[1], v[2]); }
+}
+
+// a node shared by several faces is one vertex, the triangles index the vertices of their nodes, bodies stay apart
+KAR_TEST(surface_export_vertex_dedup)
+{
+	CiSoftBody* bodies[2] = { MakeOctahedron(btVector3(0, 0, 0)), MakeOctahedron(btVector3(5, 0, 0)) };
+	SurfaceExport exporter;
+	KAR_CHECK(exporter.addSurface(bodies, 2) == 0);
+	KAR_CHECK(exporter.getNumVertices(0) == 12);
+	KAR_CHECK(exporter.getNumTriangles(0) == 16);
+
+	exporter.write();
+	KAR_CHECK(exporter.acquire());
+	const SurfaceFrame& frame = exporter.getFrame();
+	KAR_CHECK(frame.pos.size() == 1 && frame.pos[0].size() == 12 * 3);
+
+	// every triangle corner is the position of its face node
+	const unsigned int* idx = exporter.getIndices(0);
+	bool same = true;
+	int t = 0;
+	for (int b = 0; b < 2; b++)
+		for (int i = 0; i < bodies[b]->m_surfaceMeshFace.size(); i++, t++)
+			for (int j = 0; j < 3; j++)
+				same = same && Vec3(&frame.pos[0][idx[t * 3 + j] * 3]) == bodies[b]->m_surfaceMeshFace[i].m_n[j]->m_x;
+	KAR_CHECK(same);
+
+	// a second surface gets its own vertices and frame arrays
+	KAR_CHECK(exporter.addSurface(bodies, 1) == 1);
+	KAR_CHECK(exporter.getNumSurfaces() == 2 && exporter.getNumVertices(1) == 6);
+
+	delete bodies[0];
+	delete bodies[1];
+}
+
+// vertex normal : sum of the face normals weighted by the face areas (cross products), normalized
+KAR_TEST(surface_export_area_weighted_normals)
+{
+	// the corner at the origin is shared by a large face in xy (normal +z) and a small one in xz (normal -y)
+	const float a = 2.f, b = 0.5f;
+	std::vector<btVector3> x = { btVector3(0, 0, 0), btVector3(a, 0, 0), btVector3(0, a, 0), btVector3(0, 0, b), btVector3(b, 0, 0) };
+	CiSoftBody* psb = MakeSurfaceBody(x, { 0, 1, 2, 0, 4, 3 });
+	SurfaceExport exporter;
+	exporter.addSurface(&psb, 1);
+	exporter.write();
+	KAR_CHECK(exporter.acquire());
+	const SurfaceFrame& frame = exporter.getFrame();
+
+	// vertex 0 : areas a^2 / 2 and b^2 / 2
+	const btVector3 expected = btVector3(0, -b * b, a * a).normalized();
+	KAR_CHECK((Vec3(&frame.nrl[0][0]) - expected).length() < 1e-5f);
+	// single face vertices take their face normal
+	KAR_CHECK((Vec3(&frame.nrl[0][1 * 3]) - btVector3(0, 0, 1)).length() < 1e-5f);
+	KAR_CHECK((Vec3(&frame.nrl[0][3 * 3]) - btVector3(0, -1, 0)).length() < 1e-5f);
+	delete psb;
+
+	// octahedron : the vertex normals point outward along the axes, the same after a move (no stale sums)
+	CiSoftBody* octa = MakeOctahedron(btVector3(0, 0, 0));
+	SurfaceExport octa_exporter;
+	octa_exporter.addSurface(&octa, 1);
+	for (int pass = 0; pass < 2; pass++)
+	{
+		octa_exporter.write();
+		KAR_CHECK(octa_exporter.acquire());
+		const SurfaceFrame& f = octa_exporter.getFrame();
+		float max_err = 0;
+		for (int i = 0; i < 6; i++)
+		{
+			const btVector3 out = (Vec3(&f.pos[0][i * 3]) - btVector3(pass * 3.f, 0, 0)).normalized();
+			max_err = std::max(max_err, (float)(Vec3(&f.nrl[0][i * 3]) - out).length());
+		}
+		KAR_CHECK(max_err < 1e-5f);
+		for (int i = 0; i < octa->m_nodes.size(); i++) octa->m_nodes[i].m_x += btVector3(3, 0, 0);
+	}
+	delete octa;
+}
+
+// the deform thread moves the nodes and writes a frame per step, the render thread acquires the latest one :
+// every acquired frame is complete (all vertices of the same step) and newer than the previous one
+KAR_TEST(surface_export_thread_handoff)
+{
+	CiSoftBody* octa = MakeOctahedron(btVector3(0, 0, 0));
+	SurfaceExport exporter;
+	exporter.addSurface(&octa, 1);
+	std::vector<btVector3> x0(6);
+	for (int i = 0; i < 6; i++) x0[i] = octa->m_nodes[i].m_x;
+
+	KAR_CHECK(!exporter.acquire()); // nothing written yet
+	exporter.write();
+	KAR_CHECK(exporter.acquire() && exporter.getFrame().frame == 1);
+	const std::vector<float> x_base = exporter.getFrame().pos[0]; // surface vertex order
+
+	const int num_steps = 20000;
+	std::atomic<bool> done(false);
+	std::thread deform([&]()
+	{
+		for (int step = 1; step <= num_steps; step++)
+		{
+			for (int i = 0; i < 6; i++) octa->m_nodes[i].m_x = x0[i] + btVector3((btScalar)step, 0, 0);
+			exporter.write();
+			if ((step & 63) == 0) std::this_thread::yield();
+		}
+		done = true;
+	});
+
+	long long last = 1;
+	int num_torn = 0, num_back = 0, num_acquired = 0;
+	for (;;)
+	{
+		const bool finished = done;
+		if (exporter.acquire())
+		{
+			const SurfaceFrame& f = exporter.getFrame();
+			for (int i = 0; i < 6; i++)
+				num_torn += f.pos[0][i * 3] != x_base[i * 3] + (float)(f.frame - 1);
+			num_back += f.frame <= last;
+			last = f.frame;
+			num_acquired++;
+		}
+		else if (finished) break;
+		else std::this_thread::yield();
+	}
+	deform.join();
+	KAR_CHECK(num_torn == 0 && num_back == 0);
+	KAR_CHECK(last == num_steps + 1 && num_acquired > 0);
+
+	// no new frame : acquire is false and the last frame stays readable
+	KAR_CHECK(!exporter.acquire());
+	KAR_CHECK(exporter.getFrame().frame == num_steps + 1);
+
+	// clear : no surface, write does nothing
+	exporter.clear();
+	exporter.write();
+	KAR_CHECK(exporter.getNumSurfaces() == 0 && !exporter.acquire());
+	delete octa;
+}
@@ -0,0 +1,64 @@
+#include "test_util.h"
+
+#include <string.h>
+
+// usage : tests [--bench] [name filter]
+//  no argument : every KAR_TEST
+//  --bench : the KAR_BENCH cases as well
+//  name filter : only the cases whose name contains it
+namespace kar_test
+{
+	static int num_failures = 0;
+	static std::string exe_path;
+
+	std::vector<test_case>& Registry()
+	{
+		static std::vector<test_case> registry;
+		return registry;
+	}
+
+	void ReportFailure(const char* file, const int line, const char* expr)
+	{
+		printf("  FAILED %s(%d) : %s\n", file, line, expr);
+		num_failures++;
+	}
+
+	const std::string& ExePath()
+	{
+		return exe_path;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	using namespace kar_test;
+
+	if (argc > 0) exe_path = argv[0];
+	bool run_bench = false;
+	const char* filter = NULL;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--bench") == 0) run_bench = true;
+		else filter = argv[i];
+	}
+
+	int num_run = 0, num_failed_cases = 0;
+	for (const test_case& tc : Registry())
+	{
+		if (tc.is_bench && !run_bench) continue;
+		if (filter && strstr(tc.name, filter) == NULL) continue;
+
+		printf("[%s] %s\n", tc.is_bench ? "bench" : "test", tc.name);
+		fflush(stdout);
+		const int failures_before = num_failures;
+		double t0 = NowMs();
+		tc.func();
+		const bool passed = num_failures == failures_before;
+		printf("  %s (%.1f ms)\n", passed ? "ok" : "FAILED", NowMs() - t0);
+		num_run++;
+		if (!passed) num_failed_cases++;
+	}
+
+	printf("%d case(s) run, %d failed\n", num_run, num_failed_cases);
+	return num_failed_cases == 0 ? 0 : 1;
+}
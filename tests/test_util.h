@@ -0,0 +1,111 @@
+#pragma once
+
+#include <stdio.h>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <filesystem>
+
+// console checks and benchmarks of the engine modules (no device, no vzm window)
+// KAR_TEST(name) { ... } : run by default, KAR_CHECK failures are counted and make the exit code non-zero
+// KAR_BENCH(name) { ... } : run with --bench, prints its timings (KAR_CHECK can still fail it)
+namespace kar_test
+{
+	typedef void(*test_func)();
+
+	struct test_case
+	{
+		const char* name;
+		const char* file;
+		test_func func;
+		bool is_bench;
+	};
+
+	std::vector<test_case>& Registry();
+	void ReportFailure(const char* file, const int line, const char* expr);
+	// the executable, argv[0] of main
+	const std::string& ExePath();
+
+	struct test_registrar
+	{
+		test_registrar(const char* name, const char* file, test_func func, const bool is_bench)
+		{
+			test_case tc = { name, file, func, is_bench };
+			Registry().push_back(tc);
+		}
+	};
+
+	inline double NowMs()
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// best-of-reps time (ms) of one call of func
+	template<typename Func>
+	double TimeMs(Func func, const int reps = 5)
+	{
+		double best = 1e30;
+		for (int i = 0; i < reps; i++)
+		{
+			double t0 = NowMs();
+			func();
+			best = std::min(best, NowMs() - t0);
+		}
+		return best;
+	}
+
+	// p in [0, 1] of the (unsorted) samples
+	inline double Percentile(std::vector<double> samples, const double p)
+	{
+		if (samples.empty()) return 0;
+		std::sort(samples.begin(), samples.end());
+		size_t idx = (size_t)(p * (samples.size() - 1) + 0.5);
+		return samples[std::min(idx, samples.size() - 1)];
+	}
+
+	// scratch file of the checks, in the temp folder (the working directory may be the source tree)
+	inline std::string TempPath(const std::string& name)
+	{
+		return (std::filesystem::temp_directory_path() / name).string();
+	}
+
+	// the Data folder of the solution holding probe_file, "" when absent : looked up from the working directory,
+	// the folder of the executable and the source folder of the tests, then their parents
+	inline std::string DataDir(const std::string& probe_file)
+	{
+		namespace fs = std::filesystem;
+		std::error_code ec;
+		const fs::path starts[] = { fs::current_path(ec), fs::absolute(fs::path(ExePath()), ec).parent_path(), fs::path(__FILE__).parent_path() };
+		for (fs::path dir : starts)
+		{
+			for (int up = 0; up < 4 && !dir.empty(); up++, dir = dir.parent_path())
+			{
+				if (fs::exists(dir / "Data" / probe_file, ec)) return (dir / "Data").string();
+				if (dir == dir.parent_path()) break;
+			}
+		}
+		return "";
+	}
+
+	// fixed-seed generator, the benchmark inputs are the same on every run
+	struct lcg
+	{
+		unsigned int s;
+		lcg(const unsigned int seed = 7) { s = seed; }
+		unsigned int Next() { s = s * 1103515245u + 12345u; return s >> 8; }
+		// [lo, hi)
+		float Uniform(const float lo, const float hi) { return lo + (hi - lo) * (float)(Next() & 0xffff) / 65536.f; }
+	};
+}
+
+#define KAR_TEST_CONCAT_(A, B) A##B
+#define KAR_TEST_CONCAT(A, B) KAR_TEST_CONCAT_(A, B)
+#define KAR_TEST_DEFINE(NAME, IS_BENCH) \
+	static void NAME(); \
+	static kar_test::test_registrar KAR_TEST_CONCAT(NAME, _registrar)(#NAME, __FILE__, NAME, IS_BENCH); \
+	static void NAME()
+#define KAR_TEST(NAME) KAR_TEST_DEFINE(NAME, false)
+#define KAR_BENCH(NAME) KAR_TEST_DEFINE(NAME, true)
+
+#define KAR_CHECK(EXPR) do { if (!(EXPR)) kar_test::ReportFailure(__FILE__, __LINE__, #EXPR); } while (0)
@@ -0,0 +1,324 @@
+#include "test_util.h"
+#include "../optitrk/trk_replay.h"
+
+#include <string.h>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+// replay backend of optitrk : a synthetic .krec session (track_info serial frames at a fixed rate) served headless in the
+// RECORDED, FAST and STEP modes, and the frame throughput / latency of an UpdateTrackInfo -> render style consumer
+
+using namespace kar_test;
+
+namespace
+{
+	const char* rb_names[4] = { "probe", "tool", "ss_head", "ss_tool_v1" };
+	const int max_mks = 32;
+
+	int NumMarkers(const int f, const int num_mks) { return num_mks - f % 3; }
+	glm::fvec3 MarkerPos(const int f, const int i) { return glm::fvec3(0.01f * i, 0.002f * f, 1.f + 0.001f * (f + i)); }
+	// the rigid body k is detected in every frame but every (k + 2)-th, translated by its frame
+	bool RbDetected(const int f, const int k) { return f % (k + 2) != 0; }
+	glm::fmat4x4 RbMat(const int f, const int k) { return glm::translate(glm::fmat4x4(1.f), glm::fvec3(0.001f * f, 0.1f * k, 0.5f)); }
+
+	// track_info::WriteSerialBuffer layout (kar_helpers.hpp) : magic, version, num_mks, num_lfrms, markers, rigid bodies
+	// headerless : the layout of the frames recorded before the header (num_mks first)
+	void WriteTrkFrame(const int f, const int num_mks, const int num_rbs, const bool headerless, std::vector<char>& buf)
+	{
+		const int n = NumMarkers(f, num_mks);
+		const size_t rb_unit = 100 + sizeof(bool) + sizeof(glm::fmat4x4), mk_unit = sizeof(glm::fvec3) + sizeof(float) + 128 / 8;
+		const size_t header = headerless ? 8 : 16;
+		buf.assign(header + mk_unit * n + rb_unit * num_rbs, 0);
+		int head[4] = { 0x4b52544b, 2, n, num_rbs };
+		memcpy(buf.data(), headerless ? &head[2] : head, header);
+
+		char* mk_buf = &buf[header];
+		for (int i = 0; i < n; i++)
+		{
+			const glm::fvec3 p = MarkerPos(f, i);
+			const float residue = 0.0001f * i;
+			std::bitset<128> cid;
+			cid.set(i);
+			memcpy(&mk_buf[sizeof(glm::fvec3) * i], &p, sizeof(p));
+			memcpy(&mk_buf[sizeof(glm::fvec3) * n + sizeof(float) * i], &residue, sizeof(float));
+			memcpy(&mk_buf[(sizeof(glm::fvec3) + sizeof(float)) * n + 16 * i], &cid, 16);
+		}
+		char* rb_buf = &buf[header + mk_unit * n];
+		for (int k = 0; k < num_rbs; k++)
+		{
+			const glm::fmat4x4 mat = RbMat(f, k);
+			memcpy(&rb_buf[rb_unit * k], rb_names[k], strlen(rb_names[k]));
+			rb_buf[rb_unit * k + 100] = RbDetected(f, k);
+			memcpy(&rb_buf[rb_unit * k + 100 + sizeof(bool)], &mat, sizeof(mat));
+		}
+	}
+
+	// num_frames tracker frames every dt_ms, a small image per frame (the tracking stream is the one replayed)
+	void WriteSession(const std::string& path, const int num_frames, const double dt_ms, const int num_mks, const int num_rbs,
+		const int headerless_from = -1)
+	{
+		session_recorder rec;
+		rec.Start(path, 8, 8, 3, 16);
+		std::vector<char> img(8 * 8 * 3, 0), trk;
+		for (int f = 0; f < num_frames; f++)
+		{
+			WriteTrkFrame(f, num_mks, num_rbs, headerless_from >= 0 && f >= headerless_from, trk);
+			while (!rec.Push(100. + f * dt_ms, 0, img.data(), trk.data(), trk.size())) std::this_thread::yield();
+		}
+		rec.Stop();
+	}
+
+	// the decoded frame against the synthetic one
+	bool FrameMatches(const trk_replay& replay, const int f, const int num_mks, const int num_rbs)
+	{
+		const trk_replay_frame& frame = replay.GetFrame();
+		if (frame.frame_idx != f || (int)frame.rb_names.size() != num_rbs) return false;
+		float xyz[max_mks * 3], residue[max_mks];
+		std::bitset<128> cid[max_mks];
+		const int n = replay.GetMarkers(max_mks, xyz, residue, cid);
+		if (n != NumMarkers(f, num_mks)) return false;
+		for (int i = 0; i < n; i++)
+		{
+			const glm::fvec3 p = MarkerPos(f, i);
+			if (memcmp(&xyz[i * 3], &p, sizeof(p)) != 0 || residue[i] != 0.0001f * i || !cid[i].test(i) || cid[i].count() != 1) return false;
+		}
+		for (int k = 0; k < num_rbs; k++)
+		{
+			glm::fmat4x4 mat(0);
+			std::string name;
+			if (replay.FindRigidBody(rb_names[k]) != k) return false;
+			if (replay.GetRigidBody(k, (float*)&mat, &name) != RbDetected(f, k) || name != rb_names[k]) return false;
+			if (RbDetected(f, k) && mat != RbMat(f, k)) return false;
+		}
+		return true;
+	}
+
+	// UpdateTrackInfo -> render style work on a frame : markers and poses out of the backend, the markers in every rigid body frame
+	float ProcessFrame(const trk_replay& replay)
+	{
+		float xyz[max_mks * 3];
+		const int n = replay.GetMarkers(max_mks, xyz, NULL, NULL);
+		float sum = 0;
+		for (int k = 0; k < (int)replay.GetFrame().rb_names.size(); k++)
+		{
+			glm::fmat4x4 mat;
+			if (!replay.GetRigidBody(k, (float*)&mat, NULL)) continue;
+			const glm::fmat4x4 mat_ws2rb = glm::inverse(mat);
+			for (int i = 0; i < n; i++) sum += (mat_ws2rb * glm::fvec4(xyz[i * 3], xyz[i * 3 + 1], xyz[i * 3 + 2], 1.f)).z;
+		}
+		return sum;
+	}
+}
+
+KAR_TEST(trk_replay_step_mode)
+{
+	const std::string path = TempPath("kar_test_replay_step.krec");
+	const int num_frames = 40, num_mks = 12, num_rbs = 4;
+	WriteSession(path, num_frames, 8.0, num_mks, num_rbs, 30);
+
+	trk_replay replay;
+	KAR_CHECK(replay.Open(path, TRK_REPLAY_STEP));
+	KAR_CHECK(replay.IsOpen() && replay.GetMode() == TRK_REPLAY_STEP && replay.GetNumFrames() == num_frames);
+
+	// before the first step
+	KAR_CHECK(replay.GetCursor() == -1 && !replay.UpdateFrame());
+
+	// every frame in order, the frames from 30 on without the serial header
+	int num_matched = 0;
+	for (int f = 0; f < num_frames; f++)
+	{
+		KAR_CHECK(replay.Step(1) == f);
+		double t_ms = 0;
+		KAR_CHECK(replay.GetCursor(&t_ms) == f && t_ms == 100. + f * 8.0);
+		KAR_CHECK(replay.UpdateFrame());
+		num_matched += FrameMatches(replay, f, num_mks, num_rbs);
+		KAR_CHECK(replay.UpdateFrame() && replay.GetFrame().frame_idx == f); // same cursor, no decoding
+	}
+	KAR_CHECK(num_matched == num_frames);
+
+	// the cursor is clamped to the session
+	KAR_CHECK(replay.Step(1) == num_frames - 1);
+	KAR_CHECK(replay.Step(-1000) == 0);
+	KAR_CHECK(replay.UpdateFrame() && FrameMatches(replay, 0, num_mks, num_rbs));
+	KAR_CHECK(replay.Step(17) == 17 && replay.UpdateFrame() && FrameMatches(replay, 17, num_mks, num_rbs));
+	KAR_CHECK(replay.FindRigidBody("unknown") == -1);
+	replay.Close();
+	KAR_CHECK(!replay.IsOpen() && !replay.UpdateFrame() && replay.GetCursor() == -1);
+
+	// no session, a mode out of range
+	KAR_CHECK(!replay.Open(TempPath("kar_test_missing.krec"), TRK_REPLAY_STEP));
+	KAR_CHECK(!replay.Open(path, TRK_REPLAY_COUNT));
+	remove(path.c_str());
+}
+
+// FAST : the consumer steps as soon as it took a frame, every frame is served once and in order
+KAR_TEST(trk_replay_fast_mode)
+{
+	const std::string path = TempPath("kar_test_replay_fast.krec");
+	const int num_frames = 500, num_mks = 8, num_rbs = 2;
+	WriteSession(path, num_frames, 8.0, num_mks, num_rbs);
+
+	trk_replay replay;
+	KAR_CHECK(replay.Open(path, TRK_REPLAY_FAST));
+	replay.Step(1);
+	int num_served = 0, num_matched = 0;
+	while (replay.UpdateFrame())
+	{
+		num_matched += FrameMatches(replay, num_served, num_mks, num_rbs);
+		num_served++;
+		if (replay.GetCursor() == num_frames - 1) break;
+		replay.Step(1);
+	}
+	KAR_CHECK(num_served == num_frames && num_matched == num_frames);
+	replay.Close();
+	remove(path.c_str());
+}
+
+// RECORDED : the cursor follows the wall clock from the first UpdateFrame, x speed, and never goes back
+KAR_TEST(trk_replay_recorded_timing)
+{
+	const std::string path = TempPath("kar_test_replay_recorded.krec");
+	const int num_frames = 60;
+	const double dt_ms = 10.0, speed = 4.0;
+	WriteSession(path, num_frames, dt_ms, 4, 1);
+
+	trk_replay replay;
+	KAR_CHECK(replay.Open(path, TRK_REPLAY_RECORDED, speed));
+	KAR_CHECK(replay.GetCursor() == -1);
+	KAR_CHECK(replay.Step(5) == -1); // the clock moves the cursor, not Step
+
+	const double t0 = NowMs();
+	int last = -1, num_back = 0, num_early = 0, num_served = 0;
+	while (last < num_frames - 1)
+	{
+		KAR_CHECK(replay.UpdateFrame());
+		const int f = replay.GetFrame().frame_idx;
+		// the frame is due at t0 + f * dt / speed
+		num_early += NowMs() - t0 < f * dt_ms / speed - 1.0;
+		num_back += f < last;
+		num_served += f != last;
+		last = f;
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	const double elapsed = NowMs() - t0;
+	printf("  %d of %d frames served in %.1f ms (recorded %.1f ms at x%.0f)\n", num_served, num_frames, elapsed, (num_frames - 1) * dt_ms,
+		speed);
+	KAR_CHECK(num_back == 0 && num_early == 0);
+	KAR_CHECK(elapsed >= (num_frames - 1) * dt_ms / speed - 1.0);
+	// past the last frame the cursor stays on it
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	KAR_CHECK(replay.UpdateFrame() && replay.GetCursor() == num_frames - 1);
+	replay.Close();
+	remove(path.c_str());
+}
+
+// a tracker thread serving the replay and a render thread processing the newest frame (the prototype loops, headless),
+// in FAST the render thread steps the replay when it took a frame
+// throughput : frames processed per second, latency : from the frame being due (RECORDED) or decoded (FAST) to processed
+// STEP : decode and process on one thread, the cost of a frame through the pipeline
+KAR_BENCH(trk_replay_throughput)
+{
+	const std::string path = TempPath("kar_test_replay_bench.krec");
+	const int num_frames = 2000, num_mks = 24, num_rbs = 4;
+	const double dt_ms = 1000.0 / 120.0;
+	WriteSession(path, num_frames, dt_ms, num_mks, num_rbs);
+
+	printf("  %-22s %8s %8s %10s %10s %10s\n", "mode", "served", "skipped", "frames/s", "p50 ms", "p99 ms");
+	const char* mode_names[TRK_REPLAY_COUNT] = { "recorded (x10)", "fast", "step" };
+	for (int mode = TRK_REPLAY_RECORDED; mode < TRK_REPLAY_COUNT; mode++)
+	{
+		trk_replay replay;
+		const double speed = 10.0;
+		KAR_CHECK(replay.Open(path, (TrkReplayMode)mode, speed));
+
+		std::vector<double> latency;
+		latency.reserve(num_frames);
+		int num_served = 0;
+		volatile float sink = 0;
+		const double t0 = NowMs();
+		if (mode == TRK_REPLAY_STEP)
+		{
+			for (int f = 0; f < num_frames; f++)
+			{
+				const double t_frame = NowMs();
+				replay.Step(1);
+				replay.UpdateFrame();
+				sink = sink + ProcessFrame(replay);
+				latency.push_back(NowMs() - t_frame);
+				num_served++;
+			}
+		}
+		else
+		{
+			// the tracker thread publishes the frame it decoded, the render thread takes the newest one
+			std::mutex frame_lock;
+			trk_replay_frame published;
+			double t_published = 0;
+			std::atomic<bool> done(false);
+			std::thread tracker([&]()
+			{
+				if (mode == TRK_REPLAY_FAST) replay.Step(1);
+				int last = -1;
+				while (last < num_frames - 1)
+				{
+					if (!replay.UpdateFrame() || replay.GetFrame().frame_idx == last)
+					{
+						std::this_thread::yield();
+						continue;
+					}
+					last = replay.GetFrame().frame_idx;
+					{
+						std::lock_guard<std::mutex> lock(frame_lock);
+						published = replay.GetFrame();
+						t_published = mode == TRK_REPLAY_RECORDED ? t0 + (published.t_ms - 100.) / speed : NowMs();
+					}
+				}
+				done = true;
+			});
+
+			int last = -1;
+			trk_replay_frame taken;
+			for (;;)
+			{
+				const bool finished = done;
+				double t_due = 0;
+				{
+					std::lock_guard<std::mutex> lock(frame_lock);
+					if (published.frame_idx != last)
+					{
+						taken = published;
+						t_due = t_published;
+					}
+				}
+				if (taken.frame_idx != last)
+				{
+					last = taken.frame_idx;
+					if (mode == TRK_REPLAY_FAST) replay.Step(1); // StepReplay of the consumer, the tracker decodes the next frame meanwhile
+					float sum = 0;
+					for (int k = 0; k < (int)taken.rb_names.size(); k++)
+					{
+						if (!taken.rb_detected[k]) continue;
+						const glm::fmat4x4 mat_ws2rb = glm::inverse(*(const glm::fmat4x4*)&taken.rb_mats[k * 16]);
+						for (size_t i = 0; i < taken.mk_residue.size(); i++)
+							sum += (mat_ws2rb * glm::fvec4(taken.mk_xyz[i * 3], taken.mk_xyz[i * 3 + 1], taken.mk_xyz[i * 3 + 2], 1.f)).z;
+					}
+					sink = sink + sum;
+					latency.push_back(NowMs() - t_due);
+					num_served++;
+				}
+				else if (finished) break;
+				else std::this_thread::yield();
+			}
+			tracker.join();
+		}
+		const double elapsed = NowMs() - t0;
+		printf("  %-22s %8d %8d %10.0f %10.3f %10.3f\n", mode_names[mode], num_served, num_frames - num_served, num_served / elapsed * 1000.0,
+			Percentile(latency, 0.5), Percentile(latency, 0.99));
+		KAR_CHECK(num_served > 0 && replay.GetCursor() == num_frames - 1);
+		if (mode != TRK_REPLAY_RECORDED) KAR_CHECK(num_served == num_frames);
+	}
+	remove(path.c_str());
+}
@@ -0,0 +1,219 @@
+#include "test_util.h"
+
+#include "../ar_settings/ViewGraph.h"
+
+#include <string.h>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <mutex>
+
+// view scheduler of ViewGraph.cpp with a mock backend : the stages fill, convert and "show" plain buffers (no vzm, no window)
+
+using namespace kar_test;
+
+namespace
+{
+	// busy work of a stage, roughly us microseconds
+	void spin_us(const double us)
+	{
+		const double t_end = NowMs() + us * 1e-3;
+		while (NowMs() < t_end) {}
+	}
+
+	// mock of a rendered view : Render fills an RGBA buffer from the frame counter (the engine),
+	// Process converts it to BGR (the compositing), Present checks and records the result (imshow)
+	struct mock_view
+	{
+		int idx, w, h;
+		double render_us, process_us;
+		bool render_result;
+
+		std::vector<unsigned char> rgba, bgr;
+		int frame_value;	// written by Render, read by Process and Present
+		int num_render, num_process, num_present, num_bad_present;
+		std::thread::id caller, render_thread, present_thread;
+		std::atomic<int> num_process_off_caller;
+
+		mock_view(const int _idx, const int _w, const int _h)
+		{
+			idx = _idx; w = _w; h = _h;
+			render_us = process_us = 0;
+			render_result = true;
+			rgba.resize((size_t)w * h * 4);
+			bgr.resize((size_t)w * h * 3);
+			frame_value = 0;
+			num_render = num_process = num_present = num_bad_present = 0;
+			num_process_off_caller = 0;
+			caller = std::this_thread::get_id();
+		}
+
+		view_node Node(const int inputs, int* frame_counter, std::vector<int>* present_order, std::mutex* present_lock)
+		{
+			view_node node;
+			node.name = "mock " + std::to_string(idx);
+			node.inputs = inputs;
+			node.Render = [this, frame_counter]() {
+				render_thread = std::this_thread::get_id();
+				num_render++;
+				if (!render_result) return false;
+				frame_value = *frame_counter;
+				memset(&rgba[0], (frame_value + idx) & 0xff, rgba.size());
+				spin_us(render_us);
+				return true;
+			};
+			node.Process = [this]() {
+				if (std::this_thread::get_id() != caller) num_process_off_caller++;
+				num_process++;
+				for (size_t p = 0; p < (size_t)w * h; p++)
+				{
+					bgr[p * 3 + 0] = rgba[p * 4 + 2];
+					bgr[p * 3 + 1] = rgba[p * 4 + 1];
+					bgr[p * 3 + 2] = rgba[p * 4 + 0];
+				}
+				spin_us(process_us);
+			};
+			node.Present = [this, present_order, present_lock]() {
+				present_thread = std::this_thread::get_id();
+				num_present++;
+				// the processed buffer of this frame's render, not of an older one
+				const unsigned char v = (unsigned char)((frame_value + idx) & 0xff);
+				if (bgr[0] != v || bgr[bgr.size() - 1] != v) num_bad_present++;
+				std::lock_guard<std::mutex> lock(*present_lock);
+				present_order->push_back(idx);
+			};
+			return node;
+		}
+	};
+}
+
+KAR_TEST(view_graph_headless_frames)
+{
+	const int num_views = 4, num_frames = 12;
+	const int inputs[num_views] = { VG_IN_TRACK | VG_IN_IMAGE, VG_IN_IMAGE, VG_IN_MODEL, VG_IN_TOUCH | VG_IN_MODEL };
+	int frame_counter = 0;
+	std::vector<int> present_order;
+	std::mutex present_lock;
+
+	view_graph graph(2);
+	std::vector<std::unique_ptr<mock_view>> mocks;
+	for (int i = 0; i < num_views; i++)
+	{
+		mocks.push_back(std::unique_ptr<mock_view>(new mock_view(i, 64 + 16 * i, 48)));
+		mocks[i]->render_us = 200;
+		mocks[i]->process_us = 400;
+		KAR_CHECK(graph.AddView(mocks[i]->Node(inputs[i], &frame_counter, &present_order, &present_lock)) == i);
+	}
+
+	// the image changes every frame, the model every 4th frame, the touch input never (after the first run)
+	int expected_runs[num_views] = { 0 };
+	for (int f = 0; f < num_frames; f++)
+	{
+		frame_counter = f + 1;
+		graph.SetInput(VG_IN_TRACK, 1);
+		graph.SetInput(VG_IN_IMAGE, f + 1);
+		graph.SetInput(VG_IN_MODEL, 1 + f / 4);
+		graph.SetInput(VG_IN_TOUCH, 7);
+		const bool model_changed = f % 4 == 0;
+		for (int i = 0; i < num_views; i++) KAR_CHECK(graph.IsDirty(i) == (i < 2 || model_changed));
+
+		present_order.clear();
+		const int num_run = graph.Execute();
+		KAR_CHECK(num_run == (model_changed ? 4 : 2));
+		for (int i = 0; i < num_views; i++)
+		{
+			if (i < 2 || model_changed) expected_runs[i]++;
+			KAR_CHECK(!graph.IsDirty(i));
+		}
+
+		// presented in the view order, once per run view
+		KAR_CHECK((int)present_order.size() == num_run);
+		for (int k = 1; k < (int)present_order.size(); k++) KAR_CHECK(present_order[k - 1] < present_order[k]);
+	}
+
+	const std::thread::id caller = std::this_thread::get_id();
+	for (int i = 0; i < num_views; i++)
+	{
+		const mock_view& m = *mocks[i];
+		KAR_CHECK(m.num_render == expected_runs[i]);
+		KAR_CHECK(m.num_process == expected_runs[i]);
+		KAR_CHECK(m.num_present == expected_runs[i]);
+		KAR_CHECK(m.num_bad_present == 0);
+		// render and present on the caller, process on the pool
+		KAR_CHECK(m.render_thread == caller && m.present_thread == caller);
+		KAR_CHECK(m.num_process_off_caller == m.num_process);
+	}
+
+	// an invalidated view runs whatever its inputs, a view whose Render fails is neither processed nor presented
+	graph.Invalidate(2);
+	mocks[2]->render_result = false;
+	present_order.clear();
+	KAR_CHECK(graph.Execute() == 1);
+	KAR_CHECK(mocks[2]->num_render == expected_runs[2] + 1);
+	KAR_CHECK(mocks[2]->num_process == expected_runs[2]);
+	KAR_CHECK(present_order.empty());
+
+	const view_graph_stats stats = graph.GetStats(true);
+	KAR_CHECK(stats.frames == num_frames + 1);
+	KAR_CHECK(stats.views_run + stats.views_skipped == (num_frames + 1) * num_views);
+	KAR_CHECK(graph.GetStats().frames == 0);
+}
+
+KAR_TEST(view_graph_no_workers)
+{
+	int frame_counter = 1;
+	std::vector<int> present_order;
+	std::mutex present_lock;
+	view_graph graph(0);
+	mock_view a(0, 32, 32), b(1, 32, 32);
+	graph.AddView(a.Node(VG_IN_IMAGE, &frame_counter, &present_order, &present_lock));
+	graph.AddView(b.Node(VG_IN_IMAGE, &frame_counter, &present_order, &present_lock));
+	for (int f = 0; f < 3; f++)
+	{
+		frame_counter = f + 1;
+		graph.SetInput(VG_IN_IMAGE, f + 1);
+		KAR_CHECK(graph.Execute() == 2);
+	}
+	KAR_CHECK(a.num_present == 3 && b.num_present == 3);
+	KAR_CHECK(a.num_bad_present == 0 && b.num_bad_present == 0);
+	KAR_CHECK(a.num_process_off_caller == 0 && b.num_process_off_caller == 0);
+	KAR_CHECK(present_order.size() == 6);
+}
+
+KAR_BENCH(view_graph_overlap)
+{
+	// the three views of ArSettings (ws, rs, stg) with render and process costs of the same order
+	const int num_views = 3, num_frames = 60;
+	printf("  %7s | %9s %9s\n", "workers", "ms/frame", "p95");
+	double ms_serial = 0;
+	for (int num_workers = 0; num_workers <= 2; num_workers++)
+	{
+		int frame_counter = 0;
+		std::vector<int> present_order;
+		std::mutex present_lock;
+		view_graph graph(num_workers);
+		std::vector<std::unique_ptr<mock_view>> mocks;
+		for (int i = 0; i < num_views; i++)
+		{
+			mocks.push_back(std::unique_ptr<mock_view>(new mock_view(i, 640, 360)));
+			mocks[i]->render_us = 1500;
+			mocks[i]->process_us = 1500;
+			graph.AddView(mocks[i]->Node(VG_IN_IMAGE, &frame_counter, &present_order, &present_lock));
+		}
+		std::vector<double> ms;
+		for (int f = 0; f < num_frames; f++)
+		{
+			frame_counter = f + 1;
+			graph.SetInput(VG_IN_IMAGE, f + 1);
+			const double t0 = NowMs();
+			graph.Execute();
+			ms.push_back(NowMs() - t0);
+		}
+		const double med = Percentile(ms, 0.5);
+		if (num_workers == 0) ms_serial = med;
+		printf("  %7d | %9.3f %9.3f\n", num_workers, med, Percentile(ms, 0.95));
+		for (int i = 0; i < num_views; i++) KAR_CHECK(mocks[i]->num_bad_present == 0);
+		// the processing overlaps the rendering of the next views (the stages spin, one core runs them in turn)
+		if (num_workers > 0 && std::thread::hardware_concurrency() > 1) KAR_CHECK(med < ms_serial);
+	}
+}